@@ -0,0 +1,174 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "OSegCacheReplayBenchmark.hpp"
+#include <sirikata/space/ShardedOSegCache.hpp>
+#include <sirikata/core/options/Options.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <boost/thread.hpp>
+#include <fstream>
+#include <cmath>
+
+#define REPLAY_LOG(lvl,msg) SILOG(benchmark, lvl, msg)
+
+namespace Sirikata {
+
+namespace {
+// Number of servers objects are spread over in synthetic traces
+const uint32 SYNTHETIC_SERVERS = 16;
+}
+
+OSegCacheReplayBenchmark::OSegCacheReplayBenchmark(const FinishedCallback& finished_cb, const String& param)
+ : Benchmark(finished_cb),
+   mForceStop(false)
+{
+    OptionValue* trace;
+    OptionValue* capacity;
+    OptionValue* shards;
+    OptionValue* threads;
+    OptionValue* objects;
+    OptionValue* lookups;
+    OptionValue* skew;
+    Sirikata::InitializeClassOptions ico("OSegCacheReplayBenchmark",this,
+        trace=new OptionValue("trace","",Sirikata::OptionValueType<String>(),"File containing the lookup trace to replay, one object UUID (and optionally server ID) per line. If empty, a synthetic trace is used."),
+        capacity=new OptionValue("capacity","10000",Sirikata::OptionValueType<uint32>(),"Maximum number of entries in the cache"),
+        shards=new OptionValue("shards","16",Sirikata::OptionValueType<uint32>(),"Number of cache shards"),
+        threads=new OptionValue("threads","1",Sirikata::OptionValueType<uint32>(),"Number of threads replaying the trace concurrently"),
+        objects=new OptionValue("objects","100000",Sirikata::OptionValueType<uint32>(),"Number of distinct objects in the synthetic trace"),
+        lookups=new OptionValue("lookups","2000000",Sirikata::OptionValueType<uint32>(),"Number of lookups in the synthetic trace"),
+        skew=new OptionValue("skew","0.9",Sirikata::OptionValueType<double>(),"Zipf exponent for object popularity in the synthetic trace"),
+        NULL);
+
+    OptionSet* optionsSet = OptionSet::getOptions("OSegCacheReplayBenchmark",this);
+    optionsSet->parse(param);
+
+    mTraceFile = trace->as<String>();
+    mCapacity = capacity->as<uint32>();
+    mShards = shards->as<uint32>();
+    mThreads = std::max(threads->as<uint32>(), (uint32)1);
+    mObjects = std::max(objects->as<uint32>(), (uint32)1);
+    mLookups = lookups->as<uint32>();
+    mSkew = skew->as<double>();
+}
+
+String OSegCacheReplayBenchmark::name() {
+    return "oseg-cache-replay";
+}
+
+bool OSegCacheReplayBenchmark::loadTrace() {
+    std::ifstream fp(mTraceFile.c_str());
+    if (!fp) {
+        REPLAY_LOG(error, "Couldn't open trace file " << mTraceFile);
+        return false;
+    }
+
+    String line;
+    while(std::getline(fp, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        String id_str;
+        Lookup lookup;
+        lookup.server = 0;
+        iss >> id_str >> lookup.server;
+        lookup.id = UUID(id_str, UUID::HumanReadable());
+        if (lookup.server == 0)
+            lookup.server = (lookup.id.hash() % SYNTHETIC_SERVERS) + 1;
+        mTrace.push_back(lookup);
+    }
+    return true;
+}
+
+void OSegCacheReplayBenchmark::generateTrace() {
+    std::vector<UUID> ids;
+    ids.reserve(mObjects);
+    for(uint32 i = 0; i < mObjects; i++)
+        ids.push_back(UUID::random());
+
+    // Cumulative distribution for Zipf popularity
+    std::vector<double> cdf(mObjects);
+    double total = 0;
+    for(uint32 i = 0; i < mObjects; i++) {
+        total += 1.0 / std::pow((double)(i+1), mSkew);
+        cdf[i] = total;
+    }
+
+    // Fixed seed so runs are comparable
+    uint64 rng = 0x2545f4914f6cdd1dULL;
+    mTrace.reserve(mLookups);
+    for(uint32 i = 0; i < mLookups; i++) {
+        rng ^= rng >> 12; rng ^= rng << 25; rng ^= rng >> 27;
+        double r = (double)((rng * 0x2545f4914f6cdd1dULL) >> 11) / (double)(1ULL << 53) * total;
+        uint32 idx = std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin();
+        if (idx >= mObjects) idx = mObjects - 1;
+
+        Lookup lookup;
+        lookup.id = ids[idx];
+        lookup.server = (idx % SYNTHETIC_SERVERS) + 1;
+        mTrace.push_back(lookup);
+    }
+}
+
+void OSegCacheReplayBenchmark::replay(ShardedOSegCache* cache, uint32 offset, uint32 stride) {
+    for(uint32 i = offset; i < mTrace.size() && !mForceStop; i += stride) {
+        const Lookup& lookup = mTrace[i];
+        if (cache->get(lookup.id).isNull())
+            cache->insert(lookup.id, OSegEntry(lookup.server, 1.f));
+    }
+}
+
+void OSegCacheReplayBenchmark::start() {
+    mForceStop = false;
+
+    if (!mTraceFile.empty()) {
+        if (!loadTrace()) {
+            notifyFinished();
+            return;
+        }
+    }
+    else {
+        generateTrace();
+    }
+
+    // No context is needed since entries never expire during the replay
+    ShardedOSegCache cache(NULL, mCapacity, mShards, Duration::zero());
+
+    Time start_time = Timer::now();
+    if (mThreads == 1) {
+        replay(&cache, 0, 1);
+    }
+    else {
+        boost::thread_group threads;
+        for(uint32 i = 0; i < mThreads; i++)
+            threads.create_thread(std::tr1::bind(&OSegCacheReplayBenchmark::replay, this, &cache, i, mThreads));
+        threads.join_all();
+    }
+    Time end_time = Timer::now();
+
+    if (mForceStop) {
+        REPLAY_LOG(info, "Replay stopped before the trace finished");
+        notifyFinished();
+        return;
+    }
+
+    Duration dur = end_time - start_time;
+    ShardedOSegCache::Stats stats = cache.stats();
+    uint64 nlookups = stats.hits + stats.misses;
+    REPLAY_LOG(info,
+        nlookups << " lookups with " << mThreads << " threads, " << dur << ": "
+        << (dur.toMicroseconds()*1000/double(nlookups)) << "ns/lookup, "
+        << double(nlookups)/dur.toSeconds() << " lookups/s");
+    REPLAY_LOG(info,
+        "hit rate " << (nlookups > 0 ? double(stats.hits)/nlookups : 0) << ", "
+        << stats.evictions << " evictions, " << stats.rejections << " rejected inserts, "
+        << cache.size() << " entries");
+
+    notifyFinished();
+}
+
+void OSegCacheReplayBenchmark::stop() {
+    mForceStop = true;
+}
+
+} // namespace Sirikata
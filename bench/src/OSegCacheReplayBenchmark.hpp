@@ -0,0 +1,66 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OSEG_CACHE_REPLAY_BENCHMARK_HPP_
+#define _SIRIKATA_OSEG_CACHE_REPLAY_BENCHMARK_HPP_
+
+#include "Benchmark.hpp"
+#include <sirikata/core/util/UUID.hpp>
+
+namespace Sirikata {
+
+class ShardedOSegCache;
+
+/** OSegCacheReplayBenchmark replays a sequence of OSeg lookups against the
+ *  sharded OSeg cache, inserting an entry after each miss just as the OSeg
+ *  does when a lookup completes, and reports the hit rate and throughput.
+ *
+ *  The trace is a text file with one object UUID per line, optionally
+ *  followed by the server the object lives on. If no trace is given, a
+ *  synthetic trace with Zipf distributed popularity is generated. With
+ *  multiple threads, each thread replays an interleaved share of the trace
+ *  to measure lock contention.
+ */
+class OSegCacheReplayBenchmark : public Benchmark {
+  public:
+    typedef std::tr1::function<void()> FinishedCallback;
+
+    static Benchmark* create(const FinishedCallback& finished_cb, const String& param) {
+        return new OSegCacheReplayBenchmark(finished_cb, param);
+    }
+
+    OSegCacheReplayBenchmark(const FinishedCallback& finished_cb, const String& param);
+
+    virtual String name();
+
+    virtual void start();
+    virtual void stop();
+
+  private:
+    struct Lookup {
+        UUID id;
+        uint32 server;
+    };
+    typedef std::vector<Lookup> LookupTrace;
+
+    bool loadTrace();
+    void generateTrace();
+    void replay(ShardedOSegCache* cache, uint32 offset, uint32 stride);
+
+    bool mForceStop;
+
+    String mTraceFile;
+    uint32 mCapacity;
+    uint32 mShards;
+    uint32 mThreads;
+    uint32 mObjects;
+    uint32 mLookups;
+    double mSkew;
+
+    LookupTrace mTrace;
+}; // class OSegCacheReplayBenchmark
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OSEG_CACHE_REPLAY_BENCHMARK_HPP_
@@ -36,6 +36,7 @@
 #include "TimerJitterBenchmark.hpp"
 #include "TimerMonotonicityBenchmark.hpp"
 #include "TCPSSTBenchmark.hpp"
+#include "OSegCacheReplayBenchmark.hpp"
 
 #include <sirikata/core/util/DynamicLibrary.hpp>
 
@@ -67,6 +68,8 @@ int main(int argc, char** argv) {
     ADD_BENCHMARK(timer-monotonicity, TimerMonotonicityBenchmark::create);
 
     ADD_BENCHMARK(ping, SSTBenchmark::create);
+
+    ADD_BENCHMARK(oseg-cache-replay, OSegCacheReplayBenchmark::create);
     BenchmarkRunner runner(factory, Duration::seconds(30.f));
 
 
@@ -80,6 +80,19 @@ String sha1(void* data, size_t len) {
   return retval;
 }
 
+static RegionLoad regionLoadFromReport(const Sirikata::Protocol::CSeg::LoadReportMessage& message) {
+  RegionLoad load;
+
+  load.objectCount = message.has_object_count() ? message.object_count() : message.load_value();
+  load.messageRate = message.message_rate();
+  for (int i = 0; i < message.x_histogram_size(); i++)
+    load.histogram[0].push_back(message.x_histogram(i));
+  for (int i = 0; i < message.y_histogram_size(); i++)
+    load.histogram[1].push_back(message.y_histogram(i));
+
+  return load;
+}
+
 static String sha1_bbox(const BoundingBox3f& bb) {
     char buf[24];
     *((float32*)buf) = bb.min().x;
@@ -225,6 +238,8 @@ DistributedCoordinateSegmentation::DistributedCoordinateSegmentation(CSegContext
   int numLLTreesSoFar = 0;
   generateHierarchicalTrees(&mTopLevelRegion, 1, numLLTreesSoFar);
 
+  rebuildFlatTree();
+
   /* Upper tree servers: start listening for requests! */
   if ((int)ctx->id() <= mUpperTreeCSEGServers) {
       mAcceptor = boost::shared_ptr<tcp::acceptor>(
@@ -391,6 +406,14 @@ bool DistributedCoordinateSegmentation::handleLookup(Vector3f pos, boost::shared
   (searchVec.x < region.min().x) ? searchVec.x = region.min().x : (i=0);
   (searchVec.y < region.min().y) ? searchVec.y = region.min().y : (i=0);
 
+  /* The flattened tree answers everything handled by local subtrees without
+     walking the pointer based trees. */
+  sid = mFlatTree.lookup(searchVec, &server_bbox);
+  if (sid != NullServerID) {
+    writeLookupResponse(socket, server_bbox, sid);
+    return true;
+  }
+
   const SegmentedRegion* segRegion = mTopLevelRegion.lookup(searchVec);
   ServerID topLevelIdx = segRegion->mServer;
 
@@ -516,7 +539,7 @@ void DistributedCoordinateSegmentation::handleLoadReport(boost::shared_ptr<tcp::
       if (sid == segRegion->mServer && bbox == segRegion->mBoundingBox) {
         segRegion->mLoadValue = message->load_value();
 
-        mLoadBalancer.reportRegionLoad(segRegion, sid, segRegion->mLoadValue);
+        mLoadBalancer.reportRegionLoad(segRegion, sid, regionLoadFromReport(*message));
       }
     }
     else {
@@ -528,7 +551,7 @@ void DistributedCoordinateSegmentation::handleLoadReport(boost::shared_ptr<tcp::
         // deal with the value for this region's load.
         if (sid == segRegion->mServer && bbox == segRegion->mBoundingBox) {
           segRegion->mLoadValue = message->load_value();
-          mLoadBalancer.reportRegionLoad(segRegion, sid, segRegion->mLoadValue);
+          mLoadBalancer.reportRegionLoad(segRegion, sid, regionLoadFromReport(*message));
         }
       }
       else {
@@ -600,7 +623,8 @@ void DistributedCoordinateSegmentation::poll() {
 void DistributedCoordinateSegmentation::service() {
   boost::unique_lock<boost::shared_mutex> lock(mCSEGReadWriteMutex);
 
-  mLoadBalancer.service();
+  if (mLoadBalancer.service())
+    rebuildFlatTree();
 }
 
 void DistributedCoordinateSegmentation::notifySpaceServersOfChange(const std::vector<SegmentationInfo> segInfoVector)
@@ -627,6 +651,14 @@ void DistributedCoordinateSegmentation::notifySpaceServersOfChange(const std::ve
     }
   }
 
+  /* Include the whole tree as this server knows it so space servers can
+     answer lookups locally. */
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mCSEGReadWriteMutex);
+    if (!mFlatTree.empty())
+      csegMessage.mutable_change_message().set_bsp_tree(mFlatTree.serialize());
+  }
+
   /* Send to CSEG servers connected to this server.  */
   sendToAllCSEGServers(csegMessage);
 
@@ -639,32 +671,29 @@ void DistributedCoordinateSegmentation::notifySpaceServersOfChange(const std::ve
 void DistributedCoordinateSegmentation::csegChangeMessage(Sirikata::Protocol::CSeg::ChangeMessage* ccMsg) {
 }
 
-void DistributedCoordinateSegmentation::serializeBSPTree(SerializedBSPTree* serializedBSPTree) {
-  boost::shared_lock<boost::shared_mutex> mCSEGExclusiveWriteLock(mCSEGReadWriteMutex);
+const SegmentedRegion* DistributedCoordinateSegmentation::resolveSubtree(const SegmentedRegion* leaf) {
+  if (leaf->mServer != mContext->id())
+    return NULL;
 
-  uint32 idx = 0;
-  traverseAndStoreTree(&mTopLevelRegion, idx, serializedBSPTree);
-}
+  String bbox_hash = sha1_bbox(leaf->mBoundingBox);
 
-void DistributedCoordinateSegmentation::traverseAndStoreTree(SegmentedRegion* region, uint32& idx,
-							     SerializedBSPTree* serializedTree)
-{
-  uint32 localIdx = idx;
-  serializedTree->mSegmentedRegions[localIdx].mServerID = region->mServer;
-  serializedTree->mSegmentedRegions[localIdx].mLeafCount = region->mLeafCount;
-  serializedTree->mSegmentedRegions[localIdx].mBoundingBox.serialize(region->mBoundingBox);
+  std::map<String, SegmentedRegion*>::const_iterator it = mHigherLevelTrees.find(bbox_hash);
+  if (it != mHigherLevelTrees.end())
+    return it->second;
 
-  // std::cout << "at index " << localIdx  <<" bbox=" << region->mBoundingBox << "\n";
+  it = mLowerLevelTrees.find(bbox_hash);
+  if (it != mLowerLevelTrees.end())
+    return it->second;
 
-  if (region->mLeftChild != NULL) {
-    serializedTree->mSegmentedRegions[localIdx].mLeftChildIdx = idx+1;
-    traverseAndStoreTree(region->mLeftChild, ++idx, serializedTree);
-  }
+  return NULL;
+}
 
-  if (region->mRightChild != NULL) {
-    serializedTree->mSegmentedRegions[localIdx].mRightChildIdx = idx+1;
-    traverseAndStoreTree(region->mRightChild, ++idx, serializedTree);
-  }
+/* Must be called with mCSEGReadWriteMutex held exclusively. */
+void DistributedCoordinateSegmentation::rebuildFlatTree() {
+  FlatBSPTree tree(&mTopLevelRegion,
+                   std::tr1::bind(&DistributedCoordinateSegmentation::resolveSubtree, this,
+                                  std::tr1::placeholders::_1));
+  mFlatTree.swap(tree);
 }
 
 void DistributedCoordinateSegmentation::accept_handler()
@@ -863,7 +892,8 @@ void DistributedCoordinateSegmentation::asyncLLRead(boost::shared_ptr<tcp::socke
         //deal with the load from the space server
         segRegion->mLoadValue = csegMessage.ll_load_report_message().load_report_message().load_value();
 
-        mLoadBalancer.reportRegionLoad(segRegion, segRegion->mServer, segRegion->mLoadValue);
+        mLoadBalancer.reportRegionLoad(segRegion, segRegion->mServer,
+                                       regionLoadFromReport(csegMessage.ll_load_report_message().load_report_message()));
       }
     }
     else {
@@ -45,6 +45,7 @@
 #include <sirikata/core/queue/SizedThreadSafeQueue.hpp>
 #include <sirikata/core/service/PollingService.hpp>
 #include <sirikata/space/SegmentedRegion.hpp>
+#include <sirikata/space/FlatBSPTree.hpp>
 #include <sirikata/core/network/Address4.hpp>
 #include <sirikata/core/options/CommonOptions.hpp>
 #include <sirikata/core/network/Message.hpp>
@@ -113,6 +114,11 @@ public:
 
     void handleSelfLookup(ServerID my_sid, Address4 my_addr);
 
+    /* Does the initial kd-tree partitioning of the virtual world into regions. */
+    static void subdivideTopLevelRegion(SegmentedRegion* region,
+                                        Vector3ui32 perdim,
+                                        int& numServersAssigned);
+
 private:
     void service();
 
@@ -139,6 +145,11 @@ private:
     std::map<String, SegmentedRegion*> mHigherLevelTrees;
     std::map<String, SegmentedRegion*> mLowerLevelTrees;
 
+    /* Flattened copy of the top level tree with all the subtrees this server
+       knows about grafted in. Rebuilt whenever the segmentation changes, with
+       mCSEGReadWriteMutex held exclusively. */
+    FlatBSPTree mFlatTree;
+
     int mAvailableCSEGServers;
     int mUpperTreeCSEGServers;
 
@@ -158,9 +169,6 @@ private:
       divide the kd-tree into upper and lower trees.
    */
     void generateHierarchicalTrees(SegmentedRegion* region, int depth, int& numLLTreesSoFar);
-    void subdivideTopLevelRegion(SegmentedRegion* region,
-				 Vector3ui32 perdim,
-				 int& numServersAssigned);
 
 
 
@@ -224,10 +232,9 @@ private:
     void readCSEGMessage(boost::shared_ptr<tcp::socket> socket,
                          Sirikata::Protocol::CSeg::CSegMessage& csegMessage);
 
-    /* Functions to serialize the whole CSEG tree. */
-    void serializeBSPTree(SerializedBSPTree* serializedBSPTree);
-    void traverseAndStoreTree(SegmentedRegion* region, uint32& idx,
-			      SerializedBSPTree* serializedTree);
+    /* Functions to maintain the flattened CSEG tree. */
+    void rebuildFlatTree();
+    const SegmentedRegion* resolveSubtree(const SegmentedRegion* leaf);
 
 
 
@@ -0,0 +1,413 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LoadBalancePlanner.hpp"
+
+namespace Sirikata {
+
+namespace {
+
+bool isLeaf(const SegmentedRegion* region) {
+  return (region->mLeftChild == NULL && region->mRightChild == NULL);
+}
+
+// Orders regions by position so that planning never depends on the order of
+// pointers in a LoadMap, which keeps simulations repeatable.
+bool regionBefore(const SegmentedRegion* a, const SegmentedRegion* b) {
+  const Vector3f& amin = a->mBoundingBox.min();
+  const Vector3f& bmin = b->mBoundingBox.min();
+  if (amin.x != bmin.x) return amin.x < bmin.x;
+  if (amin.y != bmin.y) return amin.y < bmin.y;
+  if (amin.z != bmin.z) return amin.z < bmin.z;
+  return a->mServer < b->mServer;
+}
+
+struct MergeCandidate {
+  SegmentedRegion* parent;
+  float combinedLoad;
+  uint32 migrations;
+  bool keepLeft;
+};
+
+bool mergeCandidateBefore(const MergeCandidate& a, const MergeCandidate& b) {
+  if (a.migrations != b.migrations) return a.migrations < b.migrations;
+  if (a.combinedLoad != b.combinedLoad) return a.combinedLoad < b.combinedLoad;
+  return regionBefore(a.parent, b.parent);
+}
+
+} // namespace
+
+LoadBalancePlanner::Parameters::Parameters()
+ : policy(POLICY_PLANNED),
+   splitLoad(2000),
+   mergeLoad(100),
+   splitTarget(0.75f),
+   messageWeight(0),
+   maxActions(4),
+   maxMigrations(0)
+{
+}
+
+LoadBalancePlanner::LoadBalancePlanner(const Parameters& params)
+ : mParams(params)
+{
+  if (mParams.policy == POLICY_THRESHOLD)
+    mParams.maxActions = 1;
+}
+
+float LoadBalancePlanner::load(const RegionLoad& rl) const {
+  return rl.objectCount + mParams.messageWeight * rl.messageRate;
+}
+
+void LoadBalancePlanner::run(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out) {
+  std::vector<Action> actions;
+  uint32 migrations_used = 0;
+
+  if (mParams.policy == POLICY_THRESHOLD) {
+    // Splitting takes priority and merges only happen in otherwise idle
+    // rounds, as in the original load balancer.
+    planSplits(loads, available, &actions, &migrations_used);
+    if (actions.empty())
+      planMerges(loads, available, &actions, &migrations_used);
+  }
+  else {
+    // Merging first frees up servers for the splits.
+    planMerges(loads, available, &actions, &migrations_used);
+    planSplits(loads, available, &actions, &migrations_used);
+  }
+
+  actions_out->insert(actions_out->end(), actions.begin(), actions.end());
+}
+
+bool LoadBalancePlanner::withinBudget(uint32 migrations, uint32 migrations_used, const std::vector<Action>& actions) const {
+  if (mParams.maxMigrations == 0 || actions.empty())
+    return true;
+  return (migrations_used + migrations <= mParams.maxMigrations);
+}
+
+void LoadBalancePlanner::planMerges(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out,
+                                    uint32* migrations_used)
+{
+  std::vector<MergeCandidate> candidates;
+
+  for (LoadMap::iterator it = loads->begin(); it != loads->end(); it++) {
+    SegmentedRegion* left = it->first;
+    SegmentedRegion* parent = left->mParent;
+    // Only look at each pair once, from the left child
+    if (parent == NULL || parent->mLeftChild != left || it->second.estimated)
+      continue;
+
+    SegmentedRegion* right = parent->mRightChild;
+    if (right == NULL || !isLeaf(left) || !isLeaf(right))
+      continue;
+
+    LoadMap::iterator right_it = loads->find(right);
+    if (right_it == loads->end() || right_it->second.estimated)
+      continue;
+
+    MergeCandidate candidate;
+    candidate.parent = parent;
+    candidate.combinedLoad = load(it->second) + load(right_it->second);
+    if (candidate.combinedLoad >= mParams.mergeLoad)
+      continue;
+
+    // Keep whichever server already has more of the objects, unless we're
+    // emulating the original policy, which always kept the left server.
+    uint32 left_objects = it->second.objectCount;
+    uint32 right_objects = right_it->second.objectCount;
+    candidate.keepLeft = (mParams.policy == POLICY_THRESHOLD || left_objects >= right_objects);
+    candidate.migrations = candidate.keepLeft ? right_objects : left_objects;
+
+    candidates.push_back(candidate);
+  }
+
+  std::sort(candidates.begin(), candidates.end(), mergeCandidateBefore);
+
+  for (std::vector<MergeCandidate>::iterator it = candidates.begin(); it != candidates.end(); it++) {
+    if (actions_out->size() >= mParams.maxActions)
+      break;
+    if (!withinBudget(it->migrations, *migrations_used, *actions_out))
+      continue;
+
+    SegmentedRegion* parent = it->parent;
+    SegmentedRegion* left = parent->mLeftChild;
+    SegmentedRegion* right = parent->mRightChild;
+
+    Action action;
+    action.type = Action::MERGE;
+    action.region = parent;
+    action.kept = it->keepLeft ? left->mServer : right->mServer;
+    action.other = it->keepLeft ? right->mServer : left->mServer;
+    action.axis = 0;
+    action.position = 0;
+    action.migrations = it->migrations;
+
+    const RegionLoad& left_load = (*loads)[left];
+    const RegionLoad& right_load = (*loads)[right];
+    RegionLoad merged;
+    merged.objectCount = left_load.objectCount + right_load.objectCount;
+    merged.messageRate = left_load.messageRate + right_load.messageRate;
+    merged.estimated = true;
+
+    loads->erase(left);
+    loads->erase(right);
+    (*loads)[parent] = merged;
+
+    parent->mServer = action.kept;
+    delete left;
+    delete right;
+    parent->mLeftChild = NULL;
+    parent->mRightChild = NULL;
+
+    available->push_back(action.other);
+    *migrations_used += action.migrations;
+    actions_out->push_back(action);
+  }
+}
+
+void LoadBalancePlanner::planSplits(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out,
+                                    uint32* migrations_used)
+{
+  std::vector<SegmentedRegion*> work;
+  for (LoadMap::iterator it = loads->begin(); it != loads->end(); it++) {
+    if (!it->second.estimated && isLeaf(it->first) && load(it->second) > mParams.splitLoad)
+      work.push_back(it->first);
+  }
+
+  while (!work.empty()) {
+    if (actions_out->size() >= mParams.maxActions || available->empty())
+      break;
+
+    // Always handle the hottest remaining region next
+    uint32 hottest = 0;
+    float hottest_load = load((*loads)[work[0]]);
+    for (uint32 i = 1; i < work.size(); i++) {
+      float l = load((*loads)[work[i]]);
+      if (l > hottest_load || (l == hottest_load && regionBefore(work[i], work[hottest]))) {
+        hottest = i;
+        hottest_load = l;
+      }
+    }
+    SegmentedRegion* region = work[hottest];
+    work.erase(work.begin() + hottest);
+
+    RegionLoad rl = (*loads)[region];
+    SplitPlan plan;
+    if (!planSplit(region, rl, &plan))
+      continue;
+    if (!withinBudget(plan.migrations, *migrations_used, *actions_out))
+      continue;
+
+    ServerID new_server = available->front();
+    available->erase(available->begin());
+    ServerID old_server = region->mServer;
+
+    applySplit(region, rl, plan, new_server, loads);
+
+    Action action;
+    action.type = Action::SPLIT;
+    action.region = region;
+    action.kept = old_server;
+    action.other = new_server;
+    action.axis = plan.axis;
+    action.position = plan.position;
+    action.migrations = plan.migrations;
+
+    *migrations_used += action.migrations;
+    actions_out->push_back(action);
+
+    // Keep splitting halves that are still overloaded
+    if (mParams.policy == POLICY_PLANNED) {
+      if (load((*loads)[region->mLeftChild]) > mParams.splitLoad)
+        work.push_back(region->mLeftChild);
+      if (load((*loads)[region->mRightChild]) > mParams.splitLoad)
+        work.push_back(region->mRightChild);
+    }
+  }
+}
+
+bool LoadBalancePlanner::planSplit(SegmentedRegion* region, const RegionLoad& rl, SplitPlan* plan) const {
+  if (mParams.policy == POLICY_THRESHOLD) {
+    // Alternate between the X and Y axes and cut in the middle, giving the
+    // upper half to the new server.
+    uint32 axis = (region->mSplitAxis == SegmentedRegion::Y) ? 0 : 1;
+    const std::vector<uint32>& hist = rl.histogram[axis];
+
+    plan->axis = axis;
+    if (hist.size() >= 2 && hist.size() % 2 == 0) {
+      plan->cutBin = hist.size() / 2;
+      plan->numBins = hist.size();
+    }
+    else {
+      plan->cutBin = 1;
+      plan->numBins = 2;
+    }
+
+    const Vector3f& rmin = region->mBoundingBox.min();
+    const Vector3f& rmax = region->mBoundingBox.max();
+    plan->position = (rmin[axis] + rmax[axis]) / 2.0;
+
+    uint32 hist_total = 0, hist_lower = 0;
+    for (uint32 i = 0; i < hist.size(); i++) {
+      hist_total += hist[i];
+      if (i < plan->cutBin) hist_lower += hist[i];
+    }
+    float frac = (hist_total > 0 && plan->numBins == hist.size()) ? hist_lower / (float)hist_total : 0.5f;
+
+    plan->lowerObjects = (uint32)(frac * rl.objectCount + 0.5f);
+    plan->upperObjects = rl.objectCount - plan->lowerObjects;
+    plan->newServerLower = false;
+    plan->migrations = plan->upperObjects;
+    plan->maxSideLoad = std::max(frac, 1.f - frac) * load(rl);
+    return true;
+  }
+
+  SplitPlan best;
+  bool found = false;
+  for (uint32 axis = 0; axis < 2; axis++) {
+    SplitPlan candidate;
+    if (!planSplitAxis(region, rl, axis, &candidate))
+      continue;
+    if (!found || betterSplit(candidate, best)) {
+      best = candidate;
+      found = true;
+    }
+  }
+
+  // A split that can't move any load off the region isn't worth a server
+  if (!found || best.maxSideLoad >= load(rl))
+    return false;
+
+  *plan = best;
+  return true;
+}
+
+bool LoadBalancePlanner::planSplitAxis(SegmentedRegion* region, const RegionLoad& rl, uint32 axis, SplitPlan* plan) const {
+  const Vector3f& rmin = region->mBoundingBox.min();
+  const Vector3f& rmax = region->mBoundingBox.max();
+  float extent = rmax[axis] - rmin[axis];
+  if (extent <= 0)
+    return false;
+
+  const std::vector<uint32>& hist = rl.histogram[axis];
+  uint32 hist_total = 0;
+  for (uint32 i = 0; i < hist.size(); i++)
+    hist_total += hist[i];
+
+  // Without a histogram we can only assume objects are spread uniformly.
+  uint32 num_bins = (hist.size() >= 2) ? hist.size() : 2;
+  float total_load = load(rl);
+
+  bool found = false;
+  uint32 prefix = 0;
+  for (uint32 k = 1; k < num_bins; k++) {
+    float frac;
+    if (hist.size() >= 2 && hist_total > 0) {
+      prefix += hist[k-1];
+      frac = prefix / (float)hist_total;
+    }
+    else {
+      frac = k / (float)num_bins;
+    }
+
+    SplitPlan candidate;
+    candidate.axis = axis;
+    candidate.cutBin = k;
+    candidate.numBins = num_bins;
+    candidate.position = rmin[axis] + extent * k / num_bins;
+    candidate.lowerObjects = (uint32)(frac * rl.objectCount + 0.5f);
+    candidate.upperObjects = rl.objectCount - candidate.lowerObjects;
+    candidate.newServerLower = (candidate.lowerObjects < candidate.upperObjects);
+    candidate.migrations = std::min(candidate.lowerObjects, candidate.upperObjects);
+    candidate.maxSideLoad = std::max(frac, 1.f - frac) * total_load;
+
+    if (!found || betterSplit(candidate, *plan)) {
+      *plan = candidate;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+bool LoadBalancePlanner::betterSplit(const SplitPlan& a, const SplitPlan& b) const {
+  // Among splits that leave both halves with enough headroom, move as few
+  // objects as possible. Otherwise get as close to an even split as we can.
+  float target = mParams.splitTarget * mParams.splitLoad;
+  bool a_ok = (a.maxSideLoad <= target);
+  bool b_ok = (b.maxSideLoad <= target);
+  if (a_ok != b_ok)
+    return a_ok;
+
+  if (a_ok) {
+    if (a.migrations != b.migrations) return a.migrations < b.migrations;
+    return a.maxSideLoad < b.maxSideLoad;
+  }
+
+  if (a.maxSideLoad != b.maxSideLoad) return a.maxSideLoad < b.maxSideLoad;
+  return a.migrations < b.migrations;
+}
+
+void LoadBalancePlanner::applySplit(SegmentedRegion* region, const RegionLoad& rl, const SplitPlan& plan,
+                                    ServerID new_server, LoadMap* loads)
+{
+  const BoundingBox3f bbox = region->mBoundingBox;
+  Vector3f lower_max = bbox.max();
+  lower_max[plan.axis] = plan.position;
+  Vector3f upper_min = bbox.min();
+  upper_min[plan.axis] = plan.position;
+
+  SegmentedRegion* lower = new SegmentedRegion(region);
+  SegmentedRegion* upper = new SegmentedRegion(region);
+  lower->mBoundingBox = BoundingBox3f(bbox.min(), lower_max);
+  upper->mBoundingBox = BoundingBox3f(upper_min, bbox.max());
+  lower->mSplitAxis = upper->mSplitAxis = (plan.axis == 0) ? SegmentedRegion::X : SegmentedRegion::Y;
+  lower->mServer = plan.newServerLower ? new_server : region->mServer;
+  upper->mServer = plan.newServerLower ? region->mServer : new_server;
+
+  region->mLeftChild = lower;
+  region->mRightChild = upper;
+
+  RegionLoad lower_load = estimateChild(rl, plan, true);
+  RegionLoad upper_load = estimateChild(rl, plan, false);
+  loads->erase(region);
+  (*loads)[lower] = lower_load;
+  (*loads)[upper] = upper_load;
+}
+
+RegionLoad LoadBalancePlanner::estimateChild(const RegionLoad& rl, const SplitPlan& plan, bool lower) const {
+  RegionLoad child;
+  child.estimated = true;
+  child.objectCount = lower ? plan.lowerObjects : plan.upperObjects;
+
+  float frac;
+  if (rl.objectCount > 0)
+    frac = child.objectCount / (float)rl.objectCount;
+  else
+    frac = (lower ? plan.cutBin : (plan.numBins - plan.cutBin)) / (float)plan.numBins;
+  child.messageRate = rl.messageRate * frac;
+
+  for (uint32 axis = 0; axis < 2; axis++) {
+    const std::vector<uint32>& hist = rl.histogram[axis];
+    if (hist.empty()) continue;
+
+    if (axis == plan.axis) {
+      // Cuts are on bin boundaries, so the child gets a subset of the bins
+      if (hist.size() != plan.numBins) continue;
+      if (lower)
+        child.histogram[axis].assign(hist.begin(), hist.begin() + plan.cutBin);
+      else
+        child.histogram[axis].assign(hist.begin() + plan.cutBin, hist.end());
+    }
+    else {
+      child.histogram[axis].resize(hist.size());
+      for (uint32 i = 0; i < hist.size(); i++)
+        child.histogram[axis][i] = (uint32)(hist[i] * frac + 0.5f);
+    }
+  }
+
+  return child;
+}
+
+} // namespace Sirikata
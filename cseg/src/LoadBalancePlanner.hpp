@@ -0,0 +1,158 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CSEG_LOAD_BALANCE_PLANNER_HPP_
+#define _SIRIKATA_CSEG_LOAD_BALANCE_PLANNER_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/space/SegmentedRegion.hpp>
+
+namespace Sirikata {
+
+/** Load measurements for a leaf region, as reported by the space server
+ *  handling it.
+ */
+struct RegionLoad {
+  RegionLoad()
+   : objectCount(0),
+     messageRate(0),
+     estimated(false)
+  {}
+
+  uint32 objectCount;
+  // Messages per second handled for objects in the region.
+  float messageRate;
+  // Number of objects in equal width slices of the region along the X (0)
+  // and Y (1) axes. Either may be empty if it wasn't reported.
+  std::vector<uint32> histogram[2];
+  // True if this was derived by the planner when it created the region
+  // rather than reported by a space server.
+  bool estimated;
+};
+
+/** Decides how to split and merge leaf regions based on their load, and
+ *  applies those decisions to the SegmentedRegion tree. It has no knowledge
+ *  of the network so the same code drives both the CSeg server's
+ *  LoadBalancer and the offline LoadBalanceSimulator.
+ *
+ *  Load is the object count plus a weighted message rate. Each round the
+ *  planner first merges pairs of sibling leaves whose combined load is low,
+ *  which frees up servers, then splits leaves whose load is too high,
+ *  hottest first. Split planes are placed using the reported object
+ *  histograms: of all the cuts that bring both halves comfortably under the
+ *  split threshold it picks the one that moves the fewest objects, and the
+ *  new server always takes the side with fewer objects. If a half is still
+ *  overloaded it is split again in the same round. The number of actions
+ *  and expected object migrations per round are bounded so changes are
+ *  rolled out incrementally.
+ *
+ *  The threshold policy reproduces the original behavior for comparison:
+ *  at most one change per round, always splitting at the midpoint.
+ */
+class LoadBalancePlanner {
+public:
+  enum Policy {
+    POLICY_PLANNED,
+    POLICY_THRESHOLD
+  };
+
+  struct Parameters {
+    Parameters();
+
+    Policy policy;
+    // Leaves with load above this are split
+    float splitLoad;
+    // Sibling leaves with combined load below this are merged
+    float mergeLoad;
+    // Splits aim to leave both halves below splitTarget * splitLoad
+    float splitTarget;
+    // Weight of the message rate relative to the object count
+    float messageWeight;
+    // Maximum number of splits and merges in a round
+    uint32 maxActions;
+    // Maximum number of expected object migrations in a round, or 0 for no
+    // limit. The first action of a round is always allowed.
+    uint32 maxMigrations;
+  };
+
+  struct Action {
+    enum Type {
+      SPLIT,
+      MERGE
+    };
+
+    Type type;
+    // The leaf that was split or the parent of the leaves that were merged.
+    SegmentedRegion* region;
+    // For splits, the server that kept part of the region. For merges, the
+    // server that now handles the whole region.
+    ServerID kept;
+    // For splits, the server that took over the other part of the region.
+    // For merges, the server that was released.
+    ServerID other;
+    // Split axis and position. Only valid for splits.
+    uint32 axis;
+    float position;
+    // Expected number of objects that have to move to a different server.
+    uint32 migrations;
+  };
+
+  typedef std::map<SegmentedRegion*, RegionLoad> LoadMap;
+
+  LoadBalancePlanner(const Parameters& params);
+
+  const Parameters& parameters() const {
+    return mParams;
+  }
+
+  float load(const RegionLoad& rl) const;
+
+  /** Plan and apply one round of changes.
+   *  \param loads the leaves to consider and their loads. Updated to reflect
+   *         the changes: merged leaves are removed and new leaves are added
+   *         with estimated loads. Leaves that already have estimated loads
+   *         are ignored until a real report replaces them.
+   *  \param available idle servers in order of preference. Servers assigned
+   *         by splits are removed and servers released by merges appended.
+   *  \param actions_out the changes that were applied, in order
+   */
+  void run(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out);
+
+private:
+  struct SplitPlan {
+    uint32 axis;
+    // Number of histogram bins below the split and the total number of bins
+    // along the axis. For unreported histograms these are 1 and 2.
+    uint32 cutBin;
+    uint32 numBins;
+    float position;
+    uint32 lowerObjects;
+    uint32 upperObjects;
+    // Whether the new server takes the lower half
+    bool newServerLower;
+    uint32 migrations;
+    float maxSideLoad;
+  };
+
+  void planMerges(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out,
+                  uint32* migrations_used);
+  void planSplits(LoadMap* loads, std::vector<ServerID>* available, std::vector<Action>* actions_out,
+                  uint32* migrations_used);
+
+  bool planSplit(SegmentedRegion* region, const RegionLoad& rl, SplitPlan* plan) const;
+  bool planSplitAxis(SegmentedRegion* region, const RegionLoad& rl, uint32 axis, SplitPlan* plan) const;
+  bool betterSplit(const SplitPlan& a, const SplitPlan& b) const;
+
+  void applySplit(SegmentedRegion* region, const RegionLoad& rl, const SplitPlan& plan,
+                  ServerID new_server, LoadMap* loads);
+  RegionLoad estimateChild(const RegionLoad& rl, const SplitPlan& plan, bool lower) const;
+
+  bool withinBudget(uint32 migrations, uint32 migrations_used, const std::vector<Action>& actions) const;
+
+  Parameters mParams;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CSEG_LOAD_BALANCE_PLANNER_HPP_
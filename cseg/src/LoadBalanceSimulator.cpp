@@ -0,0 +1,274 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LoadBalanceSimulator.hpp"
+#include "LoadBalancer.hpp"
+#include "DistributedCoordinateSegmentation.hpp"
+#include <fstream>
+
+#define LBSIM_LOG(lvl,msg) SILOG(cseg, lvl, msg)
+
+namespace Sirikata {
+
+namespace {
+
+float overlap(float a0, float a1, float b0, float b1) {
+  float lo = std::max(a0, b0);
+  float hi = std::min(a1, b1);
+  return (hi > lo) ? (hi - lo) : 0;
+}
+
+// Fraction of the objects in [r0,r1], distributed according to hist, that
+// lie in [c0,c1]. Objects within a histogram bin are assumed to be uniformly
+// distributed.
+float massFraction(const std::vector<uint32>& hist, float r0, float r1, float c0, float c1) {
+  float extent = r1 - r0;
+  if (extent <= 0) return 0;
+
+  uint32 total = 0;
+  for (uint32 i = 0; i < hist.size(); i++)
+    total += hist[i];
+  if (total == 0)
+    return overlap(r0, r1, c0, c1) / extent;
+
+  float width = extent / hist.size();
+  float frac = 0;
+  for (uint32 i = 0; i < hist.size(); i++) {
+    if (hist[i] == 0) continue;
+    float b0 = r0 + width * i;
+    frac += hist[i] / (float)total * overlap(b0, b0 + width, c0, c1) / width;
+  }
+  return frac;
+}
+
+bool overlapsXY(const BoundingBox3f& a, const BoundingBox3f& b) {
+  return overlap(a.min().x, a.max().x, b.min().x, b.max().x) > 0 &&
+    overlap(a.min().y, a.max().y, b.min().y, b.max().y) > 0;
+}
+
+} // namespace
+
+LoadBalanceSimulator::Results::Results()
+ : rounds(0),
+   splits(0),
+   merges(0),
+   migrations(0),
+   overloadedLeafRounds(0),
+   meanImbalance(0),
+   maxLoad(0),
+   maxServers(0)
+{
+}
+
+LoadBalanceSimulator::LoadBalanceSimulator(const BoundingBox3f& region, const Vector3ui32& layout, uint32 nservers,
+                                           uint32 grid_size, uint32 hist_bins, const Duration& interval)
+ : mRegion(region),
+   mLayout(layout),
+   mServers(nservers),
+   mGridSize(std::max(grid_size, (uint32)1)),
+   mHistBins(std::max(hist_bins, (uint32)1)),
+   mInterval(interval)
+{
+  if (mInterval <= Duration::zero())
+    mInterval = Duration::seconds(1);
+}
+
+LoadBalanceSimulator::~LoadBalanceSimulator() {
+}
+
+bool LoadBalanceSimulator::loadTrace(const String& filename) {
+  std::ifstream fp(filename.c_str());
+  if (!fp) {
+    LBSIM_LOG(error, "Couldn't open load report trace " << filename);
+    return false;
+  }
+
+  String line;
+  uint32 lineno = 0;
+  while (std::getline(fp, line)) {
+    lineno++;
+    if (line.empty() || line[0] == '#') continue;
+
+    Report report;
+    if (!LoadBalancer::parseLoadReportLog(line, &report.time, &report.server, &report.bbox, &report.load)) {
+      LBSIM_LOG(warn, "Skipping malformed load report on line " << lineno);
+      continue;
+    }
+    mReports.push_back(report);
+  }
+
+  LBSIM_LOG(info, "Loaded " << mReports.size() << " load reports");
+  return true;
+}
+
+void LoadBalanceSimulator::deposit(const Report& report, std::vector<float>* objects, std::vector<float>* messages) const {
+  const BoundingBox3f& bbox = report.bbox;
+  Vector3f cell_size = (mRegion.max() - mRegion.min()) / (float)mGridSize;
+
+  for (uint32 j = 0; j < mGridSize; j++) {
+    float c0y = mRegion.min().y + cell_size.y * j;
+    float yfrac = massFraction(report.load.histogram[1], bbox.min().y, bbox.max().y, c0y, c0y + cell_size.y);
+    if (yfrac <= 0) continue;
+
+    for (uint32 i = 0; i < mGridSize; i++) {
+      float c0x = mRegion.min().x + cell_size.x * i;
+      float xfrac = massFraction(report.load.histogram[0], bbox.min().x, bbox.max().x, c0x, c0x + cell_size.x);
+      if (xfrac <= 0) continue;
+
+      (*objects)[j * mGridSize + i] += report.load.objectCount * xfrac * yfrac;
+      (*messages)[j * mGridSize + i] += report.load.messageRate * xfrac * yfrac;
+    }
+  }
+}
+
+void LoadBalanceSimulator::buildField(const std::vector<const Report*>& active) {
+  mObjectField.assign(mGridSize * mGridSize, 0);
+  mMessageField.assign(mGridSize * mGridSize, 0);
+  for (uint32 i = 0; i < active.size(); i++)
+    deposit(*active[i], &mObjectField, &mMessageField);
+}
+
+float LoadBalanceSimulator::fieldSum(const std::vector<float>& field, const BoundingBox3f& bbox) const {
+  Vector3f cell_size = (mRegion.max() - mRegion.min()) / (float)mGridSize;
+  float sum = 0;
+
+  for (uint32 j = 0; j < mGridSize; j++) {
+    float c0y = mRegion.min().y + cell_size.y * j;
+    float yfrac = overlap(c0y, c0y + cell_size.y, bbox.min().y, bbox.max().y) / cell_size.y;
+    if (yfrac <= 0) continue;
+
+    for (uint32 i = 0; i < mGridSize; i++) {
+      float c0x = mRegion.min().x + cell_size.x * i;
+      float xfrac = overlap(c0x, c0x + cell_size.x, bbox.min().x, bbox.max().x) / cell_size.x;
+      if (xfrac <= 0) continue;
+
+      sum += field[j * mGridSize + i] * xfrac * yfrac;
+    }
+  }
+
+  return sum;
+}
+
+RegionLoad LoadBalanceSimulator::measure(const BoundingBox3f& bbox) const {
+  RegionLoad load;
+  load.objectCount = (uint32)(fieldSum(mObjectField, bbox) + 0.5f);
+  load.messageRate = fieldSum(mMessageField, bbox);
+
+  for (uint32 axis = 0; axis < 2; axis++) {
+    float width = (bbox.max()[axis] - bbox.min()[axis]) / mHistBins;
+    load.histogram[axis].resize(mHistBins);
+    for (uint32 b = 0; b < mHistBins; b++) {
+      Vector3f bin_min = bbox.min(), bin_max = bbox.max();
+      bin_min[axis] = bbox.min()[axis] + width * b;
+      bin_max[axis] = bin_min[axis] + width;
+      load.histogram[axis][b] = (uint32)(fieldSum(mObjectField, BoundingBox3f(bin_min, bin_max)) + 0.5f);
+    }
+  }
+
+  return load;
+}
+
+void LoadBalanceSimulator::collectLeaves(SegmentedRegion* region, std::vector<SegmentedRegion*>* leaves) const {
+  if (region->mLeftChild == NULL && region->mRightChild == NULL) {
+    leaves->push_back(region);
+    return;
+  }
+  if (region->mLeftChild != NULL) collectLeaves(region->mLeftChild, leaves);
+  if (region->mRightChild != NULL) collectLeaves(region->mRightChild, leaves);
+}
+
+LoadBalanceSimulator::Results LoadBalanceSimulator::run(const LoadBalancePlanner::Parameters& params) {
+  Results results;
+  LoadBalancePlanner planner(params);
+
+  SegmentedRegion root(NULL);
+  root.mBoundingBox = mRegion;
+  int assigned = 0;
+  DistributedCoordinateSegmentation::subdivideTopLevelRegion(&root, mLayout, assigned);
+
+  std::vector<ServerID> available;
+  for (uint32 sid = assigned + 1; sid <= mServers; sid++)
+    available.push_back(sid);
+
+  std::vector<const Report*> active;
+  uint32 next_report = 0;
+  double imbalance_sum = 0;
+  uint32 imbalance_rounds = 0;
+
+  for (Duration t = mInterval; next_report < mReports.size(); t += mInterval) {
+    // Newer reports replace whatever we knew about the space they cover
+    bool changed = false;
+    while (next_report < mReports.size() && mReports[next_report].time < t) {
+      const Report* report = &mReports[next_report++];
+      for (uint32 i = 0; i < active.size(); ) {
+        if (overlapsXY(active[i]->bbox, report->bbox))
+          active.erase(active.begin() + i);
+        else
+          i++;
+      }
+      active.push_back(report);
+      changed = true;
+    }
+    if (changed)
+      buildField(active);
+
+    std::vector<SegmentedRegion*> leaves;
+    collectLeaves(&root, &leaves);
+    LoadBalancePlanner::LoadMap loads;
+    for (uint32 i = 0; i < leaves.size(); i++)
+      loads[leaves[i]] = measure(leaves[i]->mBoundingBox);
+
+    std::vector<LoadBalancePlanner::Action> actions;
+    planner.run(&loads, &available, &actions);
+
+    for (uint32 i = 0; i < actions.size(); i++) {
+      const LoadBalancePlanner::Action& action = actions[i];
+      if (action.type == LoadBalancePlanner::Action::SPLIT) {
+        results.splits++;
+        // The region may have been split again in the same round, so count
+        // everything in the subtree now handled by the new server.
+        std::vector<SegmentedRegion*> moved;
+        collectLeaves(action.region, &moved);
+        for (uint32 m = 0; m < moved.size(); m++) {
+          if (moved[m]->mServer == action.other)
+            results.migrations += (uint64)(fieldSum(mObjectField, moved[m]->mBoundingBox) + 0.5f);
+        }
+      }
+      else {
+        results.merges++;
+        results.migrations += action.migrations;
+      }
+    }
+
+    // Measure the state after this round's changes
+    leaves.clear();
+    collectLeaves(&root, &leaves);
+    float max_load = 0, total_load = 0;
+    for (uint32 i = 0; i < leaves.size(); i++) {
+      float l = planner.load(measure(leaves[i]->mBoundingBox));
+      max_load = std::max(max_load, l);
+      total_load += l;
+      if (l > params.splitLoad)
+        results.overloadedLeafRounds++;
+    }
+    if (total_load > 0) {
+      imbalance_sum += max_load / (total_load / leaves.size());
+      imbalance_rounds++;
+    }
+    results.maxLoad = std::max(results.maxLoad, max_load);
+    results.maxServers = std::max(results.maxServers, (uint32)leaves.size());
+    results.rounds++;
+
+    LBSIM_LOG(detailed, "t=" << t << " leaves=" << leaves.size() << " actions=" << actions.size()
+              << " max load=" << max_load);
+  }
+
+  if (imbalance_rounds > 0)
+    results.meanImbalance = imbalance_sum / imbalance_rounds;
+
+  root.destroy();
+  return results;
+}
+
+} // namespace Sirikata
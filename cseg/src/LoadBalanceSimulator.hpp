@@ -0,0 +1,83 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_CSEG_LOAD_BALANCE_SIMULATOR_HPP_
+#define _SIRIKATA_CSEG_LOAD_BALANCE_SIMULATOR_HPP_
+
+#include "LoadBalancePlanner.hpp"
+
+namespace Sirikata {
+
+/** Offline, deterministic replay of recorded load reports (see the
+ *  cseg-load-report-log option) against a LoadBalancePlanner.
+ *
+ *  Since the simulated segmentation diverges from the one the reports were
+ *  recorded with, the reports are first turned into a load field over a grid
+ *  covering the world: each report spreads its objects and messages over its
+ *  region following its histograms, and newer reports replace older ones for
+ *  the space they cover. Every balancing interval the loads of the simulated
+ *  leaves are read back out of the field, including histograms, and a
+ *  balancing round is run. Migrations are counted from the field, not from
+ *  the planner's estimates.
+ */
+class LoadBalanceSimulator {
+public:
+  struct Results {
+    Results();
+
+    uint32 rounds;
+    uint32 splits;
+    uint32 merges;
+    uint64 migrations;
+    // Sum over rounds of the number of leaves above the split load after
+    // balancing
+    uint64 overloadedLeafRounds;
+    // Average over rounds of the max / mean leaf load after balancing
+    double meanImbalance;
+    float maxLoad;
+    uint32 maxServers;
+  };
+
+  LoadBalanceSimulator(const BoundingBox3f& region, const Vector3ui32& layout, uint32 nservers,
+                       uint32 grid_size, uint32 hist_bins, const Duration& interval);
+  ~LoadBalanceSimulator();
+
+  /** Load recorded reports. Returns false if the file couldn't be read. */
+  bool loadTrace(const String& filename);
+
+  /** Replay the trace against a fresh initial segmentation. */
+  Results run(const LoadBalancePlanner::Parameters& params);
+
+private:
+  struct Report {
+    Duration time;
+    ServerID server;
+    BoundingBox3f bbox;
+    RegionLoad load;
+  };
+
+  void deposit(const Report& report, std::vector<float>* objects, std::vector<float>* messages) const;
+  void buildField(const std::vector<const Report*>& active);
+  RegionLoad measure(const BoundingBox3f& bbox) const;
+  float fieldSum(const std::vector<float>& field, const BoundingBox3f& bbox) const;
+
+  void collectLeaves(SegmentedRegion* region, std::vector<SegmentedRegion*>* leaves) const;
+
+  BoundingBox3f mRegion;
+  Vector3ui32 mLayout;
+  uint32 mServers;
+  uint32 mGridSize;
+  uint32 mHistBins;
+  Duration mInterval;
+
+  std::vector<Report> mReports;
+
+  // Objects and messages/s in each grid cell, row major with X varying fastest
+  std::vector<float> mObjectField;
+  std::vector<float> mMessageField;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_CSEG_LOAD_BALANCE_SIMULATOR_HPP_
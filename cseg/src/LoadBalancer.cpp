@@ -32,13 +32,18 @@
 
 #include "LoadBalancer.hpp"
 #include "DistributedCoordinateSegmentation.hpp"
-
-#define OVERLOAD_THRESHOLD 2000
-#define UNDERLOAD_THRESHOLD 50
+#include "Options.hpp"
+#include <sirikata/core/options/Options.hpp>
+#include <sirikata/core/util/Timer.hpp>
 
 namespace Sirikata {
 
-LoadBalancer::LoadBalancer(DistributedCoordinateSegmentation* cseg, int nservers, const Vector3ui32& perdim) {
+LoadBalancer::LoadBalancer(DistributedCoordinateSegmentation* cseg, int nservers, const Vector3ui32& perdim)
+ : mPlanner(parametersFromOptions(GetOptionValue<String>(OPT_CSEG_BALANCE_POLICY))),
+   mBalanceInterval(GetOptionValue<Duration>(OPT_CSEG_BALANCE_INTERVAL)),
+   mNextBalanceTime(Time::null()),
+   mStartTime(Timer::now())
+{
   for (int i=0; i<nservers;i++) {
     ServerAvailability sa;
     sa.mServer = i+1;
@@ -47,6 +52,13 @@ LoadBalancer::LoadBalancer(DistributedCoordinateSegmentation* cseg, int nservers
     mAvailableServers.push_back(sa);
   }
 
+  String report_log = GetOptionValue<String>(OPT_CSEG_LOAD_REPORT_LOG);
+  if (!report_log.empty()) {
+    mLoadReportLog.open(report_log.c_str());
+    if (!mLoadReportLog)
+      std::cout << "Couldn't open load report log " << report_log << "\n";
+  }
+
   mCSeg = cseg;
 }
 
@@ -54,247 +66,184 @@ LoadBalancer::~LoadBalancer() {
 
 }
 
-uint32 LoadBalancer::getAvailableServerIndex() {
-  uint32 availableSvrIndex = INT_MAX;
+LoadBalancePlanner::Parameters LoadBalancer::parametersFromOptions(const String& policy) {
+  LoadBalancePlanner::Parameters params;
 
-  for (uint32 i=0; i<mAvailableServers.size(); i++) {
-    if (mAvailableServers[i].mAvailable == true) {
-      availableSvrIndex = i;
-      break;
-    }
-  }
+  if (policy == "threshold")
+    params.policy = LoadBalancePlanner::POLICY_THRESHOLD;
+  else if (policy == "planned")
+    params.policy = LoadBalancePlanner::POLICY_PLANNED;
+  else
+    std::cout << "Unknown load balancing policy " << policy << ", using planned\n";
 
-  return availableSvrIndex;
-}
+  params.splitLoad = GetOptionValue<float>(OPT_CSEG_SPLIT_LOAD);
+  params.mergeLoad = GetOptionValue<float>(OPT_CSEG_MERGE_LOAD);
+  params.splitTarget = GetOptionValue<float>(OPT_CSEG_SPLIT_TARGET);
+  params.messageWeight = GetOptionValue<float>(OPT_CSEG_MESSAGE_WEIGHT);
+  params.maxActions = GetOptionValue<uint32>(OPT_CSEG_MAX_BALANCE_ACTIONS);
+  params.maxMigrations = GetOptionValue<uint32>(OPT_CSEG_MAX_BALANCE_MIGRATIONS);
 
-void LoadBalancer::reportRegionLoad(SegmentedRegion* segRegion, ServerID sid, uint32 loadValue) {
-  boost::mutex::scoped_lock overloadedRegionsListLock(mOverloadedRegionsListMutex);
-  boost::mutex::scoped_lock underloadedRegionsListLock(mUnderloadedRegionsListMutex);
+  return params;
+}
 
-  if (segRegion->mLoadValue > OVERLOAD_THRESHOLD) {
-    std::vector<SegmentedRegion*>::iterator it = std::find(mOverloadedRegionsList.begin(),
-                                                           mOverloadedRegionsList.end(), segRegion);
-    if (it == mOverloadedRegionsList.end()) {
-      std::cout << "Adding to overloaded: " << sid << "\n";
+/* Load report log format, one report per line:
+     <ms since start> <server> <min x y z> <max x y z> <objects> <message rate>
+     <# x bins> <x bins...> <# y bins> <y bins...>
+*/
+void LoadBalancer::logLoadReport(ServerID sid, const BoundingBox3f& bbox, const RegionLoad& load) {
+  if (!mLoadReportLog.is_open()) return;
+
+  mLoadReportLog << (Timer::now() - mStartTime).toMilliseconds() << " " << sid << " "
+                 << bbox.min().x << " " << bbox.min().y << " " << bbox.min().z << " "
+                 << bbox.max().x << " " << bbox.max().y << " " << bbox.max().z << " "
+                 << load.objectCount << " " << load.messageRate;
+  for (uint32 axis = 0; axis < 2; axis++) {
+    mLoadReportLog << " " << load.histogram[axis].size();
+    for (uint32 i = 0; i < load.histogram[axis].size(); i++)
+      mLoadReportLog << " " << load.histogram[axis][i];
+  }
+  mLoadReportLog << "\n";
+  mLoadReportLog.flush();
+}
 
-      mOverloadedRegionsList.push_back(segRegion);
+bool LoadBalancer::parseLoadReportLog(const String& line, Duration* time, ServerID* sid,
+                                      BoundingBox3f* bbox, RegionLoad* load)
+{
+  std::istringstream iss(line);
+  int64 ms;
+  Vector3f bmin, bmax;
+  *load = RegionLoad();
+
+  iss >> ms >> *sid
+      >> bmin.x >> bmin.y >> bmin.z
+      >> bmax.x >> bmax.y >> bmax.z
+      >> load->objectCount >> load->messageRate;
+  if (!iss) return false;
+
+  for (uint32 axis = 0; axis < 2; axis++) {
+    uint32 nbins = 0;
+    if (!(iss >> nbins)) break;
+    load->histogram[axis].resize(nbins);
+    for (uint32 i = 0; i < nbins; i++) {
+      if (!(iss >> load->histogram[axis][i])) return false;
     }
+  }
 
+  *time = Duration::milliseconds(ms);
+  *bbox = BoundingBox3f(bmin, bmax);
+  return true;
+}
 
-    it = std::find(mUnderloadedRegionsList.begin(),
-                   mUnderloadedRegionsList.end(), segRegion);
-    if (it != mUnderloadedRegionsList.end()) {
-      mUnderloadedRegionsList.erase(it);
-    }
-  }
-  else if (segRegion->mLoadValue < UNDERLOAD_THRESHOLD) {
-    std::vector<SegmentedRegion*>::iterator it = std::find(mUnderloadedRegionsList.begin(),
-                                                           mUnderloadedRegionsList.end(), segRegion);
-    if (it == mUnderloadedRegionsList.end()) {
-      mUnderloadedRegionsList.push_back(segRegion);
-      std::cout << "Adding to underloaded: " << sid << "\n";
-    }
-  }
-  else {
-    std::vector<SegmentedRegion*>::iterator it = std::find(mUnderloadedRegionsList.begin(),
-                                                           mUnderloadedRegionsList.end(), segRegion);
-    if (it != mUnderloadedRegionsList.end()) {
-      mUnderloadedRegionsList.erase(it);
-      std::cout << "Removing from underloaded: " << sid << "\n";
-    }
-  }
+void LoadBalancer::reportRegionLoad(SegmentedRegion* segRegion, ServerID sid, const RegionLoad& load) {
+  boost::mutex::scoped_lock regionLoadsLock(mRegionLoadsMutex);
+
+  mRegionLoads[segRegion] = load;
+  logLoadReport(sid, segRegion->mBoundingBox, load);
 }
 
 void LoadBalancer::handleSegmentationChange(Sirikata::Protocol::CSeg::ChangeMessage segChangeMessage) {
+  boost::mutex::scoped_lock regionLoadsLock(mRegionLoadsMutex);
+
   for (int i=0; i < segChangeMessage.region_size(); i++) {
     Sirikata::Protocol::CSeg::SplitRegion region = segChangeMessage.region(i);
 
     for (uint32 i=0; i<mAvailableServers.size(); i++) {
-      if (mAvailableServers[i].mServer == region.id() &&
-          region.bounds().min().x != region.bounds().max().x)
-        {
-          mAvailableServers[i].mAvailable = false;
-          break;
-        }
+      // Released servers are sent with an empty region
+      if (mAvailableServers[i].mServer == region.id()) {
+        mAvailableServers[i].mAvailable = (region.bounds().min().x == region.bounds().max().x);
+        break;
+      }
     }
   }
 }
 
-void LoadBalancer::service() {
-  boost::mutex::scoped_lock overloadedRegionsListLock(mOverloadedRegionsListMutex);
-  boost::mutex::scoped_lock underloadedRegionsListLock(mUnderloadedRegionsListMutex);
-
-  //splitting overloaded regions
-  for (std::vector<SegmentedRegion*>::iterator it = mOverloadedRegionsList.begin();
-       it != mOverloadedRegionsList.end();
-       it++)
-  {
-    uint32 availableSvrIndex = getAvailableServerIndex();
-    if (availableSvrIndex != INT_MAX) {
-      ServerID availableServer = mAvailableServers[availableSvrIndex].mServer;
-      SegmentedRegion* overloadedRegion = *it;
-
-      std::vector<SegmentationInfo> segInfoVector;
-      SegmentationInfo segInfo, segInfo2;
-      segInfo.server = overloadedRegion->mServer;
-      segInfo.region = mCSeg->serverRegionCached(overloadedRegion->mServer);
-      if (segInfo.region.size() == 0) {
-        //Get the server region information asynchronously. This overloaded region will
-        //be handled later when service() is called.
-        mCSeg->getServerRegionUncached(segInfo.server, boost::shared_ptr<tcp::socket>() );
-        continue;
-      }
-      segInfoVector.push_back( segInfo );
-
-      segInfo2.server = availableServer;
-      segInfo2.region = mCSeg->serverRegionCached(availableServer);
-      if (segInfo2.region.size() == 0) {
-        //Get the server region information asynchronously. This overloaded region will
-        //be handled later when service() is called.
-        mCSeg->getServerRegionUncached(segInfo2.server, boost::shared_ptr<tcp::socket>() );
-        continue;
-      }
-      segInfoVector.push_back(segInfo2);
-
+bool LoadBalancer::service() {
+  boost::mutex::scoped_lock regionLoadsLock(mRegionLoadsMutex);
 
-      mAvailableServers[availableSvrIndex].mAvailable = false;
-
-      overloadedRegion->mLeftChild = new SegmentedRegion(overloadedRegion);
-      overloadedRegion->mRightChild = new SegmentedRegion(overloadedRegion);
-
-      BoundingBox3f region = overloadedRegion->mBoundingBox;
-      float minX = region.min().x; float minY = region.min().y;
-      float maxX = region.max().x; float maxY = region.max().y;
-      float minZ = region.min().z; float maxZ = region.max().z;
-
-      assert(overloadedRegion->mParent == NULL || overloadedRegion->mSplitAxis != SegmentedRegion::UNDEFINED);
-
-      if (overloadedRegion->mSplitAxis == SegmentedRegion::Y) {
-        overloadedRegion->mLeftChild->mBoundingBox = BoundingBox3f( region.min(),
-							    Vector3f( (minX+maxX)/2.0, maxY, maxZ) );
-        overloadedRegion->mRightChild->mBoundingBox = BoundingBox3f( Vector3f( (minX+maxX)/2.0,minY,minZ),
-                                                             region.max() );
-
-        overloadedRegion->mLeftChild->mSplitAxis = overloadedRegion->mRightChild->mSplitAxis = SegmentedRegion::X;
-      }
-      else {
-        overloadedRegion->mLeftChild->mBoundingBox = BoundingBox3f( region.min(),
-                                                                    Vector3f( maxX, (minY+maxY)/2.0, maxZ) );
-        overloadedRegion->mRightChild->mBoundingBox = BoundingBox3f( Vector3f( minX,(minY+maxY)/2.0,minZ),
-                                                             region.max() );
-
-        overloadedRegion->mLeftChild->mSplitAxis = overloadedRegion->mRightChild->mSplitAxis = SegmentedRegion::Y;
-      }
-      overloadedRegion->mLeftChild->mServer = overloadedRegion->mServer;
-      overloadedRegion->mRightChild->mServer = availableServer;
+  sendPendingRegionChanges();
 
-      std::cout << "Split\n";
-      std::cout << overloadedRegion->mServer << " : " << overloadedRegion->mLeftChild->mBoundingBox << "\n";
-      std::cout << availableServer << " : " << overloadedRegion->mRightChild->mBoundingBox << "\n";
+  Time now = Timer::now();
+  if (now < mNextBalanceTime)
+    return false;
+  mNextBalanceTime = now + mBalanceInterval;
 
-      mCSeg->mWholeTreeServerRegionMap.erase(overloadedRegion->mServer);
-      mCSeg->mWholeTreeServerRegionMap.erase(availableServer);
-      mCSeg->mLowerTreeServerRegionMap.erase(overloadedRegion->mServer);
-      mCSeg->mLowerTreeServerRegionMap.erase(availableServer);
+  // Retry region requests that haven't been answered by now
+  for (PendingRegionMap::iterator it = mPendingRegionChanges.begin(); it != mPendingRegionChanges.end(); it++)
+    it->second = false;
 
-
-      Thread thrd("CSeg Notify Space Servers", boost::bind(&DistributedCoordinateSegmentation::notifySpaceServersOfChange,mCSeg,segInfoVector));
-
-      mOverloadedRegionsList.erase(it);
-
-      return; //enough work for this iteration. No further splitting or merging.
-    }
-    else {
-      //No idle servers are available at this time...
-      break;
-    }
+  std::vector<ServerID> available;
+  for (uint32 i=0; i<mAvailableServers.size(); i++) {
+    if (mAvailableServers[i].mAvailable)
+      available.push_back(mAvailableServers[i].mServer);
   }
 
-  //merging underloaded regions
-  for (std::vector<SegmentedRegion*>::iterator it = mUnderloadedRegionsList.begin();
-       it != mUnderloadedRegionsList.end();
-       it++)
-  {
-    SegmentedRegion* underloadedRegion = *it;
-
-    if (underloadedRegion->mParent == NULL) {
-      mUnderloadedRegionsList.erase(it);
-      break;
-    }
+  std::vector<LoadBalancePlanner::Action> actions;
+  mPlanner.run(&mRegionLoads, &available, &actions);
+  if (actions.empty())
+    return false;
 
-    SegmentedRegion* parent = underloadedRegion->mParent;
+  for (uint32 i=0; i<mAvailableServers.size(); i++) {
+    mAvailableServers[i].mAvailable =
+      (std::find(available.begin(), available.end(), mAvailableServers[i].mServer) != available.end());
+  }
 
-    bool isRightChild = (underloadedRegion->mParent->mRightChild == underloadedRegion);
-    SegmentedRegion* sibling = NULL;
-    if (isRightChild) {
-      sibling = underloadedRegion->mParent->mLeftChild;
+  // Every server whose regions changed gets its new set of regions. Servers
+  // that were released get an empty region, which also tells other CSEG
+  // servers they're available again.
+  std::set<ServerID> affected;
+  for (uint32 i=0; i<actions.size(); i++) {
+    const LoadBalancePlanner::Action& action = actions[i];
+    if (action.type == LoadBalancePlanner::Action::SPLIT) {
+      std::cout << "Split " << action.kept << " : " << action.other << " axis " << action.axis
+                << " at " << action.position << ", " << action.migrations << " migrations\n";
     }
     else {
-      sibling = underloadedRegion->mParent->mRightChild;
+      std::cout << "Merged " << action.kept << " : " << action.other
+                << ", " << action.migrations << " migrations\n";
     }
+    affected.insert(action.kept);
+    affected.insert(action.other);
+  }
 
-    std::vector<SegmentedRegion*>::iterator sibling_it =
-               std::find(mUnderloadedRegionsList.begin(), mUnderloadedRegionsList.end(), sibling);
-    if (sibling_it == mUnderloadedRegionsList.end())
-    {
-      mUnderloadedRegionsList.erase(it);
-      break;
-    }
+  for (std::set<ServerID>::iterator it = affected.begin(); it != affected.end(); it++) {
+    mCSeg->mWholeTreeServerRegionMap.erase(*it);
+    mCSeg->mLowerTreeServerRegionMap.erase(*it);
+    mPendingRegionChanges[*it] = false;
+  }
+  sendPendingRegionChanges();
 
+  return true;
+}
 
-    std::vector<SegmentationInfo> segInfoVector;
-    SegmentationInfo segInfo, segInfo2;
-    segInfo.server = parent->mRightChild->mServer;
-    segInfo.region = mCSeg->serverRegionCached(parent->mRightChild->mServer);
+void LoadBalancer::sendPendingRegionChanges() {
+  if (mPendingRegionChanges.empty())
+    return;
+
+  // Servers can also have regions in trees stored on other CSEG servers, so
+  // space servers are sent their regions across the whole tree.
+  std::vector<SegmentationInfo> segInfoVector;
+  for (PendingRegionMap::iterator it = mPendingRegionChanges.begin(); it != mPendingRegionChanges.end(); ) {
+    SegmentationInfo segInfo;
+    segInfo.server = it->first;
+    segInfo.region = mCSeg->serverRegionCached(it->first);
     if (segInfo.region.size() == 0) {
-      //Get the server region information asynchronously. This underloaded region will
-      //be handled later when service() is called.
-      mCSeg->getServerRegionUncached( segInfo.server, boost::shared_ptr<tcp::socket>() );
-      continue;
-    }
-    segInfoVector.push_back( segInfo );
-
-    segInfo2.server = parent->mLeftChild->mServer;
-    segInfo2.region = mCSeg->serverRegionCached(parent->mLeftChild->mServer);
-    if (segInfo2.region.size() == 0) {
-      //Get the server region information asynchronously. This underloaded region will
-      //be handled later when service() is called.
-      mCSeg->getServerRegionUncached( segInfo2.server, boost::shared_ptr<tcp::socket>() );
-      continue;
-    }
-    segInfoVector.push_back(segInfo2);
-
-
-    parent->mServer = parent->mLeftChild->mServer;
-    for (uint32 i=0; i<mAvailableServers.size(); i++) {
-      if (mAvailableServers[i].mServer == parent->mRightChild->mServer) {
-        mAvailableServers[i].mAvailable = true;
-        break;
+      //Get the server region information asynchronously. The change will
+      //be sent later when service() is called.
+      if (!it->second) {
+        mCSeg->getServerRegionUncached(it->first, boost::shared_ptr<tcp::socket>() );
+        it->second = true;
       }
+      it++;
+      continue;
     }
+    segInfoVector.push_back(segInfo);
+    mPendingRegionChanges.erase(it++);
+  }
 
-    mCSeg->mWholeTreeServerRegionMap.erase(parent->mRightChild->mServer);
-    mCSeg->mLowerTreeServerRegionMap.erase(parent->mRightChild->mServer);
-    mCSeg->mWholeTreeServerRegionMap.erase(parent->mLeftChild->mServer);
-    mCSeg->mLowerTreeServerRegionMap.erase(parent->mLeftChild->mServer);
-
-
-    Thread thrd("CSeg Notify Space Servers", boost::bind(&DistributedCoordinateSegmentation::notifySpaceServersOfChange,mCSeg,segInfoVector));
-
-    mUnderloadedRegionsList.erase(it);
-    sibling_it = std::find(mUnderloadedRegionsList.begin(), mUnderloadedRegionsList.end(), sibling);
-    mUnderloadedRegionsList.erase(sibling_it);
-
-    std::cout << "Merged " << parent->mLeftChild->mServer << " : " << parent->mRightChild->mServer << "!\n";
-
-    delete parent->mLeftChild;
-    delete parent->mRightChild;
-    parent->mLeftChild = NULL;
-    parent->mRightChild = NULL;
-
+  if (segInfoVector.empty())
+    return;
 
-    break;
-  }
+  Thread thrd("CSeg Notify Space Servers", boost::bind(&DistributedCoordinateSegmentation::notifySpaceServersOfChange,mCSeg,segInfoVector));
 }
 
 uint32 LoadBalancer::numAvailableServers() {
@@ -37,9 +37,11 @@
 #include <sirikata/core/service/PollingService.hpp>
 #include <sirikata/space/SegmentedRegion.hpp>
 #include "CSegContext.hpp"
+#include "LoadBalancePlanner.hpp"
 
 #include "Protocol_CSeg.pbj.hpp"
 
+#include <fstream>
 
 namespace Sirikata {
 
@@ -58,26 +60,44 @@ public:
   LoadBalancer(DistributedCoordinateSegmentation*, int nservers, const Vector3ui32& perdim);
   ~LoadBalancer();
 
-  void reportRegionLoad(SegmentedRegion* region, ServerID sid, uint32 loadValue);
+  void reportRegionLoad(SegmentedRegion* region, ServerID sid, const RegionLoad& load);
   void handleSegmentationChange(Sirikata::Protocol::CSeg::ChangeMessage segChangeMessage);
 
-  void service();
+  // Returns true if the segmentation was changed.
+  bool service();
 
   uint32 numAvailableServers() ;
 
-  
+  // Planner parameters for the given policy, taken from the options.
+  static LoadBalancePlanner::Parameters parametersFromOptions(const String& policy);
+
+  // Read a load report in the format used in the load report log. Returns
+  // false if the line couldn't be parsed.
+  static bool parseLoadReportLog(const String& line, Duration* time, ServerID* sid,
+                                 BoundingBox3f* bbox, RegionLoad* load);
 
 private:
 
-  uint32 getAvailableServerIndex();
-   
-  
-  std::vector<SegmentedRegion*> mOverloadedRegionsList;
-  std::vector<SegmentedRegion*> mUnderloadedRegionsList;    
-  boost::mutex mOverloadedRegionsListMutex;
-  boost::mutex mUnderloadedRegionsListMutex;
+  void logLoadReport(ServerID sid, const BoundingBox3f& bbox, const RegionLoad& load);
+  // Sends changed regions to the space servers once their whole-tree regions
+  // are known, requesting any that aren't cached yet.
+  void sendPendingRegionChanges();
+
+  LoadBalancePlanner mPlanner;
+  LoadBalancePlanner::LoadMap mRegionLoads;
+  boost::mutex mRegionLoadsMutex;
+
+  Duration mBalanceInterval;
+  Time mNextBalanceTime;
 
   std::vector<ServerAvailability> mAvailableServers;
+  // Servers whose regions changed but haven't been sent out yet, and whether
+  // their whole-tree region has been requested
+  typedef std::map<ServerID, bool> PendingRegionMap;
+  PendingRegionMap mPendingRegionChanges;
+
+  std::ofstream mLoadReportLog;
+  Time mStartTime;
 
   DistributedCoordinateSegmentation* mCSeg;
 
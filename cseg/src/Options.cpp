@@ -65,6 +65,21 @@ void InitCSegOptions() {
 
       .addOption(new OptionValue("num-upper-tree-cseg-servers", "1", Sirikata::OptionValueType<uint16>(), "Number of CSEG servers that solely maintain the upper tree"))
 
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_POLICY, "planned", Sirikata::OptionValueType<String>(), "Load balancing policy: planned (multiple histogram guided splits and merges per round) or threshold (one midpoint split or merge per round)"))
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_INTERVAL, "1s", Sirikata::OptionValueType<Duration>(), "Minimum time between load balancing rounds"))
+      .addOption(new OptionValue(OPT_CSEG_SPLIT_LOAD, "2000", Sirikata::OptionValueType<float>(), "Regions with load above this are split"))
+      .addOption(new OptionValue(OPT_CSEG_MERGE_LOAD, "100", Sirikata::OptionValueType<float>(), "Sibling regions with combined load below this are merged"))
+      .addOption(new OptionValue(OPT_CSEG_SPLIT_TARGET, "0.75", Sirikata::OptionValueType<float>(), "Fraction of the split load splits try to leave each half below"))
+      .addOption(new OptionValue(OPT_CSEG_MESSAGE_WEIGHT, "0", Sirikata::OptionValueType<float>(), "Weight of a region's message rate (messages/s) relative to its object count when computing its load"))
+      .addOption(new OptionValue(OPT_CSEG_MAX_BALANCE_ACTIONS, "4", Sirikata::OptionValueType<uint32>(), "Maximum number of splits and merges per load balancing round"))
+      .addOption(new OptionValue(OPT_CSEG_MAX_BALANCE_MIGRATIONS, "0", Sirikata::OptionValueType<uint32>(), "Maximum number of expected object migrations per load balancing round, or 0 for no limit"))
+      .addOption(new OptionValue(OPT_CSEG_LOAD_REPORT_LOG, "", Sirikata::OptionValueType<String>(), "If non-empty, load reports are recorded to this file for use with the load balancing simulator"))
+
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_SIM_TRACE, "", Sirikata::OptionValueType<String>(), "If non-empty, run the offline load balancing simulator on this recorded load report file instead of starting the CSEG server"))
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_SIM_POLICIES, "planned,threshold", Sirikata::OptionValueType<String>(), "Comma separated list of load balancing policies to compare in the simulator"))
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_SIM_GRID, "64", Sirikata::OptionValueType<uint32>(), "Resolution of the grid the simulator uses to model load across the world"))
+      .addOption(new OptionValue(OPT_CSEG_BALANCE_SIM_BINS, "16", Sirikata::OptionValueType<uint32>(), "Number of histogram bins per axis in the load reports the simulator generates"))
+
       ;
 }
 
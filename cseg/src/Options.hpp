@@ -35,6 +35,21 @@
 
 #define OPT_CSEG_PLUGINS           "cseg.plugins"
 
+#define OPT_CSEG_BALANCE_POLICY           "cseg-balance-policy"
+#define OPT_CSEG_BALANCE_INTERVAL         "cseg-balance-interval"
+#define OPT_CSEG_SPLIT_LOAD               "cseg-split-load"
+#define OPT_CSEG_MERGE_LOAD               "cseg-merge-load"
+#define OPT_CSEG_SPLIT_TARGET             "cseg-split-target"
+#define OPT_CSEG_MESSAGE_WEIGHT           "cseg-message-weight"
+#define OPT_CSEG_MAX_BALANCE_ACTIONS      "cseg-max-balance-actions"
+#define OPT_CSEG_MAX_BALANCE_MIGRATIONS   "cseg-max-balance-migrations"
+#define OPT_CSEG_LOAD_REPORT_LOG          "cseg-load-report-log"
+
+#define OPT_CSEG_BALANCE_SIM_TRACE        "cseg-balance-sim-trace"
+#define OPT_CSEG_BALANCE_SIM_POLICIES     "cseg-balance-sim-policies"
+#define OPT_CSEG_BALANCE_SIM_GRID         "cseg-balance-sim-grid"
+#define OPT_CSEG_BALANCE_SIM_BINS         "cseg-balance-sim-bins"
+
 namespace Sirikata {
 
 void InitCSegOptions();
@@ -38,6 +38,9 @@
 #include <sirikata/core/trace/Trace.hpp>
 #include <sirikata/core/network/ServerIDMap.hpp>
 #include "DistributedCoordinateSegmentation.hpp"
+#include "LoadBalancer.hpp"
+#include "LoadBalanceSimulator.hpp"
+#include <boost/algorithm/string.hpp>
 
 int main(int argc, char** argv) {
     using namespace Sirikata;
@@ -63,6 +66,41 @@ int main(int argc, char** argv) {
 
     ReportVersion(); // After options so log goes to the right place
 
+    BoundingBox3f region = GetOptionValue<BoundingBox3f>("region");
+    Vector3ui32 layout = GetOptionValue<Vector3ui32>("layout");
+
+    uint32 max_space_servers = GetOptionValue<uint32>("max-servers");
+    if (max_space_servers == 0)
+      max_space_servers = layout.x * layout.y * layout.z;
+
+    // Offline load balancing simulation doesn't need any of the networking
+    String balance_sim_trace = GetOptionValue<String>(OPT_CSEG_BALANCE_SIM_TRACE);
+    if (!balance_sim_trace.empty()) {
+        LoadBalanceSimulator sim(region, layout, max_space_servers,
+            GetOptionValue<uint32>(OPT_CSEG_BALANCE_SIM_GRID),
+            GetOptionValue<uint32>(OPT_CSEG_BALANCE_SIM_BINS),
+            GetOptionValue<Duration>(OPT_CSEG_BALANCE_INTERVAL));
+        if (!sim.loadTrace(balance_sim_trace))
+            return 1;
+
+        std::vector<String> policies;
+        boost::algorithm::split(policies, GetOptionValue<String>(OPT_CSEG_BALANCE_SIM_POLICIES), boost::algorithm::is_any_of(","));
+        for(uint32 i = 0; i < policies.size(); i++) {
+            if (policies[i].empty()) continue;
+            LoadBalanceSimulator::Results res = sim.run(LoadBalancer::parametersFromOptions(policies[i]));
+            SILOG(cseg, info, policies[i] << ": " << res.rounds << " rounds, "
+                << res.splits << " splits, " << res.merges << " merges, "
+                << res.migrations << " migrations, "
+                << res.overloadedLeafRounds << " overloaded leaf-rounds, "
+                << "mean max/avg load " << res.meanImbalance << ", "
+                << "peak load " << res.maxLoad << ", "
+                << "peak servers " << res.maxServers);
+        }
+
+        Sirikata::Logging::finishLog();
+        return 0;
+    }
+
     ServerID server_id = GetOptionValue<ServerID>("cseg-id");
     String trace_file = GetPerServerFile(STATS_TRACE_FILE, server_id);
     Trace::Trace* trace = new Trace::Trace(trace_file);
@@ -85,13 +123,6 @@ int main(int argc, char** argv) {
     String timeseries_options = GetOptionValue<String>(OPT_TRACE_TIMESERIES_OPTIONS);
     Trace::TimeSeries* time_series = Trace::TimeSeriesFactory::getSingleton().getConstructor(timeseries_type)(cseg_context, timeseries_options);
 
-    BoundingBox3f region = GetOptionValue<BoundingBox3f>("region");
-    Vector3ui32 layout = GetOptionValue<Vector3ui32>("layout");
-
-    uint32 max_space_servers = GetOptionValue<uint32>("max-servers");
-    if (max_space_servers == 0)
-      max_space_servers = layout.x * layout.y * layout.z;
-
     srand( GetOptionValue<uint32>("rand-seed") );
 
     String servermap_type = GetOptionValue<String>("servermap");
@@ -41,9 +41,12 @@
 #define OPT_EXTRA_PLUGINS         "extra-plugins"
 
 #define OPT_LOG_FILE                  "log-file"
+#define OPT_LOG_ASYNC                 "log-async"
 #define STATS_TRACE_FILE     "stats.trace-filename"
 #define PROFILE                    "profile"
 
+#define OPT_OH_SESSION_BATCH     "ohsessionbatch"
+
 #define OPT_REGION_WEIGHT        "region-weight"
 #define OPT_REGION_WEIGHT_ARGS   "region-weight-args"
 
@@ -53,6 +56,12 @@
 #define OPT_CDN_DOWNLOAD_URI_PREFIX     "cdn.download.prefix"
 #define OPT_CDN_UPLOAD_URI_PREFIX   "cdn.upload.prefix"
 #define OPT_CDN_UPLOAD_STATUS_URI_PREFIX   "cdn.upload.status.prefix"
+#define OPT_CDN_RANGE_THRESHOLD  "cdn.range.threshold"
+#define OPT_CDN_RANGE_PARALLEL   "cdn.range.parallel"
+
+#define OPT_HTTP_MAX_CONNECTIONS                "http.max-connections"
+#define OPT_HTTP_MAX_CONNECTIONS_PER_ENDPOINT   "http.max-connections-per-endpoint"
+#define OPT_HTTP_PIPELINE_DEPTH                 "http.pipeline-depth"
 
 #define OPT_TRACE_TIMESERIES           "trace.timeseries"
 #define OPT_TRACE_TIMESERIES_OPTIONS   "trace.timeseries-options"
@@ -89,6 +89,9 @@ public:
     }
     // WARNING: The evaluates Timer::now, which shouldn't be done too often
     Time simTime() const {
+        if (mVirtualClock)
+            return mLastSimTime.read();
+
         Time curt = simTime( Timer::now() );
 
 #if FORCE_MONOTONIC_CLOCK
@@ -111,6 +114,23 @@ public:
         return this->mLastSimTime.read();
     }
 
+    /** Stop following the system clock and report the time set by
+     *  setVirtualSimTime as the simulation time instead. This lets recorded
+     *  traces be replayed with deterministic timestamps. Only simTime() is
+     *  affected: timers posted to the IOService and profiling still use the
+     *  real clock. This must be called once, before any other threads use the
+     *  context, and can't be undone.
+     */
+    void useVirtualSimTime(const Time& start) {
+        mLastSimTime = start;
+        mVirtualClock = true;
+    }
+    /** Set the time simTime() reports. Only valid after useVirtualSimTime. */
+    void setVirtualSimTime(const Time& t) {
+        assert(mVirtualClock);
+        mLastSimTime = t;
+    }
+
     /** In a few, rare cases, you'll need the *actual* time representation
      *  rather than an offset since the start of simulation. In those cases,
      *  this method gives you the real time, in UTC. Note that this is still in
@@ -196,6 +216,8 @@ protected:
 
     Sirikata::AtomicValue<Time> mEpoch;
     Sirikata::AtomicValue<Time> mLastSimTime;
+    // Only set during startup, so it is safe to read without synchronization
+    bool mVirtualClock;
     Duration mSimDuration;
     typedef std::vector<Service*> ServiceList;
     ServiceList mServices;
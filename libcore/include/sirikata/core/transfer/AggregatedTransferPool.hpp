@@ -24,16 +24,13 @@ public:
         boost::unique_lock<boost::mutex> lock(mMutex);
         for(RequestDataMap::iterator it = mRequestData.begin(); it != mRequestData.end(); it++) {
             setRequestDeletion(it->second.aggregateRequest);
-            mDeltaQueue.push(it->second.aggregateRequest);
+            pushDelta(it->second.aggregateRequest);
         }
     }
 
     //Puts a request into the pool
     virtual void addRequest(TransferRequestPtr req) {
-        if (!req) {
-            mDeltaQueue.push(req);
-            return;
-        }
+        if (!req) return;
 
         boost::unique_lock<boost::mutex> lock(mMutex);
 
@@ -101,7 +98,7 @@ public:
         setRequestClientID(it->second.aggregateRequest);
         setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
 
-        mDeltaQueue.push(it->second.aggregateRequest);
+        pushDelta(it->second.aggregateRequest);
     }
 
     //Updates priority of a request in the pool
@@ -122,7 +119,7 @@ public:
         setRequestPriority(req, p);
         // Update aggregate priority
         setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
-        mDeltaQueue.push(it->second.aggregateRequest);
+        pushDelta(it->second.aggregateRequest);
     }
 
     //Updates priority of a request in the pool
@@ -151,19 +148,19 @@ public:
         // aggregate and clean up.
         if (it->second.inputRequests.empty()) {
             setRequestDeletion(it->second.aggregateRequest);
-            mDeltaQueue.push(it->second.aggregateRequest);
+            pushDelta(it->second.aggregateRequest);
             mRequestData.erase(it);
         }
         else {
             // Otherwise, update priority
             setRequestPriority(it->second.aggregateRequest, mAggregationAlgorithm->aggregate(it->second.inputRequests));
-            mDeltaQueue.push(it->second.aggregateRequest);
+            pushDelta(it->second.aggregateRequest);
         }
 
     }
 
 private:
-    // Friend in TransferMediator so it can construct, call getRequest
+    // Friend in TransferMediator so it can construct
     friend class TransferMediator;
 
     AggregatedTransferPool(const std::string &clientID)
@@ -173,13 +170,6 @@ private:
         mAggregationAlgorithm = new MaxPriorityAggregation();
     }
 
-    //Returns an item from the pool. Blocks if pool is empty.
-    inline std::tr1::shared_ptr<TransferRequest> getRequest() {
-        std::tr1::shared_ptr<TransferRequest> retval;
-        mDeltaQueue.blockingPop(retval);
-        return retval;
-    }
-
 
     // Handle metadata callback, sending data to callbacks
     void handleMetadata(const String input_identifier, MetadataRequestPtr req, RemoteFileMetadataPtr response) {
@@ -305,9 +295,6 @@ private:
     // UniqueID -> RequestData
     typedef std::tr1::unordered_map<String, RequestData> RequestDataMap;
     RequestDataMap mRequestData;
-
-    // Requests to the TransferMediator
-    ThreadSafeQueue<TransferRequestPtr> mDeltaQueue;
 };
 
 } // namespace Transfer
@@ -40,7 +40,7 @@ public:
      * Reads the chunk referenced and calls callback when completed
      */
     void get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback);
 
     static DataChunkHandler& getSingleton();
     static void destroy();
@@ -37,6 +37,8 @@
 #include <sirikata/core/util/Platform.hpp>
 #include <string>
 #include <deque>
+#include <queue>
+#include <limits>
 #include <sstream>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
@@ -46,14 +48,14 @@
 #ifdef check
 #undef check
 #endif
-#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/copy.hpp>
 #include <sirikata/core/network/IOServicePool.hpp>
 #include <sirikata/core/network/IOWork.hpp>
 #include <sirikata/core/network/Asio.hpp>
 #include <sirikata/core/network/Address.hpp>
 #include <sirikata/core/transfer/TransferData.hpp>
+#include <sirikata/core/transfer/Defs.hpp>
 
 
 // This is a hack around a problem created by different packages
@@ -93,6 +95,12 @@ namespace Transfer {
 
 /*
  * Handles managing connections to the CDN
+ *
+ * Requests are queued per endpoint (host:port) and ordered by priority. Each
+ * endpoint gets a pool of persistent connections, limited both per endpoint
+ * and in total. Once a server has shown that it keeps HTTP/1.1 connections
+ * open, GET and HEAD requests are pipelined on them, so many small requests
+ * don't each pay a round trip.
  */
 class SIRIKATA_EXPORT HttpManager
     : public AutoSingleton<HttpManager> {
@@ -153,6 +161,10 @@ public:
      *
      * Note that getContentLength might not be a valid value. If there was no
      * content length header in the response, getContentLength is undefined.
+     *
+     * Bodies with Content-Encoding: gzip are decompressed as they arrive, so
+     * getData and getContentLength refer to the decoded body. For streaming
+     * requests the body is handed out in pieces instead and getData is null.
      */
     class HttpResponse {
     protected:
@@ -162,10 +174,15 @@ public:
         LAST_HEADER_CB mLastCallback;
         bool mHeaderComplete;
         bool mMessageComplete;
-        http_parser_settings mHttpSettings;
-        http_parser mHttpParser;
         bool mGzip;
-        std::stringstream mCompressedStream;
+        // Set for gzip encoded bodies, writes decoded data back to the response
+        std::tr1::shared_ptr<boost::iostreams::filtering_ostream> mDecompressor;
+        // Whether the body goes to the request's BodyCallback instead of mData
+        bool mStreaming;
+        // Decoded body bytes received so far
+        uint64 mBodyLength;
+        // Streamed body data that hasn't been handed out yet
+        std::vector<MutableDenseDataPtr> mPieces;
         //
 
         Headers mHeaders;
@@ -175,7 +192,7 @@ public:
 
         HttpResponse()
             : mLastCallback(NONE), mHeaderComplete(false), mMessageComplete(false),
-              mGzip(false), mContentLength(0), mStatusCode(0) {}
+              mGzip(false), mStreaming(false), mBodyLength(0), mContentLength(0), mStatusCode(0) {}
     public:
         inline std::tr1::shared_ptr<DenseData> getData() { return mData; }
         inline const Headers& getHeaders() { return mHeaders; }
@@ -212,9 +229,35 @@ public:
                 const boost::system::error_code& boost_error
             )> HttpCallback;
 
+    /*
+     * Callback for body data of a streaming request. Each piece holds the
+     * next part of the decoded body and its range gives the offset of the
+     * piece within the body. If a request has to be retried after part of
+     * the body was delivered, the same ranges may be delivered again.
+     */
+    typedef std::tr1::function<void(DenseDataPtr piece)> BodyCallback;
+
     static HttpManager& getSingleton();
     static void destroy();
 
+    /** Priority used for requests that don't specify one. These are usually
+     *  API calls rather than asset downloads, so they go ahead of everything
+     *  else.
+     */
+    static Priority defaultPriority() {
+        return std::numeric_limits<Priority>::max();
+    }
+
+    /** Change the connection limits. Existing connections above the new limits
+     *  are closed as they become idle. Limits are initially taken from the
+     *  http.* options.
+     */
+    void setConnectionLimits(uint32 max_connections, uint32 max_connections_per_endpoint);
+    /** Change the maximum number of requests outstanding on one connection. 1
+     *  disables pipelining.
+     */
+    void setPipelineDepth(uint32 depth);
+
     //Methods supported
     enum HTTP_METHOD {
         HEAD,
@@ -228,7 +271,8 @@ public:
      *  should ensure is properly formatted. Usually you should use the
      *  convenience wrappers that format the request for you.
      */
-    void makeRequest(Sirikata::Network::Address addr, HTTP_METHOD method, std::string req, bool allow_redirects, HttpCallback cb);
+    void makeRequest(Sirikata::Network::Address addr, HTTP_METHOD method, std::string req, bool allow_redirects, HttpCallback cb,
+        Priority priority = defaultPriority());
 
     /** Formats and makes an HTTP request and calls cb when finished. This
      *  version is a utility for the more specific request types (i.e. head()
@@ -246,13 +290,16 @@ public:
      *         probably include headers to specify it's format
      *  \param allow_redirects if true, redirects will be followed, triggering a
      *         new requests
+     *  \param priority requests to the same endpoint are made in order of
+     *         decreasing priority
      */
     void makeRequest(
         Sirikata::Network::Address addr, HTTP_METHOD method, const String& path,
         HttpCallback cb,
         const Headers& headers = Headers(), const QueryParameters& query_params = QueryParameters(),
         const String& body = "",
-        bool allow_redirects = true
+        bool allow_redirects = true,
+        Priority priority = defaultPriority()
     );
 
     static String formatURLEncodedDictionary(const StringDictionary& query_params);
@@ -262,13 +309,26 @@ public:
     void head(
         Sirikata::Network::Address addr, const String& path,
         HttpCallback cb, const Headers& headers = Headers(), const QueryParameters& query_params = QueryParameters(),
-        bool allow_redirects = true
+        bool allow_redirects = true, Priority priority = defaultPriority()
     );
 
     void get(
         Sirikata::Network::Address addr, const String& path,
         HttpCallback cb, const Headers& headers = Headers(), const QueryParameters& query_params = QueryParameters(),
-        bool allow_redirects = true
+        bool allow_redirects = true, Priority priority = defaultPriority()
+    );
+
+    /** Like get(), but successful (2xx) response bodies are passed to body_cb
+     *  piece by piece as they arrive instead of being collected, so
+     *  processing can start before the download completes and the body never
+     *  has to be held in one buffer. cb is invoked once the response is
+     *  complete, with a response that has no data.
+     */
+    void getStreaming(
+        Sirikata::Network::Address addr, const String& path,
+        BodyCallback body_cb, HttpCallback cb,
+        const Headers& headers = Headers(), const QueryParameters& query_params = QueryParameters(),
+        bool allow_redirects = true, Priority priority = defaultPriority()
     );
 
     /** Perform an HTTP POST using the specified content type and message
@@ -315,6 +375,9 @@ protected:
     static void formatURLEncodedDictionary(std::ostream& os, const StringDictionary& query_params);
     // Formats the entire path portion of a URL -- path + query args
     static void formatPath(std::ostream& os, const String& path, const QueryParameters& query_params);
+    // Formats a complete HTTP request
+    static String formatRequest(HTTP_METHOD method, const String& path,
+        const Headers& headers, const QueryParameters& query_params, const String& body);
 private:
     //For convenience
     typedef Sirikata::Network::IOServicePool IOServicePool;
@@ -332,13 +395,18 @@ private:
         const HttpCallback cb;
         const HTTP_METHOD method;
         const bool allow_redirects;
-        HttpRequest(Sirikata::Network::Address _addr, std::string _req, HTTP_METHOD meth, bool _allow_redirects, HttpCallback _cb)
-         : addr(_addr), req(_req), cb(_cb), method(meth), allow_redirects(_allow_redirects),
-           mNumTries(0), mLastCallback(NONE), mHeaderComplete(false) {}
+        const Priority priority;
+        // Set for streaming requests
+        BodyCallback body_cb;
+        HttpRequest(Sirikata::Network::Address _addr, std::string _req, HTTP_METHOD meth, bool _allow_redirects, HttpCallback _cb, Priority _priority)
+         : addr(_addr), req(_req), cb(_cb), method(meth), allow_redirects(_allow_redirects), priority(_priority),
+           mNumTries(0), mSeqNo(0), mLastCallback(NONE), mHeaderComplete(false) {}
 
         friend class HttpManager;
     protected:
         uint32 mNumTries;
+        // Order the request was made in, breaks ties between equal priorities
+        uint64 mSeqNo;
         http_parser_settings mHttpSettings;
         http_parser mHttpParser;
         std::string mTempHeaderField;
@@ -347,60 +415,129 @@ private:
         bool mHeaderComplete;
         Headers mHeaders;
     };
+    typedef std::tr1::shared_ptr<HttpRequest> HttpRequestPtr;
+
+    // Puts the highest priority, oldest request at the top of a priority_queue
+    struct HttpRequestPriorityLess {
+        bool operator()(const HttpRequestPtr& lhs, const HttpRequestPtr& rhs) const {
+            if (lhs->priority != rhs->priority) return (lhs->priority < rhs->priority);
+            return (lhs->mSeqNo > rhs->mSeqNo);
+        }
+    };
 
     //Holds a queue of requests to be made
-    typedef std::list<std::tr1::shared_ptr<HttpRequest> > RequestQueueType;
-    RequestQueueType mRequestQueue;
-    //Lock this to access mRequestQueue
-    boost::mutex mRequestQueueLock;
+    typedef std::priority_queue<HttpRequestPtr, std::vector<HttpRequestPtr>, HttpRequestPriorityLess> RequestQueueType;
 
-    //TODO: should get these from settings
-    static const uint32 MAX_CONNECTIONS_PER_ENDPOINT = 2;
-    static const uint32 MAX_TOTAL_CONNECTIONS = 10;
-    static const uint32 SOCKET_BUFFER_SIZE = 10240;
+    /*
+     * A connection to an endpoint. Requests are written in the order they
+     * were assigned and responses arrive in the same order, so the response
+     * being parsed always belongs to mInFlight.front().
+     */
+    class Connection {
+    public:
+        Connection(Sirikata::Network::IOService* ios, const Sirikata::Network::Address& _addr);
 
+        const Sirikata::Network::Address addr;
+        std::tr1::shared_ptr<TCPSocket> socket;
+
+        // Requests assigned to this connection, oldest first. The first
+        // mNumWritten have been sent.
+        std::deque<HttpRequestPtr> mInFlight;
+        uint32 mNumWritten;
+
+        bool mConnected;
+        bool mWriting;
+        bool mReading;
+        // Set once the server has shown it keeps HTTP/1.1 connections open
+        bool mPipelining;
+        // Set when the server is going to close the connection, nothing else
+        // may be assigned to it
+        bool mClosing;
+        bool mClosed;
+        // Number of complete responses received
+        uint32 mNumResponses;
+
+        std::vector<unsigned char> mReadBuffer;
+        http_parser mHttpParser;
+        // Response for mInFlight.front()
+        std::tr1::shared_ptr<HttpResponse> mResponse;
+        // Responses parsed during the current read, waiting for callbacks
+        typedef std::vector<std::pair<HttpRequestPtr, std::tr1::shared_ptr<HttpResponse> > > CompletedList;
+        CompletedList mCompleted;
+    };
+    typedef std::tr1::shared_ptr<Connection> ConnectionPtr;
+
+    // Pending requests and open connections for one host:port pair
+    struct Endpoint {
+        RequestQueueType pending;
+        std::vector<ConnectionPtr> connections;
+    };
+    typedef std::map<Sirikata::Network::Address, Endpoint> EndpointMap;
+    EndpointMap mEndpoints;
     //Keeps track of the total number of connections currently open
     uint32 mNumTotalConnections;
+    uint64 mNextSeqNo;
+    //Lock this to access mEndpoints, mNumTotalConnections, mNextSeqNo or any
+    //Connection's state
+    boost::mutex mEndpointsLock;
 
-    //Keeps track of the number of connections open per host:port pair
-    typedef std::map<Sirikata::Network::Address, uint32> NumConnsType;
-    NumConnsType mNumConnsPerAddr;
-    //Lock this to access mNumTotalConnections or mNumConnsPerAddr
-    boost::mutex mNumConnsLock;
+    uint32 mMaxConnections;
+    uint32 mMaxConnectionsPerEndpoint;
+    uint32 mPipelineDepth;
 
-    //Holds connections that are open but not being used
-    typedef std::map<Sirikata::Network::Address,
-        std::queue<std::tr1::shared_ptr<TCPSocket> > > RecycleBinType;
-    RecycleBinType mRecycleBin;
-    //Lock this to access mRecycleBin
-    boost::mutex mRecycleBinLock;
+    static const uint32 SOCKET_BUFFER_SIZE = 65536;
+    // Number of times a request is retried after connection failures
+    static const uint32 MAX_TRIES = 10;
 
     IOServicePool* mServicePool;
     TCPResolver* mResolver;
 
     http_parser_settings EMPTY_PARSER_SETTINGS;
+    http_parser_settings mResponseSettings;
+
+    // Requests that have given up, with the error to report
+    struct FailedRequest {
+        FailedRequest(HttpRequestPtr _req, ERR_TYPE _error, const boost::system::error_code& _ec)
+         : req(_req), error(_error), ec(_ec) {}
+        HttpRequestPtr req;
+        ERR_TYPE error;
+        boost::system::error_code ec;
+    };
+    typedef std::vector<FailedRequest> FailedList;
 
-    void processQueue();
-
-    void add_req(std::tr1::shared_ptr<HttpRequest> req);
-    void decrement_connection(const Sirikata::Network::Address& addr);
-    void write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req);
+    // Body data for streaming requests waiting to be handed out
+    typedef std::vector<std::pair<HttpRequestPtr, MutableDenseDataPtr> > PieceList;
 
-    void handle_resolve(std::tr1::shared_ptr<HttpRequest> req, const boost::system::error_code& err,
+    void enqueue_request(HttpRequestPtr req);
+    void processQueue();
+    void add_req(HttpRequestPtr req);
+    void notify_failed(const FailedList& failed);
+    void handle_response(HttpRequestPtr req, std::tr1::shared_ptr<HttpResponse> respPtr);
+
+    // All of these require mEndpointsLock to be held
+    void dispatch(Endpoint& ep, const Sirikata::Network::Address& addr);
+    bool canPipeline(const ConnectionPtr& conn, const HttpRequestPtr& req) const;
+    ConnectionPtr open_connection(Endpoint& ep, const Sirikata::Network::Address& addr);
+    bool close_idle_connection(const Sirikata::Network::Address& except);
+    void start_write(ConnectionPtr conn);
+    void start_read(ConnectionPtr conn);
+    void close_connection(ConnectionPtr conn, bool count_try, const boost::system::error_code& ec, FailedList* failed);
+    static void take_pieces(const HttpRequestPtr& req, HttpResponse* resp, PieceList* pieces);
+
+    void handle_resolve(ConnectionPtr conn, const boost::system::error_code& err,
             TCPResolver::iterator endpoint_iterator);
-    void handle_connect(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-            const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator);
-    void handle_write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
+    void handle_connect(ConnectionPtr conn, const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator);
+    void handle_write_request(ConnectionPtr conn, uint32 count,
             const boost::system::error_code& err, std::tr1::shared_ptr<boost::asio::streambuf> request_stream);
-    void handle_read(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-            std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf, std::tr1::shared_ptr<HttpResponse> respPtr,
-            const boost::system::error_code& err, std::size_t bytes_transferred);
+    void handle_read(ConnectionPtr conn, const boost::system::error_code& err, std::size_t bytes_transferred);
 
     static int on_header_field(http_parser *_, const char *at, size_t len);
     static int on_header_value(http_parser *_, const char *at, size_t len);
     static int on_headers_complete(http_parser *_);
     static int on_body(http_parser *_, const char *at, size_t len);
     static int on_message_complete(http_parser *_);
+    static std::tr1::shared_ptr<HttpResponse> new_response();
+    static void append_body(HttpResponse* resp, const char* at, size_t len);
 
     static int on_request_header_field(http_parser *_, const char *at, size_t len);
     static int on_request_header_value(http_parser *_, const char *at, size_t len);
@@ -415,7 +552,7 @@ private:
       , F_SKIPBODY = 1 << 5
       };
 
-    static void print_flags(std::tr1::shared_ptr<HttpResponse> resp);
+    static void print_flags(const http_parser& parser, std::tr1::shared_ptr<HttpResponse> resp);
 
 public:
 
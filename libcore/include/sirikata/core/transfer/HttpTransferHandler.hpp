@@ -52,7 +52,7 @@ class SIRIKATA_EXPORT HttpChunkHandler
 
 private:
     void cache_check_callback(const SparseData* data, std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback);
 
 public:
     HttpChunkHandler();
@@ -62,7 +62,7 @@ public:
      * Downloads the chunk referenced and calls callback when completed
      */
     void get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback);
 
     /*
      * Callback from HttpManager when an http request finishes
@@ -90,22 +90,77 @@ private:
     const Network::Address mCdnAddr;
 
     void cache_check_callback(const SparseData* data, const URI& uri,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+            ChunkPieceCallback piece_callback, ChunkCallback callback);
+    // Requests the whole chunk with a single request
+    void request_chunk(const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
+            const Network::Address& cdn_addr, const String& path, HttpManager::Headers headers,
+            Priority priority, ChunkPieceCallback piece_callback, ChunkCallback callback);
+    // Collects a piece of a streamed chunk and passes on whatever is new
+    static void request_data(DenseDataPtr piece, MutableDenseDataPtr assembled,
+            ChunkPieceCallback piece_callback);
+
+    // Large chunks are downloaded as several Range requests in parallel,
+    // written directly into a single buffer
+    struct RangedDownload;
+    typedef std::tr1::shared_ptr<RangedDownload> RangedDownloadPtr;
+    // Starts a ranged download if the chunk is large enough to be worth it,
+    // returning false if it should be requested normally
+    bool start_ranged(const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
+            const Network::Address& cdn_addr, const String& path, const HttpManager::Headers& headers,
+            Priority priority, ChunkPieceCallback piece_callback, ChunkCallback callback);
+    void request_range(RangedDownloadPtr dl, uint32 part);
+    static void range_data(RangedDownloadPtr dl, uint32 part, DenseDataPtr piece);
+    void range_finished(RangedDownloadPtr dl, uint32 part,
+            std::tr1::shared_ptr<HttpManager::HttpResponse> response,
+            HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error);
+    // Size of parts for new ranged downloads, based on observed throughput
+    uint64 rangePartSize();
+    void recordRangeThroughput(uint64 bytes, const Duration& elapsed);
+
+    boost::mutex mRangeMutex;
+    uint64 mRangeThreshold;
+    uint32 mMaxParallelRanges;
+    // Moving average of bytes/s seen by parts of ranged downloads
+    double mRangeThroughput;
 
 public:
     MeerkatChunkHandler();
     ~MeerkatChunkHandler();
 
+    /*
+     * Chunks of at least threshold bytes are downloaded as several Range
+     * requests, with at most max_parallel of them outstanding at once.
+     * A threshold of 0 disables ranged downloads.
+     */
+    void setRangedDownloads(uint64 threshold, uint32 max_parallel);
+
     /*
      * Downloads the chunk referenced and calls callback when completed
      */
     void get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback);
+
+    /*
+     * Downloads the chunk referenced, passing data to piece_callback as it
+     * arrives and calling callback when completed. Chunks found in the cache
+     * only get the final callback.
+     */
+    void getStreaming(std::tr1::shared_ptr<RemoteFileMetadata> file,
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+            ChunkPieceCallback piece_callback, ChunkCallback callback);
 
     /*
      * Downloads the chunk referenced and calls callback when completed
      */
-    void get(std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback);
+    void get(std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback);
+
+    /*
+     * Downloads the chunk referenced, passing data to piece_callback as it
+     * arrives and calling callback when completed
+     */
+    void getStreaming(std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+            ChunkPieceCallback piece_callback, ChunkCallback callback);
 
     /*
      * Callback from HttpManager when an http request finishes
@@ -113,7 +168,7 @@ public:
     void request_finished(std::tr1::shared_ptr<HttpManager::HttpResponse> response,
             HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error,
             const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
-            bool chunkReq, ChunkCallback callback);
+            bool chunkReq, MutableDenseDataPtr streamed, ChunkCallback callback);
 
     static MeerkatChunkHandler& getSingleton();
     static void destroy();
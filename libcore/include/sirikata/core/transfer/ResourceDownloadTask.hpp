@@ -39,6 +39,8 @@
 #include <sirikata/core/transfer/Range.hpp>
 #include <sirikata/core/transfer/RemoteFileMetadata.hpp>
 #include <sirikata/core/util/SelfWeakPtr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 
 namespace Sirikata {
 namespace Transfer {
@@ -62,6 +64,15 @@ public:
         ResourceDownloadTaskPtr taskptr,
         TransferRequestPtr request,
         DenseDataPtr response)> DownloadCallback;
+    /* Invoked with each piece of the resource's data as it arrives, before
+     * the DownloadCallback, so consumers can start on a resource before it
+     * has finished downloading. The range of the piece gives its offset in
+     * the resource. Pieces are delivered from the transfer thread and aren't
+     * delivered at all for data that is already cached or read locally.
+     */
+    typedef std::tr1::function<void(
+        ResourceDownloadTaskPtr taskptr,
+        DenseDataPtr piece)> ProgressCallback;
 
     /* Download this resource based on URI
      * - First a name lookup will be performed for the URI
@@ -78,6 +89,9 @@ public:
 
     void mergeData(const SparseData &dataToMerge);
 
+    /* Set a callback for data as it arrives. Must be called before start(). */
+    void setProgressCallback(ProgressCallback progress_cb);
+
     void start();
 
     bool isStarted() {
@@ -108,9 +122,18 @@ protected:
         DirectChunkRequestPtr request,
         DenseDataPtr response);
 
+    static void chunkProgressWeak(ResourceDownloadTaskWPtr thiswptr,
+        DenseDataPtr piece);
+    void chunkProgress(DenseDataPtr piece);
+
     void chunkFinished(TransferRequestPtr request,
         DenseDataPtr response);
 
+    // Copies of the callbacks, taken under mCallbackMutex since cancel() may
+    // clear them from another thread while the transfer is finishing.
+    DownloadCallback callback();
+    bool hasProgressCallback();
+
     bool mStarted;
     const URI mURI;
     const Chunk mChunk;
@@ -118,7 +141,10 @@ protected:
     TransferRequestPtr mCurrentRequest;
     SparseData mMergeData;
     double mPriority;
+    // Protects cb and mProgressCallback
+    boost::mutex mCallbackMutex;
     DownloadCallback cb;
+    ProgressCallback mProgressCallback;
     const String mID;
 };
 
@@ -117,6 +117,11 @@ public:
 		mData.resize(len);
 	}
 
+	/// Allocates space for len bytes so appends up to that size don't reallocate.
+	inline void reserve(size_t len) {
+		mData.reserve(len);
+	}
+
 	//Appends len bytes from data to internal data vector and adds to length of range
 	inline void append(const char* data, size_t len, bool is_npos) {
 	    if(len <= 0) return;
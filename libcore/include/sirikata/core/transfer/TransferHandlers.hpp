@@ -76,8 +76,26 @@ public:
                 std::tr1::shared_ptr<const DenseData> response
             )> ChunkCallback;
 
+    /*
+     * Gets the chunk. priority orders the request relative to other
+     * outstanding requests, for handlers that have to queue them.
+     */
     virtual void get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) = 0;
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) = 0;
+
+    typedef std::tr1::function<void(DenseDataPtr piece)> ChunkPieceCallback;
+
+    /*
+     * Gets the chunk like get(), but also passes its data to piece_callback as
+     * it arrives, before callback is invoked with the complete chunk. The range
+     * of each piece gives its offset within the chunk. Handlers that can't
+     * stream just deliver the complete chunk.
+     */
+    virtual void getStreaming(std::tr1::shared_ptr<RemoteFileMetadata> file,
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+            ChunkPieceCallback piece_callback, ChunkCallback callback) {
+        get(file, chunk, priority, callback);
+    }
 
     virtual ~ChunkHandler() {
     }
@@ -41,8 +41,10 @@
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOServicePool.hpp>
 #include <sirikata/core/network/Asio.hpp>
 #include <sirikata/core/util/Thread.hpp>
 #include <sirikata/core/util/Singleton.hpp>
@@ -56,10 +58,29 @@ using namespace boost::multi_index;
 
 /*
  * Mediates requests for name lookups and chunk downloads
+ *
+ * Pools push their changes (new requests, priority updates and deletions)
+ * directly to the mediator, which applies them on its own IOService and
+ * starts requests as soon as there's room for them. Requests are grouped by
+ * the kind of handler that will service them, and each kind has its own limit
+ * on outstanding requests, so e.g. slow HTTP downloads don't keep data: URIs
+ * from being decoded. Within each kind the highest priority request is always
+ * started first.
  */
 class SIRIKATA_EXPORT TransferMediator
     : public AutoSingleton<TransferMediator> {
-
+public:
+    // Kinds of handlers requests are dispatched to, each with its own
+    // concurrency limit
+    enum HandlerClass {
+        HANDLER_HTTP,
+        HANDLER_FILE,
+        HANDLER_DATA,
+        HANDLER_OTHER,
+        NUM_HANDLER_CLASSES
+    };
+
+private:
     /*
      * Used to aggregate requests from different clients. If multiple clients request
      * the same file, this object keeps track of the original separate requests so that
@@ -73,6 +94,8 @@ class SIRIKATA_EXPORT TransferMediator
 		Priority mPriority;
             // Whether we've started processing this request.
             bool mExecuting;
+            // The HandlerClass that will service this request
+            uint32 mHandlerClass;
 	private:
 		//Maps each client's string ID to the original TransferRequest object
 		std::map<std::string, std::tr1::shared_ptr<TransferRequest> > mTransferReqs;
@@ -112,10 +135,12 @@ class SIRIKATA_EXPORT TransferMediator
 	//tags used to index AggregateList (see boost::multi_index)
 	struct tagID{};
 	struct tagPriority{};
+	struct tagHandler{};
 
 	/*
 	 * This multi_index_container allows the efficient retrieval of an AggregateRequest
-	 * either by its identifier or sorted by its priority
+	 * either by its identifier, sorted by its priority, or, for each handler
+	 * class, the highest priority request that hasn't been started yet
 	 */
 	typedef multi_index_container<
 		std::tr1::shared_ptr<AggregateRequest>,
@@ -123,7 +148,13 @@ class SIRIKATA_EXPORT TransferMediator
 			hashed_unique<tag<tagID>, const_mem_fun<AggregateRequest,const std::string &,&AggregateRequest::getIdentifier> >,
 			ordered_non_unique<tag<tagPriority>,
 			member<AggregateRequest,Priority,&AggregateRequest::mPriority>,
-			std::greater<Priority> >
+			std::greater<Priority> >,
+			ordered_non_unique<tag<tagHandler>,
+			composite_key<AggregateRequest,
+				member<AggregateRequest,uint32,&AggregateRequest::mHandlerClass>,
+				member<AggregateRequest,bool,&AggregateRequest::mExecuting>,
+				member<AggregateRequest,Priority,&AggregateRequest::mPriority> >,
+			composite_key_compare<std::less<uint32>, std::less<bool>, std::greater<Priority> > >
 		>
 	> AggregateList;
 	AggregateList mAggregateList;
@@ -131,73 +162,64 @@ class SIRIKATA_EXPORT TransferMediator
 	//access iterators for AggregateList for convenience (see boost::multi_index)
 	typedef AggregateList::index<tagID>::type AggregateListByID;
 	typedef AggregateList::index<tagPriority>::type AggregateListByPriority;
+	typedef AggregateList::index<tagHandler>::type AggregateListByHandler;
 
-	/*
-	 * Used to process the queue of requests coming from a single client.
-	 * There is one PoolWorker for each client, and this makes it so that the client's
-	 * thread doesn't have to block when inserting a request. Instead, the PoolWorkers
-	 * block against each other when inserting the request into the aggregated list.
-	 */
-	class PoolWorker {
-	private:
-	    //The TransferPool associated with this worker
-		std::tr1::shared_ptr<TransferPool> mTransferPool;
-
-		//The worker's thread
-		Thread * mWorkerThread;
-
-		//Set to true when worker should shut down
-		bool mCleanup;
-
-		//Runs the worker thread
-	    void run();
-
-	public:
-		//Initialize with the associated TransferPool
-		PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool);
-
-		//Returns the TransferPool this was initialized with
-		std::tr1::shared_ptr<TransferPool> getTransferPool() const;
-
-		//Returns the worker's thread
-		Thread * getThread() const;
-
-		//Signal to shut down
-		void cleanup();
+	// Used with AggregateList::modify to mark a request as started
+	struct MarkExecuting {
+	    void operator()(std::tr1::shared_ptr<AggregateRequest>& agg) const {
+	        agg->mExecuting = true;
+	    }
 	};
 
-    friend class PoolWorker;
-    //Helper for compatibility with compilers where TransferPool declaring
-    //TransferMediator as a friend does not give PoolWorker access
-    static inline std::tr1::shared_ptr<TransferRequest> getRequest(std::tr1::shared_ptr<TransferPool> pool) {
-        return pool->getRequest();
-    }
-
-	//Maps a client ID string to the PoolWorker class
-	typedef std::map<std::string, std::tr1::shared_ptr<PoolWorker> > PoolType;
+    // Maximum outstanding requests for each HandlerClass. HTTP allows enough
+    // to keep HttpManager's pipelined connections busy. Beyond that requests
+    // would just wait in HttpManager's queue, where their priorities can't be
+    // updated.
+    static const uint32 MAX_OUTSTANDING_HTTP = 16;
+    static const uint32 MAX_OUTSTANDING_FILE = 4;
+    static const uint32 MAX_OUTSTANDING_DATA = 32;
+    static const uint32 MAX_OUTSTANDING_OTHER = 4;
+
+	//Maps a client ID string to its pool
+	typedef std::map<std::string, TransferPoolPtr> PoolType;
 	//Stores the list of pools
 	PoolType mPools;
 	//lock this to access mPools
 	boost::shared_mutex mPoolMutex;
 
+    // All changes to mAggregateList and the outstanding counts happen on this
+    // single threaded IOService
+    Network::IOServicePool* mServicePool;
+
+    // Changes pushed by pools that haven't been applied yet, and whether
+    // processing them has already been posted
+    boost::mutex mDeltaMutex;
+    std::vector<TransferRequestPtr> mDeltas;
+    bool mDeltasScheduled;
+
 	//Set to true to signal shutdown
 	bool mCleanup;
-	//Number of outstanding requests
-	uint32 mNumOutstanding;
-
-	//TransferMediator's worker thread
-	Thread* mThread;
+	//Number of outstanding requests and the limit for each HandlerClass
+	uint32 mNumOutstanding[NUM_HANDLER_CLASSES];
+	uint32 mMaxOutstanding[NUM_HANDLER_CLASSES];
 
     // Algorithm used to aggregate priorities of requests
     PriorityAggregationAlgorithm* mAggregationAlgorithm;
 
-    //Main thread that handles the input pools
-    void mediatorThread();
+    static HandlerClass classify(TransferRequestPtr req);
+
+    // Called by pools, from any thread, when a request is added, updated or
+    // deleted
+    void pushDelta(TransferRequestPtr req);
+    // Applies queued changes from pools
+    void processDeltas();
+    void applyDelta(TransferRequestPtr req);
 
     //Callback for when an executed request finishes
-    void execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id);
+    void execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id, uint32 handler);
+    void handleExecuteFinished(std::tr1::shared_ptr<TransferRequest> req, std::string id, uint32 handler);
 
-    //Check our internal queue to see what request to process next
+    //Start as many of the highest priority requests as the limits allow
     void checkQueue();
 
     void registerPool(TransferPoolPtr pool);
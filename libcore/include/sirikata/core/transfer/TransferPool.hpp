@@ -35,7 +35,6 @@
 #define SIRIKATA_TransferPool_HPP__
 
 #include <sirikata/core/transfer/Defs.hpp>
-#include <sirikata/core/queue/ThreadSafeQueue.hpp>
 #include <sirikata/core/transfer/TransferRequest.hpp>
 
 namespace Sirikata {
@@ -91,14 +90,21 @@ public:
     virtual void deleteRequest(TransferRequestPtr req) = 0;
 
 protected:
-    // Friend in TransferMediator so it can construct, call getRequest
+    // Friend in TransferMediator so it can construct, set mDeltaCallback
     friend class TransferMediator;
 
+    typedef std::tr1::function<void(TransferRequestPtr)> DeltaCallback;
+
     TransferPool(const std::string& clientID)
      : mClientID(clientID)
     {}
 
-    virtual TransferRequestPtr getRequest() = 0;
+    /** Hands a new, updated or deleted request to the TransferMediator. Safe
+     *  to call from any thread, and never calls back into the pool.
+     */
+    void pushDelta(TransferRequestPtr req) {
+        if (mDeltaCallback) mDeltaCallback(req);
+    }
 
     // Utility methods because they require being friended by
     // TransferRequest but that doesn't extend to subclasses
@@ -113,6 +119,8 @@ protected:
     }
 
     const std::string mClientID;
+    // Set by the TransferMediator when the pool is registered
+    DeltaCallback mDeltaCallback;
 };
 typedef std::tr1::shared_ptr<TransferPool> TransferPoolPtr;
 
@@ -125,40 +133,31 @@ public:
 
     //Puts a request into the pool
     virtual void addRequest(TransferRequestPtr req) {
-        if (req)
-            setRequestClientID(req);
-        mDeltaQueue.push(req);
+        if (!req) return;
+        setRequestClientID(req);
+        pushDelta(req);
     }
 
     //Updates priority of a request in the pool
     virtual void updatePriority(TransferRequestPtr req, Priority p) {
         setRequestPriority(req, p);
-        mDeltaQueue.push(req);
+        pushDelta(req);
     }
 
     //Updates priority of a request in the pool
     inline void deleteRequest(TransferRequestPtr req) {
         setRequestDeletion(req);
-        mDeltaQueue.push(req);
+        pushDelta(req);
     }
 
 private:
-    // Friend in TransferMediator so it can construct, call getRequest
+    // Friend in TransferMediator so it can construct
     friend class TransferMediator;
 
-    ThreadSafeQueue<TransferRequestPtr> mDeltaQueue;
-
     SimpleTransferPool(const std::string &clientID)
      : TransferPool(clientID)
     {
     }
-
-    //Returns an item from the pool. Blocks if pool is empty.
-    inline std::tr1::shared_ptr<TransferRequest> getRequest() {
-        std::tr1::shared_ptr<TransferRequest> retval;
-        mDeltaQueue.blockingPop(retval);
-        return retval;
-    }
 };
 
 }
@@ -162,6 +162,9 @@ public:
     typedef std::tr1::function<void(
             std::tr1::shared_ptr<DirectChunkRequest> request,
             std::tr1::shared_ptr<const DenseData> response)> DirectChunkCallback;
+    typedef std::tr1::function<void(
+            std::tr1::shared_ptr<DirectChunkRequest> request,
+            DenseDataPtr piece)> DirectChunkProgressCallback;
 
     DirectChunkRequest(const Chunk &chunk, Priority priority, DirectChunkCallback cb)
             : mChunk(std::tr1::shared_ptr<Chunk>(new Chunk(chunk))),
@@ -180,6 +183,16 @@ public:
         return mID;
     }
 
+    /*
+     * Receives the chunk's data as it arrives, before the final callback.
+     * Pieces are passed directly from the transfer thread, and only the
+     * request that actually gets executed receives them, not duplicates
+     * that were merged with it. Must be set before the request is submitted.
+     */
+    inline void setProgressCallback(DirectChunkProgressCallback cb) {
+        mProgressCallback = cb;
+    }
+
     void execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb);
 
     void execute_finished(std::tr1::shared_ptr<const DenseData> response, ExecuteFinished cb);
@@ -191,6 +204,7 @@ protected:
     std::string mID;
     std::tr1::shared_ptr<Chunk> mChunk;
     DirectChunkCallback mCallback;
+    DirectChunkProgressCallback mProgressCallback;
     std::tr1::shared_ptr<const DenseData> mDenseData;
 };
 
@@ -205,6 +219,9 @@ public:
     typedef std::tr1::function<void(
             std::tr1::shared_ptr<ChunkRequest> request,
             std::tr1::shared_ptr<const DenseData> response)> ChunkCallback;
+    typedef std::tr1::function<void(
+            std::tr1::shared_ptr<ChunkRequest> request,
+            DenseDataPtr piece)> ChunkProgressCallback;
 
 	ChunkRequest(const URI &uri, const RemoteFileMetadata &metadata, const Chunk &chunk,
 	        Priority priority, ChunkCallback cb)
@@ -225,6 +242,14 @@ public:
 		return *mChunk;
 	}
 
+    /*
+     * Receives the chunk's data as it arrives, before the final callback.
+     * See DirectChunkRequest::setProgressCallback.
+     */
+    inline void setProgressCallback(ChunkProgressCallback cb) {
+        mProgressCallback = cb;
+    }
+
     void execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFinished cb);
 
     void execute_finished(std::tr1::shared_ptr<const DenseData> response, ExecuteFinished cb);
@@ -237,6 +262,7 @@ protected:
     std::tr1::shared_ptr<Chunk> mChunk;
     std::tr1::shared_ptr<const DenseData> mDenseData;
     ChunkCallback mCallback;
+    ChunkProgressCallback mProgressCallback;
 };
 
 typedef std::tr1::shared_ptr<ChunkRequest> ChunkRequestPtr;
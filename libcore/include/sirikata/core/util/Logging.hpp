@@ -34,6 +34,7 @@
 #define _SIRIKATA_LOGGING_HPP_
 
 #include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
 #include <iomanip>
 
 extern "C" SIRIKATA_EXPORT void* Sirikata_Logging_OptionValue_defaultLevel;
@@ -56,37 +57,116 @@ enum LOGGING_LEVEL {
 SIRIKATA_FUNCTION_EXPORT const String& LogModuleString(const char* base);
 SIRIKATA_FUNCTION_EXPORT const char* LogLevelString(LOGGING_LEVEL lvl, const char* lvl_as_string);
 
-// Public so the macros work efficiently instead of another call
+/** Get the effective level for a module, i.e. the most verbose level that
+ *  will be logged for it. The returned value is owned by the logging system,
+ *  stays valid for the life of the process, and is updated in place by
+ *  refreshLogLevels(), so callers (i.e. the SILOG macros) can cache the
+ *  pointer and check levels without any lookups.
+ */
+SIRIKATA_FUNCTION_EXPORT const AtomicValue<int32>* LogModuleLevel(const char* module);
+/** Look up a module's level with LogModuleLevel and publish it to a call
+ *  site's cache. Threads may race to fill the same site; they all store the
+ *  same value, and the store is a full barrier, so a thread that sees the
+ *  pointer also sees the level it points to.
+ */
+SIRIKATA_FUNCTION_EXPORT const AtomicValue<int32>* cacheLogModuleLevel(const AtomicValue<int32>* volatile* site, const char* module);
+/** Recompute cached module levels from the loglevel, maxloglevel and
+ *  moduleloglevel options. Must be called after those options are parsed.
+ */
+SIRIKATA_FUNCTION_EXPORT void refreshLogLevels();
+
+// Public so the macros work efficiently instead of another call. This is the
+// most verbose level any module currently logs at, letting disabled log calls
+// bail out before looking at their module.
+extern "C" SIRIKATA_EXPORT AtomicValue<int32> SirikataLogLevelCeiling;
+// The stream log lines are written to. Use setLogStream to change it since the
+// asynchronous writer may be using it.
 extern "C" SIRIKATA_EXPORT std::ostream* SirikataLogStream;
 
 
 SIRIKATA_FUNCTION_EXPORT void setLogStream(std::ostream* logfs);
 SIRIKATA_FUNCTION_EXPORT void finishLog();
 
+/** Write a formatted line (without trailing newline) to the log. When
+ *  asynchronous logging is enabled, the line is queued in a per-thread buffer
+ *  and written by a background thread, except for errors and fatal errors,
+ *  which are written (along with anything queued before them) before this
+ *  returns.
+ */
+SIRIKATA_FUNCTION_EXPORT void writeLogLine(LOGGING_LEVEL lvl, const String& line);
+/// Start writing log lines from a background thread.
+SIRIKATA_FUNCTION_EXPORT void startAsyncLog();
+/// Stop the background writer, writing out everything already queued.
+/// Subsequent log lines are written synchronously.
+SIRIKATA_FUNCTION_EXPORT void stopAsyncLog();
+/// Write out all queued log lines and flush the log stream.
+SIRIKATA_FUNCTION_EXPORT void flushLog();
+
+/// Check a module's level from a call site, looking it up on first use.
+inline bool logSiteEnabled(const AtomicValue<int32>* volatile* site, const char* module, int32 lvl) {
+    const AtomicValue<int32>* level = *site;
+    if (level == NULL)
+        level = cacheLogModuleLevel(site, module);
+    return level->read() >= lvl;
+}
+
+namespace {
+// Per call site storage for SILOGP, which has to work as an expression and so
+// can't declare its own static. Each call site in a translation unit uses a
+// different Site.
+template<int Site>
+struct LogSiteLevel {
+    static const AtomicValue<int32>* volatile level;
+};
+template<int Site>
+const AtomicValue<int32>* volatile LogSiteLevel<Site>::level = NULL;
+}
+
 } }
+
+// Log calls more verbose than this level are compiled out entirely, e.g. build
+// with -DSIRIKATA_MAX_COMPILED_LOG_LEVEL=info to drop all debug logging.
+#ifndef SIRIKATA_MAX_COMPILED_LOG_LEVEL
+# define SIRIKATA_MAX_COMPILED_LOG_LEVEL insane
+#endif
+#define SILOG_COMPILED(lvl) (Sirikata::Logging::lvl <= Sirikata::Logging::SIRIKATA_MAX_COMPILED_LOG_LEVEL)
+
 #if 1
 # ifdef DEBUG_ALL
 #  define SILOGP(module,lvl) true
+#  define SILOGBARE(module,lvl,value)                                   \
+    do {                                                                \
+        std::ostringstream __log_stream;                                \
+        __log_stream << value;                                          \
+        Sirikata::Logging::writeLogLine(Sirikata::Logging::lvl, __log_stream.str()); \
+    } while (0)
 # else
-//needs to use unsafeAs because the LOGGING_LEVEL typeinfos are not preserved across dll lines
-#  define SILOGP(module,lvl) \
-    ( \
-     std::max( reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_atLeastLevel)->unsafeAs<Sirikata::Logging::LOGGING_LEVEL>(), \
-	       reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_defaultLevel)->unsafeAs<Sirikata::Logging::LOGGING_LEVEL>()) \
-     >=Sirikata::Logging::lvl &&					\
-        ( (reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<std::tr1::unordered_map<std::string,Sirikata::Logging::LOGGING_LEVEL> >().find(#module)==reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<std::tr1::unordered_map<std::string,Sirikata::Logging::LOGGING_LEVEL> >().end() && \
-           reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_defaultLevel)->unsafeAs<Sirikata::Logging::LOGGING_LEVEL>()>=(Sirikata::Logging::lvl)) \
-		   || (reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<std::tr1::unordered_map<std::string,Sirikata::Logging::LOGGING_LEVEL> >().find(#module)!=reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<std::tr1::unordered_map<std::string,Sirikata::Logging::LOGGING_LEVEL> >().end() && \
-              reinterpret_cast<Sirikata::OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<std::tr1::unordered_map<std::string,Sirikata::Logging::LOGGING_LEVEL> >()[#module]>=Sirikata::Logging::lvl)))
-# endif
-# define SILOGBARE(module,lvl,value)                                    \
+#  ifdef __COUNTER__
+#   define SILOG_SITE __COUNTER__
+#  else
+// Only distinct per line, so two SILOGP checks for different modules on one
+// line would share a cached level.
+#   define SILOG_SITE __LINE__
+#  endif
+// Each call site looks up its module's level once and keeps the pointer, see
+// cacheLogModuleLevel.
+#  define SILOGP(module,lvl)                                            \
+    (SILOG_COMPILED(lvl) &&                                             \
+     Sirikata::Logging::SirikataLogLevelCeiling.read() >= Sirikata::Logging::lvl && \
+     Sirikata::Logging::logSiteEnabled(&Sirikata::Logging::LogSiteLevel<SILOG_SITE>::level, #module, Sirikata::Logging::lvl))
+#  define SILOGBARE(module,lvl,value)                                   \
     do {                                                                \
-        if (SILOGP(module,lvl)) {                                       \
-            std::ostringstream __log_stream;                            \
-            __log_stream << value;                                      \
-            (*Sirikata::Logging::SirikataLogStream) << __log_stream.str() << std::endl; \
+        if (SILOG_COMPILED(lvl) &&                                      \
+            Sirikata::Logging::SirikataLogLevelCeiling.read() >= Sirikata::Logging::lvl) { \
+            static const Sirikata::AtomicValue<Sirikata::int32>* volatile __log_module_level = NULL; \
+            if (Sirikata::Logging::logSiteEnabled(&__log_module_level, #module, Sirikata::Logging::lvl)) { \
+                std::ostringstream __log_stream;                        \
+                __log_stream << value;                                  \
+                Sirikata::Logging::writeLogLine(Sirikata::Logging::lvl, __log_stream.str()); \
+            }                                                           \
         }                                                               \
     } while (0)
+# endif
 #else
 # define SILOGP(module,lvl) false
 # define SILOGBARE(module,lvl,value)
@@ -60,6 +60,7 @@ void InitOptions() {
 
         .addOption(new OptionValue("ohstreamlib","tcpsst",Sirikata::OptionValueType<String>(),"Which library to use to communicate with the object host"))
         .addOption(new OptionValue("ohstreamoptions","--send-buffer-size=16384 --parallel-sockets=1 --no-delay=false",Sirikata::OptionValueType<String>(),"TCPSST stream options such as how many bytes to collect for sending during an ongoing asynchronous send call."))
+        .addOption(new OptionValue(OPT_OH_SESSION_BATCH,"64",Sirikata::OptionValueType<uint32>(),"Maximum number of object session messages packed into a single message between an object host and a space server. 0 or 1 sends each separately."))
 
         .addOption(new OptionValue(OPT_REGION_WEIGHT, "sqr", Sirikata::OptionValueType<String>(), "Type of region weight calculator to use, which affects communication falloff."))
         .addOption(new OptionValue(OPT_REGION_WEIGHT_ARGS, "--flatness=8 --const-cutoff=64", Sirikata::OptionValueType<String>(), "Arguments to region weight calculator."))
@@ -77,6 +78,7 @@ void InitOptions() {
         .addOption(new OptionValue("rand-seed", "0", Sirikata::OptionValueType<uint32>(), "The random seed to synchronize all servers"))
 
         .addOption(new OptionValue(OPT_LOG_FILE, "", Sirikata::OptionValueType<String>(), "Filename to log SILOG messages to. If empty or -, uses stderr"))
+        .addOption(new OptionValue(OPT_LOG_ASYNC, "true", Sirikata::OptionValueType<bool>(), "If true, SILOG messages are written by a background thread instead of by the thread logging them. Errors are always written immediately."))
         .addOption(new OptionValue(STATS_TRACE_FILE, "trace.txt", Sirikata::OptionValueType<String>(), "The filename to save the trace to"))
 
         .addOption(new OptionValue("time-server", "", Sirikata::OptionValueType<String>(), "The server to sync with"))
@@ -95,6 +97,12 @@ void InitOptions() {
         .addOption(new OptionValue(OPT_CDN_DOWNLOAD_URI_PREFIX, "/download", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP downloads."))
         .addOption(new OptionValue(OPT_CDN_UPLOAD_URI_PREFIX, "/api/upload", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP uploads."))
         .addOption(new OptionValue(OPT_CDN_UPLOAD_STATUS_URI_PREFIX, "/upload/processing", Sirikata::OptionValueType<String>(), "URI prefix for CDN HTTP upload status checks."))
+        .addOption(new OptionValue(OPT_CDN_RANGE_THRESHOLD, "4194304", Sirikata::OptionValueType<uint32>(), "Size in bytes above which CDN downloads are split into parallel range requests. 0 disables ranged downloads."))
+        .addOption(new OptionValue(OPT_CDN_RANGE_PARALLEL, "4", Sirikata::OptionValueType<uint32>(), "Maximum number of range requests outstanding for a single CDN download."))
+
+        .addOption(new OptionValue(OPT_HTTP_MAX_CONNECTIONS, "10", Sirikata::OptionValueType<uint32>(), "Maximum number of open HTTP connections."))
+        .addOption(new OptionValue(OPT_HTTP_MAX_CONNECTIONS_PER_ENDPOINT, "2", Sirikata::OptionValueType<uint32>(), "Maximum number of open HTTP connections to a single host."))
+        .addOption(new OptionValue(OPT_HTTP_PIPELINE_DEPTH, "4", Sirikata::OptionValueType<uint32>(), "Maximum number of requests outstanding on a single HTTP connection. 1 disables pipelining."))
 
         .addOption(new OptionValue(OPT_TRACE_TIMESERIES, "null", Sirikata::OptionValueType<String>(), "Service to report TimeSeries data to."))
         .addOption(new OptionValue(OPT_TRACE_TIMESERIES_OPTIONS, "", Sirikata::OptionValueType<String>(), "Options for TimeSeries reporting service."))
@@ -105,7 +113,7 @@ void InitOptions() {
 }
 
 namespace {
-void setLogOutput() {
+void setLogStream() {
     String logfile = GetOptionValue<String>(OPT_LOG_FILE);
     if (logfile != "" && logfile != "-") {
         // Try to open the log file
@@ -116,7 +124,16 @@ void setLogOutput() {
         }
     }
     // If that failed, go back to cerr
-    Sirikata::Logging::SirikataLogStream = &std::cerr;
+    Sirikata::Logging::setLogStream(&std::cerr);
+}
+
+void setLogOutput() {
+    Sirikata::Logging::refreshLogLevels();
+    setLogStream();
+    if (GetOptionValue<bool>(OPT_LOG_ASYNC))
+        Sirikata::Logging::startAsyncLog();
+    else
+        Sirikata::Logging::stopAsyncLog();
 }
 
 }
@@ -125,6 +142,7 @@ void FakeParseOptions() {
     OptionSet* options = OptionSet::getOptions(SIRIKATA_OPTIONS_MODULE,NULL);
     int argc = 1; const char* argv[2] = { "bogus", NULL };
     options->parse(argc, argv);
+    Sirikata::Logging::refreshLogLevels();
 }
 
 void ParseOptions(int argc, char** argv) {
@@ -166,6 +184,7 @@ void FillMissingOptionDefaults() {
     // Parse command line once to make sure we have the right config
     // file. On this pass, use defaults so everything gets filled in.
     options->fillMissingDefaults();
+    Sirikata::Logging::refreshLogLevels();
 }
 
 OptionValue* GetOption(const char* name) {
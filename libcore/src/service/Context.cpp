@@ -53,6 +53,7 @@ Context::Context(const String& name_, Network::IOService* ios, Network::IOStrand
    mCommander(NULL),
    mEpoch(epoch),
    mLastSimTime(Time::null()),
+   mVirtualClock(false),
    mSimDuration(simlen),
    mKillThread(),
    mKillService(NULL),
@@ -73,7 +73,7 @@ DataChunkHandler::~DataChunkHandler() {
 }
 
 void DataChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-        std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+        std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
 
     std::tr1::shared_ptr<DenseData> bad;
 
@@ -73,7 +73,7 @@ FileChunkHandler::~FileChunkHandler() {
 }
 
 void FileChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-        std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+        std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
 
     //Check for null arguments
     std::tr1::shared_ptr<DenseData> bad;
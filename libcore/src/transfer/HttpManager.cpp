@@ -34,6 +34,7 @@
 #include <sirikata/core/transfer/HttpManager.hpp>
 #include <sirikata/core/transfer/URL.hpp>
 #include <sirikata/core/network/Address.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
 #include <liboauthcpp/liboauthcpp.h>
 
 #include <boost/lexical_cast.hpp>
@@ -51,9 +52,79 @@ void HttpManager::destroy() {
     AutoSingleton<HttpManager>::destroy();
 }
 
-HttpManager::HttpManager()
-    : mNumTotalConnections(0) {
+namespace {
+// HttpManager is also used by tools that never initialize the common options,
+// so fall back to the defaults if they aren't registered
+uint32 GetUInt32Option(const char* name, uint32 default_value) {
+    OptionValue* opt = GetOption(name);
+    if (opt == NULL || opt->get()->empty())
+        return default_value;
+    return opt->unsafeAs<uint32>();
+}
+
+// Cap on how much space is allocated up front from a response's
+// Content-Length, so a bogus header can't make us allocate arbitrary amounts
+const size_t MAX_PREALLOCATED_BODY = 64 * 1024 * 1024;
 
+struct HigherPriorityFirst {
+    template<typename PairType>
+    bool operator()(const PairType& lhs, const PairType& rhs) const {
+        return lhs.first > rhs.first;
+    }
+};
+
+// Final stage of a response's gzip decoding chain, passes the decoded data
+// on as soon as the decompressor produces it
+class DecodedBodySink {
+public:
+    typedef char char_type;
+    typedef boost::iostreams::sink_tag category;
+    typedef std::tr1::function<void(const char*, size_t)> WriteFunction;
+
+    DecodedBodySink(const WriteFunction& write_func)
+     : mWrite(write_func)
+    {}
+
+    std::streamsize write(const char* s, std::streamsize n) {
+        mWrite(s, (size_t)n);
+        return n;
+    }
+private:
+    WriteFunction mWrite;
+};
+}
+
+HttpManager::Connection::Connection(Sirikata::Network::IOService* ios, const Sirikata::Network::Address& _addr)
+ : addr(_addr),
+   socket(new TCPSocket(*ios)),
+   mNumWritten(0),
+   mConnected(false),
+   mWriting(false),
+   mReading(false),
+   mPipelining(false),
+   mClosing(false),
+   mClosed(false),
+   mNumResponses(0),
+   mReadBuffer(SOCKET_BUFFER_SIZE),
+   mResponse(new_response())
+{
+    //Initialize the parser for parsing responses
+    http_parser_init(&mHttpParser, HTTP_RESPONSE);
+
+    /*
+     * http-parser library uses this void * parameter to callbacks for user-defined data
+     * Store a pointer to the Connection so we can find the current response during static callbacks
+     */
+    mHttpParser.data = static_cast<void *>(this);
+}
+
+HttpManager::HttpManager()
+    : mNumTotalConnections(0),
+      mNextSeqNo(0),
+      mMaxConnections(GetUInt32Option(OPT_HTTP_MAX_CONNECTIONS, 10)),
+      mMaxConnectionsPerEndpoint(GetUInt32Option(OPT_HTTP_MAX_CONNECTIONS_PER_ENDPOINT, 2)),
+      mPipelineDepth(GetUInt32Option(OPT_HTTP_PIPELINE_DEPTH, 4))
+{
     EMPTY_PARSER_SETTINGS.on_message_begin = 0;
     EMPTY_PARSER_SETTINGS.on_header_field = 0;
     EMPTY_PARSER_SETTINGS.on_header_value = 0;
@@ -65,7 +136,16 @@ HttpManager::HttpManager()
     EMPTY_PARSER_SETTINGS.on_headers_complete = 0;
     EMPTY_PARSER_SETTINGS.on_message_complete = 0;
 
-    //Making a single thread IOService to handle requests
+    //Response parser settings are shared by all connections
+    mResponseSettings = EMPTY_PARSER_SETTINGS;
+    mResponseSettings.on_header_field = &HttpManager::on_header_field;
+    mResponseSettings.on_header_value = &HttpManager::on_header_value;
+    mResponseSettings.on_body = &HttpManager::on_body;
+    mResponseSettings.on_headers_complete = &HttpManager::on_headers_complete;
+    mResponseSettings.on_message_complete = &HttpManager::on_message_complete;
+
+    //Making an IOService with two threads to handle requests. Endpoint and
+    //connection state is shared between them under mEndpointsLock
     mServicePool = new IOServicePool("HttpManager", 2);
 
     //Add a dummy IOWork so that the IOService stays running
@@ -89,9 +169,27 @@ HttpManager::~HttpManager() {
 
     //Delete dummy worker and service pool
     mServicePool->stopWork();
+
+    //Close sockets before the service they belong to goes away
+    mEndpoints.clear();
     delete mServicePool;
 }
 
+void HttpManager::setConnectionLimits(uint32 max_connections, uint32 max_connections_per_endpoint) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    mMaxConnections = std::max(max_connections, (uint32)1);
+    mMaxConnectionsPerEndpoint = std::max(max_connections_per_endpoint, (uint32)1);
+    lock.unlock();
+    processQueue();
+}
+
+void HttpManager::setPipelineDepth(uint32 depth) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    mPipelineDepth = std::max(depth, (uint32)1);
+    lock.unlock();
+    processQueue();
+}
+
 void HttpManager::postCallback(IOCallback cb, const char* tag) {
     mServicePool->service()->post(cb, tag);
 }
@@ -109,9 +207,13 @@ String HttpManager::methodAsString(HTTP_METHOD m) {
     }
 }
 
-void HttpManager::makeRequest(Sirikata::Network::Address addr, HTTP_METHOD method, std::string req, bool allow_redirects, HttpCallback cb) {
+void HttpManager::makeRequest(Sirikata::Network::Address addr, HTTP_METHOD method, std::string req, bool allow_redirects, HttpCallback cb,
+    Priority priority) {
+    enqueue_request(HttpRequestPtr(new HttpRequest(addr, req, method, allow_redirects, cb, priority)));
+}
 
-    std::tr1::shared_ptr<HttpRequest> r(new HttpRequest(addr, req, method, allow_redirects, cb));
+void HttpManager::enqueue_request(HttpRequestPtr r) {
+    const String& req = r->req;
 
     //Initialize http parser settings callbacks
     r->mHttpSettings = EMPTY_PARSER_SETTINGS;
@@ -133,7 +235,7 @@ void HttpManager::makeRequest(Sirikata::Network::Address addr, HTTP_METHOD metho
         SILOG(transfer, warning, "Parsing http request failed");
         boost::system::error_code ec;
         postCallback(
-            std::tr1::bind(cb, std::tr1::shared_ptr<HttpResponse>(), REQUEST_PARSING_FAILED, ec),
+            std::tr1::bind(r->cb, std::tr1::shared_ptr<HttpResponse>(), REQUEST_PARSING_FAILED, ec),
             "HttpManager::makeRequest callback"
         );
         return;
@@ -148,7 +250,17 @@ void HttpManager::makeRequest(
     HttpCallback cb,
     const Headers& headers, const QueryParameters& query_params,
     const String& body,
-    bool allow_redirects)
+    bool allow_redirects,
+    Priority priority)
+{
+    // FIXME This is actually kind of round-about as we are formatting and then
+    // reparsing the request by going through the other makeRequest call. We
+    // could dispatch this ourselves and not waste the time reparsing.
+    makeRequest(addr, method, formatRequest(method, path, headers, query_params, body), allow_redirects, cb, priority);
+}
+
+String HttpManager::formatRequest(HTTP_METHOD method, const String& path,
+    const Headers& headers, const QueryParameters& query_params, const String& body)
 {
     std::ostringstream request_stream;
 
@@ -170,10 +282,7 @@ void HttpManager::makeRequest(
     if (!body.empty())
         request_stream << body;
 
-    // FIXME This is actually kind of round-about as we are formatting and then
-    // reparsing the request by going through the other makeRequest call. We
-    // could dispatch this ourselves and not waste the time reparsing.
-    makeRequest(addr, method, request_stream.str(), allow_redirects, cb);
+    return request_stream.str();
 }
 
 void HttpManager::formatURLEncodedDictionary(std::ostream& os, const StringDictionary& query_params) {
@@ -216,16 +325,30 @@ String HttpManager::formatURL(const String& host, const String& service, const S
 
 void HttpManager::head(
     Sirikata::Network::Address addr, const String& path,
-    HttpCallback cb, const Headers& headers, const QueryParameters& query_params, bool allow_redirects)
+    HttpCallback cb, const Headers& headers, const QueryParameters& query_params, bool allow_redirects,
+    Priority priority)
 {
-    makeRequest(addr, HEAD, path, cb, headers, query_params, "", allow_redirects);
+    makeRequest(addr, HEAD, path, cb, headers, query_params, "", allow_redirects, priority);
 }
 
 void HttpManager::get(
     Sirikata::Network::Address addr, const String& path,
-    HttpCallback cb, const Headers& headers, const QueryParameters& query_params, bool allow_redirects)
+    HttpCallback cb, const Headers& headers, const QueryParameters& query_params, bool allow_redirects,
+    Priority priority)
+{
+    makeRequest(addr, GET, path, cb, headers, query_params, "", allow_redirects, priority);
+}
+
+void HttpManager::getStreaming(
+    Sirikata::Network::Address addr, const String& path,
+    BodyCallback body_cb, HttpCallback cb,
+    const Headers& headers, const QueryParameters& query_params, bool allow_redirects,
+    Priority priority)
 {
-    makeRequest(addr, GET, path, cb, headers, query_params, "", allow_redirects);
+    HttpRequestPtr r(new HttpRequest(addr, formatRequest(GET, path, headers, query_params, ""),
+            GET, allow_redirects, cb, priority));
+    r->body_cb = body_cb;
+    enqueue_request(r);
 }
 
 void HttpManager::post(
@@ -304,321 +427,415 @@ void HttpManager::postMultipartForm(
 
 
 void HttpManager::processQueue() {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+
     SILOG(transfer, insane, "processQueue called, mNumTotalConnections = "
-            << mNumTotalConnections << " and recycle bin size = " << mRecycleBin.size()
-            << " and size of hosts = " << mNumConnsPerAddr.size()
-            << " and request queue size = " << mRequestQueue.size());
-
-    boost::unique_lock<boost::mutex> lockQueue(mRequestQueueLock);
-    boost::unique_lock<boost::mutex> lockNumConns(mNumConnsLock, boost::defer_lock);
-
-    for (RequestQueueType::iterator req = mRequestQueue.begin(); req != mRequestQueue.end(); ) {
-
-        std::tr1::shared_ptr<TCPSocket> sock;
-
-        //First check the recycle bin to see if there's a connection already open we can use
-        boost::unique_lock<boost::mutex> lockRB(mRecycleBinLock); {
-            RecycleBinType::iterator findRec = mRecycleBin.find((*req)->addr);
-            if (findRec != mRecycleBin.end()) {
-                sock = findRec->second.front();
-                findRec->second.pop();
-                if (findRec->second.size() == 0) {
-                    mRecycleBin.erase(findRec);
-                }
-            }
-        }
-        lockRB.unlock();
+            << mNumTotalConnections << " and number of endpoints = " << mEndpoints.size());
+
+    // Serve endpoints in order of their most important pending request so
+    // that, when we're at the total connection limit, connection slots go to
+    // the most important requests first.
+    typedef std::vector<std::pair<Priority, EndpointMap::iterator> > EndpointOrder;
+    EndpointOrder order;
+    for(EndpointMap::iterator it = mEndpoints.begin(); it != mEndpoints.end(); it++) {
+        if (!it->second.pending.empty())
+            order.push_back(std::make_pair(it->second.pending.top()->priority, it));
+    }
+    std::stable_sort(order.begin(), order.end(), HigherPriorityFirst());
 
-        if (sock) {
-            //SILOG(transfer, debug, "Reusing a connection for " << (*req)->addr.toString());
-            write_request(sock, *req);
-            req = mRequestQueue.erase(req);
-        } else {
+    for(EndpointOrder::iterator it = order.begin(); it != order.end(); it++)
+        dispatch(it->second->second, it->second->first);
 
-            lockNumConns.lock(); {
-                //If nothing in the recycle bin, let's see if we can open a new connection
-                if (mNumTotalConnections < MAX_TOTAL_CONNECTIONS) {
-                    NumConnsType::iterator findNumC = mNumConnsPerAddr.find((*req)->addr);
-                    if (mNumTotalConnections < MAX_TOTAL_CONNECTIONS &&
-                            (findNumC == mNumConnsPerAddr.end() || findNumC->second < MAX_CONNECTIONS_PER_ENDPOINT)) {
-
-                        //We are safe to open a new connection, but increase counts first
-                        mNumTotalConnections++;
-                        if (findNumC == mNumConnsPerAddr.end()) {
-                           mNumConnsPerAddr[(*req)->addr] = 1;
-                        } else {
-                            mNumConnsPerAddr[(*req)->addr] = findNumC->second + 1;
-                        }
-
-                        //SILOG(transfer, debug, "Creating a new connection for " << (*req)->addr.toString());
-                        TCPResolver::query query((*req)->addr.getHostName(), (*req)->addr.getService(), Network::TCPResolver::query::all_matching);
-                        mResolver->async_resolve(query, boost::bind(&HttpManager::handle_resolve, this, *req,
-                                                boost::asio::placeholders::error, boost::asio::placeholders::iterator));
-
-                        req = mRequestQueue.erase(req);
-                    } else {
-                        //No available recycled connections, can't open a new one, so do nothing
-                        req++;
-                    }
-                } else {
-                    //No available recycled connections, can't open a new one, so do nothing
-                    req++;
-                }
-            } lockNumConns.unlock();
-        }
+    // Forget endpoints we're done with
+    for(EndpointMap::iterator it = mEndpoints.begin(); it != mEndpoints.end(); ) {
+        if (it->second.pending.empty() && it->second.connections.empty())
+            mEndpoints.erase(it++);
+        else
+            it++;
     }
-
-    lockQueue.unlock();
 }
 
-void HttpManager::decrement_connection(const Sirikata::Network::Address& addr) {
-    //SILOG(transfer, debug, "Reducing number of connections by 1 for " << addr.toString());
-    boost::unique_lock<boost::mutex> lockNumConns(mNumConnsLock); {
-        mNumTotalConnections--;
-        NumConnsType::iterator findNumC = mNumConnsPerAddr.find(addr);
-        if (findNumC != mNumConnsPerAddr.end()) {
-            if (findNumC->second == 1) {
-                mNumConnsPerAddr.erase(findNumC);
-            } else {
-                mNumConnsPerAddr[addr] = findNumC->second - 1;
+void HttpManager::dispatch(Endpoint& ep, const Sirikata::Network::Address& addr) {
+    while(!ep.pending.empty()) {
+        HttpRequestPtr req = ep.pending.top();
+
+        // Prefer an idle connection, then a new connection, and only then
+        // pipeline behind other requests, since pipelined requests have to
+        // wait for all the responses ahead of them.
+        ConnectionPtr conn;
+        for(uint32 i = 0; i < ep.connections.size(); i++) {
+            const ConnectionPtr& c = ep.connections[i];
+            if (!c->mClosing && c->mInFlight.empty()) {
+                conn = c;
+                break;
             }
         }
+        if (!conn)
+            conn = open_connection(ep, addr);
+        if (!conn) {
+            for(uint32 i = 0; i < ep.connections.size(); i++) {
+                const ConnectionPtr& c = ep.connections[i];
+                if (canPipeline(c, req) && (!conn || c->mInFlight.size() < conn->mInFlight.size()))
+                    conn = c;
+            }
+        }
+        if (!conn) break;
+
+        ep.pending.pop();
+        conn->mInFlight.push_back(req);
+        if (conn->mConnected)
+            start_write(conn);
     }
-    lockNumConns.unlock();
 }
 
-void HttpManager::add_req(std::tr1::shared_ptr<HttpRequest> req) {
-    boost::unique_lock<boost::mutex> lockQueue(mRequestQueueLock);
-    mRequestQueue.push_back(req);
-    lockQueue.unlock();
+bool HttpManager::canPipeline(const ConnectionPtr& conn, const HttpRequestPtr& req) const {
+    // Only pipeline once the server has shown it keeps connections open.
+    // POSTs aren't idempotent, so they aren't pipelined in either direction:
+    // if the connection drops we couldn't tell whether they were handled.
+    return (conn->mPipelining && !conn->mClosing &&
+        conn->mInFlight.size() < mPipelineDepth &&
+        req->method != POST && conn->mInFlight.back()->method != POST);
 }
 
-void HttpManager::handle_resolve(std::tr1::shared_ptr<HttpRequest> req, const boost::system::error_code& err,
-        TCPResolver::iterator endpoint_iterator) {
-    if (!err) {
-        TCPEndPoint endpoint = *endpoint_iterator;
-        std::tr1::shared_ptr<TCPSocket> socket(new TCPSocket(*(mServicePool->service())));
-        socket->async_connect(endpoint, boost::bind(
-                &HttpManager::handle_connect, this, socket, req,
-                boost::asio::placeholders::error, ++endpoint_iterator));
-    } else {
-        SILOG(transfer, error, "Failed to resolve hostname. Error = " << err.message());
-        decrement_connection(req->addr);
-
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::host_not_found);
-        } else {
-            add_req(req);
-        }
+HttpManager::ConnectionPtr HttpManager::open_connection(Endpoint& ep, const Sirikata::Network::Address& addr) {
+    if (ep.connections.size() >= mMaxConnectionsPerEndpoint)
+        return ConnectionPtr();
+    while (mNumTotalConnections >= mMaxConnections) {
+        if (!close_idle_connection(addr))
+            return ConnectionPtr();
+    }
 
-        add_req(req);
-        processQueue();
+    ConnectionPtr conn(new Connection(mServicePool->service(), addr));
+    ep.connections.push_back(conn);
+    mNumTotalConnections++;
+
+    SILOG(transfer, detailed, "Creating a new connection for " << addr.toString());
+    TCPResolver::query query(addr.getHostName(), addr.getService(), Network::TCPResolver::query::all_matching);
+    mResolver->async_resolve(query, boost::bind(&HttpManager::handle_resolve, this, conn,
+            boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+    return conn;
+}
+
+bool HttpManager::close_idle_connection(const Sirikata::Network::Address& except) {
+    // Frees up a connection slot held by an idle connection to an endpoint
+    // that has nothing left to request
+    for(EndpointMap::iterator it = mEndpoints.begin(); it != mEndpoints.end(); it++) {
+        if (it->first == except || !it->second.pending.empty()) continue;
+        for(uint32 i = 0; i < it->second.connections.size(); i++) {
+            ConnectionPtr conn = it->second.connections[i];
+            if (conn->mConnected && conn->mInFlight.empty()) {
+                FailedList failed;
+                close_connection(conn, false, boost::system::error_code(), &failed);
+                return true;
+            }
+        }
     }
+    return false;
 }
 
-void HttpManager::write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req) {
+void HttpManager::start_write(ConnectionPtr conn) {
+    if (conn->mWriting || conn->mClosing || conn->mNumWritten == conn->mInFlight.size())
+        return;
+
+    // Send everything that's been assigned to the connection in one write
     std::tr1::shared_ptr<boost::asio::streambuf> request_ptr(new boost::asio::streambuf());
     std::ostream request_stream(request_ptr.get());
-    request_stream << req->req;
-    boost::asio::async_write(*socket, *request_ptr, boost::bind(
-            &HttpManager::handle_write_request, this, socket, req,
+    uint32 count = 0;
+    for(uint32 i = conn->mNumWritten; i < conn->mInFlight.size(); i++, count++)
+        request_stream << conn->mInFlight[i]->req;
+
+    // Counted as written as soon as the write starts since a response can't
+    // arrive before its request has been sent
+    conn->mNumWritten += count;
+    conn->mWriting = true;
+    boost::asio::async_write(*(conn->socket), *request_ptr, boost::bind(
+            &HttpManager::handle_write_request, this, conn, count,
             boost::asio::placeholders::error, request_ptr));
+
+    start_read(conn);
+}
+
+void HttpManager::start_read(ConnectionPtr conn) {
+    if (conn->mReading) return;
+
+    conn->mReading = true;
+    conn->socket->async_read_some(boost::asio::buffer(conn->mReadBuffer), boost::bind(
+            &HttpManager::handle_read, this, conn,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+}
+
+void HttpManager::close_connection(ConnectionPtr conn, bool count_try, const boost::system::error_code& ec, FailedList* failed) {
+    if (conn->mClosed) return;
+    conn->mClosed = true;
+
+    boost::system::error_code ignored;
+    conn->socket->close(ignored);
+
+    EndpointMap::iterator ep_it = mEndpoints.find(conn->addr);
+    assert(ep_it != mEndpoints.end());
+    Endpoint& ep = ep_it->second;
+    ep.connections.erase(std::find(ep.connections.begin(), ep.connections.end(), conn));
+    mNumTotalConnections--;
+
+    // Anything still outstanding goes back in the queue. Requests keep their
+    // sequence number so they don't lose their place. Only the first one is
+    // charged a try, the rest were just waiting behind it.
+    for(std::deque<HttpRequestPtr>::iterator it = conn->mInFlight.begin(); it != conn->mInFlight.end(); it++) {
+        HttpRequestPtr req = *it;
+        if (count_try && it == conn->mInFlight.begin()) {
+            req->mNumTries++;
+            if (req->mNumTries > MAX_TRIES) {
+                //This means this request has gotten an error too many times. Let's stop trying
+                failed->push_back(FailedRequest(req, BOOST_ERROR, ec));
+                continue;
+            }
+        }
+        ep.pending.push(req);
+    }
+    conn->mInFlight.clear();
+    conn->mNumWritten = 0;
+}
+
+void HttpManager::add_req(HttpRequestPtr req) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    req->mSeqNo = mNextSeqNo++;
+    mEndpoints[req->addr].pending.push(req);
 }
 
-void HttpManager::handle_connect(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator) {
+void HttpManager::notify_failed(const FailedList& failed) {
+    for(FailedList::const_iterator it = failed.begin(); it != failed.end(); it++)
+        it->req->cb(std::tr1::shared_ptr<HttpResponse>(), it->error, it->ec);
+}
+
+void HttpManager::handle_resolve(ConnectionPtr conn, const boost::system::error_code& err,
+        TCPResolver::iterator endpoint_iterator) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    if (conn->mClosed) return;
+
     if (!err) {
-        write_request(socket, req);
-    } else if (endpoint_iterator != TCPResolver::iterator()) {
-        socket->close();
         TCPEndPoint endpoint = *endpoint_iterator;
-        socket->async_connect(endpoint, boost::bind(
-                &HttpManager::handle_connect, this, socket, req,
+        conn->socket->async_connect(endpoint, boost::bind(
+                &HttpManager::handle_connect, this, conn,
                 boost::asio::placeholders::error, ++endpoint_iterator));
-    } else {
-        SILOG(transfer, error, "Failed to connect. Error = " << err.message());
-        decrement_connection(req->addr);
-
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::host_unreachable);
-        } else {
-            add_req(req);
-        }
-
-        processQueue();
+        return;
     }
+
+    SILOG(transfer, error, "Failed to resolve hostname. Error = " << err.message());
+    FailedList failed;
+    close_connection(conn, true, boost::asio::error::host_not_found, &failed);
+    lock.unlock();
+
+    notify_failed(failed);
+    processQueue();
 }
 
-void HttpManager::handle_write_request(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        const boost::system::error_code& err, std::tr1::shared_ptr<boost::asio::streambuf> request_stream) {
+void HttpManager::handle_connect(ConnectionPtr conn, const boost::system::error_code& err, TCPResolver::iterator endpoint_iterator) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    if (conn->mClosed) return;
 
-    if (err) {
-        socket->close();
-        SILOG(transfer, error, "Failed to write. Error = " << err.message());
-        decrement_connection(req->addr);
-        add_req(req);
-        processQueue();
+    if (!err) {
+        conn->mConnected = true;
+        start_write(conn);
         return;
     }
 
-    //Create a new response object
-    std::tr1::shared_ptr<HttpResponse> respPtr(new HttpResponse());
+    if (endpoint_iterator != TCPResolver::iterator()) {
+        boost::system::error_code ignored;
+        conn->socket->close(ignored);
+        TCPEndPoint endpoint = *endpoint_iterator;
+        conn->socket->async_connect(endpoint, boost::bind(
+                &HttpManager::handle_connect, this, conn,
+                boost::asio::placeholders::error, ++endpoint_iterator));
+        return;
+    }
 
-    //Initiate an empty DenseData
-    std::tr1::shared_ptr<DenseData> emptyData(new DenseData(Range(true)));
-    respPtr->mData = emptyData;
+    SILOG(transfer, error, "Failed to connect. Error = " << err.message());
+    FailedList failed;
+    close_connection(conn, true, boost::asio::error::host_unreachable, &failed);
+    lock.unlock();
 
-    //Initialize http parser settings callbacks
-    respPtr->mHttpSettings = EMPTY_PARSER_SETTINGS;
-    respPtr->mHttpSettings.on_header_field = &HttpManager::on_header_field;
-    respPtr->mHttpSettings.on_header_value = &HttpManager::on_header_value;
-    respPtr->mHttpSettings.on_body = &HttpManager::on_body;
-    respPtr->mHttpSettings.on_headers_complete = &HttpManager::on_headers_complete;
-    respPtr->mHttpSettings.on_message_complete = &HttpManager::on_message_complete;
+    notify_failed(failed);
+    processQueue();
+}
 
-    //Initialize the parser for parsing a response
-    http_parser_init(&(respPtr->mHttpParser), HTTP_RESPONSE);
+void HttpManager::handle_write_request(ConnectionPtr conn, uint32 count,
+        const boost::system::error_code& err, std::tr1::shared_ptr<boost::asio::streambuf> request_stream) {
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    conn->mWriting = false;
+    if (conn->mClosed) return;
 
-    /*
-     * http-parser library uses this void * parameter to callbacks for user-defined data
-     * Store a pointer to the HttpResponse object so we can access it during static callbacks
-     */
-    respPtr->mHttpParser.data = static_cast<void *>(respPtr.get());
+    if (!err) {
+        // More requests may have been pipelined while we were writing
+        start_write(conn);
+        return;
+    }
 
-    //Create a buffer for receiving from socket
-    std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf(new std::vector<unsigned char>(SOCKET_BUFFER_SIZE));
+    SILOG(transfer, error, "Failed to write. Error = " << err.message());
+    // A connection that has already been used was probably closed by the
+    // server while it was idle, so retrying on a new one is free
+    FailedList failed;
+    close_connection(conn, conn->mNumResponses == 0, err, &failed);
+    lock.unlock();
 
-    //Read some data
-    socket->async_read_some(boost::asio::buffer(*vecbuf), boost::bind(
-            &HttpManager::handle_read, this, socket, req, vecbuf, respPtr,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+    notify_failed(failed);
+    processQueue();
 }
 
-void HttpManager::handle_read(std::tr1::shared_ptr<TCPSocket> socket, std::tr1::shared_ptr<HttpRequest> req,
-        std::tr1::shared_ptr<std::vector<unsigned char> > vecbuf, std::tr1::shared_ptr<HttpResponse> respPtr,
-        const boost::system::error_code& err, std::size_t bytes_transferred) {
+void HttpManager::handle_read(ConnectionPtr conn, const boost::system::error_code& err, std::size_t bytes_transferred) {
 
     SILOG(transfer, insane, "handle_read triggered with bytes_transferred = " << bytes_transferred << " EOF? "
             << (err == boost::asio::error::eof ? "Y" : "N"));
 
-    if ((err || bytes_transferred == 0) && err != boost::asio::error::eof) {
-        SILOG(transfer, error, "Failed to write. Error = " << err.message());
-        socket->close();
-        decrement_connection(req->addr);
-        add_req(req);
-        processQueue();
-        return;
-    }
-
-    //Parse the data we just got back from the socket
-    size_t nparsed = http_parser_execute(&(respPtr->mHttpParser), &(respPtr->mHttpSettings),
-            (const char *)(&((*vecbuf)[0])), bytes_transferred);
+    boost::unique_lock<boost::mutex> lock(mEndpointsLock);
+    conn->mReading = false;
+    if (conn->mClosed) return;
 
+    FailedList failed;
+    Connection::CompletedList completed;
+    PieceList pieces;
     boost::system::error_code ec;
-    if (nparsed != bytes_transferred) {
-        SILOG(transfer, warning, "Failed to parse http response. nparsed=" << nparsed << " while bytes_transferred=" << bytes_transferred);
-        req->cb(std::tr1::shared_ptr<HttpResponse>(), RESPONSE_PARSING_FAILED, ec);
-        socket->close();
-        decrement_connection(req->addr);
-        processQueue();
-        return;
-    }
 
-    if (err == boost::asio::error::eof && bytes_transferred != 0) {
-        //Pass 0 as fourth parameter to parser to tell it that we got EOF
-        size_t nparsed = http_parser_execute(&(respPtr->mHttpParser), &(respPtr->mHttpSettings),
-                (const char *)(&((*vecbuf)[0])), 0);
-        if (nparsed != 0) {
-            SILOG(transfer, warning, "Failed to parse http response when giving EOF. nparsed=" << nparsed);
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), RESPONSE_PARSING_FAILED, ec);
-            socket->close();
-            decrement_connection(req->addr);
-            processQueue();
-            return;
+    if (err && err != boost::asio::error::eof) {
+        SILOG(transfer, error, "Failed to read. Error = " << err.message());
+        close_connection(conn, conn->mNumResponses == 0, err, &failed);
+    } else {
+        //Parse the data we just got back from the socket. Complete responses
+        //are collected in conn->mCompleted
+        bool parse_failed = false;
+        if (bytes_transferred > 0) {
+            size_t nparsed = http_parser_execute(&(conn->mHttpParser), &mResponseSettings,
+                    (const char *)(&(conn->mReadBuffer[0])), bytes_transferred);
+            if (nparsed != bytes_transferred) {
+                SILOG(transfer, warning, "Failed to parse http response. nparsed=" << nparsed << " while bytes_transferred=" << bytes_transferred);
+                parse_failed = true;
+            }
         }
 
-    }
-
-    if ((req->method == HEAD && respPtr->mHeaderComplete) ||
-        ((req->method == GET || req->method == POST) && respPtr->mMessageComplete)) {
-        //We're done
-
-        //If we didn't get any body data, erase the DenseData pointer
-        if (respPtr->mData->length() == 0) {
-            respPtr->mData.reset();
+        if (!parse_failed && err == boost::asio::error::eof) {
+            //Pass 0 as length to tell the parser we got EOF, which completes
+            //responses delimited by the connection closing. If a response was
+            //cut off it just stays in flight and gets retried below.
+            http_parser_execute(&(conn->mHttpParser), &mResponseSettings,
+                    (const char *)(&(conn->mReadBuffer[0])), 0);
         }
 
-        SILOG(transfer, detailed, "Finished http transfer with content length of " << respPtr->getContentLength());
-        Headers::const_iterator findLocation;
-        findLocation = respPtr->mHeaders.find("Location");
-        if (respPtr->getStatusCode() == 301 && findLocation != respPtr->mHeaders.end() && req->allow_redirects) {
-            SILOG(transfer, detailed, "Got a 301 redirect reply and location = " << findLocation->second);
-            std::ostringstream request_stream;
-            std::string request_method = methodAsString(req->method);
-            URL newURI(findLocation->second.c_str());
-            request_stream << request_method << " " << newURI.fullpath() << " HTTP/1.1\r\n";
-            Headers::const_iterator it;
-            for (it = req->mHeaders.begin(); it != req->mHeaders.end(); it++) {
-            	if (it->first == "Host") {
-            		request_stream << "Host: " << newURI.host() << "\r\n";
-            	} else {
-            		request_stream << it->first << ": " << it->second << "\r\n";
-            	}
+        //Collect streamed body data before closing the connection below
+        //requeues the request it belongs to
+        completed.swap(conn->mCompleted);
+        for(Connection::CompletedList::iterator it = completed.begin(); it != completed.end(); it++)
+            take_pieces(it->first, it->second.get(), &pieces);
+        if (!conn->mInFlight.empty())
+            take_pieces(conn->mInFlight.front(), conn->mResponse.get(), &pieces);
+
+        if (parse_failed) {
+            if (!conn->mInFlight.empty()) {
+                failed.push_back(FailedRequest(conn->mInFlight.front(), RESPONSE_PARSING_FAILED, ec));
+                conn->mInFlight.pop_front();
             }
-            request_stream << "\r\n";
-            Network::Address newaddr(newURI.host(), newURI.proto());
-            makeRequest(newaddr, req->method, request_stream.str(), req->allow_redirects, req->cb);
+            close_connection(conn, false, ec, &failed);
+        } else if (err == boost::asio::error::eof) {
+            if (!conn->mInFlight.empty())
+                SILOG(transfer, detailed, "Connection closed with " << conn->mInFlight.size() << " requests outstanding");
+            close_connection(conn, conn->mNumResponses == 0, boost::asio::error::eof, &failed);
+        } else if ((conn->mClosing && conn->mNumWritten == 0) ||
+            (conn->mInFlight.empty() &&
+                (mEndpoints[conn->addr].connections.size() > mMaxConnectionsPerEndpoint ||
+                    mNumTotalConnections > mMaxConnections))) {
+            //Either the server is closing the connection and everything that
+            //was sent has been answered, or we're over the (reduced) limits
+            close_connection(conn, false, ec, &failed);
         } else {
-            req->cb(respPtr, SUCCESS, ec);
+            if (!conn->mInFlight.empty())
+                start_read(conn);
+            start_write(conn);
         }
+    }
 
-        //If this is Connection: Close or we reached EOF, then close connection, otherwise recycle
-        if ((respPtr->mHttpParser.flags & F_CONNECTION_CLOSE) || err == boost::asio::error::eof) {
-            socket->close();
-            decrement_connection(req->addr);
-        } else {
-            boost::unique_lock<boost::mutex> lockRB(mRecycleBinLock);
-            mRecycleBin[req->addr].push(socket);
-            lockRB.unlock();
-        }
-        processQueue();
-
-    } else if(err == boost::asio::error::eof || bytes_transferred == 0) {
-        SILOG(transfer, warning, "EOF was true or bytes_transferred==0 and the parser wasn't finished, so connection is broken");
-        socket->close();
-        decrement_connection(req->addr);
-
-        req->mNumTries++;
-        if (req->mNumTries > 10) {
-            //This means this connection has gotten an error over 10 times. Let's stop trying
-            //TODO: this should probably be configurable
-            req->cb(std::tr1::shared_ptr<HttpResponse>(), BOOST_ERROR, boost::asio::error::eof);
-        } else {
-            add_req(req);
-        }
+    lock.unlock();
 
-        processQueue();
-        return;
+    //Body data always comes before the completion of the request it belongs to
+    for(PieceList::iterator it = pieces.begin(); it != pieces.end(); it++)
+        it->first->body_cb(it->second);
+    for(Connection::CompletedList::iterator it = completed.begin(); it != completed.end(); it++)
+        handle_response(it->first, it->second);
+    notify_failed(failed);
+    processQueue();
+}
+
+void HttpManager::take_pieces(const HttpRequestPtr& req, HttpResponse* resp, PieceList* pieces) {
+    for(std::vector<MutableDenseDataPtr>::iterator it = resp->mPieces.begin(); it != resp->mPieces.end(); it++)
+        pieces->push_back(std::make_pair(req, *it));
+    resp->mPieces.clear();
+}
+
+void HttpManager::handle_response(HttpRequestPtr req, std::tr1::shared_ptr<HttpResponse> respPtr) {
+    boost::system::error_code ec;
+
+    //If we didn't get any body data, erase the DenseData pointer
+    if (respPtr->mData->length() == 0) {
+        respPtr->mData.reset();
+    }
+
+    SILOG(transfer, detailed, "Finished http transfer with content length of " << respPtr->getContentLength());
+    Headers::const_iterator findLocation;
+    findLocation = respPtr->mHeaders.find("Location");
+    if (respPtr->getStatusCode() == 301 && findLocation != respPtr->mHeaders.end() && req->allow_redirects) {
+        SILOG(transfer, detailed, "Got a 301 redirect reply and location = " << findLocation->second);
+        std::ostringstream request_stream;
+        std::string request_method = methodAsString(req->method);
+        URL newURI(findLocation->second.c_str());
+        request_stream << request_method << " " << newURI.fullpath() << " HTTP/1.1\r\n";
+        Headers::const_iterator it;
+        for (it = req->mHeaders.begin(); it != req->mHeaders.end(); it++) {
+        	if (it->first == "Host") {
+        		request_stream << "Host: " << newURI.host() << "\r\n";
+        	} else {
+        		request_stream << it->first << ": " << it->second << "\r\n";
+        	}
+        }
+        request_stream << "\r\n";
+        Network::Address newaddr(newURI.host(), newURI.proto());
+        HttpRequestPtr redirected(new HttpRequest(newaddr, request_stream.str(), req->method, req->allow_redirects, req->cb, req->priority));
+        redirected->body_cb = req->body_cb;
+        enqueue_request(redirected);
     } else {
-        //Read some more data
-        socket->async_read_some(boost::asio::buffer(*vecbuf), boost::bind(
-                &HttpManager::handle_read, this, socket, req, vecbuf, respPtr,
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred));
+        req->cb(respPtr, SUCCESS, ec);
     }
+}
+
+std::tr1::shared_ptr<HttpManager::HttpResponse> HttpManager::new_response() {
+    std::tr1::shared_ptr<HttpResponse> respPtr(new HttpResponse());
 
+    //Initiate an empty DenseData
+    std::tr1::shared_ptr<DenseData> emptyData(new DenseData(Range(true)));
+    respPtr->mData = emptyData;
+    return respPtr;
+}
+
+void HttpManager::append_body(HttpResponse* resp, const char* at, size_t len) {
+    if (len == 0) return;
+
+    if (resp->mStreaming) {
+        //Data from the same read goes into a single piece, which is handed
+        //out once the read has been parsed
+        if (resp->mPieces.empty())
+            resp->mPieces.push_back(MutableDenseDataPtr(new DenseData(Range(resp->mBodyLength, 0, LENGTH, false))));
+        resp->mPieces.back()->append(at, len, false);
+    } else {
+        resp->mData->append(at, len, true);
+    }
+    resp->mBodyLength += len;
 }
 
 int HttpManager::on_headers_complete(http_parser* _) {
     //SILOG(transfer, debug, "headers complete. content length = " << _->content_length);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    Connection* conn = static_cast<Connection*>(_->data);
+    // The server sent a response we didn't ask for
+    if (conn->mInFlight.empty())
+        return -1;
+
+    HttpResponse* curResponse = conn->mResponse.get();
     curResponse->mContentLength = _->content_length;
     curResponse->mStatusCode = _->status_code;
 
@@ -629,16 +846,35 @@ int HttpManager::on_headers_complete(http_parser* _) {
 
     //Check if Content-Encoding = gzip
     Headers::const_iterator it = curResponse->mHeaders.find("Content-Encoding");
-    if(it != curResponse->mHeaders.end() && it->second == "gzip") {
+    if(it != curResponse->mHeaders.end() && it->second == "gzip" && conn->mInFlight.front()->method != HEAD) {
+        //Decode as the body arrives rather than buffering the whole
+        //compressed body first
         curResponse->mGzip = true;
+        curResponse->mDecompressor.reset(new boost::iostreams::filtering_ostream());
+        curResponse->mDecompressor->push(boost::iostreams::gzip_decompressor());
+        curResponse->mDecompressor->push(DecodedBodySink(
+                std::tr1::bind(&HttpManager::append_body, curResponse, std::tr1::placeholders::_1, std::tr1::placeholders::_2)
+            ));
     }
 
+    //Successful responses to streaming requests are handed out piece by
+    //piece, anything else is collected so it can be inspected as usual
+    curResponse->mStreaming = (conn->mInFlight.front()->body_cb &&
+        _->status_code >= 200 && _->status_code < 300);
+
+    //Allocate the whole body up front so appending it doesn't reallocate
+    if (!curResponse->mGzip && !curResponse->mStreaming && _->content_length > 0)
+        curResponse->mData->reserve(std::min((size_t)_->content_length, MAX_PREALLOCATED_BODY));
+
     curResponse->mHeaderComplete = true;
-    return 0;
+
+    //Responses to HEAD requests have no body even if they have a
+    //Content-Length, returning 1 tells the parser not to expect one
+    return (conn->mInFlight.front()->method == HEAD) ? 1 : 0;
 }
 
 int HttpManager::on_header_field(http_parser* _, const char* at, size_t len) {
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<Connection*>(_->data)->mResponse.get();
 
     //See http-parser documentation for why this is necessary
     switch (curResponse->mLastCallback) {
@@ -662,7 +898,7 @@ int HttpManager::on_header_field(http_parser* _, const char* at, size_t len) {
 
 int HttpManager::on_header_value(http_parser* _, const char* at, size_t len) {
     //SILOG(transfer, debug, "on_header_value called");
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
+    HttpResponse* curResponse = static_cast<Connection*>(_->data)->mResponse.get();
 
     //See http-parser documentation for why this is necessary
     switch(curResponse->mLastCallback) {
@@ -746,14 +982,26 @@ int HttpManager::on_request_header_value(http_parser* _, const char* at, size_t
 
 int HttpManager::on_body(http_parser* _, const char* at, size_t len) {
     //SILOG(transfer, debug, "on_body called with length = " << len);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
-
-    if(curResponse->mGzip) {
-        //Gzip encoding, so pass this buffer through a decoder
-        curResponse->mCompressedStream.write(at, len);
+    HttpResponse* curResponse = static_cast<Connection*>(_->data)->mResponse.get();
+
+    if(curResponse->mDecompressor) {
+        //Gzip encoding, so pass this buffer through the decoder. Flushing
+        //makes it pass on everything it can decode so far.
+        try {
+            curResponse->mDecompressor->write(at, len);
+            curResponse->mDecompressor->flush();
+        }
+        catch(std::exception& e) {
+            SILOG(transfer, error, "Failed to decode gzip response body: " << e.what());
+            return -1;
+        }
+        if (!(*curResponse->mDecompressor)) {
+            SILOG(transfer, error, "Failed to decode gzip response body");
+            return -1;
+        }
     } else {
-        //Raw encoding, so append the bytes in current body pointer directly to the DenseData pointer in our response
-        curResponse->mData->append(at, len, true);
+        //Raw encoding, so append the bytes in current body pointer directly to the response
+        append_body(curResponse, at, len);
     }
 
     return 0;
@@ -761,25 +1009,44 @@ int HttpManager::on_body(http_parser* _, const char* at, size_t len) {
 
 int HttpManager::on_message_complete(http_parser* _) {
     //SILOG(transfer, debug, "message complete. content length = " << _->content_length);
-    HttpResponse* curResponse = static_cast<HttpResponse*>(_->data);
-
-    if(curResponse->mGzip) {
-        std::stringstream decompressed;
-        boost::iostreams::filtering_streambuf<boost::iostreams::input> out;
-        out.push(boost::iostreams::gzip_decompressor());
-        out.push(curResponse->mCompressedStream);
-        boost::iostreams::copy(out, decompressed);
-        curResponse->mCompressedStream.str("");
-        curResponse->mData->append(decompressed.str().c_str(), decompressed.str().length(), true);
-        curResponse->mContentLength = decompressed.str().length();
+    Connection* conn = static_cast<Connection*>(_->data);
+    HttpResponse* curResponse = conn->mResponse.get();
+
+    if(curResponse->mDecompressor) {
+        //Closing the chain flushes whatever the decoder is still holding and
+        //checks the gzip trailer
+        try {
+            curResponse->mDecompressor->reset();
+        }
+        catch(std::exception& e) {
+            SILOG(transfer, error, "Failed to decode gzip response body: " << e.what());
+            return -1;
+        }
+        curResponse->mDecompressor.reset();
+        curResponse->mContentLength = curResponse->mBodyLength;
     }
 
     curResponse->mMessageComplete = true;
+
+    //Responses come back in the order the requests were sent, so this one
+    //belongs to the oldest outstanding request
+    conn->mCompleted.push_back(std::make_pair(conn->mInFlight.front(), conn->mResponse));
+    conn->mInFlight.pop_front();
+    if (conn->mNumWritten > 0) conn->mNumWritten--;
+    conn->mNumResponses++;
+
+    //Requests are only pipelined to servers that keep HTTP/1.1 connections open
+    if (!http_should_keep_alive(_))
+        conn->mClosing = true;
+    else if (_->http_major > 1 || (_->http_major == 1 && _->http_minor >= 1))
+        conn->mPipelining = true;
+
+    conn->mResponse = new_response();
     return 0;
 }
 
-void HttpManager::print_flags(std::tr1::shared_ptr<HttpResponse> resp) {
-    char flags = resp->mHttpParser.flags;
+void HttpManager::print_flags(const http_parser& parser, std::tr1::shared_ptr<HttpResponse> resp) {
+    char flags = parser.flags;
     SILOG(transfer, detailed, "Flags are: "
             << (flags & F_CHUNKED ? "F_CHUNKED " : "")
             << (flags & F_CONNECTION_KEEP_ALIVE ? "F_CONNECTION_KEEP_ALIVE " : "")
@@ -68,7 +68,7 @@ void HttpNameHandler::resolve(std::tr1::shared_ptr<MetadataRequest> request, Nam
     HttpManager::getSingleton().get(
         cdn_addr, url.fullpath(),
         std::tr1::bind(&HttpNameHandler::request_finished, this, _1, _2, _3, request, callback),
-        headers
+        headers, HttpManager::QueryParameters(), true, request->getPriority()
     );
 }
 
@@ -140,7 +140,7 @@ HttpChunkHandler::~HttpChunkHandler() {
 }
 
 void HttpChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-        std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+        std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
 
     //Check for null arguments
     std::tr1::shared_ptr<DenseData> bad;
@@ -171,11 +171,11 @@ void HttpChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
 
     //Check to see if it's in the cache first
     SharedChunkCache::getSingleton().getCache()->getData(file->getFingerprint(), chunk->getRange(), std::tr1::bind(
-            &HttpChunkHandler::cache_check_callback, this, _1, file, chunk, callback));
+            &HttpChunkHandler::cache_check_callback, this, _1, file, chunk, priority, callback));
 }
 
 void HttpChunkHandler::cache_check_callback(const SparseData* data, std::tr1::shared_ptr<RemoteFileMetadata> file,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
     if (data) {
         std::tr1::shared_ptr<const DenseData> flattened = data->flatten();
         callback(flattened);
@@ -195,7 +195,7 @@ void HttpChunkHandler::cache_check_callback(const SparseData* data, std::tr1::sh
         HttpManager::getSingleton().get(
             cdn_addr, url.fullpath(),
             std::tr1::bind(&HttpChunkHandler::request_finished, this, _1, _2, _3, file, chunk, callback),
-            headers
+            headers, HttpManager::QueryParameters(), true, priority
         );
     }
 }
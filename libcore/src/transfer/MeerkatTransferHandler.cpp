@@ -9,6 +9,7 @@
 #include <sirikata/core/transfer/MeerkatTransferHandler.hpp>
 #include <sirikata/core/transfer/OAuthHttpManager.hpp>
 #include <sirikata/core/transfer/URL.hpp>
+#include <sirikata/core/util/Timer.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include <json_spirit/json_spirit.h>
@@ -80,7 +81,7 @@ void MeerkatNameHandler::resolve(std::tr1::shared_ptr<MetadataRequest> request,
     HttpManager::getSingleton().head(
         cdn_addr, dns_uri_prefix + url.fullpath(),
         std::tr1::bind(&MeerkatNameHandler::request_finished, this, _1, _2, _3, request, callback),
-        headers
+        headers, HttpManager::QueryParameters(), true, request->getPriority()
     );
 }
 
@@ -187,7 +188,10 @@ MeerkatChunkHandler::MeerkatChunkHandler()
  : CDN_HOST_NAME(GetOptionValue<String>(OPT_CDN_HOST)),
    CDN_SERVICE(GetOptionValue<String>(OPT_CDN_SERVICE)),
    CDN_DOWNLOAD_URI_PREFIX(GetOptionValue<String>(OPT_CDN_DOWNLOAD_URI_PREFIX)),
-   mCdnAddr(CDN_HOST_NAME, CDN_SERVICE)
+   mCdnAddr(CDN_HOST_NAME, CDN_SERVICE),
+   mRangeThreshold(GetOptionValue<uint32>(OPT_CDN_RANGE_THRESHOLD)),
+   mMaxParallelRanges(std::max(GetOptionValue<uint32>(OPT_CDN_RANGE_PARALLEL), (uint32)1)),
+   mRangeThroughput(0)
 {
 }
 
@@ -195,7 +199,13 @@ MeerkatChunkHandler::~MeerkatChunkHandler() {
 }
 
 void MeerkatChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
-        std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+        std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
+    getStreaming(file, chunk, priority, ChunkPieceCallback(), callback);
+}
+
+void MeerkatChunkHandler::getStreaming(std::tr1::shared_ptr<RemoteFileMetadata> file,
+        std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+        ChunkPieceCallback piece_callback, ChunkCallback callback) {
 
     //Check for null arguments
     std::tr1::shared_ptr<DenseData> bad;
@@ -226,10 +236,15 @@ void MeerkatChunkHandler::get(std::tr1::shared_ptr<RemoteFileMetadata> file,
 
     //Check to see if it's in the cache first
     SharedChunkCache::getSingleton().getCache()->getData(file->getFingerprint(), chunk->getRange(), std::tr1::bind(
-            &MeerkatChunkHandler::cache_check_callback, this, _1, file->getURI(), chunk, callback));
+            &MeerkatChunkHandler::cache_check_callback, this, _1, file->getURI(), chunk, priority, piece_callback, callback));
+}
+
+void MeerkatChunkHandler::get(std::tr1::shared_ptr<Chunk> chunk, Priority priority, ChunkCallback callback) {
+    getStreaming(chunk, priority, ChunkPieceCallback(), callback);
 }
 
-void MeerkatChunkHandler::get(std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+void MeerkatChunkHandler::getStreaming(std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+        ChunkPieceCallback piece_callback, ChunkCallback callback) {
     std::tr1::shared_ptr<DenseData> bad;
     if (!chunk) {
         SILOG(transfer, error, "HttpChunkHandler get called with null chunk parameter");
@@ -238,11 +253,12 @@ void MeerkatChunkHandler::get(std::tr1::shared_ptr<Chunk> chunk, ChunkCallback c
     }
     //Check to see if it's in the cache first
     SharedChunkCache::getSingleton().getCache()->getData(chunk->getHash(), chunk->getRange(), std::tr1::bind(
-            &MeerkatChunkHandler::cache_check_callback, this, _1, URI("meerkat:///"), chunk, callback));
+            &MeerkatChunkHandler::cache_check_callback, this, _1, URI("meerkat:///"), chunk, priority, piece_callback, callback));
 }
 
 void MeerkatChunkHandler::cache_check_callback(const SparseData* data, const URI& uri,
-            std::tr1::shared_ptr<Chunk> chunk, ChunkCallback callback) {
+            std::tr1::shared_ptr<Chunk> chunk, Priority priority,
+            ChunkPieceCallback piece_callback, ChunkCallback callback) {
     if (data) {
         std::tr1::shared_ptr<const DenseData> flattened = data->flatten();
         callback(flattened);
@@ -265,27 +281,311 @@ void MeerkatChunkHandler::cache_check_callback(const SparseData* data, const URI
 
         HttpManager::Headers headers;
         headers["Host"] = host_name;
-        headers["Accept-Encoding"] = "deflate, gzip";
 
-        bool chunkReq = false;
-        if(!chunk->getRange().goesToEndOfFile() || chunk->getRange().startbyte() != 0) {
-            chunkReq = true;
-            headers["Range"] = "bytes=" + boost::lexical_cast<String>(chunk->getRange().startbyte()) +
-                "-" + boost::lexical_cast<String>(chunk->getRange().endbyte());
-        }
+        String path = download_uri_prefix + "/" + chunk->getHash().convertToHexString();
+
+        //Large chunks are split into several Range requests so they can be
+        //fetched over multiple connections at once
+        if (start_ranged(uri, chunk, cdn_addr, path, headers, priority, piece_callback, callback))
+            return;
+        request_chunk(uri, chunk, cdn_addr, path, headers, priority, piece_callback, callback);
+    }
+}
+
+void MeerkatChunkHandler::request_chunk(const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
+        const Network::Address& cdn_addr, const String& path, HttpManager::Headers headers,
+        Priority priority, ChunkPieceCallback piece_callback, ChunkCallback callback) {
+    headers["Accept-Encoding"] = "deflate, gzip";
+
+    bool chunkReq = false;
+    if(!chunk->getRange().goesToEndOfFile() || chunk->getRange().startbyte() != 0) {
+        chunkReq = true;
+        headers["Range"] = "bytes=" + boost::lexical_cast<String>(chunk->getRange().startbyte()) +
+            "-" + boost::lexical_cast<String>(chunk->getRange().endbyte());
+    }
 
+    if (!piece_callback) {
         HttpManager::getSingleton().get(
-            cdn_addr, download_uri_prefix + "/" + chunk->getHash().convertToHexString(),
-            std::tr1::bind(&MeerkatChunkHandler::request_finished, this, _1, _2, _3, uri, chunk, chunkReq, callback),
-            headers
+            cdn_addr, path,
+            std::tr1::bind(&MeerkatChunkHandler::request_finished, this, _1, _2, _3, uri, chunk, chunkReq, MutableDenseDataPtr(), callback),
+            headers, HttpManager::QueryParameters(), true, priority
+        );
+    } else {
+        //The pieces are also assembled here so the complete chunk can
+        //still be validated and cached once it's finished
+        MutableDenseDataPtr assembled(new DenseData(Range(true)));
+        assembled->reserve((size_t)chunk->getRange().length());
+        HttpManager::getSingleton().getStreaming(
+            cdn_addr, path,
+            std::tr1::bind(&MeerkatChunkHandler::request_data, _1, assembled, piece_callback),
+            std::tr1::bind(&MeerkatChunkHandler::request_finished, this, _1, _2, _3, uri, chunk, chunkReq, assembled, callback),
+            headers, HttpManager::QueryParameters(), true, priority
         );
     }
 }
 
+namespace {
+// Bounds on the size of each part of a ranged download. Parts are sized to
+// take about RANGE_PART_SECONDS at the throughput we've been seeing, which
+// keeps per-request overhead small on fast connections while still
+// splitting downloads up on slow ones.
+const uint64 MIN_RANGE_PART_SIZE = 256 * 1024;
+const uint64 MAX_RANGE_PART_SIZE = 8 * 1024 * 1024;
+const uint64 DEFAULT_RANGE_PART_SIZE = 1024 * 1024;
+const double RANGE_PART_SECONDS = 1.0;
+// Weight of each new measurement in the throughput estimate
+const double RANGE_THROUGHPUT_ALPHA = 0.25;
+}
+
+struct MeerkatChunkHandler::RangedDownload {
+    RangedDownload(const URI& _uri, std::tr1::shared_ptr<Chunk> _chunk,
+        const Network::Address& _addr, const String& _path, const HttpManager::Headers& _headers,
+        Priority _priority, ChunkPieceCallback _piece_callback, ChunkCallback _callback,
+        uint64 part_size)
+     : uri(_uri), chunk(_chunk), addr(_addr), path(_path), headers(_headers),
+       priority(_priority), piece_callback(_piece_callback), callback(_callback),
+       data(new DenseData(Range(0, _chunk->getRange().length(), LENGTH, true))),
+       partSize(part_size),
+       numParts((uint32)((_chunk->getRange().length() + part_size - 1) / part_size)),
+       received(numParts, 0),
+       started(numParts),
+       done(numParts, false),
+       nextPart(0),
+       outstanding(0),
+       delivered(0),
+       failed(false)
+    {}
+
+    uint64 partStart(uint32 part) const {
+        return part * partSize;
+    }
+    uint64 partLength(uint32 part) const {
+        return std::min(partSize, (uint64)data->length() - partStart(part));
+    }
+
+    const URI uri;
+    const std::tr1::shared_ptr<Chunk> chunk;
+    const Network::Address addr;
+    const String path;
+    const HttpManager::Headers headers;
+    const Priority priority;
+    const ChunkPieceCallback piece_callback;
+    const ChunkCallback callback;
+
+    // The complete chunk. Parts are written straight into place as they
+    // arrive, so nothing needs to be merged once they're all done.
+    const MutableDenseDataPtr data;
+    const uint64 partSize;
+    const uint32 numParts;
+    // Bytes received for each part. A part's data all arrives on one
+    // thread, so these are only touched by that part's callbacks.
+    std::vector<uint64> received;
+
+    // Parts finish on different HttpManager threads
+    boost::mutex mutex;
+    std::vector<Time> started;
+    std::vector<bool> done;
+    uint32 nextPart;
+    uint32 outstanding;
+    // Number of leading parts passed on to piece_callback
+    uint32 delivered;
+    bool failed;
+};
+
+void MeerkatChunkHandler::setRangedDownloads(uint64 threshold, uint32 max_parallel) {
+    boost::unique_lock<boost::mutex> lock(mRangeMutex);
+    mRangeThreshold = threshold;
+    mMaxParallelRanges = std::max(max_parallel, (uint32)1);
+}
+
+uint64 MeerkatChunkHandler::rangePartSize() {
+    boost::unique_lock<boost::mutex> lock(mRangeMutex);
+    if (mRangeThroughput <= 0)
+        return DEFAULT_RANGE_PART_SIZE;
+    uint64 part_size = (uint64)(mRangeThroughput * RANGE_PART_SECONDS);
+    return std::max(MIN_RANGE_PART_SIZE, std::min(MAX_RANGE_PART_SIZE, part_size));
+}
+
+void MeerkatChunkHandler::recordRangeThroughput(uint64 bytes, const Duration& elapsed) {
+    if (elapsed <= Duration::zero()) return;
+    double rate = bytes / elapsed.toSeconds();
+    boost::unique_lock<boost::mutex> lock(mRangeMutex);
+    if (mRangeThroughput <= 0)
+        mRangeThroughput = rate;
+    else
+        mRangeThroughput = (1 - RANGE_THROUGHPUT_ALPHA) * mRangeThroughput + RANGE_THROUGHPUT_ALPHA * rate;
+}
+
+bool MeerkatChunkHandler::start_ranged(const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
+        const Network::Address& cdn_addr, const String& path, const HttpManager::Headers& headers,
+        Priority priority, ChunkPieceCallback piece_callback, ChunkCallback callback) {
+    uint64 threshold;
+    uint32 max_parallel;
+    {
+        boost::unique_lock<boost::mutex> lock(mRangeMutex);
+        threshold = mRangeThreshold;
+        max_parallel = mMaxParallelRanges;
+    }
+
+    uint64 length = chunk->getRange().length();
+    if (threshold == 0 || max_parallel < 2 || length < threshold)
+        return false;
+    uint64 part_size = rangePartSize();
+    if (length <= part_size)
+        return false;
+
+    RangedDownloadPtr dl(new RangedDownload(uri, chunk, cdn_addr, path, headers,
+            priority, piece_callback, callback, part_size));
+    SILOG(transfer, detailed, "Downloading " << chunk->getHash().convertToHexString() << " (" << length
+        << " bytes) as " << dl->numParts << " ranges");
+
+    std::vector<uint32> parts;
+    {
+        boost::unique_lock<boost::mutex> lock(dl->mutex);
+        while(dl->nextPart < dl->numParts && dl->outstanding < max_parallel) {
+            dl->started[dl->nextPart] = Timer::now();
+            parts.push_back(dl->nextPart++);
+            dl->outstanding++;
+        }
+    }
+    for(uint32 i = 0; i < parts.size(); i++)
+        request_range(dl, parts[i]);
+    return true;
+}
+
+void MeerkatChunkHandler::request_range(RangedDownloadPtr dl, uint32 part) {
+    //Content-Range refers to the encoded body, so unlike request_chunk this
+    //doesn't add Accept-Encoding
+    HttpManager::Headers headers = dl->headers;
+    uint64 start = dl->chunk->getRange().startbyte() + dl->partStart(part);
+    headers["Range"] = "bytes=" + boost::lexical_cast<String>(start) +
+        "-" + boost::lexical_cast<String>(start + dl->partLength(part) - 1);
+
+    HttpManager::getSingleton().getStreaming(
+        dl->addr, dl->path,
+        std::tr1::bind(&MeerkatChunkHandler::range_data, dl, part, _1),
+        std::tr1::bind(&MeerkatChunkHandler::range_finished, this, dl, part, _1, _2, _3),
+        headers, HttpManager::QueryParameters(), true, dl->priority
+    );
+}
+
+void MeerkatChunkHandler::range_data(RangedDownloadPtr dl, uint32 part, DenseDataPtr piece) {
+    //Anything beyond the requested range means the server ignored the Range
+    //header, which is caught when the part finishes
+    uint64 part_length = dl->partLength(part);
+    if (piece->startbyte() >= part_length) return;
+    uint64 len = std::min((uint64)piece->length(), part_length - piece->startbyte());
+    std::memcpy(dl->data->writableData() + dl->partStart(part) + piece->startbyte(), piece->data(), (size_t)len);
+    //Retries start the part over, which just rewrites the same bytes
+    dl->received[part] = std::max(dl->received[part], (uint64)(piece->startbyte() + len));
+}
+
+void MeerkatChunkHandler::range_finished(RangedDownloadPtr dl, uint32 part,
+        std::tr1::shared_ptr<HttpManager::HttpResponse> response,
+        HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error) {
+
+    bool ok = (error == HttpManager::SUCCESS && response && response->getStatusCode() == 206 &&
+        dl->received[part] == dl->partLength(part));
+    if (ok) {
+        uint64 start = dl->chunk->getRange().startbyte() + dl->partStart(part);
+        HttpManager::Headers::const_iterator it = response->getHeaders().find("Content-Range");
+        ok = (it != response->getHeaders().end() &&
+            it->second.find("bytes " + boost::lexical_cast<String>(start) + "-") == 0);
+    }
+
+    uint32 max_parallel;
+    {
+        boost::unique_lock<boost::mutex> lock(mRangeMutex);
+        max_parallel = mMaxParallelRanges;
+    }
+
+    bool fallback = false, complete = false;
+    std::vector<uint32> parts;
+    std::vector<DenseDataPtr> pieces;
+    Duration elapsed;
+    {
+        boost::unique_lock<boost::mutex> lock(dl->mutex);
+        dl->outstanding--;
+        if (dl->failed) return;
+
+        if (!ok) {
+            dl->failed = true;
+            fallback = true;
+        } else {
+            dl->done[part] = true;
+            elapsed = Timer::now() - dl->started[part];
+
+            //Pieces are passed on in order, so a part is only handed out once
+            //all the parts before it are done
+            while(dl->delivered < dl->numParts && dl->done[dl->delivered]) {
+                if (dl->piece_callback) {
+                    uint32 p = dl->delivered;
+                    MutableDenseDataPtr piece(new DenseData(Range(dl->partStart(p), dl->partLength(p), LENGTH, false)));
+                    std::memcpy(piece->writableData(), dl->data->writableData() + dl->partStart(p), (size_t)dl->partLength(p));
+                    pieces.push_back(piece);
+                }
+                dl->delivered++;
+            }
+            complete = (dl->delivered == dl->numParts);
+
+            while(dl->nextPart < dl->numParts && dl->outstanding < max_parallel) {
+                dl->started[dl->nextPart] = Timer::now();
+                parts.push_back(dl->nextPart++);
+                dl->outstanding++;
+            }
+        }
+    }
+
+    if (fallback) {
+        //Most likely the server doesn't support ranges, so just get it all in
+        //one request. Pieces that were already handed out will be repeated.
+        SILOG(transfer, warn, "Ranged download of " << dl->chunk->getHash().convertToHexString()
+            << " failed, falling back to a single request (" << dl->uri << ")");
+        request_chunk(dl->uri, dl->chunk, dl->addr, dl->path, dl->headers,
+            dl->priority, dl->piece_callback, dl->callback);
+        return;
+    }
+
+    recordRangeThroughput(dl->partLength(part), elapsed);
+    for(uint32 i = 0; i < parts.size(); i++)
+        request_range(dl, parts[i]);
+    for(uint32 i = 0; i < pieces.size(); i++)
+        dl->piece_callback(pieces[i]);
+
+    if (complete) {
+        SILOG(transfer, detailed, "about to call addToCache with fingerprint ID = " << dl->chunk->getHash().convertToHexString());
+        SharedChunkCache::getSingleton().getCache()->addToCache(dl->chunk->getHash(), dl->data);
+        dl->callback(dl->data);
+    }
+}
+
+void MeerkatChunkHandler::request_data(DenseDataPtr piece, MutableDenseDataPtr assembled,
+        ChunkPieceCallback piece_callback) {
+    //If the request had to be retried the body starts over, so skip anything
+    //we've already seen
+    cache_usize_type have = assembled->length();
+    if (piece->startbyte() > have || piece->endbyte() < have)
+        return;
+    cache_usize_type skip = have - piece->startbyte();
+    cache_usize_type length = piece->length() - skip;
+    if (length == 0)
+        return;
+    assembled->append((const char*)piece->data() + skip, (size_t)length, true);
+
+    //Only hand out the bytes that haven't been delivered before
+    if (skip == 0) {
+        piece_callback(piece);
+        return;
+    }
+    MutableDenseDataPtr fresh(new DenseData(Range(have, length, LENGTH, false)));
+    std::memcpy(fresh->writableData(), piece->data() + skip, (size_t)length);
+    piece_callback(fresh);
+}
+
 void MeerkatChunkHandler::request_finished(std::tr1::shared_ptr<HttpManager::HttpResponse> response,
         HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error,
         const URI& uri, std::tr1::shared_ptr<Chunk> chunk,
-        bool chunkReq, ChunkCallback callback) {
+        bool chunkReq, MutableDenseDataPtr streamed, ChunkCallback callback) {
 
     std::tr1::shared_ptr<DenseData> bad;
     std::string reqType = "file request";
@@ -329,7 +629,12 @@ void MeerkatChunkHandler::request_finished(std::tr1::shared_ptr<HttpManager::Htt
         return;
     }
 
-    if (!response->getData()) {
+    //Streamed bodies were collected as they arrived
+    std::tr1::shared_ptr<DenseData> data = response->getData();
+    if (streamed && streamed->length() > 0)
+        data = streamed;
+
+    if (!data) {
         SILOG(transfer, error, "Body not present during an HTTP " << reqType << " (" << uri << ")");
         callback(bad);
         return;
@@ -364,7 +669,7 @@ void MeerkatChunkHandler::request_finished(std::tr1::shared_ptr<HttpManager::Htt
 
                 if (range_start == chunk->getRange().startbyte() &&
                         range_end == chunk->getRange().endbyte() &&
-                        response->getData()->length() == chunk->getRange().length()) {
+                        data->length() == chunk->getRange().length()) {
                     range_parsed = true;
                 }
             }
@@ -375,17 +680,17 @@ void MeerkatChunkHandler::request_finished(std::tr1::shared_ptr<HttpManager::Htt
             callback(bad);
             return;
         }
-    } else if (!chunkReq && response->getData()->length() != chunk->getRange().size()) {
+    } else if (!chunkReq && data->length() != chunk->getRange().size()) {
         SILOG(transfer, error, "Data retrieved not expected size during an HTTP "
-                << reqType << " response=" << response->getData()->length() << " expected=" << chunk->getRange().size());
+                << reqType << " response=" << data->length() << " expected=" << chunk->getRange().size());
         callback(bad);
         return;
     }
 
     SILOG(transfer, detailed, "about to call addToCache with fingerprint ID = " << chunk->getHash().convertToHexString());
-    SharedChunkCache::getSingleton().getCache()->addToCache(chunk->getHash(), response->getData());
+    SharedChunkCache::getSingleton().getCache()->addToCache(chunk->getHash(), data);
 
-    callback(response->getData());
+    callback(data);
     SILOG(transfer, detailed, "done http chunk handler request_finished");
 }
 
@@ -76,7 +76,11 @@ void ResourceDownloadTask::updatePriority(float64 priority) {
 void ResourceDownloadTask::cancel() {
     // Delete request and ensure we won't perform the callback even if it's in
     // the process of finishing
-    cb = 0;
+    {
+        boost::lock_guard<boost::mutex> lock(mCallbackMutex);
+        cb = 0;
+        mProgressCallback = 0;
+    }
     if (mCurrentRequest)
         mTransferPool->deleteRequest(mCurrentRequest);
 }
@@ -90,6 +94,38 @@ void ResourceDownloadTask::mergeData(const Transfer::SparseData &dataToMerge) {
   }
 }
 
+void ResourceDownloadTask::setProgressCallback(ProgressCallback progress_cb) {
+    assert(!mStarted);
+    boost::lock_guard<boost::mutex> lock(mCallbackMutex);
+    mProgressCallback = progress_cb;
+}
+
+ResourceDownloadTask::DownloadCallback ResourceDownloadTask::callback() {
+    boost::lock_guard<boost::mutex> lock(mCallbackMutex);
+    return cb;
+}
+
+bool ResourceDownloadTask::hasProgressCallback() {
+    boost::lock_guard<boost::mutex> lock(mCallbackMutex);
+    return (bool)mProgressCallback;
+}
+
+void ResourceDownloadTask::chunkProgressWeak(ResourceDownloadTaskWPtr thiswptr, DenseDataPtr piece) {
+    ResourceDownloadTaskPtr thisptr(thiswptr.lock());
+    if (thisptr) thisptr->chunkProgress(piece);
+}
+
+void ResourceDownloadTask::chunkProgress(DenseDataPtr piece) {
+    // Pieces can still trickle in after a cancel, which may be running on
+    // another thread
+    ProgressCallback progress_cb;
+    {
+        boost::lock_guard<boost::mutex> lock(mCallbackMutex);
+        if (cb) progress_cb = mProgressCallback;
+    }
+    if (!progress_cb) return;
+    progress_cb(getSharedPtr(), piece);
+}
 
 void ResourceDownloadTask::chunkFinishedWeak(ResourceDownloadTaskWPtr thiswptr, ChunkRequestPtr request, DenseDataPtr response) {
     ResourceDownloadTaskPtr thisptr(thiswptr.lock());
@@ -107,14 +143,15 @@ void ResourceDownloadTask::chunkFinished(TransferRequestPtr request,
     // Let the request get cleaned up.
     mCurrentRequest.reset();
 
+    DownloadCallback finished_cb = callback();
     // Nothing to do with no callback
-    if (!cb) return;
+    if (!finished_cb) return;
 
     if (response != NULL) {
-        cb(getSharedPtr(), request, response);
+        finished_cb(getSharedPtr(), request, response);
     }
     else {
-        cb(getSharedPtr(), request, Transfer::DenseDataPtr());
+        finished_cb(getSharedPtr(), request, Transfer::DenseDataPtr());
     }
 }
 
@@ -131,15 +168,19 @@ void ResourceDownloadTask::metadataFinished(MetadataRequestPtr request,
     //TODO: Support files with more than 1 chunk
     assert(response->getChunkList().size() == 1);
 
-    mCurrentRequest = TransferRequestPtr(new Transfer::ChunkRequest(mURI, *response,
+    ChunkRequestPtr chunk_req(new Transfer::ChunkRequest(mURI, *response,
             response->getChunkList().front(), mPriority,
             std::tr1::bind(&ResourceDownloadTask::chunkFinishedWeak, getWeakPtr(), _1, _2)));
+    if (hasProgressCallback())
+        chunk_req->setProgressCallback(std::tr1::bind(&ResourceDownloadTask::chunkProgressWeak, getWeakPtr(), _2));
+    mCurrentRequest = chunk_req;
 
     mTransferPool->addRequest(mCurrentRequest);
   }
   else {
       SILOG(ogre,error,"Failed metadata download");
-      if (cb) cb(getSharedPtr(), ChunkRequestPtr(), Transfer::DenseDataPtr());
+      DownloadCallback finished_cb = callback();
+      if (finished_cb) finished_cb(getSharedPtr(), ChunkRequestPtr(), Transfer::DenseDataPtr());
   }
 }
 
@@ -151,9 +192,12 @@ void ResourceDownloadTask::start()
 
     if (mURI.empty()) {
         //just a hash lookup
-        mCurrentRequest = TransferRequestPtr(
+        DirectChunkRequestPtr chunk_req(
             new DirectChunkRequest(mChunk, mPriority,
                 std::tr1::bind(&ResourceDownloadTask::directChunkFinishedWeak, getWeakPtr(), _1, _2)));
+        if (hasProgressCallback())
+            chunk_req->setProgressCallback(std::tr1::bind(&ResourceDownloadTask::chunkProgressWeak, getWeakPtr(), _2));
+        mCurrentRequest = chunk_req;
     } else {
         //a full name/hash lookup
         mCurrentRequest = TransferRequestPtr(
@@ -2,7 +2,6 @@
 
 #include <sirikata/core/transfer/TransferMediator.hpp>
 #include <sirikata/core/transfer/MaxPriorityAggregation.hpp>
-#include <sirikata/core/util/Timer.hpp>
 #include <stdio.h>
 
 using namespace std;
@@ -27,38 +26,37 @@ void TransferMediator::destroy() {
     AutoSingleton<TransferMediator>::destroy();
 }
 
-TransferMediator::TransferMediator() {
-    mCleanup = false;
-    mNumOutstanding = 0;
+TransferMediator::TransferMediator()
+ : mDeltasScheduled(false),
+   mCleanup(false)
+{
+    mMaxOutstanding[HANDLER_HTTP] = MAX_OUTSTANDING_HTTP;
+    mMaxOutstanding[HANDLER_FILE] = MAX_OUTSTANDING_FILE;
+    mMaxOutstanding[HANDLER_DATA] = MAX_OUTSTANDING_DATA;
+    mMaxOutstanding[HANDLER_OTHER] = MAX_OUTSTANDING_OTHER;
+    for(uint32 i = 0; i < NUM_HANDLER_CLASSES; i++)
+        mNumOutstanding[i] = 0;
+
     mAggregationAlgorithm = new MaxPriorityAggregation();
-    mThread = new Thread("TransferMediator", std::tr1::bind(&TransferMediator::mediatorThread, this));
-}
 
-TransferMediator::~TransferMediator() {
-    delete mAggregationAlgorithm;
+    mServicePool = new Network::IOServicePool("TransferMediator", 1);
+    mServicePool->startWork();
+    mServicePool->run();
 }
 
-void TransferMediator::mediatorThread() {
-    while(!mCleanup) {
-        checkQueue();
-
-        /**
-           Ewen and I weren't able to identify why the below call caused a
-           deadlock on the shared space hosted on sns30 (could not reproduce on
-           other machines).  With the below line, in gdb, with bulletphysics on,
-           and servermap-options set to port 6880, we'd get 4 calls to
-           checkQueue, followed by no follow up calls.  Not sure what to say.
-         */
-        //boost::this_thread::sleep(boost::posix_time::milliseconds(5));
-        Timer::sleep(Duration::milliseconds(5));
-    }
-    for(PoolType::iterator pool = mPools.begin(); pool != mPools.end(); pool++) {
-        pool->second->cleanup();
-        pool->second->getTransferPool()->addRequest(std::tr1::shared_ptr<TransferRequest>());
-    }
-    for(PoolType::iterator pool = mPools.begin(); pool != mPools.end(); pool++) {
-        pool->second->getThread()->join();
+TransferMediator::~TransferMediator() {
+    cleanup();
+
+    // Pools may outlive us, make sure they stop calling in
+    {
+        boost::unique_lock<boost::shared_mutex> lock(mPoolMutex);
+        for(PoolType::iterator it = mPools.begin(); it != mPools.end(); it++)
+            it->second->mDeltaCallback = TransferPool::DeltaCallback();
+        mPools.clear();
     }
+
+    delete mServicePool;
+    delete mAggregationAlgorithm;
 }
 
 void TransferMediator::registerPool(TransferPoolPtr pool) {
@@ -70,77 +68,207 @@ void TransferMediator::registerPool(TransferPoolPtr pool) {
     PoolType::iterator findClientId = mPools.find(pool->getClientID());
     assert(findClientId == mPools.end());
 
-    std::tr1::shared_ptr<PoolWorker> worker(new PoolWorker(pool));
-    mPools.insert(PoolType::value_type(pool->getClientID(), worker));
+    pool->mDeltaCallback = std::tr1::bind(&TransferMediator::pushDelta, this, _1);
+    mPools.insert(PoolType::value_type(pool->getClientID(), pool));
 }
 
 void TransferMediator::cleanup() {
-    mCleanup = true;
-    mThread->join();
+    {
+        boost::unique_lock<boost::mutex> lock(mDeltaMutex);
+        if (mCleanup) return;
+        mCleanup = true;
+    }
+    // Drains anything already posted, then stops the thread
+    mServicePool->join();
 }
 
-void TransferMediator::execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id) {
-    boost::unique_lock<boost::mutex> lock(mAggMutex, boost::defer_lock_t());
-    lock.lock();
+TransferMediator::HandlerClass TransferMediator::classify(TransferRequestPtr req) {
+    String scheme;
+    ChunkRequestPtr chunk_req = std::tr1::dynamic_pointer_cast<ChunkRequest>(req);
+    MetadataRequestPtr metadata_req = std::tr1::dynamic_pointer_cast<MetadataRequest>(req);
+    // Chunk requests are dispatched based on the URI in their metadata, see
+    // ChunkRequest::execute
+    if (chunk_req)
+        scheme = chunk_req->getMetadata().getURI().scheme();
+    else if (metadata_req)
+        scheme = metadata_req->getURI().scheme();
+    else if (std::tr1::dynamic_pointer_cast<DirectChunkRequest>(req) ||
+        std::tr1::dynamic_pointer_cast<UploadRequest>(req))
+        return HANDLER_HTTP; // Both always go to the CDN
+
+    if (scheme == "http" || scheme == "meerkat")
+        return HANDLER_HTTP;
+    else if (scheme == "file")
+        return HANDLER_FILE;
+    else if (scheme == "data")
+        return HANDLER_DATA;
+    return HANDLER_OTHER;
+}
 
+void TransferMediator::pushDelta(TransferRequestPtr req) {
+    boost::unique_lock<boost::mutex> lock(mDeltaMutex);
+    if (mCleanup) return;
+
+    mDeltas.push_back(req);
+    // Bursts of changes, e.g. a frame's worth of priority updates, are
+    // applied together by a single handler
+    if (!mDeltasScheduled) {
+        mDeltasScheduled = true;
+        mServicePool->service()->post(
+            std::tr1::bind(&TransferMediator::processDeltas, this),
+            "TransferMediator::processDeltas"
+        );
+    }
+}
+
+void TransferMediator::processDeltas() {
+    std::vector<TransferRequestPtr> deltas;
+    {
+        boost::unique_lock<boost::mutex> lock(mDeltaMutex);
+        deltas.swap(mDeltas);
+        mDeltasScheduled = false;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mAggMutex);
+        for(std::vector<TransferRequestPtr>::iterator it = deltas.begin(); it != deltas.end(); it++)
+            applyDelta(*it);
+    }
+
+    checkQueue();
+}
+
+void TransferMediator::applyDelta(TransferRequestPtr req) {
     AggregateListByID& idIndex = mAggregateList.get<tagID>();
-    AggregateListByID::iterator findID = idIndex.find(id);
-    if(findID == idIndex.end()) {
-        //This can happen now if a request was canceled but it was already outstanding
-        mNumOutstanding--;
-        lock.unlock();
-        checkQueue();
-        return;
+    AggregateListByID::iterator findID = idIndex.find(req->getIdentifier());
+
+    //Check if this request already exists
+    if(findID != idIndex.end()) {
+        //store original aggregated priority for later
+        Priority oldAggPriority = (*findID)->getPriority();
+
+        //Check if this request is for deleting
+        if(req->isDeletionRequest()) {
+            const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
+                allReqs = (*findID)->getTransferRequests();
+
+            std::map<std::string,
+                std::tr1::shared_ptr<TransferRequest> >::const_iterator findClient =
+                allReqs.find(req->getClientID());
+
+            /* If the client isn't in the aggregated request, it must have already
+             * been deleted, or the deletion request is invalid
+             */
+            if(findClient == allReqs.end())
+                return;
+
+            if(allReqs.size() == 1) {
+                // If only one in the list, we can erase the entire request. If
+                // it's outstanding its slot is freed when it finishes.
+                mAggregateList.erase(findID);
+                return;
+            }
+
+            /* If there are more than one, we need to just delete the single client
+             * from the aggregate request
+             */
+            (*findID)->removeClient(req->getClientID());
+        } else {
+            //Update the priority of this client
+            (*findID)->setClientPriority(req);
+        }
+
+        //And check if it's changed, we need to update the index. This
+        //repositions the request in place in every index.
+        Priority newAggPriority = (*findID)->getPriority();
+        if(oldAggPriority != newAggPriority) {
+            //Convert the iterator to the priority one and update
+            AggregateListByPriority::iterator byPriority =
+                mAggregateList.project<tagPriority>(findID);
+            AggregateListByPriority & priorityIndex =
+                mAggregateList.get<tagPriority>();
+            // mPriority was already changed by the AggregateRequest, restore
+            // it so the container sees the change
+            (*findID)->mPriority = oldAggPriority;
+            priorityIndex.modify_key(byPriority, boost::lambda::_1=newAggPriority);
+        }
+    } else if (!req->isDeletionRequest()) {
+        //Make a new one and insert it
+        std::tr1::shared_ptr<AggregateRequest> newAggReq(new AggregateRequest(req));
+        mAggregateList.insert(newAggReq);
     }
+}
+
+void TransferMediator::execute_finished(std::tr1::shared_ptr<TransferRequest> req, std::string id, uint32 handler) {
+    // Called from the handler's thread, get back onto ours
+    mServicePool->service()->post(
+        std::tr1::bind(&TransferMediator::handleExecuteFinished, this, req, id, handler),
+        "TransferMediator::handleExecuteFinished"
+    );
+}
+
+void TransferMediator::handleExecuteFinished(std::tr1::shared_ptr<TransferRequest> req, std::string id, uint32 handler) {
+    std::map<std::string, std::tr1::shared_ptr<TransferRequest> > allReqs;
+    {
+        boost::unique_lock<boost::mutex> lock(mAggMutex);
 
-    const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
-        allReqs = (*findID)->getTransferRequests();
+        mNumOutstanding[handler]--;
+
+        AggregateListByID& idIndex = mAggregateList.get<tagID>();
+        AggregateListByID::iterator findID = idIndex.find(id);
+        //This can happen if a request was canceled but it was already outstanding
+        if(findID != idIndex.end()) {
+            allReqs = (*findID)->getTransferRequests();
+            mAggregateList.erase(findID);
+        }
+    }
 
+    // Callers may add new requests in response, so they are notified without
+    // holding any locks
     for(std::map<std::string, std::tr1::shared_ptr<TransferRequest> >::const_iterator
             it = allReqs.begin(); it != allReqs.end(); it++) {
         SILOG(transfer, detailed, "Notifying a caller that TransferRequest is complete");
         it->second->notifyCaller(it->second, req);
     }
 
-    mAggregateList.erase(findID);
-
-    mNumOutstanding--;
-    lock.unlock();
     SILOG(transfer, detailed, "done transfer mediator execute_finished");
     checkQueue();
 }
 
 void TransferMediator::checkQueue() {
-    boost::unique_lock<boost::mutex> lock(mAggMutex, boost::defer_lock_t());
-
-    lock.lock();
-
-    AggregateListByPriority & priorityIndex = mAggregateList.get<tagPriority>();
-    AggregateListByPriority::iterator findTop = priorityIndex.begin();
-
-    if(findTop != priorityIndex.end()) {
-        std::string topId = (*findTop)->getIdentifier();
-        SILOG(transfer, detailed, priorityIndex.size() << " length agg list, top priority "
-                << (*findTop)->getPriority() << " id " << topId);
-    }
-
-    // While we have free slots and there are items left, scan for items that
-    // haven't been started yet that we can process.
-    while(findTop != priorityIndex.end() && mNumOutstanding < 10) {
-        if (!(*findTop)->mExecuting) {
-            mNumOutstanding++;
-            (*findTop)->mExecuting = true;
-            std::tr1::shared_ptr<TransferRequest> req = (*findTop)->getSingleRequest();
-            req->execute(
-                req,
-                std::tr1::bind(&TransferMediator::execute_finished, this,
-                    req, (*findTop)->getIdentifier())
-            );
+    std::vector<std::tr1::shared_ptr<AggregateRequest> > toExecute;
+    {
+        boost::unique_lock<boost::mutex> lock(mAggMutex);
+
+        SILOG(transfer, detailed, mAggregateList.size() << " length agg list");
+
+        // For each kind of handler with free slots, start the highest priority
+        // requests that haven't been started yet. These are always at the
+        // front of that handler's range in the handler index.
+        AggregateListByHandler& handlerIndex = mAggregateList.get<tagHandler>();
+        for(uint32 handler = 0; handler < NUM_HANDLER_CLASSES; handler++) {
+            while(mNumOutstanding[handler] < mMaxOutstanding[handler]) {
+                AggregateListByHandler::iterator next =
+                    handlerIndex.lower_bound(boost::make_tuple(handler, false));
+                if (next == handlerIndex.end() ||
+                    (*next)->mHandlerClass != handler || (*next)->mExecuting)
+                    break;
+
+                handlerIndex.modify(next, MarkExecuting());
+                mNumOutstanding[handler]++;
+                toExecute.push_back(*next);
+            }
         }
-        findTop++;
     }
 
-    lock.unlock();
+    for(uint32 i = 0; i < toExecute.size(); i++) {
+        std::tr1::shared_ptr<TransferRequest> req = toExecute[i]->getSingleRequest();
+        req->execute(
+            req,
+            std::tr1::bind(&TransferMediator::execute_finished, this,
+                req, toExecute[i]->getIdentifier(), toExecute[i]->mHandlerClass)
+        );
+    }
 }
 
 
@@ -165,21 +293,20 @@ std::tr1::shared_ptr<TransferRequest> TransferMediator::AggregateRequest::getSin
 void TransferMediator::AggregateRequest::setClientPriority(std::tr1::shared_ptr<TransferRequest> req) {
     const std::string& clientID = req->getClientID();
     std::map<std::string, std::tr1::shared_ptr<TransferRequest> >::iterator findClient = mTransferReqs.find(clientID);
-    if(findClient == mTransferReqs.end()) {
+    if(findClient == mTransferReqs.end())
         mTransferReqs[clientID] = req;
-        updateAggregatePriority();
-    } else if(findClient->second->getPriority() != req->getPriority()) {
-        findClient->second = req;
-        updateAggregatePriority();
-    } else {
+    else
         findClient->second = req;
-    }
+    // Pools usually pass the same request object back with its priority
+    // already changed, so we can't tell whether it changed by comparing.
+    updateAggregatePriority();
 }
 
 void TransferMediator::AggregateRequest::removeClient(std::string clientID) {
     std::map<std::string, std::tr1::shared_ptr<TransferRequest> >::iterator findClient = mTransferReqs.find(clientID);
     if(findClient != mTransferReqs.end()) {
         mTransferReqs.erase(findClient);
+        updateAggregatePriority();
     }
 }
 
@@ -192,100 +319,13 @@ Priority TransferMediator::AggregateRequest::getPriority() const {
 }
 
 TransferMediator::AggregateRequest::AggregateRequest(std::tr1::shared_ptr<TransferRequest> req)
- : mIdentifier(req->getIdentifier()),
-   mExecuting(false)
+ : mExecuting(false),
+   mHandlerClass(TransferMediator::classify(req)),
+   mIdentifier(req->getIdentifier())
 {
     setClientPriority(req);
 }
 
-/*
- * TransferMediator::PoolWorker definitions
- */
-
-TransferMediator::PoolWorker::PoolWorker(std::tr1::shared_ptr<TransferPool> transferPool)
-    : mTransferPool(transferPool), mCleanup(false) {
-    mWorkerThread = new Thread("TransferMediator Worker", std::tr1::bind(&PoolWorker::run, this));
-}
-
-std::tr1::shared_ptr<TransferPool> TransferMediator::PoolWorker::getTransferPool() const {
-    return mTransferPool;
-}
-
-Thread * TransferMediator::PoolWorker::getThread() const {
-    return mWorkerThread;
-}
-
-void TransferMediator::PoolWorker::cleanup() {
-    mCleanup = true;
-}
-
-void TransferMediator::PoolWorker::run() {
-    while(!mCleanup) {
-        std::tr1::shared_ptr<TransferRequest> req = TransferMediator::getRequest(mTransferPool);
-        if(req == NULL) {
-            continue;
-        }
-        //SILOG(transfer, debug, "worker got one!");
-
-        boost::unique_lock<boost::mutex> lock(TransferMediator::getSingleton().mAggMutex);
-        AggregateListByID& idIndex = TransferMediator::getSingleton().mAggregateList.get<tagID>();
-        AggregateListByID::iterator findID = idIndex.find(req->getIdentifier());
-
-        //Check if this request already exists
-        if(findID != idIndex.end()) {
-            //Check if this request is for deleting
-            if(req->isDeletionRequest()) {
-                const std::map<std::string, std::tr1::shared_ptr<TransferRequest> >&
-                    allReqs = (*findID)->getTransferRequests();
-
-                std::map<std::string,
-                    std::tr1::shared_ptr<TransferRequest> >::const_iterator findClient =
-                    allReqs.find(req->getClientID());
-
-                /* If the client isn't in the aggregated request, it must have already
-                 * been deleted, or the deletion request is invalid
-                 */
-                if(findClient == allReqs.end()) {
-                    continue;
-                }
-
-                if(allReqs.size() > 1) {
-                    /* If there are more than one, we need to just delete the single client
-                     * from the aggregate request
-                     */
-                    (*findID)->removeClient(req->getClientID());
-                } else {
-                    // If only one in the list, we can erase the entire request
-                    TransferMediator::getSingleton().mAggregateList.erase(findID);
-                }
-            } else {
-                //store original aggregated priority for later
-                Priority oldAggPriority = (*findID)->getPriority();
-
-                //Update the priority of this client
-                (*findID)->setClientPriority(req);
-
-                //And check if it's changed, we need to update the index
-                Priority newAggPriority = (*findID)->getPriority();
-                if(oldAggPriority != newAggPriority) {
-                    //Convert the iterator to the priority one and update
-                    AggregateListByPriority::iterator byPriority =
-                            TransferMediator::getSingleton().mAggregateList.project<tagPriority>(findID);
-                    AggregateListByPriority & priorityIndex =
-                            TransferMediator::getSingleton().mAggregateList.get<tagPriority>();
-                    priorityIndex.modify_key(byPriority, boost::lambda::_1=newAggPriority);
-                }
-            }
-        } else {
-            //Make a new one and insert it
-            //SILOG(transfer, debug, "worker id " << mTransferPool->getClientID() << " adding url " << req->getIdentifier());
-            std::tr1::shared_ptr<AggregateRequest> newAggReq(new AggregateRequest(req));
-            TransferMediator::getSingleton().mAggregateList.insert(newAggReq);
-        }
-
-    }
-}
-
 void TransferMediator::registerContext(Context* ctx) {
     if (ctx->commander()) {
         ctx->commander()->registerCommand(
@@ -38,17 +38,21 @@ void ChunkRequest::execute(std::tr1::shared_ptr<TransferRequest> req, ExecuteFin
     std::tr1::shared_ptr<ChunkRequest> casted =
             std::tr1::static_pointer_cast<ChunkRequest, TransferRequest>(req);
 
+    ChunkHandler::ChunkPieceCallback piece_cb;
+    if (mProgressCallback)
+        piece_cb = std::tr1::bind(mProgressCallback, casted, _1);
+
     if (casted->getMetadata().getURI().scheme() == "meerkat") {
-        MeerkatChunkHandler::getSingleton().get(mMetadata, mChunk, std::tr1::bind(
+        MeerkatChunkHandler::getSingleton().getStreaming(mMetadata, mChunk, getPriority(), piece_cb, std::tr1::bind(
                 &ChunkRequest::execute_finished, this, _1, cb));
     } else if (casted->getMetadata().getURI().scheme() == "file") {
-        FileChunkHandler::getSingleton().get(mMetadata, mChunk, std::tr1::bind(
+        FileChunkHandler::getSingleton().getStreaming(mMetadata, mChunk, getPriority(), piece_cb, std::tr1::bind(
                 &ChunkRequest::execute_finished, this, _1, cb));
     } else if (casted->getMetadata().getURI().scheme() == "http") {
-        HttpChunkHandler::getSingleton().get(mMetadata, mChunk, std::tr1::bind(
+        HttpChunkHandler::getSingleton().getStreaming(mMetadata, mChunk, getPriority(), piece_cb, std::tr1::bind(
                 &ChunkRequest::execute_finished, this, _1, cb));
     } else if (casted->getMetadata().getURI().scheme() == "data") {
-        DataChunkHandler::getSingleton().get(mMetadata, mChunk, std::tr1::bind(
+        DataChunkHandler::getSingleton().getStreaming(mMetadata, mChunk, getPriority(), piece_cb, std::tr1::bind(
                 &ChunkRequest::execute_finished, this, _1, cb));
     } else {
         SILOG(transfer, error, "Got unknown protocol in Chunk request: " << casted->getMetadata().getURI().scheme());
@@ -105,7 +109,11 @@ void DirectChunkRequest::execute(std::tr1::shared_ptr<TransferRequest> req, Exec
     std::tr1::shared_ptr<DirectChunkRequest> casted =
             std::tr1::static_pointer_cast<DirectChunkRequest, TransferRequest>(req);
 
-    MeerkatChunkHandler::getSingleton().get(mChunk,
+    ChunkHandler::ChunkPieceCallback piece_cb;
+    if (mProgressCallback)
+        piece_cb = std::tr1::bind(mProgressCallback, casted, _1);
+
+    MeerkatChunkHandler::getSingleton().getStreaming(mChunk, getPriority(), piece_cb,
             std::tr1::bind(&DirectChunkRequest::execute_finished, this, _1, cb));
 }
 
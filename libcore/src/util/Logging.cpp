@@ -33,6 +33,9 @@
 #include <sirikata/core/util/Standard.hh>
 #include <sirikata/core/options/Options.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
 
 extern "C" {
 void *Sirikata_Logging_OptionValue_defaultLevel;
@@ -42,14 +45,176 @@ void *Sirikata_Logging_OptionValue_moduleLevel;
 namespace Sirikata { namespace Logging {
 
 extern "C" {
+AtomicValue<int32> SirikataLogLevelCeiling(insane);
 std::ostream* SirikataLogStream = &std::cerr;
 }
 
+namespace {
+
+/** Ring of formatted log lines filled by a single thread and emptied by
+ *  whoever holds LogState::writeMutex. Slots keep their storage between uses,
+ *  so once warmed up queueing a line is a copy into existing memory and a
+ *  single atomic increment.
+ */
+class LogRing {
+public:
+    // Must be a power of 2 so indices stay consistent across wraparound.
+    static const uint32 Capacity = 1024;
+
+    LogRing()
+     : retired(false),
+       mSlots(Capacity),
+       mHead(0),
+       mTail(0),
+       mCachedTail(0)
+    {}
+
+    /// Called by the owning thread. Returns false if the ring is full.
+    bool push(const String& line) {
+        uint32 head = mHead.read();
+        if (head - mCachedTail >= Capacity) {
+            // Only go back to the shared tail when our cached copy says we're
+            // full, keeping the common case free of extra atomic operations.
+            mCachedTail = (mTail += 0);
+            if (head - mCachedTail >= Capacity)
+                return false;
+        }
+        mSlots[head & (Capacity-1)].assign(line);
+        ++mHead;
+        return true;
+    }
+
+    /// Called by the owning thread, approximate number of queued lines.
+    uint32 queued() const {
+        return mHead.read() - mCachedTail;
+    }
+
+    /// Called with LogState::writeMutex held. Appends all queued lines to out.
+    void drain(String* out) {
+        uint32 head = (mHead += 0);
+        uint32 tail = mTail.read();
+        uint32 count = head - tail;
+        for(; tail != head; tail++) {
+            String& slot = mSlots[tail & (Capacity-1)];
+            out->append(slot);
+            out->push_back('\n');
+            slot.clear();
+        }
+        // Only release the slots once we're done reading them.
+        mTail += count;
+    }
+
+    bool empty() const {
+        return mHead.read() == mTail.read();
+    }
+
+    // Set, under LogState::writeMutex, when the owning thread exits.
+    bool retired;
+
+private:
+    std::vector<String> mSlots;
+    AtomicValue<uint32> mHead;
+    AtomicValue<uint32> mTail;
+    // Producer's view of mTail, only touched by the owning thread.
+    uint32 mCachedTail;
+};
+
+void retireLogRing(LogRing* ring);
+
+// All the state for writing log lines. It's allocated once and never freed so
+// it remains usable while other static objects are being destroyed.
+struct LogState {
+    LogState()
+     : localRing(retireLogRing),
+       writer(NULL),
+       async(false),
+       stopping(false)
+    {}
+
+    // Protects rings, the log stream and the writer thread.
+    boost::mutex writeMutex;
+    boost::condition_variable writerWakeup;
+    std::vector<LogRing*> rings;
+    boost::thread_specific_ptr<LogRing> localRing;
+    boost::thread* writer;
+    volatile bool async;
+    bool stopping;
+    // Reused buffer for batches of lines
+    String batch;
+
+    // Cached per-module levels, see LogModuleLevel
+    boost::mutex levelsMutex;
+    typedef std::tr1::unordered_map<String, AtomicValue<int32>*> ModuleLevelMap;
+    ModuleLevelMap moduleLevels;
+};
+
+LogState* logState() {
+    static LogState* state = new LogState();
+    return state;
+}
+
+// How long the writer waits for more lines before writing a batch.
+const boost::posix_time::milliseconds WriterInterval(10);
+
+// Write out all queued lines in one batch. Must hold writeMutex.
+void drainLocked(LogState* state) {
+    for(std::vector<LogRing*>::iterator it = state->rings.begin(); it != state->rings.end(); ) {
+        LogRing* ring = *it;
+        ring->drain(&state->batch);
+        if (ring->retired && ring->empty()) {
+            delete ring;
+            it = state->rings.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+
+    if (!state->batch.empty()) {
+        SirikataLogStream->write(state->batch.data(), state->batch.size());
+        state->batch.clear();
+    }
+    SirikataLogStream->flush();
+}
+
+void retireLogRing(LogRing* ring) {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->writeMutex);
+    ring->retired = true;
+}
+
+void writerMain() {
+    LogState* state = logState();
+    boost::unique_lock<boost::mutex> lock(state->writeMutex);
+    while(!state->stopping) {
+        drainLocked(state);
+        state->writerWakeup.timed_wait(lock, WriterInterval);
+    }
+    drainLocked(state);
+}
+
+// Stops the writer at exit for programs that don't call finishLog.
+struct AsyncLogShutdown {
+    ~AsyncLogShutdown() {
+        stopAsyncLog();
+    }
+} gAsyncLogShutdown;
+
+} // namespace
+
 void setLogStream(std::ostream* logfs) {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->writeMutex);
+    // Anything already queued was logged while the old stream was active
+    drainLocked(state);
     SirikataLogStream = logfs;
 }
 
 void finishLog() {
+    stopAsyncLog();
+
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->writeMutex);
     SirikataLogStream->flush();
     if (SirikataLogStream != &std::cerr) {
         delete SirikataLogStream;
@@ -57,6 +222,76 @@ void finishLog() {
     }
 }
 
+void writeLogLine(LOGGING_LEVEL lvl, const String& line) {
+    LogState* state = logState();
+
+    if (!state->async) {
+        boost::mutex::scoped_lock lock(state->writeMutex);
+        (*SirikataLogStream) << line << std::endl;
+        return;
+    }
+
+    LogRing* ring = state->localRing.get();
+    if (ring == NULL) {
+        ring = new LogRing();
+        state->localRing.reset(ring);
+        boost::mutex::scoped_lock lock(state->writeMutex);
+        state->rings.push_back(ring);
+    }
+
+    if (!ring->push(line)) {
+        // The writer is falling behind. Rather than dropping lines, make
+        // room ourselves.
+        boost::mutex::scoped_lock lock(state->writeMutex);
+        drainLocked(state);
+        (*SirikataLogStream) << line << std::endl;
+        return;
+    }
+
+    // Errors are written immediately in case we're about to crash. We also
+    // need to handle the writer being stopped after we checked async above,
+    // in which case nobody else will drain the line we just queued.
+    if (lvl <= error || !state->async)
+        flushLog();
+    else if (ring->queued() == LogRing::Capacity/2)
+        state->writerWakeup.notify_one();
+}
+
+void startAsyncLog() {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->writeMutex);
+    if (state->writer != NULL) return;
+
+    state->stopping = false;
+    state->writer = new boost::thread(writerMain);
+    state->async = true;
+}
+
+void stopAsyncLog() {
+    LogState* state = logState();
+    boost::thread* writer = NULL;
+    {
+        boost::mutex::scoped_lock lock(state->writeMutex);
+        if (state->writer == NULL) return;
+        state->async = false;
+        state->stopping = true;
+        writer = state->writer;
+        state->writer = NULL;
+    }
+    state->writerWakeup.notify_all();
+    writer->join();
+    delete writer;
+
+    // Pick up anything queued by threads that hadn't noticed we stopped yet.
+    flushLog();
+}
+
+void flushLog() {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->writeMutex);
+    drainLocked(state);
+}
+
 typedef std::tr1::unordered_map<const char*, String> CapsNameMap;
 static CapsNameMap LogModuleStrings;
 
@@ -166,4 +401,85 @@ InitializeGlobalOptions o("",
 
 std::tr1::unordered_map<std::string,LOGGING_LEVEL> module_level;
 
+namespace {
+typedef std::tr1::unordered_map<std::string,LOGGING_LEVEL> ModuleLevelOverrides;
+
+LOGGING_LEVEL optionLevel(void* opt, LOGGING_LEVEL fallback) {
+    if (opt == NULL) return fallback;
+    return reinterpret_cast<OptionValue*>(opt)->unsafeAs<LOGGING_LEVEL>();
+}
+
+// Fallbacks match the option defaults, for logging before options are set up.
+LOGGING_LEVEL defaultLevel() {
+#ifdef NDEBUG
+    return optionLevel(Sirikata_Logging_OptionValue_defaultLevel, info);
+#else
+    return optionLevel(Sirikata_Logging_OptionValue_defaultLevel, debug);
+#endif
+}
+
+LOGGING_LEVEL atLeastLevel() {
+#ifdef NDEBUG
+    return optionLevel(Sirikata_Logging_OptionValue_atLeastLevel, info);
+#else
+    return optionLevel(Sirikata_Logging_OptionValue_atLeastLevel, insane);
+#endif
+}
+
+int32 computeModuleLevel(const String& module) {
+    // A module logs at a level if both its own level (or the default) and
+    // max(maxloglevel, loglevel) allow it.
+    int32 cap = std::max(defaultLevel(), atLeastLevel());
+    int32 lvl = defaultLevel();
+    if (Sirikata_Logging_OptionValue_moduleLevel != NULL) {
+        ModuleLevelOverrides& overrides = reinterpret_cast<OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<ModuleLevelOverrides>();
+        ModuleLevelOverrides::iterator it = overrides.find(module);
+        if (it != overrides.end())
+            lvl = it->second;
+    }
+    return std::min(cap, lvl);
+}
+} // namespace
+
+const AtomicValue<int32>* LogModuleLevel(const char* module) {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->levelsMutex);
+
+    String module_str(module);
+    LogState::ModuleLevelMap::iterator it = state->moduleLevels.find(module_str);
+    if (it != state->moduleLevels.end())
+        return it->second;
+
+    // Never freed since call sites hold on to these
+    AtomicValue<int32>* lvl = new AtomicValue<int32>(computeModuleLevel(module_str));
+    state->moduleLevels[module_str] = lvl;
+    return lvl;
+}
+
+const AtomicValue<int32>* cacheLogModuleLevel(const AtomicValue<int32>* volatile* site, const char* module) {
+    typedef volatile const AtomicValue<int32> Level;
+    const AtomicValue<int32>* lvl = LogModuleLevel(module);
+    // If another thread got here first it stored the same pointer
+    compare_and_swap((Level* volatile*)site, (Level*)NULL, (Level*)lvl);
+    return lvl;
+}
+
+void refreshLogLevels() {
+    LogState* state = logState();
+    boost::mutex::scoped_lock lock(state->levelsMutex);
+
+    for(LogState::ModuleLevelMap::iterator it = state->moduleLevels.begin(); it != state->moduleLevels.end(); it++)
+        *(it->second) = computeModuleLevel(it->first);
+
+    // The ceiling covers modules that haven't logged anything yet, so it's
+    // computed from the options rather than the cached levels.
+    int32 ceiling = computeModuleLevel(String());
+    if (Sirikata_Logging_OptionValue_moduleLevel != NULL) {
+        ModuleLevelOverrides& overrides = reinterpret_cast<OptionValue*>(Sirikata_Logging_OptionValue_moduleLevel)->unsafeAs<ModuleLevelOverrides>();
+        for(ModuleLevelOverrides::iterator it = overrides.begin(); it != overrides.end(); it++)
+            ceiling = std::max(ceiling, computeModuleLevel(it->first));
+    }
+    SirikataLogLevelCeiling = ceiling;
+}
+
 } }
@@ -0,0 +1,125 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OH_BULK_LOC_UPDATE_HPP_
+#define _SIRIKATA_OH_BULK_LOC_UPDATE_HPP_
+
+#include <sirikata/oh/LocUpdate.hpp>
+#include <sirikata/core/util/BoundingSphere.hpp>
+
+namespace Sirikata {
+
+namespace Protocol {
+namespace Loc {
+class BulkLocationUpdate;
+}
+}
+
+/** A BulkLocationUpdate decoded all at once into parallel arrays, one entry
+ *  per contained LocationUpdate. Decoding up front means each field is only
+ *  extracted from the message once, and lets the whole set of updates be
+ *  applied in a single pass (see HostedObject::handleLocationUpdates) instead
+ *  of one LocUpdate at a time. Times are left as they were in the message,
+ *  i.e. in space time.
+ *
+ *  Individual entries can still be passed to code that expects a LocUpdate by
+ *  wrapping them in an Entry.
+ */
+class SIRIKATA_OH_EXPORT BulkLocUpdate : Noncopyable {
+public:
+    enum Fields {
+        HAS_EPOCH = 1,
+        HAS_PARENT = 2,
+        HAS_LOCATION = 4,
+        HAS_ORIENTATION = 8,
+        HAS_BOUNDS = 16,
+        HAS_MESH = 32,
+        HAS_PHYSICS = 64
+    };
+
+    BulkLocUpdate();
+
+    /** Decode all the updates in bulk, replacing the current contents. */
+    void decode(const Sirikata::Protocol::Loc::BulkLocationUpdate& bulk);
+    void clear();
+
+    uint32 size() const { return mObjects.size(); }
+    bool empty() const { return mObjects.empty(); }
+
+    const ObjectReference& object(uint32 i) const { return mObjects[i]; }
+    bool has(uint32 i, Fields f) const { return (mFields[i] & f) != 0; }
+    uint64 seqno(uint32 i) const { return mSeqnos[i]; }
+    uint64 epoch(uint32 i) const { return mEpochs[i]; }
+    const ObjectReference& parent(uint32 i) const { return mParents[i]; }
+    const TimedMotionVector3f& location(uint32 i) const { return mLocations[i]; }
+    const TimedMotionQuaternion& orientation(uint32 i) const { return mOrientations[i]; }
+    const BoundingSphere3f& bounds(uint32 i) const { return mBounds[i]; }
+    const String& mesh(uint32 i) const { return mMeshes[i]; }
+    const String& physics(uint32 i) const { return mPhysics[i]; }
+
+    /** LocUpdate for one entry. Only valid while the BulkLocUpdate is alive
+     *  and unmodified.
+     */
+    class SIRIKATA_OH_EXPORT Entry : public LocUpdate {
+    public:
+        Entry(const BulkLocUpdate& bulk, uint32 idx)
+         : mBulk(bulk),
+           mIdx(idx)
+        {}
+        virtual ~Entry() {}
+
+        virtual ObjectReference object() const { return mBulk.object(mIdx); }
+
+        virtual bool has_epoch() const { return mBulk.has(mIdx, HAS_EPOCH); }
+        virtual uint64 epoch() const { return mBulk.epoch(mIdx); }
+
+        virtual bool has_parent() const { return mBulk.has(mIdx, HAS_PARENT); }
+        virtual ObjectReference parent() const { return mBulk.parent(mIdx); }
+        virtual uint64 parent_seqno() const { return mBulk.seqno(mIdx); }
+
+        virtual bool has_location() const { return mBulk.has(mIdx, HAS_LOCATION); }
+        virtual TimedMotionVector3f location() const { return mBulk.location(mIdx); }
+        virtual uint64 location_seqno() const { return mBulk.seqno(mIdx); }
+
+        virtual bool has_orientation() const { return mBulk.has(mIdx, HAS_ORIENTATION); }
+        virtual TimedMotionQuaternion orientation() const { return mBulk.orientation(mIdx); }
+        virtual uint64 orientation_seqno() const { return mBulk.seqno(mIdx); }
+
+        virtual bool has_bounds() const { return mBulk.has(mIdx, HAS_BOUNDS); }
+        virtual BoundingSphere3f bounds() const { return mBulk.bounds(mIdx); }
+        virtual uint64 bounds_seqno() const { return mBulk.seqno(mIdx); }
+
+        virtual bool has_mesh() const { return mBulk.has(mIdx, HAS_MESH); }
+        virtual String mesh() const { return mBulk.mesh(mIdx); }
+        virtual uint64 mesh_seqno() const { return mBulk.seqno(mIdx); }
+
+        virtual bool has_physics() const { return mBulk.has(mIdx, HAS_PHYSICS); }
+        virtual String physics() const { return mBulk.physics(mIdx); }
+        virtual uint64 physics_seqno() const { return mBulk.seqno(mIdx); }
+    private:
+        Entry();
+        Entry(const Entry&);
+
+        const BulkLocUpdate& mBulk;
+        const uint32 mIdx;
+    };
+
+private:
+    // Per update values. Fields that aren't present in an update are left
+    // default constructed, so the arrays always stay the same length.
+    std::vector<ObjectReference> mObjects;
+    std::vector<uint8> mFields;
+    std::vector<uint64> mSeqnos;
+    std::vector<uint64> mEpochs;
+    std::vector<ObjectReference> mParents;
+    std::vector<TimedMotionVector3f> mLocations;
+    std::vector<TimedMotionQuaternion> mOrientations;
+    std::vector<BoundingSphere3f> mBounds;
+    std::vector<String> mMeshes;
+    std::vector<String> mPhysics;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OH_BULK_LOC_UPDATE_HPP_
@@ -72,6 +72,7 @@
 namespace Sirikata {
 
 class LocUpdate;
+class BulkLocUpdate;
 
 namespace Protocol {
 namespace Loc {
@@ -318,6 +319,12 @@ public:
     // ObjectQuerier Interface
     void handleProximityUpdate(const SpaceObjectReference& spaceobj, const Sirikata::Protocol::Prox::ProximityUpdate& update);
     void handleLocationUpdate(const SpaceObjectReference& spaceobj, const LocUpdate& lu);
+    /** Apply all the updates in bulk to the presence's proxies in one pass,
+     *  notifying listeners once per proxy after all of them have been
+     *  applied. Updates for objects without proxies are ignored, so the
+     *  caller should deal with orphans first.
+     */
+    void handleLocationUpdates(const SpaceObjectReference& spaceobj, const BulkLocUpdate& bulk);
 
 
 
@@ -361,7 +368,8 @@ public:
     bool delegateODPPortSend(const ODP::Endpoint& source_ep, const ODP::Endpoint& dest_ep, MemoryReference payload);
 
 
-    // Handlers for core space-managed updates
+    // Handlers for core space-managed updates. If batch is non-NULL, listener
+    // notifications are collected in it instead of being sent immediately.
     void processLocationUpdate(const SpaceObjectReference& sporef, ProxyObjectPtr proxy_obj, const LocUpdate& update);
     void processLocationUpdate(
         const SpaceID& space, ProxyObjectPtr proxy_obj, bool predictive,
@@ -369,7 +377,8 @@ public:
         TimedMotionQuaternion* orient, uint64 orient_seqno,
         BoundingSphere3f* bounds, uint64 bounds_seqno,
         String* mesh, uint64 mesh_seqno,
-        String* phy, uint64 phy_seqno
+        String* phy, uint64 phy_seqno,
+        ProxyUpdateBatch* batch = NULL
     );
 
     // Helper for creating the correct type of proxy
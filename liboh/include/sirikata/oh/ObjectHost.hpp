@@ -50,6 +50,8 @@
 #include <sirikata/core/transfer/TransferPool.hpp>
 #include <sirikata/core/transfer/TransferMediator.hpp>
 
+#include <sirikata/proxyobject/Defs.hpp>
+
 namespace Sirikata {
 class ProxyManager;
 class PluginManager;
@@ -107,6 +109,9 @@ class SIRIKATA_OH_EXPORT ObjectHost
     std::tr1::shared_ptr<Transfer::TransferPool> mTransferPool;
     Transfer::TransferMediator *mTransferMediator;
 
+    // Proxy state shared by all presences of all objects on this host
+    ProxyObjectStorePtr mProxyObjectStore;
+
     std::tr1::unordered_map<String,OptionSet*> mSpaceConnectionProtocolOptions;
     ///options passed to initialization of scripts (usually path information)
     std::map<std::string, std::string > mSimOptions;
@@ -187,6 +192,11 @@ public:
 
     std::tr1::shared_ptr<Transfer::TransferPool> getTransferPool() { return mTransferPool; }
 
+    /** Get the store through which presences share ProxyObject state, so
+     *  objects seen by several presences are only stored and updated once.
+     */
+    ProxyObjectStorePtr getProxyObjectStore() { return mProxyObjectStore; }
+
     // Primary HostedObject API
 
     /** Connect the object to the space with the given starting parameters.
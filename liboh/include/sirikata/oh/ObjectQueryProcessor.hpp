@@ -104,6 +104,15 @@ class SIRIKATA_OH_EXPORT ObjectQueryProcessor : public Service {
      *  \param lu the location update
      */
     void deliverLocationUpdate(HostedObjectPtr ho, const SpaceObjectReference& sporef, const LocUpdate& lu);
+
+    /** Helper method for implementations which delivers a whole set of
+     *  location updates to the HostedObject at once. Updates for objects the
+     *  HostedObject doesn't have proxies for are dropped.
+     *  \param ho the HostedObject requesting the update
+     *  \param sporef the ID of the presence that registered the query
+     *  \param bulk the decoded location updates
+     */
+    void deliverLocationUpdates(HostedObjectPtr ho, const SpaceObjectReference& sporef, const BulkLocUpdate& bulk);
 };
 
 
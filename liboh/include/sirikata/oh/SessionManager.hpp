@@ -175,19 +175,30 @@ class SIRIKATA_OH_EXPORT SessionManager
     virtual void poll();
 
 private:
-    // Implementation Note: mIOStrand is a bit misleading. All the "real" IO is isolated to that strand --
-    // reads and writes to the actual sockets are handled in mIOStrand. But that is all that is handled
-    // there. Since creating/connecting/disconnecting/destroying SpaceNodeConnections is cheap and relatively
-    // rare, we keep these in the main strand, allowing us to leave the SpaceNodeConnection map without a lock.
-    // Note that the SpaceNodeConnections may themselves be accessed from multiple threads.
+    // Implementation Note: Session state is sharded by space server. Each
+    // server gets a ServerShard with its own IOStrand, where all the "real" IO
+    // for that server is isolated -- reads and writes to its socket are handled
+    // in that strand, so traffic to different space servers is handled in
+    // parallel instead of contending for a single IO strand. Since
+    // creating/connecting/disconnecting/destroying SpaceNodeConnections is cheap
+    // and relatively rare, we keep these in the main strand, allowing us to
+    // leave the SpaceNodeConnection and shard maps without a lock.  Note that
+    // the SpaceNodeConnections may themselves be accessed from multiple threads.
     //
     // The data exchange between the strands happens in two places. When sending, it occurs in the connections
     // queue, which is thread safe.  When receiving, it occurs by posting a handler for the parsed message
     // to the main thread.
     //
-    // Note that this means the majority of this class is executed in the main strand. Only reading and writing
-    // are separated out, which allows us to ensure the network will be serviced as fast as possible, but
-    // doesn't help if our limiting factor is the speed at which this input/output can be handled.
+    // Session bookkeeping stays in the main strand because it invokes the
+    // objects' callbacks, which expect to run there. To keep it cheap when
+    // many objects connect at once, requests are batched: all connect requests
+    // made while we're waiting for an initial space connection share one
+    // lookup, session requests to a server are queued on its shard and sent
+    // together once the connection is available, and each shard uses a single
+    // timer to retry the requests that haven't been answered rather than one
+    // timer per object. The requests and acks are also packed into
+    // SessionBatch messages on the wire, which the space server unpacks and
+    // processes together, and it batches its replies the same way.
     //
     // Note also that this class does *not* handle multithreaded input -- currently all access of public
     // methods should be performed from the main strand.
@@ -203,6 +214,8 @@ private:
 
     // Handles session messages received from the server -- connection replies, migration requests, etc.
     void handleSessionMessage(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID from_server);
+    // Unpacks a batch of session messages and handles each of them
+    void handleSessionBatch(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID from_server);
     // Handlers for specific parts of session messages
     void handleSessionMessageConnectResponseSuccess(ServerID from_server, const SpaceObjectReference& sporef_obj, Sirikata::Protocol::Session::Container& session_msg);
     void handleSessionMessageConnectResponseRedirect(ServerID from_server, const SpaceObjectReference& sporef_obj, Sirikata::Protocol::Session::Container& session_msg);
@@ -230,6 +243,11 @@ private:
     // the connection success response back).
     void sendDisconnectMessage(const SpaceObjectReference& sporef, ServerID connected_to, uint64 session_seqno);
 
+    // Queue a session message for the object to the server. Queued messages are
+    // packed into batches and resent until they make it onto the connection.
+    void queueSessionMessage(ServerID dest_server, const SpaceObjectReference& sporef, const std::string& payload);
+    void flushSessionMessages(ServerID dest_server);
+
     // Utility method which keeps trying to resend a message
     void sendRetryingMessage(const SpaceObjectReference& sporef_src, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload, ServerID dest_server, Network::IOStrand* strand, const Duration& rate);
 
@@ -269,11 +287,23 @@ private:
     // ID/seqno)
     void openConnectionStartSession(const SpaceObjectReference& sporef_uuid, SpaceNodeConnection* conn, bool is_retry);
 
-    // Timeout handler for initial session message -- checks if the connection
-    // succeeded and, if necessary, retries. Requires a seqno so the identical
+    // Initial connection requests are batched until we get any space
+    // connection, then all started together
+    void flushPendingConnects(SpaceNodeConnection* conn);
+
+    // Queue a session request to the given server, requesting the connection to
+    // it if this is the first request in the batch
+    void queueSessionStart(ServerID sid, const SpaceObjectReference& sporef_uuid, bool is_retry);
+    // Start all the session requests queued for the server
+    void flushSessionStarts(ServerID sid, SpaceNodeConnection* conn);
+
+    // Timeout handler for initial session messages -- checks if the
+    // connections to the server whose requests have timed out succeeded and,
+    // if necessary, retries them. Retries reuse the seqno so the identical
     // request can be identified if it was retransmitted because it took too
     // long to get a response but was received
-    void checkConnectedAndRetry(const SpaceObjectReference& sporef_uuid, ServerID connTo);
+    void checkConnectedAndRetry(ServerID connTo);
+    void scheduleCheckConnectedAndRetry(ServerID connTo);
 
 
     /** Object session migration. */
@@ -302,7 +332,45 @@ private:
     ObjectHostContext* mContext;
     SpaceID mSpace;
 
-    Network::IOStrand* mIOStrand;
+    // Per space server state. These are created on demand and live as long as
+    // the SessionManager so their strands remain valid for any connection that
+    // may still be using them.
+    struct ServerShard {
+        ServerShard(Network::IOStrand* strand);
+        ~ServerShard();
+
+        // All socket IO for the server is handled in this strand
+        Network::IOStrand* ioStrand;
+
+        // Session requests waiting for the connection to the server, with
+        // whether each is a retry
+        typedef std::vector< std::pair<SpaceObjectReference, bool> > PendingSessionList;
+        PendingSessionList pendingSessions;
+        bool sessionFlushRequested;
+
+        // Session requests that have been sent and their retry deadlines. The
+        // timeout is constant, so these are ordered by deadline.
+        typedef std::deque< std::pair<SpaceObjectReference, Time> > OutstandingSessionList;
+        OutstandingSessionList outstandingSessions;
+        bool retryScheduled;
+
+        // Session messages (requests and acks) waiting to be packed into a
+        // batch and sent to the server
+        typedef std::deque< std::pair<UUID, std::string> > OutgoingSessionList;
+        OutgoingSessionList outgoingSessions;
+        bool sendScheduled;
+    };
+    typedef std::tr1::unordered_map<ServerID, ServerShard*> ServerShardMap;
+    // Only accessed from the main strand
+    ServerShardMap mShards;
+    ServerShard* getShard(ServerID sid);
+
+    // Objects waiting for any space connection so they can start their session
+    std::vector<SpaceObjectReference> mPendingConnects;
+    bool mPendingConnectsRequested;
+
+    // Maximum number of session messages per batch. 0 or 1 disables batching.
+    uint32 mSessionBatchSize;
 
     ServerIDMap* mServerIDMap;
 
@@ -435,7 +503,8 @@ private:
   	    StreamCreatedCallback streamCreatedCB;
   	    DisconnectedCallback disconnectedCB;
         };
-        typedef std::tr1::unordered_map<ServerID, std::vector<SpaceObjectReference> > ObjectServerMap;
+        typedef std::tr1::unordered_set<SpaceObjectReference, SpaceObjectReference::Hasher> ObjectSet;
+        typedef std::tr1::unordered_map<ServerID, ObjectSet> ObjectServerMap;
         ObjectServerMap mObjectServerMap;
         typedef std::tr1::unordered_map<SpaceObjectReference, ObjectInfo, SpaceObjectReference::Hasher> ObjectInfoMap;
         ObjectInfoMap mObjectInfo;
@@ -456,7 +525,8 @@ private:
     bool mShuttingDown;
 
     void spaceConnectCallback(int err, SSTStreamPtr s, SpaceObjectReference obj, ConnectionEvent after);
-    std::map<ObjectReference, SSTStreamPtr> mObjectToSpaceStreams;
+    typedef std::tr1::unordered_map<ObjectReference, SSTStreamPtr, ObjectReference::Hasher> ObjectStreamMap;
+    ObjectStreamMap mObjectToSpaceStreams;
 
 #ifdef PROFILE_OH_PACKET_RTT
     // Track outstanding packets for computing RTTs
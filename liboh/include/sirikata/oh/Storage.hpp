@@ -114,6 +114,17 @@ public:
     typedef std::tr1::function<void(Result result, ReadSet* rs)> CommitCallback;
     typedef std::tr1::function<void(Result result, int32 count)> CountCallback;
 
+    /** Opaque position in a range scan. An empty token starts a scan at the
+     *  beginning of the range.
+     */
+    typedef String ScanToken;
+    /** ScanCallbacks receive one page of a range scan. On success rs holds the
+     *  keys in the page and ownership transfers to the caller. If next is
+     *  empty the scan is complete, otherwise pass it to rangeScan to get the
+     *  following page.
+     */
+    typedef std::tr1::function<void(Result result, ReadSet* rs, const ScanToken& next)> ScanCallback;
+
     virtual ~Storage() {};
 
     /** Service Interface. */
@@ -247,6 +258,47 @@ public:
        @return {bool} true if operation is successful, false otherwise
      */
     virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current") = 0;
+
+    /** Read a range of keys one page at a time, so large ranges never have to
+     *  be held in memory at once. Each page contains up to max_keys keys,
+     *  continuing in key order from where token left off. Like count(), scans
+     *  run outside of transactions: each page is consistent, but writes
+     *  committed between pages may or may not be visible in later pages.
+     *
+     *  Unlike rangeRead, a range with no keys is a successful, empty scan.
+     *  The default implementation pages through the result of a full
+     *  rangeRead, so it reports an empty range as rangeRead does and doesn't
+     *  bound memory; implementations should override it with a cursor.
+     *
+       @param {Key} start the start key of range of keys to scan
+       @param {Key} finish the end key of range of keys to scan
+       @param {ScanToken} token empty to start the scan, or the token
+                      returned with the previous page
+       @param {uint32} max_keys maximum number of keys to return in this page
+       @param {ScanCallback} cb callback invoked with the page
+       @param {String} timestamp the timestamp of the operation
+
+       @return {bool} true if the scan is queued, false otherwise
+     */
+    virtual bool rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp="current");
+
+protected:
+    /** Tokens record the last key returned, stored as the length of the
+     *  prefix it shares with the start of the range followed by the rest of
+     *  the key, since scanned keys usually share a long prefix with it.
+     */
+    static ScanToken encodeScanToken(const Key& start, const Key& last);
+    /** Decode a token from encodeScanToken. Returns false if the token is
+     *  invalid for this range.
+     */
+    static bool decodeScanToken(const Key& start, const ScanToken& token, Key* last_out);
+    /** Select the page following the key recorded in token from a full range,
+     *  removing all other keys from rs. Used by the default rangeScan.
+     */
+    static ScanToken trimScanPage(const Key& start, const ScanToken& token, uint32 max_keys, ReadSet* rs);
+
+private:
+    void handleRangeScanRead(const Key start, const ScanToken token, uint32 max_keys, ScanCallback cb, Result result, ReadSet* rs);
 };
 
 
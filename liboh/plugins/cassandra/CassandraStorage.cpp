@@ -595,6 +595,53 @@ void CassandraStorage::completeCount(CountCallback cb, Result result, int32 coun
     if (cb) cb(result, count);
 }
 
+bool CassandraStorage::rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp) {
+    Key resume = start;
+    if (max_keys == 0 || (!token.empty() && !decodeScanToken(start, token, &resume)))
+        return false;
+
+    // The slice starts at the last key of the previous page, which is dropped
+    // again when the page is trimmed, and reads one key past the page to find
+    // out whether there's another one. Each page only reads its own keys.
+    SliceRange range;
+    range.start = resume;
+    range.finish = finish;
+    range.count = max_keys + 2;
+
+    mIOService->post(
+        std::tr1::bind(&CassandraStorage::executeScan, this, bucket, start, range, token, max_keys, cb, timestamp),
+        "CassandraStorage::executeScan"
+    );
+
+    return true;
+}
+
+void CassandraStorage::executeScan(const Bucket& bucket, const Key& start, SliceRange& range, const ScanToken& token, uint32 max_keys, ScanCallback cb, const String& timestamp)
+{
+    Result result = SUCCESS;
+    ReadSet* rs = new ReadSet();
+    ScanToken next;
+    try{
+        *rs = mDB->db()->getColumnsValues(bucket.rawHexData(), CF_NAME, timestamp, range);
+        next = trimScanPage(start, token, max_keys, rs);
+    }
+    catch(...) {
+        result = TRANSACTION_ERROR;
+        delete rs;
+        rs = NULL;
+    }
+
+    mContext->mainStrand->post(
+        std::tr1::bind(&CassandraStorage::completeScan, this, cb, result, rs, next),
+        "CassandraStorage::completeScan"
+    );
+}
+
+void CassandraStorage::completeScan(ScanCallback cb, Result result, ReadSet* rs, const ScanToken& next) {
+    if (cb) cb(result, rs, next);
+    else delete rs;
+}
+
 
 
 String CassandraStorage::getLeaseBucketName(const Bucket& bucket) {
@@ -62,6 +62,7 @@ public:
     virtual bool rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
     virtual bool compare(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb = 0, const String& timestamp="current");
     virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp="current");
 
 
 private:
@@ -127,10 +128,12 @@ private:
     void executeCommit(const Bucket& bucket, Transaction* trans, CommitCallback cb, const String& timestamp);
 
     void executeCount(const Bucket& bucket, ColumnParent& parent, SlicePredicate& predicate, CountCallback cb, const String& timestamp);
+    void executeScan(const Bucket& bucket, const Key& start, SliceRange& range, const ScanToken& token, uint32 max_keys, ScanCallback cb, const String& timestamp);
 
     // Complete a commit back in the main thread, cleaning it up and dispatching the callback
     void completeCommit(Transaction* trans, CommitCallback cb, Result success, ReadSet* rs);
     void completeCount(CountCallback cb, Result success, int32 count);
+    void completeScan(ScanCallback cb, Result success, ReadSet* rs, const ScanToken& next);
 
     // Call libcassandra methods to commit transcation
     Result CassandraCommit(CassandraDBPtr db, const Bucket& bucket, Columns* columns, Keys* eraseKeys, Keys* readKeys, SliceRanges* readRanges, ReadSet* compares, SliceRanges* eraseRanges, ReadSet* rs, const String& timestamp);
@@ -33,18 +33,33 @@
 #include "CSVObjectFactory.hpp"
 #include <sirikata/oh/Platform.hpp>
 #include <sirikata/oh/HostedObject.hpp>
+#include <sirikata/core/util/Timer.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
 
 namespace Sirikata {
 
-CSVObjectFactory::CSVObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const std::list<String>& search_paths, const String& filename, int32 max_objects, int32 connect_rate)
+CSVObjectFactory::CSVObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const std::list<String>& search_paths, const String& filename, int32 max_objects, int32 connect_rate, uint32 parse_threads, uint32 create_batch, uint32 max_pending)
  : mContext(ctx),
    mOH(oh),
    mSpace(space),
    mFilename(),
    mMaxObjects(max_objects),
-   mConnectRate(connect_rate)
+   mParseThreads(parse_threads),
+   mCreateBatch(std::max(create_batch, (uint32)1)),
+   mMaxPending(std::max(max_pending, (uint32)1)),
+   mNextToCreate(0),
+   mConnectRate(connect_rate),
+   mRateWindowStart(Time::null()),
+   mConnectedInWindow(0),
+   mStartTime(Time::null()),
+   mObjectsConnected(0)
 {
+    if (mParseThreads == 0)
+        mParseThreads = std::max(boost::thread::hardware_concurrency(), (unsigned int)1);
+
     using namespace boost::filesystem;
 
     // Find the file while we have the search paths
@@ -150,200 +165,271 @@ CSVObjectFactory::StringList CSVObjectFactory::sepCommas(String line)
 
 
 
-void CSVObjectFactory::generate(const String& timestamp)
+CSVObjectFactory::Columns::Columns()
+ : objtype(-1),
+   pos(-1),
+   orient(-1),
+   vel(-1),
+   mesh(-1),
+   quat_vel(-1),
+   script_type(-1),
+   script_opts(-1),
+   script_contents(-1),
+   scale(-1),
+   objid(-1),
+   query(-1),
+   physics(-1)
 {
-    if (mFilename.empty()) return;
+}
 
-    int count =0;
-    std::ifstream fp(mFilename.c_str());
-    if (!fp) return;
-
-
-    bool is_first = true;
-    int objtype_idx = -1;
-    int pos_idx = -1;
-    int orient_idx = -1;
-    int vel_idx = -1;
-    int mesh_idx = -1;
-
-    int quat_vel_idx = -1;
-    int script_type_idx = -1;
-    int script_opts_idx = -1;
-    int script_contents_idx = -1;
-    int scale_idx = -1;
-    int objid_idx = -1;
-    int query_idx = -1;
-    int physics_opts_idx = -1;
-
-    // For each line
-    while(fp && (count < mMaxObjects))
+void CSVObjectFactory::Columns::parseHeader(const StringList& line_parts) {
+    for(uint32 idx = 0; idx < line_parts.size(); idx++)
     {
-        String line;
-        std::getline(fp, line);
+        if (line_parts[idx] == "objtype") objtype = idx;
+        if (line_parts[idx] == "pos_x") pos = idx;
+        if (line_parts[idx] == "orient_x") orient = idx;
+        if (line_parts[idx] == "vel_x") vel = idx;
+        if (line_parts[idx] == "meshURI") mesh = idx;
+        if (line_parts[idx] == "rot_axis_x") quat_vel = idx;
+        if (line_parts[idx] == "script_type") script_type = idx;
+        if (line_parts[idx] == "script_options") script_opts = idx;
+        if (line_parts[idx] == "script_contents") script_contents = idx;
+        if (line_parts[idx] == "scale") scale = idx;
+        if (line_parts[idx] == "objid") objid = idx;
+        if (line_parts[idx] == "query") query = idx;
+        if (line_parts[idx] == "physics") physics = idx;
+    }
+}
+
+namespace {
+// Extracts the line starting at offset, without its line ending, and returns
+// the offset of the next line. Lines don't extend past end.
+std::size_t nextLine(const char* data, std::size_t offset, std::size_t end, String* line) {
+    const char* newline = (const char*)std::memchr(data + offset, '\n', end - offset);
+    std::size_t line_end = (newline == NULL) ? end : (std::size_t)(newline - data);
+    std::size_t next = (newline == NULL) ? end : line_end + 1;
+    if (line_end > offset && data[line_end-1] == '\r') line_end--;
+    line->assign(data + offset, line_end - offset);
+    return next;
+}
+}
+
+bool CSVObjectFactory::parseLine(const StringList& line_parts, const Columns& cols, ObjectCreateInfo* out) {
+    if (line_parts.size() <= (uint32)cols.objtype || line_parts[cols.objtype] != "mesh")
+        return false;
+
+    Vector3d pos(
+        safeLexicalCast<double>(line_parts.at(cols.pos+0)),
+        safeLexicalCast<double>(line_parts.at(cols.pos+1)),
+        safeLexicalCast<double>(line_parts.at(cols.pos+2))
+    );
+    Quaternion orient =
+        cols.orient == -1 ?
+        Quaternion(0, 0, 0, 1) :
+        Quaternion(
+            safeLexicalCast<float>(line_parts.at(cols.orient+0)),
+            safeLexicalCast<float>(line_parts.at(cols.orient+1)),
+            safeLexicalCast<float>(line_parts.at(cols.orient+2)),
+            safeLexicalCast<float>(line_parts.at(cols.orient+3)),
+            Quaternion::XYZW()
+        );
+    Vector3f vel =
+        cols.vel == -1 ?
+        Vector3f(0, 0, 0) :
+        Vector3f(
+            safeLexicalCast<float>(line_parts.at(cols.vel+0)),
+            safeLexicalCast<float>(line_parts.at(cols.vel+1)),
+            safeLexicalCast<float>(line_parts.at(cols.vel+2))
+        );
+
+    Vector3f rot_axis =
+        cols.quat_vel == -1 ?
+        Vector3f(0, 0, 0) :
+        Vector3f(
+            safeLexicalCast<float>(line_parts.at(cols.quat_vel+0)),
+            safeLexicalCast<float>(line_parts.at(cols.quat_vel+1)),
+            safeLexicalCast<float>(line_parts.at(cols.quat_vel+2))
+        );
+
+    float angular_speed =
+        cols.quat_vel == -1 ?
+        0 :
+        safeLexicalCast<float>(line_parts.at(cols.quat_vel+3));
+
+    float scale =
+        cols.scale == -1 ?
+        1.f :
+        safeLexicalCast<float>(line_parts.at(cols.scale), 1.f);
+
+    out->mesh = line_parts.at(cols.mesh);
+    out->scriptType = (cols.script_type == -1) ? "" : line_parts.at(cols.script_type);
+    out->scriptOpts = (cols.script_opts == -1) ? "" : line_parts.at(cols.script_opts);
+    out->scriptContents = (cols.script_contents == -1) ? "" : line_parts.at(cols.script_contents);
+    out->query = (cols.query == -1) ? "" : line_parts.at(cols.query);
+    out->physics = (cols.physics == -1) ? "" : line_parts.at(cols.physics);
+
+    /*
+
+      Ticket #134
+
+    */
+    out->hasID = (cols.objid != -1);
+    if (out->hasID)
+        out->id = UUID(line_parts.at(cols.objid), UUID::HumanReadable());
+
+    out->loc = Location( pos, orient, vel, rot_axis, angular_speed);
+    out->bounds = BoundingSphere3f(Vector3f::zero(), scale);
+    return true;
+}
+
+void CSVObjectFactory::parseLines(const char* data, std::size_t begin, std::size_t end, const Columns* cols, ObjectCreateInfoList* out) {
+    String line;
+    std::size_t offset = begin;
+    while(offset < end) {
+        offset = nextLine(data, offset, end, &line);
         // First char is # and not the first non whitespace char
-	// then this is a comment
-        if(line.length() > 0 && line.at(0) == '#')
-        {
+        // then this is a comment
+        if (line.empty() || line[0] == '#')
             continue;
+
+        ObjectCreateInfo info;
+        try {
+            if (parseLine(sepCommas(line), *cols, &info))
+                out->push_back(info);
         }
+        catch(std::exception&) {
+            SILOG(csvfactory, error, "Skipping invalid line in scene file: " << line);
+        }
+    }
+}
 
+void CSVObjectFactory::generate(const String& timestamp)
+{
+    if (mFilename.empty()) return;
 
-        // Split into parts by commas
-        CSVObjectFactory::StringList line_parts = sepCommas(line);
-
-        if (is_first) {
-            for(uint32 idx = 0; idx < line_parts.size(); idx++)
-            {
-
-                if (line_parts[idx] == "objtype") objtype_idx = idx;
-                if (line_parts[idx] == "pos_x") pos_idx = idx;
-                if (line_parts[idx] == "orient_x") orient_idx = idx;
-                if (line_parts[idx] == "vel_x") vel_idx = idx;
-                if (line_parts[idx] == "meshURI") mesh_idx = idx;
-                if (line_parts[idx] == "rot_axis_x") quat_vel_idx = idx;
-                if (line_parts[idx] == "script_type") script_type_idx = idx;
-                if (line_parts[idx] == "script_options") script_opts_idx = idx;
-                if (line_parts[idx] == "script_contents") script_contents_idx = idx;
-                if (line_parts[idx] == "scale") scale_idx = idx;
-                if(line_parts[idx] == "objid")
-                {
-                    objid_idx = idx;
-                }
-                if(line_parts[idx] == "query") query_idx = idx;
-                if (line_parts[idx] == "physics") physics_opts_idx = idx;
-            }
+    mStartTime = Timer::now();
+
+    // Map the whole file rather than reading it line by line. It's much
+    // faster, avoids copying it, and lets us split the parsing across threads.
+    // Zero length files can't be mapped, but they don't have anything in them
+    // anyway.
+    try {
+        if (boost::filesystem::file_size(mFilename) == 0) return;
+    }
+    catch(boost::filesystem::filesystem_error&) {
+        SILOG(csvfactory, error, "Couldn't find size of scene file " << mFilename);
+        return;
+    }
+    boost::iostreams::mapped_file_source file;
+    try {
+        file.open(mFilename);
+    }
+    catch(std::exception& e) {
+        SILOG(csvfactory, error, "Couldn't map scene file " << mFilename << ": " << e.what());
+        return;
+    }
+    if (!file.is_open()) return;
+    const char* data = file.data();
+    const std::size_t data_size = file.size();
 
-            is_first = false;
+    // The first line that isn't a comment describes the columns
+    Columns cols;
+    std::size_t body_start = 0;
+    {
+        String line;
+        while(body_start < data_size) {
+            body_start = nextLine(data, body_start, data_size, &line);
+            if (line.length() > 0 && line.at(0) == '#')
+                continue;
+            cols.parseHeader(sepCommas(line));
+            break;
         }
-        else {
-            //note: script_file is not required, so not checking it with the assert
-            assert(objtype_idx != -1 && pos_idx != -1 && mesh_idx != -1);
-            //assert(objtype_idx != -1 && pos_idx != -1 && mesh_idx != -1);
-
-            if (line_parts[objtype_idx] == "mesh") {
-                Vector3d pos(
-                    safeLexicalCast<double>(line_parts[pos_idx+0]),
-                    safeLexicalCast<double>(line_parts[pos_idx+1]),
-                    safeLexicalCast<double>(line_parts[pos_idx+2])
-                );
-                Quaternion orient =
-                    orient_idx == -1 ?
-                    Quaternion(0, 0, 0, 1) :
-                    Quaternion(
-                        safeLexicalCast<float>(line_parts[orient_idx+0]),
-                        safeLexicalCast<float>(line_parts[orient_idx+1]),
-                        safeLexicalCast<float>(line_parts[orient_idx+2]),
-                        safeLexicalCast<float>(line_parts[orient_idx+3]),
-                        Quaternion::XYZW()
-                    );
-                Vector3f vel =
-                    vel_idx == -1 ?
-                    Vector3f(0, 0, 0) :
-                    Vector3f(
-                        safeLexicalCast<float>(line_parts[vel_idx+0]),
-                        safeLexicalCast<float>(line_parts[vel_idx+1]),
-                        safeLexicalCast<float>(line_parts[vel_idx+2])
-                    );
-
-                Vector3f rot_axis =
-                    quat_vel_idx == -1 ?
-                    Vector3f(0, 0, 0) :
-                    Vector3f(
-                        safeLexicalCast<float>(line_parts[quat_vel_idx+0]),
-                        safeLexicalCast<float>(line_parts[quat_vel_idx+1]),
-                        safeLexicalCast<float>(line_parts[quat_vel_idx+2])
-                    );
-
-                float angular_speed =
-                    quat_vel_idx == -1 ?
-                    0 :
-                    safeLexicalCast<float>(line_parts[quat_vel_idx+3]);
-
-                String mesh( line_parts[mesh_idx] );
-
-                String scriptType = "";
-                String scriptOpts = "";
-                String scriptContents = "";
-
-              	if(script_type_idx != -1)
-                {
-                    scriptType = line_parts[script_type_idx];
-                }
-                if(script_opts_idx != -1)
-                {
-                    scriptOpts = line_parts[script_opts_idx];
-                }
-                if(script_contents_idx != -1)
-                {
-                    scriptContents = line_parts[script_contents_idx];
-                }
-
-                float scale =
-                    scale_idx == -1 ?
-                    1.f :
-                    safeLexicalCast<float>(line_parts[scale_idx], 1.f);
-
-                String query_opts =
-                    query_idx == -1 ?
-                    "" :
-                    line_parts[query_idx];
-
-                String physics_opts =
-                    physics_opts_idx == -1 ?
-                    "" :
-                    line_parts[physics_opts_idx];
-
-                /*
-
-                  Ticket #134
-
-                */
-                String objid = "";
-                if(objid_idx != -1)
-                {
-                    objid = line_parts[objid_idx];
-                }
-
-                HostedObjectPtr obj;
-
-                if (objid_idx != -1) {
-                    obj = mOH->createObject(
-                        UUID(objid, UUID::HumanReadable()),
-                        scriptType, scriptOpts, scriptContents
-                    );
-                }
-                else {
-                    obj = mOH->createObject(scriptType, scriptOpts, scriptContents);
-                }
-
-                ObjectConnectInfo oci;
-                oci.object = obj;
-                oci.loc = Location( pos, orient, vel, rot_axis, angular_speed);
-                oci.bounds = BoundingSphere3f(Vector3f::zero(), scale);
-                oci.mesh = mesh;
-                oci.query = query_opts;
-                oci.physics = physics_opts;
-                mIncompleteObjects.push(oci);
-
-                count++;
-            }
+    }
+    //note: script_file is not required, so not checking it
+    if (cols.objtype == -1 || cols.pos == -1 || cols.mesh == -1) {
+        SILOG(csvfactory, error, "Scene file " << mFilename << " is missing required columns (objtype, pos_x, meshURI). Not generating any objects.");
+        return;
+    }
+
+    // Split the rest into roughly equal chunks at line boundaries and parse
+    // them in parallel. Small files aren't worth the threads.
+    static const std::size_t MinChunkSize = 64*1024;
+    uint32 nchunks = std::min(
+        mParseThreads,
+        (uint32)std::max((std::size_t)1, (data_size - body_start) / MinChunkSize)
+    );
+    std::vector<ObjectCreateInfoList> chunk_objects(nchunks);
+    std::vector<std::size_t> chunk_bounds;
+    chunk_bounds.push_back(body_start);
+    for(uint32 i = 1; i < nchunks; i++) {
+        std::size_t split = body_start + (data_size - body_start) * i / nchunks;
+        split = std::max(split, chunk_bounds.back());
+        const char* newline = (split < data_size) ? (const char*)std::memchr(data + split, '\n', data_size - split) : NULL;
+        chunk_bounds.push_back(newline == NULL ? data_size : (std::size_t)(newline - data) + 1);
+    }
+    chunk_bounds.push_back(data_size);
+
+    if (nchunks == 1) {
+        parseLines(data, chunk_bounds[0], chunk_bounds[1], &cols, &chunk_objects[0]);
+    }
+    else {
+        boost::thread_group parsers;
+        for(uint32 i = 0; i < nchunks; i++) {
+            parsers.create_thread(
+                std::tr1::bind(&CSVObjectFactory::parseLines, data, chunk_bounds[i], chunk_bounds[i+1], &cols, &chunk_objects[i])
+            );
         }
+        parsers.join_all();
+    }
+
+    for(uint32 i = 0; i < nchunks && (int32)mToCreate.size() < mMaxObjects; i++) {
+        ObjectCreateInfoList& chunk = chunk_objects[i];
+        ObjectCreateInfoList::size_type remaining = mMaxObjects - mToCreate.size();
+        mToCreate.insert(mToCreate.end(), chunk.begin(), chunk.begin() + std::min(remaining, chunk.size()));
+        ObjectCreateInfoList().swap(chunk);
     }
+    mNextToCreate = 0;
 
-    SILOG(csvfactory, detailed, "Generated " << count << " objects from " << mFilename);
+    SILOG(csvfactory, info, "Parsed " << mToCreate.size() << " objects from " << mFilename << " using " << nchunks << " threads in " << (Timer::now() - mStartTime).seconds() << "s");
 
-    fp.close();
-    connectObjects();
-    return;
+    loadObjects();
 }
 
 
-void CSVObjectFactory::connectObjects()
+void CSVObjectFactory::loadObjects()
 {
     if (mContext->stopped())
         return;
 
-    for(int32 i = 0; i < mConnectRate && !mIncompleteObjects.empty(); i++) {
+    Time now = Timer::now();
+    if (now - mRateWindowStart >= Duration::seconds(1.f)) {
+        mRateWindowStart = now;
+        mConnectedInWindow = 0;
+    }
+
+    // Create a batch, as long as there aren't too many objects already waiting
+    // for their connections to be requested.
+    for(uint32 i = 0; i < mCreateBatch && mNextToCreate < mToCreate.size() && mIncompleteObjects.size() < mMaxPending; i++) {
+        const ObjectCreateInfo& info = mToCreate[mNextToCreate++];
+
+        ObjectConnectInfo oci;
+        if (info.hasID)
+            oci.object = mOH->createObject(info.id, info.scriptType, info.scriptOpts, info.scriptContents);
+        else
+            oci.object = mOH->createObject(info.scriptType, info.scriptOpts, info.scriptContents);
+        oci.loc = info.loc;
+        oci.bounds = info.bounds;
+        oci.mesh = info.mesh;
+        oci.query = info.query;
+        oci.physics = info.physics;
+        mIncompleteObjects.push(oci);
+    }
+    if (mNextToCreate == mToCreate.size() && !mToCreate.empty()) {
+        ObjectCreateInfoList().swap(mToCreate);
+        mNextToCreate = 0;
+    }
+
+    for(; mConnectedInWindow < mConnectRate && !mIncompleteObjects.empty(); mConnectedInWindow++) {
         ObjectConnectInfo oci = mIncompleteObjects.front();
         mIncompleteObjects.pop();
 
@@ -351,14 +437,26 @@ void CSVObjectFactory::connectObjects()
             mSpace,
             oci.loc, oci.bounds, oci.mesh, oci.physics, oci.query
         );
+        mObjectsConnected++;
     }
 
-    if (!mIncompleteObjects.empty())
-        mContext->mainStrand->post(
-            Duration::seconds(1.f),
-            std::tr1::bind(&CSVObjectFactory::connectObjects, this),
-            "CSVObjectFactory::connectObjects"
-        );
+    if (mToCreate.empty() && mIncompleteObjects.empty()) {
+        SILOG(csvfactory, info, "Created and requested connections for " << mObjectsConnected << " objects from " << mFilename << " in " << (Timer::now() - mStartTime).seconds() << "s");
+        return;
+    }
+
+    // Yield to other work on the main strand between batches, and if we've hit
+    // the connect rate, wait for the next window.
+    Duration wait = Duration::zero();
+    if (mConnectedInWindow >= mConnectRate) {
+        wait = (mRateWindowStart + Duration::seconds(1.f)) - Timer::now();
+        if (wait < Duration::zero()) wait = Duration::zero();
+    }
+    mContext->mainStrand->post(
+        wait,
+        std::tr1::bind(&CSVObjectFactory::loadObjects, this),
+        "CSVObjectFactory::loadObjects"
+    );
 }
 
 }
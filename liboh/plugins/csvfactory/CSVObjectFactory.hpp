@@ -40,12 +40,20 @@
 
 namespace Sirikata {
 
-/** CSVObjectFactory generates objects from an input CSV file. */
+/** CSVObjectFactory generates objects from an input CSV file.
+ *
+ *  The file is memory mapped and its lines are parsed in parallel by
+ *  parse_threads worker threads. Objects are then created and connected in
+ *  batches on the main strand: up to create_batch objects are created at a
+ *  time, at most max_pending created objects wait for their connection
+ *  request, and no more than connect_rate connections are requested per
+ *  second.
+ */
 class CSVObjectFactory : public ObjectFactory {
 public:
     typedef std::vector<String> StringList;
 
-    CSVObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const std::list<String>& search_paths, const String& filename, int32 max_objects, int32 connect_rate);
+    CSVObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const std::list<String>& search_paths, const String& filename, int32 max_objects, int32 connect_rate, uint32 parse_threads, uint32 create_batch, uint32 max_pending);
     virtual ~CSVObjectFactory() {}
 
     virtual void generate(const String& timestamp="current");
@@ -74,15 +82,65 @@ public:
     static CSVObjectFactory::StringList sepCommas(String toSep);
 
 private:
-    // Connects one batch of objects and sets up another callback for more
-    // additions if necessary.
-    void connectObjects();
+    // Indices of each field within a line, filled in from the header line.
+    struct Columns {
+        Columns();
+        void parseHeader(const StringList& header);
+
+        int objtype;
+        int pos;
+        int orient;
+        int vel;
+        int mesh;
+        int quat_vel;
+        int script_type;
+        int script_opts;
+        int script_contents;
+        int scale;
+        int objid;
+        int query;
+        int physics;
+    };
+
+    struct ObjectCreateInfo {
+        bool hasID;
+        UUID id;
+        String scriptType;
+        String scriptOpts;
+        String scriptContents;
+        Location loc;
+        BoundingSphere3f bounds;
+        String mesh;
+        String query;
+        String physics;
+    };
+    typedef std::vector<ObjectCreateInfo> ObjectCreateInfoList;
+
+    // Parses the lines in data[begin, end), which must start at the beginning
+    // of a line, appending objects to out. Run by parsing worker threads, so
+    // this can't touch any member state.
+    static void parseLines(const char* data, std::size_t begin, std::size_t end, const Columns* cols, ObjectCreateInfoList* out);
+    // Parses one line, returning false if it doesn't describe an object
+    static bool parseLine(const StringList& line_parts, const Columns& cols, ObjectCreateInfo* out);
+
+    // Creates one batch of objects and requests connections for as many
+    // created objects as the connect rate allows, then schedules itself to
+    // continue if necessary.
+    void loadObjects();
 
     ObjectHostContext* mContext;
     ObjectHost* mOH;
     SpaceID mSpace;
     String mFilename;
     int32 mMaxObjects;
+    uint32 mParseThreads;
+    uint32 mCreateBatch;
+    uint32 mMaxPending;
+
+    // Parsed objects waiting to be created
+    ObjectCreateInfoList mToCreate;
+    ObjectCreateInfoList::size_type mNextToCreate;
+
     struct ObjectConnectInfo {
         HostedObjectPtr object;
         Location loc;
@@ -91,8 +149,15 @@ private:
         String query;
         String physics;
     };
+    // Created objects waiting to be connected
     std::queue<ObjectConnectInfo> mIncompleteObjects;
     int32 mConnectRate;
+    // Connections requested in the current one second window
+    Time mRateWindowStart;
+    int32 mConnectedInWindow;
+
+    Time mStartTime;
+    uint32 mObjectsConnected;
 };
 
 } // namespace Sirikata
@@ -51,6 +51,9 @@ static void InitPluginOptions() {
         new Sirikata::OptionValue("db", "sirikata.db", Sirikata::OptionValueType<String>(), "File to read objects from."),
         new Sirikata::OptionValue("rate", "1000000", Sirikata::OptionValueType<int32>(), "Rate to connect objects that are generated by this factory to the space, in objects per second.  Intended to avoid overloading the space server."),
         new Sirikata::OptionValue("objects", "1000000", Sirikata::OptionValueType<int32>(), "Maximum number of objects to load from the file."),
+        new Sirikata::OptionValue("parse-threads", "0", Sirikata::OptionValueType<uint32>(), "Number of threads to parse the file with. 0 uses one per hardware thread."),
+        new Sirikata::OptionValue("create-batch", "100", Sirikata::OptionValueType<uint32>(), "Number of objects to create at a time before giving other work on the main thread a chance to run."),
+        new Sirikata::OptionValue("max-pending", "10000", Sirikata::OptionValueType<uint32>(), "Maximum number of created objects waiting to be connected, which limits how far object creation gets ahead of the connect rate."),
         NULL);
 }
 
@@ -65,8 +68,11 @@ static ObjectFactory* createCSVObjectFactory(ObjectHostContext* ctx, ObjectHost*
     String dbfile = optionsSet->referenceOption("db")->as<String>();
     int32 nobjects = optionsSet->referenceOption("objects")->as<int32>();
     int32 add_rate = optionsSet->referenceOption("rate")->as<int32>();
+    uint32 parse_threads = optionsSet->referenceOption("parse-threads")->as<uint32>();
+    uint32 create_batch = optionsSet->referenceOption("create-batch")->as<uint32>();
+    uint32 max_pending = optionsSet->referenceOption("max-pending")->as<uint32>();
 
-    return new CSVObjectFactory(ctx, oh, space, search_paths, dbfile, nobjects, add_rate);
+    return new CSVObjectFactory(ctx, oh, space, search_paths, dbfile, nobjects, add_rate, parse_threads, create_batch, max_pending);
 }
 
 } // namespace Sirikata
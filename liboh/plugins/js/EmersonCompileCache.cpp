@@ -0,0 +1,99 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "EmersonCompileCache.hpp"
+
+namespace Sirikata {
+namespace JS {
+
+EmersonCompileCache::EmersonCompileCache(uint32 max_entries)
+ : mMaxEntries(max_entries),
+   mHits(0),
+   mMisses(0)
+{
+}
+
+EmersonCompileCache::~EmersonCompileCache() {
+}
+
+SHA256 EmersonCompileCache::key(const String& script_name, const String& em_script) {
+    SHA256Context ctx;
+    ctx.update(script_name);
+    // Separate the two so the name and source can't run together
+    ctx.updateZeros(1);
+    ctx.update(em_script);
+    return ctx.get();
+}
+
+bool EmersonCompileCache::lookup(const String& script_name, const String& em_script, String* js_out, LineMap* line_map_out) {
+    if (mMaxEntries == 0) return false;
+
+    SHA256 k = key(script_name, em_script);
+
+    boost::mutex::scoped_lock lock(mMutex);
+    EntryMap::iterator it = mEntries.find(k);
+    if (it == mEntries.end()) {
+        mMisses++;
+        return false;
+    }
+    mHits++;
+
+    mLRU.splice(mLRU.begin(), mLRU, it->second.lru);
+    *js_out = it->second.js;
+    if (line_map_out != NULL)
+        *line_map_out = it->second.lineMap;
+    return true;
+}
+
+bool EmersonCompileCache::contains(const String& script_name, const String& em_script) {
+    if (mMaxEntries == 0) return false;
+
+    SHA256 k = key(script_name, em_script);
+
+    boost::mutex::scoped_lock lock(mMutex);
+    return (mEntries.find(k) != mEntries.end());
+}
+
+void EmersonCompileCache::insert(const String& script_name, const String& em_script, const String& js, const LineMap& line_map) {
+    if (mMaxEntries == 0) return;
+
+    SHA256 k = key(script_name, em_script);
+
+    boost::mutex::scoped_lock lock(mMutex);
+    EntryMap::iterator it = mEntries.find(k);
+    if (it != mEntries.end()) {
+        // Another script translated it at the same time
+        mLRU.splice(mLRU.begin(), mLRU, it->second.lru);
+        return;
+    }
+
+    while(mEntries.size() >= mMaxEntries) {
+        mEntries.erase(mLRU.back());
+        mLRU.pop_back();
+    }
+
+    mLRU.push_front(k);
+    Entry& entry = mEntries[k];
+    entry.js = js;
+    entry.lineMap = line_map;
+    entry.lru = mLRU.begin();
+}
+
+uint32 EmersonCompileCache::size() {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mEntries.size();
+}
+
+uint32 EmersonCompileCache::hits() {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mHits;
+}
+
+uint32 EmersonCompileCache::misses() {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mMisses;
+}
+
+} // namespace JS
+} // namespace Sirikata
@@ -0,0 +1,80 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef __EMERSON_COMPILE_CACHE_HPP__
+#define __EMERSON_COMPILE_CACHE_HPP__
+
+#include "Platform.hpp"
+#include <sirikata/core/util/Sha256.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+
+namespace Sirikata {
+namespace JS {
+
+/** Cache of Emerson sources translated to JavaScript, shared by all the
+ *  scripts created by a JSObjectScriptManager. Every scripted object imports
+ *  the same standard library, and running each file through the ANTLR
+ *  generated parser and tree walker (which are also serialized behind one
+ *  lock) dominates script startup. With this cache only the first object to
+ *  import a file pays for the translation; later ones just hand V8 the
+ *  JavaScript.
+ *
+ *  Entries are keyed by a hash of the script name and source, so a modified
+ *  file simply misses, and hold the line map as well so errors are still
+ *  reported against the Emerson source. The least recently used entries are
+ *  evicted once the cache is full.
+ *
+ *  Scripts run on their own strands, so access is protected by a mutex.
+ */
+class EmersonCompileCache {
+public:
+    typedef std::map<int, int> LineMap;
+
+    /** Create a cache holding up to max_entries translations. With
+     *  max_entries == 0 nothing is ever cached.
+     */
+    EmersonCompileCache(uint32 max_entries);
+    ~EmersonCompileCache();
+
+    /** Look up the translation of em_script, which was loaded as
+     *  script_name. Returns true and fills in js_out and line_map_out (if
+     *  non-NULL) if it was found.
+     */
+    bool lookup(const String& script_name, const String& em_script, String* js_out, LineMap* line_map_out);
+    /// Check whether a translation of em_script is cached, without using it
+    bool contains(const String& script_name, const String& em_script);
+    /// Store the translation of em_script
+    void insert(const String& script_name, const String& em_script, const String& js, const LineMap& line_map);
+
+    uint32 size();
+    uint32 hits();
+    uint32 misses();
+
+private:
+    static SHA256 key(const String& script_name, const String& em_script);
+
+    typedef std::list<SHA256> LRUList;
+    struct Entry {
+        String js;
+        LineMap lineMap;
+        LRUList::iterator lru;
+    };
+    typedef std::map<SHA256, Entry> EntryMap;
+
+    boost::mutex mMutex;
+    const uint32 mMaxEntries;
+    EntryMap mEntries;
+    // Most recently used at the front
+    LRUList mLRU;
+
+    uint32 mHits;
+    uint32 mMisses;
+};
+
+} // namespace JS
+} // namespace Sirikata
+
+#endif //__EMERSON_COMPILE_CACHE_HPP__
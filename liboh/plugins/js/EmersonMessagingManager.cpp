@@ -6,14 +6,76 @@
 #include "JSLogging.hpp"
 #include <sirikata/core/network/Frame.hpp>
 #include "Protocol_Frame.pbj.hpp"
+#include <boost/lexical_cast.hpp>
 
 namespace Sirikata{
 namespace JS{
 
 #define EMERSON_RELIABLE_COMMUNICATION_PORT 5
 
+// Number of times in a row we'll fail to set up a channel before giving up on
+// the messages queued for it.
+#define EMERSON_CHANNEL_MAX_FAILURES 5
+// Upper bound on how much we hand a channel's substream in one write.
+#define EMERSON_CHANNEL_MAX_WRITE 65536
+// Upper bound on the size of a datagram packing several unreliable messages.
+#define EMERSON_MAX_DATAGRAM_BATCH 1024
+// How long to wait for a receiver to acknowledge a new channel before assuming
+// it only reads one message per substream.
+#define EMERSON_CHANNEL_MODE_TIMEOUT_MS 3000
+// How long a channel can go without new messages before it's closed.
+#define EMERSON_CHANNEL_IDLE_TIMEOUT_MS 60000
+
+// Prefix marking a datagram as a batch of framed messages. Neither the binary
+// message encoding nor a protocol buffer can start with it.
+static const char EMERSON_DATAGRAM_BATCH_HEADER[2] = { 0x00, (char)0xFF };
+// Prefix marking a message on a channel substream as carrying the channel's
+// session and the message's sequence number, 8 bytes each, before the
+// message itself.
+static const char EMERSON_SEQUENCED_HEADER[2] = { 0x00, (char)0xFE };
+#define EMERSON_SEQUENCED_HEADER_SIZE (sizeof(EMERSON_SEQUENCED_HEADER) + 16)
+
+static void appendUint64(String* out, uint64 v) {
+    for(int i = 0; i < 8; i++)
+        out->push_back((char)((v >> (8*i)) & 0xFF));
+}
+
+static uint64 readUint64(const String& data, String::size_type offset) {
+    uint64 v = 0;
+    for(int i = 0; i < 8; i++)
+        v |= ((uint64)(uint8)data[offset + i]) << (8*i);
+    return v;
+}
+
+static bool isSequenced(const String& msg) {
+    return (msg.size() >= sizeof(EMERSON_SEQUENCED_HEADER) &&
+        msg.compare(0, sizeof(EMERSON_SEQUENCED_HEADER), EMERSON_SEQUENCED_HEADER, sizeof(EMERSON_SEQUENCED_HEADER)) == 0);
+}
+
+// Channels are only acknowledged by receivers that understand sequence
+// numbers, so anything else gets the bare message.
+static String frameMessage(uint64 session, bool sequenced, const String& payload, uint64 seqno) {
+    if (!sequenced)
+        return Network::Frame::write(payload);
+
+    String msg(EMERSON_SEQUENCED_HEADER, sizeof(EMERSON_SEQUENCED_HEADER));
+    appendUint64(&msg, session);
+    appendUint64(&msg, seqno);
+    msg.append(payload);
+    return Network::Frame::write(msg);
+}
+
+static uint64 newChannelSession() {
+    UUID id = UUID::random();
+    uint64 session;
+    memcpy(&session, id.getArray().data(), sizeof(session));
+    return session;
+}
+
 EmersonMessagingManager::EmersonMessagingManager(ObjectHostContext* ctx)
- : mMainContext(ctx)
+ : mMainContext(ctx),
+   mFlushPosted(false),
+   mIdleCheckPosted(false)
 {
 }
 
@@ -37,6 +99,20 @@ EmersonMessagingManager::~EmersonMessagingManager()
     }
 
     mStreams.clear();
+
+    boost::mutex::scoped_lock lock(mChannelMutex);
+    for(PresenceChannelMap::iterator pres_it = mChannels.begin(); pres_it != mChannels.end(); pres_it++) {
+        for(ChannelMap::iterator it = pres_it->second.begin(); it != pres_it->second.end(); it++) {
+            it->second->closed = true;
+            if (it->second->substream) {
+                it->second->substream->registerReadCallback(0);
+                it->second->substream->close(false);
+            }
+        }
+    }
+    mChannels.clear();
+    mDirtyChannels.clear();
+    mChannelCapable.clear();
 }
 
 void EmersonMessagingManager::presenceConnected(const SpaceObjectReference& connPresSporef)
@@ -61,7 +137,13 @@ void EmersonMessagingManager::presenceDisconnected(const SpaceObjectReference& d
         return;
     }
     allPres.erase(allPresFinder);
-    clearStreams(disconnPresSporef);
+
+    // Streams and channels are only touched on the main strand
+    mMainContext->mainStrand->post(
+        std::tr1::bind(&EmersonMessagingManager::clearStreams, this,
+            livenessToken(), disconnPresSporef),
+        "EmersonMessagingManager::clearStreams"
+    );
 }
 
 
@@ -92,9 +174,8 @@ void EmersonMessagingManager::setupNewStream(
 
     //doing this for the case where a previous stream wasn't responding to
     //messages, and we want to close it and replace it.  (should really only
-    //happen in call scriptCommWriteStreamConnectedCB, which only gets called if
-    //previous stream didn't exist or if it did exist, but couldn't get messages
-    //to other end after numerous retries.)
+    //happen in channelStreamConnected, when a channel is being reconnected
+    //after the previous stream failed.)
     if (closePrevious)
     {
         if (mStreams.find(pres) != mStreams.end())
@@ -131,10 +212,41 @@ SSTStreamPtr EmersonMessagingManager::getStream(const SpaceObjectReference& pres
     return SSTStreamPtr();
 }
 
-void EmersonMessagingManager::clearStreams(const SpaceObjectReference& pres) {
+void EmersonMessagingManager::forgetStream(const SpaceObjectReference& pres, const SpaceObjectReference& remote) {
+    PresenceStreamMap::iterator pres_it = mStreams.find(pres);
+    if (pres_it == mStreams.end()) return;
+    StreamMap::iterator it = pres_it->second.find(remote);
+    if (it == pres_it->second.end()) return;
+    it->second->close(false);
+    pres_it->second.erase(it);
+}
+
+void EmersonMessagingManager::clearStreams(Liveness::Token alive, const SpaceObjectReference& pres) {
+    Liveness::Lock locked(alive);
+    if (!locked) return;
+
     PresenceStreamMap::iterator pres_it = mStreams.find(pres);
     if (pres_it != mStreams.end())
         mStreams.erase(pres_it);
+    mIncomingSequences.erase(pres);
+
+    ChannelMap channels;
+    {
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        PresenceChannelMap::iterator chan_it = mChannels.find(pres);
+        if (chan_it == mChannels.end()) return;
+        channels.swap(chan_it->second);
+        mChannels.erase(chan_it);
+        for(ChannelMap::iterator it = channels.begin(); it != channels.end(); it++) {
+            it->second->closed = true;
+            it->second->queue.clear();
+            releaseChannelCapable(it->second);
+        }
+    }
+    for(ChannelMap::iterator it = channels.begin(); it != channels.end(); it++) {
+        it->second->inFlight.clear();
+        closeChannelSubstream(it->second);
+    }
 }
 
 //Gets executed whenever a new stream connects to presence with sporef toListenFrom.
@@ -155,227 +267,676 @@ void EmersonMessagingManager::handleIncomingSubstream(Liveness::Token alive, int
 
     if (err != SST_IMPL_SUCCESS) return;
 
-    String* msgBuf = new String();
+    IncomingChannelPtr incoming(new IncomingChannel(streamPtr));
     streamPtr->registerReadCallback(
         std::tr1::bind(&EmersonMessagingManager::handleScriptCommStreamRead, this,
-            livenessToken(), streamPtr, msgBuf, _1, _2)
+            livenessToken(), incoming, _1, _2)
     );
+
+    // Let the sender know we'll keep reading from this substream. Senders
+    // that open one substream per message never read it.
+    writeIncomingAck(incoming, true);
 }
 
 
 //Gets executed whenever have additional data to read.
-void EmersonMessagingManager::handleScriptCommStreamRead(Liveness::Token alive, SSTStreamPtr sstptr, String* prevdata, uint8* buffer, int length)
+void EmersonMessagingManager::handleScriptCommStreamRead(Liveness::Token alive, IncomingChannelPtr incoming, uint8* buffer, int length)
 {
+    SSTStreamPtr sstptr = incoming->substream;
     if (!alive) {
-        delete prevdata;
         sstptr->registerReadCallback(0);
         sstptr->close(false);
         return;
     }
 
-    prevdata->append((const char*)buffer, length);
+    incoming->readBuf.append((const char*)buffer, length);
 
-    // We should only ever get one message per substream, so there's no need to
-    // loop and we can clean up as soon as we parse a message successfully.
-    std::string msg = Network::Frame::parse(*prevdata);
+    const SpaceObjectReference& remote = sstptr->remoteEndPoint().endPoint;
+    const SpaceObjectReference& local = sstptr->localEndPoint().endPoint;
 
-    // If we don't have a full message, just wait for more
-    if (msg.empty())
-        return;
+    // Channels stay open and carry any number of messages, possibly several
+    // in one read. Handle all the complete ones and wait for the rest.
+    while(true) {
+        std::string msg = Network::Frame::parse(incoming->readBuf);
+        if (msg.empty())
+            break;
 
-    //otherwise, try to handle it.
-    handleScriptCommRead(sstptr->remoteEndPoint().endPoint, sstptr->localEndPoint().endPoint, msg);
+        // Senders that open a substream per message send it bare
+        if (!isSequenced(msg)) {
+            handleScriptCommRead(remote, local, msg);
+            continue;
+        }
+        if (msg.size() < EMERSON_SEQUENCED_HEADER_SIZE) {
+            JSLOG(error, "Ignoring truncated message from " << remote);
+            continue;
+        }
 
+        uint64 session = readUint64(msg, sizeof(EMERSON_SEQUENCED_HEADER));
+        uint64 seqno = readUint64(msg, sizeof(EMERSON_SEQUENCED_HEADER) + 8);
+        // Duplicates are acknowledged too, the sender just hadn't heard that
+        // they arrived
+        if (seqno > incoming->received)
+            incoming->received = seqno;
+        if (!acceptSequenced(local, remote, session, seqno))
+            continue;
+        handleScriptCommRead(remote, local, msg.substr(EMERSON_SEQUENCED_HEADER_SIZE));
+    }
 
-    delete prevdata;
-    sstptr->registerReadCallback(0);
-    sstptr->close(false);
+    writeIncomingAck(incoming, false);
 }
 
+void EmersonMessagingManager::writeIncomingAck(IncomingChannelPtr incoming, bool force)
+{
+    if (incoming->ackFailed) return;
+
+    // Only one acknowledgement is written at a time. Any messages read while
+    // it's going out are covered by the next one.
+    if (incoming->ackBuf.empty()) {
+        if (!force && incoming->received == incoming->acked) return;
+        incoming->acked = incoming->received;
+        incoming->ackBuf = Network::Frame::write(boost::lexical_cast<String>(incoming->acked));
+    }
+
+    int bytesWritten = incoming->substream->write((const uint8*)incoming->ackBuf.data(), incoming->ackBuf.size());
+    if (bytesWritten == -1) {
+        incoming->ackFailed = true;
+        incoming->ackBuf.clear();
+        return;
+    }
+    incoming->ackBuf.erase(0, bytesWritten);
 
-////////////////writing functions.
+    if ((!incoming->ackBuf.empty() || incoming->received != incoming->acked) && !incoming->ackRetryPosted) {
+        incoming->ackRetryPosted = true;
+        mMainContext->mainStrand->post(
+            Duration::milliseconds((int64)20),
+            std::tr1::bind(&EmersonMessagingManager::retryIncomingAck, this, livenessToken(), incoming),
+            "EmersonMessagingManager::retryIncomingAck"
+        );
+    }
+}
+
+void EmersonMessagingManager::retryIncomingAck(Liveness::Token alive, IncomingChannelPtr incoming)
+{
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-bool EmersonMessagingManager::sendScriptCommMessageReliable(const SpaceObjectReference& sender, const SpaceObjectReference& receiver, const String& msg) {
-    // arbitrary default # of retries
-    return sendScriptCommMessageReliable(sender, receiver, msg, 10,5);
+    incoming->ackRetryPosted = false;
+    writeIncomingAck(incoming, false);
 }
 
-void EmersonMessagingManager::removeStream(
-    const SpaceObjectReference& sender, const SpaceObjectReference& receiver)
+bool EmersonMessagingManager::acceptSequenced(const SpaceObjectReference& local, const SpaceObjectReference& remote, uint64 session, uint64 seqno)
 {
-    if (mStreams.find(sender) != mStreams.end())
+    IncomingSequenceMap& pres_sequences = mIncomingSequences[local];
+    bool is_new = (pres_sequences.find(remote) == pres_sequences.end());
+    IncomingSequence& seq = pres_sequences[remote];
+    seq.lastUsed = mMainContext->simTime();
+
+    // Messages on a channel arrive in order, so anything at or below the last
+    // one we delivered is a resend
+    if (seq.session == session && seqno <= seq.seqno)
+        return false;
+    seq.session = session;
+    seq.seqno = seqno;
+
+    if (is_new) {
+        bool post_idle_check = false;
+        {
+            boost::mutex::scoped_lock lock(mChannelMutex);
+            if (!mIdleCheckPosted) {
+                mIdleCheckPosted = true;
+                post_idle_check = true;
+            }
+        }
+        if (post_idle_check) {
+            mMainContext->mainStrand->post(
+                Duration::milliseconds((int64)EMERSON_CHANNEL_IDLE_TIMEOUT_MS),
+                std::tr1::bind(&EmersonMessagingManager::closeIdleChannels, this, livenessToken()),
+                "EmersonMessagingManager::closeIdleChannels"
+            );
+        }
+    }
+    return true;
+}
+
+
+////////////////writing functions.
+
+bool EmersonMessagingManager::sendScriptCommMessageReliable(const SpaceObjectReference& sender, const SpaceObjectReference& receiver, const String& msg)
+{
+    bool post_flush = false;
+    bool post_idle_check = false;
     {
-        StreamMap& smap = mStreams[sender];
-        for(StreamMap::iterator it = smap.begin(); it != smap.end(); it++)
-            it->second->close(false);
-        mStreams.erase(sender);
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        Time now = mMainContext->simTime();
+        ChannelPtr& chan = mChannels[sender][receiver];
+        if (!chan) {
+            bool capable = (mChannelCapable.find(receiver) != mChannelCapable.end());
+            chan = ChannelPtr(new Channel(sender, receiver, newChannelSession(),
+                    capable ? Channel::MODE_PERSISTENT : Channel::MODE_UNKNOWN, now));
+            if (capable)
+                setChannelCapable(chan);
+            if (!mIdleCheckPosted) {
+                mIdleCheckPosted = true;
+                post_idle_check = true;
+            }
+        }
+
+        chan->queue.push_back(OutgoingMessage(chan->nextSeqno++, msg));
+        chan->lastUsed = now;
+        if (!chan->dirty) {
+            chan->dirty = true;
+            mDirtyChannels.push_back(chan);
+        }
+        if (!mFlushPosted) {
+            mFlushPosted = true;
+            post_flush = true;
+        }
     }
+
+    // Everything queued before the flush runs goes out with it
+    if (post_flush) {
+        mMainContext->mainStrand->post(
+            std::tr1::bind(&EmersonMessagingManager::flushChannels, this, livenessToken()),
+            "EmersonMessagingManager::flushChannels"
+        );
+    }
+    if (post_idle_check) {
+        mMainContext->mainStrand->post(
+            Duration::milliseconds((int64)EMERSON_CHANNEL_IDLE_TIMEOUT_MS),
+            std::tr1::bind(&EmersonMessagingManager::closeIdleChannels, this, livenessToken()),
+            "EmersonMessagingManager::closeIdleChannels"
+        );
+    }
+    return true;
+}
+
+uint32 EmersonMessagingManager::sendQueueDepth(const SpaceObjectReference& sender, const SpaceObjectReference& receiver)
+{
+    boost::mutex::scoped_lock lock(mChannelMutex);
+    PresenceChannelMap::iterator pres_it = mChannels.find(sender);
+    if (pres_it == mChannels.end()) return 0;
+    ChannelMap::iterator it = pres_it->second.find(receiver);
+    if (it == pres_it->second.end()) return 0;
+    return it->second->queue.size();
 }
 
-bool EmersonMessagingManager::sendScriptCommMessageReliable(const SpaceObjectReference& sender, const SpaceObjectReference& receiver, const String& msg, int8 retriesSameStream,int8 retriesNewStream,bool isRetry)
+void EmersonMessagingManager::flushChannels(Liveness::Token alive)
 {
-    bool returner = false;
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-    //if we have tried to create a bunch of new streams, and that has still
-    //failed, then remove the existing stream (if it's there), and drop message.
-    if (retriesNewStream == 0)
+    std::vector<ChannelPtr> dirty;
     {
-        JSLOG(error, "Cannot send message from sender "<< sender<<\
-              " to "<<receiver<<".  Aborting.");
-        removeStream(sender,receiver);
-        return false;
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        dirty.swap(mDirtyChannels);
+        mFlushPosted = false;
+        for(uint32 i = 0; i < dirty.size(); i++)
+            dirty[i]->dirty = false;
+    }
+
+    for(uint32 i = 0; i < dirty.size(); i++) {
+        if (dirty[i]->substream)
+            writeChannel(dirty[i]);
+        else
+            openChannel(dirty[i]);
     }
+}
 
+void EmersonMessagingManager::openChannel(ChannelPtr chan)
+{
+    if (chan->connecting) return;
 
-    if (retriesSameStream > 0)
     {
-        // If we have a stream
-        SSTStreamPtr streamPtr = getStream(sender, receiver);
-        if (streamPtr)
-        {
-            writeMessage(
-                livenessToken(), streamPtr, msg, sender,
-                receiver, retriesSameStream,--retriesNewStream);
-            return true;
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        if (chan->closed || chan->queue.empty()) return;
+
+        if (chan->failures >= EMERSON_CHANNEL_MAX_FAILURES) {
+            JSLOG(error, "Cannot send message from sender "<< chan->sender<<\
+                " to "<<chan->receiver<<".  Dropping " << chan->queue.size() << " queued messages.");
+            chan->queue.clear();
+            chan->frontOffset = 0;
+            chan->failures = 0;
+            return;
         }
     }
 
+    chan->connecting = true;
 
-    //what to do when the connection is created.
-    CommWriteStreamConnectedCBRetryData retryData;
-    retryData.retriesSameStream = retriesSameStream;
-    retryData.retriesNewStream = --retriesNewStream;
-    retryData.isRetry = isRetry;
+    // Reuse a stream we already have to the receiver if we can
+    SSTStreamPtr streamPtr = getStream(chan->sender, chan->receiver);
+    if (streamPtr) {
+        createChannelSubstream(chan, streamPtr);
+        return;
+    }
 
-    // Otherwise, start the process of connecting
-    // connection will overwrite existing streams if they are there.
-    returner = mMainContext->sstConnMgr()->connectStream(
-        SST::EndPoint<SpaceObjectReference>(sender,0), //local port is random
+    bool connecting = mMainContext->sstConnMgr()->connectStream(
+        SST::EndPoint<SpaceObjectReference>(chan->sender,0), //local port is random
 
         //send to receiver's script comm port
-        SST::EndPoint<SpaceObjectReference>(receiver,EMERSON_RELIABLE_COMMUNICATION_PORT),
+        SST::EndPoint<SpaceObjectReference>(chan->receiver,EMERSON_RELIABLE_COMMUNICATION_PORT),
 
         std::tr1::bind(
-            &EmersonMessagingManager::scriptCommWriteStreamConnectedCB, this,
-            livenessToken(),
-            msg, sender,receiver, _1, _2, retryData
+            &EmersonMessagingManager::channelStreamConnected, this,
+            livenessToken(), chan, _1, _2
         )
     );
-
-    return returner;
+    if (!connecting)
+        channelFailed(chan);
 }
 
-
-void EmersonMessagingManager::scriptCommWriteStreamConnectedCB(
-    Liveness::Token alive, const String& msg,
-    const SpaceObjectReference& sender,
-    const SpaceObjectReference& receiver, int err, SSTStreamPtr streamPtr,
-    CommWriteStreamConnectedCBRetryData retryData)
+void EmersonMessagingManager::channelStreamConnected(
+    Liveness::Token alive, ChannelPtr chan, int err, SSTStreamPtr streamPtr)
 {
-    if (!alive) return;
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-    int8 retriesSameStream = retryData.retriesSameStream;
-    int8 retriesNewStream = retryData.retriesNewStream;
-    bool isRetry = retryData.isRetry;
-
-    //if connection failure, just try to re-connect.
-    if (err != SST_IMPL_SUCCESS)
-    {
-        if (retriesSameStream > 0)
-        {
-            sendScriptCommMessageReliable(
-                sender, receiver, msg, --retriesSameStream,
-                retriesNewStream,true);
-        }
+    if (err != SST_IMPL_SUCCESS) {
+        channelFailed(chan);
         return;
     }
-    //will overwrite any existing streams if they existed before.
-    setupNewStream(streamPtr,isRetry);
 
-    writeMessage(
-        livenessToken(), streamPtr, msg, sender,
-        receiver, retriesSameStream,retriesNewStream);
+    // If we got here after failures, the stream we had saved wasn't working,
+    // so make sure this one replaces it.
+    setupNewStream(streamPtr, chan->failures > 0);
+    createChannelSubstream(chan, streamPtr);
 }
 
-void EmersonMessagingManager::writeMessage(
-    Liveness::Token alive, SSTStreamPtr streamPtr,
-    const String& msg, const SpaceObjectReference& sender,
-    const SpaceObjectReference& receiver, int8 retriesSameStream,
-    int8 retriesNewStream)
+void EmersonMessagingManager::createChannelSubstream(ChannelPtr chan, SSTStreamPtr streamPtr)
 {
-    if (!alive) return;
-
-    // FIXME we're not pushing data directly here because it doesn't seem like
-    // you can actually find out how much data was successfully pushed in. what
-    // if we have a very large message?
     int retCode = streamPtr->createChildStream(
-        std::tr1::bind(&EmersonMessagingManager::writeMessageSubstream,
-            this, alive, _1, _2, msg, sender, receiver,
-            retriesSameStream,retriesNewStream),
+        std::tr1::bind(&EmersonMessagingManager::channelSubstreamCreated,
+            this, livenessToken(), chan, _1, _2),
         NULL, 0,
         EMERSON_RELIABLE_COMMUNICATION_PORT, EMERSON_RELIABLE_COMMUNICATION_PORT
     );
 
-    
-    if (retCode == -1)
+    //createChildStream failed, so the stream is no good. Drop it so the next
+    //attempt connects a new one.
+    if (retCode == -1) {
+        forgetStream(chan->sender, chan->receiver);
+        channelFailed(chan);
+    }
+}
+
+void EmersonMessagingManager::channelSubstreamCreated(
+    Liveness::Token alive, ChannelPtr chan, int err, SSTStreamPtr subStreamPtr)
+{
+    Liveness::Lock locked(alive);
+    if (!locked) return;
+
+    if (err != SST_IMPL_SUCCESS) {
+        forgetStream(chan->sender, chan->receiver);
+        channelFailed(chan);
+        return;
+    }
+
+    bool closed;
     {
-        //createChildStream failed.  close streamPtr and create a new stream to
-        //try to send the message.  (Setting the retriesSameStream to zero and
-        //isRetry to true should cause this to happen.)
-        sendScriptCommMessageReliable(
-            sender, receiver, msg, 0,--retriesNewStream,true);
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        closed = chan->closed;
     }
-    
+    chan->connecting = false;
+    if (closed) {
+        subStreamPtr->close(false);
+        return;
+    }
+
+    chan->substream = subStreamPtr;
+    chan->readBuf.clear();
+    chan->failures = 0;
+    subStreamPtr->registerReadCallback(
+        std::tr1::bind(&EmersonMessagingManager::handleChannelRead, this,
+            livenessToken(), chan, subStreamPtr, _1, _2)
+    );
+    // Receivers that keep channels open say so as soon as they accept the
+    // substream. Until then we don't know how to frame messages for them.
+    if (chan->mode == Channel::MODE_UNKNOWN) {
+        mMainContext->mainStrand->post(
+            Duration::milliseconds((int64)EMERSON_CHANNEL_MODE_TIMEOUT_MS),
+            std::tr1::bind(&EmersonMessagingManager::channelModeTimeout, this, livenessToken(), chan, subStreamPtr),
+            "EmersonMessagingManager::channelModeTimeout"
+        );
+        return;
+    }
+    writeChannel(chan);
 }
 
-void EmersonMessagingManager::writeMessageSubstream(
-    Liveness::Token alive, int err, SSTStreamPtr subStreamPtr,
-    const String& msg, const SpaceObjectReference& sender,
-    const SpaceObjectReference& receiver, int8 retriesSameStream,
-    int8 retriesNewStream)
+void EmersonMessagingManager::handleChannelRead(
+    Liveness::Token alive, ChannelPtr chan, SSTStreamPtr subStreamPtr, uint8* buffer, int length)
 {
-    if (!alive) return;
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-    if (err != SST_IMPL_SUCCESS)
+    // Left over from a substream we've given up on
+    if (chan->substream != subStreamPtr) return;
+
+    chan->readBuf.append((const char*)buffer, length);
+
+    // Once we've given up on the receiver keeping channels open, every
+    // substream carries one bare message, even if an acknowledgement arrives
+    // late.
+    if (chan->mode == Channel::MODE_SINGLE) return;
+
+    bool was_persistent = (chan->mode == Channel::MODE_PERSISTENT);
+    while(true) {
+        std::string ack_str = Network::Frame::parse(chan->readBuf);
+        if (ack_str.empty())
+            break;
+
+        uint64 acked;
+        try {
+            acked = boost::lexical_cast<uint64>(ack_str);
+        }
+        catch(boost::bad_lexical_cast&) {
+            JSLOG(error, "Ignoring invalid acknowledgement from " << chan->receiver);
+            continue;
+        }
+
+        // Everything up to the acknowledged sequence number has been
+        // delivered and won't need to be sent again
+        while(!chan->inFlight.empty() && chan->inFlight.front().seqno <= acked)
+            chan->inFlight.pop_front();
+
+        if (chan->mode != Channel::MODE_PERSISTENT) {
+            chan->mode = Channel::MODE_PERSISTENT;
+            boost::mutex::scoped_lock lock(mChannelMutex);
+            setChannelCapable(chan);
+        }
+    }
+
+    // Everything that queued up while we were waiting can go out now
+    if (!was_persistent && chan->mode == Channel::MODE_PERSISTENT)
+        writeChannel(chan);
+}
+
+void EmersonMessagingManager::channelModeTimeout(Liveness::Token alive, ChannelPtr chan, SSTStreamPtr subStreamPtr)
+{
+    Liveness::Lock locked(alive);
+    if (!locked) return;
+
+    if (chan->substream != subStreamPtr || chan->mode != Channel::MODE_UNKNOWN)
+        return;
+
+    JSLOG(detailed, "Receiver " << chan->receiver << " didn't acknowledge channel, sending one message per substream.");
+    chan->mode = Channel::MODE_SINGLE;
+    // Nothing has been written yet, so this substream can carry the first
+    // message
+    writeChannel(chan);
+}
+
+void EmersonMessagingManager::channelFailed(ChannelPtr chan)
+{
+    chan->connecting = false;
+    closeChannelSubstream(chan);
+
+    boost::mutex::scoped_lock lock(mChannelMutex);
+    chan->failures++;
+    // Messages the substream accepted after the last acknowledgement may not
+    // have reached the receiver, so they go out again on the new one ahead of
+    // everything else. They keep their sequence numbers, so the receiver
+    // drops any it already delivered. A message that was partially written
+    // also has to be sent again in full.
+    chan->queue.insert(chan->queue.begin(), chan->inFlight.begin(), chan->inFlight.end());
+    chan->inFlight.clear();
+    chan->frontOffset = 0;
+    lock.unlock();
+
+    openChannel(chan);
+}
+
+void EmersonMessagingManager::setChannelCapable(ChannelPtr chan)
+{
+    if (chan->capable) return;
+    chan->capable = true;
+    mChannelCapable[chan->receiver]++;
+}
+
+void EmersonMessagingManager::releaseChannelCapable(ChannelPtr chan)
+{
+    if (!chan->capable) return;
+    chan->capable = false;
+    RemoteCountMap::iterator it = mChannelCapable.find(chan->receiver);
+    if (it == mChannelCapable.end()) return;
+    if (--it->second == 0)
+        mChannelCapable.erase(it);
+}
+
+void EmersonMessagingManager::closeChannelSubstream(ChannelPtr chan)
+{
+    if (!chan->substream) return;
+    chan->substream->registerReadCallback(0);
+    chan->substream->close(false);
+    chan->substream.reset();
+    chan->readBuf.clear();
+}
+
+void EmersonMessagingManager::writeChannel(ChannelPtr chan)
+{
+    if (!chan->substream) return;
+
+    // Wait to hear whether the receiver keeps the channel open, see
+    // channelSubstreamCreated
+    if (chan->mode == Channel::MODE_UNKNOWN) return;
+
+    // Receivers that don't keep channels open get one message per substream
+    bool single = (chan->mode == Channel::MODE_SINGLE);
+    if (single && !chan->inFlight.empty()) return;
+
+    // Gather as much of the queue as we're willing to write at once. Only the
+    // main strand removes messages, so the front of the queue stays the same
+    // until we account for what was written below.
+    String batch;
+    std::vector<uint32> frame_sizes;
     {
-        // Try the whole process over, starting from scratch in case the stream
-        // changed
-        if (retriesSameStream > 0)
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        if (chan->closed) return;
+        for(OutgoingQueue::iterator it = chan->queue.begin();
+            it != chan->queue.end() && batch.size() < EMERSON_CHANNEL_MAX_WRITE;
+            it++)
         {
-            sendScriptCommMessageReliable(
-                sender, receiver, msg, --retriesSameStream,retriesNewStream,true);
+            String frame = frameMessage(chan->session, !single, it->payload, it->seqno);
+            frame_sizes.push_back(frame.size());
+            if (it == chan->queue.begin())
+                batch.append(frame, chan->frontOffset, String::npos);
+            else
+                batch.append(frame);
+            if (single) break;
         }
+    }
+    if (batch.empty()) return;
+
+    int bytesWritten = chan->substream->write((const uint8*)batch.data(), batch.size());
+    if (bytesWritten == -1) {
+        JSLOG(detailed,"Channel to " << chan->receiver << " stopped accepting data.  Reconnecting.");
+        channelFailed(chan);
         return;
     }
 
-    writeData(livenessToken(), subStreamPtr, Network::Frame::write(msg), sender, receiver);
+    // Move whatever the substream accepted to inFlight until the receiver
+    // acknowledges it, keeping track of a partially written message.
+    bool more;
+    {
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        uint32 remaining = bytesWritten;
+        for(uint32 i = 0; remaining > 0 && i < frame_sizes.size() && !chan->queue.empty(); i++) {
+            uint32 left = frame_sizes[i] - chan->frontOffset;
+            if (remaining >= left) {
+                remaining -= left;
+                chan->inFlight.push_back(chan->queue.front());
+                chan->queue.pop_front();
+                chan->frontOffset = 0;
+            }
+            else {
+                chan->frontOffset += remaining;
+                remaining = 0;
+            }
+        }
+        more = !chan->queue.empty();
+    }
+
+    if (single && !chan->inFlight.empty()) {
+        // The message is out. The receiver closes the substream after reading
+        // it, so the next one gets a new substream. A graceful close still
+        // delivers this one.
+        chan->inFlight.clear();
+        closeChannelSubstream(chan);
+        openChannel(chan);
+        return;
+    }
+
+    if (!more) return;
+
+    if (bytesWritten < (int)batch.size()) {
+        // The substream's buffer is full. Scripts can see the queue growing in
+        // the meantime through sendQueueDepth.
+        if (!chan->writeRetryPosted) {
+            chan->writeRetryPosted = true;
+            mMainContext->mainStrand->post(
+                Duration::milliseconds((int64)20),
+                std::tr1::bind(&EmersonMessagingManager::retryWriteChannel, this, livenessToken(), chan),
+                "EmersonMessagingManager::retryWriteChannel"
+            );
+            JSLOG(detailed,"More script data to write to stream.  Queueing future write operation.");
+        }
+    }
+    else {
+        // We only stopped because of EMERSON_CHANNEL_MAX_WRITE
+        writeChannel(chan);
+    }
 }
 
-void EmersonMessagingManager::writeData(Liveness::Token alive, SSTStreamPtr streamPtr, const String& msg, const SpaceObjectReference& sender, const SpaceObjectReference& receiver) {
-    if (!alive) return;
+void EmersonMessagingManager::retryWriteChannel(Liveness::Token alive, ChannelPtr chan)
+{
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-    int bytesWritten = streamPtr->write((uint8*) msg.data(), msg.size());
-    //errored out: log message and abort.
-    if (bytesWritten == -1)
-    {
-        JSLOG(error,"Error sending script communication message in scriptCommStreamCallback.  Not sending message.");
-        return;
+    chan->writeRetryPosted = false;
+    writeChannel(chan);
+}
+
+void EmersonMessagingManager::closeIdleChannels(Liveness::Token alive)
+{
+    Liveness::Lock locked(alive);
+    if (!locked) return;
+
+    Time now = mMainContext->simTime();
+    Duration timeout = Duration::milliseconds((int64)EMERSON_CHANNEL_IDLE_TIMEOUT_MS);
+
+    // Senders only resend while their channel is open, which it won't be
+    // for long after it stops carrying messages. Give them some slack before
+    // forgetting what they've sent.
+    for(PresenceIncomingSequenceMap::iterator pres_it = mIncomingSequences.begin(); pres_it != mIncomingSequences.end(); ) {
+        IncomingSequenceMap& pres_sequences = pres_it->second;
+        for(IncomingSequenceMap::iterator it = pres_sequences.begin(); it != pres_sequences.end(); ) {
+            if (now - it->second.lastUsed < timeout * 2)
+                it++;
+            else
+                pres_sequences.erase(it++);
+        }
+        if (pres_sequences.empty())
+            mIncomingSequences.erase(pres_it++);
+        else
+            pres_it++;
     }
 
-    //check if full message was written.
-    if(bytesWritten < (int)msg.size())
+    std::vector<ChannelPtr> idle;
+    bool post_idle_check;
     {
-        //retry write infinitely
-        String restToWrite = msg.substr(bytesWritten);
+        boost::mutex::scoped_lock lock(mChannelMutex);
+        for(PresenceChannelMap::iterator pres_it = mChannels.begin(); pres_it != mChannels.end(); ) {
+            ChannelMap& pres_channels = pres_it->second;
+            for(ChannelMap::iterator it = pres_channels.begin(); it != pres_channels.end(); ) {
+                ChannelPtr chan = it->second;
+                if (!chan->queue.empty() || chan->dirty || chan->connecting || now - chan->lastUsed < timeout) {
+                    it++;
+                    continue;
+                }
+                // Anything still holding on to it, e.g. a pending retry, will
+                // see that it's closed. New messages get a new channel.
+                chan->closed = true;
+                releaseChannelCapable(chan);
+                idle.push_back(chan);
+                pres_channels.erase(it++);
+            }
+            if (pres_channels.empty())
+                mChannels.erase(pres_it++);
+            else
+                pres_it++;
+        }
+        post_idle_check = !mChannels.empty() || !mIncomingSequences.empty();
+        mIdleCheckPosted = post_idle_check;
+    }
+
+    for(uint32 i = 0; i < idle.size(); i++) {
+        // Graceful close, so messages waiting for a count still get through
+        idle[i]->inFlight.clear();
+        closeChannelSubstream(idle[i]);
+    }
+
+    if (post_idle_check) {
         mMainContext->mainStrand->post(
-            Duration::milliseconds((int64)20),
-            std::tr1::bind(&EmersonMessagingManager::writeData, this, livenessToken(), streamPtr, restToWrite, sender, receiver),
-            "EmersonMessagingManager::writeData"
+            Duration::milliseconds((int64)EMERSON_CHANNEL_IDLE_TIMEOUT_MS),
+            std::tr1::bind(&EmersonMessagingManager::closeIdleChannels, this, livenessToken()),
+            "EmersonMessagingManager::closeIdleChannels"
         );
-        JSLOG(detailed,"More sript data to write to stream.  Queueing future write operation.");
     }
-    else
-        streamPtr->close(false);
+}
+
+
+void EmersonMessagingManager::packDatagrams(const std::deque<String>& msgs, bool batch, std::vector<String>* datagrams_out)
+{
+    if (!batch || msgs.size() == 1) {
+        datagrams_out->insert(datagrams_out->end(), msgs.begin(), msgs.end());
+        return;
+    }
+
+    String packed;
+    uint32 batch_count = 0;
+    for(std::deque<String>::const_iterator it = msgs.begin(); it != msgs.end(); it++) {
+        String framed = Network::Frame::write(*it);
+        if (batch_count > 0 && packed.size() + framed.size() > EMERSON_MAX_DATAGRAM_BATCH) {
+            datagrams_out->push_back(packed);
+            packed.clear();
+            batch_count = 0;
+        }
+        if (batch_count == 0)
+            packed.append(EMERSON_DATAGRAM_BATCH_HEADER, sizeof(EMERSON_DATAGRAM_BATCH_HEADER));
+        packed.append(framed);
+        batch_count++;
+    }
+    if (batch_count > 0)
+        datagrams_out->push_back(packed);
+}
+
+void EmersonMessagingManager::unpackDatagram(const String& payload, std::vector<String>* msgs_out)
+{
+    if (payload.size() < sizeof(EMERSON_DATAGRAM_BATCH_HEADER) ||
+        payload.compare(0, sizeof(EMERSON_DATAGRAM_BATCH_HEADER), EMERSON_DATAGRAM_BATCH_HEADER, sizeof(EMERSON_DATAGRAM_BATCH_HEADER)) != 0)
+    {
+        msgs_out->push_back(payload);
+        return;
+    }
+
+    String rest = payload.substr(sizeof(EMERSON_DATAGRAM_BATCH_HEADER));
+    while(true) {
+        String msg = Network::Frame::parse(rest);
+        if (msg.empty())
+            break;
+        msgs_out->push_back(msg);
+    }
+    if (!rest.empty())
+        JSLOG(error, "Discarding truncated message at the end of a batched datagram.");
+}
+
+bool EmersonMessagingManager::supportsBatching(const SpaceObjectReference& remote)
+{
+    boost::mutex::scoped_lock lock(mChannelMutex);
+    return (mChannelCapable.find(remote) != mChannelCapable.end());
+}
+
+bool EmersonMessagingManager::supportsBinaryMessages(const SpaceObjectReference& remote)
+{
+    return supportsBatching(remote);
 }
 
 
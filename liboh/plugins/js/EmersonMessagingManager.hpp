@@ -6,12 +6,14 @@
 #define __EMERSON_MESSAGING_MANAGER_HPP__
 
 #include <map>
+#include <deque>
 #include <sirikata/core/odp/SST.hpp>
 #include <sirikata/core/network/ObjectMessage.hpp>
 #include <string>
 #include <sstream>
 #include <sirikata/core/util/Liveness.hpp>
 #include <sirikata/oh/ObjectHostContext.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace Sirikata{
 namespace JS{
@@ -37,17 +39,156 @@ public:
     virtual bool handleScriptCommRead(const SpaceObjectReference& src, const SpaceObjectReference& dst, const std::string& payload) = 0;
 
 
+    /**
+       Queue msg to be sent reliably from sender to receiver. Messages between
+       the same pair of objects are delivered in the order they were queued.
+       Everything queued for a pair during one pass of the event loop is
+       written to its channel together.
+     */
     bool sendScriptCommMessageReliable(const SpaceObjectReference& sender, const SpaceObjectReference& receiver, const String& msg);
-    bool sendScriptCommMessageReliable(
-        const SpaceObjectReference& sender, const SpaceObjectReference& receiver,
-        const String& msg, int8 retriesSameStream,int8 retriesNewStream,
-        bool isRetry=false);
 
+    /**
+       Number of reliable messages from sender to receiver that haven't been
+       handed to the underlying stream yet. Scripts can use this to back off
+       when a receiver can't keep up.
+     */
+    uint32 sendQueueDepth(const SpaceObjectReference& sender, const SpaceObjectReference& receiver);
+
+    /**
+       Whether messages to remote can use JSSerializer's binary encoding.
+       Receivers that acknowledge channels also decode it, so this holds while
+       one of our channels to remote is open and acknowledged. Everyone else
+       gets the protocol buffer encoding.
+     */
+    bool supportsBinaryMessages(const SpaceObjectReference& remote);
 
     void presenceConnected(const SpaceObjectReference& connPresSporef);
     void presenceDisconnected(const SpaceObjectReference& disconnPresSporef);
 
+protected:
+    /**
+       Pack unreliable messages queued for the same destination into as few
+       datagrams as possible if batch is true, otherwise send each one in its
+       own datagram. A datagram holding a single message is just that message,
+       so unbatched senders and receivers still interoperate.
+     */
+    static void packDatagrams(const std::deque<String>& msgs, bool batch, std::vector<String>* datagrams_out);
+    /// Split a received datagram back into the messages it contains
+    static void unpackDatagram(const String& payload, std::vector<String>* msgs_out);
+    /**
+       Whether remote is known to handle batched datagrams. Receivers that keep
+       channels open also unpack batches, so this holds while one of our
+       channels to remote is open and acknowledged.
+     */
+    bool supportsBatching(const SpaceObjectReference& remote);
+
 private:
+    // A reliable message waiting to be sent or acknowledged
+    struct OutgoingMessage {
+        OutgoingMessage(uint64 seq, const String& p)
+         : seqno(seq), payload(p)
+        {}
+
+        uint64 seqno;
+        String payload;
+    };
+    typedef std::deque<OutgoingMessage> OutgoingQueue;
+
+    // All reliable messages from one of our presences to one remote object go
+    // over a single long-lived substream, the channel, rather than a new
+    // substream per message. Receivers that support channels send back the
+    // highest sequence number they've read, which also tells us they won't
+    // close the substream after the first one. Until we hear from the
+    // receiver nothing is written, and if we never do each substream only
+    // carries one message.
+    struct Channel {
+        enum Mode {
+            // Haven't heard from the receiver yet
+            MODE_UNKNOWN,
+            // Receiver keeps the substream open, send everything over it
+            MODE_PERSISTENT,
+            // Receiver reads one message per substream and closes it
+            MODE_SINGLE
+        };
+
+        Channel(const SpaceObjectReference& s, const SpaceObjectReference& r, uint64 sess, Mode m, const Time& t)
+         : sender(s), receiver(r),
+           session(sess),
+           nextSeqno(1),
+           frontOffset(0),
+           dirty(false),
+           closed(false),
+           capable(false),
+           lastUsed(t),
+           mode(m),
+           connecting(false),
+           writeRetryPosted(false),
+           failures(0)
+        {}
+
+        const SpaceObjectReference sender;
+        const SpaceObjectReference receiver;
+        // Identifies this channel to the receiver, which tracks the sequence
+        // numbers it has delivered per session. Sequence numbers carry over
+        // to new substreams, so messages sent again after a failure can be
+        // recognized as duplicates.
+        const uint64 session;
+
+        // Protected by mChannelMutex.
+        uint64 nextSeqno;
+        // Messages not fully accepted by the substream yet, oldest first, and
+        // how much of the first one's frame has been.
+        OutgoingQueue queue;
+        uint32 frontOffset;
+        // Whether it's waiting in mDirtyChannels
+        bool dirty;
+        // Set when the sender disconnects or the channel is idle
+        bool closed;
+        // Whether it's counted in mChannelCapable
+        bool capable;
+        // Last time a message was queued
+        Time lastUsed;
+
+        // Only used on the main strand.
+        Mode mode;
+        SSTStreamPtr substream;
+        // Messages the substream accepted that the receiver hasn't
+        // acknowledged yet, requeued if it fails
+        OutgoingQueue inFlight;
+        // Partial frames from the receiver
+        String readBuf;
+        bool connecting;
+        bool writeRetryPosted;
+        uint8 failures;
+    };
+    typedef std::tr1::shared_ptr<Channel> ChannelPtr;
+
+    // The receiving end of a channel, only used on the main strand
+    struct IncomingChannel {
+        IncomingChannel(SSTStreamPtr s)
+         : substream(s),
+           received(0),
+           acked(0),
+           ackFailed(false),
+           ackRetryPosted(false)
+        {}
+
+        SSTStreamPtr substream;
+        // Partial message data
+        String readBuf;
+        // Highest sequence number read and the one last sent back to the
+        // sender
+        uint64 received;
+        uint64 acked;
+        // Acknowledgement frame that hasn't been fully written yet
+        String ackBuf;
+        // Set once the sender stops accepting data, e.g. because it only
+        // sends one message per substream
+        bool ackFailed;
+        bool ackRetryPosted;
+    };
+    typedef std::tr1::shared_ptr<IncomingChannel> IncomingChannelPtr;
+
     // Possibly save the new stream to mStreams for later use. Since both sides
     // might initiate, we always save the stream initiated by the object with
     // smaller if we identify a conflict.
@@ -55,45 +196,41 @@ private:
     // Get a saved stream for the given destination object, or NULL if one isn't
     // available.
     SSTStreamPtr getStream(const SpaceObjectReference& pres, const SpaceObjectReference& remote);
+    // Close and discard the saved stream to remote, e.g. because it stopped
+    // accepting substreams.
+    void forgetStream(const SpaceObjectReference& pres, const SpaceObjectReference& remote);
 
-    // "Destroy" (i.e. discard reference to) all streams owned by an object
-    void clearStreams(const SpaceObjectReference& pres);
+    // "Destroy" (i.e. discard reference to) all streams and channels owned by
+    // an object
+    void clearStreams(Liveness::Token alive, const SpaceObjectReference& pres);
 
     //reading helpers
     void createScriptCommListenerStreamCB(Liveness::Token alive, const SpaceObjectReference& toListenFrom, int err, SSTStreamPtr sstStream);
     void handleIncomingSubstream(Liveness::Token alive, int err, SSTStreamPtr streamPtr);
-    void handleScriptCommStreamRead(Liveness::Token alive, SSTStreamPtr sstptr, String* prevdata, uint8* buffer, int length);
-
-    // Only put a few parameters in here to avoid copying lots of stuff, we only
-    // need to get < 8 parameters for bind to work on all platforms
-    struct CommWriteStreamConnectedCBRetryData {
-        int8 retriesSameStream;
-        int8 retriesNewStream;
-        bool isRetry;
-    };
-    //writing helper
-    void scriptCommWriteStreamConnectedCB(
-        Liveness::Token alive, const String& msg,
-        const SpaceObjectReference& sender, const SpaceObjectReference& receiver,
-        int err, SSTStreamPtr streamPtr, CommWriteStreamConnectedCBRetryData retryData);
-
-    // Writes a message to a *substream* of the given stream
-    void writeMessage(
-        Liveness::Token alive, SSTStreamPtr streamPtr,
-        const String& msg, const SpaceObjectReference& sender,
-        const SpaceObjectReference& receiver, int8 retriesSameStream,
-        int8 retriesNewStream);
+    void handleScriptCommStreamRead(Liveness::Token alive, IncomingChannelPtr incoming, uint8* buffer, int length);
+    void writeIncomingAck(IncomingChannelPtr incoming, bool force);
+    void retryIncomingAck(Liveness::Token alive, IncomingChannelPtr incoming);
+    // Returns false if the message was already delivered, i.e. the sender
+    // sent it again after a failure
+    bool acceptSequenced(const SpaceObjectReference& local, const SpaceObjectReference& remote, uint64 session, uint64 seqno);
 
-    void writeMessageSubstream(
-        Liveness::Token alive, int err, SSTStreamPtr subStreamPtr,
-        const String& msg, const SpaceObjectReference& sender,
-        const SpaceObjectReference& receiver, int8 retriesSameStream,
-        int8 retriesNewStream);
-
-    void writeData(Liveness::Token alive, SSTStreamPtr streamPtr, const String& msg, const SpaceObjectReference& sender, const SpaceObjectReference& receiver);
-
-    void removeStream(
-        const SpaceObjectReference& sender, const SpaceObjectReference& receiver);
+    //writing helpers, all run on the main strand
+    void flushChannels(Liveness::Token alive);
+    void openChannel(ChannelPtr chan);
+    void channelStreamConnected(Liveness::Token alive, ChannelPtr chan, int err, SSTStreamPtr streamPtr);
+    void createChannelSubstream(ChannelPtr chan, SSTStreamPtr streamPtr);
+    void channelSubstreamCreated(Liveness::Token alive, ChannelPtr chan, int err, SSTStreamPtr subStreamPtr);
+    void handleChannelRead(Liveness::Token alive, ChannelPtr chan, SSTStreamPtr subStreamPtr, uint8* buffer, int length);
+    void channelModeTimeout(Liveness::Token alive, ChannelPtr chan, SSTStreamPtr subStreamPtr);
+    void channelFailed(ChannelPtr chan);
+    // Track which receivers have acknowledged a channel, with mChannelMutex held
+    void setChannelCapable(ChannelPtr chan);
+    void releaseChannelCapable(ChannelPtr chan);
+    void closeChannelSubstream(ChannelPtr chan);
+    void writeChannel(ChannelPtr chan);
+    void retryWriteChannel(Liveness::Token alive, ChannelPtr chan);
+    // Close and forget channels that haven't been used for a while
+    void closeIdleChannels(Liveness::Token alive);
 
 
     ObjectHostContext* mMainContext;
@@ -102,10 +239,40 @@ private:
     //checking if particular presences are connected.
     std::map<SpaceObjectReference, bool> allPres;
 
-    // Streams to be reused for sending messages
+    // Streams to be reused for sending messages. Only used on the main strand.
     typedef std::tr1::unordered_map<SpaceObjectReference, SSTStreamPtr, SpaceObjectReference::Hasher> StreamMap;
     typedef std::tr1::unordered_map<SpaceObjectReference, StreamMap, SpaceObjectReference::Hasher> PresenceStreamMap;
     PresenceStreamMap mStreams;
+
+    // Scripts queue messages from their own strands while the channels are
+    // serviced on the main strand, so the maps and queues are protected by
+    // mChannelMutex.
+    boost::mutex mChannelMutex;
+    typedef std::tr1::unordered_map<SpaceObjectReference, ChannelPtr, SpaceObjectReference::Hasher> ChannelMap;
+    typedef std::tr1::unordered_map<SpaceObjectReference, ChannelMap, SpaceObjectReference::Hasher> PresenceChannelMap;
+    PresenceChannelMap mChannels;
+    // Channels with newly queued messages, written by the next flushChannels
+    std::vector<ChannelPtr> mDirtyChannels;
+    bool mFlushPosted;
+    bool mIdleCheckPosted;
+    // Remote objects with acknowledged channels open, and how many
+    typedef std::tr1::unordered_map<SpaceObjectReference, uint32, SpaceObjectReference::Hasher> RemoteCountMap;
+    RemoteCountMap mChannelCapable;
+
+    // Last sequence number delivered from each remote object's channel to
+    // each of our presences. Only used on the main strand.
+    struct IncomingSequence {
+        IncomingSequence()
+         : session(0), seqno(0), lastUsed(Time::null())
+        {}
+
+        uint64 session;
+        uint64 seqno;
+        Time lastUsed;
+    };
+    typedef std::tr1::unordered_map<SpaceObjectReference, IncomingSequence, SpaceObjectReference::Hasher> IncomingSequenceMap;
+    typedef std::tr1::unordered_map<SpaceObjectReference, IncomingSequenceMap, SpaceObjectReference::Hasher> PresenceIncomingSequenceMap;
+    PresenceIncomingSequenceMap mIncomingSequences;
 };
 
 } //end namespace js
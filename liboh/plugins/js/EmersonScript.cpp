@@ -821,17 +821,54 @@ void EmersonScript::sendMessageToEntityUnreliable(
     const std::string& msgBody)
 {
     EMERSCRIPT_SERIAL_CHECK();
-    std::map<SpaceObjectReference, ODP::Port*>::iterator iter = mMessagingPortMap.find(from);
-    if (iter == mMessagingPortMap.end())
+    if (mMessagingPortMap.find(from) == mMessagingPortMap.end())
     {
         JSLOG(error,"Trying to send from a sporef that does not exist");
         return;
     }
 
-    ODP::Endpoint dest (sporef.space(),sporef.object(),EMERSON_UNRELIABLE_COMMUNICATION_PORT);
-    MemoryReference toSend(msgBody);
+    if (mUnreliableQueues.empty())
+    {
+        JSObjectScript::mCtx->objStrand->post(
+            std::tr1::bind(&EmersonScript::flushUnreliableMessages,this,
+                Liveness::livenessToken()),
+            "EmersonScript::flushUnreliableMessages"
+        );
+    }
+    mUnreliableQueues[std::make_pair(from, sporef)].push_back(msgBody);
+}
+
+//called from mStrand
+void EmersonScript::flushUnreliableMessages(Liveness::Token alive)
+{
+    if (!alive) return;
+    Liveness::Lock locked(alive);
+    if (!locked) return;
 
-    iter->second->send(dest,toSend);
+    EMERSCRIPT_SERIAL_CHECK();
+
+    UnreliableMessageQueues queues;
+    queues.swap(mUnreliableQueues);
+
+    for (UnreliableMessageQueues::iterator it = queues.begin(); it != queues.end(); ++it)
+    {
+        const SpaceObjectReference& from = it->first.first;
+        const SpaceObjectReference& sporef = it->first.second;
+
+        // The presence may have gone away since the messages were queued
+        MessagingPortMap::iterator iter = mMessagingPortMap.find(from);
+        if (iter == mMessagingPortMap.end())
+            continue;
+
+        ODP::Endpoint dest (sporef.space(),sporef.object(),EMERSON_UNRELIABLE_COMMUNICATION_PORT);
+        std::vector<String> datagrams;
+        packDatagrams(it->second, supportsBatching(sporef), &datagrams);
+        for (std::vector<String>::iterator dg_it = datagrams.begin(); dg_it != datagrams.end(); ++dg_it)
+        {
+            MemoryReference toSend(*dg_it);
+            iter->second->send(dest,toSend);
+        }
+    }
 }
 
 
@@ -1026,12 +1063,17 @@ void EmersonScript::iHandleScriptCommRead(
 
     Sirikata::JS::Protocol::JSMessage jsMsg;
     Sirikata::JS::Protocol::JSFieldValue jsFieldVal;
-    bool isJSMsg   = jsMsg.ParseFromString(payload);
-    if (! isJSMsg)
-        isJSMsg = jsMsg.ParseFromArray(payload.data(),payload.size());
+    bool isBinary = JSSerializer::isBinaryMessage(payload);
+    bool isJSMsg = false;
+    if (!isBinary)
+    {
+        isJSMsg = jsMsg.ParseFromString(payload);
+        if (! isJSMsg)
+            isJSMsg = jsMsg.ParseFromArray(payload.data(),payload.size());
+    }
 
     bool isJSField = false;
-    if (!isJSMsg)
+    if (!isBinary && !isJSMsg)
     {
         isJSField = jsFieldVal.ParseFromString(payload);
         if (!isJSField)
@@ -1040,7 +1082,7 @@ void EmersonScript::iHandleScriptCommRead(
 
     //if can't decode the payload as a jsmessage or
     //a jsfieldval, then return false;
-    if (!(isJSMsg || isJSField))
+    if (!(isBinary || isJSMsg || isJSField))
         return;
 
     if (isStopped()) {
@@ -1093,7 +1135,12 @@ void EmersonScript::iHandleScriptCommRead(
             std::vector< v8::Persistent<v8::Object> > visiblesToMakeWeak;
 
             v8::Handle<v8::Value> msgVal;
-            if (isJSMsg)
+            if (isBinary)
+            {
+                msgVal = JSSerializer::deserializeBinaryMessage(this, payload,
+                    deserializeWorks);
+            }
+            else if (isJSMsg)
             {
                 //try to decode as object.
                 msgVal = JSSerializer::deserializeObject( this, jsMsg,
@@ -1180,7 +1227,11 @@ void EmersonScript::iHandleScriptCommUnreliable(
 
     SpaceObjectReference to  (dst.space(), dst.object());
     SpaceObjectReference from(src.space(), src.object());
-    handleScriptCommRead(from,to,String((const char*) payload.data(), payload.size()));
+
+    std::vector<String> msgs;
+    unpackDatagram(String((const char*) payload.data(), payload.size()), &msgs);
+    for (std::vector<String>::iterator it = msgs.begin(); it != msgs.end(); ++it)
+        handleScriptCommRead(from,to,*it);
 }
 
 //called from within mStrand
@@ -1250,12 +1301,17 @@ void EmersonScript::processSandboxMessage(
     Sirikata::JS::Protocol::JSMessage jsMsg;
     Sirikata::JS::Protocol::JSFieldValue jsFieldVal;
 
-    bool isJSMsg   = jsMsg.ParseFromString(payload);
-    if (! isJSMsg)
-        isJSMsg = jsMsg.ParseFromArray(payload.data(),payload.size());
+    bool isBinary = JSSerializer::isBinaryMessage(payload);
+    bool isJSMsg = false;
+    if (!isBinary)
+    {
+        isJSMsg = jsMsg.ParseFromString(payload);
+        if (! isJSMsg)
+            isJSMsg = jsMsg.ParseFromArray(payload.data(),payload.size());
+    }
 
     bool isJSField = false;
-    if (!isJSMsg)
+    if (!isBinary && !isJSMsg)
     {
         isJSField = jsFieldVal.ParseFromString(payload);
         if (!isJSField)
@@ -1264,7 +1320,7 @@ void EmersonScript::processSandboxMessage(
 
     //if can't decode the payload as a jsmessage or
     //a jsfieldval, then return false;
-    if (!(isJSMsg || isJSField))
+    if (!(isBinary || isJSMsg || isJSField))
         return;
 
 
@@ -1277,7 +1333,12 @@ void EmersonScript::processSandboxMessage(
 
     bool deserializeWorks = false;
     v8::Handle<v8::Value> msgVal;
-    if (isJSMsg)
+    if (isBinary)
+    {
+        msgVal = JSSerializer::deserializeBinaryMessage(this, payload,
+            deserializeWorks);
+    }
+    else if (isJSMsg)
     {
         //try to decode as object.
         msgVal = JSSerializer::deserializeObject( this, jsMsg,
@@ -174,7 +174,9 @@ public:
        from to some other presence in world with sporef receiver.
 
        Gets port to send over as value of mMessagingPortMap associated with key
-       from.
+       from. Messages are queued and everything sent to the same receiver
+       during one pass of the event loop is packed into as few datagrams as
+       possible.
      */
     void sendMessageToEntityUnreliable(const SpaceObjectReference& receiver, const SpaceObjectReference& from, const std::string& msgBody);
 
@@ -381,6 +383,11 @@ private:
     typedef std::map<SpaceObjectReference, ODP::Port*> MessagingPortMap;
     MessagingPortMap mMessagingPortMap;
 
+    // Unreliable messages waiting for flushUnreliableMessages, keyed by
+    // (sender, receiver)
+    typedef std::map<std::pair<SpaceObjectReference, SpaceObjectReference>, std::deque<String> > UnreliableMessageQueues;
+    UnreliableMessageQueues mUnreliableQueues;
+
 
     void callbackUnconnected(ProxyObjectPtr proxy, HostedObject::PresenceToken token);
     HostedObject::PresenceToken presenceToken;
@@ -432,6 +439,8 @@ private:
         const ODP::Endpoint& src, const ODP::Endpoint& dst,
         MemoryReference payload,Liveness::Token alive);
 
+    void flushUnreliableMessages(Liveness::Token alive);
+
     void mainStrandCompletePresConnect(Location newLoc,BoundingSphere3f bs,
         PresStructRestoreParams psrp,HostedObject::PresenceToken presToke,
         Liveness::Token alive);
@@ -0,0 +1,860 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "JSSerializer.hpp"
+#include "JSSystemNames.hpp"
+#include "JSLogging.hpp"
+#include "JSObjects/JSFields.hpp"
+#include "JSObjects/JSVec3.hpp"
+#include "JSObjectStructs/JSVisibleStruct.hpp"
+#include "JSObjectStructs/JSSystemStruct.hpp"
+#include "JSObjectStructs/JSPresenceStruct.hpp"
+#include "EmersonScript.hpp"
+
+#include <v8.h>
+
+/*
+  Binary encoding used by JSSerializer::serializeBinaryMessage.
+
+  The protocol buffer encoding (JSMessage/JSFieldValue) builds a full message
+  tree, repeats every field name as a string, stamps every object with a hidden
+  value to detect cycles (and then has to remove them all again) and needs a
+  separate fixup pass when deserializing. Messages between scripts are usually
+  small objects with the same handful of field names, so most of that is
+  overhead. This encoding is written directly into a string in one pass:
+
+    stream  := 0x00 VERSION value
+    value   := tag payload
+    fields  := (name value)* 0
+    name    := varint((index+1) << 1)           reference to an earlier name
+             | varint(len << 1 | 1) bytes       new name, gets the next index
+
+  The leading zero byte can never start a valid protocol buffer (field number
+  0 is reserved), so receivers can still accept messages from older scripts.
+  Older receivers can't decode this encoding though, so messages to other
+  objects only use it once the receiver is known to support it (see
+  EmersonMessagingManager::supportsBinaryMessages).
+
+  Field names are interned per stream: the first use of a name carries its
+  text, later uses only its index. Every object is numbered in the order it is
+  first encountered, on both sides, so a repeated or cyclic reference is
+  written as TAG_REF and resolved immediately on decode -- objects are
+  registered before their fields are read, so a back reference always points
+  at an object that already exists. Only prototypes that are back references
+  need to wait until the end, since their fields may not all be filled in yet.
+
+  Plain objects and arrays whose prototype is the default one skip the
+  comparison against the prototype's properties that getOwnPropertyNames does,
+  and don't ship their prototype. Vec3 and Quaternion values are written as raw
+  doubles rather than as objects with their (large) shared prototype.
+ */
+
+namespace Sirikata {
+namespace JS {
+
+namespace {
+
+const uint8 JSBINARY_MAGIC = 0x00;
+const uint8 JSBINARY_VERSION = 0x01;
+
+// Limits recursion when decoding messages received from other objects.
+const uint32 JSBINARY_MAX_DEPTH = 256;
+
+enum JSBinaryTag {
+    TAG_UNDEFINED = 1,
+    TAG_NULL,
+    TAG_TRUE,
+    TAG_FALSE,
+    TAG_INT32,
+    TAG_UINT32,
+    TAG_DOUBLE,
+    TAG_STRING,
+    TAG_OBJECT,
+    TAG_ROOT_OBJECT,
+    TAG_ARRAY,
+    TAG_FUNCTION,
+    TAG_VEC3,
+    TAG_QUATERNION,
+    TAG_VISIBLE,
+    TAG_SYSTEM,
+    TAG_REF,
+    // Missing array element, only valid inside TAG_ARRAY
+    TAG_HOLE
+};
+
+// Looks up util.<name> in the current context, returning an empty handle if
+// this context doesn't have it (e.g. a restricted sandbox).
+v8::Local<v8::Function> getUtilConstructor(const char* name) {
+    v8::Local<v8::Value> util = v8::Context::GetCurrent()->Global()->Get(v8::String::New(JSSystemNames::UTIL_OBJECT_NAME));
+    if (util.IsEmpty() || !util->IsObject())
+        return v8::Local<v8::Function>();
+    v8::Local<v8::Value> ctor = util->ToObject()->Get(v8::String::New(name));
+    if (ctor.IsEmpty() || !ctor->IsFunction())
+        return v8::Local<v8::Function>();
+    return v8::Local<v8::Function>::Cast(ctor);
+}
+
+bool isArrayIndexBelow(v8::Local<v8::Value> key, uint32 limit) {
+    if (limit == 0) return false;
+    v8::Local<v8::Uint32> idx = key->ToArrayIndex();
+    return (!idx.IsEmpty() && idx->Value() < limit);
+}
+
+// See the comment in JSSerializer::serializeObjectInternal: fields referring
+// to native code aren't shipped.
+bool isNativeFunction(v8::Local<v8::Value> val) {
+    v8::String::Utf8Value text(val);
+    if (*text == NULL) return false;
+    String str(*text, text.length());
+    return ((str.find("{ [native code] }") != String::npos) &&
+        (str != FUNCTION_CONSTRUCTOR_TEXT));
+}
+
+} // namespace
+
+
+class JSBinaryEncoder {
+public:
+    JSBinaryEncoder(String* out)
+     : mOut(out),
+       mNumObjects(0),
+       mTypedProtosInitialized(false),
+       mVec3ProtoProps(0),
+       mQuaternionProtoProps(0)
+    {
+        mObjectProto = v8::Object::New()->GetPrototype();
+        mArrayProto = v8::Array::New()->GetPrototype();
+        // If somebody added enumerable properties to the default prototypes,
+        // fall back to comparing against them like the protobuf encoding.
+        mDefaultProtosEmpty =
+            mObjectProto->ToObject()->GetPropertyNames()->Length() == 0 &&
+            mArrayProto->ToObject()->GetPropertyNames()->Length() == 0;
+
+        mOut->push_back((char)JSBINARY_MAGIC);
+        mOut->push_back((char)JSBINARY_VERSION);
+    }
+
+    void writeValue(v8::Local<v8::Value> val) {
+        if (val.IsEmpty() || val->IsUndefined()) {
+            writeByte(TAG_UNDEFINED);
+        }
+        else if (val->IsString()) {
+            writeByte(TAG_STRING);
+            writeString(val);
+        }
+        else if (val->IsInt32()) {
+            int32 i = val->Int32Value();
+            writeByte(TAG_INT32);
+            writeVarint( ((uint32)i << 1) ^ (uint32)(i >> 31) );
+        }
+        else if (val->IsUint32()) {
+            writeByte(TAG_UINT32);
+            writeVarint(val->Uint32Value());
+        }
+        else if (val->IsNumber()) {
+            writeByte(TAG_DOUBLE);
+            writeDouble(val->NumberValue());
+        }
+        else if (val->IsBoolean()) {
+            writeByte(val->BooleanValue() ? TAG_TRUE : TAG_FALSE);
+        }
+        else if (val->IsNull()) {
+            writeByte(TAG_NULL);
+        }
+        else if (val->IsObject()) {
+            writeObject(v8::Local<v8::Object>::Cast(val));
+        }
+        else {
+            JSLOG(error, "Unknown value type in binary serialization, sending undefined.");
+            writeByte(TAG_UNDEFINED);
+        }
+    }
+
+private:
+    void writeByte(uint8 b) {
+        mOut->push_back((char)b);
+    }
+
+    void writeVarint(uint64 v) {
+        while (v >= 0x80) {
+            mOut->push_back((char)((v & 0x7F) | 0x80));
+            v >>= 7;
+        }
+        mOut->push_back((char)v);
+    }
+
+    void writeDouble(float64 d) {
+        uint64 bits;
+        memcpy(&bits, &d, sizeof(bits));
+        for(int i = 0; i < 8; i++)
+            mOut->push_back((char)((bits >> (8*i)) & 0xFF));
+    }
+
+    void writeBytes(const char* data, uint32 len) {
+        writeVarint(len);
+        mOut->append(data, len);
+    }
+
+    void writeString(v8::Local<v8::Value> val) {
+        v8::String::Utf8Value utf8(val);
+        if (*utf8 == NULL) {
+            JSLOG(error, "Error decoding string in binary serialization.");
+            writeVarint(0);
+            return;
+        }
+        writeBytes(*utf8, utf8.length());
+    }
+
+    void writeName(const String& name) {
+        NameTable::iterator it = mNames.find(name);
+        if (it != mNames.end()) {
+            writeVarint( ((uint64)it->second + 1) << 1 );
+            return;
+        }
+        uint32 idx = mNames.size();
+        mNames[name] = idx;
+        writeVarint( ((uint64)name.size() << 1) | 1 );
+        mOut->append(name);
+    }
+
+    void writeEndFields() {
+        writeVarint(0);
+    }
+
+    void writeField(const String& name, v8::Local<v8::Value> val) {
+        if (val->IsFunction() && isNativeFunction(val))
+            return;
+        writeName(name);
+        writeValue(val);
+    }
+
+    // Returns true and fills in idx_out if obj was already written
+    bool lookupObject(v8::Local<v8::Object> obj, uint32* idx_out) {
+        std::pair<ObjectIndex::iterator, ObjectIndex::iterator> range =
+            mObjectIndex.equal_range(obj->GetIdentityHash());
+        for(ObjectIndex::iterator it = range.first; it != range.second; it++) {
+            if (it->second.first->StrictEquals(obj)) {
+                *idx_out = it->second.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void registerObject(v8::Local<v8::Object> obj) {
+        mObjectIndex.insert(
+            ObjectIndex::value_type(obj->GetIdentityHash(), std::make_pair(obj, mNumObjects))
+        );
+        mNumObjects++;
+    }
+
+    void initTypedProtos() {
+        if (mTypedProtosInitialized) return;
+        mTypedProtosInitialized = true;
+
+        v8::Local<v8::Function> vec3_ctor = getUtilConstructor("Vec3");
+        if (!vec3_ctor.IsEmpty()) {
+            mVec3Proto = vec3_ctor->Get(v8::String::New("prototype"));
+            if (mVec3Proto->IsObject())
+                mVec3ProtoProps = mVec3Proto->ToObject()->GetPropertyNames()->Length();
+        }
+        v8::Local<v8::Function> quat_ctor = getUtilConstructor("Quaternion");
+        if (!quat_ctor.IsEmpty()) {
+            mQuaternionProto = quat_ctor->Get(v8::String::New("prototype"));
+            if (mQuaternionProto->IsObject())
+                mQuaternionProtoProps = mQuaternionProto->ToObject()->GetPropertyNames()->Length();
+        }
+    }
+
+    // Checks that obj has exactly the numeric fields in names (num_names of
+    // them) in addition to what it inherits from a prototype with
+    // proto_props enumerable properties.
+    bool hasOnlyNumericFields(v8::Local<v8::Object> obj, const char** names, uint32 num_names, uint32 proto_props) {
+        for(uint32 i = 0; i < num_names; i++) {
+            v8::Local<v8::String> name = v8::String::New(names[i]);
+            if (!obj->HasRealNamedProperty(name) || !obj->Get(name)->IsNumber())
+                return false;
+        }
+        return (obj->GetPropertyNames()->Length() == proto_props + num_names);
+    }
+
+    bool writeTyped(v8::Local<v8::Object> obj, v8::Local<v8::Value> proto) {
+        initTypedProtos();
+
+        static const char* vec3_fields[] = { "x", "y", "z" };
+        static const char* quat_fields[] = { "x", "y", "z", "w" };
+
+        if (!mVec3Proto.IsEmpty() && proto->StrictEquals(mVec3Proto) &&
+            hasOnlyNumericFields(obj, vec3_fields, 3, mVec3ProtoProps))
+        {
+            writeByte(TAG_VEC3);
+            for(uint32 i = 0; i < 3; i++)
+                writeDouble(obj->Get(v8::String::New(vec3_fields[i]))->NumberValue());
+            return true;
+        }
+        if (!mQuaternionProto.IsEmpty() && proto->StrictEquals(mQuaternionProto) &&
+            hasOnlyNumericFields(obj, quat_fields, 4, mQuaternionProtoProps))
+        {
+            writeByte(TAG_QUATERNION);
+            for(uint32 i = 0; i < 4; i++)
+                writeDouble(obj->Get(v8::String::New(quat_fields[i]))->NumberValue());
+            return true;
+        }
+        return false;
+    }
+
+    // Objects wrapping native structs. Mirrors serializeObjectInternal.
+    bool writeNative(v8::Local<v8::Object> obj) {
+        if (obj->InternalFieldCount() == 0)
+            return false;
+        v8::Local<v8::Value> typeidVal = obj->GetInternalField(TYPEID_FIELD);
+        if (typeidVal.IsEmpty() || typeidVal->IsNull() || typeidVal->IsUndefined())
+            return false;
+
+        v8::Local<v8::External> wrapped = v8::Local<v8::External>::Cast(typeidVal);
+        std::string* typeId = static_cast<std::string*>(wrapped->Value());
+        std::string err_msg;
+        if (typeId != NULL && *typeId == VISIBLE_TYPEID_STRING) {
+            JSVisibleStruct* vstruct = JSVisibleStruct::decodeVisible(obj, err_msg);
+            if (err_msg.empty()) {
+                writeByte(TAG_VISIBLE);
+                String sporef = vstruct->getSporef().toString();
+                writeBytes(sporef.data(), sporef.size());
+                return true;
+            }
+            SILOG(js, error, "Could not decode Visible in binary serialization: " + err_msg);
+        }
+        else if (typeId != NULL && *typeId == PRESENCE_TYPEID_STRING) {
+            JSPresenceStruct* pstruct = JSPresenceStruct::decodePresenceStruct(obj, err_msg);
+            if (err_msg.empty()) {
+                writeByte(TAG_VISIBLE);
+                String sporef = pstruct->getSporef().toString();
+                writeBytes(sporef.data(), sporef.size());
+                return true;
+            }
+            SILOG(js, error, "Could not decode Presence in binary serialization: " + err_msg);
+        }
+        else if (typeId != NULL && *typeId == SYSTEM_TYPEID_STRING) {
+            writeByte(TAG_SYSTEM);
+            return true;
+        }
+
+        // Anything else can't be shipped and arrives as an empty object
+        writeByte(TAG_OBJECT);
+        writeEndFields();
+        return true;
+    }
+
+    // Enumerable properties, for objects whose prototype has none
+    void writeFieldsFast(v8::Local<v8::Object> obj, uint32 skip_indices_below) {
+        v8::Local<v8::Array> props = obj->GetPropertyNames();
+        for(uint32 i = 0; i < props->Length(); i++) {
+            v8::Local<v8::Value> key = props->Get(i);
+            if (isArrayIndexBelow(key, skip_indices_below))
+                continue;
+            v8::String::Utf8Value name(key);
+            if (*name == NULL) continue;
+            writeField(String(*name, name.length()), obj->Get(key));
+        }
+        writeEndFields();
+    }
+
+    // Same set of fields the protobuf encoding writes, including the prototype
+    void writeFieldsSlow(v8::Local<v8::Object> obj, uint32 skip_indices_below) {
+        std::vector<String> props = getOwnPropertyNames(obj);
+        for(uint32 i = 0; i < props.size(); i++) {
+            if (props[i] == JSSERIALIZER_PROTOTYPE_NAME) {
+                writeField(props[i], obj->GetPrototype());
+                continue;
+            }
+            v8::Local<v8::String> key = v8::String::New(props[i].c_str(), props[i].size());
+            if (isArrayIndexBelow(key, skip_indices_below))
+                continue;
+            writeField(props[i], obj->Get(key));
+        }
+        writeEndFields();
+    }
+
+    void writeObject(v8::Local<v8::Object> obj) {
+        uint32 idx;
+        if (lookupObject(obj, &idx)) {
+            writeByte(TAG_REF);
+            writeVarint(idx);
+            return;
+        }
+        registerObject(obj);
+
+        if (obj->IsFunction()) {
+            writeByte(TAG_FUNCTION);
+            v8::Local<v8::Value> text = v8::Local<v8::Function>::Cast(obj)->ToString();
+            v8::String::Utf8Value utf8(text);
+            String text_str = (*utf8 == NULL) ? String() : String(*utf8, utf8.length());
+            writeBytes(text_str.data(), text_str.size());
+            if (text_str == FUNCTION_CONSTRUCTOR_TEXT)
+                writeEndFields();
+            else
+                writeFieldsSlow(obj, 0);
+            return;
+        }
+
+        v8::Local<v8::Value> proto = obj->GetPrototype();
+
+        if (obj->IsArray()) {
+            v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(obj);
+            uint32 len = arr->Length();
+            writeByte(TAG_ARRAY);
+            writeVarint(len);
+            for(uint32 i = 0; i < len; i++) {
+                if (!arr->Has(i))
+                    writeByte(TAG_HOLE);
+                else
+                    writeValue(arr->Get(i));
+            }
+            if (mDefaultProtosEmpty && proto->StrictEquals(mArrayProto))
+                writeFieldsFast(obj, len);
+            else
+                writeFieldsSlow(obj, len);
+            return;
+        }
+
+        if (writeNative(obj))
+            return;
+
+        if (obj->StrictEquals(mObjectProto)) {
+            writeByte(TAG_ROOT_OBJECT);
+            writeFieldsSlow(obj, 0);
+            return;
+        }
+
+        if (mDefaultProtosEmpty && proto->StrictEquals(mObjectProto)) {
+            writeByte(TAG_OBJECT);
+            writeFieldsFast(obj, 0);
+            return;
+        }
+
+        if (writeTyped(obj, proto))
+            return;
+
+        writeByte(TAG_OBJECT);
+        writeFieldsSlow(obj, 0);
+    }
+
+    String* mOut;
+
+    typedef std::tr1::unordered_map<String, uint32> NameTable;
+    NameTable mNames;
+
+    // Identity hash -> (object, index). Handles stay valid for the lifetime
+    // of the encoder since it runs inside a single HandleScope.
+    typedef std::multimap<int, std::pair<v8::Local<v8::Object>, uint32> > ObjectIndex;
+    ObjectIndex mObjectIndex;
+    uint32 mNumObjects;
+
+    v8::Local<v8::Value> mObjectProto;
+    v8::Local<v8::Value> mArrayProto;
+    bool mDefaultProtosEmpty;
+
+    bool mTypedProtosInitialized;
+    v8::Local<v8::Value> mVec3Proto;
+    uint32 mVec3ProtoProps;
+    v8::Local<v8::Value> mQuaternionProto;
+    uint32 mQuaternionProtoProps;
+};
+
+
+class JSBinaryDecoder {
+public:
+    JSBinaryDecoder(EmersonScript* emerScript, const String& data)
+     : mEmerScript(emerScript),
+       mData(data),
+       mPos(0),
+       mDepth(0),
+       mTypedCtorsInitialized(false)
+    {}
+
+    bool decode(v8::Handle<v8::Value>* out) {
+        uint8 magic, version;
+        if (!readByte(&magic) || magic != JSBINARY_MAGIC ||
+            !readByte(&version) || version != JSBINARY_VERSION)
+        {
+            JSLOG(error, "Error deserializing binary message: bad header.");
+            return false;
+        }
+
+        int32 obj_idx;
+        bool was_ref;
+        if (!readValue(out, &obj_idx, &was_ref))
+            return false;
+        if (mPos != mData.size()) {
+            JSLOG(error, "Error deserializing binary message: trailing data.");
+            return false;
+        }
+
+        // Prototypes that referred back to objects that were still being
+        // filled in when we saw them.
+        for(uint32 i = 0; i < mPendingPrototypes.size(); i++)
+            applyPrototype(mPendingPrototypes[i].first, mPendingPrototypes[i].second);
+        return true;
+    }
+
+private:
+    bool readByte(uint8* out) {
+        if (mPos >= mData.size()) return false;
+        *out = (uint8)mData[mPos++];
+        return true;
+    }
+
+    bool readVarint(uint64* out) {
+        uint64 result = 0;
+        for(uint32 shift = 0; shift < 64; shift += 7) {
+            uint8 b;
+            if (!readByte(&b)) return false;
+            result |= ((uint64)(b & 0x7F)) << shift;
+            if ((b & 0x80) == 0) {
+                *out = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readDouble(float64* out) {
+        if (mData.size() - mPos < 8) return false;
+        uint64 bits = 0;
+        for(int i = 0; i < 8; i++)
+            bits |= ((uint64)(uint8)mData[mPos + i]) << (8*i);
+        mPos += 8;
+        memcpy(out, &bits, sizeof(bits));
+        return true;
+    }
+
+    // Returns a pointer into mData and the length of a length-prefixed string
+    bool readBytes(const char** data_out, uint32* len_out) {
+        uint64 len;
+        if (!readVarint(&len) || len > mData.size() - mPos) return false;
+        *data_out = mData.data() + mPos;
+        *len_out = (uint32)len;
+        mPos += len;
+        return true;
+    }
+
+    int32 registerObject(v8::Handle<v8::Object> obj, bool is_root = false) {
+        mObjects.push_back(obj);
+        mIsRoot.push_back(is_root);
+        return (int32)mObjects.size() - 1;
+    }
+
+    void initTypedCtors() {
+        if (mTypedCtorsInitialized) return;
+        mTypedCtorsInitialized = true;
+        mVec3Ctor = getUtilConstructor("Vec3");
+        mQuaternionCtor = getUtilConstructor("Quaternion");
+    }
+
+    v8::Handle<v8::Object> newTyped(v8::Handle<v8::Function> ctor) {
+        if (ctor.IsEmpty())
+            return v8::Object::New();
+        return ctor->NewInstance();
+    }
+
+    // Same semantics as JSSerializer::setPrototype
+    void applyPrototype(v8::Handle<v8::Object> obj, int32 proto_idx) {
+        if (mIsRoot[proto_idx])
+            obj->SetPrototype(mObjects[proto_idx]);
+        else
+            JSSerializer::shallowCopyFields(obj, mObjects[proto_idx]);
+    }
+
+    bool readFields(v8::Handle<v8::Object> obj) {
+        while(true) {
+            uint64 token;
+            if (!readVarint(&token)) return false;
+            if (token == 0) return true;
+
+            uint32 name_idx;
+            if (token & 1) {
+                uint64 len = token >> 1;
+                if (len > mData.size() - mPos) return false;
+                const char* name_data = mData.data() + mPos;
+                mPos += len;
+                mNames.push_back(v8::String::NewSymbol(name_data, (int)len));
+                mIsPrototypeName.push_back(String(name_data, len) == JSSERIALIZER_PROTOTYPE_NAME);
+                name_idx = mNames.size() - 1;
+            }
+            else {
+                uint64 idx = (token >> 1) - 1;
+                if (idx >= mNames.size()) return false;
+                name_idx = (uint32)idx;
+            }
+
+            v8::Handle<v8::Value> val;
+            int32 obj_idx;
+            bool was_ref;
+            if (!readValue(&val, &obj_idx, &was_ref))
+                return false;
+
+            if (!mIsPrototypeName[name_idx]) {
+                obj->Set(mNames[name_idx], val);
+            }
+            else if (obj_idx >= 0) {
+                if (was_ref)
+                    mPendingPrototypes.push_back(std::make_pair(obj, obj_idx));
+                else
+                    applyPrototype(obj, obj_idx);
+            }
+            else if (!val->IsUndefined() && !val->IsNull()) {
+                obj->SetPrototype(val);
+            }
+        }
+    }
+
+    // obj_idx_out is set to the index of the object read, or -1 for
+    // primitives. was_ref_out indicates the object was a back reference.
+    bool readValue(v8::Handle<v8::Value>* out, int32* obj_idx_out, bool* was_ref_out) {
+        *obj_idx_out = -1;
+        *was_ref_out = false;
+
+        uint8 tag;
+        if (!readByte(&tag)) return false;
+
+        switch(tag) {
+          case TAG_UNDEFINED:
+            *out = v8::Undefined();
+            return true;
+          case TAG_NULL:
+            *out = v8::Null();
+            return true;
+          case TAG_TRUE:
+            *out = v8::Boolean::New(true);
+            return true;
+          case TAG_FALSE:
+            *out = v8::Boolean::New(false);
+            return true;
+          case TAG_INT32:
+            {
+                uint64 v;
+                if (!readVarint(&v)) return false;
+                uint32 zz = (uint32)v;
+                *out = v8::Integer::New( (int32)(zz >> 1) ^ -(int32)(zz & 1) );
+                return true;
+            }
+          case TAG_UINT32:
+            {
+                uint64 v;
+                if (!readVarint(&v)) return false;
+                *out = v8::Integer::NewFromUnsigned((uint32)v);
+                return true;
+            }
+          case TAG_DOUBLE:
+            {
+                float64 d;
+                if (!readDouble(&d)) return false;
+                *out = v8::Number::New(d);
+                return true;
+            }
+          case TAG_STRING:
+            {
+                const char* data;
+                uint32 len;
+                if (!readBytes(&data, &len)) return false;
+                *out = v8::String::New(data, len);
+                return true;
+            }
+          case TAG_REF:
+            {
+                uint64 idx;
+                if (!readVarint(&idx) || idx >= mObjects.size()) {
+                    JSLOG(error, "Error deserializing binary message: reference to unknown object.");
+                    return false;
+                }
+                *out = mObjects[idx];
+                *obj_idx_out = (int32)idx;
+                *was_ref_out = true;
+                return true;
+            }
+          case TAG_VEC3:
+            {
+                float64 v[3];
+                for(uint32 i = 0; i < 3; i++)
+                    if (!readDouble(&v[i])) return false;
+                initTypedCtors();
+                v8::Handle<v8::Object> obj = newTyped(mVec3Ctor);
+                Vec3Fill(obj, Vector3d(v[0], v[1], v[2]));
+                *obj_idx_out = registerObject(obj);
+                *out = obj;
+                return true;
+            }
+          case TAG_QUATERNION:
+            {
+                float64 v[4];
+                for(uint32 i = 0; i < 4; i++)
+                    if (!readDouble(&v[i])) return false;
+                initTypedCtors();
+                v8::Handle<v8::Object> obj = newTyped(mQuaternionCtor);
+                // Not QuaternionFill, which would round through floats
+                obj->Set(JS_STRING(x), v8::Number::New(v[0]));
+                obj->Set(JS_STRING(y), v8::Number::New(v[1]));
+                obj->Set(JS_STRING(z), v8::Number::New(v[2]));
+                obj->Set(JS_STRING(w), v8::Number::New(v[3]));
+                *obj_idx_out = registerObject(obj);
+                *out = obj;
+                return true;
+            }
+          case TAG_VISIBLE:
+            {
+                const char* data;
+                uint32 len;
+                if (!readBytes(&data, &len)) return false;
+                v8::Handle<v8::Object> obj = mEmerScript->createVisibleWeakPersistent(
+                    SpaceObjectReference(String(data, len)), JSVisibleDataPtr()
+                );
+                *obj_idx_out = registerObject(obj);
+                *out = obj;
+                return true;
+            }
+          case TAG_SYSTEM:
+            {
+                v8::Handle<v8::Object> obj = v8::Object::New();
+                obj->Set(v8::String::New("builtin"), v8::String::New("[object system]"));
+                *obj_idx_out = registerObject(obj);
+                *out = obj;
+                return true;
+            }
+          case TAG_OBJECT:
+          case TAG_ROOT_OBJECT:
+          case TAG_ARRAY:
+          case TAG_FUNCTION:
+            {
+                if (mDepth >= JSBINARY_MAX_DEPTH) {
+                    JSLOG(error, "Error deserializing binary message: nested too deeply.");
+                    return false;
+                }
+                mDepth++;
+                bool success = readComposite(tag, out, obj_idx_out);
+                mDepth--;
+                return success;
+            }
+          default:
+            JSLOG(error, "Error deserializing binary message: unknown tag " << (int)tag);
+            return false;
+        }
+    }
+
+    bool readComposite(uint8 tag, v8::Handle<v8::Value>* out, int32* obj_idx_out) {
+        v8::Handle<v8::Object> obj;
+
+        if (tag == TAG_OBJECT || tag == TAG_ROOT_OBJECT) {
+            obj = v8::Object::New();
+            *obj_idx_out = registerObject(obj, (tag == TAG_ROOT_OBJECT));
+        }
+        else if (tag == TAG_ARRAY) {
+            uint64 len;
+            if (!readVarint(&len) || len > mData.size() - mPos) return false;
+            v8::Handle<v8::Array> arr = v8::Array::New((int)len);
+            obj = arr;
+            *obj_idx_out = registerObject(obj);
+
+            for(uint32 i = 0; i < len; i++) {
+                if (mPos < mData.size() && (uint8)mData[mPos] == TAG_HOLE) {
+                    mPos++;
+                    continue;
+                }
+                v8::Handle<v8::Value> elem;
+                int32 elem_idx;
+                bool elem_was_ref;
+                if (!readValue(&elem, &elem_idx, &elem_was_ref))
+                    return false;
+                arr->Set(i, elem);
+            }
+        }
+        else {
+            const char* data;
+            uint32 len;
+            if (!readBytes(&data, &len)) return false;
+            String text(data, len);
+
+            v8::Handle<v8::Function> func;
+            if (text == FUNCTION_CONSTRUCTOR_TEXT) {
+                v8::Local<v8::Function> tmpFun = mEmerScript->functionValue("function(){}");
+                v8::Local<v8::Value> ctor = tmpFun->Get(v8::String::New("constructor"));
+                if (!ctor.IsEmpty() && ctor->IsFunction())
+                    func = v8::Handle<v8::Function>::Cast(ctor);
+                else {
+                    JSLOG(error, "Error setting the constructor of an object.  Setting to dummy constructor.");
+                    func = tmpFun;
+                }
+            }
+            else {
+                func = mEmerScript->functionValue(text);
+            }
+            if (func.IsEmpty()) {
+                JSLOG(error, "Error deserializing binary message: could not evaluate function.");
+                return false;
+            }
+            obj = func;
+            *obj_idx_out = registerObject(obj);
+        }
+
+        *out = obj;
+        return readFields(obj);
+    }
+
+    EmersonScript* mEmerScript;
+    const String& mData;
+    String::size_type mPos;
+    uint32 mDepth;
+
+    std::vector<v8::Handle<v8::String> > mNames;
+    std::vector<bool> mIsPrototypeName;
+
+    std::vector<v8::Handle<v8::Object> > mObjects;
+    std::vector<bool> mIsRoot;
+    std::vector< std::pair<v8::Handle<v8::Object>, int32> > mPendingPrototypes;
+
+    bool mTypedCtorsInitialized;
+    v8::Handle<v8::Function> mVec3Ctor;
+    v8::Handle<v8::Function> mQuaternionCtor;
+};
+
+
+
+std::string JSSerializer::serializeBinaryMessage(v8::Local<v8::Value> v8Val)
+{
+    v8::HandleScope handleScope;
+    String serialized;
+    JSBinaryEncoder encoder(&serialized);
+    encoder.writeValue(v8Val);
+    return serialized;
+}
+
+bool JSSerializer::isBinaryMessage(const String& payload)
+{
+    return (payload.size() >= 2 &&
+        (uint8)payload[0] == JSBINARY_MAGIC &&
+        (uint8)payload[1] == JSBINARY_VERSION);
+}
+
+v8::Handle<v8::Value> JSSerializer::deserializeBinaryMessage(EmersonScript* emerScript, const String& payload, bool& deserializeSuccessful)
+{
+    if (! v8::Context::InContext())
+    {
+        JSLOG(error, "Error when deserializing.  Am not inside a v8 context.  Aborting.");
+        deserializeSuccessful = false;
+        return v8::Undefined();
+    }
+
+    v8::HandleScope handle_scope;
+    v8::Handle<v8::Value> returner;
+    JSBinaryDecoder decoder(emerScript, payload);
+    deserializeSuccessful = decoder.decode(&returner);
+    if (!deserializeSuccessful || returner.IsEmpty())
+    {
+        deserializeSuccessful = false;
+        return v8::Undefined();
+    }
+    return handle_scope.Close(returner);
+}
+
+} // namespace JS
+} // namespace Sirikata
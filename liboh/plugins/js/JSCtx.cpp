@@ -7,13 +7,25 @@ namespace JS
 {
 
 
-JSCtx::JSCtx(
-    Context* ctx,Network::IOStrandPtr oStrand,
-    Network::IOStrandPtr vmStrand,v8::Isolate* is)
- : objStrand(oStrand),
-   visManStrand(vmStrand),
+JSCtx::JSCtx(Context* ctx, JSIsolatePool* pool, JSIsolate* iso)
+ : objStrand(iso->scriptStrand),
+   visManStrand(iso->visManStrand),
    mainStrand(ctx->mainStrand),
-   mIsolate(is),
+   mIsolate(iso->mIsolate),
+   // These just alias the isolate's handles, which it disposes of
+   mVisibleTemplate(iso->mVisibleTemplate),
+   mPresenceTemplate(iso->mPresenceTemplate),
+   mContextTemplate(iso->mContextTemplate),
+   mUtilTemplate(iso->mUtilTemplate),
+   mInvokableObjectTemplate(iso->mInvokableObjectTemplate),
+   mSystemTemplate(iso->mSystemTemplate),
+   mTimerTemplate(iso->mTimerTemplate),
+   mContextGlobalTemplate(iso->mContextGlobalTemplate),
+   mVec3Template(iso->mVec3Template),
+   mQuaternionTemplate(iso->mQuaternionTemplate),
+   mPatternTemplate(iso->mPatternTemplate),
+   mPool(pool),
+   mShared(iso),
    internalContext(ctx),
    isStopped(false),
    isInitialized(false),
@@ -23,25 +35,8 @@ JSCtx::JSCtx(
 
 JSCtx::~JSCtx()
 {
-    mVisibleTemplate.Dispose();
-    mPresenceTemplate.Dispose();
-    mContextTemplate.Dispose();
-    mUtilTemplate.Dispose();
-    mInvokableObjectTemplate.Dispose();
-    mSystemTemplate.Dispose();
-    mTimerTemplate.Dispose();
-    mContextGlobalTemplate.Dispose();
-
-    // The manager tracks the templates so they can be reused by all the
-    // individual scripts.
-    mVec3Template.Dispose();
-    mQuaternionTemplate.Dispose();
-    mPatternTemplate.Dispose();
-
-    if (mIsolate == v8::Isolate::GetCurrent())
-        mIsolate->Exit();
-    
-    mIsolate->Dispose();
+    // The templates and isolate are owned by the pool, just give up our spot
+    mPool->release(mShared);
 }
 
 Sirikata::SerializationCheck* JSCtx::serializationCheck()
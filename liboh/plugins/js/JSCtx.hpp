@@ -3,6 +3,7 @@
 
 #include <sirikata/core/service/Context.hpp>
 #include <sirikata/core/util/SerializationCheck.hpp>
+#include "JSIsolatePool.hpp"
 #include <v8.h>
 
 
@@ -18,9 +19,11 @@ namespace JS
 class JSCtx 
 {
 public:    
-    JSCtx(
-        Context* ctx,Network::IOStrandPtr oStrand,
-        Network::IOStrandPtr vmStrand,v8::Isolate* is);
+    /** Create the context for one script, running in iso, which was acquired
+     *  from pool. The strands, isolate and templates below all belong to iso
+     *  and are shared with the other scripts assigned to it.
+     */
+    JSCtx(Context* ctx, JSIsolatePool* pool, JSIsolate* iso);
     
     ~JSCtx();
     
@@ -54,6 +57,9 @@ public:
     
     
 private:
+    JSIsolatePool* mPool;
+    JSIsolate* mShared;
+
     Context* internalContext;
     bool isStopped;
     bool isInitialized;
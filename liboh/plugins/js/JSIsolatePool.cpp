@@ -0,0 +1,89 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "JSIsolatePool.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace Sirikata {
+namespace JS {
+
+JSIsolate::JSIsolate(Context* ctx, uint32 idx)
+ : mIsolate(v8::Isolate::New()),
+   scriptStrand(ctx->ioService->createStrand("EmersonScript Isolate " + boost::lexical_cast<String>(idx))),
+   visManStrand(ctx->ioService->createStrand("VisManager Isolate " + boost::lexical_cast<String>(idx))),
+   templatesInitialized(false),
+   numScripts(0)
+{
+}
+
+JSIsolate::~JSIsolate()
+{
+    assert(numScripts == 0);
+
+    if (templatesInitialized) {
+        v8::Locker locker(mIsolate);
+        v8::Isolate::Scope iscope(mIsolate);
+
+        mVisibleTemplate.Dispose();
+        mPresenceTemplate.Dispose();
+        mContextTemplate.Dispose();
+        mUtilTemplate.Dispose();
+        mInvokableObjectTemplate.Dispose();
+        mSystemTemplate.Dispose();
+        mTimerTemplate.Dispose();
+        mContextGlobalTemplate.Dispose();
+
+        mVec3Template.Dispose();
+        mQuaternionTemplate.Dispose();
+        mPatternTemplate.Dispose();
+    }
+
+    if (mIsolate == v8::Isolate::GetCurrent())
+        mIsolate->Exit();
+
+    mIsolate->Dispose();
+}
+
+
+
+JSIsolatePool::JSIsolatePool(Context* ctx, uint32 size)
+{
+    if (size == 0)
+        size = std::max(boost::thread::hardware_concurrency(), (unsigned int)1);
+
+    for(uint32 i = 0; i < size; i++)
+        mIsolates.push_back(new JSIsolate(ctx, i));
+}
+
+JSIsolatePool::~JSIsolatePool()
+{
+    for(uint32 i = 0; i < mIsolates.size(); i++)
+        delete mIsolates[i];
+    mIsolates.clear();
+}
+
+JSIsolate* JSIsolatePool::acquire()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+
+    JSIsolate* least_loaded = mIsolates[0];
+    for(uint32 i = 1; i < mIsolates.size(); i++) {
+        if (mIsolates[i]->numScripts < least_loaded->numScripts)
+            least_loaded = mIsolates[i];
+    }
+    least_loaded->numScripts++;
+    return least_loaded;
+}
+
+void JSIsolatePool::release(JSIsolate* iso)
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    assert(iso->numScripts > 0);
+    iso->numScripts--;
+}
+
+} // namespace JS
+} // namespace Sirikata
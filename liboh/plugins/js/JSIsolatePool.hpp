@@ -0,0 +1,86 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef __SIRIKATA_JS_ISOLATE_POOL_HPP__
+#define __SIRIKATA_JS_ISOLATE_POOL_HPP__
+
+#include "Platform.hpp"
+#include <sirikata/core/service/Context.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <boost/thread/mutex.hpp>
+#include <v8.h>
+
+namespace Sirikata {
+namespace JS {
+
+/** A V8 isolate shared by many scripts, along with the templates built for it
+ *  and the strands its scripts run on. Each script still gets its own
+ *  contexts within the isolate, so scripts are isolated from each other just
+ *  as they are within a single object's sandboxes, but the (large) per isolate
+ *  heap and the templates are only paid for once per JSIsolate.
+ *
+ *  Every script assigned to an isolate runs its callbacks on the isolate's
+ *  scriptStrand. Since the strand already serializes them, scripts sharing an
+ *  isolate don't contend for its v8::Locker, and scripts in different
+ *  isolates never touch each other's locks.
+ */
+class JSIsolate {
+public:
+    JSIsolate(Context* ctx, uint32 idx);
+    ~JSIsolate();
+
+    v8::Isolate* mIsolate;
+
+    Network::IOStrandPtr scriptStrand;
+    Network::IOStrandPtr visManStrand;
+
+    // Filled in by JSObjectScriptManager the first time a script is assigned
+    // to this isolate.
+    bool templatesInitialized;
+
+    v8::Persistent<v8::FunctionTemplate> mVisibleTemplate;
+    v8::Persistent<v8::FunctionTemplate> mPresenceTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mContextTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mUtilTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mInvokableObjectTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mSystemTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mTimerTemplate;
+    v8::Persistent<v8::ObjectTemplate>   mContextGlobalTemplate;
+
+    v8::Persistent<v8::FunctionTemplate> mVec3Template;
+    v8::Persistent<v8::FunctionTemplate> mQuaternionTemplate;
+    v8::Persistent<v8::FunctionTemplate> mPatternTemplate;
+
+    // Number of scripts currently assigned
+    uint32 numScripts;
+};
+
+/** A fixed set of JSIsolates that scripts are spread across, normally about
+ *  one per core. Scripts are assigned to the isolate with the fewest scripts
+ *  when they are created and stay there for their lifetime.
+ */
+class JSIsolatePool {
+public:
+    /** Create a pool with size isolates. If size is 0, one isolate is created
+     *  per hardware thread.
+     */
+    JSIsolatePool(Context* ctx, uint32 size);
+    ~JSIsolatePool();
+
+    /// Assign a new script to an isolate
+    JSIsolate* acquire();
+    /// Indicate that a script assigned to iso has been destroyed
+    void release(JSIsolate* iso);
+
+    uint32 size() const { return mIsolates.size(); }
+
+private:
+    boost::mutex mMutex;
+    std::vector<JSIsolate*> mIsolates;
+};
+
+} // namespace JS
+} // namespace Sirikata
+
+#endif //__SIRIKATA_JS_ISOLATE_POOL_HPP__
@@ -626,6 +626,93 @@ void JSObjectScript::iStorageCountCallback(
 }
 
 
+void JSObjectScript::storageScanCallback(
+    JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
+    OH::Storage::Result result, OH::Storage::ReadSet* rs,
+    const OH::Storage::ScanToken& next, Liveness::Token objAlive,
+    Liveness::Token ctxAlive)
+{
+    if (!objAlive) { delete rs; return; }
+    Liveness::Lock locked(objAlive);
+    if (!locked) { delete rs; return; }
+
+    if (!ctxAlive) { delete rs; return; }
+    Liveness::Lock lockedCtx(ctxAlive);
+    if (!lockedCtx) { delete rs; return; }
+
+
+    if (isStopped()) {
+        JSLOG(warn, "Ignoring storage scan callback after shutdown request.");
+        delete rs;
+        return;
+    }
+
+    mCtx->objStrand->post(
+        std::tr1::bind(&JSObjectScript::iStorageScanCallback,this,
+            jscont,cb,result,rs,next,Liveness::livenessToken(),
+            jscont->livenessToken()),
+        "JSObjectScript::iStorageScanCallback"
+    );
+}
+
+void JSObjectScript::iStorageScanCallback(
+    JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
+    OH::Storage::Result result, OH::Storage::ReadSet* rs,
+    const OH::Storage::ScanToken& next, Liveness::Token objAlive,
+    Liveness::Token ctxAlive)
+{
+    if (!objAlive) { delete rs; return; }
+    Liveness::Lock locked(objAlive);
+    if (!locked) { delete rs; return; }
+
+    if (!ctxAlive) { delete rs; return; }
+    Liveness::Lock lockedCtx(ctxAlive);
+    if (!lockedCtx) { delete rs; return; }
+
+
+    JSSCRIPT_SERIAL_CHECK();
+    if (mCtx->stopped())
+    {
+        JSLOG(warn, "Ignoring storage scan callback after shutdown request.");
+        delete rs;
+        return;
+    }
+
+    while (!mCtx->initialized())
+    {}
+
+    v8::Locker locker (mCtx->mIsolate);
+    v8::Isolate::Scope iscope(mCtx->mIsolate);
+
+    v8::HandleScope handle_scope;
+    v8::Context::Scope context_scope(mContext->mContext);
+    TryCatch try_catch;
+
+    v8::Handle<v8::Boolean> js_success = v8::Boolean::New(result == OH::Storage::SUCCESS);
+    // Pages are always objects, possibly empty, so scripts can just iterate
+    v8::Handle<v8::Value> js_rs = v8::Undefined();
+    if (result == OH::Storage::SUCCESS) {
+        v8::Handle<v8::Object> js_rs_obj = v8::Object::New();
+        if (rs) {
+            for(OH::Storage::ReadSet::const_iterator it = rs->begin(); it != rs->end(); it++)
+                js_rs_obj->Set(v8::String::New(it->first.c_str(), it->first.size()), strToUint16Str(it->second));
+        }
+        js_rs = js_rs_obj;
+    }
+    // We own the read set.
+    delete rs;
+
+    v8::Handle<v8::Value> js_next = v8::Undefined();
+    if (!next.empty())
+        js_next = v8::String::New(next.c_str(), next.size());
+
+    int argc = 3;
+    v8::Handle<v8::Value> argv[3] = { js_success, js_rs, js_next };
+    invokeCallback(jscont, cb, argc, argv);
+    postCallbackChecks();
+}
+
+
 v8::Handle<v8::Value> JSObjectScript::storageErase(
     const OH::Storage::Key& key, v8::Handle<v8::Function> cb,
     JSContextStruct* jscont)
@@ -887,6 +974,52 @@ void JSObjectScript::eStorageCount(
     bool returner = mStorage->count(mInternalID, start, finish, wrapped_cb);
 }
 
+
+v8::Handle<v8::Value> JSObjectScript::storageRangeScan(
+    const OH::Storage::Key& start, const OH::Storage::Key& finish,
+    const OH::Storage::ScanToken& token, uint32 max_keys,
+    v8::Handle<v8::Function> cb, JSContextStruct* jscont)
+{
+    JSSCRIPT_SERIAL_CHECK();
+    if (mStorage == NULL) return v8::ThrowException( v8::Exception::Error(v8::String::New("No persistent storage available.")) );
+
+    mCtx->mainStrand->post(
+        std::tr1::bind(&JSObjectScript::eStorageRangeScan,this,
+            start,finish,token,max_keys,v8::Persistent<v8::Function>::New(cb),
+            jscont,Liveness::livenessToken(),jscont->livenessToken()),
+        "JSObjectScript::eStorageRangeScan"
+    );
+
+    return v8::Boolean::New(true);
+}
+
+void JSObjectScript::eStorageRangeScan(
+    const OH::Storage::Key& start, const OH::Storage::Key& finish,
+    const OH::Storage::ScanToken& token, uint32 max_keys,
+    v8::Persistent<v8::Function> cb, JSContextStruct* jscont,
+    Liveness::Token objAlive,Liveness::Token ctxAlive)
+{
+    if (!objAlive) return;
+    Liveness::Lock locked(objAlive);
+    if (!locked) return;
+
+    if (!ctxAlive) return;
+    Liveness::Lock lockedCtx(ctxAlive);
+    if (!lockedCtx) return;
+
+    OH::Storage::ScanCallback wrapped_cb = 0;
+    if (!cb.IsEmpty())
+    {
+        wrapped_cb =
+            std::tr1::bind(&JSObjectScript::storageScanCallback, this,
+                jscont, cb, _1, _2, _3, livenessToken(),jscont->livenessToken());
+    }
+
+    // Invalid tokens are rejected without a callback, so report them here
+    if (!mStorage->rangeScan(mInternalID, start, finish, token, max_keys, wrapped_cb) && wrapped_cb)
+        wrapped_cb(OH::Storage::TRANSACTION_ERROR, NULL, OH::Storage::ScanToken());
+}
+
 void JSObjectScript::iSetRestoreScriptCallback(
     JSContextStruct* jscont, v8::Persistent<v8::Function> cb, bool success,
     Liveness::Token objAlive,Liveness::Token ctxAlive)
@@ -1221,12 +1354,19 @@ v8::Handle<v8::Value> JSObjectScript::emersonCompileString(const String& toCompi
 
     try {
         int em_compile_err = 0;
+        String script_name("eval statement");
+        EmersonCompileCache* compile_cache = mManager->compileCache();
 
         String js_script_str;
-        bool successfullyCompiled = EmersonUtil::emerson_compile(
-            String("eval statement"), em_script_str.c_str(),
-            js_script_str, em_compile_err, handleEmersonRecognitionError,
-            &lineMap);
+        bool successfullyCompiled = compile_cache->lookup(script_name, em_script_str, &js_script_str, &lineMap);
+        if (!successfullyCompiled) {
+            successfullyCompiled = EmersonUtil::emerson_compile(
+                script_name, em_script_str.c_str(),
+                js_script_str, em_compile_err, handleEmersonRecognitionError,
+                &lineMap);
+            if (successfullyCompiled)
+                compile_cache->insert(script_name, em_script_str, js_script_str, lineMap);
+        }
 
         if (successfullyCompiled)
         {
@@ -1298,12 +1438,21 @@ v8::Handle<v8::Value> JSObjectScript::internalEval(const String& em_script_str,
         try {
             int em_compile_err = 0;
             v8::String::Utf8Value parent_script_name(em_script_name->ResourceName());
+            String script_name = FromV8String(parent_script_name);
+            EmersonCompileCache* compile_cache = mManager->compileCache();
 
+            // Other scripts have usually translated the same source already,
+            // e.g. the standard library, so try the shared cache first
             String js_script_str;
-            bool successfullyCompiled = EmersonUtil::emerson_compile(
-                FromV8String(parent_script_name), em_script_str_new.c_str(),
-                js_script_str, em_compile_err, handleEmersonRecognitionError,
-                &lineMap);
+            bool successfullyCompiled = compile_cache->lookup(script_name, em_script_str, &js_script_str, &lineMap);
+            if (!successfullyCompiled) {
+                successfullyCompiled = EmersonUtil::emerson_compile(
+                    script_name, em_script_str_new.c_str(),
+                    js_script_str, em_compile_err, handleEmersonRecognitionError,
+                    &lineMap);
+                if (successfullyCompiled)
+                    compile_cache->insert(script_name, em_script_str, js_script_str, lineMap);
+            }
 
 
             if (successfullyCompiled)
@@ -1722,14 +1871,26 @@ v8::Handle<v8::Value> JSObjectScript::absoluteImport(const boost::filesystem::pa
 
     JSLOG(detailed, " Performing import on absolute path: " << full_filename.string());
 
+    // Setup eval context information
+    EvalContext& ctx = mEvalContextStack.top();
+    EvalContext new_ctx(ctx);
+
+    new_ctx.currentScriptDir = full_filename.parent_path();
+    new_ctx.currentScriptBaseDir = full_base_dir;
+    String script_name = (new_ctx.getFullRelativeScriptDir() / full_filename.filename()).string();
+    ScriptOrigin origin( v8::String::New( script_name.c_str() ) );
+
     // Now try to read in and run the file. We want to avoid having to compile
-    // the file, so we use a cache of precompiled versions of the file
-    // if it's not javascript.
+    // the file, so if it's not javascript we look for a precompiled version.
     //
-    // We try to read both files, but we try the cached file first. That way,
-    // the worst that happens if the file gets replaced/updated is that we read
-    // the cached version before and the mtimes will cause us to ignore the
-    // cached script.
+    // The first place to look is the manager's in memory compile cache, which
+    // internalEval will find the translation in (along with its line map) if
+    // any other script has already imported the same file.
+    //
+    // Otherwise we use a cache of precompiled versions of the file on disk.
+    // We read the original first, so if the file gets replaced/updated while
+    // we're reading the worst that happens is that we pick up a cached version
+    // of the newer file.
     //
     // The location of the cached file needs to be handled carefully. We place
     // the cache under a temporary directory, isolate these files in their own
@@ -1737,6 +1898,12 @@ v8::Handle<v8::Value> JSObjectScript::absoluteImport(const boost::filesystem::pa
     // root path, e.g. / or C:/, removed) to generate the location within that
     // directory, ensuring that there aren't any conflicts due to multiple
     // import base paths.
+    std::string contents;
+    int64 source_mtime;
+    bool read_success = read_file_contents(full_filename.string(), contents, &source_mtime);
+    if (!read_success)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New("Couldn't open file for import.")) );
+
     boost::filesystem::path cache_dir(Path::Get(Path::DIR_TEMP, "emerson_cache"));
     String cached_js_file =
         (cache_dir /
@@ -1746,21 +1913,18 @@ v8::Handle<v8::Value> JSObjectScript::absoluteImport(const boost::filesystem::pa
     int64 cached_mtime;
     bool got_cached_js = false;
     // Only actually try to get the cached version if its not JS
-    if (!isJS)
-        got_cached_js = read_file_contents(cached_js_file, cached_contents, &cached_mtime);
-    // Grab the original. TODO(ewencp) We could probably avoid actually reading
-    // the file by allowing read_file_contents to bail early when the cache
-    // validity check passes, but its not worth bothering with right now since
-    // these scripts are relatively small and it makes read_file_contents more
-    // complicated.
-    std::string contents;
-    int64 source_mtime;
-    bool read_success = read_file_contents(full_filename.string(), contents, &source_mtime);
-    if (!read_success)
-        return v8::ThrowException( v8::Exception::Error(v8::String::New("Couldn't open file for import.")) );
+    if (!isJS) {
+        if (mManager->compileCache()->contains(script_name, contents))
+            cached_js_file = ""; // Already translated, leave the disk cache alone
+        else
+            got_cached_js = read_file_contents(cached_js_file, cached_contents, &cached_mtime);
+    }
 
     // If we did get valid cached data, set thin
     if (got_cached_js && cached_mtime > source_mtime) {
+        // Share it with other scripts. There's no line map for it, but that's
+        // no worse than running the cached JS directly.
+        mManager->compileCache()->insert(script_name, contents, cached_contents, EmersonCompileCache::LineMap());
         // Make the contents we execute the cached JS
         contents = cached_contents;
         // Cached data is JS, no need to recompile
@@ -1769,14 +1933,6 @@ v8::Handle<v8::Value> JSObjectScript::absoluteImport(const boost::filesystem::pa
         cached_js_file = "";
     }
 
-    // Setup eval context information
-    EvalContext& ctx = mEvalContextStack.top();
-    EvalContext new_ctx(ctx);
-
-    new_ctx.currentScriptDir = full_filename.parent_path();
-    new_ctx.currentScriptBaseDir = full_base_dir;
-    ScriptOrigin origin( v8::String::New( (new_ctx.getFullRelativeScriptDir() / full_filename.filename()).string().c_str() ) );
-
     mImportedFiles[jscont->getContextID()].insert( full_filename.string() );
 
     // Eval
@@ -134,6 +134,7 @@ public:
     v8::Handle<v8::Value> storageRangeRead(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb, JSContextStruct* jscont);
     v8::Handle<v8::Value> storageRangeErase(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb, JSContextStruct* jscont);
     v8::Handle<v8::Value> storageCount(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb, JSContextStruct* jscont);
+    v8::Handle<v8::Value> storageRangeScan(const OH::Storage::Key& start, const OH::Storage::Key& finish, const OH::Storage::ScanToken& token, uint32 max_keys, v8::Handle<v8::Function> cb, JSContextStruct* jscont);
 
     v8::Handle<v8::Value> setRestoreScript(JSContextStruct* jscont, const String& script, v8::Handle<v8::Function> cb);
 
@@ -347,6 +348,10 @@ protected:
     void storageCountCallback(JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
         OH::Storage::Result result, int32 count,Liveness::Token objAlive,Liveness::Token ctxAlive);
 
+    void storageScanCallback(JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
+        OH::Storage::Result result, OH::Storage::ReadSet* rs, const OH::Storage::ScanToken& next,
+        Liveness::Token objAlive,Liveness::Token ctxAlive);
+
     void iSetRestoreScriptCallback(
         JSContextStruct* jscont, v8::Persistent<v8::Function> cb, bool success,
         Liveness::Token,Liveness::Token ctxAlive);
@@ -413,6 +418,11 @@ protected:
         JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
         OH::Storage::Result result, int32 count,Liveness::Token objAlive,
         Liveness::Token ctxAlive);
+    void iStorageScanCallback(
+        JSContextStruct* jscont, v8::Persistent<v8::Function> cb,
+        OH::Storage::Result result, OH::Storage::ReadSet* rs,
+        const OH::Storage::ScanToken& next, Liveness::Token objAlive,
+        Liveness::Token ctxAlive);
     void eStorageErase(
         const OH::Storage::Key& key, v8::Persistent<v8::Function> cb,
         JSContextStruct* jscont,Liveness::Token objAlive,
@@ -441,6 +451,12 @@ protected:
         v8::Persistent<v8::Function> cb, JSContextStruct* jscont,
         Liveness::Token objAlive,Liveness::Token ctxAlive);
 
+    void eStorageRangeScan(
+        const OH::Storage::Key& start, const OH::Storage::Key& finish,
+        const OH::Storage::ScanToken& token, uint32 max_keys,
+        v8::Persistent<v8::Function> cb, JSContextStruct* jscont,
+        Liveness::Token objAlive,Liveness::Token ctxAlive);
+
     void eSetRestoreScript(
         JSContextStruct* jscont, const String& script,
         v8::Persistent<v8::Function> cb, Liveness::Token objAlive,
@@ -82,7 +82,10 @@ JSObjectScriptManager::JSObjectScriptManager(ObjectHostContext* ctx, const Sirik
    mParsingWork(NULL),
    mParsingThread(NULL),
    mModelParser(NULL),
-   mModelFilter(NULL)
+   mModelFilter(NULL),
+   mCompileCache(NULL),
+   mIsolatePool(NULL),
+   mIsolatePoolSize(0)
 {
     // In emheadless we run without an ObjectHostContext
     if (mContext != NULL) {
@@ -114,6 +117,8 @@ JSObjectScriptManager::JSObjectScriptManager(ObjectHostContext* ctx, const Sirik
     OptionValue* import_paths;
     OptionValue* v8_flags_opt;
     OptionValue* emer_resource_max;
+    OptionValue* compile_cache_size;
+    OptionValue* isolates;
     InitializeClassOptions(
         "jsobjectscriptmanager",this,
         // Default value allows us to use std libs in the build tree, starting
@@ -133,6 +138,8 @@ JSObjectScriptManager::JSObjectScriptManager(ObjectHostContext* ctx, const Sirik
         import_paths = new OptionValue("import-paths","",OptionValueType<std::list<String> >(),"Comma separated list of paths to import files from, searched in order for the requested import."),
         v8_flags_opt = new OptionValue("v8-flags", "", OptionValueType<String>(), "Flags to pass on to v8, e.g. for profiling."),
         emer_resource_max = new OptionValue("emer-resource-max","100000000",OptionValueType<int>(),"int32: how many cycles to allow to run in one pass of event loop before throwing resource error in Emerson."),
+        compile_cache_size = new OptionValue("compile-cache-size","1024",OptionValueType<uint32>(),"Number of Emerson to JavaScript translations to keep in memory and share between scripts. 0 disables the cache."),
+        isolates = new OptionValue("isolates","0",OptionValueType<uint32>(),"Number of V8 isolates to spread scripts across. Each isolate can host many scripts. 0 uses one per hardware thread."),
         NULL
     );
 
@@ -143,254 +150,266 @@ JSObjectScriptManager::JSObjectScriptManager(ObjectHostContext* ctx, const Sirik
     if (!v8_flags.empty()) {
         v8::V8::SetFlagsFromString(v8_flags.c_str(), v8_flags.size());
     }
+
+    mCompileCache = new EmersonCompileCache(compile_cache_size->as<uint32>());
+    mIsolatePoolSize = isolates->as<uint32>();
 }
 
 /*
   EMERSON!: util
  */
 
-void JSObjectScriptManager::createUtilTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createUtilTemplate(JSIsolate* iso)
 {
 
     v8::HandleScope handle_scope;
-    jsctx->mUtilTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+    iso->mUtilTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
 
     // An internal field holds the JSObjectScript*
-    jsctx->mUtilTemplate->SetInternalFieldCount(UTIL_TEMPLATE_FIELD_COUNT);
-
-    jsctx->mUtilTemplate->Set(JS_STRING(sqrt),v8::FunctionTemplate::New(JSUtilObj::ScriptSqrtFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(acos),v8::FunctionTemplate::New(JSUtilObj::ScriptAcosFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(asin),v8::FunctionTemplate::New(JSUtilObj::ScriptAsinFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(cos),v8::FunctionTemplate::New(JSUtilObj::ScriptCosFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(sin),v8::FunctionTemplate::New(JSUtilObj::ScriptSinFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(rand),v8::FunctionTemplate::New(JSUtilObj::ScriptRandFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(pow),v8::FunctionTemplate::New(JSUtilObj::ScriptPowFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(exp),v8::FunctionTemplate::New(JSUtilObj::ScriptExpFunction));
-    jsctx->mUtilTemplate->Set(JS_STRING(abs),v8::FunctionTemplate::New(JSUtilObj::ScriptAbsFunction));
-
-    jsctx->mUtilTemplate->Set(v8::String::New("plus"), v8::FunctionTemplate::New(JSUtilObj::ScriptPlus));
-    jsctx->mUtilTemplate->Set(v8::String::New("sub"), v8::FunctionTemplate::New(JSUtilObj::ScriptMinus));
-    jsctx->mUtilTemplate->Set(v8::String::New("identifier"),v8::FunctionTemplate::New(JSUtilObj::ScriptSporef));
-
-    jsctx->mUtilTemplate->Set(v8::String::New("div"),v8::FunctionTemplate::New(JSUtilObj::ScriptDiv));
-    jsctx->mUtilTemplate->Set(v8::String::New("mul"),v8::FunctionTemplate::New(JSUtilObj::ScriptMult));
-    jsctx->mUtilTemplate->Set(v8::String::New("mod"),v8::FunctionTemplate::New(JSUtilObj::ScriptMod));
-    jsctx->mUtilTemplate->Set(v8::String::New("equal"),v8::FunctionTemplate::New(JSUtilObj::ScriptEqual));
-    jsctx->mUtilTemplate->Set(v8::String::New("Quaternion"), jsctx->mQuaternionTemplate);
-    jsctx->mUtilTemplate->Set(v8::String::New("Vec3"), jsctx->mVec3Template);
-
-    jsctx->mUtilTemplate->Set(v8::String::New("_base64Encode"), v8::FunctionTemplate::New(JSUtilObj::Base64Encode));
-    jsctx->mUtilTemplate->Set(v8::String::New("_base64EncodeURL"), v8::FunctionTemplate::New(JSUtilObj::Base64EncodeURL));
-    jsctx->mUtilTemplate->Set(v8::String::New("_base64Decode"), v8::FunctionTemplate::New(JSUtilObj::Base64Decode));
-    jsctx->mUtilTemplate->Set(v8::String::New("_base64DecodeURL"), v8::FunctionTemplate::New(JSUtilObj::Base64DecodeURL));
+    iso->mUtilTemplate->SetInternalFieldCount(UTIL_TEMPLATE_FIELD_COUNT);
+
+    iso->mUtilTemplate->Set(JS_STRING(sqrt),v8::FunctionTemplate::New(JSUtilObj::ScriptSqrtFunction));
+    iso->mUtilTemplate->Set(JS_STRING(acos),v8::FunctionTemplate::New(JSUtilObj::ScriptAcosFunction));
+    iso->mUtilTemplate->Set(JS_STRING(asin),v8::FunctionTemplate::New(JSUtilObj::ScriptAsinFunction));
+    iso->mUtilTemplate->Set(JS_STRING(cos),v8::FunctionTemplate::New(JSUtilObj::ScriptCosFunction));
+    iso->mUtilTemplate->Set(JS_STRING(sin),v8::FunctionTemplate::New(JSUtilObj::ScriptSinFunction));
+    iso->mUtilTemplate->Set(JS_STRING(rand),v8::FunctionTemplate::New(JSUtilObj::ScriptRandFunction));
+    iso->mUtilTemplate->Set(JS_STRING(pow),v8::FunctionTemplate::New(JSUtilObj::ScriptPowFunction));
+    iso->mUtilTemplate->Set(JS_STRING(exp),v8::FunctionTemplate::New(JSUtilObj::ScriptExpFunction));
+    iso->mUtilTemplate->Set(JS_STRING(abs),v8::FunctionTemplate::New(JSUtilObj::ScriptAbsFunction));
+
+    iso->mUtilTemplate->Set(v8::String::New("plus"), v8::FunctionTemplate::New(JSUtilObj::ScriptPlus));
+    iso->mUtilTemplate->Set(v8::String::New("sub"), v8::FunctionTemplate::New(JSUtilObj::ScriptMinus));
+    iso->mUtilTemplate->Set(v8::String::New("identifier"),v8::FunctionTemplate::New(JSUtilObj::ScriptSporef));
+
+    iso->mUtilTemplate->Set(v8::String::New("div"),v8::FunctionTemplate::New(JSUtilObj::ScriptDiv));
+    iso->mUtilTemplate->Set(v8::String::New("mul"),v8::FunctionTemplate::New(JSUtilObj::ScriptMult));
+    iso->mUtilTemplate->Set(v8::String::New("mod"),v8::FunctionTemplate::New(JSUtilObj::ScriptMod));
+    iso->mUtilTemplate->Set(v8::String::New("equal"),v8::FunctionTemplate::New(JSUtilObj::ScriptEqual));
+    iso->mUtilTemplate->Set(v8::String::New("Quaternion"), iso->mQuaternionTemplate);
+    iso->mUtilTemplate->Set(v8::String::New("Vec3"), iso->mVec3Template);
+
+    iso->mUtilTemplate->Set(v8::String::New("_base64Encode"), v8::FunctionTemplate::New(JSUtilObj::Base64Encode));
+    iso->mUtilTemplate->Set(v8::String::New("_base64EncodeURL"), v8::FunctionTemplate::New(JSUtilObj::Base64EncodeURL));
+    iso->mUtilTemplate->Set(v8::String::New("_base64Decode"), v8::FunctionTemplate::New(JSUtilObj::Base64Decode));
+    iso->mUtilTemplate->Set(v8::String::New("_base64DecodeURL"), v8::FunctionTemplate::New(JSUtilObj::Base64DecodeURL));
 }
 
 
 
 //these templates involve vec, quat, pattern, etc.
-JSCtx* JSObjectScriptManager::createJSCtx(HostedObjectPtr ho)
+void JSObjectScriptManager::createTemplates(JSIsolate* iso)
 {
-    JSCtx* jsctx =
-        new JSCtx(mContext,
-            Network::IOStrandPtr(
-                mContext->ioService->createStrand("EmersonScript " + ho->id().toString())),
-            Network::IOStrandPtr(
-                mContext->ioService->createStrand("VisManager "    + ho->id().toString())),
-            v8::Isolate::New());
-
-    v8::Locker locker (jsctx->mIsolate);
-    v8::Isolate::Scope iscope(jsctx->mIsolate);
+    v8::Locker locker (iso->mIsolate);
+    v8::Isolate::Scope iscope(iso->mIsolate);
     v8::HandleScope handle_scope;
-    jsctx->mVec3Template = v8::Persistent<v8::FunctionTemplate>::New(CreateVec3Template());
-    jsctx->mQuaternionTemplate  = v8::Persistent<v8::FunctionTemplate>::New(CreateQuaternionTemplate());
-
-    createUtilTemplate(jsctx);
-    createVisibleTemplate(jsctx);
-    createTimerTemplate(jsctx);
-    createJSInvokableObjectTemplate(jsctx);
-    createPresenceTemplate(jsctx);
-    createSystemTemplate(jsctx);
-    createContextTemplate(jsctx);
-    createContextGlobalTemplate(jsctx);
-
-    return jsctx;
+    iso->mVec3Template = v8::Persistent<v8::FunctionTemplate>::New(CreateVec3Template());
+    iso->mQuaternionTemplate  = v8::Persistent<v8::FunctionTemplate>::New(CreateQuaternionTemplate());
+
+    createUtilTemplate(iso);
+    createVisibleTemplate(iso);
+    createTimerTemplate(iso);
+    createJSInvokableObjectTemplate(iso);
+    createPresenceTemplate(iso);
+    createSystemTemplate(iso);
+    createContextTemplate(iso);
+    createContextGlobalTemplate(iso);
+
+    iso->templatesInitialized = true;
 }
 
+JSCtx* JSObjectScriptManager::createJSCtx(HostedObjectPtr ho)
+{
+    // Scripts share isolates, and the templates built for them, so the pool
+    // is only created and filled in as scripts need it.
+    boost::mutex::scoped_lock lock(mIsolatePoolMutex);
+    if (mIsolatePool == NULL)
+        mIsolatePool = new JSIsolatePool(mContext, mIsolatePoolSize);
 
+    JSIsolate* iso = mIsolatePool->acquire();
+    if (!iso->templatesInitialized)
+        createTemplates(iso);
 
-void JSObjectScriptManager::createTimerTemplate(JSCtx* jsctx)
+    return new JSCtx(mContext, mIsolatePool, iso);
+}
+
+
+
+void JSObjectScriptManager::createTimerTemplate(JSIsolate* iso)
 {
     v8::HandleScope handle_scope;
-    jsctx->mTimerTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
-    jsctx->mTimerTemplate->SetInternalFieldCount(TIMER_JSTIMER_TEMPLATE_FIELD_COUNT);
-
-    jsctx->mTimerTemplate->Set(v8::String::New("resetTimer"),v8::FunctionTemplate::New(JSTimer::resetTimer));
-    jsctx->mTimerTemplate->Set(v8::String::New("clear"),v8::FunctionTemplate::New(JSTimer::clear));
-    jsctx->mTimerTemplate->Set(v8::String::New("suspend"),v8::FunctionTemplate::New(JSTimer::suspend));
-    jsctx->mTimerTemplate->Set(v8::String::New("reset"),v8::FunctionTemplate::New(JSTimer::resume));
-    jsctx->mTimerTemplate->Set(v8::String::New("isSuspended"),v8::FunctionTemplate::New(JSTimer::isSuspended));
-    jsctx->mTimerTemplate->Set(v8::String::New("getAllData"), v8::FunctionTemplate::New(JSTimer::getAllData));
-    jsctx->mTimerTemplate->Set(v8::String::New("__getType"),v8::FunctionTemplate::New(JSTimer::getType));
+    iso->mTimerTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+    iso->mTimerTemplate->SetInternalFieldCount(TIMER_JSTIMER_TEMPLATE_FIELD_COUNT);
+
+    iso->mTimerTemplate->Set(v8::String::New("resetTimer"),v8::FunctionTemplate::New(JSTimer::resetTimer));
+    iso->mTimerTemplate->Set(v8::String::New("clear"),v8::FunctionTemplate::New(JSTimer::clear));
+    iso->mTimerTemplate->Set(v8::String::New("suspend"),v8::FunctionTemplate::New(JSTimer::suspend));
+    iso->mTimerTemplate->Set(v8::String::New("reset"),v8::FunctionTemplate::New(JSTimer::resume));
+    iso->mTimerTemplate->Set(v8::String::New("isSuspended"),v8::FunctionTemplate::New(JSTimer::isSuspended));
+    iso->mTimerTemplate->Set(v8::String::New("getAllData"), v8::FunctionTemplate::New(JSTimer::getAllData));
+    iso->mTimerTemplate->Set(v8::String::New("__getType"),v8::FunctionTemplate::New(JSTimer::getType));
 }
 
 
 
-void JSObjectScriptManager::createSystemTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createSystemTemplate(JSIsolate* iso)
 {
     v8::HandleScope handle_scope;
-    jsctx->mSystemTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+    iso->mSystemTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
 
-    jsctx->mSystemTemplate->SetInternalFieldCount(SYSTEM_TEMPLATE_FIELD_COUNT);
+    iso->mSystemTemplate->SetInternalFieldCount(SYSTEM_TEMPLATE_FIELD_COUNT);
 
-    jsctx->mSystemTemplate->Set(v8::String::New("registerProxAddedHandler"),v8::FunctionTemplate::New(JSSystem::root_proxAddedHandler));
-    jsctx->mSystemTemplate->Set(v8::String::New("registerProxRemovedHandler"),v8::FunctionTemplate::New(JSSystem::root_proxRemovedHandler));
+    iso->mSystemTemplate->Set(v8::String::New("registerProxAddedHandler"),v8::FunctionTemplate::New(JSSystem::root_proxAddedHandler));
+    iso->mSystemTemplate->Set(v8::String::New("registerProxRemovedHandler"),v8::FunctionTemplate::New(JSSystem::root_proxRemovedHandler));
 
 
-    jsctx->mSystemTemplate->Set(v8::String::New("headless"),v8::FunctionTemplate::New(JSSystem::root_headless));
-    jsctx->mSystemTemplate->Set(v8::String::New("__debugFileWrite"),v8::FunctionTemplate::New(JSSystem::debug_fileWrite));
-    jsctx->mSystemTemplate->Set(v8::String::New("__debugFileRead"),v8::FunctionTemplate::New(JSSystem::debug_fileRead));
-    jsctx->mSystemTemplate->Set(v8::String::New("sendHome"),v8::FunctionTemplate::New(JSSystem::root_sendHome));
-    jsctx->mSystemTemplate->Set(v8::String::New("event"), v8::FunctionTemplate::New(JSSystem::root_event));
-    jsctx->mSystemTemplate->Set(v8::String::New("timeout"), v8::FunctionTemplate::New(JSSystem::root_timeout));
-    jsctx->mSystemTemplate->Set(v8::String::New("print"), v8::FunctionTemplate::New(JSSystem::root_print));
+    iso->mSystemTemplate->Set(v8::String::New("headless"),v8::FunctionTemplate::New(JSSystem::root_headless));
+    iso->mSystemTemplate->Set(v8::String::New("__debugFileWrite"),v8::FunctionTemplate::New(JSSystem::debug_fileWrite));
+    iso->mSystemTemplate->Set(v8::String::New("__debugFileRead"),v8::FunctionTemplate::New(JSSystem::debug_fileRead));
+    iso->mSystemTemplate->Set(v8::String::New("sendHome"),v8::FunctionTemplate::New(JSSystem::root_sendHome));
+    iso->mSystemTemplate->Set(v8::String::New("event"), v8::FunctionTemplate::New(JSSystem::root_event));
+    iso->mSystemTemplate->Set(v8::String::New("timeout"), v8::FunctionTemplate::New(JSSystem::root_timeout));
+    iso->mSystemTemplate->Set(v8::String::New("print"), v8::FunctionTemplate::New(JSSystem::root_print));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("getAssociatedPresence"), v8::FunctionTemplate::New(JSSystem::getAssociatedPresence));
+    iso->mSystemTemplate->Set(v8::String::New("getAssociatedPresence"), v8::FunctionTemplate::New(JSSystem::getAssociatedPresence));
 
 
-    jsctx->mSystemTemplate->Set(v8::String::New("__evalInGlobal"), v8::FunctionTemplate::New(JSSystem::evalInGlobal));
-    jsctx->mSystemTemplate->Set(v8::String::New("sendSandbox"), v8::FunctionTemplate::New(JSSystem::root_sendSandbox));
+    iso->mSystemTemplate->Set(v8::String::New("__evalInGlobal"), v8::FunctionTemplate::New(JSSystem::evalInGlobal));
+    iso->mSystemTemplate->Set(v8::String::New("sendSandbox"), v8::FunctionTemplate::New(JSSystem::root_sendSandbox));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("js_import"), v8::FunctionTemplate::New(JSSystem::root_jsimport));
-    jsctx->mSystemTemplate->Set(v8::String::New("js_require"), v8::FunctionTemplate::New(JSSystem::root_jsrequire));
+    iso->mSystemTemplate->Set(v8::String::New("js_import"), v8::FunctionTemplate::New(JSSystem::root_jsimport));
+    iso->mSystemTemplate->Set(v8::String::New("js_require"), v8::FunctionTemplate::New(JSSystem::root_jsrequire));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("sendMessage"), v8::FunctionTemplate::New(JSSystem::sendMessageReliable));
-    jsctx->mSystemTemplate->Set(v8::String::New("sendMessageUnreliable"),v8::FunctionTemplate::New(JSSystem::sendMessageUnreliable));
+    iso->mSystemTemplate->Set(v8::String::New("sendMessage"), v8::FunctionTemplate::New(JSSystem::sendMessageReliable));
+    iso->mSystemTemplate->Set(v8::String::New("sendMessageUnreliable"),v8::FunctionTemplate::New(JSSystem::sendMessageUnreliable));
+    iso->mSystemTemplate->Set(v8::String::New("sendQueueDepth"),v8::FunctionTemplate::New(JSSystem::sendQueueDepth));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("import"), v8::FunctionTemplate::New(JSSystem::root_import));
+    iso->mSystemTemplate->Set(v8::String::New("import"), v8::FunctionTemplate::New(JSSystem::root_import));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("http"), v8::FunctionTemplate::New(JSSystem::root_http));
+    iso->mSystemTemplate->Set(v8::String::New("http"), v8::FunctionTemplate::New(JSSystem::root_http));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("storageBeginTransaction"),v8::FunctionTemplate::New(JSSystem::storageBeginTransaction));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageCommit"),v8::FunctionTemplate::New(JSSystem::storageCommit));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageErase"), v8::FunctionTemplate::New(JSSystem::storageErase));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageWrite"),v8::FunctionTemplate::New(JSSystem::storageWrite));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageRead"),v8::FunctionTemplate::New(JSSystem::storageRead));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageRangeRead"),v8::FunctionTemplate::New(JSSystem::storageRangeRead));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageRangeErase"),v8::FunctionTemplate::New(JSSystem::storageRangeErase));
-    jsctx->mSystemTemplate->Set(v8::String::New("storageCount"),v8::FunctionTemplate::New(JSSystem::storageCount));
+    iso->mSystemTemplate->Set(v8::String::New("storageBeginTransaction"),v8::FunctionTemplate::New(JSSystem::storageBeginTransaction));
+    iso->mSystemTemplate->Set(v8::String::New("storageCommit"),v8::FunctionTemplate::New(JSSystem::storageCommit));
+    iso->mSystemTemplate->Set(v8::String::New("storageErase"), v8::FunctionTemplate::New(JSSystem::storageErase));
+    iso->mSystemTemplate->Set(v8::String::New("storageWrite"),v8::FunctionTemplate::New(JSSystem::storageWrite));
+    iso->mSystemTemplate->Set(v8::String::New("storageRead"),v8::FunctionTemplate::New(JSSystem::storageRead));
+    iso->mSystemTemplate->Set(v8::String::New("storageRangeRead"),v8::FunctionTemplate::New(JSSystem::storageRangeRead));
+    iso->mSystemTemplate->Set(v8::String::New("storageRangeErase"),v8::FunctionTemplate::New(JSSystem::storageRangeErase));
+    iso->mSystemTemplate->Set(v8::String::New("storageCount"),v8::FunctionTemplate::New(JSSystem::storageCount));
+    iso->mSystemTemplate->Set(v8::String::New("storageRangeScan"),v8::FunctionTemplate::New(JSSystem::storageRangeScan));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("setSandboxMessageCallback"),v8::FunctionTemplate::New(JSSystem::setSandboxMessageCallback));
-    jsctx->mSystemTemplate->Set(v8::String::New("setPresenceMessageCallback"),v8::FunctionTemplate::New(JSSystem::setPresenceMessageCallback));
+    iso->mSystemTemplate->Set(v8::String::New("setSandboxMessageCallback"),v8::FunctionTemplate::New(JSSystem::setSandboxMessageCallback));
+    iso->mSystemTemplate->Set(v8::String::New("setPresenceMessageCallback"),v8::FunctionTemplate::New(JSSystem::setPresenceMessageCallback));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("setRestoreScript"),v8::FunctionTemplate::New(JSSystem::setRestoreScript));
-    jsctx->mSystemTemplate->Set(v8::String::New("__emersonCompileString"), v8::FunctionTemplate::New(JSSystem::emersonCompileString));
+    iso->mSystemTemplate->Set(v8::String::New("setRestoreScript"),v8::FunctionTemplate::New(JSSystem::setRestoreScript));
+    iso->mSystemTemplate->Set(v8::String::New("__emersonCompileString"), v8::FunctionTemplate::New(JSSystem::emersonCompileString));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("__pushEvalContextScopeDirectory"),
+    iso->mSystemTemplate->Set(v8::String::New("__pushEvalContextScopeDirectory"),
         v8::FunctionTemplate::New(JSSystem::pushEvalContextScopeDirectory));
-    jsctx->mSystemTemplate->Set(v8::String::New("__popEvalContextScopeDirectory"),
+    iso->mSystemTemplate->Set(v8::String::New("__popEvalContextScopeDirectory"),
         v8::FunctionTemplate::New(JSSystem::popEvalContextScopeDirectory));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("getUniqueToken"),
+    iso->mSystemTemplate->Set(v8::String::New("getUniqueToken"),
         v8::FunctionTemplate::New(JSSystem::getUniqueToken));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("createVisible"),v8::FunctionTemplate::New(JSSystem::root_createVisible));
+    iso->mSystemTemplate->Set(v8::String::New("createVisible"),v8::FunctionTemplate::New(JSSystem::root_createVisible));
 
     //check what permissions fake root is loaded with
-    jsctx->mSystemTemplate->Set(v8::String::New("canSendMessage"), v8::FunctionTemplate::New(JSSystem::root_canSendMessage));
-    jsctx->mSystemTemplate->Set(v8::String::New("canRecvMessage"), v8::FunctionTemplate::New(JSSystem::root_canRecvMessage));
-    jsctx->mSystemTemplate->Set(v8::String::New("canProxCallback"), v8::FunctionTemplate::New(JSSystem::root_canProxCallback));
-    jsctx->mSystemTemplate->Set(v8::String::New("canProxChangeQuery"), v8::FunctionTemplate::New(JSSystem::root_canProxChangeQuery));
-    jsctx->mSystemTemplate->Set(v8::String::New("canImport"),v8::FunctionTemplate::New(JSSystem::root_canImport));
+    iso->mSystemTemplate->Set(v8::String::New("canSendMessage"), v8::FunctionTemplate::New(JSSystem::root_canSendMessage));
+    iso->mSystemTemplate->Set(v8::String::New("canRecvMessage"), v8::FunctionTemplate::New(JSSystem::root_canRecvMessage));
+    iso->mSystemTemplate->Set(v8::String::New("canProxCallback"), v8::FunctionTemplate::New(JSSystem::root_canProxCallback));
+    iso->mSystemTemplate->Set(v8::String::New("canProxChangeQuery"), v8::FunctionTemplate::New(JSSystem::root_canProxChangeQuery));
+    iso->mSystemTemplate->Set(v8::String::New("canImport"),v8::FunctionTemplate::New(JSSystem::root_canImport));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("canCreatePresence"), v8::FunctionTemplate::New(JSSystem::root_canCreatePres));
-    jsctx->mSystemTemplate->Set(v8::String::New("canCreateEntity"), v8::FunctionTemplate::New(JSSystem::root_canCreateEnt));
-    jsctx->mSystemTemplate->Set(v8::String::New("canEval"), v8::FunctionTemplate::New(JSSystem::root_canEval));
+    iso->mSystemTemplate->Set(v8::String::New("canCreatePresence"), v8::FunctionTemplate::New(JSSystem::root_canCreatePres));
+    iso->mSystemTemplate->Set(v8::String::New("canCreateEntity"), v8::FunctionTemplate::New(JSSystem::root_canCreateEnt));
+    iso->mSystemTemplate->Set(v8::String::New("canEval"), v8::FunctionTemplate::New(JSSystem::root_canEval));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("serialize"), v8::FunctionTemplate::New(JSSystem::root_serialize));
-    jsctx->mSystemTemplate->Set(v8::String::New("deserialize"), v8::FunctionTemplate::New(JSSystem::root_deserialize));
+    iso->mSystemTemplate->Set(v8::String::New("serialize"), v8::FunctionTemplate::New(JSSystem::root_serialize));
+    iso->mSystemTemplate->Set(v8::String::New("deserialize"), v8::FunctionTemplate::New(JSSystem::root_deserialize));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("restorePresence"), v8::FunctionTemplate::New(JSSystem::root_restorePresence));
+    iso->mSystemTemplate->Set(v8::String::New("restorePresence"), v8::FunctionTemplate::New(JSSystem::root_restorePresence));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("getVersion"),v8::FunctionTemplate::New(JSSystem::root_getVersion));
+    iso->mSystemTemplate->Set(v8::String::New("getVersion"),v8::FunctionTemplate::New(JSSystem::root_getVersion));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("killEntity"), v8::FunctionTemplate::New(JSSystem::root_killEntity));
+    iso->mSystemTemplate->Set(v8::String::New("killEntity"), v8::FunctionTemplate::New(JSSystem::root_killEntity));
 
     //this doesn't work now.
-    jsctx->mSystemTemplate->Set(v8::String::New("create_context"),v8::FunctionTemplate::New(JSSystem::root_createContext));
+    iso->mSystemTemplate->Set(v8::String::New("create_context"),v8::FunctionTemplate::New(JSSystem::root_createContext));
 
 
-    jsctx->mSystemTemplate->Set(v8::String::New("create_entity_no_space"), v8::FunctionTemplate::New(JSSystem::root_createEntityNoSpace));
+    iso->mSystemTemplate->Set(v8::String::New("create_entity_no_space"), v8::FunctionTemplate::New(JSSystem::root_createEntityNoSpace));
 
-    jsctx->mSystemTemplate->Set(v8::String::New("create_entity"), v8::FunctionTemplate::New(JSSystem::root_createEntity));
+    iso->mSystemTemplate->Set(v8::String::New("create_entity"), v8::FunctionTemplate::New(JSSystem::root_createEntity));
 
 
-    jsctx->mSystemTemplate->Set(v8::String::New("onPresenceConnected"),v8::FunctionTemplate::New(JSSystem::root_onPresenceConnected));
-    jsctx->mSystemTemplate->Set(v8::String::New("onPresenceDisconnected"),v8::FunctionTemplate::New(JSSystem::root_onPresenceDisconnected));
+    iso->mSystemTemplate->Set(v8::String::New("onPresenceConnected"),v8::FunctionTemplate::New(JSSystem::root_onPresenceConnected));
+    iso->mSystemTemplate->Set(v8::String::New("onPresenceDisconnected"),v8::FunctionTemplate::New(JSSystem::root_onPresenceDisconnected));
 
 
-    jsctx->mSystemTemplate->Set(JS_STRING(__presence_constructor__), jsctx->mPresenceTemplate);
-    jsctx->mSystemTemplate->Set(JS_STRING(__visible_constructor__), jsctx->mVisibleTemplate);
+    iso->mSystemTemplate->Set(JS_STRING(__presence_constructor__), iso->mPresenceTemplate);
+    iso->mSystemTemplate->Set(JS_STRING(__visible_constructor__), iso->mVisibleTemplate);
 
-    jsctx->mSystemTemplate->Set(v8::String::New("require"), v8::FunctionTemplate::New(JSSystem::root_require));
-    jsctx->mSystemTemplate->Set(v8::String::New("reset"),v8::FunctionTemplate::New(JSSystem::root_reset));
-    jsctx->mSystemTemplate->Set(v8::String::New("set_script"),v8::FunctionTemplate::New(JSSystem::root_setScript));
-    jsctx->mSystemTemplate->Set(v8::String::New("getScript"),v8::FunctionTemplate::New(JSSystem::root_getScript));
+    iso->mSystemTemplate->Set(v8::String::New("require"), v8::FunctionTemplate::New(JSSystem::root_require));
+    iso->mSystemTemplate->Set(v8::String::New("reset"),v8::FunctionTemplate::New(JSSystem::root_reset));
+    iso->mSystemTemplate->Set(v8::String::New("set_script"),v8::FunctionTemplate::New(JSSystem::root_setScript));
+    iso->mSystemTemplate->Set(v8::String::New("getScript"),v8::FunctionTemplate::New(JSSystem::root_getScript));
 
 }
 
 
-void JSObjectScriptManager::createContextTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createContextTemplate(JSIsolate* iso)
 {
     v8::HandleScope handle_scope;
     // And we expose some functionality directly
-    jsctx->mContextTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+    iso->mContextTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
 
     // An internal field holds the JSObjectScript*
-    jsctx->mContextTemplate->SetInternalFieldCount(CONTEXT_TEMPLATE_FIELD_COUNT);
+    iso->mContextTemplate->SetInternalFieldCount(CONTEXT_TEMPLATE_FIELD_COUNT);
 
     // Functions / types
     //suspend,kill,resume,execute
-    jsctx->mContextTemplate->Set(v8::String::New("execute"), v8::FunctionTemplate::New(JSContext::ScriptExecute));
-    jsctx->mContextTemplate->Set(v8::String::New("suspend"), v8::FunctionTemplate::New(JSContext::ScriptSuspend));
-    jsctx->mContextTemplate->Set(v8::String::New("resume"), v8::FunctionTemplate::New(JSContext::ScriptResume));
-    jsctx->mContextTemplate->Set(v8::String::New("clear"), v8::FunctionTemplate::New(JSContext::ScriptClear));
+    iso->mContextTemplate->Set(v8::String::New("execute"), v8::FunctionTemplate::New(JSContext::ScriptExecute));
+    iso->mContextTemplate->Set(v8::String::New("suspend"), v8::FunctionTemplate::New(JSContext::ScriptSuspend));
+    iso->mContextTemplate->Set(v8::String::New("resume"), v8::FunctionTemplate::New(JSContext::ScriptResume));
+    iso->mContextTemplate->Set(v8::String::New("clear"), v8::FunctionTemplate::New(JSContext::ScriptClear));
 
 }
 
 
-void JSObjectScriptManager::createContextGlobalTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createContextGlobalTemplate(JSIsolate* iso)
 {
     v8::HandleScope handle_scope;
     // And we expose some functionality directly
-    jsctx->mContextGlobalTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
-    jsctx->mContextGlobalTemplate->SetInternalFieldCount(CONTEXT_GLOBAL_TEMPLATE_FIELD_COUNT);
+    iso->mContextGlobalTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+    iso->mContextGlobalTemplate->SetInternalFieldCount(CONTEXT_GLOBAL_TEMPLATE_FIELD_COUNT);
 
-    jsctx->mContextGlobalTemplate->Set(v8::String::New(JSSystemNames::SYSTEM_OBJECT_NAME),jsctx->mSystemTemplate);
-    jsctx->mContextGlobalTemplate->Set(v8::String::New(JSSystemNames::UTIL_OBJECT_NAME), jsctx->mUtilTemplate);
+    iso->mContextGlobalTemplate->Set(v8::String::New(JSSystemNames::SYSTEM_OBJECT_NAME),iso->mSystemTemplate);
+    iso->mContextGlobalTemplate->Set(v8::String::New(JSSystemNames::UTIL_OBJECT_NAME), iso->mUtilTemplate);
 
-    jsctx->mContextGlobalTemplate->Set(v8::String::New("__checkResources8_8_3_1__"), v8::FunctionTemplate::New(JSGlobal::checkResources));
+    iso->mContextGlobalTemplate->Set(v8::String::New("__checkResources8_8_3_1__"), v8::FunctionTemplate::New(JSGlobal::checkResources));
 }
 
 
 
-void JSObjectScriptManager::createJSInvokableObjectTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createJSInvokableObjectTemplate(JSIsolate* iso)
 {
   v8::HandleScope handle_scope;
 
-  jsctx->mInvokableObjectTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
-  jsctx->mInvokableObjectTemplate->SetInternalFieldCount(JSSIMOBJECT_TEMPLATE_FIELD_COUNT);
-  jsctx->mInvokableObjectTemplate->Set(v8::String::New("invoke"), v8::FunctionTemplate::New(JSInvokableObject::invoke));
+  iso->mInvokableObjectTemplate = v8::Persistent<v8::ObjectTemplate>::New(v8::ObjectTemplate::New());
+  iso->mInvokableObjectTemplate->SetInternalFieldCount(JSSIMOBJECT_TEMPLATE_FIELD_COUNT);
+  iso->mInvokableObjectTemplate->Set(v8::String::New("invoke"), v8::FunctionTemplate::New(JSInvokableObject::invoke));
 }
 
 
 
-void JSObjectScriptManager::createVisibleTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createVisibleTemplate(JSIsolate* iso)
 {
     v8::HandleScope handle_scope;
 
-    jsctx->mVisibleTemplate = v8::Persistent<v8::FunctionTemplate>::New(v8::FunctionTemplate::New());
+    iso->mVisibleTemplate = v8::Persistent<v8::FunctionTemplate>::New(v8::FunctionTemplate::New());
 
-    v8::Local<v8::Template> proto_t = jsctx->mVisibleTemplate->PrototypeTemplate();
+    v8::Local<v8::Template> proto_t = iso->mVisibleTemplate->PrototypeTemplate();
     //these function calls are defined in JSObjects/JSVisible.hpp
 
     proto_t->Set(v8::String::New("__debugRef"),v8::FunctionTemplate::New(JSVisible::__debugRef));
@@ -424,20 +443,20 @@ void JSObjectScriptManager::createVisibleTemplate(JSCtx* jsctx)
 
 
     // For instance templates
-    v8::Local<v8::ObjectTemplate> instance_t = jsctx->mVisibleTemplate->InstanceTemplate();
+    v8::Local<v8::ObjectTemplate> instance_t = iso->mVisibleTemplate->InstanceTemplate();
     instance_t->SetInternalFieldCount(VISIBLE_FIELD_COUNT);
 
 }
 
 
-void JSObjectScriptManager::createPresenceTemplate(JSCtx* jsctx)
+void JSObjectScriptManager::createPresenceTemplate(JSIsolate* iso)
 {
   v8::HandleScope handle_scope;
 
-  jsctx->mPresenceTemplate = v8::Persistent<v8::FunctionTemplate>::New(v8::FunctionTemplate::New());
+  iso->mPresenceTemplate = v8::Persistent<v8::FunctionTemplate>::New(v8::FunctionTemplate::New());
   //mPresenceTemplate->SetInternalFieldCount(PRESENCE_FIELD_COUNT);
 
-  v8::Local<v8::Template> proto_t = jsctx->mPresenceTemplate->PrototypeTemplate();
+  v8::Local<v8::Template> proto_t = iso->mPresenceTemplate->PrototypeTemplate();
 
   //These are not just accessors because we need to ensure that we can deal with
   //their failure conditions.  (Have callbacks).
@@ -508,7 +527,7 @@ void JSObjectScriptManager::createPresenceTemplate(JSCtx* jsctx)
   proto_t->Set(v8::String::New("getAnimationList"),v8::FunctionTemplate::New(JSPresence::getAnimationList));
 
   // For instance templates
-  v8::Local<v8::ObjectTemplate> instance_t = jsctx->mPresenceTemplate->InstanceTemplate();
+  v8::Local<v8::ObjectTemplate> instance_t = iso->mPresenceTemplate->InstanceTemplate();
   instance_t->SetInternalFieldCount(PRESENCE_FIELD_COUNT);
 }
 
@@ -603,6 +622,11 @@ JSObjectScriptManager::~JSObjectScriptManager()
         delete mModelFilter;
         delete mModelParser;
     }
+
+    JSLOG(detailed, "Emerson compile cache: " << mCompileCache->size() << " entries, " << mCompileCache->hits() << " hits, " << mCompileCache->misses() << " misses");
+    delete mCompileCache;
+    // All the scripts must have been destroyed by now
+    delete mIsolatePool;
 }
 
 
@@ -41,6 +41,8 @@
 #include <sirikata/mesh/ModelsSystem.hpp>
 #include <sirikata/mesh/Filter.hpp>
 #include <sirikata/mesh/Visual.hpp>
+#include "EmersonCompileCache.hpp"
+#include "JSIsolatePool.hpp"
 
 #include <v8.h>
 
@@ -66,6 +68,9 @@ public:
 
     OptionSet* getOptions() const { return mOptions; }
 
+    /// Translations of Emerson to JavaScript shared by all scripts
+    EmersonCompileCache* compileCache() const { return mCompileCache; }
+
 
 
 
@@ -76,14 +81,15 @@ public:
 private:
     ObjectHostContext* mContext;
     
-    void createVisibleTemplate(JSCtx*);
-    void createPresenceTemplate(JSCtx*);
-    void createContextTemplate(JSCtx*);
-    void createUtilTemplate(JSCtx*);
-    void createJSInvokableObjectTemplate(JSCtx*);
-    void createSystemTemplate(JSCtx*);
-    void createTimerTemplate(JSCtx*);
-    void createContextGlobalTemplate(JSCtx*);
+    void createVisibleTemplate(JSIsolate*);
+    void createPresenceTemplate(JSIsolate*);
+    void createContextTemplate(JSIsolate*);
+    void createUtilTemplate(JSIsolate*);
+    void createJSInvokableObjectTemplate(JSIsolate*);
+    void createSystemTemplate(JSIsolate*);
+    void createTimerTemplate(JSIsolate*);
+    void createContextGlobalTemplate(JSIsolate*);
+    void createTemplates(JSIsolate*);
     JSCtx* createJSCtx(HostedObjectPtr);
 
 
@@ -114,6 +120,14 @@ private:
     ModelsSystem* mModelParser;
     Mesh::Filter* mModelFilter;
 
+    EmersonCompileCache* mCompileCache;
+
+    // Scripts are spread across a fixed set of isolates instead of each
+    // getting its own
+    boost::mutex mIsolatePoolMutex;
+    JSIsolatePool* mIsolatePool;
+    uint32 mIsolatePoolSize;
+
     void meshDownloaded(Transfer::ResourceDownloadTaskPtr taskptr, Transfer::TransferRequestPtr request, Transfer::DenseDataPtr data);
     void parseMeshWork(const Transfer::RemoteFileMetadata& metadata, const Transfer::Fingerprint& fp, Transfer::DenseDataPtr data);
     void meshParsed();
@@ -261,6 +261,11 @@ v8::Handle<v8::Value> JSContextStruct::storageCount(const OH::Storage::Key& star
     return jsObjScript->storageCount(start,finish,cb,this);
 }
 
+v8::Handle<v8::Value> JSContextStruct::storageRangeScan(const OH::Storage::Key& start, const OH::Storage::Key& finish, const OH::Storage::ScanToken& token, uint32 max_keys, v8::Handle<v8::Function> cb)
+{
+    return jsObjScript->storageRangeScan(start,finish,token,max_keys,cb,this);
+}
+
 
 v8::Handle<v8::Value> JSContextStruct::setRestoreScript(const String& key, v8::Handle<v8::Function> cb) {
     return jsObjScript->setRestoreScript(this, key, cb);
@@ -437,12 +442,20 @@ v8::Handle<v8::Value> JSContextStruct::setPresenceMessageCallback(v8::Persistent
 
 
 
-v8::Handle<v8::Value> JSContextStruct::sendMessageNoErrorHandler(JSPresenceStruct* jspres,const String& serialized_message,JSPositionListener* jspl,bool reliable)
+v8::Handle<v8::Value> JSContextStruct::sendMessageNoErrorHandler(JSPresenceStruct* jspres,v8::Local<v8::Value> msg,JSPositionListener* jspl,bool reliable)
 {
     CHECK_EMERSON_SCRIPT_ERROR(emerScript,sendMessage,jsObjScript);
 
     if (! emerScript->isStopped())
     {
+        //receivers that we haven't heard from yet may not understand the
+        //binary encoding.
+        String serialized_message;
+        if (emerScript->supportsBinaryMessages(jspl->getSporef()))
+            serialized_message = JSSerializer::serializeBinaryMessage(msg);
+        else
+            serialized_message = JSSerializer::serializeMessage(msg);
+
         if (reliable)
             emerScript->sendScriptCommMessageReliable(jspres->getSporef(),  jspl->getSporef(),serialized_message);
         else
@@ -452,6 +465,12 @@ v8::Handle<v8::Value> JSContextStruct::sendMessageNoErrorHandler(JSPresenceStruc
     return v8::Undefined();
 }
 
+v8::Handle<v8::Value> JSContextStruct::struct_sendQueueDepth(JSPresenceStruct* jspres,JSPositionListener* jspl)
+{
+    CHECK_EMERSON_SCRIPT_ERROR(emerScript,sendQueueDepth,jsObjScript);
+    return v8::Integer::NewFromUnsigned(emerScript->sendQueueDepth(jspres->getSporef(), jspl->getSporef()));
+}
+
 
 //string argument is the filename that we're trying to open and execute
 //contents of.
@@ -492,6 +511,14 @@ v8::Handle<v8::Value> JSContextStruct::deserialize(const String& toDeserialize)
     v8::HandleScope handle_scope;
     CHECK_EMERSON_SCRIPT_ERROR(emerScript,deserialize,jsObjScript);
 
+    if (JSSerializer::isBinaryMessage(toDeserialize))
+    {
+        bool deserializedSuccess = false;
+        v8::Handle<v8::Value> returner = JSSerializer::deserializeBinaryMessage(emerScript, toDeserialize, deserializedSuccess);
+        if (!deserializedSuccess)
+            return v8::ThrowException( v8::Exception::Error(v8::String::New("Error could not deserialize object")));
+        return handle_scope.Close(returner);
+    }
 
     Sirikata::JS::Protocol::JSMessage js_msg;
     bool parsed = js_msg.ParseFromString(toDeserialize);
@@ -106,6 +106,7 @@ struct JSContextStruct : public JSSuspendable, public Liveness
     v8::Handle<v8::Value> storageRangeRead(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
     v8::Handle<v8::Value> storageRangeErase(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
     v8::Handle<v8::Value> storageCount(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
+    v8::Handle<v8::Value> storageRangeScan(const OH::Storage::Key& start, const OH::Storage::Key& finish, const OH::Storage::ScanToken& token, uint32 max_keys, v8::Handle<v8::Function> cb);
 
     /**
        @param {string} serialized message to send
@@ -203,7 +204,8 @@ struct JSContextStruct : public JSSuspendable, public Liveness
     v8::Handle<v8::Value> struct_createTimeout(double period,v8::Persistent<v8::Function>& cb, uint32 contID,double timeRemaining, bool isSuspended, bool isCleared);
 
 
-    v8::Handle<v8::Value> sendMessageNoErrorHandler(JSPresenceStruct* jspres,const String& serialized_message,JSPositionListener* jspl,bool reliable);
+    v8::Handle<v8::Value> sendMessageNoErrorHandler(JSPresenceStruct* jspres,v8::Local<v8::Value> msg,JSPositionListener* jspl,bool reliable);
+    v8::Handle<v8::Value> struct_sendQueueDepth(JSPresenceStruct* jspres,JSPositionListener* jspl);
 
 
     //register cb_persist as the default handler that gets thrown
@@ -86,6 +86,11 @@ v8::Handle<v8::Value> JSSystemStruct::storageCount(const OH::Storage::Key& start
     return associatedContext->storageCount(start, finish, cb);
 }
 
+v8::Handle<v8::Value> JSSystemStruct::storageRangeScan(const OH::Storage::Key& start, const OH::Storage::Key& finish, const OH::Storage::ScanToken& token, uint32 max_keys, v8::Handle<v8::Function> cb)
+{
+    return associatedContext->storageRangeScan(start, finish, token, max_keys, cb);
+}
+
 v8::Handle<v8::Value> JSSystemStruct::sendSandbox(const String& msgToSend, JSContextStruct* destination)
 {
     return associatedContext->sendSandbox(msgToSend,destination);
@@ -194,12 +199,17 @@ v8::Handle<v8::Value> JSSystemStruct::struct_canImport()
 }
 
 
-v8::Handle<v8::Value> JSSystemStruct::sendMessageNoErrorHandler(JSPresenceStruct* jspres, const String& serialized_message,JSPositionListener* jspl,bool reliable)
+v8::Handle<v8::Value> JSSystemStruct::sendMessageNoErrorHandler(JSPresenceStruct* jspres, v8::Local<v8::Value> msg,JSPositionListener* jspl,bool reliable)
 {
     if (! checkCurCtxtHasCapability(jspres, Capabilities::SEND_MESSAGE))
         V8_EXCEPTION_CSTR("Error.  You do not have the capability to send messages.");
 
-    return associatedContext->sendMessageNoErrorHandler(jspres,serialized_message,jspl,reliable);
+    return associatedContext->sendMessageNoErrorHandler(jspres,msg,jspl,reliable);
+}
+
+v8::Handle<v8::Value> JSSystemStruct::struct_sendQueueDepth(JSPresenceStruct* jspres, JSPositionListener* jspl)
+{
+    return associatedContext->struct_sendQueueDepth(jspres,jspl);
 }
 
 bool JSSystemStruct::checkCurCtxtHasCapability(JSPresenceStruct* jspres, Capabilities::Caps capRequesting)
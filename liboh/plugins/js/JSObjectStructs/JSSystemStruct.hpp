@@ -55,6 +55,7 @@ struct JSSystemStruct
     v8::Handle<v8::Value> storageRangeRead(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
     v8::Handle<v8::Value> storageRangeErase(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
     v8::Handle<v8::Value> storageCount(const OH::Storage::Key& start, const OH::Storage::Key& finish, v8::Handle<v8::Function> cb);
+    v8::Handle<v8::Value> storageRangeScan(const OH::Storage::Key& start, const OH::Storage::Key& finish, const OH::Storage::ScanToken& token, uint32 max_keys, v8::Handle<v8::Function> cb);
 
 
     v8::Handle<v8::Value> setRestoreScript(const String& key, v8::Handle<v8::Function> cb);
@@ -114,7 +115,8 @@ struct JSSystemStruct
     v8::Handle<v8::Value> struct_registerOnPresenceDisconnectedHandler(v8::Persistent<v8::Function> cb_persist);
 
     //last bool indicates whether to send message reliably or unreliably.
-    v8::Handle<v8::Value> sendMessageNoErrorHandler(JSPresenceStruct* jspres, const String& serialized_message,JSPositionListener* jspl,bool reliable);
+    v8::Handle<v8::Value> sendMessageNoErrorHandler(JSPresenceStruct* jspres, v8::Local<v8::Value> msg,JSPositionListener* jspl,bool reliable);
+    v8::Handle<v8::Value> struct_sendQueueDepth(JSPresenceStruct* jspres, JSPositionListener* jspl);
 
 
     v8::Handle<v8::Value> deserialize(const String& toDeserialize);
@@ -63,9 +63,6 @@ v8::Handle<v8::Value> sendMessage(const v8::Arguments&args, bool reliable)
     if (jspres == NULL)
         return v8::ThrowException( v8::Exception::Error(v8::String::New(errMsg.c_str())));
 
-    //convert the message value to send to a string.
-    std::string serialized_message = JSSerializer::serializeMessage(args[1]);
-
     //visible to send to
     v8::Handle<v8::Value> visToSendTo = args[2];
     //decode the visible struct associated with this object
@@ -85,7 +82,39 @@ v8::Handle<v8::Value> sendMessage(const v8::Arguments&args, bool reliable)
         return v8::ThrowException( v8::Exception::Error(v8::String::New(errorMessage.c_str())));
 
 
-    return jsfake->sendMessageNoErrorHandler(jspres,serialized_message,jspl,reliable);
+    //the message is serialized once we know what encoding the receiver
+    //understands.
+    return jsfake->sendMessageNoErrorHandler(jspres,args[1],jspl,reliable);
+}
+
+/**
+   @param {presence} Presence messages are sent from.
+   @param {visible} Visible messages are sent to.
+
+   @return Number of reliable messages from the presence to the visible that
+   are still waiting to be sent.
+ */
+v8::Handle<v8::Value> sendQueueDepth(const v8::Arguments& args)
+{
+    if (args.Length() != 2)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New("Error.  Requires 2 arguments.  <presence messages are sent from><visible they are sent to>")));
+
+    String errMsg = "Error decoding presence argument to sendQueueDepth.  ";
+    JSPresenceStruct* jspres = JSPresenceStruct::decodePresenceStruct(args[0],errMsg);
+    if (jspres == NULL)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New(errMsg.c_str())));
+
+    std::string errorMessage = "Error decoding visible argument to sendQueueDepth.  ";
+    JSPositionListener* jspl = decodeJSPosListener(args[1],errorMessage);
+    if (jspl == NULL)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New(errorMessage.c_str())));
+
+    errorMessage = "Error decoding system object in sendQueueDepth.  ";
+    JSSystemStruct* jsfake  = JSSystemStruct::decodeSystemStruct(args.This(), errorMessage);
+    if (jsfake == NULL)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New(errorMessage.c_str())));
+
+    return jsfake->struct_sendQueueDepth(jspres,jspl);
 }
 
 
@@ -212,8 +241,9 @@ v8::Handle<v8::Value> root_sendSandbox(const v8::Arguments& args)
     //get jssystemstruct
     INLINE_SYSTEM_CONV_ERROR(args.This(),sendSandbox,this,jssys);
 
-    //decode message.
-    String serializedMessage = JSSerializer::serializeMessage(args[0]);
+    //decode message.  Sandboxes all live in this script, so they understand
+    //the binary encoding.
+    String serializedMessage = JSSerializer::serializeBinaryMessage(args[0]);
 
 
     //recipeint == null implies send to parent (if it exists).
@@ -480,6 +510,36 @@ v8::Handle<v8::Value> storageCount(const v8::Arguments& args)
     return jsfake->storageCount(start, finish, cb);
 }
 
+v8::Handle<v8::Value> storageRangeScan(const v8::Arguments& args)
+{
+    if (args.Length() != 5)
+        return v8::ThrowException ( v8::Exception::Error(v8::String::New("Error calling storageRangeScan.  Require 5 arguments: a start key (string), a finish key (string), a continuation token (string or undefined), the maximum number of keys to return (uint32), and a callback")));
+
+    INLINE_STR_CONV_ERROR(args[0],storageRangeScan,1,start);
+    INLINE_STR_CONV_ERROR(args[1],storageRangeScan,2,finish);
+
+    String token;
+    if (!args[2]->IsUndefined() && !args[2]->IsNull()) {
+        INLINE_STR_CONV_ERROR(args[2],storageRangeScan,3,token_arg);
+        token = token_arg;
+    }
+
+    if (!args[3]->IsUint32() || args[3]->ToUint32()->Value() == 0)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New("Error calling storageRangeScan.  Maximum number of keys should be a positive uint32.")) );
+    uint32 max_keys = args[3]->ToUint32()->Value();
+
+    v8::Handle<v8::Function> cb = maybeDecodeCallbackArgument(args, 4);
+
+    //decode system object
+    String errorMessage = "Error decoding error message when storageRangeScanning";
+    JSSystemStruct* jsfake  = JSSystemStruct::decodeSystemStruct(args.This(), errorMessage);
+
+    if (jsfake == NULL)
+        return v8::ThrowException( v8::Exception::Error(v8::String::New(errorMessage.c_str())));
+
+    return jsfake->storageRangeScan(start, finish, token, max_keys, cb);
+}
+
 v8::Handle<v8::Value> setRestoreScript(const v8::Arguments& args) {
     if (args.Length() != 1 && args.Length() != 2)
         return v8::ThrowException ( v8::Exception::Error(v8::String::New("Error calling setRestoreScript. Require 1 or 2 arguments: an script (string or function) and optional callback")));
@@ -555,7 +615,8 @@ v8::Handle<v8::Value> root_serialize(const v8::Arguments& args)
         return v8::ThrowException( v8::Exception::Error(v8::String::New("Error calling serialize.  Must pass in at least one argument to be serialized.")));
 
 
-    String stringifiedValue = JSSerializer::serializeMessage(args[0]);
+    //system.deserialize handles both encodings, so use the faster one.
+    String stringifiedValue = JSSerializer::serializeBinaryMessage(args[0]);
 
     String errorMessage = "Error decoding error message when serializing object";
     JSSystemStruct* jsfake  = JSSystemStruct::decodeSystemStruct(args.This(), errorMessage);
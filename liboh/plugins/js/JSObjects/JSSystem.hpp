@@ -18,6 +18,7 @@ namespace JSSystem {
 v8::Handle<v8::Value> sendMessageReliable (const v8::Arguments& args);
 v8::Handle<v8::Value> sendMessageUnreliable(const v8::Arguments& args);
 v8::Handle<v8::Value> sendMessage(const v8::Arguments&args, bool reliable);
+v8::Handle<v8::Value> sendQueueDepth(const v8::Arguments& args);
 
 v8::Handle<v8::Value> getAssociatedPresence(const v8::Arguments& args);
 v8::Handle<v8::Value> root_canSendMessage(const v8::Arguments& args);
@@ -63,6 +64,7 @@ v8::Handle<v8::Value> storageErase(const v8::Arguments& args);
 v8::Handle<v8::Value> storageRangeRead(const v8::Arguments& args);
 v8::Handle<v8::Value> storageRangeErase(const v8::Arguments& args);
 v8::Handle<v8::Value> storageCount(const v8::Arguments& args);
+v8::Handle<v8::Value> storageRangeScan(const v8::Arguments& args);
 //end storage functions
 
 v8::Handle<v8::Value> setRestoreScript(const v8::Arguments& args);
@@ -679,6 +679,21 @@ v8::Handle<v8::Value> JSSerializer::deserializeMessage(EmersonScript* emerScript
     return handle_scope.Close(returner);
 }
 
+v8::Handle<v8::Value> JSSerializer::deserializeMessage(EmersonScript* emerScript, const String& payload, bool& deserializeSuccessful)
+{
+    if (isBinaryMessage(payload))
+        return deserializeBinaryMessage(emerScript, payload, deserializeSuccessful);
+
+    Sirikata::JS::Protocol::JSFieldValue jsfieldval;
+    if (! jsfieldval.ParseFromString(payload))
+    {
+        JSLOG(error, "Error when deserializing.  Could not parse message.");
+        deserializeSuccessful = false;
+        return v8::Undefined();
+    }
+    return deserializeMessage(emerScript, jsfieldval, deserializeSuccessful);
+}
+
 
 
 bool JSSerializer::deserializeObjectInternal( EmersonScript* emerScript, Sirikata::JS::Protocol::JSMessage jsmessage,v8::Handle<v8::Object>& deserializeTo, ObjectMap& labeledObjs,FixupMap& toFixUp)
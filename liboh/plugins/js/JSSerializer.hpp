@@ -55,8 +55,14 @@ typedef FixupMap::iterator FixupMapIter;
 void debug_printSerialized(Sirikata::JS::Protocol::JSMessage jm, String prepend);
 void debug_printSerializedFieldVal(Sirikata::JS::Protocol::JSFieldValue jsfieldval, String prepend,String name);
 
-class JSSerializer
+std::vector<String> getOwnPropertyNames(v8::Local<v8::Object> obj);
+
+class JSBinaryDecoder;
+
+class SIRIKATA_SCRIPTING_JS_EXPORT JSSerializer
 {
+    friend class JSBinaryDecoder;
+
     static void pointOtherObject(int32 int32ToPointTo,Sirikata::JS::Protocol::IJSFieldValue& jsf_value);
 
     static void annotateObject(ObjectVec& objVec, v8::Handle<v8::Object> v8Obj,int32 toStampWith);
@@ -93,10 +99,36 @@ public:
     
     //deprecated
     static std::string serializeObject(v8::Local<v8::Value> v8Val,int32 toStamp = 0);
+
+    /**
+       Serializes v8Val as a JSFieldValue protocol buffer, which every receiver
+       understands.  Must be called from within a v8 context.
+     */
     static std::string serializeMessage(v8::Local<v8::Value> v8Val, int32 toStamp=0);
 
-    //both of these must be called from within a v8 context
+    /**
+       Serializes v8Val using the compact binary encoding (see
+       JSBinarySerializer.cpp).  Older receivers drop these, so only use it
+       for receivers known to decode it.  Must be called from within a v8
+       context.
+     */
+    static std::string serializeBinaryMessage(v8::Local<v8::Value> v8Val);
+
+    /**
+       Returns true if payload was produced by serializeBinaryMessage, as
+       opposed to being a JSMessage or JSFieldValue in the older protocol
+       buffer encoding.
+     */
+    static bool isBinaryMessage(const String& payload);
+
+    //all of these must be called from within a v8 context
+    static v8::Handle<v8::Value> deserializeBinaryMessage( EmersonScript* emerScript, const String& payload, bool& deserializeSuccessful);
     static v8::Handle<v8::Value> deserializeMessage( EmersonScript* emerScript, Sirikata::JS::Protocol::JSFieldValue jsfieldval,bool& deserializeSuccessful);
+    /**
+       Deserializes the output of either serializeMessage or
+       serializeBinaryMessage.
+     */
+    static v8::Handle<v8::Value> deserializeMessage( EmersonScript* emerScript, const String& payload, bool& deserializeSuccessful);
     //both of these must be called from within a v8 context
     static v8::Handle<v8::Object> deserializeObject( EmersonScript* emerScript, Sirikata::JS::Protocol::JSMessage jsmessage,bool& deserializeSuccessful);
 };
@@ -357,6 +357,33 @@ PresenceEntry.prototype.proxRemovedEvent = function (visibleObj,visTo)
      };
 
 
+     /**
+      @param {String} scanKeyStart. Specifies start of the range of keys in
+      the backend storage system to read data from.
+      @param {String} scanKeyFinish. Specifies end of the range of keys in
+      the backend storage system to read data from.
+      @param {String} token. undefined to read the first page of the range,
+      otherwise the token passed to the callback for the previous page.
+      @param {int} maxKeys. Maximum number of keys to read in this page.
+
+      @param {function} cb Callback to execute when the page has been read.
+      Takes three arguments: 1) bool (true if read succeeded, false if read
+      failed); 2) If read succeeded, an object holding the keys and values in
+      this page (if read failed, undefined); 3) The token to pass to get the
+      next page, or undefined if this was the last page.
+
+      Unlike storageRangeRead, only one page of the range is held in memory
+      at a time.
+      */
+     system.storageRangeScan = function()
+     {
+         if (arguments.length == 5 && typeof(arguments[4] === 'function'))
+             return baseSystem.storageRangeScan.apply(baseSystem, [ arguments[0], arguments[1], arguments[2], arguments[3], system.wrapCallbackForSelf(arguments[4]) ]);
+         else
+             return baseSystem.storageRangeScan.apply(baseSystem, arguments);
+     };
+
+
      /**
       @param {String} eraseKeyStart. Specifies start of the range of keys in 
       the backend storage system to remove.
@@ -720,6 +747,19 @@ PresenceEntry.prototype.proxRemovedEvent = function (visibleObj,visTo)
      {
          baseSystem.sendMessageUnreliable.apply(baseSystem,arguments);
      };
+
+     /**
+      @function
+      @param Presence messages are sent from.
+      @param Visible messages are sent to.
+      @return Number of reliable messages from the presence to the visible
+      that haven't been sent yet. Scripts sending many messages can use this
+      to slow down when the receiver isn't keeping up.
+      */
+     system.sendQueueDepth = function()
+     {
+         return baseSystem.sendQueueDepth.apply(baseSystem,arguments);
+     };
      
 
 
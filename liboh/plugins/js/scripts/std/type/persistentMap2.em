@@ -17,6 +17,8 @@ if (typeof(std) === "undefined") /** @namespace */ std = {};
  *   retrieve(keys,cb)  : Retrieve elements with given list of keys from backend to memory
  *                        Callback: cb(success)
  *   restore(cb)        : Restore all elements from backend to memory. Callback: cb(success)
+ *   scan(fn,cb)        : Call fn(key,value) for every element in backend storage, a page at a
+ *                        time, without loading them into memory. Callback: cb(success)
  *   reset(cb)          : Clear content in both memory and backend. Callback: cb(success)
  *   name()             : Return name of the map
  *   data()             : Return all elements in memory, as an associative array
@@ -128,25 +130,61 @@ std.persistentMap.prototype._retrieveCommit = function(keys, cb, success, val)
     cb(success);
 };
 
+// Number of elements read from backend storage at once by restore and scan
+std.persistentMap.SCAN_PAGE_SIZE = 1000;
+
 std.persistentMap.prototype.restore = function(cb)
 {
-    start = this._mapName;
-    finish = this._mapName+'@';
-    system.storageRangeRead(start, finish,  std.core.bind(this._restoreCommit, this, cb));
+    // Pages are copied into the map as they arrive, so only one is held
+    // outside of it at a time. If a page fails, elements from earlier pages
+    // stay restored.
+    this.scan(
+        std.core.bind(this._restoreElement, this),
+        std.core.bind(this._restoreCommit, this, cb)
+    );
 };
 
-std.persistentMap.prototype._restoreCommit = function(cb, success, val)
+std.persistentMap.prototype._restoreElement = function(key, value)
+{
+    this._data[key] = value;
+};
+
+std.persistentMap.prototype._restoreCommit = function(cb, success)
 {
     if (!success)
         system.print('Restore fails');
-    else {
-        for (key in val)
-            this._data[key.split(':')[2]]=val[key];
+    else
         this._dirtyKeys = {};
-    }
     cb(success);
 };
 
+std.persistentMap.prototype.scan = function(fn, cb)
+{
+    start = this._mapName;
+    finish = this._mapName+'@';
+    system.storageRangeScan(start, finish, undefined, std.persistentMap.SCAN_PAGE_SIZE, std.core.bind(this._scanPage, this, fn, cb));
+};
+
+std.persistentMap.prototype._scanPage = function(fn, cb, success, val, next)
+{
+    if (!success) {
+        cb(false);
+        return;
+    }
+
+    for (key in val)
+        fn(key.split(':')[2], val[key]);
+
+    if (typeof(next) === 'undefined') {
+        cb(true);
+        return;
+    }
+
+    start = this._mapName;
+    finish = this._mapName+'@';
+    system.storageRangeScan(start, finish, next, std.persistentMap.SCAN_PAGE_SIZE, std.core.bind(this._scanPage, this, fn, cb));
+};
+
 std.persistentMap.prototype.reset = function(cb)
 {
     start = this._mapName;
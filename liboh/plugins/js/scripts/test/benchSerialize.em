@@ -0,0 +1,71 @@
+// Times system.serialize/system.deserialize, which use the same encoding as
+// messages sent between sandboxes and to objects known to support it, on a
+// few representative message shapes. Run in a scripted object and compare the printed rates and
+// sizes before and after changes to JSSerializer.
+
+var iterations = 2000;
+
+function makeCyclic()
+{
+    var parent = { name: 'parent', children: [] };
+    for (var i = 0; i < 4; ++i)
+        parent.children.push({ name: 'child' + i, parent: parent, index: i });
+    return parent;
+}
+
+var shapes = {
+    // Small command messages, the most common thing scripts send.
+    'command': { request: 'getPosition', seq: 42, reliable: true },
+
+    // Location updates, dominated by Vec3/Quaternion values.
+    'location': {
+        command: 'locationResponse',
+        position: new util.Vec3(1.5, -20.25, 300.125),
+        velocity: new util.Vec3(0, 0.5, 0),
+        orientation: new util.Quaternion(0, 0, 0, 1),
+        time: 1234567.891
+    },
+
+    // Chat-style message with a longer string payload.
+    'chat': {
+        command: 'chat',
+        from: 'avatar-0123456789',
+        text: 'The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog.'
+    },
+
+    // Arrays of records repeating the same field names.
+    'records': (function() {
+        var recs = [];
+        for (var i = 0; i < 32; ++i)
+            recs.push({ id: i, score: i * 1.5, tag: 'r' + i, alive: (i % 2) == 0 });
+        return { command: 'scores', records: recs };
+    })(),
+
+    // Object graph with cycles and shared references.
+    'cyclic': makeCyclic()
+};
+
+function now()
+{
+    return new Date().getTime();
+}
+
+for (var shapeName in shapes)
+{
+    var msg = shapes[shapeName];
+
+    var start = now();
+    var serialized;
+    for (var i = 0; i < iterations; ++i)
+        serialized = system.serialize(msg);
+    var serializeMs = now() - start;
+
+    start = now();
+    for (var i = 0; i < iterations; ++i)
+        system.deserialize(serialized);
+    var deserializeMs = now() - start;
+
+    system.print(shapeName + ': ' + serialized.length + ' chars, ' +
+                 'serialize ' + (serializeMs * 1000 / iterations) + 'us/msg, ' +
+                 'deserialize ' + (deserializeMs * 1000 / iterations) + 'us/msg\n');
+}
@@ -0,0 +1,554 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LSMSegment.hpp"
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Identifies the footer of a segment file
+#define SEGMENT_MAGIC 0x4c534d31
+// index offset, index size, index checksum, number of entries, magic
+#define SEGMENT_FOOTER_SIZE (8 + 4 + 4 + 8 + 4)
+// Blocks are closed after this many bytes even if they have room for more
+// entries
+#define SEGMENT_MAX_BLOCK_BYTES 4096
+
+namespace Sirikata {
+namespace OH {
+
+namespace LSMFormat {
+
+void putFixed32(String* dst, uint32 v) {
+    for(int i = 0; i < 4; i++)
+        dst->push_back((char)((v >> (8*i)) & 0xff));
+}
+
+void putFixed64(String* dst, uint64 v) {
+    for(int i = 0; i < 8; i++)
+        dst->push_back((char)((v >> (8*i)) & 0xff));
+}
+
+void putVarint(String* dst, uint64 v) {
+    while(v >= 0x80) {
+        dst->push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    dst->push_back((char)v);
+}
+
+void putString(String* dst, const String& s) {
+    putVarint(dst, s.size());
+    dst->append(s);
+}
+
+bool getFixed32(const String& src, size_t* pos, uint32* v) {
+    if (*pos + 4 > src.size()) return false;
+    *v = 0;
+    for(int i = 0; i < 4; i++)
+        *v |= ((uint32)(unsigned char)src[*pos + i]) << (8*i);
+    *pos += 4;
+    return true;
+}
+
+bool getFixed64(const String& src, size_t* pos, uint64* v) {
+    if (*pos + 8 > src.size()) return false;
+    *v = 0;
+    for(int i = 0; i < 8; i++)
+        *v |= ((uint64)(unsigned char)src[*pos + i]) << (8*i);
+    *pos += 8;
+    return true;
+}
+
+bool getVarint(const String& src, size_t* pos, uint64* v) {
+    *v = 0;
+    for(uint32 shift = 0; shift < 64 && *pos < src.size(); shift += 7) {
+        unsigned char byte = (unsigned char)src[(*pos)++];
+        *v |= ((uint64)(byte & 0x7f)) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool getString(const String& src, size_t* pos, String* s) {
+    uint64 len;
+    if (!getVarint(src, pos, &len)) return false;
+    if (len > src.size() - *pos) return false;
+    s->assign(src, *pos, (size_t)len);
+    *pos += (size_t)len;
+    return true;
+}
+
+uint32 checksum(const char* data, size_t len) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, len);
+    return crc.checksum();
+}
+
+uint32 checksum(const String& data) {
+    return checksum(data.data(), data.size());
+}
+
+bool readFully(FILE* fp, char* buf, size_t len) {
+    return (len == 0 || fread(buf, 1, len, fp) == len);
+}
+
+bool syncFile(FILE* fp) {
+    if (fflush(fp) != 0) return false;
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_WINDOWS
+    return FlushFileBuffers((HANDLE) _get_osfhandle(_fileno(fp))) != 0;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
+
+} // namespace LSMFormat
+
+using namespace LSMFormat;
+
+
+LSMMapIterator::LSMMapIterator(LSMEntryMapPtr entries)
+ : mEntries(entries),
+   mIt(entries->begin())
+{
+}
+
+bool LSMMapIterator::valid() const {
+    return mIt != mEntries->end();
+}
+
+const String& LSMMapIterator::key() const {
+    return mIt->first;
+}
+
+const LSMEntry& LSMMapIterator::entry() const {
+    return mIt->second;
+}
+
+void LSMMapIterator::next() {
+    mIt++;
+}
+
+void LSMMapIterator::seek(const String& target) {
+    mIt = mEntries->lower_bound(target);
+}
+
+
+LSMMergingIterator::LSMMergingIterator(const std::vector<LSMIteratorPtr>& sources)
+ : mSources(sources),
+   mCurrent(-1)
+{
+    findCurrent();
+}
+
+bool LSMMergingIterator::valid() const {
+    return mCurrent >= 0;
+}
+
+bool LSMMergingIterator::failed() const {
+    for(uint32 i = 0; i < mSources.size(); i++) {
+        if (mSources[i]->failed())
+            return true;
+    }
+    return false;
+}
+
+const String& LSMMergingIterator::key() const {
+    return mSources[mCurrent]->key();
+}
+
+const LSMEntry& LSMMergingIterator::entry() const {
+    return mSources[mCurrent]->entry();
+}
+
+void LSMMergingIterator::next() {
+    // Skip the key in every source so older versions of it are hidden
+    String cur = key();
+    for(uint32 i = 0; i < mSources.size(); i++) {
+        if (mSources[i]->valid() && mSources[i]->key() == cur)
+            mSources[i]->next();
+    }
+    findCurrent();
+}
+
+void LSMMergingIterator::seek(const String& target) {
+    for(uint32 i = 0; i < mSources.size(); i++)
+        mSources[i]->seek(target);
+    findCurrent();
+}
+
+void LSMMergingIterator::findCurrent() {
+    mCurrent = -1;
+    if (failed()) return;
+    for(uint32 i = 0; i < mSources.size(); i++) {
+        if (!mSources[i]->valid()) continue;
+        if (mCurrent < 0 || mSources[i]->key() < mSources[mCurrent]->key())
+            mCurrent = (int32)i;
+    }
+}
+
+
+/** Iterates over a segment, decoding one block at a time. */
+class LSMSegmentIterator : public LSMIterator {
+public:
+    LSMSegmentIterator(LSMSegmentPtr seg)
+     : mSegment(seg),
+       mBlockIdx(0),
+       mPos(0),
+       mFailed(false)
+    {
+        loadBlock(0);
+    }
+
+    virtual bool valid() const {
+        return mPos < mBlock.size();
+    }
+    virtual bool failed() const {
+        return mFailed;
+    }
+    virtual const String& key() const {
+        return mBlock[mPos].first;
+    }
+    virtual const LSMEntry& entry() const {
+        return mBlock[mPos].second;
+    }
+    virtual void next() {
+        mPos++;
+        if (mPos >= mBlock.size())
+            loadBlock(mBlockIdx + 1);
+    }
+    virtual void seek(const String& target) {
+        if (mFailed) return;
+        int32 idx = mSegment->findBlock(target);
+        loadBlock(idx < 0 ? 0 : (uint32)idx);
+        while(valid() && mBlock[mPos].first < target)
+            next();
+    }
+
+private:
+    // Load the block, or mark the iterator as finished if there are no more
+    // blocks. If the block can't be read the iterator is also marked failed.
+    void loadBlock(uint32 idx) {
+        mBlock.clear();
+        mPos = 0;
+        mBlockIdx = idx;
+        while(mBlockIdx < mSegment->mIndex.size()) {
+            if (!mSegment->readBlock(mBlockIdx, &mBlock)) {
+                mBlock.clear();
+                mFailed = true;
+                return;
+            }
+            if (!mBlock.empty()) return;
+            mBlockIdx++;
+        }
+    }
+
+    LSMSegmentPtr mSegment;
+    uint32 mBlockIdx;
+    LSMSegment::Block mBlock;
+    size_t mPos;
+    bool mFailed;
+};
+
+
+LSMSegment::LSMSegment(const String& path, uint64 number, FILE* fp, const BlockIndex& index, uint64 entries)
+ : mPath(path),
+   mNumber(number),
+   mFile(fp),
+   mIndex(index),
+   mEntries(entries),
+   mObsolete(false)
+{
+}
+
+LSMSegment::~LSMSegment() {
+    boost::unique_lock<boost::mutex> lck(mFileMutex);
+    fclose(mFile);
+    if (mObsolete) {
+        try {
+            boost::filesystem::remove(mPath);
+        }
+        catch(boost::filesystem::filesystem_error&) {
+            SILOG(lsm-storage, error, "Couldn't remove obsolete segment " << mPath);
+        }
+    }
+}
+
+void LSMSegment::setObsolete() {
+    boost::unique_lock<boost::mutex> lck(mFileMutex);
+    mObsolete = true;
+}
+
+LSMSegmentPtr LSMSegment::write(const String& path, uint64 number, LSMIterator* it, bool drop_tombstones, uint32 block_entries, bool sync) {
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (fp == NULL) {
+        SILOG(lsm-storage, error, "Couldn't create segment " << path);
+        return LSMSegmentPtr();
+    }
+
+    bool success = true;
+    uint64 offset = 0;
+    uint64 entries = 0;
+    BlockIndex index;
+
+    String block;
+    uint32 block_count = 0;
+    String block_first_key;
+    String prev_key;
+    for(; success && it->valid(); it->next()) {
+        const LSMEntry& entry = it->entry();
+        if (drop_tombstones && entry.deleted)
+            continue;
+
+        const String& key = it->key();
+        size_t shared = 0;
+        if (block_count > 0) {
+            while(shared < key.size() && shared < prev_key.size() && key[shared] == prev_key[shared])
+                shared++;
+        }
+        else {
+            block_first_key = key;
+        }
+
+        putVarint(&block, shared);
+        putVarint(&block, key.size() - shared);
+        block.push_back(entry.deleted ? 1 : 0);
+        block.append(key, shared, String::npos);
+        if (!entry.deleted)
+            putString(&block, entry.value);
+
+        prev_key = key;
+        block_count++;
+        entries++;
+
+        if (block_count >= block_entries || block.size() >= SEGMENT_MAX_BLOCK_BYTES) {
+            BlockHandle handle;
+            handle.firstKey = block_first_key;
+            handle.offset = offset;
+            handle.size = (uint32)block.size();
+            handle.crc = checksum(block);
+            index.push_back(handle);
+
+            success = (fwrite(block.data(), 1, block.size(), fp) == block.size());
+            offset += block.size();
+            block.clear();
+            block_count = 0;
+        }
+    }
+    if (success && block_count > 0) {
+        BlockHandle handle;
+        handle.firstKey = block_first_key;
+        handle.offset = offset;
+        handle.size = (uint32)block.size();
+        handle.crc = checksum(block);
+        index.push_back(handle);
+
+        success = (fwrite(block.data(), 1, block.size(), fp) == block.size());
+        offset += block.size();
+    }
+    // A source that couldn't be read would leave the segment incomplete
+    if (it->failed()) {
+        SILOG(lsm-storage, error, "Error reading entries for segment " << path);
+        success = false;
+    }
+
+    String index_data;
+    putVarint(&index_data, index.size());
+    for(BlockIndex::iterator idx_it = index.begin(); idx_it != index.end(); idx_it++) {
+        putString(&index_data, idx_it->firstKey);
+        putVarint(&index_data, idx_it->offset);
+        putVarint(&index_data, idx_it->size);
+        putFixed32(&index_data, idx_it->crc);
+    }
+
+    String footer;
+    putFixed64(&footer, offset);
+    putFixed32(&footer, (uint32)index_data.size());
+    putFixed32(&footer, checksum(index_data));
+    putFixed64(&footer, entries);
+    putFixed32(&footer, SEGMENT_MAGIC);
+
+    success = success &&
+        (fwrite(index_data.data(), 1, index_data.size(), fp) == index_data.size()) &&
+        (fwrite(footer.data(), 1, footer.size(), fp) == footer.size());
+    if (success && sync)
+        success = syncFile(fp);
+    fclose(fp);
+
+    if (!success) {
+        SILOG(lsm-storage, error, "Error writing segment " << path);
+        try {
+            boost::filesystem::remove(path);
+        }
+        catch(boost::filesystem::filesystem_error&) {
+        }
+        return LSMSegmentPtr();
+    }
+
+    return open(path, number);
+}
+
+LSMSegmentPtr LSMSegment::open(const String& path, uint64 number) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        SILOG(lsm-storage, error, "Couldn't open segment " << path);
+        return LSMSegmentPtr();
+    }
+
+    bool success = (fseek(fp, 0, SEEK_END) == 0);
+    long file_size = success ? ftell(fp) : 0;
+    success = success && (file_size >= SEGMENT_FOOTER_SIZE);
+
+    String footer(SEGMENT_FOOTER_SIZE, '\0');
+    success = success &&
+        (fseek(fp, file_size - SEGMENT_FOOTER_SIZE, SEEK_SET) == 0) &&
+        readFully(fp, &footer[0], footer.size());
+
+    uint64 index_offset = 0, entries = 0;
+    uint32 index_size = 0, index_crc = 0, magic = 0;
+    size_t pos = 0;
+    success = success &&
+        getFixed64(footer, &pos, &index_offset) &&
+        getFixed32(footer, &pos, &index_size) &&
+        getFixed32(footer, &pos, &index_crc) &&
+        getFixed64(footer, &pos, &entries) &&
+        getFixed32(footer, &pos, &magic) &&
+        magic == SEGMENT_MAGIC &&
+        index_offset + index_size + SEGMENT_FOOTER_SIZE == (uint64)file_size;
+
+    String index_data;
+    if (success) {
+        index_data.resize(index_size);
+        success =
+            (fseek(fp, (long)index_offset, SEEK_SET) == 0) &&
+            readFully(fp, &index_data[0], index_data.size()) &&
+            checksum(index_data) == index_crc;
+    }
+
+    BlockIndex index;
+    if (success) {
+        pos = 0;
+        uint64 nblocks = 0;
+        success = getVarint(index_data, &pos, &nblocks);
+        for(uint64 i = 0; success && i < nblocks; i++) {
+            BlockHandle handle;
+            uint64 size = 0;
+            success =
+                getString(index_data, &pos, &handle.firstKey) &&
+                getVarint(index_data, &pos, &handle.offset) &&
+                getVarint(index_data, &pos, &size) &&
+                getFixed32(index_data, &pos, &handle.crc);
+            handle.size = (uint32)size;
+            index.push_back(handle);
+        }
+    }
+
+    if (!success) {
+        SILOG(lsm-storage, error, "Segment " << path << " is corrupt");
+        fclose(fp);
+        return LSMSegmentPtr();
+    }
+
+    return LSMSegmentPtr(new LSMSegment(path, number, fp, index, entries));
+}
+
+int32 LSMSegment::findBlock(const String& key) const {
+    // Find the last block whose first key is <= key
+    int32 lo = 0, hi = (int32)mIndex.size();
+    while(lo < hi) {
+        int32 mid = lo + (hi - lo) / 2;
+        if (mIndex[mid].firstKey <= key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - 1;
+}
+
+bool LSMSegment::readBlock(uint32 idx, Block* block_out) {
+    const BlockHandle& handle = mIndex[idx];
+
+    String data(handle.size, '\0');
+    {
+        boost::unique_lock<boost::mutex> lck(mFileMutex);
+        if (fseek(mFile, (long)handle.offset, SEEK_SET) != 0 ||
+            !readFully(mFile, &data[0], data.size()))
+        {
+            SILOG(lsm-storage, error, "Error reading block " << idx << " of segment " << mPath);
+            return false;
+        }
+    }
+    if (checksum(data) != handle.crc) {
+        SILOG(lsm-storage, error, "Block " << idx << " of segment " << mPath << " is corrupt");
+        return false;
+    }
+
+    block_out->clear();
+    size_t pos = 0;
+    String prev_key;
+    while(pos < data.size()) {
+        uint64 shared, unshared;
+        if (!getVarint(data, &pos, &shared) ||
+            !getVarint(data, &pos, &unshared) ||
+            shared > prev_key.size() ||
+            pos + 1 + unshared > data.size())
+        {
+            SILOG(lsm-storage, error, "Block " << idx << " of segment " << mPath << " is corrupt");
+            return false;
+        }
+        bool deleted = (data[pos++] != 0);
+
+        String key = prev_key.substr(0, (size_t)shared);
+        key.append(data, pos, (size_t)unshared);
+        pos += (size_t)unshared;
+
+        LSMEntry entry;
+        entry.deleted = deleted;
+        if (!deleted && !getString(data, &pos, &entry.value)) {
+            SILOG(lsm-storage, error, "Block " << idx << " of segment " << mPath << " is corrupt");
+            return false;
+        }
+
+        block_out->push_back(std::make_pair(key, entry));
+        prev_key = key;
+    }
+    return true;
+}
+
+bool LSMSegment::get(const String& key, LSMEntry* entry_out, bool* found_out) {
+    *found_out = false;
+    int32 idx = findBlock(key);
+    if (idx < 0) return true;
+
+    Block block;
+    if (!readBlock((uint32)idx, &block)) return false;
+
+    size_t lo = 0, hi = block.size();
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (block[mid].first < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < block.size() && block[lo].first == key) {
+        *entry_out = block[lo].second;
+        *found_out = true;
+    }
+    return true;
+}
+
+LSMIteratorPtr LSMSegment::iterator() {
+    // The iterator holds a reference to keep the segment's file alive
+    return LSMIteratorPtr(new LSMSegmentIterator(shared_from_this()));
+}
+
+} // namespace OH
+} // namespace Sirikata
@@ -0,0 +1,198 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef __SIRIKATA_OH_STORAGE_LSM_SEGMENT_HPP__
+#define __SIRIKATA_OH_STORAGE_LSM_SEGMENT_HPP__
+
+#include <sirikata/oh/Platform.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdio>
+
+namespace Sirikata {
+namespace OH {
+
+/** A value in the store. Erased keys are kept as tombstones until compaction
+ *  can prove no older value for them remains.
+ */
+struct LSMEntry {
+    LSMEntry() : deleted(false), value() {}
+    LSMEntry(const String& v) : deleted(false), value(v) {}
+
+    static LSMEntry tombstone() {
+        LSMEntry e;
+        e.deleted = true;
+        return e;
+    }
+
+    bool deleted;
+    String value;
+};
+
+typedef std::map<String, LSMEntry> LSMEntryMap;
+typedef std::tr1::shared_ptr<LSMEntryMap> LSMEntryMapPtr;
+
+/** Iterates over entries in key order, including tombstones. */
+class LSMIterator {
+public:
+    virtual ~LSMIterator() {}
+
+    virtual bool valid() const = 0;
+    /** Whether iteration stopped early because data couldn't be read. Once
+     *  set, valid() is false, so always check this after a loop finishes.
+     */
+    virtual bool failed() const = 0;
+    virtual const String& key() const = 0;
+    virtual const LSMEntry& entry() const = 0;
+    virtual void next() = 0;
+    /** Position at the first entry with a key >= target. */
+    virtual void seek(const String& target) = 0;
+};
+typedef std::tr1::shared_ptr<LSMIterator> LSMIteratorPtr;
+
+/** Iterates over an LSMEntryMap. Entries may be added or updated, but not
+ *  removed, while the iterator is in use.
+ */
+class LSMMapIterator : public LSMIterator {
+public:
+    LSMMapIterator(LSMEntryMapPtr entries);
+
+    virtual bool valid() const;
+    virtual bool failed() const { return false; }
+    virtual const String& key() const;
+    virtual const LSMEntry& entry() const;
+    virtual void next();
+    virtual void seek(const String& target);
+private:
+    LSMEntryMapPtr mEntries;
+    LSMEntryMap::const_iterator mIt;
+};
+
+/** Merges several iterators into one. Sources are ordered newest first: when
+ *  more than one contains a key, only the entry from the newest is returned.
+ *  If any source fails the merge fails too, since continuing without it could
+ *  return values it had overwritten.
+ */
+class LSMMergingIterator : public LSMIterator {
+public:
+    LSMMergingIterator(const std::vector<LSMIteratorPtr>& sources);
+
+    virtual bool valid() const;
+    virtual bool failed() const;
+    virtual const String& key() const;
+    virtual const LSMEntry& entry() const;
+    virtual void next();
+    virtual void seek(const String& target);
+private:
+    // Select the source with the smallest key, preferring newer sources
+    void findCurrent();
+
+    std::vector<LSMIteratorPtr> mSources;
+    int32 mCurrent;
+};
+
+class LSMSegment;
+typedef std::tr1::shared_ptr<LSMSegment> LSMSegmentPtr;
+
+/** An immutable, sorted file of entries.
+ *
+ *  Entries are grouped into blocks. Within a block each key is stored as the
+ *  length of the prefix it shares with the previous key and the remaining
+ *  suffix, so the long common prefixes of keys in the same bucket are only
+ *  stored once per block. The first key of each block is kept in an index at
+ *  the end of the file, which is loaded when the segment is opened, so a
+ *  lookup reads a single block.
+ *
+ *  Segments can be read from multiple threads. Once a segment is replaced by
+ *  compaction it is marked obsolete, and its file is removed when the last
+ *  reference to it goes away.
+ */
+class LSMSegment : public std::tr1::enable_shared_from_this<LSMSegment> {
+public:
+    ~LSMSegment();
+
+    /** Write all entries from it to a new segment file and open it.
+     *  \param path the file to write
+     *  \param number the file number of the segment
+     *  \param it source of entries, which must be in key order
+     *  \param drop_tombstones if true, don't write erased entries
+     *  \param block_entries maximum number of entries per block
+     *  \param sync if true, sync the file to disk before returning
+     *  \returns the new segment, or an empty pointer if writing or reading
+     *  from it fails
+     */
+    static LSMSegmentPtr write(const String& path, uint64 number, LSMIterator* it, bool drop_tombstones, uint32 block_entries, bool sync);
+    /** Open an existing segment file. Returns an empty pointer if the file
+     *  can't be read or is corrupt.
+     */
+    static LSMSegmentPtr open(const String& path, uint64 number);
+
+    uint64 number() const { return mNumber; }
+    uint64 entries() const { return mEntries; }
+
+    /** Look up a key, setting found_out to whether the segment contains an
+     *  entry, possibly a tombstone, for it. Returns false if the segment
+     *  couldn't be read, in which case found_out isn't meaningful.
+     */
+    bool get(const String& key, LSMEntry* entry_out, bool* found_out);
+
+    LSMIteratorPtr iterator();
+
+    /** Remove the file once no one is using the segment anymore. */
+    void setObsolete();
+
+private:
+    friend class LSMSegmentIterator;
+
+    struct BlockHandle {
+        String firstKey;
+        uint64 offset;
+        uint32 size;
+        uint32 crc;
+    };
+    typedef std::vector<BlockHandle> BlockIndex;
+    typedef std::vector<std::pair<String, LSMEntry> > Block;
+
+    LSMSegment(const String& path, uint64 number, FILE* fp, const BlockIndex& index, uint64 entries);
+
+    // Index of the block that would contain key, or -1 if it's before the
+    // first key in the segment
+    int32 findBlock(const String& key) const;
+    bool readBlock(uint32 idx, Block* block_out);
+
+    String mPath;
+    uint64 mNumber;
+    // Protects mFile and mObsolete, which is set by the background thread
+    // but read by whichever thread drops the last reference
+    boost::mutex mFileMutex;
+    FILE* mFile;
+    BlockIndex mIndex;
+    uint64 mEntries;
+    bool mObsolete;
+};
+
+
+// Helpers for the binary encodings used by segments and the write-ahead log.
+namespace LSMFormat {
+void putFixed32(String* dst, uint32 v);
+void putFixed64(String* dst, uint64 v);
+void putVarint(String* dst, uint64 v);
+void putString(String* dst, const String& s);
+
+// Decoders advance *pos and return false if the input is too short.
+bool getFixed32(const String& src, size_t* pos, uint32* v);
+bool getFixed64(const String& src, size_t* pos, uint64* v);
+bool getVarint(const String& src, size_t* pos, uint64* v);
+bool getString(const String& src, size_t* pos, String* s);
+
+uint32 checksum(const String& data);
+uint32 checksum(const char* data, size_t len);
+
+bool readFully(FILE* fp, char* buf, size_t len);
+bool syncFile(FILE* fp);
+} // namespace LSMFormat
+
+} // namespace OH
+} // namespace Sirikata
+
+#endif //__SIRIKATA_OH_STORAGE_LSM_SEGMENT_HPP__
@@ -0,0 +1,408 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LSMStorage.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOWork.hpp>
+
+namespace Sirikata {
+namespace OH {
+
+bool LSMStorage::Overlay::get(const String& key, LSMEntry* entry_out, bool* found_out) {
+    *found_out = true;
+    LSMEntryMap::const_iterator it = trans->find(key);
+    if (it != trans->end()) {
+        *entry_out = it->second;
+        return true;
+    }
+    it = group->find(key);
+    if (it != group->end()) {
+        *entry_out = it->second;
+        return true;
+    }
+    return store->get(key, entry_out, found_out);
+}
+
+LSMIteratorPtr LSMStorage::Overlay::iterator() {
+    std::vector<LSMIteratorPtr> sources;
+    sources.push_back(LSMIteratorPtr(new LSMMapIterator(trans)));
+    sources.push_back(LSMIteratorPtr(new LSMMapIterator(group)));
+    sources.push_back(store->iterator());
+    return LSMIteratorPtr(new LSMMergingIterator(sources));
+}
+
+
+LSMStorage::LSMStorage(ObjectHostContext* ctx, const LSMStore::Options& opts)
+ : mContext(ctx),
+   mOptions(opts),
+   mStore(NULL),
+   mIOService(NULL),
+   mWork(NULL),
+   mThread(NULL),
+   mTransactionQueue(std::tr1::bind(&LSMStorage::postProcessTransactions, this)),
+   mMaxGroupedTransactions(100)
+{
+}
+
+LSMStorage::~LSMStorage()
+{
+}
+
+void LSMStorage::start() {
+    mIOService = new Network::IOService("LSMStorage");
+    mWork = new Network::IOWork(*mIOService, "LSMStorage IO Thread");
+    mThread = new Sirikata::Thread("LSMStorage IO", std::tr1::bind(&Network::IOService::runNoReturn, mIOService));
+
+    mIOService->post(std::tr1::bind(&LSMStorage::openStore, this), "LSMStorage::openStore");
+}
+
+void LSMStorage::openStore() {
+    mStore = new LSMStore(mOptions);
+    if (!mStore->open()) {
+        SILOG(lsm-storage, error, "Couldn't open storage in " << mOptions.dir << ", all transactions will fail");
+        delete mStore;
+        mStore = NULL;
+    }
+}
+
+void LSMStorage::stop() {
+    // Let outstanding transactions finish, then close the store
+    delete mWork;
+    mWork = NULL;
+    mThread->join();
+    delete mThread;
+    mThread = NULL;
+    delete mIOService;
+    mIOService = NULL;
+
+    delete mStore;
+    mStore = NULL;
+
+    // Clean up data from any outstanding pending transactions
+    for(BucketTransactions::iterator it = mTransactions.begin(); it != mTransactions.end(); it++) {
+        Transaction* trans = it->second;
+        delete trans;
+    }
+    mTransactions.clear();
+}
+
+String LSMStorage::storeKey(const Bucket& bucket, const Key& key) {
+    return bucket.rawHexData() + key;
+}
+
+LSMStorage::Transaction* LSMStorage::getTransaction(const Bucket& bucket, bool* is_new) {
+    if (mTransactions.find(bucket) == mTransactions.end()) {
+        if (is_new != NULL) *is_new = true;
+        mTransactions[bucket] = new Transaction();
+    }
+
+    return mTransactions[bucket];
+}
+
+void LSMStorage::leaseBucket(const Bucket& bucket) {
+    // The store is only ever open in this process, so no leases are needed
+}
+
+void LSMStorage::releaseBucket(const Bucket& bucket) {
+}
+
+void LSMStorage::beginTransaction(const Bucket& bucket) {
+    getTransaction(bucket);
+}
+
+void LSMStorage::commitTransaction(const Bucket& bucket, const CommitCallback& cb, const String& timestamp)
+{
+    Transaction* trans = getTransaction(bucket);
+    mTransactions.erase(bucket);
+
+    if(trans->empty()) {
+        delete trans;
+        ReadSet* rs = NULL;
+        if (cb) cb(SUCCESS, rs);
+        return;
+    }
+
+    mTransactionQueue.push(
+        TransactionData(bucket, trans, cb)
+    );
+}
+
+void LSMStorage::addAction(const Bucket& bucket, const StorageAction& action, const CommitCallback& cb) {
+    bool is_new = false;
+    Transaction* trans = getTransaction(bucket, &is_new);
+    trans->push_back(action);
+
+    // Run commit if this is a one-off transaction
+    if (is_new)
+        commitTransaction(bucket, cb);
+}
+
+bool LSMStorage::erase(const Bucket& bucket, const Key& key, const CommitCallback& cb, const String& timestamp) {
+    addAction(bucket, StorageAction(StorageAction::Erase, key), cb);
+    return true;
+}
+
+bool LSMStorage::write(const Bucket& bucket, const Key& key, const String& strToWrite, const CommitCallback& cb, const String& timestamp) {
+    StorageAction action(StorageAction::Write, key);
+    action.value = strToWrite;
+    addAction(bucket, action, cb);
+    return true;
+}
+
+bool LSMStorage::read(const Bucket& bucket, const Key& key, const CommitCallback& cb, const String& timestamp) {
+    addAction(bucket, StorageAction(StorageAction::Read, key), cb);
+    return true;
+}
+
+bool LSMStorage::compare(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb, const String& timestamp) {
+    StorageAction action(StorageAction::Compare, key);
+    action.value = value;
+    addAction(bucket, action, cb);
+    return true;
+}
+
+bool LSMStorage::rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb, const String& timestamp) {
+    StorageAction action(StorageAction::ReadRange, start);
+    action.keyEnd = finish;
+    addAction(bucket, action, cb);
+    return true;
+}
+
+bool LSMStorage::rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb, const String& timestamp) {
+    StorageAction action(StorageAction::EraseRange, start);
+    action.keyEnd = finish;
+    addAction(bucket, action, cb);
+    return true;
+}
+
+void LSMStorage::postProcessTransactions() {
+    mIOService->post(
+        std::tr1::bind(&LSMStorage::processTransactions, this),
+        "LSMStorage::processTransactions"
+    );
+}
+
+void LSMStorage::processTransactions() {
+    while(!mTransactionQueue.empty()) {
+        std::vector<TransactionData> transactions;
+        std::vector<Result> results;
+        std::vector<ReadSet*> read_sets;
+
+        // Run every waiting transaction, up to the limit, against a shared
+        // overlay so later ones see the effects of earlier ones, then write
+        // all their changes at once.
+        Overlay overlay(mStore);
+        while(!mTransactionQueue.empty() && transactions.size() < mMaxGroupedTransactions) {
+            TransactionData data;
+            bool popped = mTransactionQueue.pop(data);
+            assert(popped);
+
+            ReadSet* rs = NULL;
+            Result result = TRANSACTION_ERROR;
+            if (mStore != NULL)
+                result = executeCommit(data.bucket, data.trans, &overlay, &rs);
+            // Failed transactions leave no changes behind
+            if (result == SUCCESS) {
+                for(LSMEntryMap::iterator it = overlay.trans->begin(); it != overlay.trans->end(); it++)
+                    (*overlay.group)[it->first] = it->second;
+            }
+            overlay.trans->clear();
+
+            transactions.push_back(data);
+            results.push_back(result);
+            read_sets.push_back(rs);
+        }
+
+        if (!overlay.group->empty()) {
+            LSMStore::WriteBatch batch(overlay.group->begin(), overlay.group->end());
+            if (!mStore->write(batch)) {
+                // None of the group's changes were applied. Transactions
+                // that only read may have seen them, so fail everything.
+                for(uint32 i = 0; i < transactions.size(); i++) {
+                    results[i] = TRANSACTION_ERROR;
+                    delete read_sets[i];
+                    read_sets[i] = NULL;
+                }
+            }
+        }
+
+        for(uint32 i = 0; i < transactions.size(); i++) {
+            delete transactions[i].trans;
+            if (transactions[i].cb) {
+                mContext->mainStrand->post(
+                    std::tr1::bind(transactions[i].cb, results[i], read_sets[i]),
+                    "LSMStorage completeCommit"
+                );
+            }
+            else {
+                delete read_sets[i];
+            }
+        }
+    }
+}
+
+Storage::Result LSMStorage::executeCommit(const Bucket& bucket, Transaction* trans, Overlay* overlay, ReadSet** read_set_out) {
+    ReadSet* rs = new ReadSet;
+    String prefix = bucket.rawHexData();
+
+    Result result = SUCCESS;
+    for (Transaction::iterator it = trans->begin(); (result == SUCCESS) && it != trans->end(); it++) {
+        StorageAction& action = *it;
+        switch(action.type) {
+          case StorageAction::Read:
+          case StorageAction::Compare:
+              {
+                  LSMEntry entry;
+                  bool found;
+                  if (!overlay->get(prefix + action.key, &entry, &found) || !found || entry.deleted)
+                      result = TRANSACTION_ERROR;
+                  else if (action.type == StorageAction::Read)
+                      (*rs)[action.key] = entry.value;
+                  else if (entry.value != action.value)
+                      result = TRANSACTION_ERROR;
+              }
+              break;
+          case StorageAction::Write:
+              (*overlay->trans)[prefix + action.key] = LSMEntry(action.value);
+              break;
+          case StorageAction::Erase:
+              (*overlay->trans)[prefix + action.key] = LSMEntry::tombstone();
+              break;
+          case StorageAction::ReadRange:
+          case StorageAction::EraseRange:
+              {
+                  String end = prefix + action.keyEnd;
+                  std::vector<String> erased;
+                  bool found = false;
+                  LSMIteratorPtr range_it = overlay->iterator();
+                  for(range_it->seek(prefix + action.key); range_it->valid() && range_it->key() <= end; range_it->next()) {
+                      if (range_it->entry().deleted) continue;
+                      found = true;
+                      if (action.type == StorageAction::ReadRange)
+                          (*rs)[range_it->key().substr(prefix.size())] = range_it->entry().value;
+                      else
+                          erased.push_back(range_it->key());
+                  }
+                  if (range_it->failed() || (action.type == StorageAction::ReadRange && !found))
+                      result = TRANSACTION_ERROR;
+                  for(uint32 i = 0; i < erased.size(); i++)
+                      (*overlay->trans)[erased[i]] = LSMEntry::tombstone();
+              }
+              break;
+        }
+    }
+
+    if (rs->empty() || (result != SUCCESS)) {
+        delete rs;
+        rs = NULL;
+    }
+
+    *read_set_out = rs;
+    return result;
+}
+
+bool LSMStorage::count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb, const String& timestamp) {
+    // Like the other backends, counts don't participate in transactions
+    mIOService->post(
+        std::tr1::bind(&LSMStorage::executeCount, this, bucket, start, finish, cb),
+        "LSMStorage::executeCount"
+    );
+    return true;
+}
+
+void LSMStorage::executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb)
+{
+    bool success = (mStore != NULL);
+    int32 count = 0;
+
+    if (success) {
+        String end = storeKey(bucket, finish);
+        LSMIteratorPtr it = mStore->iterator();
+        for(it->seek(storeKey(bucket, start)); it->valid() && it->key() <= end; it->next()) {
+            if (!it->entry().deleted)
+                count++;
+        }
+        // Don't report a partial count
+        if (it->failed()) {
+            success = false;
+            count = 0;
+        }
+    }
+
+    if (cb) {
+        Result result = (success ? SUCCESS : TRANSACTION_ERROR);
+        mContext->mainStrand->post(
+            std::tr1::bind(cb, result, count),
+            "LSMStorage completeCount"
+        );
+    }
+}
+
+bool LSMStorage::rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp) {
+    Key last;
+    if (max_keys == 0 || (!token.empty() && !decodeScanToken(start, token, &last)))
+        return false;
+
+    mIOService->post(
+        std::tr1::bind(&LSMStorage::executeScan, this, bucket, start, finish, token, max_keys, cb),
+        "LSMStorage::executeScan"
+    );
+    return true;
+}
+
+void LSMStorage::executeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, ScanCallback cb)
+{
+    bool success = (mStore != NULL);
+    ReadSet* rs = NULL;
+    ScanToken next;
+
+    if (success) {
+        rs = new ReadSet();
+
+        // Resuming starts just after the last key of the previous page
+        Key from = start;
+        bool resuming = !token.empty();
+        if (resuming) decodeScanToken(start, token, &from);
+
+        String prefix = bucket.rawHexData();
+        String from_key = prefix + from;
+        String end = prefix + finish;
+        uint32 nread = 0;
+        Key last_key;
+        LSMIteratorPtr it = mStore->iterator();
+        for(it->seek(from_key); it->valid() && it->key() <= end; it->next()) {
+            if (it->entry().deleted || (resuming && it->key() == from_key))
+                continue;
+            // A live key past the end of the page means there's another page
+            if (nread == max_keys) {
+                next = encodeScanToken(start, last_key);
+                break;
+            }
+            nread++;
+            last_key = it->key().substr(prefix.size());
+            (*rs)[last_key] = it->entry().value;
+        }
+        // Don't report a partial page
+        if (it->failed()) {
+            success = false;
+            delete rs;
+            rs = NULL;
+            next = ScanToken();
+        }
+    }
+
+    if (cb) {
+        Result result = (success ? SUCCESS : TRANSACTION_ERROR);
+        mContext->mainStrand->post(
+            std::tr1::bind(cb, result, rs, next),
+            "LSMStorage completeScan"
+        );
+    }
+    else {
+        delete rs;
+    }
+}
+
+} //end namespace OH
+} //end namespace Sirikata
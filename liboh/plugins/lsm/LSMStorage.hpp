@@ -0,0 +1,144 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef __SIRIKATA_OH_STORAGE_LSM_HPP__
+#define __SIRIKATA_OH_STORAGE_LSM_HPP__
+
+#include <sirikata/oh/Storage.hpp>
+#include <sirikata/core/queue/ThreadSafeQueueWithNotification.hpp>
+#include "LSMStore.hpp"
+
+namespace Sirikata {
+namespace OH {
+
+/** Storage backed by an embedded LSMStore in a local directory.
+ *
+ *  Keys in the store are the bucket's hex representation followed by the
+ *  key, so each bucket is a contiguous range. Transactions are queued and
+ *  processed on a separate IO thread, and all the transactions that are
+ *  waiting when it wakes up, up to a limit, are committed together with a
+ *  single append to the write-ahead log.
+ *
+ *  The store's directory is locked by a single process, so there's no need
+ *  for leases between object hosts: leaseBucket and releaseBucket do nothing.
+ */
+class LSMStorage : public Storage
+{
+public:
+    LSMStorage(ObjectHostContext* ctx, const LSMStore::Options& opts);
+    ~LSMStorage();
+
+    virtual void start();
+    virtual void stop();
+
+    virtual void leaseBucket(const Bucket& bucket);
+    virtual void releaseBucket(const Bucket& bucket);
+
+    virtual void beginTransaction(const Bucket& bucket);
+
+    virtual void commitTransaction(const Bucket& bucket, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool erase(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool write(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool read(const Bucket& bucket, const Key& key, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool compare(const Bucket& bucket, const Key& key, const String& value, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
+    virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp="current");
+
+private:
+    struct StorageAction {
+        enum Type {
+            Read,
+            ReadRange,
+            Compare,
+            Write,
+            Erase,
+            EraseRange
+        };
+
+        StorageAction(Type t, const Key& k)
+         : type(t), key(k), keyEnd(), value()
+        {}
+
+        Type type;
+        Key key;
+        Key keyEnd; // Only relevant for *Range
+        String value; // Only relevant for Write and Compare
+    };
+
+    typedef std::vector<StorageAction> Transaction;
+    typedef std::tr1::unordered_map<Bucket, Transaction*, Bucket::Hasher> BucketTransactions;
+
+    struct TransactionData {
+        TransactionData()
+         : bucket(), trans(NULL), cb()
+        {}
+        TransactionData(const Bucket& b, Transaction* t, CommitCallback c)
+         : bucket(b), trans(t), cb(c)
+        {}
+
+        Bucket bucket;
+        Transaction* trans;
+        CommitCallback cb;
+    };
+    typedef ThreadSafeQueueWithNotification<TransactionData> TransactionQueue;
+
+    // Changes that haven't been written to the store yet. Transactions see
+    // their own changes, then those of earlier transactions in the same
+    // group, then the store.
+    struct Overlay {
+        Overlay(LSMStore* s)
+         : store(s),
+           group(new LSMEntryMap()),
+           trans(new LSMEntryMap())
+        {}
+
+        bool get(const String& key, LSMEntry* entry_out, bool* found_out);
+        LSMIteratorPtr iterator();
+
+        LSMStore* store;
+        LSMEntryMapPtr group;
+        LSMEntryMapPtr trans;
+    };
+
+    Transaction* getTransaction(const Bucket& bucket, bool* is_new = NULL);
+    // Add an action, committing it immediately if there's no transaction
+    void addAction(const Bucket& bucket, const StorageAction& action, const CommitCallback& cb);
+
+    void openStore();
+
+    // Indirection to get on mIOService
+    void postProcessTransactions();
+    // Process transactions. Runs until queue is empty and is triggered anytime
+    // the queue goes from empty to non-empty.
+    void processTransactions();
+    // Run a transaction against the overlay, leaving its changes in
+    // overlay->trans
+    Result executeCommit(const Bucket& bucket, Transaction* trans, Overlay* overlay, ReadSet** read_set_out);
+
+    void executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb);
+    void executeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, ScanCallback cb);
+
+    static String storeKey(const Bucket& bucket, const Key& key);
+
+    ObjectHostContext* mContext;
+    BucketTransactions mTransactions;
+    LSMStore::Options mOptions;
+    // Only valid once opened on the IO thread
+    LSMStore* mStore;
+
+    Network::IOService* mIOService;
+    Network::IOWork* mWork;
+    Thread* mThread;
+
+    TransactionQueue mTransactionQueue;
+    // Maximum number of transactions to commit with a single log append
+    uint32 mMaxGroupedTransactions;
+};
+
+}//end namespace OH
+}//end namespace Sirikata
+
+#endif //__SIRIKATA_OH_STORAGE_LSM_HPP__
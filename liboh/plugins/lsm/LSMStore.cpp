@@ -0,0 +1,601 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "LSMStore.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+#define MANIFEST_FILE "MANIFEST"
+#define LOCK_FILE "LOCK"
+// Rough per-entry overhead of the memtable, used to decide when to flush
+#define MEMTABLE_ENTRY_OVERHEAD 48
+// How long a write waits for the previous memtable to be flushed before
+// giving up, e.g. because flushes keep failing on a full disk
+#define MAX_FLUSH_WAIT_SECONDS 30
+
+namespace Sirikata {
+namespace OH {
+
+using namespace LSMFormat;
+
+namespace {
+// Entry types in log records
+enum {
+    LogPut = 0,
+    LogErase = 1
+};
+}
+
+LSMStore::LSMStore(const Options& opts)
+ : mOptions(opts),
+   mLockFile(NULL),
+   mLock(NULL),
+   mLog(NULL),
+   mLogNumber(0),
+   mLogFailed(false),
+   mMemtable(new LSMEntryMap()),
+   mMemtableBytes(0),
+   mImmutable(),
+   mSegments(),
+   mManifestLog(1),
+   mNextFile(1),
+   mClosing(false),
+   mIOService(NULL),
+   mWork(NULL),
+   mThread(NULL)
+{
+}
+
+LSMStore::~LSMStore() {
+    close();
+}
+
+String LSMStore::path(uint64 number, const char* ext) const {
+    std::ostringstream ss;
+    ss << mOptions.dir << "/" << number << "." << ext;
+    return ss.str();
+}
+
+bool LSMStore::open() {
+    try {
+        boost::filesystem::create_directories(mOptions.dir);
+    }
+    catch(boost::filesystem::filesystem_error& e) {
+        SILOG(lsm-storage, error, "Couldn't create storage directory " << mOptions.dir << ": " << e.what());
+        return false;
+    }
+
+    // file_lock requires that the file already exists
+    String lock_path = mOptions.dir + "/" LOCK_FILE;
+    mLockFile = fopen(lock_path.c_str(), "a");
+    if (mLockFile == NULL) {
+        SILOG(lsm-storage, error, "Couldn't create lock file " << lock_path);
+        return false;
+    }
+    try {
+        mLock = new boost::interprocess::file_lock(lock_path.c_str());
+        if (!mLock->try_lock()) {
+            SILOG(lsm-storage, error, "Storage directory " << mOptions.dir << " is in use by another process");
+            unlockDir();
+            return false;
+        }
+    }
+    catch(boost::interprocess::interprocess_exception& e) {
+        SILOG(lsm-storage, error, "Couldn't lock storage directory " << mOptions.dir << ": " << e.what());
+        unlockDir();
+        return false;
+    }
+
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    mClosing = false;
+    mLogFailed = false;
+
+    uint64 first_log = 1;
+    std::vector<uint64> segment_numbers;
+    if (boost::filesystem::exists(mOptions.dir + "/" MANIFEST_FILE) &&
+        !readManifest(&first_log, &segment_numbers))
+    {
+        SILOG(lsm-storage, error, "Couldn't read manifest in " << mOptions.dir);
+        unlockDir();
+        return false;
+    }
+
+    for(uint32 i = 0; i < segment_numbers.size(); i++) {
+        LSMSegmentPtr seg = LSMSegment::open(path(segment_numbers[i], "seg"), segment_numbers[i]);
+        if (!seg) {
+            mSegments.clear();
+            unlockDir();
+            return false;
+        }
+        mSegments.push_back(seg);
+    }
+
+    // Recover writes that never made it into a segment
+    for(uint64 n = first_log; n < mNextFile; n++) {
+        if (boost::filesystem::exists(path(n, "log")) && !replayLog(n)) {
+            mSegments.clear();
+            mMemtable.reset(new LSMEntryMap());
+            mMemtableBytes = 0;
+            unlockDir();
+            return false;
+        }
+    }
+    if (!mMemtable->empty()) {
+        uint64 seg_number = mNextFile++;
+        LSMMapIterator it(mMemtable);
+        LSMSegmentPtr seg = LSMSegment::write(path(seg_number, "seg"), seg_number, &it, false, mOptions.blockEntries, true);
+        mMemtable.reset(new LSMEntryMap());
+        mMemtableBytes = 0;
+        if (!seg) {
+            mSegments.clear();
+            unlockDir();
+            return false;
+        }
+        mSegments.insert(mSegments.begin(), seg);
+    }
+
+    uint64 log_number = mNextFile++;
+    mManifestLog = log_number;
+    if (!writeManifest() || !openLog(log_number)) {
+        mSegments.clear();
+        unlockDir();
+        return false;
+    }
+    // Everything in the old logs is now in segments, and anything else was
+    // left behind by a crash
+    removeObsoleteFiles();
+
+    lck.unlock();
+
+    mIOService = new Network::IOService("LSMStore");
+    mWork = new Network::IOWork(*mIOService, "LSMStore Background");
+    mThread = new Sirikata::Thread("LSMStore Background", std::tr1::bind(&Network::IOService::runNoReturn, mIOService));
+    mIOService->post(std::tr1::bind(&LSMStore::maybeCompact, this), "LSMStore::maybeCompact");
+
+    return true;
+}
+
+void LSMStore::close() {
+    if (mThread != NULL) {
+        {
+            boost::unique_lock<boost::mutex> lck(mMutex);
+            mClosing = true;
+            mFlushDone.notify_all();
+        }
+        // Let outstanding flushes and compactions finish
+        delete mWork;
+        mWork = NULL;
+        mThread->join();
+        delete mThread;
+        mThread = NULL;
+        delete mIOService;
+        mIOService = NULL;
+    }
+
+    if (mLog != NULL) {
+        fclose(mLog);
+        mLog = NULL;
+    }
+
+    // Anything left in memory is in the logs
+    mMemtable.reset(new LSMEntryMap());
+    mMemtableBytes = 0;
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        mImmutable.reset();
+        mSegments.clear();
+    }
+
+    unlockDir();
+}
+
+void LSMStore::unlockDir() {
+    if (mLock != NULL) {
+        try {
+            mLock->unlock();
+        }
+        catch(boost::interprocess::interprocess_exception&) {
+        }
+        delete mLock;
+        mLock = NULL;
+    }
+    if (mLockFile != NULL) {
+        fclose(mLockFile);
+        mLockFile = NULL;
+    }
+}
+
+bool LSMStore::readManifest(uint64* log_out, std::vector<uint64>* segments_out) {
+    std::ifstream manifest((mOptions.dir + "/" MANIFEST_FILE).c_str());
+    if (!manifest) return false;
+
+    bool have_next = false;
+    String kind;
+    uint64 number;
+    while(manifest >> kind >> number) {
+        if (kind == "log")
+            *log_out = number;
+        else if (kind == "next") {
+            mNextFile = number;
+            have_next = true;
+        }
+        else if (kind == "segment")
+            segments_out->push_back(number);
+        else
+            return false;
+    }
+    return have_next && manifest.eof();
+}
+
+bool LSMStore::writeManifest() {
+    std::ostringstream ss;
+    ss << "log " << mManifestLog << "\n";
+    ss << "next " << mNextFile << "\n";
+    for(SegmentList::iterator it = mSegments.begin(); it != mSegments.end(); it++)
+        ss << "segment " << (*it)->number() << "\n";
+    String data = ss.str();
+
+    // Write a new copy and swap it in so a crash leaves either the old or new
+    // manifest intact
+    String manifest_path = mOptions.dir + "/" MANIFEST_FILE;
+    String tmp_path = manifest_path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL) {
+        SILOG(lsm-storage, error, "Couldn't create " << tmp_path);
+        return false;
+    }
+    bool success = (fwrite(data.data(), 1, data.size(), fp) == data.size()) && syncFile(fp);
+    fclose(fp);
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_WINDOWS
+    // rename won't replace an existing file on Windows
+    if (success)
+        std::remove(manifest_path.c_str());
+#endif
+    success = success && (std::rename(tmp_path.c_str(), manifest_path.c_str()) == 0);
+    if (!success)
+        SILOG(lsm-storage, error, "Couldn't write manifest in " << mOptions.dir);
+    return success;
+}
+
+bool LSMStore::replayLog(uint64 number) {
+    String log_path = path(number, "log");
+    FILE* fp = fopen(log_path.c_str(), "rb");
+    if (fp == NULL) {
+        SILOG(lsm-storage, error, "Couldn't open log " << log_path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long remaining = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    // Each record is applied only if it is complete and intact. A damaged
+    // record can only be the last one, from a write interrupted by a crash, so
+    // stop there.
+    uint64 nrecords = 0;
+    while(remaining > 0) {
+        String header(8, '\0');
+        uint32 len = 0, crc = 0;
+        size_t pos = 0;
+        if (!readFully(fp, &header[0], header.size()) ||
+            !getFixed32(header, &pos, &len) ||
+            !getFixed32(header, &pos, &crc) ||
+            (long)len > remaining - 8)
+            break;
+        remaining -= 8;
+
+        String payload(len, '\0');
+        if (!readFully(fp, &payload[0], payload.size()) || checksum(payload) != crc)
+            break;
+        remaining -= len;
+
+        WriteBatch batch;
+        pos = 0;
+        uint64 count = 0;
+        bool valid = getVarint(payload, &pos, &count);
+        for(uint64 i = 0; valid && i < count; i++) {
+            LSMEntry entry;
+            String key;
+            valid = (pos < payload.size());
+            if (!valid) break;
+            entry.deleted = (payload[pos++] == LogErase);
+            valid = getString(payload, &pos, &key) &&
+                (entry.deleted || getString(payload, &pos, &entry.value));
+            batch.push_back(std::make_pair(key, entry));
+        }
+        if (!valid)
+            break;
+
+        for(WriteBatch::iterator it = batch.begin(); it != batch.end(); it++)
+            applyToMemtable(it->first, it->second);
+        nrecords++;
+    }
+    if (remaining > 0)
+        SILOG(lsm-storage, warning, "Ignoring damaged tail of log " << log_path);
+
+    SILOG(lsm-storage, detailed, "Recovered " << nrecords << " records from " << log_path);
+    fclose(fp);
+    return true;
+}
+
+void LSMStore::applyToMemtable(const String& key, const LSMEntry& entry) {
+    mMemtableBytes += key.size() + entry.value.size() + MEMTABLE_ENTRY_OVERHEAD;
+    (*mMemtable)[key] = entry;
+}
+
+bool LSMStore::openLog(uint64 number) {
+    String log_path = path(number, "log");
+    FILE* fp = fopen(log_path.c_str(), "wb");
+    if (fp == NULL) {
+        SILOG(lsm-storage, error, "Couldn't create log " << log_path);
+        return false;
+    }
+    if (mLog != NULL)
+        fclose(mLog);
+    mLog = fp;
+    mLogNumber = number;
+    return true;
+}
+
+void LSMStore::removeLogs(uint64 first, uint64 end) {
+    for(uint64 n = first; n < end; n++) {
+        String log_path = path(n, "log");
+        try {
+            if (boost::filesystem::exists(log_path))
+                boost::filesystem::remove(log_path);
+        }
+        catch(boost::filesystem::filesystem_error&) {
+            SILOG(lsm-storage, warning, "Couldn't remove old log " << log_path);
+        }
+    }
+}
+
+void LSMStore::removeObsoleteFiles() {
+    std::set<uint64> live;
+    for(SegmentList::iterator it = mSegments.begin(); it != mSegments.end(); it++)
+        live.insert((*it)->number());
+
+    std::vector<String> obsolete;
+    try {
+        boost::filesystem::directory_iterator end;
+        for(boost::filesystem::directory_iterator it(mOptions.dir); it != end; it++) {
+            String name = it->path().string();
+            name = name.substr(name.find_last_of("/\\") + 1);
+
+            std::size_t dot = name.find('.');
+            if (dot == String::npos) continue;
+            String ext = name.substr(dot + 1);
+            uint64 number;
+            try {
+                number = boost::lexical_cast<uint64>(name.substr(0, dot));
+            }
+            catch(boost::bad_lexical_cast&) {
+                continue;
+            }
+
+            if ((ext == "seg" && live.find(number) == live.end()) ||
+                (ext == "log" && number < mLogNumber))
+                obsolete.push_back(it->path().string());
+        }
+        for(uint32 i = 0; i < obsolete.size(); i++)
+            boost::filesystem::remove(obsolete[i]);
+    }
+    catch(boost::filesystem::filesystem_error& e) {
+        SILOG(lsm-storage, warning, "Couldn't remove obsolete files from " << mOptions.dir << ": " << e.what());
+    }
+}
+
+bool LSMStore::write(const WriteBatch& batch) {
+    if (mLog == NULL || mLogFailed)
+        return false;
+    if (batch.empty())
+        return true;
+
+    // Make room before logging the batch, so that if the previous memtable
+    // can't be flushed this write fails instead of one that's already applied
+    if (mMemtableBytes >= mOptions.memtableSize && !rotateMemtable()) {
+        SILOG(lsm-storage, error, "Couldn't start a new memtable, no more writes will be accepted");
+        mLogFailed = true;
+        return false;
+    }
+
+    String payload;
+    putVarint(&payload, batch.size());
+    for(WriteBatch::const_iterator it = batch.begin(); it != batch.end(); it++) {
+        payload.push_back((char)(it->second.deleted ? LogErase : LogPut));
+        putString(&payload, it->first);
+        if (!it->second.deleted)
+            putString(&payload, it->second.value);
+    }
+    String record;
+    putFixed32(&record, (uint32)payload.size());
+    putFixed32(&record, checksum(payload));
+    record.append(payload);
+
+    bool success =
+        (fwrite(record.data(), 1, record.size(), mLog) == record.size()) &&
+        (fflush(mLog) == 0);
+    if (success && mOptions.sync)
+        success = syncFile(mLog);
+    if (!success) {
+        SILOG(lsm-storage, error, "Error appending to log " << path(mLogNumber, "log") << ", no more writes will be accepted");
+        mLogFailed = true;
+        return false;
+    }
+
+    for(WriteBatch::const_iterator it = batch.begin(); it != batch.end(); it++)
+        applyToMemtable(it->first, it->second);
+
+    return true;
+}
+
+bool LSMStore::rotateMemtable() {
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    // Only one memtable can be waiting to be flushed. If writes outpace
+    // flushes, block until the last one finishes, but not forever: a flush
+    // that keeps failing would otherwise hang the writer and close().
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(MAX_FLUSH_WAIT_SECONDS);
+    while(mImmutable) {
+        if (mClosing || !mFlushDone.timed_wait(lck, deadline)) {
+            if (!mImmutable) break;
+            SILOG(lsm-storage, error, "Gave up waiting for the previous memtable to be flushed");
+            return false;
+        }
+    }
+
+    uint64 seg_number = mNextFile++;
+    uint64 log_number = mNextFile++;
+    // Record the new log before creating it so recovery will find it
+    if (!writeManifest() || !openLog(log_number))
+        return false;
+
+    mImmutable = mMemtable;
+    mMemtable.reset(new LSMEntryMap());
+    mMemtableBytes = 0;
+
+    mIOService->post(
+        std::tr1::bind(&LSMStore::flushMemtable, this, mImmutable, seg_number, log_number),
+        "LSMStore::flushMemtable"
+    );
+    return true;
+}
+
+void LSMStore::flushMemtable(LSMEntryMapPtr mem, uint64 segment_number, uint64 next_log) {
+    // Tombstones are kept since older segments may have values for the keys
+    LSMMapIterator it(mem);
+    LSMSegmentPtr seg = LSMSegment::write(path(segment_number, "seg"), segment_number, &it, false, mOptions.blockEntries, true);
+
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    if (!seg) {
+        // Keep serving reads from the immutable memtable and try again
+        // later. The data is still in the logs.
+        if (!mClosing) {
+            mIOService->post(
+                Duration::seconds(1),
+                std::tr1::bind(&LSMStore::flushMemtable, this, mem, segment_number, next_log),
+                "LSMStore::flushMemtable"
+            );
+        }
+        return;
+    }
+
+    mSegments.insert(mSegments.begin(), seg);
+    uint64 first_log = mManifestLog;
+    mManifestLog = next_log;
+    mImmutable.reset();
+    bool recorded = writeManifest();
+    mFlushDone.notify_all();
+    lck.unlock();
+
+    // If the manifest couldn't be written the old logs are still needed.
+    // They'll be cleaned up after they're replayed by the next open().
+    if (recorded)
+        removeLogs(first_log, next_log);
+
+    maybeCompact();
+}
+
+void LSMStore::maybeCompact() {
+    // Flushes and compactions both run on the background thread, so the
+    // segment list can't change until this compaction finishes.
+    SegmentList inputs;
+    uint64 number;
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        if (mSegments.size() <= mOptions.maxSegments)
+            return;
+        inputs = mSegments;
+        number = mNextFile++;
+    }
+
+    std::vector<LSMIteratorPtr> sources;
+    uint64 input_entries = 0;
+    for(SegmentList::iterator it = inputs.begin(); it != inputs.end(); it++) {
+        sources.push_back((*it)->iterator());
+        input_entries += (*it)->entries();
+    }
+    LSMMergingIterator merged(sources);
+    // This merges every segment, so there's nothing older left for
+    // tombstones to hide and they can be dropped. If any input can't be read
+    // the write fails and the inputs are kept, so nothing they hold is lost.
+    LSMSegmentPtr output = LSMSegment::write(path(number, "seg"), number, &merged, true, mOptions.blockEntries, true);
+    if (!output) {
+        SILOG(lsm-storage, error, "Compaction of " << inputs.size() << " segments failed, keeping them");
+        return;
+    }
+
+    boost::unique_lock<boost::mutex> lck(mMutex);
+    mSegments.clear();
+    mSegments.push_back(output);
+    if (!writeManifest()) {
+        // The manifest on disk still lists the old segments, keep using them
+        mSegments = inputs;
+        output->setObsolete();
+        return;
+    }
+    for(SegmentList::iterator it = inputs.begin(); it != inputs.end(); it++)
+        (*it)->setObsolete();
+
+    SILOG(lsm-storage, detailed, "Compacted " << inputs.size() << " segments with " << input_entries << " entries into " << output->entries() << " entries");
+}
+
+bool LSMStore::get(const String& key, LSMEntry* entry_out, bool* found_out) {
+    *found_out = true;
+    LSMEntryMap::const_iterator mem_it = mMemtable->find(key);
+    if (mem_it != mMemtable->end()) {
+        *entry_out = mem_it->second;
+        return true;
+    }
+
+    LSMEntryMapPtr immutable;
+    SegmentList segments;
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        immutable = mImmutable;
+        segments = mSegments;
+    }
+
+    if (immutable) {
+        mem_it = immutable->find(key);
+        if (mem_it != immutable->end()) {
+            *entry_out = mem_it->second;
+            return true;
+        }
+    }
+
+    for(SegmentList::iterator it = segments.begin(); it != segments.end(); it++) {
+        if (!(*it)->get(key, entry_out, found_out))
+            return false;
+        if (*found_out)
+            return true;
+    }
+    *found_out = false;
+    return true;
+}
+
+LSMIteratorPtr LSMStore::iterator() {
+    std::vector<LSMIteratorPtr> sources;
+    sources.push_back(LSMIteratorPtr(new LSMMapIterator(mMemtable)));
+
+    LSMEntryMapPtr immutable;
+    SegmentList segments;
+    {
+        boost::unique_lock<boost::mutex> lck(mMutex);
+        immutable = mImmutable;
+        segments = mSegments;
+    }
+
+    if (immutable)
+        sources.push_back(LSMIteratorPtr(new LSMMapIterator(immutable)));
+    for(SegmentList::iterator it = segments.begin(); it != segments.end(); it++)
+        sources.push_back((*it)->iterator());
+
+    return LSMIteratorPtr(new LSMMergingIterator(sources));
+}
+
+} // namespace OH
+} // namespace Sirikata
@@ -0,0 +1,151 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef __SIRIKATA_OH_STORAGE_LSM_STORE_HPP__
+#define __SIRIKATA_OH_STORAGE_LSM_STORE_HPP__
+
+#include "LSMSegment.hpp"
+#include <sirikata/core/network/IOService.hpp>
+#include <sirikata/core/network/IOWork.hpp>
+#include <sirikata/core/util/Thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+
+namespace Sirikata {
+namespace OH {
+
+/** An embedded log-structured merge tree key-value store.
+ *
+ *  Writes are appended to a write-ahead log and applied to an in-memory
+ *  table. When the table grows past a size limit it becomes immutable, a new
+ *  log is started, and a background thread writes the table out as a sorted
+ *  segment. Once there are too many segments the background thread merges them
+ *  all into one, dropping overwritten values and erased keys.
+ *
+ *  The directory holds the logs (<n>.log), segments (<n>.seg), a MANIFEST
+ *  listing the live segments and the oldest log that still needs to be
+ *  replayed, and a LOCK file which keeps other processes from opening the same
+ *  store.
+ *
+ *  write(), get() and iterator() must all be called from the same thread. The
+ *  background thread only touches immutable data.
+ */
+class LSMStore {
+public:
+    struct Options {
+        Options()
+         : dir("storage.lsm"),
+           memtableSize(4*1024*1024),
+           maxSegments(4),
+           blockEntries(16),
+           sync(true)
+        {}
+
+        String dir;
+        // Approximate number of bytes to buffer in memory before flushing
+        uint32 memtableSize;
+        // Number of segments to allow before compacting them
+        uint32 maxSegments;
+        // Maximum number of entries in each segment block
+        uint32 blockEntries;
+        // Whether to sync the log to disk before write() returns
+        bool sync;
+    };
+
+    // A set of changes applied atomically. Erases are tombstone entries.
+    typedef std::vector<std::pair<String, LSMEntry> > WriteBatch;
+
+    LSMStore(const Options& opts);
+    ~LSMStore();
+
+    /** Lock the directory, recover any data left in logs and start the
+     *  background thread. Returns false if the store couldn't be opened.
+     */
+    bool open();
+    /** Wait for background work to finish and release the store. */
+    void close();
+
+    /** Apply all the changes in batch with a single log append. Returns false
+     *  if the changes couldn't be logged, or if the memtable is full and the
+     *  previous one couldn't be flushed in time, in which case none are
+     *  applied and no more writes are accepted.
+     */
+    bool write(const WriteBatch& batch);
+
+    /** Look up a key, setting found_out to whether any entry, including a
+     *  tombstone, exists for it. Returns false if a segment couldn't be read.
+     *  Older segments aren't checked in that case, since they could hold a
+     *  value the unreadable entry replaced.
+     */
+    bool get(const String& key, LSMEntry* entry_out, bool* found_out);
+
+    /** Get an iterator over the entire store, including tombstones. It must
+     *  not be used after the next call to write(). Check its failed() when
+     *  done iterating.
+     */
+    LSMIteratorPtr iterator();
+
+private:
+    typedef std::vector<LSMSegmentPtr> SegmentList;
+
+    String path(uint64 number, const char* ext) const;
+
+    // Manifest, must be called with mMutex held
+    bool readManifest(uint64* log_out, std::vector<uint64>* segments_out);
+    bool writeManifest();
+
+    // Recovery
+    bool replayLog(uint64 number);
+    void applyToMemtable(const String& key, const LSMEntry& entry);
+
+    bool openLog(uint64 number);
+    void removeLogs(uint64 first, uint64 end);
+    // Remove logs and segments that are no longer referenced by the manifest
+    void removeObsoleteFiles();
+    void unlockDir();
+
+    // Freeze the memtable, start a new log and schedule a flush
+    bool rotateMemtable();
+
+    // Background thread
+    void flushMemtable(LSMEntryMapPtr mem, uint64 segment_number, uint64 next_log);
+    void maybeCompact();
+
+    const Options mOptions;
+
+    FILE* mLockFile;
+    boost::interprocess::file_lock* mLock;
+
+    FILE* mLog;
+    uint64 mLogNumber;
+    // Set if a log write fails. The tail of the log may be corrupt, so no
+    // more writes are accepted.
+    bool mLogFailed;
+
+    // Only used by the writing thread
+    LSMEntryMapPtr mMemtable;
+    uint64 mMemtableBytes;
+
+    // Protects everything below, which is shared with the background thread
+    boost::mutex mMutex;
+    boost::condition_variable mFlushDone;
+    LSMEntryMapPtr mImmutable;
+    // Newest first
+    SegmentList mSegments;
+    // Oldest log that may contain data not in a segment
+    uint64 mManifestLog;
+    uint64 mNextFile;
+    // Set while closing so failed flushes aren't retried. Their data is
+    // still in the logs and will be recovered on the next open().
+    bool mClosing;
+
+    Network::IOService* mIOService;
+    Network::IOWork* mWork;
+    Thread* mThread;
+};
+
+} // namespace OH
+} // namespace Sirikata
+
+#endif //__SIRIKATA_OH_STORAGE_LSM_STORE_HPP__
@@ -0,0 +1,69 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/oh/Platform.hpp>
+#include <sirikata/core/options/Options.hpp>
+#include "LSMStorage.hpp"
+
+static int lsmoh_plugin_refcount = 0;
+
+namespace Sirikata {
+
+static void InitPluginOptions() {
+    Sirikata::InitializeClassOptions ico("lsmstorage",NULL,
+        new Sirikata::OptionValue("dir", "storage.lsm", Sirikata::OptionValueType<String>(), "Directory to store data in."),
+        new Sirikata::OptionValue("memtable-size", "4194304", Sirikata::OptionValueType<uint32>(), "Approximate number of bytes of recent writes to keep in memory before writing them to a new segment."),
+        new Sirikata::OptionValue("max-segments", "4", Sirikata::OptionValueType<uint32>(), "Number of segments allowed before they are compacted into one. Fewer segments make reads cheaper, but require compacting more often."),
+        new Sirikata::OptionValue("sync", "true", Sirikata::OptionValueType<bool>(), "If true, commits wait for the write-ahead log to reach the disk."),
+        NULL);
+}
+
+static OH::Storage* createLSMStorage(ObjectHostContext* ctx, const String& args) {
+    OptionSet* optionsSet = OptionSet::getOptions("lsmstorage",NULL);
+    optionsSet->parse(args);
+
+    OH::LSMStore::Options opts;
+    opts.dir = optionsSet->referenceOption("dir")->as<String>();
+    opts.memtableSize = optionsSet->referenceOption("memtable-size")->as<uint32>();
+    opts.maxSegments = optionsSet->referenceOption("max-segments")->as<uint32>();
+    opts.sync = optionsSet->referenceOption("sync")->as<bool>();
+
+    return new OH::LSMStorage(ctx, opts);
+}
+
+} // namespace Sirikata
+
+SIRIKATA_PLUGIN_EXPORT_C void init() {
+    using namespace Sirikata;
+    if (lsmoh_plugin_refcount==0) {
+        InitPluginOptions();
+        OH::StorageFactory::getSingleton()
+            .registerConstructor("lsm",
+                                 std::tr1::bind(&createLSMStorage, std::tr1::placeholders::_1, std::tr1::placeholders::_2));
+    }
+    lsmoh_plugin_refcount++;
+}
+
+SIRIKATA_PLUGIN_EXPORT_C int increfcount() {
+    return ++lsmoh_plugin_refcount;
+}
+SIRIKATA_PLUGIN_EXPORT_C int decrefcount() {
+    assert(lsmoh_plugin_refcount>0);
+    return --lsmoh_plugin_refcount;
+}
+
+SIRIKATA_PLUGIN_EXPORT_C void destroy() {
+    using namespace Sirikata;
+    if (lsmoh_plugin_refcount==0) {
+        OH::StorageFactory::getSingleton().unregisterConstructor("lsm");
+    }
+}
+
+SIRIKATA_PLUGIN_EXPORT_C const char* name() {
+    return "oh-lsm";
+}
+
+SIRIKATA_PLUGIN_EXPORT_C int refcount() {
+    return lsmoh_plugin_refcount;
+}
@@ -7,6 +7,7 @@
 #include "Protocol_Prox.pbj.hpp"
 #include "Protocol_Loc.pbj.hpp"
 #include "Protocol_Frame.pbj.hpp"
+#include <sirikata/oh/BulkLocUpdate.hpp>
 
 #include <json_spirit/json_spirit.h>
 
@@ -38,6 +39,21 @@ String destroyRequest() {
     return json::write(req);
 }
 
+// Extracts the solid angle from an object's query, using the same format as
+// the space server's queries.
+bool parseQueryAngle(const String& query, SolidAngle* angle_out) {
+    if (query.empty())
+        return false;
+
+    namespace json = json_spirit;
+    json::Value parsed;
+    if (!json::read(query, parsed))
+        return false;
+
+    *angle_out = SolidAngle( parsed.getReal("angle", SolidAngle::Max.asFloat()) );
+    return true;
+}
+
 String refineRequest(const std::vector<ObjectReference>& aggs) {
     namespace json = json_spirit;
     json::Value req = json::Object();
@@ -110,7 +126,8 @@ ManualObjectQueryProcessor* ManualObjectQueryProcessor::create(ObjectHostContext
 
 
 ManualObjectQueryProcessor::ManualObjectQueryProcessor(ObjectHostContext* ctx)
- : mContext(ctx)
+ : mContext(ctx),
+   mCutPoller(ctx->mainStrand, std::tr1::bind(&ManualObjectQueryProcessor::updateCuts, this), "ManualObjectQueryProcessor Cut Poll", Duration::milliseconds((int64)100))
 {
 }
 
@@ -120,9 +137,11 @@ ManualObjectQueryProcessor::~ManualObjectQueryProcessor() {
 void ManualObjectQueryProcessor::start() {
     mContext->objectHost->SpaceNodeSessionManager::addListener(static_cast<SpaceNodeSessionListener*>(this));
     mContext->objectHost->ObjectNodeSessionProvider::addListener(static_cast<ObjectNodeSessionListener*>(this));
+    mCutPoller.start();
 }
 
 void ManualObjectQueryProcessor::stop() {
+    mCutPoller.stop();
     mContext->objectHost->ObjectNodeSessionProvider::removeListener(static_cast<ObjectNodeSessionListener*>(this));
     mContext->objectHost->SpaceNodeSessionManager::removeListener(static_cast<SpaceNodeSessionListener*>(this));
 
@@ -202,6 +221,9 @@ void ManualObjectQueryProcessor::decrementServerQuery(ServerQueryMap::iterator s
 
     QPLOG(detailed, "Destroying server query to " << serv_it->first);
     sendDestroyRequest(serv_it);
+    // Nothing is left in the server's cut once the query is gone. If a new
+    // query is registered it starts from scratch.
+    serv_it->second->cut.clear();
 }
 
 String ManualObjectQueryProcessor::connectRequest(HostedObjectPtr ho, const SpaceObjectReference& sporef, const String& query) {
@@ -210,7 +232,7 @@ String ManualObjectQueryProcessor::connectRequest(HostedObjectPtr ho, const Spac
     if (obj_it == mObjectState.end())
         obj_it = mObjectState.insert( ObjectStateMap::value_type(sporef, ObjectState()) ).first;
     obj_it->second.who = ho;
-    obj_it->second.query = query;
+    setObjectQuery(obj_it->second, query);
 
     // Return an empty query -- we don't want any query passed on to the
     // serve. We aggregate and register the OH query separately.
@@ -230,10 +252,47 @@ void ManualObjectQueryProcessor::updateQuery(HostedObjectPtr ho, const SpaceObje
     else { // Init or update
         // Track state
         it->second.who = ho;
-        it->second.query = new_query;
-        // Update server query
-        // FIXME
+        setObjectQuery(it->second, new_query);
+        // The server query is updated with the rest of the cut on the next tick
+    }
+}
+
+void ManualObjectQueryProcessor::setObjectQuery(ObjectState& state, const String& query) {
+    state.query = query;
+    state.has_angle = parseQueryAngle(query, &state.angle);
+}
+
+void ManualObjectQueryProcessor::updateCuts() {
+    Time t = mContext->objectHost->currentLocalTime();
+    for(ServerQueryMap::iterator serv_it = mServerQueries.begin(); serv_it != mServerQueries.end(); serv_it++)
+        updateCut(serv_it, t);
+}
+
+void ManualObjectQueryProcessor::updateCut(ServerQueryMap::iterator serv_it, const Time& t) {
+    ServerQueryStatePtr& query_state = serv_it->second;
+    // No registered query to refine
+    if (query_state->nconnected == 0) return;
+
+    // Collect the queries of everyone connected through this server
+    QueryCut::ObserverList observers;
+    for(ObjectStateMap::const_iterator obj_it = mObjectState.begin(); obj_it != mObjectState.end(); obj_it++) {
+        const ObjectState& state = obj_it->second;
+        if (!state.has_angle || state.node != serv_it->first.node() || obj_it->first.space() != serv_it->first.space())
+            continue;
+        HostedObjectPtr ho = state.who.lock();
+        if (!ho) continue;
+        ProxyObjectPtr self_proxy = ho->getProxy(obj_it->first.space(), obj_it->first.object());
+        if (!self_proxy) continue;
+        observers.push_back(QueryCut::Observer(self_proxy->location().position(t), state.angle));
     }
+
+    std::vector<ObjectReference> refine, coarsen;
+    query_state->cut.update(t, observers, &refine, &coarsen);
+    // Coarsen first so the server doesn't briefly hold both
+    if (!coarsen.empty())
+        sendCoarsenRequest(serv_it, coarsen);
+    if (!refine.empty())
+        sendRefineRequest(serv_it, refine);
 }
 
 
@@ -432,6 +491,7 @@ void ManualObjectQueryProcessor::handleProximityMessage(const OHDP::SpaceNodeID&
             SpaceObjectReference observed(snid.space(), observed_oref);
 
             bool is_agg = (addition.has_type() && addition.type() == Sirikata::Protocol::Prox::ObjectAddition::Aggregate);
+            ObjectReference parent_oref = (addition.has_parent() ? ObjectReference(addition.parent()) : ObjectReference::null());
 
             // Store the data
             query_state->objects->objectAdded(
@@ -443,17 +503,19 @@ void ManualObjectQueryProcessor::handleProximityMessage(const OHDP::SpaceNodeID&
                 add.physicsOrDefault(), add.physics_seqno()
             );
 
+            query_state->cut.nodeAdded(
+                observed_oref, parent_oref, is_agg,
+                add.locationWithLocalTime(mContext->objectHost, snid.space()), add.bounds()
+            );
+
             // Replay orphans
             query_state->orphans.invokeOrphanUpdates(snid, observed, this);
 
             // TODO(ewencp) temporary code to get results out. See note above.
             addAdditionResult(obj_update, observed, query_state->objects->properties(observed_oref));
 
-            // TODO(ewencp) this is a temporary way to trigger refinement -- we
-            // just always refine whenver we see. Obviously this is inefficient
-            // and won't scale, but it's useful to get some tests running.
-            if (addition.has_type() && addition.type() == Sirikata::Protocol::Prox::ObjectAddition::Aggregate)
-                sendRefineRequest(serv_it, observed_oref);
+            // Refinement isn't triggered here, the cut is updated for all
+            // additions at once in updateCuts.
         }
 
         for(int32 ridx = 0; ridx < update.removal_size(); ridx++) {
@@ -465,6 +527,10 @@ void ManualObjectQueryProcessor::handleProximityMessage(const OHDP::SpaceNodeID&
             query_state->objects->objectRemoved(
                 observed_oref
             );
+            query_state->cut.nodeRemoved(
+                observed_oref,
+                (removal.has_type() && (removal.type() == Sirikata::Protocol::Prox::ObjectRemoval::Permanent))
+            );
 
             // TODO(ewencp) temporary code to get results out. See note above.
             addRemovalResult(
@@ -515,13 +581,18 @@ void ManualObjectQueryProcessor::handleLocationSubstreamRead(const OHDP::SpaceNo
 
 namespace {
 // Helper for applying an update to
-void applyLocUpdate(const ObjectReference& objid, OHLocationServiceCachePtr loccache, const LocUpdate& lu, ObjectHost* oh, const SpaceID& space) {
-    if (lu.has_location())
-        loccache->locationUpdated(objid, lu.locationWithLocalTime(oh, space), lu.location_seqno());
+void applyLocUpdate(const ObjectReference& objid, OHLocationServiceCachePtr loccache, QueryCut& cut, const LocUpdate& lu, ObjectHost* oh, const SpaceID& space) {
+    if (lu.has_location()) {
+        TimedMotionVector3f loc = lu.locationWithLocalTime(oh, space);
+        loccache->locationUpdated(objid, loc, lu.location_seqno());
+        cut.locationUpdated(objid, loc);
+    }
     if (lu.has_orientation())
         loccache->orientationUpdated(objid, lu.orientationWithLocalTime(oh, space), lu.orientation_seqno());
-    if (lu.has_bounds())
+    if (lu.has_bounds()) {
         loccache->boundsUpdated(objid, lu.bounds(), lu.bounds_seqno());
+        cut.boundsUpdated(objid, lu.bounds());
+    }
     if (lu.has_mesh())
         loccache->meshUpdated(objid, Transfer::URI(lu.meshOrDefault()), lu.mesh_seqno());
     if (lu.has_physics())
@@ -543,19 +614,21 @@ bool ManualObjectQueryProcessor::handleLocationMessage(const OHDP::SpaceNodeID&
     }
     ServerQueryStatePtr& query_state = serv_it->second;
 
-    for(int32 idx = 0; idx < contents.update_size(); idx++) {
-        Sirikata::Protocol::Loc::LocationUpdate update = contents.update(idx);
-        ObjectReference observed_oref(update.object());
+    BulkLocUpdate bulk;
+    bulk.decode(contents);
+
+    for(uint32 idx = 0; idx < bulk.size(); idx++) {
+        const ObjectReference& observed_oref = bulk.object(idx);
         SpaceObjectReference observed(snid.space(), observed_oref);
+        BulkLocUpdate::Entry lu(bulk, idx);
 
         // Because of prox/loc ordering, we may or may not have a record of the
         // object yet.
         if (!query_state->objects->tracking(observed_oref)) {
-            query_state->orphans.addOrphanUpdate(observed, update);
+            query_state->orphans.addOrphanUpdate(observed, lu);
         }
         else {
-            LocProtocolLocUpdate llu(update);
-            applyLocUpdate(observed_oref, query_state->objects, llu, mContext->objectHost, snid.space());
+            applyLocUpdate(observed_oref, query_state->objects, query_state->cut, lu, mContext->objectHost, snid.space());
         }
     }
 
@@ -572,7 +645,7 @@ void ManualObjectQueryProcessor::onOrphanLocUpdate(const OHDP::SpaceNodeID& obse
 
     SpaceObjectReference observed(observer.space(), lu.object());
     assert(query_state->objects->tracking(lu.object()));
-    applyLocUpdate(lu.object(), query_state->objects, lu, mContext->objectHost, observer.space());
+    applyLocUpdate(lu.object(), query_state->objects, query_state->cut, lu, mContext->objectHost, observer.space());
 }
 
 } // namespace Manual
@@ -10,8 +10,10 @@
 #include <sirikata/oh/ObjectNodeSession.hpp>
 
 #include <sirikata/proxyobject/OrphanLocUpdateManager.hpp>
+#include <sirikata/core/service/Poller.hpp>
 
 #include "OHLocationServiceCache.hpp"
+#include "QueryCut.hpp"
 
 namespace Sirikata {
 namespace OH {
@@ -56,7 +58,9 @@ private:
     struct ObjectState {
         ObjectState()
          : node(OHDP::NodeID::null()),
-           query()
+           query(),
+           has_angle(false),
+           angle(SolidAngle::Max)
         {}
 
         // Checks if it is safe to destroy this ObjectState
@@ -67,6 +71,9 @@ private:
         HostedObjectWPtr who;
         OHDP::NodeID node;
         String query;
+        // Parsed from query, used to decide how the cut should be refined
+        bool has_angle;
+        SolidAngle angle;
     };
     typedef std::tr1::unordered_map<SpaceObjectReference, ObjectState, SpaceObjectReference::Hasher> ObjectStateMap;
     ObjectStateMap mObjectState;
@@ -110,11 +117,17 @@ private:
 
         OHLocationServiceCachePtr objects;
         OrphanLocUpdateManager orphans;
+        // Our view of the cut through the server's tree
+        QueryCut cut;
     };
     typedef std::tr1::shared_ptr<ServerQueryState> ServerQueryStatePtr;
     typedef std::tr1::unordered_map<OHDP::SpaceNodeID, ServerQueryStatePtr, OHDP::SpaceNodeID::Hasher> ServerQueryMap;
     ServerQueryMap mServerQueries;
 
+    // Periodically recomputes the cut for each server from all the connected
+    // objects' queries and sends the changes
+    Poller mCutPoller;
+
     // Helper that marks a server with another connected object and may register
     // a query
     void incrementServerQuery(ServerQueryMap::iterator serv_it);
@@ -125,6 +138,13 @@ private:
     // iterator, checking if it is referenced at all yet and sending a
     // message to kill the query
     void decrementServerQuery(ServerQueryMap::iterator serv_it);
+    // Store the query for an object, parsing out the parameters we need
+    void setObjectQuery(ObjectState& state, const String& query);
+
+    // Evaluate the desired cut for all servers, sending the refinements and
+    // coarsenings to get there
+    void updateCuts();
+    void updateCut(ServerQueryMap::iterator serv_it, const Time& t);
 
 
     // Proximity
@@ -0,0 +1,183 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "QueryCut.hpp"
+
+namespace Sirikata {
+namespace OH {
+namespace Manual {
+
+namespace {
+bool sameObservers(const QueryCut::ObserverList& a, const QueryCut::ObserverList& b) {
+    if (a.size() != b.size()) return false;
+    for(uint32 i = 0; i < a.size(); i++) {
+        if (a[i].position != b[i].position || a[i].angle != b[i].angle)
+            return false;
+    }
+    return true;
+}
+}
+
+QueryCut::QueryCut()
+ : mDirty(false)
+{
+}
+
+void QueryCut::nodeAdded(const ObjectReference& node, const ObjectReference& parent, bool aggregate, const TimedMotionVector3f& loc, const BoundingSphere3f& bounds) {
+    // Only parents we've seen in the cut are tracked, e.g. the root may never
+    // have been reported
+    NodeMap::iterator parent_it = mNodes.find(parent);
+    // Pointer rather than iterator since adding the node may rehash
+    Node* parent_data = (parent_it != mNodes.end() ? &parent_it->second : NULL);
+
+    Node& data = mNodes[node];
+    if (data.parent != parent) {
+        unlinkFromParent(node, data.parent);
+        data.parent = parent;
+        if (parent_data != NULL)
+            parent_data->children.push_back(node);
+    }
+    data.loc = loc;
+    data.bounds = bounds;
+    data.aggregate = aggregate;
+    data.inCut = true;
+    // Being added means the node itself was coarsened or was never refined
+    data.refined = false;
+
+    // And a child showing up means its parent was refined. The parent stays
+    // in the cut until the server removes it, which may come later.
+    if (parent_data != NULL)
+        parent_data->refined = true;
+
+    mDirty = true;
+}
+
+void QueryCut::nodeRemoved(const ObjectReference& node, bool permanent) {
+    NodeMap::iterator it = mNodes.find(node);
+    if (it == mNodes.end()) return;
+
+    mDirty = true;
+
+    // Removed because we refined it, keep it around as an interior node.
+    // Otherwise the object is gone or the server dropped it from the cut for
+    // its own reasons, e.g. coarsening an ancestor, so its subtree goes too.
+    if (it->second.refined && it->second.inCut && !permanent) {
+        it->second.inCut = false;
+        return;
+    }
+
+    eraseChildren(it->second);
+    unlinkFromParent(node, it->second.parent);
+    mNodes.erase(node);
+}
+
+void QueryCut::locationUpdated(const ObjectReference& node, const TimedMotionVector3f& loc) {
+    NodeMap::iterator it = mNodes.find(node);
+    if (it == mNodes.end()) return;
+    Node& data = it->second;
+
+    // Only aggregates are ever refined, so other objects moving can't change
+    // the cut. Updates that just restate an aggregate's motion don't either.
+    bool moved = data.aggregate &&
+        (data.loc.position(loc.updateTime()) != loc.position() || data.loc.velocity() != loc.velocity());
+    data.loc = loc;
+    if (moved)
+        mDirty = true;
+}
+
+void QueryCut::boundsUpdated(const ObjectReference& node, const BoundingSphere3f& bounds) {
+    NodeMap::iterator it = mNodes.find(node);
+    if (it == mNodes.end()) return;
+    Node& data = it->second;
+
+    bool changed = data.aggregate && data.bounds != bounds;
+    data.bounds = bounds;
+    if (changed)
+        mDirty = true;
+}
+
+void QueryCut::clear() {
+    mNodes.clear();
+    mLastObservers.clear();
+    mDirty = false;
+}
+
+bool QueryCut::wanted(const Time& t, const Node& node, const ObserverList& observers) const {
+    if (!node.aggregate) return false;
+
+    Vector3f center = node.loc.position(t) + node.bounds.center();
+    float32 radius = node.bounds.radius();
+    for(uint32 i = 0; i < observers.size(); i++) {
+        Vector3f to_center = center - observers[i].position;
+        // Inside the aggregate, always refine
+        if (to_center.lengthSquared() <= radius * radius)
+            return true;
+        if (SolidAngle::fromCenterRadius(to_center, radius) >= observers[i].angle)
+            return true;
+    }
+    return false;
+}
+
+void QueryCut::update(const Time& t, const ObserverList& observers, std::vector<ObjectReference>* refine, std::vector<ObjectReference>* coarsen) {
+    if (!mDirty && sameObservers(observers, mLastObservers))
+        return;
+    mDirty = false;
+    mLastObservers = observers;
+
+    // Find refined nodes that are no longer wanted. Only the highest of them
+    // need to be coarsened, which takes their whole subtree with them.
+    NodeSet unwanted;
+    for(NodeMap::iterator it = mNodes.begin(); it != mNodes.end(); it++) {
+        const Node& node = it->second;
+        if (node.refined && !wanted(t, node, observers))
+            unwanted.insert(it->first);
+    }
+    for(NodeSet::iterator it = unwanted.begin(); it != unwanted.end(); it++) {
+        NodeMap::iterator node_it = mNodes.find(*it);
+        if (unwanted.find(node_it->second.parent) != unwanted.end())
+            continue;
+        coarsen->push_back(*it);
+    }
+    for(uint32 i = 0; i < coarsen->size(); i++) {
+        Node& node = mNodes[(*coarsen)[i]];
+        eraseChildren(node);
+        node.refined = false;
+    }
+
+    // Then refine any aggregates in the cut that are now large enough.
+    // Coarsened nodes aren't back in the cut until the server adds them again,
+    // so they can't be refined again in the same tick.
+    for(NodeMap::iterator it = mNodes.begin(); it != mNodes.end(); it++) {
+        Node& node = it->second;
+        if (!node.inCut || node.refined) continue;
+        if (!wanted(t, node, observers)) continue;
+        refine->push_back(it->first);
+        node.refined = true;
+    }
+}
+
+void QueryCut::eraseChildren(Node& node) {
+    std::vector<ObjectReference> children;
+    children.swap(node.children);
+    for(uint32 i = 0; i < children.size(); i++) {
+        NodeMap::iterator child_it = mNodes.find(children[i]);
+        if (child_it == mNodes.end()) continue;
+        eraseChildren(child_it->second);
+        mNodes.erase(child_it);
+    }
+}
+
+void QueryCut::unlinkFromParent(const ObjectReference& node, const ObjectReference& parent) {
+    if (parent == ObjectReference::null()) return;
+    NodeMap::iterator parent_it = mNodes.find(parent);
+    if (parent_it == mNodes.end()) return;
+    std::vector<ObjectReference>& siblings = parent_it->second.children;
+    std::vector<ObjectReference>::iterator it = std::find(siblings.begin(), siblings.end(), node);
+    if (it != siblings.end())
+        siblings.erase(it);
+}
+
+} // namespace Manual
+} // namespace OH
+} // namespace Sirikata
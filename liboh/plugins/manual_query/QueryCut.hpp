@@ -0,0 +1,102 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_OH_MANUAL_QUERY_CUT_HPP_
+#define _SIRIKATA_OH_MANUAL_QUERY_CUT_HPP_
+
+#include <sirikata/oh/Platform.hpp>
+#include <sirikata/core/util/ObjectReference.hpp>
+#include <sirikata/core/util/MotionVector.hpp>
+#include <sirikata/core/util/BoundingSphere.hpp>
+#include <sirikata/core/util/SolidAngle.hpp>
+
+namespace Sirikata {
+namespace OH {
+namespace Manual {
+
+/** Tracks the cut through a space server's aggregate tree that an object host
+ *  has registered, and decides locally how it should change.
+ *
+ *  The space tells us about the cut through proximity additions and removals:
+ *  when an aggregate is refined, it is removed and its children are added with
+ *  it as their parent. We use this to maintain the acknowledged cut -- which
+ *  aggregates are refined and which nodes are currently in the cut. On each
+ *  tick, the desired cut is computed from the solid angle queries of all the
+ *  presences connected through the server: an aggregate should be refined if
+ *  it is at least as large as the query angle from any of those presences. The
+ *  difference between the two becomes a single list of aggregates to refine
+ *  and a single list to coarsen, so however much the observers move, updating
+ *  the cut costs at most one request of each type per tick.
+ *
+ *  Not thread safe, all updates must happen on one strand.
+ */
+class QueryCut : Noncopyable {
+public:
+    /// A presence whose query the cut must satisfy.
+    struct Observer {
+        Observer(const Vector3f& pos, const SolidAngle& sa)
+         : position(pos), angle(sa)
+        {}
+
+        Vector3f position;
+        SolidAngle angle;
+    };
+    typedef std::vector<Observer> ObserverList;
+
+    typedef std::tr1::unordered_set<ObjectReference, ObjectReference::Hasher> NodeSet;
+
+    QueryCut();
+
+    // Events from the space server
+    void nodeAdded(const ObjectReference& node, const ObjectReference& parent, bool aggregate, const TimedMotionVector3f& loc, const BoundingSphere3f& bounds);
+    void nodeRemoved(const ObjectReference& node, bool permanent);
+    void locationUpdated(const ObjectReference& node, const TimedMotionVector3f& loc);
+    void boundsUpdated(const ObjectReference& node, const BoundingSphere3f& bounds);
+    void clear();
+
+    /** Compute the changes to the cut needed to satisfy the observers at time
+     *  t, filling in the aggregates to refine and to coarsen. The changes are
+     *  assumed to be sent, so they won't be requested again. If neither the cut
+     *  nor the observers changed since the last call, this does nothing.
+     */
+    void update(const Time& t, const ObserverList& observers, std::vector<ObjectReference>* refine, std::vector<ObjectReference>* coarsen);
+
+private:
+    struct Node {
+        Node()
+         : parent(ObjectReference::null()),
+           aggregate(false),
+           inCut(false),
+           refined(false)
+        {}
+
+        ObjectReference parent;
+        std::vector<ObjectReference> children;
+        TimedMotionVector3f loc;
+        BoundingSphere3f bounds;
+        bool aggregate;
+        // Currently reported by the server as part of the cut
+        bool inCut;
+        // Refinement has been requested. The server's first removal of a
+        // refined node acknowledges the refinement, so it is kept as an
+        // interior node we can coarsen later. Any other removal drops it.
+        bool refined;
+    };
+    typedef std::tr1::unordered_map<ObjectReference, Node, ObjectReference::Hasher> NodeMap;
+
+    bool wanted(const Time& t, const Node& node, const ObserverList& observers) const;
+    // Remove all descendants of a node, e.g. after it is coarsened
+    void eraseChildren(Node& node);
+    void unlinkFromParent(const ObjectReference& node, const ObjectReference& parent);
+
+    NodeMap mNodes;
+    bool mDirty;
+    ObserverList mLastObservers;
+};
+
+} // namespace Manual
+} // namespace OH
+} // namespace Sirikata
+
+#endif //_SIRIKATA_OH_MANUAL_QUERY_CUT_HPP_
@@ -8,6 +8,7 @@
 #include "Protocol_Loc.pbj.hpp"
 #include "Protocol_Frame.pbj.hpp"
 #include <sirikata/oh/ProtocolLocUpdate.hpp>
+#include <sirikata/oh/BulkLocUpdate.hpp>
 #include <sirikata/proxyobject/ProxyManager.hpp>
 
 #define SOQP_LOG(lvl, msg) SILOG(simple-object-query-processor, lvl, msg)
@@ -215,19 +216,27 @@ bool SimpleObjectQueryProcessor::handleLocationMessage(const HostedObjectPtr& se
     // As well as looking up object state (orhpan manager) only once
     ObjectStatePtr obj_state = mObjectStateMap[spaceobj];
 
-    for(int32 idx = 0; idx < contents.update_size(); idx++) {
-        Sirikata::Protocol::Loc::LocationUpdate update = contents.update(idx);
-        SpaceObjectReference observed(spaceobj.space(), ObjectReference(update.object()));
+    // Decode everything at once so the updates we can deliver are applied in
+    // one pass.
+    BulkLocUpdate bulk;
+    bulk.decode(contents);
+
+    bool any_delivered = false;
+    for(uint32 idx = 0; idx < bulk.size(); idx++) {
+        SpaceObjectReference observed(spaceobj.space(), bulk.object(idx));
         ProxyObjectPtr proxy_obj = proxy_manager->getProxyObject(observed);
 
         if (!proxy_obj) {
-            obj_state->orphans.addOrphanUpdate(observed, update);
+            BulkLocUpdate::Entry lu(bulk, idx);
+            obj_state->orphans.addOrphanUpdate(observed, lu);
         }
         else {
-            LocProtocolLocUpdate llu(update);
-            deliverLocationUpdate(self, spaceobj, llu);
+            any_delivered = true;
         }
     }
+    // Orphans are skipped since they have no proxies
+    if (any_delivered)
+        deliverLocationUpdates(self, spaceobj, bulk);
 
     return true;
 }
@@ -52,6 +52,8 @@ static void InitPluginOptions() {
 
     Sirikata::InitializeClassOptions icof("sqlitefactory",NULL,
         new Sirikata::OptionValue("db", "storage.db", Sirikata::OptionValueType<String>(), "File to read objects from."),
+        new Sirikata::OptionValue("rate", "1000", Sirikata::OptionValueType<int32>(), "Maximum number of objects to restore per second."),
+        new Sirikata::OptionValue("create-batch", "100", Sirikata::OptionValueType<uint32>(), "Number of objects to restore at a time before giving other work on the main thread a chance to run."),
         NULL);
 }
 
@@ -79,8 +81,10 @@ static ObjectFactory* createSQLiteObjectFactory(ObjectHostContext* ctx, ObjectHo
     optionsSet->parse(args);
 
     String dbfile = optionsSet->referenceOption("db")->as<String>();
+    int32 restore_rate = optionsSet->referenceOption("rate")->as<int32>();
+    uint32 create_batch = optionsSet->referenceOption("create-batch")->as<uint32>();
 
-    return new SQLiteObjectFactory(ctx, oh, space, dbfile);
+    return new SQLiteObjectFactory(ctx, oh, space, dbfile, restore_rate, create_batch);
 }
 
 } // namespace Sirikata
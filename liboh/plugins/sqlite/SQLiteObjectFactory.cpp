@@ -33,21 +33,29 @@
 #include "SQLiteObjectFactory.hpp"
 #include <sirikata/oh/HostedObject.hpp>
 #include <sirikata/sqlite/SQLite.hpp>
+#include <sirikata/core/util/Timer.hpp>
 
 #define TABLE_NAME "objects"
 
 namespace Sirikata {
 
-SQLiteObjectFactory::SQLiteObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const String& filename)
+SQLiteObjectFactory::SQLiteObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const String& filename, int32 restore_rate, uint32 create_batch)
  : mContext(ctx),
    mOH(oh),
    mSpace(space),
    mDBFilename(filename),
-   mConnectRate(1)
+   mConnectRate(restore_rate),
+   mCreateBatch(std::max(create_batch, (uint32)1)),
+   mRateWindowStart(Time::null()),
+   mConnectedInWindow(0),
+   mStartTime(Time::null()),
+   mObjectsRestored(0)
 {
 }
 
 void SQLiteObjectFactory::generate(const String& timestamp) {
+    mStartTime = Timer::now();
+
     SQLiteDBPtr db = SQLite::getSingleton().open(mDBFilename);
     sqlite3_busy_timeout(db->db(), 1000);
 
@@ -108,21 +116,39 @@ void SQLiteObjectFactory::connectObjects() {
     if (mContext->stopped())
         return;
 
-    for(int32 i = 0; i < mConnectRate && !mIncompleteObjects.empty(); i++) {
+    Time now = Timer::now();
+    if (now - mRateWindowStart >= Duration::seconds(1.f)) {
+        mRateWindowStart = now;
+        mConnectedInWindow = 0;
+    }
+
+    for(uint32 i = 0; i < mCreateBatch && mConnectedInWindow < mConnectRate && !mIncompleteObjects.empty(); i++, mConnectedInWindow++) {
         ObjectInfo info = mIncompleteObjects.front();
         mIncompleteObjects.pop();
 
         HostedObjectPtr obj = mOH->createObject(
             info.id, info.scriptType, info.scriptArgs, info.scriptContents
         );
+        mObjectsRestored++;
     }
 
-    if (!mIncompleteObjects.empty())
-        mContext->mainStrand->post(
-            Duration::seconds(1.f),
-            std::tr1::bind(&SQLiteObjectFactory::connectObjects, this),
-            "SQLiteObjectFactory::connectObjects"
-        );
+    if (mIncompleteObjects.empty()) {
+        SILOG(sqlite-object-factory, info, "Restored " << mObjectsRestored << " objects from " << mDBFilename << " in " << (Timer::now() - mStartTime).seconds() << "s");
+        return;
+    }
+
+    // Yield to other work on the main strand between batches, and if we've hit
+    // the rate limit, wait for the next window.
+    Duration wait = Duration::zero();
+    if (mConnectedInWindow >= mConnectRate) {
+        wait = (mRateWindowStart + Duration::seconds(1.f)) - Timer::now();
+        if (wait < Duration::zero()) wait = Duration::zero();
+    }
+    mContext->mainStrand->post(
+        wait,
+        std::tr1::bind(&SQLiteObjectFactory::connectObjects, this),
+        "SQLiteObjectFactory::connectObjects"
+    );
 }
 
 } // namespace Sirikata
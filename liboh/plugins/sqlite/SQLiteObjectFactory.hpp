@@ -39,12 +39,15 @@
 
 namespace Sirikata {
 
-/** SQLiteObjectFactory generates objects from an input SQLite file. */
+/** SQLiteObjectFactory generates objects from an input SQLite file. Objects
+ *  are restored in batches of create_batch on the main strand, at no more than
+ *  restore_rate objects per second.
+ */
 class SQLiteObjectFactory : public ObjectFactory {
 public:
     typedef std::vector<String> StringList;
 
-    SQLiteObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const String& filename);
+    SQLiteObjectFactory(ObjectHostContext* ctx, ObjectHost* oh, const SpaceID& space, const String& filename, int32 restore_rate, uint32 create_batch);
     virtual ~SQLiteObjectFactory() {}
 
     virtual void generate(const String& timestamp="current");
@@ -64,8 +67,14 @@ private:
     SpaceID mSpace;
     String mDBFilename;
     int32 mConnectRate;
+    uint32 mCreateBatch;
+    // Objects restored in the current one second window
+    Time mRateWindowStart;
+    int32 mConnectedInWindow;
     typedef std::queue<ObjectInfo> ObjectInfoQueue;
     ObjectInfoQueue mIncompleteObjects;
+    Time mStartTime;
+    uint32 mObjectsRestored;
 };
 
 } // namespace Sirikata
@@ -136,14 +136,13 @@ SQLitePersistedObjectSet::UpdateResult SQLitePersistedObjectSet::performUpdate(c
     bool success = true;
 
     int rc;
-    char* remain;
     String value_insert;
     value_insert = "INSERT OR REPLACE INTO ";
     value_insert += "\"" TABLE_NAME "\"";
     value_insert += " (object, script_type, script_args, script_contents) VALUES(?, ?, ?, ?)";
 
     sqlite3_stmt* value_insert_stmt;
-    rc = sqlite3_prepare_v2(mDB->db(), value_insert.c_str(), -1, &value_insert_stmt, (const char**)&remain);
+    rc = mDB->prepare(value_insert, &value_insert_stmt);
     success = success && !checkSQLiteError(rc, "Error preparing value insert statement");
 
     String id_str = internal_id.rawHexData();
@@ -170,8 +169,8 @@ SQLitePersistedObjectSet::UpdateResult SQLitePersistedObjectSet::performUpdate(c
             SILOG(sqlite-persisted-object-set, error, "Update failed: " << SQLite::resultAsString(step_rc));
     }
 
-    rc = sqlite3_finalize(value_insert_stmt);
-    success = success && !checkSQLiteError(rc, "Error finalizing value insert statement");
+    rc = sqlite3_reset(value_insert_stmt);
+    success = success && !checkSQLiteError(rc, "Error resetting value insert statement");
 
     if (!success && result == SUCCESS)
         result = TRANSACTION_ERROR;
@@ -87,6 +87,15 @@ SQLiteStorage::StorageAction& SQLiteStorage::StorageAction::operator=(const Stor
     return *this;
 }
 
+int SQLiteStorage::StorageAction::bindBucket(SQLiteDBPtr db, sqlite3_stmt* stmt, const Bucket& bucket) {
+    // The bucket is always the first parameter. Binding it rather than
+    // including it in the SQL lets every bucket share the cached statements.
+    String bucket_str = bucket.rawHexData();
+    int rc = sqlite3_bind_text(stmt, 1, bucket_str.c_str(), (int)bucket_str.size(), SQLITE_TRANSIENT);
+    checkSQLiteError(db, rc, "Error binding bucket to statement");
+    return rc;
+}
+
 Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs) {
     Result result = SUCCESS;
     switch(type) {
@@ -98,16 +107,17 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
           {
               String value_query = "SELECT value FROM ";
               value_query += "\"" TABLE_NAME "\"";
-              value_query += " WHERE object == \'" + bucket.rawHexData() + "\' AND key == ?";
+              value_query += " WHERE object == ? AND key == ?";
               int rc;
-              char* remain;
               sqlite3_stmt* value_query_stmt;
               bool newStep = true;
-              rc = sqlite3_prepare_v2(db->db(), value_query.c_str(), -1, &value_query_stmt, (const char**)&remain);
+              rc = db->prepare(value_query, &value_query_stmt);
               bool success = true;
               success = success && !checkSQLiteError(db, rc, "Error preparing value query statement");
               if (rc==SQLITE_OK) {
-                  rc = sqlite3_bind_text(value_query_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+                  rc = bindBucket(db, value_query_stmt, bucket);
+                  success = success && (rc == SQLITE_OK);
+                  rc = sqlite3_bind_text(value_query_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding key name to value query statement");
                   if (rc==SQLITE_OK) {
                       int step_rc = sqlite3_step(value_query_stmt);
@@ -140,8 +150,8 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                       }
                   }
               }
-              rc = sqlite3_finalize(value_query_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
+              rc = sqlite3_reset(value_query_stmt);
+              success = success && !checkSQLiteError(db, rc, "Error resetting value query statement");
 
               if (newStep) { // no rows were found, key is missing
                   success = false;
@@ -161,18 +171,19 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
           {
               String value_query = "SELECT key, value FROM ";
               value_query += "\"" TABLE_NAME "\"";
-              value_query += " WHERE object == \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
+              value_query += " WHERE object == ? AND key BETWEEN ? AND ?";
 
               int rc;
-              char* remain;
               sqlite3_stmt* value_query_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_query.c_str(), -1, &value_query_stmt, (const char**)&remain);
+              rc = db->prepare(value_query, &value_query_stmt);
               bool success = true;
               success = success && !checkSQLiteError(db, rc, "Error preparing value query statement");
               if (rc==SQLITE_OK){
-                  rc = sqlite3_bind_text(value_query_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+                  rc = bindBucket(db, value_query_stmt, bucket);
+                  success = success && (rc == SQLITE_OK);
+                  rc = sqlite3_bind_text(value_query_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding start key to value query statement");
-                  rc = sqlite3_bind_text(value_query_stmt, 2, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
+                  rc = sqlite3_bind_text(value_query_stmt, 3, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
                   success = success && !checkSQLiteError(db, rc, "Error binding finish key to value query statement");
                   if (rc==SQLITE_OK) {
                       int step_rc = sqlite3_step(value_query_stmt);
@@ -208,8 +219,8 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                       }
                   }
               }
-              rc = sqlite3_finalize(value_query_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value query statement");
+              rc = sqlite3_reset(value_query_stmt);
+              success = success && !checkSQLiteError(db, rc, "Error resetting value query statement");
               // If no other error condition is indicated yet, mark transaction
               // error for failures
               if (!success && result == SUCCESS)
@@ -223,31 +234,32 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
               // Erase and write use different statements, but the rest is the
               // same since it just needs to execute and check for success.
               int rc;
-              char* remain;
 
               String value_insert;
               if (type == Write) {
                   value_insert = "INSERT OR REPLACE INTO ";
                   value_insert += "\"" TABLE_NAME "\"";
-                  value_insert += " (object, key, value) VALUES(\'" + bucket.rawHexData() + "\', ?, ?)";
+                  value_insert += " (object, key, value) VALUES(?, ?, ?)";
               }
               else if (type == Erase) {
                   value_insert = "DELETE FROM ";
                   value_insert += "\"" TABLE_NAME "\"";
-                  value_insert += " WHERE object = \'" + bucket.rawHexData() + "\' AND key = ?";
+                  value_insert += " WHERE object = ? AND key = ?";
               }
 
               sqlite3_stmt* value_insert_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_insert.c_str(), -1, &value_insert_stmt, (const char**)&remain);
+              rc = db->prepare(value_insert, &value_insert_stmt);
               bool success = true;
               success = success && !checkSQLiteError(db, rc, "Error preparing value insert statement");
 
-              rc = sqlite3_bind_text(value_insert_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+              rc = bindBucket(db, value_insert_stmt, bucket);
+              success = success && (rc == SQLITE_OK);
+              rc = sqlite3_bind_text(value_insert_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
               success = success && !checkSQLiteError(db, rc, "Error binding key name to value insert statement");
               if (rc==SQLITE_OK) {
                   if (type == Write) {
                       assert(value != NULL);
-                      rc = sqlite3_bind_blob(value_insert_stmt, 2, value->c_str(), (int)value->size(), SQLITE_TRANSIENT);
+                      rc = sqlite3_bind_blob(value_insert_stmt, 3, value->c_str(), (int)value->size(), SQLITE_TRANSIENT);
                       success = success && !checkSQLiteError(db, rc, "Error binding value to value insert statement");
                   }
               }
@@ -285,8 +297,8 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                   }
               }
 
-              rc = sqlite3_finalize(value_insert_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value insert statement");
+              rc = sqlite3_reset(value_insert_stmt);
+              success = success && !checkSQLiteError(db, rc, "Error resetting value insert statement");
 
               // If no other error condition is indicated yet, mark transaction
               // error for failures
@@ -299,18 +311,19 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
           {
               String value_delete = "DELETE FROM ";
               value_delete += "\"" TABLE_NAME "\"";
-              value_delete += " WHERE object = \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
+              value_delete += " WHERE object = ? AND key BETWEEN ? AND ?";
 
               int rc;
-              char* remain;
               sqlite3_stmt* value_delete_stmt;
-              rc = sqlite3_prepare_v2(db->db(), value_delete.c_str(), -1, &value_delete_stmt, (const char**)&remain);
+              rc = db->prepare(value_delete, &value_delete_stmt);
               bool success = true;
               success = success && !checkSQLiteError(db, rc, "Error preparing value delete statement");
 
-              rc = sqlite3_bind_text(value_delete_stmt, 1, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
+              rc = bindBucket(db, value_delete_stmt, bucket);
+              success = success && (rc == SQLITE_OK);
+              rc = sqlite3_bind_text(value_delete_stmt, 2, key.c_str(), (int)key.size(), SQLITE_TRANSIENT);
               success = success && !checkSQLiteError(db, rc, "Error binding start key to value delete statement");
-              rc = sqlite3_bind_text(value_delete_stmt, 2, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
+              rc = sqlite3_bind_text(value_delete_stmt, 3, keyEnd.c_str(), (int)keyEnd.size(), SQLITE_TRANSIENT);
               success = success && !checkSQLiteError(db, rc, "Error binding finish key to value delete statement");
 
               int step_rc = sqlite3_step(value_delete_stmt);
@@ -321,8 +334,8 @@ Storage::Result SQLiteStorage::StorageAction::execute(SQLiteDBPtr db, const Buck
                   if (step_rc == SQLITE_LOCKED || step_rc == SQLITE_BUSY)
                       result = LOCK_ERROR;
               }
-              rc = sqlite3_finalize(value_delete_stmt);
-              success = success && !checkSQLiteError(db, rc, "Error finalizing value delete statement");
+              rc = sqlite3_reset(value_delete_stmt);
+              success = success && !checkSQLiteError(db, rc, "Error resetting value delete statement");
 
               // If no other error condition is indicated yet, mark transaction
               // error for failures
@@ -434,17 +447,16 @@ bool SQLiteStorage::sqlBeginTransaction() {
     String begin = "BEGIN DEFERRED TRANSACTION";
 
     int rc;
-    char* remain;
     sqlite3_stmt* begin_stmt;
     bool success = true;
 
-    rc = sqlite3_prepare_v2(mDB->db(), begin.c_str(), -1, &begin_stmt, (const char**)&remain);
+    rc = mDB->prepare(begin, &begin_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error preparing begin transaction statement");
 
     rc = sqlite3_step(begin_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error executing begin statement");
-    rc = sqlite3_finalize(begin_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing begin statement");
+    rc = sqlite3_reset(begin_stmt);
+    success = success && !checkSQLiteError(mDB, rc, "Error resetting begin statement");
 
     return success;
 }
@@ -453,17 +465,16 @@ bool SQLiteStorage::sqlRollback() {
     String rollback = "ROLLBACK TRANSACTION";
 
     int rc;
-    char* remain;
     sqlite3_stmt* rollback_stmt;
     bool success = true;
 
-    rc = sqlite3_prepare_v2(mDB->db(), rollback.c_str(), -1, &rollback_stmt, (const char**)&remain);
+    rc = mDB->prepare(rollback, &rollback_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error preparing rollback transaction statement");
 
     rc = sqlite3_step(rollback_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error executing rollback statement");
-    rc = sqlite3_finalize(rollback_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing rollback statement");
+    rc = sqlite3_reset(rollback_stmt);
+    success = success && !checkSQLiteError(mDB, rc, "Error resetting rollback statement");
 
     return success;
 }
@@ -472,17 +483,16 @@ bool SQLiteStorage::sqlCommit() {
     String commit = "COMMIT TRANSACTION";
 
     int rc;
-    char* remain;
     sqlite3_stmt* commit_stmt;
     bool success = true;
 
-    rc = sqlite3_prepare_v2(mDB->db(), commit.c_str(), -1, &commit_stmt, (const char**)&remain);
+    rc = mDB->prepare(commit, &commit_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error preparing commit transaction statement");
 
     rc = sqlite3_step(commit_stmt);
     success = success && !checkSQLiteError(mDB, rc, "Error executing commit statement");
-    rc = sqlite3_finalize(commit_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing commit statement");
+    rc = sqlite3_reset(commit_stmt);
+    success = success && !checkSQLiteError(mDB, rc, "Error resetting commit statement");
 
     return success;
 }
@@ -1027,43 +1037,46 @@ bool SQLiteStorage::rangeErase(const Bucket& bucket, const Key& start, const Key
 
 bool SQLiteStorage::count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb, const String& timestamp) {
     // FIXME doesn't fit into transactions...
-    String value_count = "SELECT COUNT(*) FROM ";
-    value_count += "\"" TABLE_NAME "\"";
-    value_count += " WHERE object = \'" + bucket.rawHexData() + "\' AND key BETWEEN ? AND ?";
-
     mIOService->post(
-        std::tr1::bind(&SQLiteStorage::executeCount, this, value_count, start, finish, cb),
+        std::tr1::bind(&SQLiteStorage::executeCount, this, bucket, start, finish, cb),
         "SQLiteStorage::executeCount"
     );
     return true;
 }
 
-void SQLiteStorage::executeCount(const String value_count, const Key& start, const Key& finish, CountCallback cb)
+void SQLiteStorage::executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb)
 {
     bool success = true;
     int32 count = 0;
 
+    String value_count = "SELECT COUNT(*) FROM ";
+    value_count += "\"" TABLE_NAME "\"";
+    value_count += " WHERE object = ? AND key BETWEEN ? AND ?";
+
+    SQLiteDBPtr db = SQLite::getSingleton().openReader(mDBFilename);
+
 	int rc;
-    char* remain;
     sqlite3_stmt* value_count_stmt;
-    rc = sqlite3_prepare_v2(mDB->db(), value_count.c_str(), -1, &value_count_stmt, (const char**)&remain);
-    success = success && !checkSQLiteError(mDB, rc, "Error preparing value count statement");
+    rc = db->prepare(value_count, &value_count_stmt);
+    success = success && !checkSQLiteError(db, rc, "Error preparing value count statement");
 
     if (rc==SQLITE_OK) {
-    	rc = sqlite3_bind_text(value_count_stmt, 1, start.c_str(), (int)start.size(), SQLITE_TRANSIENT);
-    	success = success && !checkSQLiteError(mDB, rc, "Error binding start key to value count statement");
-    	rc = sqlite3_bind_text(value_count_stmt, 2, finish.c_str(), (int)finish.size(), SQLITE_TRANSIENT);
-    	success = success && !checkSQLiteError(mDB, rc, "Error binding finish key to value count statement");
+        rc = StorageAction::bindBucket(db, value_count_stmt, bucket);
+        success = success && (rc == SQLITE_OK);
+    	rc = sqlite3_bind_text(value_count_stmt, 2, start.c_str(), (int)start.size(), SQLITE_TRANSIENT);
+    	success = success && !checkSQLiteError(db, rc, "Error binding start key to value count statement");
+    	rc = sqlite3_bind_text(value_count_stmt, 3, finish.c_str(), (int)finish.size(), SQLITE_TRANSIENT);
+    	success = success && !checkSQLiteError(db, rc, "Error binding finish key to value count statement");
     	if (rc==SQLITE_OK) {
     		int step_rc = sqlite3_step(value_count_stmt);
     		count = sqlite3_column_int(value_count_stmt, 0);
     		if (step_rc != SQLITE_OK && step_rc != SQLITE_DONE && step_rc != SQLITE_ROW)
-    			sqlite3_reset(value_count_stmt); // allow this to be cleaned up
+    			success = false;
     	}
 
+        rc = sqlite3_reset(value_count_stmt);
+        success = success && !checkSQLiteError(db, rc, "Error resetting value count statement");
     }
-    rc = sqlite3_finalize(value_count_stmt);
-    success = success && !checkSQLiteError(mDB, rc, "Error finalizing value delete statement");
 
     if (cb) {
         Result result = (success ? SUCCESS : TRANSACTION_ERROR);
@@ -1074,5 +1087,99 @@ void SQLiteStorage::executeCount(const String value_count, const Key& start, con
     }
 }
 
+bool SQLiteStorage::rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp) {
+    Key last;
+    if (max_keys == 0 || (!token.empty() && !decodeScanToken(start, token, &last)))
+        return false;
+
+    mIOService->post(
+        std::tr1::bind(&SQLiteStorage::executeScan, this, bucket, start, finish, token, max_keys, cb),
+        "SQLiteStorage::executeScan"
+    );
+    return true;
+}
+
+void SQLiteStorage::executeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, ScanCallback cb)
+{
+    bool success = true;
+    ReadSet* rs = new ReadSet();
+    ScanToken next;
+
+    // Resuming starts just after the last key of the previous page
+    Key from = start;
+    bool resuming = !token.empty();
+    if (resuming) decodeScanToken(start, token, &from);
+
+    String value_scan = "SELECT key, value FROM ";
+    value_scan += "\"" TABLE_NAME "\"";
+    if (resuming)
+        value_scan += " WHERE object == ? AND key > ? AND key <= ? ORDER BY key LIMIT ?";
+    else
+        value_scan += " WHERE object == ? AND key >= ? AND key <= ? ORDER BY key LIMIT ?";
+
+    SQLiteDBPtr db = SQLite::getSingleton().openReader(mDBFilename);
+
+    int rc;
+    sqlite3_stmt* value_scan_stmt;
+    rc = db->prepare(value_scan, &value_scan_stmt);
+    success = success && !checkSQLiteError(db, rc, "Error preparing value scan statement");
+
+    if (rc==SQLITE_OK) {
+        rc = StorageAction::bindBucket(db, value_scan_stmt, bucket);
+        success = success && (rc == SQLITE_OK);
+        rc = sqlite3_bind_text(value_scan_stmt, 2, from.c_str(), (int)from.size(), SQLITE_TRANSIENT);
+        success = success && !checkSQLiteError(db, rc, "Error binding start key to value scan statement");
+        rc = sqlite3_bind_text(value_scan_stmt, 3, finish.c_str(), (int)finish.size(), SQLITE_TRANSIENT);
+        success = success && !checkSQLiteError(db, rc, "Error binding finish key to value scan statement");
+        // Ask for one extra row to find out whether there's another page
+        rc = sqlite3_bind_int64(value_scan_stmt, 4, (sqlite3_int64)max_keys + 1);
+        success = success && !checkSQLiteError(db, rc, "Error binding limit to value scan statement");
+
+        if (success) {
+            uint32 nread = 0;
+            Key last_key;
+            int step_rc = sqlite3_step(value_scan_stmt);
+            while(step_rc == SQLITE_ROW) {
+                if (nread == max_keys) {
+                    next = encodeScanToken(start, last_key);
+                    break;
+                }
+                nread++;
+                last_key = String(
+                    (const char*)sqlite3_column_text(value_scan_stmt, 0),
+                    sqlite3_column_bytes(value_scan_stmt, 0)
+                );
+                (*rs)[last_key] = String(
+                    (const char*)sqlite3_column_text(value_scan_stmt, 1),
+                    sqlite3_column_bytes(value_scan_stmt, 1)
+                );
+                step_rc = sqlite3_step(value_scan_stmt);
+            }
+            if (step_rc != SQLITE_ROW && step_rc != SQLITE_DONE)
+                success = false;
+        }
+
+        rc = sqlite3_reset(value_scan_stmt);
+        success = success && !checkSQLiteError(db, rc, "Error resetting value scan statement");
+    }
+
+    if (!success) {
+        delete rs;
+        rs = NULL;
+        next = ScanToken();
+    }
+
+    if (cb) {
+        Result result = (success ? SUCCESS : TRANSACTION_ERROR);
+        mContext->mainStrand->post(
+            std::tr1::bind(cb, result, rs, next),
+            "SQLiteStorage completeScan"
+        );
+    }
+    else {
+        delete rs;
+    }
+}
+
 } //end namespace OH
 } //end namespace Sirikata
@@ -64,6 +64,7 @@ public:
     virtual bool rangeRead(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
     virtual bool rangeErase(const Bucket& bucket, const Key& start, const Key& finish, const CommitCallback& cb = 0, const String& timestamp="current");
     virtual bool count(const Bucket& bucket, const Key& start, const Key& finish, const CountCallback& cb = 0, const String& timestamp="current");
+    virtual bool rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp="current");
 
 private:
     // StorageActions are individual actions to take, i.e. read, write,
@@ -93,6 +94,8 @@ private:
         // temporary failure to lock the database. Assumes the owning
         // SQLiteStorage has setup the transaction.
         Result executeWithRetry(SQLiteDBPtr db, const Bucket& bucket, ReadSet* rs, int32 retries, const Duration& retry_wait);
+        // Bind the bucket as the first parameter of stmt
+        static int bindBucket(SQLiteDBPtr db, sqlite3_stmt* stmt, const Bucket& bucket);
 
         // Bucket is implicit, passed into execute
         Type type;
@@ -145,7 +148,11 @@ private:
     // rollback/retrying.
     Result executeCommit(const Bucket& bucket, Transaction* trans, CommitCallback cb, ReadSet** read_set_out);
 
-    void executeCount(const String value_count, const Key& start, const Key& finish, CountCallback cb);
+    // Counts run outside of transactions, so they use a read-only connection
+    void executeCount(const Bucket& bucket, const Key& start, const Key& finish, CountCallback cb);
+    // Scans also use a read-only connection. Each page is a separate query
+    // which walks the primary key index from the last key returned.
+    void executeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, ScanCallback cb);
 
     // A few helper methods that wrap sql operations.
     bool sqlBeginTransaction();
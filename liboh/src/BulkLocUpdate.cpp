@@ -0,0 +1,84 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/oh/Platform.hpp>
+#include <sirikata/oh/BulkLocUpdate.hpp>
+#include "Protocol_Loc.pbj.hpp"
+
+namespace Sirikata {
+
+BulkLocUpdate::BulkLocUpdate()
+{
+}
+
+void BulkLocUpdate::clear() {
+    mObjects.clear();
+    mFields.clear();
+    mSeqnos.clear();
+    mEpochs.clear();
+    mParents.clear();
+    mLocations.clear();
+    mOrientations.clear();
+    mBounds.clear();
+    mMeshes.clear();
+    mPhysics.clear();
+}
+
+void BulkLocUpdate::decode(const Sirikata::Protocol::Loc::BulkLocationUpdate& bulk) {
+    uint32 n = bulk.update_size();
+
+    mObjects.resize(n);
+    mFields.assign(n, 0);
+    mSeqnos.assign(n, 0);
+    mEpochs.assign(n, 0);
+    mParents.assign(n, ObjectReference::null());
+    mLocations.resize(n);
+    mOrientations.resize(n);
+    mBounds.resize(n);
+    mMeshes.assign(n, String());
+    mPhysics.assign(n, String());
+
+    for(uint32 i = 0; i < n; i++) {
+        Sirikata::Protocol::Loc::LocationUpdate update = bulk.update(i);
+
+        mObjects[i] = ObjectReference(update.object());
+        if (update.has_seqno())
+            mSeqnos[i] = update.seqno();
+
+        uint8 fields = 0;
+        if (update.has_epoch()) {
+            fields |= HAS_EPOCH;
+            mEpochs[i] = update.epoch();
+        }
+        if (update.has_parent()) {
+            fields |= HAS_PARENT;
+            mParents[i] = ObjectReference(update.parent());
+        }
+        if (update.has_location()) {
+            fields |= HAS_LOCATION;
+            Sirikata::Protocol::TimedMotionVector update_loc = update.location();
+            mLocations[i] = TimedMotionVector3f(update_loc.t(), MotionVector3f(update_loc.position(), update_loc.velocity()));
+        }
+        if (update.has_orientation()) {
+            fields |= HAS_ORIENTATION;
+            Sirikata::Protocol::TimedMotionQuaternion update_orient = update.orientation();
+            mOrientations[i] = TimedMotionQuaternion(update_orient.t(), MotionQuaternion(update_orient.position(), update_orient.velocity()));
+        }
+        if (update.has_bounds()) {
+            fields |= HAS_BOUNDS;
+            mBounds[i] = update.bounds();
+        }
+        if (update.has_mesh()) {
+            fields |= HAS_MESH;
+            mMeshes[i] = update.mesh();
+        }
+        if (update.has_physics()) {
+            fields |= HAS_PHYSICS;
+            mPhysics[i] = update.physics();
+        }
+        mFields[i] = fields;
+    }
+}
+
+} // namespace Sirikata
@@ -55,6 +55,7 @@
 
 #include <sirikata/oh/LocUpdate.hpp>
 #include <sirikata/oh/ProtocolLocUpdate.hpp>
+#include <sirikata/oh/BulkLocUpdate.hpp>
 #include "Protocol_Loc.pbj.hpp"
 #include "Protocol_Prox.pbj.hpp"
 
@@ -779,22 +780,23 @@ void HostedObject::processLocationUpdate(
         TimedMotionQuaternion* orient, uint64 orient_seqno,
         BoundingSphere3f* bounds, uint64 bounds_seqno,
         String* mesh, uint64 mesh_seqno,
-        String* phy, uint64 phy_seqno
+        String* phy, uint64 phy_seqno,
+        ProxyUpdateBatch* batch
 ) {
     if (loc)
-        proxy_obj->setLocation(*loc, loc_seqno);
+        proxy_obj->setLocation(*loc, loc_seqno, batch);
 
     if (orient)
-        proxy_obj->setOrientation(*orient, orient_seqno);
+        proxy_obj->setOrientation(*orient, orient_seqno, batch);
 
     if (bounds)
-        proxy_obj->setBounds(*bounds, bounds_seqno);
+        proxy_obj->setBounds(*bounds, bounds_seqno, batch);
 
     if (mesh)
-        proxy_obj->setMesh(Transfer::URI(*mesh), mesh_seqno);
+        proxy_obj->setMesh(Transfer::URI(*mesh), mesh_seqno, batch);
 
     if (phy && *phy != "")
-        proxy_obj->setPhysics(*phy, phy_seqno);
+        proxy_obj->setPhysics(*phy, phy_seqno, batch);
 }
 
 void HostedObject::handleLocationUpdate(const SpaceObjectReference& observer, const LocUpdate& lu) {
@@ -811,6 +813,91 @@ void HostedObject::handleLocationUpdate(const SpaceObjectReference& observer, co
     this->processLocationUpdate( observer, proxy_obj, lu);
 }
 
+void HostedObject::handleLocationUpdates(const SpaceObjectReference& observer, const BulkLocUpdate& bulk) {
+    ProxyManagerPtr proxy_manager = this->getProxyManager(observer.space(), observer.object());
+    if (!proxy_manager) {
+        HO_LOG(warn,"Hosted Object received a message for a presence without a proxy manager.");
+        return;
+    }
+
+    ProxyUpdateBatch batch;
+    bool has_epoch = false;
+    uint64 max_epoch = 0;
+    for(uint32 i = 0; i < bulk.size(); i++) {
+        SpaceObjectReference observed(observer.space(), bulk.object(i));
+        ProxyObjectPtr proxy_obj = proxy_manager->getProxyObject(observed);
+        if (!proxy_obj) continue;
+
+        if (bulk.has(i, BulkLocUpdate::HAS_EPOCH)) {
+            has_epoch = true;
+            max_epoch = std::max(max_epoch, bulk.epoch(i));
+        }
+
+        TimedMotionVector3f loc;
+        TimedMotionQuaternion orient;
+        BoundingSphere3f bounds;
+        String mesh;
+        String phy;
+
+        TimedMotionVector3f* locptr = NULL;
+        TimedMotionQuaternion* orientptr = NULL;
+        BoundingSphere3f* boundsptr = NULL;
+        String* meshptr = NULL;
+        String* phyptr = NULL;
+
+        if (bulk.has(i, BulkLocUpdate::HAS_LOCATION)) {
+            const TimedMotionVector3f& orig = bulk.location(i);
+            loc = TimedMotionVector3f(localTime(observer.space(), orig.updateTime()), orig.value());
+
+            CONTEXT_OHTRACE(objectLoc,
+                observer.object().getAsUUID(),
+                bulk.object(i).getAsUUID(),
+                loc
+            );
+
+            locptr = &loc;
+        }
+        if (bulk.has(i, BulkLocUpdate::HAS_ORIENTATION)) {
+            const TimedMotionQuaternion& orig = bulk.orientation(i);
+            orient = TimedMotionQuaternion(localTime(observer.space(), orig.updateTime()), orig.value());
+            orientptr = &orient;
+        }
+        if (bulk.has(i, BulkLocUpdate::HAS_BOUNDS)) {
+            bounds = bulk.bounds(i);
+            boundsptr = &bounds;
+        }
+        if (bulk.has(i, BulkLocUpdate::HAS_MESH)) {
+            mesh = bulk.mesh(i);
+            meshptr = &mesh;
+        }
+        if (bulk.has(i, BulkLocUpdate::HAS_PHYSICS)) {
+            phy = bulk.physics(i);
+            phyptr = &phy;
+        }
+
+        // Every part of a bulk entry shares one sequence number
+        uint64 seqno = bulk.seqno(i);
+        processLocationUpdate(
+            observer.space(), proxy_obj, false,
+            locptr, seqno, orientptr, seqno,
+            boundsptr, seqno, meshptr, seqno, phyptr, seqno,
+            &batch
+        );
+    }
+
+    if (has_epoch) {
+        Mutex::scoped_lock locker(presenceDataMutex);
+        PresenceDataMap::iterator pres_it = mPresenceData.find(observer);
+        if (pres_it != mPresenceData.end()) {
+            PerPresenceData* pd = pres_it->second;
+            pd->latestReportedEpoch = std::max(pd->latestReportedEpoch, max_epoch);
+        }
+    }
+
+    // Listeners only hear about each proxy once, after everything is applied
+    batch.flush();
+}
+
 void HostedObject::handleProximityUpdate(const SpaceObjectReference& spaceobj, const Sirikata::Protocol::Prox::ProximityUpdate& update) {
     HostedObject* self = this;
     SpaceID space = spaceobj.space();
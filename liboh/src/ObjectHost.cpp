@@ -47,6 +47,7 @@
 #include <sirikata/core/util/SpaceObjectReference.hpp>
 #include <sirikata/core/service/Context.hpp>
 #include <sirikata/oh/ObjectQueryProcessor.hpp>
+#include <sirikata/proxyobject/ProxyObjectStore.hpp>
 
 #include <sirikata/core/network/IOStrandImpl.hpp>
 
@@ -62,7 +63,8 @@ ObjectHost::ObjectHost(ObjectHostContext* ctx, Network::IOService *ioServ, const
    mStorage(NULL),
    mPersistentSet(NULL),
    mQueryProcessor(NULL),
-   mActiveHostedObjects(0)
+   mActiveHostedObjects(0),
+   mProxyObjectStore(ProxyObjectStore::construct())
 {
     mContext->objectHost = this;
     OptionValue *protocolOptions;
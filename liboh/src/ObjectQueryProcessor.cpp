@@ -38,6 +38,10 @@ void ObjectQueryProcessor::deliverLocationUpdate(HostedObjectPtr ho, const Space
     ho->handleLocationUpdate(sporef, lu);
 }
 
+void ObjectQueryProcessor::deliverLocationUpdates(HostedObjectPtr ho, const SpaceObjectReference& sporef, const BulkLocUpdate& bulk) {
+    ho->handleLocationUpdates(sporef, bulk);
+}
+
 
 ObjectQueryProcessorFactory& ObjectQueryProcessorFactory::getSingleton() {
     return AutoSingleton<ObjectQueryProcessorFactory>::getSingleton();
@@ -6,10 +6,18 @@
 #include <sirikata/proxyobject/VWObject.hpp>
 #include <sirikata/oh/PerPresenceData.hpp>
 #include <sirikata/oh/ObjectHostContext.hpp>
+#include <sirikata/oh/ObjectHost.hpp>
 
 
 namespace Sirikata{
 
+namespace {
+ProxyObjectStorePtr getProxyObjectStore(HostedObjectPtr ho) {
+    if (ho->getObjectHost() == NULL) return ProxyObjectStorePtr();
+    return ho->getObjectHost()->getProxyObjectStore();
+}
+}
+
     SpaceObjectReference PerPresenceData::id() const
     {
         return SpaceObjectReference(space, object);
@@ -20,7 +28,7 @@ PerPresenceData::PerPresenceData(HostedObjectPtr _parent, const SpaceID& _space,
      : parent(_parent),
        space(_space),
        object(_oref),
-       proxyManager(ProxyManager::construct( _parent, SpaceObjectReference(_space, _oref) )),
+       proxyManager(ProxyManager::construct( _parent, SpaceObjectReference(_space, _oref), getProxyObjectStore(_parent) )),
        query(_query),
        mSSTDatagramLayers(layer),
        updateFields(LOC_FIELD_NONE),
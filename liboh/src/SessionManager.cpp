@@ -37,6 +37,7 @@
 #include <sirikata/core/options/CommonOptions.hpp>
 #include <sirikata/core/util/SpaceObjectReference.hpp>
 #include "Protocol_Session.pbj.hpp"
+#include "Protocol_SessionBatch.pbj.hpp"
 #include <sirikata/core/util/Platform.hpp>
 #ifdef _WIN32
 #pragma warning (disable:4355)//this within constructor initializer
@@ -148,11 +149,9 @@ void SessionManager::ObjectConnections::startMigration(const SpaceObjectReferenc
     mObjectInfo[sporef_objid].migratingTo = migrating_to;
     mObjectInfo[sporef_objid].connectingTo = NullServerID;
     // Update object indices
-    std::vector<SpaceObjectReference>& sporef_objects = mObjectServerMap[mObjectInfo[sporef_objid].connectedTo];
-    std::vector<SpaceObjectReference>::iterator sporef_where = std::find(sporef_objects.begin(), sporef_objects.end(), sporef_objid);
-    if (sporef_where != sporef_objects.end()) {
-        sporef_objects.erase(sporef_where);
-    }
+    ObjectServerMap::iterator server_it = mObjectServerMap.find(mObjectInfo[sporef_objid].connectedTo);
+    if (server_it != mObjectServerMap.end())
+        server_it->second.erase(sporef_objid);
 
     // Notify the object
     mObjectInfo[sporef_objid].migratedCB(parent->mSpace, sporef_objid.object(), migrating_to);
@@ -171,7 +170,7 @@ ServerID SessionManager::ObjectConnections::handleConnectSuccess(const SpaceObje
         if (connectedTo == mObjectInfo[sporef_obj].migratingTo) {
             mObjectInfo[sporef_obj].migratingTo = NullServerID;
         }
-        mObjectServerMap[connectedTo].push_back(sporef_obj);
+        mObjectServerMap[connectedTo].insert(sporef_obj);
 
         mObjectInfo[sporef_obj].connectedAs = sporef_obj;
 
@@ -209,7 +208,7 @@ ServerID SessionManager::ObjectConnections::handleConnectSuccess(const SpaceObje
         mObjectInfo[sporef_obj].connectedTo = migratedTo;
         mObjectInfo[sporef_obj].connectingTo = NullServerID;
         mObjectInfo[sporef_obj].migratingTo = NullServerID;
-        mObjectServerMap[migratedTo].push_back(sporef_obj);
+        mObjectServerMap[migratedTo].insert(sporef_obj);
 
         //UUID dest_internal = getInternalID(ObjectReference(obj));
         parent->mObjectMigratedCallback(sporef_obj, migratedFrom, migratedTo);
@@ -247,11 +246,9 @@ void SessionManager::ObjectConnections::handleConnectStream(const SpaceObjectRef
 
 void SessionManager::ObjectConnections::remove(const SpaceObjectReference& sporef_objid) {
     // Update object indices
-    std::vector<SpaceObjectReference>& sporef_objects = mObjectServerMap[mObjectInfo[sporef_objid].connectedTo];
-    std::vector<SpaceObjectReference>::iterator sporef_where = std::find(sporef_objects.begin(), sporef_objects.end(), sporef_objid);
-    if (sporef_where != sporef_objects.end()) {
-        sporef_objects.erase(sporef_where);
-    }
+    ObjectServerMap::iterator server_it = mObjectServerMap.find(mObjectInfo[sporef_objid].connectedTo);
+    if (server_it != mObjectServerMap.end())
+        server_it->second.erase(sporef_objid);
 
     // Remove from main object set
     mObjectInfo.erase(sporef_objid);
@@ -269,7 +266,7 @@ void SessionManager::ObjectConnections::handleUnderlyingDisconnect(ServerID sid,
     // we have a copy of all the data we need.
     typedef std::vector<SpaceObjectReference> SporefVector;
     // NOTE: Copy so iterators stay valid
-    SporefVector sporef_objects = server_it->second;
+    SporefVector sporef_objects(server_it->second.begin(), server_it->second.end());
 
     for(SporefVector::const_iterator sporef_obj_it = sporef_objects.begin(); sporef_obj_it != sporef_objects.end(); sporef_obj_it++) {
         SpaceObjectReference sporef_obj = *sporef_obj_it;
@@ -329,6 +326,20 @@ void SessionManager::ObjectConnections::invokeDeferredCallbacks() {
     mDeferredCallbacks.clear();
 }
 
+// ServerShard Implementation
+
+SessionManager::ServerShard::ServerShard(Network::IOStrand* strand)
+ : ioStrand(strand),
+   sessionFlushRequested(false),
+   retryScheduled(false),
+   sendScheduled(false)
+{
+}
+
+SessionManager::ServerShard::~ServerShard() {
+    delete ioStrand;
+}
+
 // SessionManager Implementation
 
 SessionManager::SessionManager(
@@ -340,7 +351,8 @@ SessionManager::SessionManager(
    OHDP::DelegateService( std::tr1::bind(&SessionManager::createDelegateOHDPPort, this, std::tr1::placeholders::_1, std::tr1::placeholders::_2) ),
    mContext( ctx ),
    mSpace(space),
-   mIOStrand( ctx->ioService->createStrand("SessionManager") ),
+   mPendingConnectsRequested(false),
+   mSessionBatchSize(GetOptionValue<uint32>(OPT_OH_SESSION_BATCH)),
    mServerIDMap(sidmap),
    mObjectConnectedCallback(conn_cb),
    mObjectMigratedCallback(mig_cb),
@@ -374,10 +386,25 @@ SessionManager::~SessionManager() {
     }
     mConnections.clear();
 
+    // Only after the connections, which use their strands, are gone
+    for (ServerShardMap::iterator it = mShards.begin(); it != mShards.end(); it++)
+        delete it->second;
+    mShards.clear();
+
     delete mHandleReadProfiler;
     delete mHandleMessageProfiler;
+}
 
-    delete mIOStrand;
+SessionManager::ServerShard* SessionManager::getShard(ServerID sid) {
+    ServerShardMap::iterator it = mShards.find(sid);
+    if (it != mShards.end())
+        return it->second;
+
+    ServerShard* shard = new ServerShard(
+        mContext->ioService->createStrand(String("SessionManager Server ") + boost::lexical_cast<String>(sid))
+    );
+    mShards[sid] = shard;
+    return shard;
 }
 
 void SessionManager::start() {
@@ -465,14 +492,32 @@ bool SessionManager::connect(
         stream_created_cb, disconn_cb
     );
 
-    // Get a connection to request
+    // Get a connection to request. All the objects that connect before we
+    // get one share the request.
     SESSION_LOG(detailed, "Connection starting for " << sporef_objid);
-    getAnySpaceConnection(
-        std::tr1::bind(&SessionManager::openConnectionStartSession, this, sporef_objid, _1, false)
-    );
+    mPendingConnects.push_back(sporef_objid);
+    if (!mPendingConnectsRequested) {
+        mPendingConnectsRequested = true;
+        getAnySpaceConnection(
+            std::tr1::bind(&SessionManager::flushPendingConnects, this, _1)
+        );
+    }
     return true;
 }
 
+void SessionManager::flushPendingConnects(SpaceNodeConnection* conn) {
+    Sirikata::SerializationCheck::Scoped sc(&mSerialization);
+
+    mPendingConnectsRequested = false;
+    std::vector<SpaceObjectReference> pending;
+    pending.swap(mPendingConnects);
+    for(std::vector<SpaceObjectReference>::iterator it = pending.begin(); it != pending.end(); it++) {
+        // The object may have given up while waiting
+        if (!mObjectConnections.exists(*it)) continue;
+        openConnectionStartSession(*it, conn, false);
+    }
+}
+
 void SessionManager::disconnect(const SpaceObjectReference& sporef_objid) {
     Sirikata::SerializationCheck::Scoped sc(&mSerialization);
 
@@ -528,14 +573,37 @@ Duration SessionManager::clientTimeOffset() const {
 }
 
 void SessionManager::retryOpenConnection(const SpaceObjectReference&sporef_uuid,ServerID sid) {
-    using std::tr1::placeholders::_1;
+    if (!mObjectConnections.exists(sporef_uuid)) return;
+    queueSessionStart(sid, sporef_uuid, true);
+}
+
+void SessionManager::queueSessionStart(ServerID sid, const SpaceObjectReference& sporef_uuid, bool is_retry) {
+    Sirikata::SerializationCheck::Scoped sc(&mSerialization);
+
+    ServerShard* shard = getShard(sid);
+    shard->pendingSessions.push_back(std::make_pair(sporef_uuid, is_retry));
+    if (shard->sessionFlushRequested) return;
 
+    shard->sessionFlushRequested = true;
     getSpaceConnection(
         sid,
-        std::tr1::bind(&SessionManager::openConnectionStartSession, this, sporef_uuid, _1, true)
+        std::tr1::bind(&SessionManager::flushSessionStarts, this, sid, std::tr1::placeholders::_1)
     );
 }
 
+void SessionManager::flushSessionStarts(ServerID sid, SpaceNodeConnection* conn) {
+    Sirikata::SerializationCheck::Scoped sc(&mSerialization);
+
+    ServerShard* shard = getShard(sid);
+    shard->sessionFlushRequested = false;
+    ServerShard::PendingSessionList pending;
+    pending.swap(shard->pendingSessions);
+    for(ServerShard::PendingSessionList::iterator it = pending.begin(); it != pending.end(); it++) {
+        if (!mObjectConnections.exists(it->first)) continue;
+        openConnectionStartSession(it->first, conn, it->second);
+    }
+}
+
 void SessionManager::openConnectionStartSession(const SpaceObjectReference& sporef_uuid, SpaceNodeConnection* conn, bool is_retry) {
     Sirikata::SerializationCheck::Scoped sc(&mSerialization);
 
@@ -580,7 +648,11 @@ void SessionManager::openConnectionStartSession(const SpaceObjectReference& spor
     if (ci.zernike.size() > 0)
       connect_msg.set_zernike( ci.zernike );
 
-    if (!send(sporef_uuid, OBJECT_PORT_SESSION,
+    if (mSessionBatchSize > 1) {
+        // Goes out with the other session messages for this server
+        queueSessionMessage(conn->server(), sporef_uuid, serializePBJMessage(session_msg));
+    }
+    else if (!send(sporef_uuid, OBJECT_PORT_SESSION,
               UUID::null(), OBJECT_PORT_SESSION,
               serializePBJMessage(session_msg),
             conn->server()
@@ -590,27 +662,57 @@ void SessionManager::openConnectionStartSession(const SpaceObjectReference& spor
             std::tr1::bind(&SessionManager::retryOpenConnection,this,sporef_uuid,conn->server()),
             "&SessionManager::retryOpenConnection"
         );
+        return;
     }
-    else {
-        // Setup a retry in case something gets dropped -- must check status and
-        // retries entire connection process
-        mContext->mainStrand->post(
-            Duration::seconds(3),
-            std::tr1::bind(&SessionManager::checkConnectedAndRetry, this, sporef_uuid, conn->server()),
-            "SessionManager::checkConnectedAndRetry"
-        );
-    }
+
+    // Setup a retry in case something gets dropped -- must check status and
+    // retries entire connection process. The server's shard checks all its
+    // outstanding requests with one timer.
+    ServerShard* shard = getShard(conn->server());
+    shard->outstandingSessions.push_back(
+        std::make_pair(sporef_uuid, mContext->simTime() + Duration::seconds(3))
+    );
+    scheduleCheckConnectedAndRetry(conn->server());
 }
 
-void SessionManager::checkConnectedAndRetry(const SpaceObjectReference& sporef_uuid, ServerID connTo) {
-    // The object could have connected and disconnected quickly -- we need to
-    // verify it's really still trying to connect
-    if (mObjectConnections.exists(sporef_uuid) && mObjectConnections.getConnectingToServer(sporef_uuid) == connTo) {
-        getSpaceConnection(
-            connTo,
-            std::tr1::bind(&SessionManager::openConnectionStartSession, this, sporef_uuid, std::tr1::placeholders::_1, true)
-        );
+void SessionManager::scheduleCheckConnectedAndRetry(ServerID connTo) {
+    ServerShard* shard = getShard(connTo);
+    if (shard->retryScheduled || shard->outstandingSessions.empty())
+        return;
+
+    shard->retryScheduled = true;
+    Duration wait = shard->outstandingSessions.front().second - mContext->simTime();
+    if (wait < Duration::zero()) wait = Duration::zero();
+    mContext->mainStrand->post(
+        wait,
+        std::tr1::bind(&SessionManager::checkConnectedAndRetry, this, connTo),
+        "SessionManager::checkConnectedAndRetry"
+    );
+}
+
+void SessionManager::checkConnectedAndRetry(ServerID connTo) {
+    Sirikata::SerializationCheck::Scoped sc(&mSerialization);
+
+    ServerShard* shard = getShard(connTo);
+    shard->retryScheduled = false;
+
+    // Collect the expired requests first since retrying them may add new
+    // outstanding requests
+    std::vector<SpaceObjectReference> expired;
+    Time tnow = mContext->simTime();
+    while(!shard->outstandingSessions.empty() && shard->outstandingSessions.front().second <= tnow) {
+        expired.push_back(shard->outstandingSessions.front().first);
+        shard->outstandingSessions.pop_front();
+    }
+
+    for(std::vector<SpaceObjectReference>::iterator it = expired.begin(); it != expired.end(); it++) {
+        // The object could have connected and disconnected quickly -- we need to
+        // verify it's really still trying to connect
+        if (mObjectConnections.exists(*it) && mObjectConnections.getConnectingToServer(*it) == connTo)
+            queueSessionStart(connTo, *it, true);
     }
+
+    scheduleCheckConnectedAndRetry(connTo);
 }
 
 
@@ -624,11 +726,12 @@ void SessionManager::migrate(const SpaceObjectReference& sporef_obj_id, ServerID
     //forcibly close the SST connection for this object to its current previous
     //space server
     //ObjectReference objref(sporef_obj_id.object());
-    if (mObjectToSpaceStreams.find(sporef_obj_id.object()) != mObjectToSpaceStreams.end())
+    ObjectStreamMap::iterator stream_it = mObjectToSpaceStreams.find(sporef_obj_id.object());
+    if (stream_it != mObjectToSpaceStreams.end())
     {
         SESSION_LOG(detailed, "deleting object-space streams  of " << sporef_obj_id << " to " << sid);
-        mObjectToSpaceStreams[sporef_obj_id.object()]->connection().lock()->close(true);
-        mObjectToSpaceStreams.erase(sporef_obj_id.object());
+        stream_it->second->connection().lock()->close(true);
+        mObjectToSpaceStreams.erase(stream_it);
     }
     mObjectConnections.startMigration(sporef_obj_id, sid);
 
@@ -756,6 +859,85 @@ bool SessionManager::send(const SpaceObjectReference& sporef_src, const ObjectMe
     return pushed;
 }
 
+void SessionManager::queueSessionMessage(ServerID dest_server, const SpaceObjectReference& sporef, const std::string& payload) {
+    if (mSessionBatchSize <= 1) {
+        sendRetryingMessage(
+            sporef, OBJECT_PORT_SESSION,
+            UUID::null(), OBJECT_PORT_SESSION,
+            payload,
+            dest_server,
+            mContext->mainStrand,
+            Duration::seconds(0.05)
+        );
+        return;
+    }
+
+    ServerShard* shard = getShard(dest_server);
+    shard->outgoingSessions.push_back( std::make_pair(sporef.object().getAsUUID(), payload) );
+    if (shard->sendScheduled) return;
+
+    // Wait until the current handler finishes so everything it queues goes out
+    // together
+    shard->sendScheduled = true;
+    mContext->mainStrand->post(
+        std::tr1::bind(&SessionManager::flushSessionMessages, this, dest_server),
+        "SessionManager::flushSessionMessages"
+    );
+}
+
+void SessionManager::flushSessionMessages(ServerID dest_server) {
+    Sirikata::SerializationCheck::Scoped sc(&mSerialization);
+
+    ServerShard* shard = getShard(dest_server);
+    shard->sendScheduled = false;
+
+    // If the connection is gone, so are the sessions these were for. Anything
+    // still needed will be requested again when it's reestablished.
+    if (mShuttingDown || mConnections.find(dest_server) == mConnections.end()) {
+        shard->outgoingSessions.clear();
+        return;
+    }
+
+    while(!shard->outgoingSessions.empty()) {
+        uint32 count = std::min((uint32)shard->outgoingSessions.size(), mSessionBatchSize);
+
+        bool sent = false;
+        if (count == 1) {
+            // Not worth the batch wrapper
+            sent = send(
+                SpaceObjectReference(mSpace, ObjectReference(shard->outgoingSessions.front().first)), OBJECT_PORT_SESSION,
+                UUID::null(), OBJECT_PORT_SESSION,
+                shard->outgoingSessions.front().second,
+                dest_server
+            );
+        }
+        else {
+            Sirikata::Protocol::SessionBatch::SessionBatch batch;
+            for(uint32 i = 0; i < count; i++) {
+                batch.add_object(shard->outgoingSessions[i].first);
+                batch.add_session(shard->outgoingSessions[i].second);
+            }
+            sent = send(
+                SpaceObjectReference(mSpace, ObjectReference::null()), OBJECT_PORT_SESSION_BATCH,
+                UUID::null(), OBJECT_PORT_SESSION_BATCH,
+                serializePBJMessage(batch),
+                dest_server
+            );
+        }
+
+        if (!sent) {
+            shard->sendScheduled = true;
+            mContext->mainStrand->post(
+                Duration::seconds(0.05),
+                std::tr1::bind(&SessionManager::flushSessionMessages, this, dest_server),
+                "SessionManager::flushSessionMessages"
+            );
+            return;
+        }
+        shard->outgoingSessions.erase(shard->outgoingSessions.begin(), shard->outgoingSessions.begin() + count);
+    }
+}
+
 void SessionManager::sendRetryingMessage(const SpaceObjectReference& sporef_src, const ObjectMessagePort src_port, const UUID& dest, const ObjectMessagePort dest_port, const std::string& payload, ServerID dest_server, Network::IOStrand* strand, const Duration& rate) {
     bool sent = send(
         sporef_src, src_port,
@@ -886,7 +1068,7 @@ void SessionManager::registerSpaceNodeConnection(ServerID server, SpaceNodeConne
     assert(mConnectingConnections.find(server) == mConnectingConnections.end());
     SpaceNodeConnection* conn = new SpaceNodeConnection(
         mContext,
-        mIOStrand,
+        getShard(server)->ioStrand,
         mHandleReadProfiler,
         mStreamOptions,
         mSpace,
@@ -1040,6 +1222,9 @@ void SessionManager::handleServerMessage(ObjectMessage* msg, ServerID server_id)
     if (msg->source_object() == UUID::null() && msg->dest_port() == OBJECT_PORT_SESSION) {
         handleSessionMessage(msg, server_id);
     }
+    else if (msg->source_object() == UUID::null() && msg->dest_port() == OBJECT_PORT_SESSION_BATCH) {
+        handleSessionBatch(msg, server_id);
+    }
     else if (msg->source_object() == UUID::null() && msg->dest_object() == UUID::null()) {
         // Non-session messages between the space and OH, i.e. OHDP. Note that
         // the Session messages must be handled *before* this case since they
@@ -1106,6 +1291,29 @@ void SessionManager::handleSessionMessage(Sirikata::Protocol::Object::ObjectMess
     delete msg;
 }
 
+void SessionManager::handleSessionBatch(Sirikata::Protocol::Object::ObjectMessage* msg, ServerID from_server) {
+    Sirikata::Protocol::SessionBatch::SessionBatch batch;
+    bool parse_success = batch.ParseFromString(msg->payload());
+    if (!parse_success || batch.object_size() != batch.session_size()) {
+        LOG_INVALID_MESSAGE(session, error, msg->payload());
+        delete msg;
+        return;
+    }
+
+    // Each entry is handled just as if it had arrived on its own
+    for(int32 i = 0; i < batch.session_size(); i++) {
+        Sirikata::Protocol::Object::ObjectMessage* entry = createObjectMessage(
+            from_server,
+            UUID::null(), OBJECT_PORT_SESSION,
+            batch.object(i), OBJECT_PORT_SESSION,
+            batch.session(i)
+        );
+        handleSessionMessage(entry, from_server);
+    }
+
+    delete msg;
+}
+
 void SessionManager::handleSessionMessageConnectResponseSuccess(ServerID from_server, const SpaceObjectReference& sporef_obj, Sirikata::Protocol::Session::Container& session_msg) {
     uint64 seqno = (session_msg.has_seqno() ? session_msg.seqno() : 0);
 
@@ -1203,11 +1411,9 @@ void SessionManager::handleSessionMessageConnectResponseRedirect(ServerID from_s
     // Old seqno is no longer relevant, clear it out to make way for the
     // new request
     mObjectConnections.clearSeqno(sporef_obj);
-    // Get a connection to request
-    getSpaceConnection(
-        redirected,
-        std::tr1::bind(&SessionManager::openConnectionStartSession, this, sporef_obj, std::tr1::placeholders::_1, false)
-    );
+    // Get a connection to request, batched with any other redirects to the
+    // same server
+    queueSessionStart(redirected, sporef_obj, false);
 }
 
 void SessionManager::handleSessionMessageConnectResponseError(ServerID from_server, const SpaceObjectReference& sporef_obj, Sirikata::Protocol::Session::Container& session_msg) {
@@ -1255,14 +1461,7 @@ void SessionManager::sendConnectSuccessAck(const SpaceObjectReference& sporef, S
     Sirikata::Protocol::Session::Container ack_msg;
     ack_msg.set_seqno( mObjectConnections.getSeqno(sporef) );
     Sirikata::Protocol::Session::IConnectAck connect_ack_msg = ack_msg.mutable_connect_ack();
-    sendRetryingMessage(
-        sporef, OBJECT_PORT_SESSION,
-        UUID::null(), OBJECT_PORT_SESSION,
-        serializePBJMessage(ack_msg),
-        connected_to,
-        mContext->mainStrand,
-        Duration::seconds(0.05)
-    );
+    queueSessionMessage(connected_to, sporef, serializePBJMessage(ack_msg));
 }
 
 void SessionManager::handleObjectFullyConnected(const SpaceID& space, const ObjectReference& obj, ServerID server, const ConnectingInfo& ci, ConnectedCallback real_cb) {
@@ -1304,8 +1503,9 @@ void SessionManager::handleObjectFullyMigrated(const SpaceID& space, const Objec
 }
 
 SessionManager::SSTStreamPtr SessionManager::getSpaceStream(const ObjectReference& objectID) {
-  if (mObjectToSpaceStreams.find(objectID) != mObjectToSpaceStreams.end()) {
-    return mObjectToSpaceStreams[objectID];
+  ObjectStreamMap::iterator it = mObjectToSpaceStreams.find(objectID);
+  if (it != mObjectToSpaceStreams.end()) {
+    return it->second;
   }
 
   return SSTStreamPtr();
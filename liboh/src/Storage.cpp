@@ -45,5 +45,86 @@ void StorageFactory::destroy() {
 	AutoSingleton<StorageFactory>::destroy();
 }
 
+
+bool Storage::rangeScan(const Bucket& bucket, const Key& start, const Key& finish, const ScanToken& token, uint32 max_keys, const ScanCallback& cb, const String& timestamp) {
+    Key resume = start;
+    if (max_keys == 0 || (!token.empty() && !decodeScanToken(start, token, &resume)))
+        return false;
+
+    // The last key is read again, but is removed when the page is trimmed
+    return rangeRead(
+        bucket, resume, finish,
+        std::tr1::bind(&Storage::handleRangeScanRead, this, start, token, max_keys, cb, std::tr1::placeholders::_1, std::tr1::placeholders::_2),
+        timestamp
+    );
+}
+
+void Storage::handleRangeScanRead(const Key start, const ScanToken token, uint32 max_keys, ScanCallback cb, Result result, ReadSet* rs) {
+    ScanToken next;
+    if (result == SUCCESS) {
+        if (rs == NULL) rs = new ReadSet();
+        next = trimScanPage(start, token, max_keys, rs);
+    }
+
+    if (cb)
+        cb(result, rs, next);
+    else
+        delete rs;
+}
+
+Storage::ScanToken Storage::encodeScanToken(const Key& start, const Key& last) {
+    Key::size_type shared = 0;
+    while(shared < start.size() && shared < last.size() && start[shared] == last[shared])
+        shared++;
+
+    std::ostringstream token;
+    token << shared << ':' << last.substr(shared);
+    return token.str();
+}
+
+bool Storage::decodeScanToken(const Key& start, const ScanToken& token, Key* last_out) {
+    ScanToken::size_type sep = token.find(':');
+    if (sep == ScanToken::npos || sep == 0)
+        return false;
+
+    Key::size_type shared = 0;
+    for(ScanToken::size_type i = 0; i < sep; i++) {
+        if (token[i] < '0' || token[i] > '9') return false;
+        shared = shared * 10 + (token[i] - '0');
+        if (shared > start.size()) return false;
+    }
+
+    *last_out = start.substr(0, shared) + token.substr(sep+1);
+    return true;
+}
+
+Storage::ScanToken Storage::trimScanPage(const Key& start, const ScanToken& token, uint32 max_keys, ReadSet* rs) {
+    Key last;
+    bool resuming = !token.empty() && decodeScanToken(start, token, &last);
+
+    // Keys that belong in this page, i.e. the first max_keys after last
+    std::set<Key> page;
+    for(ReadSet::iterator it = rs->begin(); it != rs->end(); it++) {
+        if (resuming && it->first <= last) continue;
+        page.insert(it->first);
+        if (page.size() > max_keys)
+            page.erase(--page.end());
+    }
+
+    bool more = false;
+    for(ReadSet::iterator it = rs->begin(); it != rs->end(); ) {
+        if (page.find(it->first) != page.end()) {
+            it++;
+            continue;
+        }
+        if (!resuming || it->first > last)
+            more = true;
+        rs->erase(it++);
+    }
+
+    if (!more || page.empty()) return ScanToken();
+    return encodeScanToken(start, *page.rbegin());
+}
+
 } // namespace OH
 } //namespace Sirikata
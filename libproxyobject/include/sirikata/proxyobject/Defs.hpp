@@ -54,6 +54,12 @@ class ProxyManager;
 typedef std::tr1::shared_ptr<ProxyManager> ProxyManagerPtr;
 typedef std::tr1::weak_ptr<ProxyManager> ProxyManagerWPtr;
 
+class ProxyObjectStore;
+typedef std::tr1::shared_ptr<ProxyObjectStore> ProxyObjectStorePtr;
+
+class SharedProxyState;
+typedef std::tr1::shared_ptr<SharedProxyState> SharedProxyStatePtr;
+
 } // namespace Sirikata
 
 #endif //_SIRIKATA_PROXYOBJECT_DEFS_HPP_
@@ -76,8 +76,16 @@ class PresencePropertiesLocUpdate;
  *  Loc updates are saved for short time and, if they aren't needed, are
  *  discarded. In all cases, sequence numbers are still used so possibly trying
  *  to apply old updates isn't an issue.
+ *
+ *  Since every update is saved with the same timeout, updates expire in the
+ *  order they were added. They are decoded and stored in a single ring buffer
+ *  in that order, so expiring them just advances the start of the ring, and
+ *  the updates for each object are chained together through the ring so they
+ *  can be found without any per-object allocations.
  */
 class SIRIKATA_PROXYOBJECT_EXPORT OrphanLocUpdateManager : public PollingService {
+private:
+    struct UpdateInfo;
 public:
     template<typename QuerierIDType>
     class Listener {
@@ -92,6 +100,10 @@ public:
      *  out.
      */
     void addOrphanUpdate(const SpaceObjectReference& observed, const Sirikata::Protocol::Loc::LocationUpdate& update);
+    /** Add an orphan update to the queue and set a timeout for it to be cleared
+     *  out. Times in the update should still be in space time.
+     */
+    void addOrphanUpdate(const SpaceObjectReference& observed, const LocUpdate& update);
     /**
        Take all fields in proxyPtr, and create an struct from
        them.
@@ -110,52 +122,149 @@ public:
         ObjectUpdateMap::iterator it = mUpdates.find(proximateID);
         if (it == mUpdates.end()) return;
 
-        const UpdateInfoList& info_list = it->second;
-        for(UpdateInfoList::const_iterator info_it = info_list.begin(); info_it != info_list.end(); info_it++) {
-            if ((*info_it)->value != NULL) {
-                LocProtocolLocUpdate llu( *((*info_it)->value) );
-                listener->onOrphanLocUpdate( observer, llu );
-            }
-            else if ((*info_it)->opd != NULL) {
-                PresencePropertiesLocUpdate plu( (*info_it)->object.object(), *((*info_it)->opd) );
-                listener->onOrphanLocUpdate( observer, plu );
-            }
-        }
-
         // Once we've notified of these we can get rid of them -- if they
         // need the info again they should re-register it with
-        // addUpdateFromExisting before cleaning up the object.
+        // addUpdateFromExisting before cleaning up the object. They're
+        // removed before notifying in case the listener adds more.
+        uint64 seq = it->second.first;
         mUpdates.erase(it);
+
+        while(seq != NO_UPDATE) {
+            uint64 cur = seq;
+            seq = at(cur).next;
+            at(cur).consumed = true;
+            at(cur).next = NO_UPDATE;
+
+            {
+                // Copies the info since the listener may add updates, which
+                // can grow the ring and move it
+                OrphanLocUpdate olu(at(cur));
+                listener->onOrphanLocUpdate( observer, olu );
+            }
+
+            // Drop any allocations now rather than when it expires. Look it
+            // up again since the ring may have grown.
+            at(cur).mesh = String();
+            at(cur).physics = String();
+        }
     }
 
+    /// Get the number of updates being held, including those already invoked
+    /// but not yet expired.
+    uint32 size() const { return mCount; }
+
 private:
     virtual void poll();
 
+    static const uint64 NO_UPDATE = (uint64)-1;
+
     struct UpdateInfo {
-        UpdateInfo(const SpaceObjectReference& obj, Sirikata::Protocol::Loc::LocationUpdate* _v, const Time& t)
-         : object(obj), value(_v), opd(NULL), expiresAt(t)
-        {}
-        UpdateInfo(const SpaceObjectReference& obj, SequencedPresenceProperties* _v, const Time& t)
-         : object(obj), value(NULL), opd(_v), expiresAt(t)
-        {}
-        ~UpdateInfo();
+        UpdateInfo();
 
         SpaceObjectReference object;
-        //Either value or opd will be non-null.  Never both.
-        Sirikata::Protocol::Loc::LocationUpdate* value;
-        SequencedPresenceProperties* opd;
-
         Time expiresAt;
+        // Sequence number in the ring of the next update for the same object
+        uint64 next;
+        // Whether this has already been passed to a listener
+        bool consumed;
+        // Updates copied from proxies are already in local time
+        bool localTime;
+
+        // LocUpdate fields, only valid if marked in fields
+        uint8 fields;
+        uint64 epoch;
+        ObjectReference parent;
+        TimedMotionVector3f location;
+        TimedMotionQuaternion orientation;
+        BoundingSphere3f bounds;
+        String mesh;
+        String physics;
+        uint64 seqnos[SequencedPresenceProperties::LOC_NUM_PART];
+    };
+
+    enum Fields {
+        HAS_EPOCH = 1,
+        HAS_PARENT = 2,
+        HAS_LOCATION = 4,
+        HAS_ORIENTATION = 8,
+        HAS_BOUNDS = 16,
+        HAS_MESH = 32,
+        HAS_PHYSICS = 64
+    };
+
+    /** Implementation of LocUpdate which reads from a copy of a saved
+     *  UpdateInfo.
+     */
+    class OrphanLocUpdate : public LocUpdate {
+    public:
+        OrphanLocUpdate(const UpdateInfo& info)
+         : mInfo(info)
+        {}
+        virtual ~OrphanLocUpdate() {}
+
+        virtual ObjectReference object() const { return mInfo.object.object(); }
+
+        virtual bool has_epoch() const { return (mInfo.fields & HAS_EPOCH) != 0; }
+        virtual uint64 epoch() const { return mInfo.epoch; }
+
+        virtual bool has_parent() const { return (mInfo.fields & HAS_PARENT) != 0; }
+        virtual ObjectReference parent() const { return mInfo.parent; }
+        virtual uint64 parent_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_PARENT_PART]; }
+
+        virtual bool has_location() const { return (mInfo.fields & HAS_LOCATION) != 0; }
+        virtual TimedMotionVector3f location() const { return mInfo.location; }
+        virtual uint64 location_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_POS_PART]; }
+        virtual TimedMotionVector3f locationWithLocalTime(ObjectHost* oh, const SpaceID& from_space) const {
+            if (mInfo.localTime) return location();
+            return LocUpdate::locationWithLocalTime(oh, from_space);
+        }
+
+        virtual bool has_orientation() const { return (mInfo.fields & HAS_ORIENTATION) != 0; }
+        virtual TimedMotionQuaternion orientation() const { return mInfo.orientation; }
+        virtual uint64 orientation_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_ORIENT_PART]; }
+        virtual TimedMotionQuaternion orientationWithLocalTime(ObjectHost* oh, const SpaceID& from_space) const {
+            if (mInfo.localTime) return orientation();
+            return LocUpdate::orientationWithLocalTime(oh, from_space);
+        }
+
+        virtual bool has_bounds() const { return (mInfo.fields & HAS_BOUNDS) != 0; }
+        virtual BoundingSphere3f bounds() const { return mInfo.bounds; }
+        virtual uint64 bounds_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_BOUNDS_PART]; }
+
+        virtual bool has_mesh() const { return (mInfo.fields & HAS_MESH) != 0; }
+        virtual String mesh() const { return mInfo.mesh; }
+        virtual uint64 mesh_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_MESH_PART]; }
+
+        virtual bool has_physics() const { return (mInfo.fields & HAS_PHYSICS) != 0; }
+        virtual String physics() const { return mInfo.physics; }
+        virtual uint64 physics_seqno() const { return mInfo.seqnos[SequencedPresenceProperties::LOC_PHYSICS_PART]; }
     private:
-        UpdateInfo();
+        OrphanLocUpdate();
+        OrphanLocUpdate(const OrphanLocUpdate&);
+
+        UpdateInfo mInfo;
     };
-    typedef std::tr1::shared_ptr<UpdateInfo> UpdateInfoPtr;
-    typedef std::vector<UpdateInfoPtr> UpdateInfoList;
 
-    typedef std::tr1::unordered_map<SpaceObjectReference, UpdateInfoList, SpaceObjectReference::Hasher> ObjectUpdateMap;
+    // Allocate a new update at the end of the ring and link it into the chain
+    // for its object
+    UpdateInfo& push(const SpaceObjectReference& observed);
+    UpdateInfo& at(uint64 seq) { return mRing[(mStart + (seq - mStartSeq)) % mRing.size()]; }
+
+    // Maps objects to the sequence numbers of their first and last saved
+    // updates, the last so new updates can be appended to the chain
+    typedef std::tr1::unordered_map<SpaceObjectReference, std::pair<uint64, uint64>, SpaceObjectReference::Hasher> ObjectUpdateMap;
 
     Context* mContext;
     Duration mTimeout;
+
+    // Ring of saved updates in the order they were added (and will expire).
+    // Each is identified by a sequence number, mStartSeq being the one at
+    // mStart, which remains valid as the ring grows.
+    std::vector<UpdateInfo> mRing;
+    uint32 mStart;
+    uint32 mCount;
+    uint64 mStartSeq;
+
     ObjectUpdateMap mUpdates;
 }; // class OrphanLocUpdateManager
 
@@ -51,13 +51,20 @@ class SIRIKATA_PROXYOBJECT_EXPORT ProxyManager
       SerializationCheck
 {
 public:
-    static ProxyManagerPtr construct(VWObjectPtr parent, const SpaceObjectReference& _id);
+    /** Create a ProxyManager for the presence _id. If store is non-NULL, the
+     *  properties of the ProxyObjects created are shared with those of other
+     *  ProxyManagers using the same store.
+     */
+    static ProxyManagerPtr construct(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyObjectStorePtr store = ProxyObjectStorePtr());
     virtual ~ProxyManager();
 
     const SpaceObjectReference& id() const { return mID; }
 
     VWObjectPtr parent() const { return mParent; }
 
+    /// Get the store ProxyObjects share state through, which may be NULL
+    ProxyObjectStorePtr proxyStore() const { return mStore; }
+
     ///Called after providers attached
     virtual void initialize();
     ///Called before providers detatched
@@ -93,7 +100,7 @@ public:
 private:
     friend class ProxyObject;
 
-    ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id);
+    ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyObjectStorePtr store);
 
     // These track the *entire* lifetime of ProxyObjects. This allows
     // clients of ProxyManager to hold onto ProxyObjects beyond when
@@ -110,6 +117,8 @@ private:
     VWObjectPtr mParent;
     // Presence identifier that runs this ProxyManager
     SpaceObjectReference mID;
+    // Store for state shared with other ProxyManagers
+    ProxyObjectStorePtr mStore;
 
     struct ProxyData {
         ProxyData(ProxyObjectPtr p)
@@ -51,6 +51,7 @@
 
 #include <sirikata/core/util/PresenceProperties.hpp>
 #include <sirikata/proxyobject/ProxyManager.hpp>
+#include <sirikata/proxyobject/ProxyObjectStore.hpp>
 
 #include <sirikata/core/util/SerializationCheck.hpp>
 
@@ -60,6 +61,7 @@ namespace Sirikata {
 //forward declares
 class MeshListener;
 class ProxyObjectListener;
+class ProxyUpdateBatch;
 
 
 //typedefs
@@ -96,12 +98,19 @@ public:
  * that this *always* represents the current reported status of the
  * object in the space, even if you own the presence.
  *
+ * The properties themselves live in a SharedProxyState, shared with the
+ * ProxyObjects other presences on the same object host have for the object
+ * (see ProxyObjectStore). Each ProxyObject tracks its own presence's sequence
+ * numbers and only notifies its own listeners. Changes accepted through other
+ * presences' ProxyObjects are reported along with this presence's next update
+ * for the object.
+ *
  * Note that this class is *not* thread safe. You need to protect it by locking
  * a mutex from the ProxyManager or HostedObject while accessing it.
  */
 class SIRIKATA_PROXYOBJECT_EXPORT ProxyObject
     : public SelfWeakPtr<ProxyObject>,
-      public SequencedPresenceProperties,
+      public virtual IPresencePropertiesRead,
       public ProxyObjectProvider,
       public PositionProvider,
       public MeshProvider,
@@ -123,6 +132,28 @@ private:
     bool mValid;
     const SpaceObjectReference mID;
     ProxyManagerPtr mParent;
+    SharedProxyStatePtr mState;
+    // Sequence numbers of the latest updates received by this presence
+    uint64 mUpdateSeqno[SequencedPresenceProperties::LOC_NUM_PART];
+    // Versions of the shared state last reported to our listeners
+    uint64 mReportedVersion[SequencedPresenceProperties::LOC_NUM_PART];
+
+    friend class ProxyUpdateBatch;
+
+    // Properties that can change, used to track which listeners need to be
+    // notified
+    enum Changes {
+        POSITION_CHANGED = 1,
+        BOUNDS_CHANGED = 2,
+        MESH_CHANGED = 4,
+        PHYSICS_CHANGED = 8,
+        IS_AGGREGATE_CHANGED = 16
+    };
+    // Notify this ProxyObject's listeners of changes in the shared state
+    void notifyChanges(uint8 changes);
+    // If part of the shared state changed since we last reported it, notify
+    // our listeners, or record the changes in batch if it is non-NULL
+    void reportChanges(SequencedPresenceProperties::LOC_PARTS part, uint8 changes, ProxyUpdateBatch* batch);
 
 public:
     /** Constructs a new ProxyObject. After constructing this object, it
@@ -176,6 +207,15 @@ public:
     /// Returns if this object has a zero velocity and requires no extrapolation.
     bool isStatic() const;
 
+    /// Get the state shared with other presences' ProxyObjects for this object.
+    SharedProxyStatePtr sharedState() const { return mState; }
+
+    /// Get the sequence number of the latest update to part from this presence.
+    uint64 getUpdateSeqNo(SequencedPresenceProperties::LOC_PARTS whichPart) const;
+    /// Get a copy of the verified properties with this presence's sequence
+    /// numbers.
+    SequencedPresenceProperties properties() const;
+
     // PresenceProperties Overrides
     virtual TimedMotionVector3f location() const;
     virtual TimedMotionQuaternion orientation() const;
@@ -183,6 +223,7 @@ public:
     virtual Transfer::URI mesh() const;
     virtual String physics() const;
     virtual bool isAggregate() const;
+    virtual ObjectReference parent() const;
     virtual ObjectReference parentAggregate() const;
 
     // Alternatives that access only the *verified* location information,
@@ -193,12 +234,14 @@ public:
     Transfer::URI verifiedMesh() const;
     String verifiedPhysics() const;
 
-    void setLocation(const TimedMotionVector3f& reqloc, uint64 seqno);
-    void setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno);
-    void setBounds(const BoundingSphere3f& bnds, uint64 seqno);
-    void setMesh (Transfer::URI const& rhs, uint64 seqno);
-    void setPhysics(const String& rhs, uint64 seqno);
-    void setIsAggregate(bool isAggregate, uint64 seqno);
+    // Setters for the properties reported by the space. If batch is non-NULL,
+    // listeners are notified when it is flushed instead of immediately.
+    void setLocation(const TimedMotionVector3f& reqloc, uint64 seqno, ProxyUpdateBatch* batch = NULL);
+    void setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno, ProxyUpdateBatch* batch = NULL);
+    void setBounds(const BoundingSphere3f& bnds, uint64 seqno, ProxyUpdateBatch* batch = NULL);
+    void setMesh (Transfer::URI const& rhs, uint64 seqno, ProxyUpdateBatch* batch = NULL);
+    void setPhysics(const String& rhs, uint64 seqno, ProxyUpdateBatch* batch = NULL);
+    void setIsAggregate(bool isAggregate, uint64 seqno, ProxyUpdateBatch* batch = NULL);
 
 
     /** Retuns the local location of this object at the current timestamp. */
@@ -233,5 +276,41 @@ public:
     };
 
 };
+
+/** Collects the listener notifications for a set of updates to ProxyObjects so
+ *  they can be delivered together. Each ProxyObject is notified at most once
+ *  per kind of change when the batch is flushed, so applying many updates for
+ *  the same object, e.g. from one bulk location message, only generates one
+ *  set of callbacks with the final values. Only add ProxyObjects belonging to
+ *  the presence whose updates are being applied, since flushing notifies their
+ *  listeners.
+ *
+ *  The batch holds references to the ProxyObjects until it is flushed, and is
+ *  flushed automatically when destroyed. Like ProxyObject, it isn't thread
+ *  safe.
+ */
+class SIRIKATA_PROXYOBJECT_EXPORT ProxyUpdateBatch : Noncopyable {
+public:
+    ProxyUpdateBatch();
+    ~ProxyUpdateBatch();
+
+    /// Deliver all pending notifications, in the order the ProxyObjects were
+    /// first updated.
+    void flush();
+
+    /// Number of ProxyObjects with pending notifications
+    uint32 size() const { return mProxies.size(); }
+    bool empty() const { return mProxies.empty(); }
+
+private:
+    friend class ProxyObject;
+    void add(const ProxyObjectPtr& proxy, uint8 changes);
+
+    std::vector<ProxyObjectPtr> mProxies;
+    std::vector<uint8> mChanges;
+    typedef std::tr1::unordered_map<ProxyObject*, uint32> IndexMap;
+    IndexMap mIndex;
+};
+
 }
 #endif
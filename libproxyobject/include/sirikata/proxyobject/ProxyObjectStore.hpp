@@ -0,0 +1,143 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_PROXYOBJECT_PROXY_OBJECT_STORE_HPP_
+#define _SIRIKATA_PROXYOBJECT_PROXY_OBJECT_STORE_HPP_
+
+#include <sirikata/proxyobject/Platform.hpp>
+#include <sirikata/proxyobject/Defs.hpp>
+#include <sirikata/core/util/PresenceProperties.hpp>
+#include <sirikata/core/util/SpaceObjectReference.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Sirikata {
+
+/** The properties of one object in a space, shared by all the ProxyObjects for
+ *  that object on an object host. Every presence gets its own ProxyObject, each
+ *  with its own sequence numbers, but the values they report are stored here
+ *  once.
+ *
+ *  Since sequence numbers are assigned per presence by the space, they can't be
+ *  used to order updates arriving through different presences. Instead, the
+ *  ProxyObject that last set a property keeps ordering its own updates by
+ *  sequence number. Another ProxyObject only takes over a property when its
+ *  own sequence number for that property advanced, i.e. its presence received
+ *  a fresh update rather than a replay of one it had already seen, and the
+ *  update carries new information: a newer update time for location and
+ *  orientation, or a different value for the other properties. This is what
+ *  makes duplicate updates from overlapping presences cheap -- the first one
+ *  is applied, the rest are dropped.
+ *
+ *  Each property also has a version which is incremented whenever it is set.
+ *  Only the owner of a presence may notify the listeners of its ProxyObjects,
+ *  so a ProxyObject never notifies the others sharing its state. Instead, each
+ *  one remembers the versions it last reported and catches up on changes made
+ *  through other presences the next time its own presence receives an update
+ *  for the object.
+ *
+ *  Presences sharing state may run on different strands, so the values,
+ *  versions, attached ProxyObjects and last writers are all protected by a
+ *  mutex.
+ */
+class SIRIKATA_PROXYOBJECT_EXPORT SharedProxyState
+    : public PresenceProperties,
+      Noncopyable
+{
+public:
+    /** Create state for an object. If store is non-NULL the state is removed
+     *  from it when destroyed, otherwise it is private to one ProxyObject.
+     */
+    SharedProxyState(ProxyObjectStorePtr store, const SpaceObjectReference& id);
+    ~SharedProxyState();
+
+    const SpaceObjectReference& id() const { return mID; }
+
+    // Reads take the lock, so they return consistent copies even while
+    // another strand is updating the state
+    virtual TimedMotionVector3f location() const;
+    virtual TimedMotionQuaternion orientation() const;
+    virtual BoundingSphere3f bounds() const;
+    virtual Transfer::URI mesh() const;
+    virtual String physics() const;
+    virtual bool isAggregate() const;
+    virtual ObjectReference parent() const;
+
+    // Each of these sets the value if writer is the last ProxyObject to set it,
+    // or if writer's sequence number for the property advanced and the value
+    // contains new information. Returns true if it was set.
+    bool updateLocation(const ProxyObject* writer, bool advanced, const TimedMotionVector3f& loc);
+    bool updateOrientation(const ProxyObject* writer, bool advanced, const TimedMotionQuaternion& orient);
+    bool updateBounds(const ProxyObject* writer, bool advanced, const BoundingSphere3f& bnds);
+    bool updateMesh(const ProxyObject* writer, bool advanced, const Transfer::URI& mesh);
+    bool updatePhysics(const ProxyObject* writer, bool advanced, const String& phy);
+    bool updateIsAggregate(const ProxyObject* writer, bool advanced, bool isAgg);
+
+    /// Get the number of times part has been set. Starts at 0.
+    uint64 version(SequencedPresenceProperties::LOC_PARTS part) const;
+
+    /// Add a ProxyObject to the set using this state
+    void attach(ProxyObject* proxy);
+    /// Remove a ProxyObject, e.g. when it is destroyed
+    void detach(ProxyObject* proxy);
+    /// Get the number of attached ProxyObjects
+    uint32 numAttached() const;
+
+private:
+    // Must be called with mMutex held
+    bool accept(SequencedPresenceProperties::LOC_PARTS part, const ProxyObject* writer, bool advanced, bool newinfo);
+
+    ProxyObjectStorePtr mStore;
+    const SpaceObjectReference mID;
+
+    mutable boost::mutex mMutex;
+    uint64 mVersion[SequencedPresenceProperties::LOC_NUM_PART];
+    // Raw pointers since a ProxyObject attaches itself before its shared_ptr
+    // exists. They're only compared, never dereferenced.
+    std::vector<ProxyObject*> mProxies;
+    // The ProxyObject that last set each property, whose own sequence numbers
+    // already order its updates.
+    const ProxyObject* mWriter[SequencedPresenceProperties::LOC_NUM_PART];
+};
+
+/** Object host wide store of SharedProxyState, keyed by the observed object's
+ *  SpaceObjectReference. The store only holds weak references: state lives as
+ *  long as some ProxyObject uses it, so presences that can see the same objects
+ *  share one copy of their properties while it's alive, and it's cleaned up
+ *  once none of them can.
+ *
+ *  Lookups are protected by a mutex since state may be released from any
+ *  thread that drops the last reference to a ProxyObject.
+ */
+class SIRIKATA_PROXYOBJECT_EXPORT ProxyObjectStore
+    : public SelfWeakPtr<ProxyObjectStore>,
+      Noncopyable
+{
+public:
+    static ProxyObjectStorePtr construct();
+    ~ProxyObjectStore();
+
+    /// Get the shared state for an object, creating it if necessary.
+    SharedProxyStatePtr acquire(const SpaceObjectReference& id);
+
+    /// Get the number of objects with live state.
+    uint32 size();
+
+private:
+    friend class SharedProxyState;
+
+    ProxyObjectStore();
+
+    // Invoked by SharedProxyState when it is destroyed
+    void release(const SpaceObjectReference& id);
+
+    typedef std::tr1::weak_ptr<SharedProxyState> SharedProxyStateWPtr;
+    typedef std::tr1::unordered_map<SpaceObjectReference, SharedProxyStateWPtr, SpaceObjectReference::Hasher> StateMap;
+
+    boost::mutex mMutex;
+    StateMap mStates;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_PROXYOBJECT_PROXY_OBJECT_STORE_HPP_
@@ -37,60 +37,165 @@
 
 namespace Sirikata {
 
-OrphanLocUpdateManager::UpdateInfo::~UpdateInfo() {
-    if (value != NULL)
-        delete value;
-    if (opd != NULL)
-        delete opd;
+const uint64 OrphanLocUpdateManager::NO_UPDATE;
+
+namespace {
+// Initial number of updates the ring can hold
+const uint32 INITIAL_RING_SIZE = 64;
+}
+
+OrphanLocUpdateManager::UpdateInfo::UpdateInfo()
+ : object(SpaceObjectReference::null()),
+   expiresAt(Time::null()),
+   next(NO_UPDATE),
+   consumed(true),
+   localTime(false),
+   fields(0),
+   epoch(0),
+   parent(ObjectReference::null())
+{
+    memset(seqnos, 0, SequencedPresenceProperties::LOC_NUM_PART * sizeof(uint64));
 }
 
 OrphanLocUpdateManager::OrphanLocUpdateManager(Context* ctx, Network::IOStrand* strand, const Duration& timeout)
  : PollingService(strand, "OrphanLocUpdateManager Poll", timeout, ctx, "OrphanLocUpdateManager"),
    mContext(ctx),
-   mTimeout(timeout)
+   mTimeout(timeout),
+   mRing(INITIAL_RING_SIZE),
+   mStart(0),
+   mCount(0),
+   mStartSeq(0)
 {
 
 }
 
+OrphanLocUpdateManager::UpdateInfo& OrphanLocUpdateManager::push(const SpaceObjectReference& observed) {
+    if (mCount == mRing.size()) {
+        // Grow, unwrapping the ring so the oldest update is at the start again
+        std::vector<UpdateInfo> grown(mRing.size() * 2);
+        for(uint32 i = 0; i < mCount; i++)
+            std::swap(grown[i], mRing[(mStart + i) % mRing.size()]);
+        mRing.swap(grown);
+        mStart = 0;
+    }
+
+    uint64 seq = mStartSeq + mCount;
+    mCount++;
+    UpdateInfo& info = at(seq);
+    info = UpdateInfo();
+    info.object = observed;
+    info.expiresAt = mContext->simTime() + mTimeout;
+    info.consumed = false;
+
+    ObjectUpdateMap::iterator it = mUpdates.find(observed);
+    if (it == mUpdates.end()) {
+        mUpdates[observed] = std::make_pair(seq, seq);
+    }
+    else {
+        at(it->second.second).next = seq;
+        it->second.second = seq;
+    }
+
+    return info;
+}
+
 void OrphanLocUpdateManager::addOrphanUpdate(const SpaceObjectReference& observed, const Sirikata::Protocol::Loc::LocationUpdate& update) {
     assert( ObjectReference(update.object()) == observed.object() );
-    UpdateInfoList& info_list = mUpdates[observed];
-    info_list.push_back(
-        UpdateInfoPtr(new UpdateInfo(observed, new Sirikata::Protocol::Loc::LocationUpdate(update), mContext->simTime() + mTimeout))
-    );
+    LocProtocolLocUpdate llu(update);
+    addOrphanUpdate(observed, llu);
+}
+
+void OrphanLocUpdateManager::addOrphanUpdate(const SpaceObjectReference& observed, const LocUpdate& update) {
+    assert( update.object() == observed.object() );
+    UpdateInfo& info = push(observed);
+
+    if (update.has_epoch()) {
+        info.fields |= HAS_EPOCH;
+        info.epoch = update.epoch();
+    }
+    if (update.has_parent()) {
+        info.fields |= HAS_PARENT;
+        info.parent = update.parent();
+        info.seqnos[SequencedPresenceProperties::LOC_PARENT_PART] = update.parent_seqno();
+    }
+    if (update.has_location()) {
+        info.fields |= HAS_LOCATION;
+        info.location = update.location();
+        info.seqnos[SequencedPresenceProperties::LOC_POS_PART] = update.location_seqno();
+    }
+    if (update.has_orientation()) {
+        info.fields |= HAS_ORIENTATION;
+        info.orientation = update.orientation();
+        info.seqnos[SequencedPresenceProperties::LOC_ORIENT_PART] = update.orientation_seqno();
+    }
+    if (update.has_bounds()) {
+        info.fields |= HAS_BOUNDS;
+        info.bounds = update.bounds();
+        info.seqnos[SequencedPresenceProperties::LOC_BOUNDS_PART] = update.bounds_seqno();
+    }
+    if (update.has_mesh()) {
+        info.fields |= HAS_MESH;
+        info.mesh = update.mesh();
+        info.seqnos[SequencedPresenceProperties::LOC_MESH_PART] = update.mesh_seqno();
+    }
+    if (update.has_physics()) {
+        info.fields |= HAS_PHYSICS;
+        info.physics = update.physics();
+        info.seqnos[SequencedPresenceProperties::LOC_PHYSICS_PART] = update.physics_seqno();
+    }
 }
 
 void OrphanLocUpdateManager::addUpdateFromExisting(
     const SpaceObjectReference& observed,
     const SequencedPresenceProperties& props
 ) {
-    UpdateInfoList& info_list = mUpdates[observed];
+    UpdateInfo& info = push(observed);
 
-    SequencedPresenceProperties* opd = new SequencedPresenceProperties(props);
-    info_list.push_back( UpdateInfoPtr(new UpdateInfo(observed, opd, mContext->simTime() + mTimeout)) );
+    // Saved state always has every field and is already in local time
+    info.localTime = true;
+    info.fields = HAS_PARENT | HAS_LOCATION | HAS_ORIENTATION | HAS_BOUNDS | HAS_MESH | HAS_PHYSICS;
+    if (props.parent() == ObjectReference::null())
+        info.fields &= ~HAS_PARENT;
+    info.parent = props.parent();
+    info.location = props.location();
+    info.orientation = props.orientation();
+    info.bounds = props.bounds();
+    info.mesh = props.mesh().toString();
+    info.physics = props.physics();
+    for(uint32 i = 0; i < SequencedPresenceProperties::LOC_NUM_PART; i++)
+        info.seqnos[i] = props.getUpdateSeqNo((SequencedPresenceProperties::LOC_PARTS)i);
 }
 
 void OrphanLocUpdateManager::addUpdateFromExisting(ProxyObjectPtr proxyPtr) {
     addUpdateFromExisting(
         proxyPtr->getObjectReference(),
-        *(dynamic_cast<SequencedPresenceProperties*>(proxyPtr.get()))
+        proxyPtr->properties()
     );
 }
 
 void OrphanLocUpdateManager::poll() {
     Time now = mContext->simTime();
-    // Scan through all updates looking for outdated ones
-    for(ObjectUpdateMap::iterator it = mUpdates.begin(); it != mUpdates.end(); ) {
-        UpdateInfoList& info_list = it->second;
-        while(!info_list.empty() && (*info_list.begin())->expiresAt < now) {
-            info_list.erase(info_list.begin());
+    // Updates expire in the order they were added, so just scan from the
+    // start of the ring until we find one that's still valid
+    while(mCount > 0) {
+        UpdateInfo& info = mRing[mStart];
+        if (info.expiresAt >= now) break;
+
+        if (!info.consumed) {
+            // Anything older for this object has already expired, so this is
+            // the start of its chain
+            ObjectUpdateMap::iterator it = mUpdates.find(info.object);
+            assert(it != mUpdates.end() && it->second.first == mStartSeq);
+            if (info.next == NO_UPDATE)
+                mUpdates.erase(it);
+            else
+                it->second.first = info.next;
         }
 
-        ObjectUpdateMap::iterator next_it = it;
-        next_it++;
-        if (info_list.empty())
-            mUpdates.erase(it);
-        it = next_it;
+        info = UpdateInfo();
+        mStart = (mStart + 1) % mRing.size();
+        mCount--;
+        mStartSeq++;
     }
 }
 
@@ -44,14 +44,15 @@
 
 namespace Sirikata {
 
-ProxyManagerPtr ProxyManager::construct(VWObjectPtr parent, const SpaceObjectReference& _id) {
-    ProxyManagerPtr res(SelfWeakPtr<ProxyManager>::internalConstruct(new ProxyManager(parent, _id)));
+ProxyManagerPtr ProxyManager::construct(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyObjectStorePtr store) {
+    ProxyManagerPtr res(SelfWeakPtr<ProxyManager>::internalConstruct(new ProxyManager(parent, _id, store)));
     return res;
 }
 
-ProxyManager::ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id)
+ProxyManager::ProxyManager(VWObjectPtr parent, const SpaceObjectReference& _id, ProxyObjectStorePtr store)
  : mParent(parent),
-   mID(_id)
+   mID(_id),
+   mStore(store)
 {}
 
 ProxyManager::~ProxyManager() {
@@ -127,7 +128,8 @@ ProxyObjectPtr ProxyManager::createObject(
     // onCreateProxy) will be completely setup, making it valid for
     // use. We don't need this for old ProxyObjects since they were
     // already initialized. The seqNo of 0 only updates something if it wasn't
-    // set yet.
+    // set yet. If another presence already has a proxy for the object, the
+    // shared state keeps whichever values are newer.
     newObj->setLocation(tmv, 0);
     newObj->setOrientation(tmq, 0);
     newObj->setBounds(bs, 0);
@@ -229,7 +231,8 @@ void ProxyManager::resetAllProxies() {
         // keep a strong ref to. This ensures that we if we reuse a proxy later
         // via the weak reference, we won't forget to reset it. Since resetting
         // only affects seqnos, this shouldn't have any adverse affects on those
-        // still holding a reference.
+        // still holding a reference, or on other presences sharing the
+        // proxies' state.
         ProxyObjectPtr proxy = iter->second.wptr.lock();
         if (proxy) proxy->reset();
     }
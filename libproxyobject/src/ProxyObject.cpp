@@ -59,21 +59,31 @@ ProxyObject::ProxyObject(ProxyManagerPtr man, const SpaceObjectReference& id)
      MeshProvider (),
      mID(id),
      mParent(man),
+     mState(
+         man->proxyStore() ?
+         man->proxyStore()->acquire(id) :
+         SharedProxyStatePtr(new SharedProxyState(ProxyObjectStorePtr(), id))
+     ),
      mValid(true)
 {
     assert(mParent);
 
+    mState->attach(this);
     reset();
     // Validate is forced in ProxyObject::construct
 }
 
 
 ProxyObject::~ProxyObject() {
+    mState->detach(this);
     mParent->proxyDeleted(mID.object());
 }
 
 void ProxyObject::reset() {
-    SequencedPresenceProperties::reset();
+    // Only the sequence numbers are per-presence, the values are left for
+    // everyone else using them
+    memset(mUpdateSeqno, 0, SequencedPresenceProperties::LOC_NUM_PART * sizeof(uint64));
+    memset(mReportedVersion, 0, SequencedPresenceProperties::LOC_NUM_PART * sizeof(uint64));
 }
 
 void ProxyObject::validate() {
@@ -108,162 +118,254 @@ bool ProxyObject::UpdateNeeded::operator() (
 
 bool ProxyObject::isStatic() const {
     PROXY_SERIALIZED();
-    return mLoc.velocity() == Vector3f::zero() && mOrientation.velocity() == Quaternion::identity();
+    return mState->location().velocity() == Vector3f::zero() && mState->orientation().velocity() == Quaternion::identity();
+}
+
+uint64 ProxyObject::getUpdateSeqNo(SequencedPresenceProperties::LOC_PARTS whichPart) const {
+    PROXY_SERIALIZED();
+    if (whichPart >= SequencedPresenceProperties::LOC_NUM_PART) {
+        SILOG(proxyobject, error, "Error in getUpdateSeqNo of proxy.  Requesting an update sequence number for a field that does not exist.  Returning 0");
+        return 0;
+    }
+    return mUpdateSeqno[whichPart];
+}
+
+SequencedPresenceProperties ProxyObject::properties() const {
+    PROXY_SERIALIZED();
+    SequencedPresenceProperties props;
+    props.setLocation(mState->location(), mUpdateSeqno[SequencedPresenceProperties::LOC_POS_PART]);
+    props.setOrientation(mState->orientation(), mUpdateSeqno[SequencedPresenceProperties::LOC_ORIENT_PART]);
+    props.setBounds(mState->bounds(), mUpdateSeqno[SequencedPresenceProperties::LOC_BOUNDS_PART]);
+    props.setMesh(mState->mesh(), mUpdateSeqno[SequencedPresenceProperties::LOC_MESH_PART]);
+    props.setPhysics(mState->physics(), mUpdateSeqno[SequencedPresenceProperties::LOC_PHYSICS_PART]);
+    props.setIsAggregate(mState->isAggregate(), mUpdateSeqno[SequencedPresenceProperties::LOC_IS_AGG_PART]);
+    props.setParent(mState->parent(), mUpdateSeqno[SequencedPresenceProperties::LOC_PARENT_PART]);
+    return props;
 }
 
 
 TimedMotionVector3f ProxyObject::location() const{
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::location();
+        return mState->location();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_POS_PART))
-        return SequencedPresenceProperties::location();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_POS_PART))
+        return mState->location();
     return req->location();
 }
 
 TimedMotionQuaternion ProxyObject::orientation() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::orientation();
+        return mState->orientation();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_ORIENT_PART))
-        return SequencedPresenceProperties::orientation();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_ORIENT_PART))
+        return mState->orientation();
     return req->orientation();
 }
 
 BoundingSphere3f ProxyObject::bounds() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::bounds();
+        return mState->bounds();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_BOUNDS_PART))
-        return SequencedPresenceProperties::bounds();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_BOUNDS_PART))
+        return mState->bounds();
     return req->bounds();
 }
 
 Transfer::URI ProxyObject::mesh() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::mesh();
+        return mState->mesh();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_MESH_PART))
-        return SequencedPresenceProperties::mesh();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_MESH_PART))
+        return mState->mesh();
     return req->mesh();
 }
 
 String ProxyObject::physics() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::physics();
+        return mState->physics();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_PHYSICS_PART))
-        return SequencedPresenceProperties::physics();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_PHYSICS_PART))
+        return mState->physics();
     return req->physics();
 }
 
 bool ProxyObject::isAggregate() const {
     PROXY_SERIALIZED();
     if (!isPresence())
-        return SequencedPresenceProperties::isAggregate();
+        return mState->isAggregate();
     SequencedPresencePropertiesPtr req = mParent->parent()->presenceRequestedLocation(getObjectReference());
     uint64 latest_epoch = mParent->parent()->presenceLatestEpoch(getObjectReference());
-    if (!req || latest_epoch >= req->getUpdateSeqNo(LOC_IS_AGG_PART))
-        return SequencedPresenceProperties::isAggregate();
+    if (!req || latest_epoch >= req->getUpdateSeqNo(SequencedPresenceProperties::LOC_IS_AGG_PART))
+        return mState->isAggregate();
     return req->isAggregate();
 }
 
+ObjectReference ProxyObject::parent() const {
+    PROXY_SERIALIZED();
+    return mState->parent();
+}
+
 ObjectReference ProxyObject::parentAggregate() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::parent();
+    return mState->parent();
 }
 
 TimedMotionVector3f ProxyObject::verifiedLocation() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::location();
+    return mState->location();
 }
 
 TimedMotionQuaternion ProxyObject::verifiedOrientation() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::orientation();
+    return mState->orientation();
 }
 
 BoundingSphere3f ProxyObject::verifiedBounds() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::bounds();
+    return mState->bounds();
 }
 
 Transfer::URI ProxyObject::verifiedMesh() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::mesh();
+    return mState->mesh();
 }
 
 String ProxyObject::verifiedPhysics() const {
     PROXY_SERIALIZED();
-    return SequencedPresenceProperties::physics();
+    return mState->physics();
 }
 
 
 
-void ProxyObject::setLocation(const TimedMotionVector3f& reqloc, uint64 seqno) {
+void ProxyObject::setLocation(const TimedMotionVector3f& reqloc, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setLocation(reqloc, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
-    }
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_POS_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_POS_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_POS_PART] = seqno;
+    mState->updateLocation(this, advanced, reqloc);
+    reportChanges(SequencedPresenceProperties::LOC_POS_PART, POSITION_CHANGED, batch);
 }
 
-void ProxyObject::setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno) {
+void ProxyObject::setOrientation(const TimedMotionQuaternion& reqorient, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setOrientation(reqorient, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
-    }
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_ORIENT_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_ORIENT_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_ORIENT_PART] = seqno;
+    mState->updateOrientation(this, advanced, reqorient);
+    reportChanges(SequencedPresenceProperties::LOC_ORIENT_PART, POSITION_CHANGED, batch);
 }
 
-void ProxyObject::setBounds(const BoundingSphere3f& bnds, uint64 seqno) {
+void ProxyObject::setBounds(const BoundingSphere3f& bnds, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setBounds(bnds, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        PositionProvider::notify(&PositionListener::updateLocation, ptr, mLoc, mOrientation, mBounds, mID);
-        MeshProvider::notify (&MeshListener::onSetScale, ptr, mBounds.radius(), mID);
-    }
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_BOUNDS_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_BOUNDS_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_BOUNDS_PART] = seqno;
+    mState->updateBounds(this, advanced, bnds);
+    reportChanges(SequencedPresenceProperties::LOC_BOUNDS_PART, BOUNDS_CHANGED, batch);
 }
 
 //you can set a camera's mesh as of now.
-void ProxyObject::setMesh (Transfer::URI const& mesh, uint64 seqno) {
+void ProxyObject::setMesh (Transfer::URI const& mesh, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setMesh(mesh, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetMesh, ptr, mesh, mID);
-    }
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_MESH_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_MESH_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_MESH_PART] = seqno;
+    mState->updateMesh(this, advanced, mesh);
+    reportChanges(SequencedPresenceProperties::LOC_MESH_PART, MESH_CHANGED, batch);
 }
 
-void ProxyObject::setPhysics (const String& rhs, uint64 seqno) {
+void ProxyObject::setPhysics (const String& rhs, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setPhysics(rhs, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetPhysics, ptr, rhs, mID);
-    }
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_PHYSICS_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_PHYSICS_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_PHYSICS_PART] = seqno;
+    mState->updatePhysics(this, advanced, rhs);
+    reportChanges(SequencedPresenceProperties::LOC_PHYSICS_PART, PHYSICS_CHANGED, batch);
 }
 
-void ProxyObject::setIsAggregate(bool isAggregate, uint64 seqno) {
+void ProxyObject::setIsAggregate(bool isAggregate, uint64 seqno, ProxyUpdateBatch* batch) {
     PROXY_SERIALIZED();
-    if (SequencedPresenceProperties::setIsAggregate(isAggregate, seqno)) {
-        ProxyObjectPtr ptr = getSharedPtr();
-        assert(ptr);
-        if (ptr) MeshProvider::notify ( &MeshListener::onSetIsAggregate, ptr, isAggregate, mID);
+    if (seqno < mUpdateSeqno[SequencedPresenceProperties::LOC_IS_AGG_PART]) return;
+    bool advanced = seqno > mUpdateSeqno[SequencedPresenceProperties::LOC_IS_AGG_PART];
+    mUpdateSeqno[SequencedPresenceProperties::LOC_IS_AGG_PART] = seqno;
+    mState->updateIsAggregate(this, advanced, isAggregate);
+    reportChanges(SequencedPresenceProperties::LOC_IS_AGG_PART, IS_AGGREGATE_CHANGED, batch);
+}
+
+void ProxyObject::reportChanges(SequencedPresenceProperties::LOC_PARTS part, uint8 changes, ProxyUpdateBatch* batch) {
+    // The version also covers changes made through other presences' ProxyObjects
+    // since our last update, which we're responsible for reporting to our own
+    // listeners
+    uint64 version = mState->version(part);
+    if (version == mReportedVersion[part]) return;
+    mReportedVersion[part] = version;
+
+    if (batch != NULL)
+        batch->add(getSharedPtr(), changes);
+    else
+        notifyChanges(changes);
+}
+
+void ProxyObject::notifyChanges(uint8 changes) {
+    ProxyObjectPtr ptr = getSharedPtr();
+    assert(ptr);
+
+    // Bounds changes are also reported as position updates
+    if (changes & (POSITION_CHANGED | BOUNDS_CHANGED))
+        PositionProvider::notify(&PositionListener::updateLocation, ptr, mState->location(), mState->orientation(), mState->bounds(), mID);
+    if (changes & BOUNDS_CHANGED)
+        MeshProvider::notify (&MeshListener::onSetScale, ptr, mState->bounds().radius(), mID);
+    if (changes & MESH_CHANGED)
+        MeshProvider::notify ( &MeshListener::onSetMesh, ptr, mState->mesh(), mID);
+    if (changes & PHYSICS_CHANGED)
+        MeshProvider::notify ( &MeshListener::onSetPhysics, ptr, mState->physics(), mID);
+    if (changes & IS_AGGREGATE_CHANGED)
+        MeshProvider::notify ( &MeshListener::onSetIsAggregate, ptr, mState->isAggregate(), mID);
+}
+
+
+
+ProxyUpdateBatch::ProxyUpdateBatch()
+{
+}
+
+ProxyUpdateBatch::~ProxyUpdateBatch() {
+    flush();
+}
+
+void ProxyUpdateBatch::add(const ProxyObjectPtr& proxy, uint8 changes) {
+    std::pair<IndexMap::iterator, bool> inserted =
+        mIndex.insert(IndexMap::value_type(proxy.get(), mProxies.size()));
+    if (inserted.second) {
+        mProxies.push_back(proxy);
+        mChanges.push_back(changes);
+    }
+    else {
+        mChanges[inserted.first->second] |= changes;
     }
 }
 
+void ProxyUpdateBatch::flush() {
+    // Listeners may apply more updates, possibly with this batch, so work
+    // from a copy
+    std::vector<ProxyObjectPtr> proxies;
+    std::vector<uint8> changes;
+    proxies.swap(mProxies);
+    changes.swap(mChanges);
+    mIndex.clear();
+
+    for(uint32 i = 0; i < proxies.size(); i++)
+        proxies[i]->notifyChanges(changes[i]);
+}
+
 }
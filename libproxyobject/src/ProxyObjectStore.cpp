@@ -0,0 +1,187 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/proxyobject/Platform.hpp>
+#include <sirikata/proxyobject/ProxyObjectStore.hpp>
+#include <sirikata/proxyobject/ProxyObject.hpp>
+
+namespace Sirikata {
+
+SharedProxyState::SharedProxyState(ProxyObjectStorePtr store, const SpaceObjectReference& id)
+ : mStore(store),
+   mID(id)
+{
+    for(uint32 i = 0; i < SequencedPresenceProperties::LOC_NUM_PART; i++) {
+        mVersion[i] = 0;
+        mWriter[i] = NULL;
+    }
+}
+
+SharedProxyState::~SharedProxyState() {
+    assert(mProxies.empty());
+    if (mStore) mStore->release(mID);
+}
+
+TimedMotionVector3f SharedProxyState::location() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::location();
+}
+
+TimedMotionQuaternion SharedProxyState::orientation() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::orientation();
+}
+
+BoundingSphere3f SharedProxyState::bounds() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::bounds();
+}
+
+Transfer::URI SharedProxyState::mesh() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::mesh();
+}
+
+String SharedProxyState::physics() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::physics();
+}
+
+bool SharedProxyState::isAggregate() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::isAggregate();
+}
+
+ObjectReference SharedProxyState::parent() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return PresenceProperties::parent();
+}
+
+bool SharedProxyState::accept(SequencedPresenceProperties::LOC_PARTS part, const ProxyObject* writer, bool advanced, bool newinfo) {
+    if (writer != mWriter[part]) {
+        // A replayed or duplicate update from another presence must not take
+        // the property away from the current writer, even if its value
+        // differs
+        if (!advanced || !newinfo)
+            return false;
+        mWriter[part] = writer;
+    }
+    mVersion[part]++;
+    return true;
+}
+
+uint64 SharedProxyState::version(SequencedPresenceProperties::LOC_PARTS part) const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mVersion[part];
+}
+
+bool SharedProxyState::updateLocation(const ProxyObject* writer, bool advanced, const TimedMotionVector3f& loc) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_POS_PART, writer, advanced, loc.updateTime() > mLoc.updateTime()))
+        return false;
+    return setLocation(loc);
+}
+
+bool SharedProxyState::updateOrientation(const ProxyObject* writer, bool advanced, const TimedMotionQuaternion& orient) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_ORIENT_PART, writer, advanced, orient.updateTime() > mOrientation.updateTime()))
+        return false;
+    return setOrientation(orient);
+}
+
+bool SharedProxyState::updateBounds(const ProxyObject* writer, bool advanced, const BoundingSphere3f& bnds) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_BOUNDS_PART, writer, advanced, !(mBounds == bnds)))
+        return false;
+    return setBounds(bnds);
+}
+
+bool SharedProxyState::updateMesh(const ProxyObject* writer, bool advanced, const Transfer::URI& mesh) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_MESH_PART, writer, advanced, !(mMesh == mesh)))
+        return false;
+    return setMesh(mesh);
+}
+
+bool SharedProxyState::updatePhysics(const ProxyObject* writer, bool advanced, const String& phy) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_PHYSICS_PART, writer, advanced, mPhysics != phy))
+        return false;
+    return setPhysics(phy);
+}
+
+bool SharedProxyState::updateIsAggregate(const ProxyObject* writer, bool advanced, bool isAgg) {
+    boost::mutex::scoped_lock lock(mMutex);
+    if (!accept(SequencedPresenceProperties::LOC_IS_AGG_PART, writer, advanced, mIsAggregate != isAgg))
+        return false;
+    return setIsAggregate(isAgg);
+}
+
+void SharedProxyState::attach(ProxyObject* proxy) {
+    boost::mutex::scoped_lock lock(mMutex);
+    mProxies.push_back(proxy);
+}
+
+void SharedProxyState::detach(ProxyObject* proxy) {
+    boost::mutex::scoped_lock lock(mMutex);
+    std::vector<ProxyObject*>::iterator it = std::find(mProxies.begin(), mProxies.end(), proxy);
+    if (it != mProxies.end())
+        mProxies.erase(it);
+    // Another ProxyObject could be allocated at the same address, so make
+    // sure it isn't mistaken for the last writer
+    for(uint32 i = 0; i < SequencedPresenceProperties::LOC_NUM_PART; i++) {
+        if (mWriter[i] == proxy)
+            mWriter[i] = NULL;
+    }
+}
+
+uint32 SharedProxyState::numAttached() const {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mProxies.size();
+}
+
+
+ProxyObjectStorePtr ProxyObjectStore::construct() {
+    return SelfWeakPtr<ProxyObjectStore>::internalConstruct(new ProxyObjectStore());
+}
+
+ProxyObjectStore::ProxyObjectStore()
+{
+}
+
+ProxyObjectStore::~ProxyObjectStore() {
+    // Every SharedProxyState holds a reference to us, so they must all be gone
+    assert(mStates.empty());
+}
+
+SharedProxyStatePtr ProxyObjectStore::acquire(const SpaceObjectReference& id) {
+    boost::mutex::scoped_lock lock(mMutex);
+
+    StateMap::iterator it = mStates.find(id);
+    if (it != mStates.end()) {
+        SharedProxyStatePtr state = it->second.lock();
+        if (state) return state;
+    }
+
+    // Either new or the old state is being destroyed, in which case its
+    // release() will see that the entry has been replaced
+    SharedProxyStatePtr state(new SharedProxyState(getSharedPtr(), id));
+    mStates[id] = state;
+    return state;
+}
+
+void ProxyObjectStore::release(const SpaceObjectReference& id) {
+    boost::mutex::scoped_lock lock(mMutex);
+
+    StateMap::iterator it = mStates.find(id);
+    if (it != mStates.end() && it->second.expired())
+        mStates.erase(it);
+}
+
+uint32 ProxyObjectStore::size() {
+    boost::mutex::scoped_lock lock(mMutex);
+    return mStates.size();
+}
+
+} // namespace Sirikata
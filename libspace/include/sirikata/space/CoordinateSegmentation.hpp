@@ -60,6 +60,11 @@ public:
     virtual ~CoordinateSegmentation();
 
     virtual ServerID lookup(const Vector3f& pos) = 0;
+    /** Look up the servers for many positions at once. results is resized to
+     *  match positions. The default implementation just calls lookup() for
+     *  each position.
+     */
+    virtual void lookupBatch(const std::vector<Vector3f>& positions, std::vector<ServerID>* results);
     virtual BoundingBoxList serverRegion(const ServerID& server)  = 0;
     virtual BoundingBox3f region()  = 0;
     virtual uint32 numServers()  = 0;
@@ -73,6 +78,13 @@ public:
 
     virtual void reportLoad(ServerID sid, const BoundingBox3f& bbox, uint32 load) {  }
 
+    /** Report detailed load for one of a server's regions: the number of
+     *  objects in it, the rate of messages handled for them, and the number
+     *  of objects in equal width slices of the region along X and Y.
+     */
+    virtual void reportRegionLoad(ServerID sid, const BoundingBox3f& bbox, uint32 objectCount, float messageRate,
+                                  const std::vector<uint32>& xHistogram, const std::vector<uint32>& yHistogram) {  }
+
     virtual void migrationHint( std::vector<ServerLoadInfo>& svrLoadInfo ) {  }
 
     // FIXME this should be private but vis needs it for now
@@ -0,0 +1,346 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_FLAT_BSP_TREE_HPP_
+#define _SIRIKATA_FLAT_BSP_TREE_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/space/SegmentedRegion.hpp>
+#include <deque>
+
+namespace Sirikata {
+
+/** FlatBSPTree is a compact, read-only form of a SegmentedRegion tree used for
+ *  fast position -> server lookups.
+ *
+ *  Nodes are laid out breadth first in a single array and the two children of
+ *  a node are always adjacent, so each node only needs its split plane and the
+ *  index of its first child (8 bytes). Picking a child is a comparison added
+ *  to that index rather than a branch, and the top levels of the tree, which
+ *  every lookup touches, share a few cache lines. Leaf data (server and
+ *  bounds) is kept in a separate array since only one leaf is read per lookup.
+ *
+ *  The whole tree lives in one contiguous buffer which is also its wire
+ *  format: serialize() returns the buffer and deserialize() only has to
+ *  validate it, with no parsing or pointer fixups. The format uses the host's
+ *  byte order, which is little endian on all our supported platforms.
+ *
+ *  Leaves that couldn't be resolved to a server when the tree was built (see
+ *  SubtreeResolver) report NullServerID, and the caller should fall back to
+ *  asking the CSeg server.
+ */
+class FlatBSPTree {
+public:
+    /** Maps a leaf of the tree being flattened to a separately stored subtree
+     *  that should be grafted in its place. Returning NULL marks the leaf as
+     *  unresolved. Only leaves of the original tree are passed to the
+     *  resolver, not leaves of grafted subtrees.
+     */
+    typedef std::tr1::function<const SegmentedRegion*(const SegmentedRegion*)> SubtreeResolver;
+
+    FlatBSPTree() {}
+
+    explicit FlatBSPTree(const SegmentedRegion* root) {
+        build(root, SubtreeResolver());
+    }
+
+    FlatBSPTree(const SegmentedRegion* root, const SubtreeResolver& resolver) {
+        build(root, resolver);
+    }
+
+    /** Replace this tree with one previously returned by serialize(). Returns
+     *  false, leaving this tree unchanged, if the data isn't a valid tree.
+     */
+    bool deserialize(const String& data) {
+        if (!valid(data)) return false;
+        mData = data;
+        return true;
+    }
+
+    const String& serialize() const {
+        return mData;
+    }
+
+    void swap(FlatBSPTree& other) {
+        mData.swap(other.mData);
+    }
+
+    void clear() {
+        mData.clear();
+    }
+
+    bool empty() const {
+        return mData.empty();
+    }
+
+    uint32 nodeCount() const {
+        return empty() ? 0 : header()->nodeCount;
+    }
+
+    uint32 leafCount() const {
+        return empty() ? 0 : header()->leafCount;
+    }
+
+    BoundingBox3f region() const {
+        if (empty()) return BoundingBox3f(Vector3f(0,0,0), Vector3f(0,0,0));
+        return toBBox(header()->region);
+    }
+
+    /** Find the server responsible for pos. Positions outside the tree's
+     *  region are assigned to the nearest leaf, matching the clamping the CSeg
+     *  server does.
+     */
+    ServerID lookup(const Vector3f& pos) const {
+        if (empty()) return NullServerID;
+        return leaves()[lookupLeaf(pos)].server;
+    }
+
+    /** Find the server responsible for pos and the bounds of the leaf region
+     *  containing it.
+     */
+    ServerID lookup(const Vector3f& pos, BoundingBox3f* leaf_bbox) const {
+        if (empty()) return NullServerID;
+        const Leaf& leaf = leaves()[lookupLeaf(pos)];
+        *leaf_bbox = toBBox(leaf.bbox);
+        return leaf.server;
+    }
+
+    /** Look up many positions at once. Groups of positions descend the tree
+     *  in lockstep so their memory accesses overlap instead of each lookup
+     *  waiting on its own chain of cache misses.
+     */
+    void lookupBatch(const Vector3f* positions, uint32 count, ServerID* results) const {
+        if (empty()) {
+            for(uint32 i = 0; i < count; i++)
+                results[i] = NullServerID;
+            return;
+        }
+
+        const Node* node_array = nodes();
+        const Leaf* leaf_array = leaves();
+        for(uint32 base = 0; base < count; base += BATCH_GROUP_SIZE) {
+            uint32 n = count - base;
+            if (n > BATCH_GROUP_SIZE) n = BATCH_GROUP_SIZE;
+            const Vector3f* pos = positions + base;
+
+            uint32 idx[BATCH_GROUP_SIZE];
+            uint32 info[BATCH_GROUP_SIZE];
+            for(uint32 j = 0; j < n; j++) {
+                idx[j] = 0;
+                info[j] = node_array[0].info;
+            }
+
+            bool active = true;
+            while(active) {
+                active = false;
+                for(uint32 j = 0; j < n; j++) {
+                    uint32 axis = info[j] & AXIS_MASK;
+                    if (axis == LEAF_AXIS) continue;
+                    idx[j] = (info[j] >> AXIS_BITS) + (uint32)(pos[j][axis] > node_array[idx[j]].split);
+                    info[j] = node_array[idx[j]].info;
+                    active = true;
+                }
+            }
+
+            for(uint32 j = 0; j < n; j++)
+                results[base + j] = leaf_array[info[j] >> AXIS_BITS].server;
+        }
+    }
+
+    void lookupBatch(const std::vector<Vector3f>& positions, std::vector<ServerID>* results) const {
+        results->resize(positions.size());
+        if (positions.empty()) return;
+        lookupBatch(&positions[0], positions.size(), &((*results)[0]));
+    }
+
+    /** Get the regions handled by a server. */
+    BoundingBoxList serverRegion(const ServerID& server) const {
+        BoundingBoxList result;
+        const Leaf* leaf_array = leaves();
+        for(uint32 i = 0; i < leafCount(); i++) {
+            if (leaf_array[i].server == server)
+                result.push_back(toBBox(leaf_array[i].bbox));
+        }
+        return result;
+    }
+
+private:
+    enum {
+        FLAT_BSP_MAGIC = 0x50534246, // "FBSP"
+        FLAT_BSP_VERSION = 1
+    };
+
+    // Node::info holds the split axis in the low bits and the index of the
+    // first child (or of the leaf) in the remaining bits.
+    static const uint32 AXIS_BITS = 2;
+    static const uint32 AXIS_MASK = 0x3;
+    static const uint32 LEAF_AXIS = 0x3;
+    static const uint32 BATCH_GROUP_SIZE = 8;
+
+    struct Header {
+        uint32 magic;
+        uint32 version;
+        uint32 nodeCount;
+        uint32 leafCount;
+        SerializedBBox region;
+    };
+
+    struct Node {
+        float32 split;
+        uint32 info;
+    };
+
+    struct Leaf {
+        uint32 server;
+        SerializedBBox bbox;
+    };
+
+    // An entry in the breadth first traversal used during building
+    struct PendingNode {
+        PendingNode(const SegmentedRegion* r, bool g, bool u)
+         : region(r), grafted(g), unresolved(u)
+        {}
+
+        const SegmentedRegion* region;
+        bool grafted;
+        bool unresolved;
+    };
+
+    static BoundingBox3f toBBox(const SerializedBBox& sbb) {
+        return BoundingBox3f(Vector3f(sbb.minX, sbb.minY, sbb.minZ),
+                             Vector3f(sbb.maxX, sbb.maxY, sbb.maxZ));
+    }
+
+    static bool isLeaf(const SegmentedRegion* region) {
+        return (region->mLeftChild == NULL || region->mRightChild == NULL);
+    }
+
+    // The left child always covers the lower half of the parent along the
+    // split axis, so the split axis is the one where the children's upper
+    // bounds differ. (SegmentedRegion::mSplitAxis can't be used here, it
+    // records how a region's parent was split.)
+    static uint32 splitAxis(const SegmentedRegion* region) {
+        const BoundingBox3f& left = region->mLeftChild->mBoundingBox;
+        const BoundingBox3f& right = region->mRightChild->mBoundingBox;
+        for(uint32 axis = 0; axis < 3; axis++) {
+            if (left.max()[axis] < right.max()[axis])
+                return axis;
+        }
+        return 0;
+    }
+
+    static PendingNode pending(const SegmentedRegion* region, bool grafted, const SubtreeResolver& resolver) {
+        if (grafted || !resolver || !isLeaf(region))
+            return PendingNode(region, grafted, false);
+
+        const SegmentedRegion* subtree = resolver(region);
+        if (subtree == NULL)
+            return PendingNode(region, false, true);
+        return PendingNode(subtree, true, false);
+    }
+
+    void build(const SegmentedRegion* root, const SubtreeResolver& resolver) {
+        mData.clear();
+        if (root == NULL) return;
+
+        std::vector<Node> node_list;
+        std::vector<Leaf> leaf_list;
+
+        // Nodes are numbered in the order they leave the queue, and children
+        // are queued together, so siblings end up adjacent.
+        std::deque<PendingNode> queue;
+        queue.push_back(pending(root, false, resolver));
+        node_list.push_back(Node());
+        for(uint32 idx = 0; !queue.empty(); idx++) {
+            PendingNode cur = queue.front();
+            queue.pop_front();
+
+            Node node;
+            if (isLeaf(cur.region)) {
+                Leaf leaf;
+                leaf.server = cur.unresolved ? NullServerID : cur.region->mServer;
+                leaf.bbox.serialize(cur.region->mBoundingBox);
+                node.split = 0;
+                node.info = (leaf_list.size() << AXIS_BITS) | LEAF_AXIS;
+                leaf_list.push_back(leaf);
+            }
+            else {
+                uint32 axis = splitAxis(cur.region);
+                node.split = cur.region->mLeftChild->mBoundingBox.max()[axis];
+                node.info = (node_list.size() << AXIS_BITS) | axis;
+                node_list.resize(node_list.size() + 2);
+                queue.push_back(pending(cur.region->mLeftChild, cur.grafted, resolver));
+                queue.push_back(pending(cur.region->mRightChild, cur.grafted, resolver));
+            }
+            node_list[idx] = node;
+        }
+
+        Header hdr;
+        hdr.magic = FLAT_BSP_MAGIC;
+        hdr.version = FLAT_BSP_VERSION;
+        hdr.nodeCount = node_list.size();
+        hdr.leafCount = leaf_list.size();
+        hdr.region.serialize(root->mBoundingBox);
+
+        mData.reserve(sizeof(Header) + node_list.size() * sizeof(Node) + leaf_list.size() * sizeof(Leaf));
+        mData.append((const char*)&hdr, sizeof(Header));
+        mData.append((const char*)&node_list[0], node_list.size() * sizeof(Node));
+        mData.append((const char*)&leaf_list[0], leaf_list.size() * sizeof(Leaf));
+    }
+
+    // Checks that the buffer is a well formed tree, so lookups on data
+    // received over the network can't read out of bounds or loop forever.
+    static bool valid(const String& data) {
+        if (data.size() < sizeof(Header)) return false;
+        const Header* hdr = (const Header*)data.data();
+        if (hdr->magic != FLAT_BSP_MAGIC || hdr->version != FLAT_BSP_VERSION)
+            return false;
+        if (hdr->nodeCount == 0 || hdr->leafCount == 0) return false;
+        if (data.size() != sizeof(Header) + (size_t)hdr->nodeCount * sizeof(Node) + (size_t)hdr->leafCount * sizeof(Leaf))
+            return false;
+
+        const Node* node_array = (const Node*)(data.data() + sizeof(Header));
+        for(uint32 i = 0; i < hdr->nodeCount; i++) {
+            uint32 axis = node_array[i].info & AXIS_MASK;
+            uint32 target = node_array[i].info >> AXIS_BITS;
+            if (axis == LEAF_AXIS) {
+                if (target >= hdr->leafCount) return false;
+            }
+            else {
+                // Children always come after their parent
+                if (target <= i || target + 1 >= hdr->nodeCount) return false;
+            }
+        }
+        return true;
+    }
+
+    uint32 lookupLeaf(const Vector3f& pos) const {
+        const Node* node_array = nodes();
+        uint32 idx = 0;
+        uint32 info = node_array[0].info;
+        while((info & AXIS_MASK) != LEAF_AXIS) {
+            idx = (info >> AXIS_BITS) + (uint32)(pos[info & AXIS_MASK] > node_array[idx].split);
+            info = node_array[idx].info;
+        }
+        return info >> AXIS_BITS;
+    }
+
+    const Header* header() const {
+        return (const Header*)mData.data();
+    }
+
+    const Node* nodes() const {
+        return (const Node*)(mData.data() + sizeof(Header));
+    }
+
+    const Leaf* leaves() const {
+        return (const Leaf*)(mData.data() + sizeof(Header) + header()->nodeCount * sizeof(Node));
+    }
+
+    String mData;
+}; // class FlatBSPTree
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_FLAT_BSP_TREE_HPP_
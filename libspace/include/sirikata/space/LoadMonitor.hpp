@@ -35,6 +35,7 @@
 
 
 #include <sirikata/space/ServerMessage.hpp>
+#include <sirikata/space/LocationService.hpp>
 #include <sirikata/core/service/PollingService.hpp>
 
 #include "Protocol_CSeg.pbj.hpp"
@@ -59,9 +60,9 @@ typedef struct ServerLoadInfo{
 
 
 
-class SIRIKATA_SPACE_EXPORT LoadMonitor : public MessageRecipient, public PollingService {
+class SIRIKATA_SPACE_EXPORT LoadMonitor : public MessageRecipient, public PollingService, public LocationServiceListener {
 public:
-    LoadMonitor(SpaceContext* ctx, CoordinateSegmentation* cseg);
+    LoadMonitor(SpaceContext* ctx, CoordinateSegmentation* cseg, LocationService* loc);
     ~LoadMonitor();
 
   void addLoadReading();
@@ -75,6 +76,11 @@ public:
     // From MessageRecipient
     void receiveMessage(Message* msg);
 
+    // LocationServiceListener Interface
+    virtual void localObjectAdded(const UUID& uuid, bool agg, const TimedMotionVector3f& loc, const TimedMotionQuaternion& orient, const BoundingSphere3f& bounds, const String& mesh, const String& physics, const String& zernike);
+    virtual void localObjectRemoved(const UUID& uuid, bool agg);
+    virtual void localLocationUpdated(const UUID& uuid, bool agg, const TimedMotionVector3f& newval);
+
 private:
     virtual void poll();
 
@@ -88,6 +94,10 @@ private:
     SEND_TO_DHT,
   };
 
+  // Sends object counts, message rates and object distributions for each of
+  // our regions to the CSEG server.
+  void reportRegionLoads();
+
   bool handlesAdjacentRegion(ServerID server_id);
 
   bool isAdjacent(BoundingBox3f& box1, BoundingBox3f& box2);
@@ -102,6 +112,17 @@ private:
     float mAveragedLoadReading;
 
     std::map<ServerID, float> mRemoteLoadReadings;
+
+    LocationService* mLoc;
+    // Whether region loads are reported. Local objects are only tracked if
+    // they are.
+    bool mReportRegionLoad;
+    typedef std::tr1::unordered_map<UUID, TimedMotionVector3f, UUID::Hasher> ObjectLocationMap;
+    ObjectLocationMap mLocalObjects;
+    // Location updates are the bulk of per-object traffic, so they're used to
+    // estimate message rates.
+    uint32 mLocationUpdates;
+    Time mLastRegionReport;
 };
 
 }
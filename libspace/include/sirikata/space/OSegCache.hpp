@@ -46,7 +46,9 @@ namespace Sirikata
       virtual ~OSegCache() {}
 
       virtual void insert(const UUID& uuid, const OSegEntry& sID) = 0;
-      virtual const OSegEntry& get(const UUID& uuid)              = 0;
+      // Returns by value since caches are shared between threads and an
+      // entry may be evicted as soon as the lookup returns.
+      virtual OSegEntry get(const UUID& uuid)                     = 0;
       virtual void remove(const UUID& uuid)                       = 0;
   };
 
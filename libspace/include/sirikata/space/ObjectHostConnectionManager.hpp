@@ -50,12 +50,17 @@ private:
     friend class ObjectHostConnectionManager;
     friend class ObjectHostConnectionID;
 
+    typedef std::tr1::function<void(const Sirikata::Protocol::Object::ObjectMessage&)> LocalSink;
+
     ObjectHostConnection(ShortObjectHostConnectionID sid, Sirikata::Network::Stream* str);
+    ObjectHostConnection(ShortObjectHostConnectionID sid, const LocalSink& sink);
     ~ObjectHostConnection();
 
     ShortObjectHostConnectionID short_id;
     Sirikata::Network::Stream* socket;
     OHDPSST::Stream::Ptr base_stream;
+    // Only set for local connections, which have no socket
+    LocalSink local_sink;
 };
 
 /** ObjectHostConnectionManager handles the networking aspects of interacting
@@ -101,6 +106,18 @@ public:
 
     void shutdown();
 
+    /** Local connections have no network stream behind them and are used to
+     *  inject object host traffic from inside the process, e.g. when
+     *  replaying a recorded trace. Messages sent over a local connection are
+     *  passed to the sink instead of being written to the network. These must
+     *  be used from within the main strand.
+     */
+    typedef ObjectHostConnection::LocalSink LocalConnectionSink;
+    ObjectHostConnectionID openLocalConnection(const LocalConnectionSink& sink);
+    /** Handle a message as if it had been read from the local connection. */
+    void receiveLocal(const ObjectHostConnectionID& conn_id, Sirikata::Protocol::Object::ObjectMessage* msg);
+    void closeLocalConnection(const ObjectHostConnectionID& conn_id);
+
     Network::IOStrand* const netStrand() const {
         return mIOStrand;
     }
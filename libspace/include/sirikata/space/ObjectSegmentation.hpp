@@ -166,6 +166,13 @@ public:
 
       
     virtual OSegEntry lookup(const UUID& obj_id) = 0;
+    /** Perform lookups for a group of objects at once. Unlike lookup(), all
+     *  results, including those that can be resolved immediately, are
+     *  reported through the OSegLookupListener. Implementations which can
+     *  issue multi-key requests to their backing store should override this;
+     *  the default just performs each lookup individually.
+     */
+    virtual void lookupBatch(const std::vector<UUID>& obj_ids);
     virtual OSegEntry cacheLookup(const UUID& obj_id) = 0;
     virtual void migrateObject(const UUID& obj_id, const OSegEntry& new_server_id) = 0;
     virtual void addNewObject(const UUID& obj_id, float radius) = 0;
@@ -258,75 +258,5 @@ typedef struct SegmentedRegion {
 
 } SegmentedRegion;
 
-typedef struct SerializedSegmentedRegion {
-  ServerID mServerID;
-  uint32 mLeftChildIdx;
-  uint32 mRightChildIdx;
-  SerializedBBox mBoundingBox;
-  uint32 mLeafCount;
-
-  SerializedSegmentedRegion() {
-    mLeftChildIdx = 0;
-    mRightChildIdx = 0;
-  }
-
-} SerializedSegmentedRegion;
-
-
-
-typedef struct SerializedBSPTree {
-  uint32 mNodeCount;
-  SerializedSegmentedRegion* mSegmentedRegions;  //allocate dynamically based on
-                                                 //size of region.
-
-  SerializedBSPTree(int numNodes) {
-    mNodeCount = numNodes;
-    mSegmentedRegions = new SerializedSegmentedRegion[numNodes];
-  }
-
-  ~SerializedBSPTree() {
-    delete mSegmentedRegions;
-  }
-
-  void deserializeBSPTree(SegmentedRegion* region, uint32 idx,
-			  SerializedBSPTree* serializedTree)
-  {
-    assert(idx<serializedTree->mNodeCount);
-
-    region->mServer = serializedTree->mSegmentedRegions[idx].mServerID;
-
-    region->mLeafCount = serializedTree->mSegmentedRegions[idx].mLeafCount;
-
-    serializedTree->mSegmentedRegions[idx].mBoundingBox.deserialize(region->mBoundingBox);
-
-    if (serializedTree->mSegmentedRegions[idx].mLeftChildIdx == 0 &&
-       serializedTree->mSegmentedRegions[idx].mRightChildIdx == 0)
-    {
-      //std::cout << region->mServer << " : " <<region->mLeafCount << "\n";
-      //std::cout << region->mBoundingBox << "\n";
-    }
-
-    //std::cout << "left " << serializedTree->mSegmentedRegions[idx].mLeftChildIdx << "\n";
-    //std::cout << "right " <<  serializedTree->mSegmentedRegions[idx].mRightChildIdx << "\n";
-
-    if (serializedTree->mSegmentedRegions[idx].mLeftChildIdx != 0) {
-      region->mLeftChild = new SegmentedRegion(region);
-      deserializeBSPTree(region->mLeftChild, serializedTree->mSegmentedRegions[idx].mLeftChildIdx, serializedTree);
-    }
-
-    if (serializedTree->mSegmentedRegions[idx].mRightChildIdx != 0) {
-      region->mRightChild = new SegmentedRegion(region);
-      deserializeBSPTree(region->mRightChild,serializedTree->mSegmentedRegions[idx].mRightChildIdx, serializedTree);
-    }
-  }
-
-private:
-  SerializedBSPTree() {
-    mNodeCount = 0;
-  }
-
-} SerializedBSPTree;
-
-
 }
 #endif
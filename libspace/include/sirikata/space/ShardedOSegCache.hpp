@@ -0,0 +1,75 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SPACE_SHARDED_OSEG_CACHE_HPP_
+#define _SIRIKATA_SPACE_SHARDED_OSEG_CACHE_HPP_
+
+#include <sirikata/space/Platform.hpp>
+#include <sirikata/space/OSegCache.hpp>
+#include <sirikata/core/service/Context.hpp>
+
+namespace Sirikata {
+
+/** ShardedOSegCache is the production OSegCache. Entries are split across a
+ *  fixed number of shards, each protected by its own lock, so concurrent
+ *  lookups from the forwarder rarely contend. Each shard is an open-addressed
+ *  table (linear probing, no per-entry allocation) which is swept by a CLOCK
+ *  hand to find eviction victims in amortized O(1).
+ *
+ *  New entries are only admitted into a full shard if they are accessed more
+ *  often than the victim CLOCK selected (TinyLFU admission). Access
+ *  frequencies are estimated by a small count-min sketch per shard which is
+ *  periodically aged, so one-off lookups, e.g. from a scan over many objects,
+ *  can't flush out the frequently used entries. Updates to entries already
+ *  in the cache are always applied.
+ */
+class SIRIKATA_SPACE_EXPORT ShardedOSegCache : public OSegCache {
+public:
+    struct Stats {
+        Stats();
+        Stats& operator+=(const Stats& rhs);
+
+        uint64 hits;
+        uint64 misses;
+        uint64 expirations;
+        uint64 inserts;
+        uint64 updates;
+        uint64 evictions;
+        uint64 rejections;
+    };
+
+    /** Create a cache.
+     *  \param ctx context used to check entry ages. May be NULL if
+     *         entry_lifetime is zero.
+     *  \param capacity maximum number of entries across all shards
+     *  \param nshards number of shards, rounded up to a power of 2
+     *  \param entry_lifetime maximum age of an entry before it is considered
+     *         stale, or zero to keep entries until they are evicted
+     */
+    ShardedOSegCache(Context* ctx, uint32 capacity, uint32 nshards, const Duration& entry_lifetime);
+    virtual ~ShardedOSegCache();
+
+    virtual void insert(const UUID& uuid, const OSegEntry& sID);
+    virtual OSegEntry get(const UUID& uuid);
+    virtual void remove(const UUID& uuid);
+
+    /** Get the number of entries currently in the cache. */
+    uint32 size();
+    /** Get statistics aggregated across all shards. */
+    Stats stats();
+
+private:
+    class Shard;
+
+    Shard* shard(uint64 h) const;
+
+    Context* mContext;
+    Duration mEntryLifetime;
+    std::vector<Shard*> mShards;
+    uint32 mShardBits;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SPACE_SHARDED_OSEG_CACHE_HPP_
@@ -34,6 +34,7 @@
 #include <sirikata/core/options/Options.hpp>
 #include <sirikata/space/ObjectSegmentation.hpp>
 #include "LocalObjectSegmentation.hpp"
+#include "SimulatedObjectSegmentation.hpp"
 #include "LocalPintoServerQuerier.hpp"
 
 static int space_local_plugin_refcount = 0;
@@ -43,6 +44,12 @@ namespace Sirikata {
 static void InitPluginOptions() {
     Sirikata::InitializeClassOptions ico("space_local", NULL,
         NULL);
+
+    Sirikata::InitializeClassOptions ico_sim("space_simulated", NULL,
+        new OptionValue("latency","1ms",Sirikata::OptionValueType<Duration>(),"Delay for each request to the simulated OSeg backend."),
+        new OptionValue("per-key-latency","0s",Sirikata::OptionValueType<Duration>(),"Additional delay for each key in a request to the simulated OSeg backend."),
+        new OptionValue("resolve-unknown","true",Sirikata::OptionValueType<bool>(),"If true, objects not on this server are resolved by hashing their IDs over all servers. Otherwise, they are not found."),
+        NULL);
 }
 
 static ObjectSegmentation* createLocalOSeg(SpaceContext* ctx, Network::IOStrand* oseg_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& args) {
@@ -52,6 +59,17 @@ static ObjectSegmentation* createLocalOSeg(SpaceContext* ctx, Network::IOStrand*
     return new LocalObjectSegmentation(ctx, oseg_strand, cseg, cache);
 }
 
+static ObjectSegmentation* createSimulatedOSeg(SpaceContext* ctx, Network::IOStrand* oseg_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& args) {
+    OptionSet* optionsSet = OptionSet::getOptions("space_simulated",NULL);
+    optionsSet->parse(args);
+
+    Duration latency = optionsSet->referenceOption("latency")->as<Duration>();
+    Duration per_key_latency = optionsSet->referenceOption("per-key-latency")->as<Duration>();
+    bool resolve_unknown = optionsSet->referenceOption("resolve-unknown")->as<bool>();
+
+    return new SimulatedObjectSegmentation(ctx, oseg_strand, cseg, cache, latency, per_key_latency, resolve_unknown);
+}
+
 static PintoServerQuerier* createLocalPintoServerQuerier(SpaceContext* ctx, const String& args) {
     OptionSet* optionsSet = OptionSet::getOptions("space_local",NULL);
     optionsSet->parse(args);
@@ -73,6 +91,9 @@ SIRIKATA_PLUGIN_EXPORT_C void init() {
         OSegFactory::getSingleton()
             .registerConstructor("local",
                 std::tr1::bind(&createLocalOSeg, _1, _2, _3, _4, _5));
+        OSegFactory::getSingleton()
+            .registerConstructor("simulated",
+                std::tr1::bind(&createSimulatedOSeg, _1, _2, _3, _4, _5));
         PintoServerQuerierFactory::getSingleton()
             .registerConstructor("local",
                 std::tr1::bind(&createLocalPintoServerQuerier, _1, _2));
@@ -92,6 +113,7 @@ SIRIKATA_PLUGIN_EXPORT_C void destroy() {
     using namespace Sirikata;
     if (space_local_plugin_refcount==0) {
         OSegFactory::getSingleton().unregisterConstructor("local");
+        OSegFactory::getSingleton().unregisterConstructor("simulated");
         PintoServerQuerierFactory::getSingleton().unregisterConstructor("local");
     }
 }
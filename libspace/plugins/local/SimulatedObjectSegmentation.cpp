@@ -0,0 +1,198 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "SimulatedObjectSegmentation.hpp"
+#include <sirikata/core/network/IOStrandImpl.hpp>
+
+#define SIMOSEG_LOG(lvl,msg) SILOG(simulated_oseg, lvl, msg)
+
+namespace Sirikata {
+
+SimulatedObjectSegmentation::SimulatedObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const Duration& latency, const Duration& per_key_latency, bool resolve_unknown)
+ : ObjectSegmentation(con, o_strand),
+   mCSeg(cseg),
+   mCache(cache),
+   mLatency(latency),
+   mPerKeyLatency(per_key_latency),
+   mResolveUnknown(resolve_unknown),
+   mStartTime(Time::null()),
+   mLookupRequests(0),
+   mLookupKeys(0),
+   mLookupMisses(0)
+{
+}
+
+void SimulatedObjectSegmentation::start() {
+    ObjectSegmentation::start();
+    mStartTime = Timer::now();
+}
+
+void SimulatedObjectSegmentation::stop() {
+    ObjectSegmentation::stop();
+
+    Duration elapsed = Timer::now() - mStartTime;
+    SIMOSEG_LOG(info, "Simulated OSeg handled " << mLookupKeys << " lookups in " << mLookupRequests << " requests over " << elapsed);
+    if (mLookupRequests > 0) {
+        SIMOSEG_LOG(info, "  " << (double)mLookupKeys / mLookupRequests << " lookups per request, "
+            << mLookupMisses << " misses, "
+            << (double)mLookupKeys / elapsed.toSeconds() << " lookups/s");
+    }
+}
+
+OSegEntry SimulatedObjectSegmentation::cacheLookup(const UUID& obj_id) {
+    // We only check the cache for statistics purposes
+    return mCache->get(obj_id);
+}
+
+OSegEntry SimulatedObjectSegmentation::resolveRemote(const UUID& obj_id) {
+    if (!mResolveUnknown) return OSegEntry::null();
+
+    uint32 nservers = mCSeg->numServers();
+    if (nservers == 0) return OSegEntry::null();
+
+    ServerID sid = (ServerID)(obj_id.hash() % nservers) + 1;
+    // If the hash says it's here but we don't know about it, it doesn't exist
+    if (sid == mContext->id()) return OSegEntry::null();
+    return OSegEntry(sid, 1.f);
+}
+
+Duration SimulatedObjectSegmentation::requestLatency(uint32 nkeys) const {
+    return mLatency + mPerKeyLatency * (double)nkeys;
+}
+
+OSegEntry SimulatedObjectSegmentation::lookup(const UUID& obj_id) {
+    OSegMap::const_iterator it = mOSeg.find(obj_id);
+    if (it != mOSeg.end()) return it->second;
+
+    if (mStopping) return OSegEntry::null();
+
+    std::vector<UUID> objs;
+    objs.push_back(obj_id);
+    lookupBatch(objs);
+    return OSegEntry::null();
+}
+
+void SimulatedObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids) {
+    if (mStopping) return;
+
+    // mOSeg is only read and written on the calling strand, so results are
+    // computed here and copied into the post. They're held back for the
+    // request latency on oStrand, which is where the cache is updated and the
+    // listener is called. Local hits still complete immediately on the calling
+    // strand.
+    LookupResults results;
+    results.reserve(obj_ids.size());
+    for(std::vector<UUID>::const_iterator it = obj_ids.begin(); it != obj_ids.end(); it++) {
+        OSegMap::const_iterator local_it = mOSeg.find(*it);
+        if (local_it != mOSeg.end()) {
+            mLookupListener->osegLookupCompleted(*it, local_it->second);
+            continue;
+        }
+
+        OSegEntry data = resolveRemote(*it);
+        if (data.isNull()) mLookupMisses++;
+        results.push_back( std::make_pair(*it, data) );
+    }
+
+    if (results.empty()) return;
+
+    mLookupRequests++;
+    mLookupKeys += results.size();
+    oStrand->post(
+        requestLatency(results.size()),
+        std::tr1::bind(&SimulatedObjectSegmentation::finishLookups, this, results),
+        "SimulatedObjectSegmentation::finishLookups"
+    );
+}
+
+void SimulatedObjectSegmentation::finishLookups(const LookupResults& results) {
+    if (mStopping) return;
+
+    for(LookupResults::const_iterator it = results.begin(); it != results.end(); it++) {
+        if (!it->second.isNull()) mCache->insert(it->first, it->second);
+        mLookupListener->osegLookupCompleted(it->first, it->second);
+    }
+}
+
+void SimulatedObjectSegmentation::addNewObject(const UUID& obj_id, float radius) {
+    if (mStopping) return;
+
+    OSegWriteListener::OSegAddNewStatus status = OSegWriteListener::SUCCESS;
+    if (mOSeg.find(obj_id) != mOSeg.end())
+        status = OSegWriteListener::OBJ_ALREADY_REGISTERED;
+    else
+        mOSeg[obj_id] = OSegEntry(mContext->id(), radius);
+
+    oStrand->post(
+        requestLatency(1),
+        std::tr1::bind(&SimulatedObjectSegmentation::finishWriteNewObject, this, obj_id, mOSeg[obj_id], status),
+        "SimulatedObjectSegmentation::finishWriteNewObject"
+    );
+}
+
+void SimulatedObjectSegmentation::finishWriteNewObject(const UUID& obj_id, const OSegEntry& data, OSegWriteListener::OSegAddNewStatus status) {
+    if (mStopping) return;
+
+    if (status == OSegWriteListener::SUCCESS)
+        mCache->insert(obj_id, data);
+
+    mWriteListener->osegAddNewFinished(obj_id, status);
+}
+
+void SimulatedObjectSegmentation::addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool generateAck) {
+    if (mStopping) return;
+
+    mOSeg[obj_id] = OSegEntry(mContext->id(), radius);
+
+    oStrand->post(
+        requestLatency(1),
+        std::tr1::bind(&SimulatedObjectSegmentation::finishWriteMigratedObject, this, obj_id, mOSeg[obj_id], (generateAck ? idServerAckTo : NullServerID)),
+        "SimulatedObjectSegmentation::finishWriteMigratedObject"
+    );
+}
+
+void SimulatedObjectSegmentation::finishWriteMigratedObject(const UUID& obj_id, const OSegEntry& data, ServerID ackTo) {
+    if (mStopping) return;
+
+    mCache->insert(obj_id, data);
+
+    if (ackTo != NullServerID) {
+        Sirikata::Protocol::OSeg::MigrateMessageAcknowledge oseg_ack_msg;
+        oseg_ack_msg.set_m_servid_from(mContext->id());
+        oseg_ack_msg.set_m_servid_to(ackTo);
+        oseg_ack_msg.set_m_message_destination(ackTo);
+        oseg_ack_msg.set_m_message_from(mContext->id());
+        oseg_ack_msg.set_m_objid(obj_id);
+        oseg_ack_msg.set_m_objradius( data.radius() );
+        queueMigAck(oseg_ack_msg);
+    }
+}
+
+void SimulatedObjectSegmentation::removeObject(const UUID& obj_id) {
+    mOSeg.erase(obj_id);
+}
+
+bool SimulatedObjectSegmentation::clearToMigrate(const UUID& obj_id) {
+    if (mStopping) return false;
+    return (mOSeg.find(obj_id) != mOSeg.end());
+}
+
+void SimulatedObjectSegmentation::migrateObject(const UUID& obj_id, const OSegEntry& new_server_id) {
+    if (mStopping) return;
+    // As with Redis, the receiving server is responsible for registering it
+    mOSeg.erase(obj_id);
+}
+
+void SimulatedObjectSegmentation::handleMigrateMessageAck(const Sirikata::Protocol::OSeg::MigrateMessageAcknowledge& msg) {
+    if (mStopping) return;
+
+    mCache->insert(msg.m_objid(), OSegEntry(msg.m_servid_from(), msg.m_objradius()));
+    mWriteListener->osegMigrationAcknowledged(msg.m_objid());
+}
+
+void SimulatedObjectSegmentation::handleUpdateOSegMessage(const Sirikata::Protocol::OSeg::UpdateOSegMessage& update_oseg_msg) {
+    mCache->insert(update_oseg_msg.m_objid(), OSegEntry(update_oseg_msg.servid_obj_on(), update_oseg_msg.m_objradius()));
+}
+
+} // namespace Sirikata
@@ -0,0 +1,79 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SIMULATED_OBJECT_SEGMENTATION_HPP_
+#define _SIRIKATA_SIMULATED_OBJECT_SEGMENTATION_HPP_
+
+#include <sirikata/space/ObjectSegmentation.hpp>
+
+namespace Sirikata {
+
+/** SimulatedObjectSegmentation is an in-process stand-in for a networked OSeg
+ *  backend like Redis or CRAQ. It keeps no shared state: objects on this
+ *  server are tracked locally and, optionally, any other object is assumed to
+ *  live on a server chosen by hashing its UUID. Every request to the "backend"
+ *  completes after a configurable delay, with batched lookups costing a single
+ *  round trip, so lookup throughput can be measured without running a real
+ *  backend.
+ */
+class SimulatedObjectSegmentation : public ObjectSegmentation {
+public:
+    /** Create a SimulatedObjectSegmentation.
+     *  \param latency delay for each request to the simulated backend
+     *  \param per_key_latency additional delay for each key in a request
+     *  \param resolve_unknown if true, objects not on this server are resolved
+     *         by hashing their UUID over all servers. Otherwise they resolve
+     *         to no server.
+     */
+    SimulatedObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const Duration& latency, const Duration& per_key_latency, bool resolve_unknown);
+
+    virtual void start();
+    virtual void stop();
+
+    virtual OSegEntry cacheLookup(const UUID& obj_id);
+    virtual OSegEntry lookup(const UUID& obj_id);
+    virtual void lookupBatch(const std::vector<UUID>& obj_ids);
+
+    virtual void addNewObject(const UUID& obj_id, float radius);
+    virtual void addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool);
+    virtual void removeObject(const UUID& obj_id);
+
+    virtual bool clearToMigrate(const UUID& obj_id);
+    virtual void migrateObject(const UUID& obj_id, const OSegEntry& new_server_id);
+
+    virtual void handleMigrateMessageAck(const Sirikata::Protocol::OSeg::MigrateMessageAcknowledge& msg);
+    virtual void handleUpdateOSegMessage(const Sirikata::Protocol::OSeg::UpdateOSegMessage& update_oseg_msg);
+
+private:
+    typedef std::vector< std::pair<UUID, OSegEntry> > LookupResults;
+
+    // Where the simulated backend thinks a remote object lives
+    OSegEntry resolveRemote(const UUID& obj_id);
+    // Time for a single request for the given number of keys
+    Duration requestLatency(uint32 nkeys) const;
+
+    void finishLookups(const LookupResults& results);
+    void finishWriteNewObject(const UUID& obj_id, const OSegEntry& data, OSegWriteListener::OSegAddNewStatus status);
+    void finishWriteMigratedObject(const UUID& obj_id, const OSegEntry& data, ServerID ackTo);
+
+    CoordinateSegmentation* mCSeg;
+    OSegCache* mCache;
+
+    Duration mLatency;
+    Duration mPerKeyLatency;
+    bool mResolveUnknown;
+
+    typedef std::tr1::unordered_map<UUID, OSegEntry, UUID::Hasher> OSegMap;
+    OSegMap mOSeg;
+
+    // Statistics, reported when stopped
+    Time mStartTime;
+    uint64 mLookupRequests;
+    uint64 mLookupKeys;
+    uint64 mLookupMisses;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SIMULATED_OBJECT_SEGMENTATION_HPP_
@@ -44,6 +44,11 @@ static void InitPluginOptions() {
         new OptionValue("host","127.0.0.1",Sirikata::OptionValueType<String>(),"Redis host to connect to."),
         new OptionValue("port","6379",Sirikata::OptionValueType<uint32>(),"Redis port to connect to."),
         new OptionValue("prefix","",Sirikata::OptionValueType<String>(),"Prefix for redis keys, allowing you to provide 'namespaces' so multiple spaces can share the same redis database."),
+        new OptionValue("read-connections","2",Sirikata::OptionValueType<uint32>(),"Number of connections used for lookups."),
+        new OptionValue("write-connections","1",Sirikata::OptionValueType<uint32>(),"Number of connections used for updates. Updates for a single object always use the same connection so they are applied in order."),
+        new OptionValue("pipeline-depth","32",Sirikata::OptionValueType<uint32>(),"Maximum number of outstanding lookup requests per read connection before lookups are queued."),
+        new OptionValue("max-batch-size","128",Sirikata::OptionValueType<uint32>(),"Maximum number of keys requested in a single MGET."),
+        new OptionValue("stub","false",Sirikata::OptionValueType<bool>(),"If true, run an in-process Redis stub server on the given port and connect to it instead of a real Redis server."),
         NULL
     );
 }
@@ -56,7 +61,14 @@ static ObjectSegmentation* createRedisOSeg(SpaceContext* ctx, Network::IOStrand*
     uint32 redis_port = optionsSet->referenceOption("port")->as<uint32>();
     String redis_prefix = optionsSet->referenceOption("prefix")->as<String>();
 
-    return new RedisObjectSegmentation(ctx, oseg_strand, cseg, cache, redis_host, redis_port, redis_prefix);
+    RedisObjectSegmentation::PoolOptions pool_opts;
+    pool_opts.readConnections = optionsSet->referenceOption("read-connections")->as<uint32>();
+    pool_opts.writeConnections = optionsSet->referenceOption("write-connections")->as<uint32>();
+    pool_opts.pipelineDepth = optionsSet->referenceOption("pipeline-depth")->as<uint32>();
+    pool_opts.maxBatchSize = optionsSet->referenceOption("max-batch-size")->as<uint32>();
+    bool run_stub = optionsSet->referenceOption("stub")->as<bool>();
+
+    return new RedisObjectSegmentation(ctx, oseg_strand, cseg, cache, redis_host, redis_port, redis_prefix, pool_opts, run_stub);
 }
 
 } // namespace Sirikata
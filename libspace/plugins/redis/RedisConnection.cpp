@@ -0,0 +1,218 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "RedisConnection.hpp"
+#include <sirikata/core/network/IOStrandImpl.hpp>
+#include <boost/bind.hpp>
+
+#define REDISCONN_LOG(lvl,msg) SILOG(redis_oseg, lvl, msg)
+
+namespace Sirikata {
+
+namespace {
+
+void globalRedisConnectHandler(const redisAsyncContext *c) {
+    REDISCONN_LOG(insane, "Connected.");
+}
+
+void globalRedisDisconnectHandler(const redisAsyncContext *c, int status) {
+    if (status == REDIS_OK) return;
+    REDISCONN_LOG(error, "Global error handler: " << c->errstr);
+    RedisConnection* conn = (RedisConnection*)c->data;
+    conn->disconnected();
+}
+
+void globalRedisAddRead(void *privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->addRead();
+}
+
+void globalRedisDelRead(void *privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->delRead();
+}
+
+void globalRedisAddWrite(void *privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->addWrite();
+}
+
+void globalRedisDelWrite(void *privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->delWrite();
+}
+
+void globalRedisCleanup(void *privdata) {
+    RedisConnection* conn = (RedisConnection*)privdata;
+    conn->cleanup();
+}
+
+} // namespace
+
+RedisConnection::RedisConnection(Network::IOStrand* strand, const String& host, uint16 port)
+ : mStrand(strand),
+   mHost(host),
+   mPort(port),
+   mStopping(false),
+   mRedisContext(NULL),
+   mRedisFD(NULL),
+   mReading(false),
+   mWriting(false),
+   mOutstanding(0)
+{
+}
+
+RedisConnection::~RedisConnection() {
+    cleanup();
+}
+
+void RedisConnection::stop() {
+    mStopping = true;
+}
+
+bool RedisConnection::connect() {
+    mRedisContext = redisAsyncConnect(mHost.c_str(), mPort);
+    if (mRedisContext == NULL) {
+        REDISCONN_LOG(error, "Failed to allocate redis context.");
+        return false;
+    }
+    if (mRedisContext->err) {
+        REDISCONN_LOG(error, "Failed to connect to redis: " << mRedisContext->errstr);
+        redisAsyncFree(mRedisContext);
+        mRedisContext = NULL;
+        return false;
+    }
+    REDISCONN_LOG(insane, "Optimistically connected to redis.");
+
+    // This appears to be the only way to get a non-static 'argument' to the
+    // connect and disconnect callbacks.
+    mRedisContext->data = (void*)this;
+
+    redisAsyncSetConnectCallback(mRedisContext, globalRedisConnectHandler);
+    redisAsyncSetDisconnectCallback(mRedisContext, globalRedisDisconnectHandler);
+
+    mRedisContext->ev.addRead = globalRedisAddRead;
+    mRedisContext->ev.delRead = globalRedisDelRead;
+    mRedisContext->ev.addWrite = globalRedisAddWrite;
+    mRedisContext->ev.delWrite = globalRedisDelWrite;
+    mRedisContext->ev.cleanup = globalRedisCleanup;
+    mRedisContext->ev.data = this;
+
+    // Wrap this connections file descripter in ASIO
+    using boost::asio::posix::stream_descriptor;
+    mRedisFD = new stream_descriptor(mStrand->service().asioService());
+    mRedisFD->assign(mRedisContext->c.fd);
+
+    // Force one command through. This ensures the connection gets fully
+    // initialized. Otherwise, we can end up leaving the connection idle, the
+    // server disconnects, and because haven't started anything, the next
+    // command fails and *then* we get the disconnect event. Performing one
+    // command ensures we'll get the disconnect event ASAP after it occurs.
+    redisAsyncCommand(mRedisContext, NULL, NULL, "PING");
+    return true;
+}
+
+void RedisConnection::command(redisCallbackFn* fn, void* privdata, int argc, const char** argv, const size_t* argvlen) {
+    PendingCommand* pc = new PendingCommand();
+    pc->conn = this;
+    pc->fn = fn;
+    pc->privdata = privdata;
+    mOutstanding++;
+
+    if (mStopping ||
+        (mRedisContext == NULL && !connect()) ||
+        redisAsyncCommandArgv(mRedisContext, &RedisConnection::commandFinished, pc, argc, argv, argvlen) != REDIS_OK)
+    {
+        REDISCONN_LOG(error, "Failed to issue redis command " << String(argv[0], argvlen[0]));
+        commandFinished(mRedisContext, NULL, pc);
+    }
+}
+
+void RedisConnection::commandFinished(redisAsyncContext* c, void* reply, void* privdata) {
+    PendingCommand* pc = (PendingCommand*)privdata;
+    pc->conn->mOutstanding--;
+    if (pc->fn != NULL)
+        pc->fn(c, reply, pc->privdata);
+    delete pc;
+}
+
+void RedisConnection::disconnected() {
+    cleanup();
+}
+
+void RedisConnection::addRead() {
+    REDISCONN_LOG(insane, "Add read");
+
+    if (mReading) return;
+    mReading = true;
+
+    startRead();
+}
+
+void RedisConnection::delRead() {
+    REDISCONN_LOG(insane, "Del read");
+    assert(mReading);
+    mReading = false;
+}
+
+void RedisConnection::addWrite() {
+    REDISCONN_LOG(insane, "Add write");
+
+    if (mWriting) return;
+    mWriting = true;
+
+    startWrite();
+}
+
+void RedisConnection::delWrite() {
+    REDISCONN_LOG(insane, "Del write");
+    assert(mWriting);
+    mWriting = false;
+}
+
+void RedisConnection::cleanup() {
+    REDISCONN_LOG(insane, "Cleanup");
+
+    mRedisContext = NULL;
+    delete mRedisFD;
+    mRedisFD = NULL;
+    mReading = false;
+    mWriting = false;
+}
+
+void RedisConnection::startRead() {
+    if (mStopping || !mReading) return;
+    mRedisFD->async_read_some(boost::asio::null_buffers(),
+        mStrand->wrap(boost::bind(&RedisConnection::readHandler, this, boost::asio::placeholders::error)));
+}
+
+void RedisConnection::startWrite() {
+    if (mStopping || !mWriting) return;
+    mRedisFD->async_write_some(boost::asio::null_buffers(),
+        mStrand->wrap(boost::bind(&RedisConnection::writeHandler, this, boost::asio::placeholders::error)));
+}
+
+void RedisConnection::readHandler(const boost::system::error_code& ec) {
+    if (ec) {
+        REDISCONN_LOG(error, "Error in read handler.");
+        return;
+    }
+    if (mRedisContext == NULL) return;
+
+    redisAsyncHandleRead(mRedisContext);
+    startRead();
+}
+
+void RedisConnection::writeHandler(const boost::system::error_code& ec) {
+    if (ec) {
+        REDISCONN_LOG(error, "Error in write handler.");
+        return;
+    }
+    if (mRedisContext == NULL) return;
+
+    redisAsyncHandleWrite(mRedisContext);
+    startWrite();
+}
+
+} // namespace Sirikata
@@ -0,0 +1,83 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_REDIS_CONNECTION_HPP_
+#define _SIRIKATA_REDIS_CONNECTION_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/network/IOStrand.hpp>
+#include <hiredis/async.h>
+#include <boost/asio.hpp>
+
+namespace Sirikata {
+
+/** RedisConnection wraps a single hiredis asynchronous connection and drives it
+ *  using ASIO. All commands must be issued from the strand the connection was
+ *  created with, and all reply callbacks are invoked from that strand. Commands
+ *  issued back to back are written together, so a connection naturally
+ *  pipelines requests. The connection is (re)established lazily when a command
+ *  is issued.
+ */
+class RedisConnection {
+public:
+    RedisConnection(Network::IOStrand* strand, const String& host, uint16 port);
+    ~RedisConnection();
+
+    /** Stop processing events. Outstanding commands will not complete. */
+    void stop();
+
+    /** Get the number of commands issued on this connection that haven't
+     *  received replies yet. Safe to call from any thread.
+     */
+    uint32 outstanding() const { return mOutstanding.read(); }
+
+    /** Issue a command. The callback follows the normal hiredis conventions,
+     *  and is invoked with a NULL reply if the command fails, including if it
+     *  couldn't be issued at all.
+     */
+    void command(redisCallbackFn* fn, void* privdata, int argc, const char** argv, const size_t* argvlen);
+
+    // Redis event handlers, public since redis needs C functions as
+    // callbacks, which then invoke these.
+    void disconnected();
+    void addRead();
+    void delRead();
+    void addWrite();
+    void delWrite();
+    void cleanup();
+
+private:
+    // Per-command state, wrapping the user's callback so we can track the
+    // number of outstanding commands.
+    struct PendingCommand {
+        RedisConnection* conn;
+        redisCallbackFn* fn;
+        void* privdata;
+    };
+    static void commandFinished(redisAsyncContext* c, void* reply, void* privdata);
+
+    bool connect();
+
+    void startRead();
+    void startWrite();
+
+    void readHandler(const boost::system::error_code& ec);
+    void writeHandler(const boost::system::error_code& ec);
+
+    Network::IOStrand* mStrand;
+    String mHost;
+    uint16 mPort;
+    bool mStopping;
+
+    redisAsyncContext* mRedisContext;
+    boost::asio::posix::stream_descriptor* mRedisFD; // Wrapped hiredis file descriptor
+    bool mReading, mWriting;
+
+    AtomicValue<uint32> mOutstanding;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_REDIS_CONNECTION_HPP_
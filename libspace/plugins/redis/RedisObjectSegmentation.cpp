@@ -31,6 +31,8 @@
  */
 
 #include "RedisObjectSegmentation.hpp"
+#include "RedisStubServer.hpp"
+#include <sirikata/core/network/IOStrandImpl.hpp>
 #include <boost/algorithm/string.hpp>
 
 #define REDISOSEG_LOG(lvl,msg) SILOG(redis_oseg, lvl, msg)
@@ -39,77 +41,59 @@ namespace Sirikata {
 
 namespace {
 
-void globalRedisConnectHandler(const redisAsyncContext *c) {
-    REDISOSEG_LOG(insane, "Connected.");
-}
-
-void globalRedisDisconnectHandler(const redisAsyncContext *c, int status) {
-    if (status == REDIS_OK) return;
-    REDISOSEG_LOG(error, "Global error handler: " << c->errstr);
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)c->data;
-    oseg->disconnected();
-}
-
-void globalRedisAddRead(void *privdata) {
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)privdata;
-    oseg->addRead();
-}
-
-void globalRedisDelRead(void *privdata) {
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)privdata;
-    oseg->delRead();
-}
-
-void globalRedisAddWrite(void *privdata) {
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)privdata;
-    oseg->addWrite();
-}
-
-void globalRedisDelWrite(void *privdata) {
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)privdata;
-    oseg->delWrite();
-}
-
-void globalRedisCleanup(void *privdata) {
-    RedisObjectSegmentation* oseg = (RedisObjectSegmentation*)privdata;
-    oseg->cleanup();
-}
-
 // Basic state tracking for a request that uses Redis async api
 struct RedisObjectOperationInfo {
     RedisObjectSegmentation* oseg;
     UUID obj;
+    // The entry being written, if any. It's captured when the write is issued
+    // since mOSeg can only be touched on the main strand and the write
+    // finishes on the OSeg strand.
+    OSegEntry entry;
 };
 // State tracking for migrate changes. If we need to generate an ack, this
 // requires additional info
 struct RedisObjectMigratedOperationInfo {
     RedisObjectSegmentation* oseg;
     UUID obj;
+    OSegEntry entry;
     ServerID ackTo;
 };
+// State tracking for batched lookups, performed with a single MGET
+struct RedisObjectBatchOperationInfo {
+    RedisObjectSegmentation* oseg;
+    std::vector<UUID> objs;
+};
 
-void globalRedisLookupObjectReadFinished(redisAsyncContext* c, void* _reply, void* privdata) {
+void globalRedisLookupObjectsReadFinished(redisAsyncContext* c, void* _reply, void* privdata) {
     redisReply *reply = (redisReply*)_reply;
-    RedisObjectOperationInfo* wi = (RedisObjectOperationInfo*)privdata;
-
-    if (reply == NULL) {
-        REDISOSEG_LOG(error, "Unknown redis error when reading object " << wi->obj.toString());
-    }
-    else if (reply->type == REDIS_REPLY_ERROR) {
-        REDISOSEG_LOG(error, "Redis error when reading object " << wi->obj.toString() << ": " << String(reply->str, reply->len));
-        wi->oseg->failReadObject(wi->obj);
-    }
-    else if (reply->type == REDIS_REPLY_NIL) {
-        REDISOSEG_LOG(error, "Redis got nil when reading object.");
-        wi->oseg->failReadObject(wi->obj);
-    }
-    else if (reply->type == REDIS_REPLY_STRING) {
-        wi->oseg->finishReadObject(wi->obj, String(reply->str, reply->len));
+    RedisObjectBatchOperationInfo* wi = (RedisObjectBatchOperationInfo*)privdata;
+
+    if (reply != NULL && reply->type == REDIS_REPLY_ARRAY && reply->elements == wi->objs.size()) {
+        for(uint32 i = 0; i < wi->objs.size(); i++) {
+            redisReply* elem = reply->element[i];
+            if (elem->type == REDIS_REPLY_STRING)
+                wi->oseg->finishReadObject(wi->objs[i], String(elem->str, elem->len));
+            else
+                wi->oseg->failReadObject(wi->objs[i]);
+        }
     }
     else {
-        REDISOSEG_LOG(error, "Unexpected redis reply type when reading object " << wi->obj.toString() << ": " << reply->type);
+        // Whatever happened, make sure the lookups complete so they don't sit
+        // in the lookup queue forever.
+        if (reply == NULL)
+            REDISOSEG_LOG(error, "Unknown redis error when reading batch of " << wi->objs.size() << " objects");
+        else if (reply->type == REDIS_REPLY_ERROR)
+            REDISOSEG_LOG(error, "Redis error when reading batch of " << wi->objs.size() << " objects: " << String(reply->str, reply->len));
+        else
+            REDISOSEG_LOG(error, "Unexpected redis reply type when reading batch of " << wi->objs.size() << " objects: " << reply->type);
+
+        for(uint32 i = 0; i < wi->objs.size(); i++)
+            wi->oseg->failReadObject(wi->objs[i]);
     }
 
+    // A slot in the read lane just opened up
+    wi->oseg->finishReadBatch();
+
     delete wi;
 }
 
@@ -122,34 +106,34 @@ void globalRedisAddNewObjectWriteFinished(redisAsyncContext* c, void* _reply, vo
     if (reply == NULL)
     {
         REDISOSEG_LOG(error, "Unknown redis error when writing new object " << wi->obj.toString());
-        wi->oseg->finishWriteNewObject(wi->obj, OSegWriteListener::UNKNOWN_ERROR);
+        wi->oseg->finishWriteNewObject(wi->obj, wi->entry, OSegWriteListener::UNKNOWN_ERROR);
     }
     else if (reply->type == REDIS_REPLY_ERROR)
     {
         REDISOSEG_LOG(error, "Redis error when writing new object " << wi->obj.toString() << ": " << String(reply->str, reply->len));
-        wi->oseg->finishWriteNewObject(wi->obj,OSegWriteListener::UNKNOWN_ERROR);
+        wi->oseg->finishWriteNewObject(wi->obj, wi->entry,OSegWriteListener::UNKNOWN_ERROR);
     }
     else if (reply->type == REDIS_REPLY_INTEGER)
     {
         if (reply->integer == 1)
         {
-            wi->oseg->finishWriteNewObject(wi->obj, OSegWriteListener::SUCCESS);
+            wi->oseg->finishWriteNewObject(wi->obj, wi->entry, OSegWriteListener::SUCCESS);
         }
         else if (reply->integer == 0)
         {
             REDISOSEG_LOG(error, "Redis error when writing new object " << wi->obj.toString() << ": " << reply->integer<< " likely already registered.");
-            wi->oseg->finishWriteNewObject(wi->obj,OSegWriteListener::OBJ_ALREADY_REGISTERED);
+            wi->oseg->finishWriteNewObject(wi->obj, wi->entry,OSegWriteListener::OBJ_ALREADY_REGISTERED);
         }
         else
         {
             REDISOSEG_LOG(error, "Redis error when writing new object " << wi->obj.toString() << ": " << reply->integer<< " unknown error.");
-            wi->oseg->finishWriteNewObject(wi->obj,OSegWriteListener::UNKNOWN_ERROR);
+            wi->oseg->finishWriteNewObject(wi->obj, wi->entry,OSegWriteListener::UNKNOWN_ERROR);
         }
     }
     else
     {
         REDISOSEG_LOG(error, "Unexpected redis reply type when writing new object " << wi->obj.toString() << ": " << reply->type);
-        wi->oseg->finishWriteNewObject(wi->obj,OSegWriteListener::UNKNOWN_ERROR);
+        wi->oseg->finishWriteNewObject(wi->obj, wi->entry,OSegWriteListener::UNKNOWN_ERROR);
     }
 
     delete wi;
@@ -167,7 +151,7 @@ void globalRedisAddMigratedObjectWriteFinished(redisAsyncContext* c, void* _repl
     }
     else if (reply->type == REDIS_REPLY_STATUS) {
         if (String(reply->str, reply->len) == String("OK"))
-            wi->oseg->finishWriteMigratedObject(wi->obj, wi->ackTo);
+            wi->oseg->finishWriteMigratedObject(wi->obj, wi->entry, wi->ackTo);
         else
             REDISOSEG_LOG(error, "Redis error when writing migrated object " << wi->obj.toString() << ": " << String(reply->str, reply->len));
     }
@@ -202,164 +186,172 @@ void globalRedisDeleteFinished(redisAsyncContext* c, void* _reply, void* privdat
 
 } // namespace
 
-RedisObjectSegmentation::RedisObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& redis_host, uint32 redis_port, const String& redis_prefix)
+RedisObjectSegmentation::RedisObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& redis_host, uint32 redis_port, const String& redis_prefix, const PoolOptions& pool_opts, bool run_stub)
  : ObjectSegmentation(con, o_strand),
    mCSeg(cseg),
    mCache(cache),
    mRedisHost(redis_host),
    mRedisPort(redis_port),
    mRedisPrefix(redis_prefix),
-   mRedisContext(NULL),
-   mRedisFD(NULL),
-   mReading(false),
-   mWriting(false)
+   mPoolOptions(pool_opts),
+   mQueuedLookupCount(0),
+   mStub(NULL),
+   mLookupBatches(0),
+   mLookupKeys(0)
 {
+    if (mPoolOptions.readConnections == 0) mPoolOptions.readConnections = 1;
+    if (mPoolOptions.writeConnections == 0) mPoolOptions.writeConnections = 1;
+    if (mPoolOptions.pipelineDepth == 0) mPoolOptions.pipelineDepth = 1;
+    if (mPoolOptions.maxBatchSize == 0) mPoolOptions.maxBatchSize = 1;
+
+    if (run_stub)
+        mStub = new RedisStubServer(mContext->ioService, mRedisPort);
+
+    for(uint32 i = 0; i < mPoolOptions.readConnections; i++)
+        mReadConnections.push_back(new RedisConnection(oStrand, mRedisHost, mRedisPort));
+    for(uint32 i = 0; i < mPoolOptions.writeConnections; i++)
+        mWriteConnections.push_back(new RedisConnection(oStrand, mRedisHost, mRedisPort));
 }
 
 RedisObjectSegmentation::~RedisObjectSegmentation() {
-    cleanup();
+    for(ConnectionPool::iterator it = mReadConnections.begin(); it != mReadConnections.end(); it++)
+        delete *it;
+    for(ConnectionPool::iterator it = mWriteConnections.begin(); it != mWriteConnections.end(); it++)
+        delete *it;
+    delete mStub;
 }
 
 void RedisObjectSegmentation::start() {
     ObjectSegmentation::start();
-    connect();
+    if (mStub != NULL) mStub->start();
 }
 
-void RedisObjectSegmentation::connect() {
-    mRedisContext = redisAsyncConnect(mRedisHost.c_str(), mRedisPort);
-    if (mRedisContext->err) {
-        REDISOSEG_LOG(error, "Failed to connect to redis: " << mRedisContext->errstr);
-        redisAsyncDisconnect(mRedisContext);
-        mRedisContext = NULL;
-    } else {
-        REDISOSEG_LOG(insane, "Optimistically connected to redis.");
-    }
+void RedisObjectSegmentation::stop() {
+    ObjectSegmentation::stop();
 
-    // This appears to be the only way to get a non-static 'argument' to the
-    // connect and disconnect callbacks.
-    mRedisContext->data = (void*)this;
-
-    redisAsyncSetConnectCallback(mRedisContext, globalRedisConnectHandler);
-    redisAsyncSetDisconnectCallback(mRedisContext, globalRedisDisconnectHandler);
-
-    mRedisContext->ev.addRead = globalRedisAddRead;
-    mRedisContext->ev.delRead = globalRedisDelRead;
-    mRedisContext->ev.addWrite = globalRedisAddWrite;
-    mRedisContext->ev.delWrite = globalRedisDelWrite;
-    mRedisContext->ev.cleanup = globalRedisCleanup;
-    mRedisContext->ev.data = this;
-
-    // Wrap this connections file descripter in ASIO
-    using boost::asio::posix::stream_descriptor;
-    mRedisFD = new stream_descriptor(mContext->ioService->asioService());
-    mRedisFD->assign(mRedisContext->c.fd);
-
-    // Force one command through. This ensures the connection gets fully
-    // initialized. Otherwise, we can end up leaving the connection idle, the
-    // server disconnects, and because haven't started anything, the next
-    // command fails and *then* we get the disconnect event. Performing one
-    // command ensures we'll get the disconnect event ASAP after it occurs.
-    redisAsyncCommand(mRedisContext, NULL, NULL, "PING");
-}
+    for(ConnectionPool::iterator it = mReadConnections.begin(); it != mReadConnections.end(); it++)
+        (*it)->stop();
+    for(ConnectionPool::iterator it = mWriteConnections.begin(); it != mWriteConnections.end(); it++)
+        (*it)->stop();
+    if (mStub != NULL) mStub->stop();
 
-void RedisObjectSegmentation::ensureConnected() {
-    if (mRedisContext == NULL) connect();
+    REDISOSEG_LOG(info, "Looked up " << mLookupKeys << " objects in " << mLookupBatches << " batches over " << mReadConnections.size() << " read connections");
 }
 
-void RedisObjectSegmentation::disconnected() {
-    cleanup();
+String RedisObjectSegmentation::key(const UUID& obj_id) const {
+    return mRedisPrefix + obj_id.toString();
 }
 
-void RedisObjectSegmentation::addRead() {
-    REDISOSEG_LOG(insane, "Add read");
-
-    if (mReading) return;
-    mReading = true;
-
-    startRead();
+int RedisObjectSegmentation::getPushback() {
+    return mQueuedLookupCount.read() / mPoolOptions.maxBatchSize;
 }
 
-void RedisObjectSegmentation::delRead() {
-    REDISOSEG_LOG(insane, "Del read");
-    assert(mReading);
-    mReading = false;
+OSegEntry RedisObjectSegmentation::cacheLookup(const UUID& obj_id) {
+    // We only check the cache for statistics purposes
+    return mCache->get(obj_id);
 }
 
-void RedisObjectSegmentation::addWrite() {
-    REDISOSEG_LOG(insane, "Add write");
-
-    if (mWriting) return;
-    mWriting = true;
+OSegEntry RedisObjectSegmentation::lookup(const UUID& obj_id) {
+    // Check locally
+    OSegMap::const_iterator it = mOSeg.find(obj_id);
+    if (it != mOSeg.end()) return it->second;
 
-    startWrite();
+    // Otherwise, kick off the lookup process and return null
+    if (mStopping) return OSegEntry::null();
+    std::vector<UUID> objs;
+    objs.push_back(obj_id);
+    mQueuedLookupCount++;
+    oStrand->post(
+        std::tr1::bind(&RedisObjectSegmentation::queueLookups, this, objs),
+        "RedisObjectSegmentation::queueLookups"
+    );
+    return OSegEntry::null();
 }
 
-void RedisObjectSegmentation::delWrite() {
-    REDISOSEG_LOG(insane, "Del write");
-    assert(mWriting);
-    mWriting = false;
-}
+void RedisObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids) {
+    if (mStopping) return;
 
-void RedisObjectSegmentation::cleanup() {
-    REDISOSEG_LOG(insane, "Cleanup");
+    std::vector<UUID> remote;
+    for(std::vector<UUID>::const_iterator it = obj_ids.begin(); it != obj_ids.end(); it++) {
+        // Anything we have locally can be reported immediately
+        OSegMap::const_iterator local_it = mOSeg.find(*it);
+        if (local_it != mOSeg.end()) {
+            mLookupListener->osegLookupCompleted(*it, local_it->second);
+            continue;
+        }
+        remote.push_back(*it);
+    }
 
-    mRedisContext = NULL;
-    delete mRedisFD;
-    mRedisFD = NULL;
-    mReading = false;
-    mWriting = false;
-}
+    if (remote.empty()) return;
 
-void RedisObjectSegmentation::startRead() {
-    if (mStopping || !mReading) return;
-    mRedisFD->async_read_some(boost::asio::null_buffers(),
-        boost::bind(&RedisObjectSegmentation::readHandler, this, boost::asio::placeholders::error));
+    mQueuedLookupCount += remote.size();
+    oStrand->post(
+        std::tr1::bind(&RedisObjectSegmentation::queueLookups, this, remote),
+        "RedisObjectSegmentation::queueLookups"
+    );
 }
 
-void RedisObjectSegmentation::startWrite() {
-    if (mStopping || !mWriting) return;
-    mRedisFD->async_write_some(boost::asio::null_buffers(),
-        boost::bind(&RedisObjectSegmentation::writeHandler, this, boost::asio::placeholders::error));
+void RedisObjectSegmentation::queueLookups(const std::vector<UUID>& obj_ids) {
+    mQueuedLookups.insert(mQueuedLookups.end(), obj_ids.begin(), obj_ids.end());
+    issueLookups();
 }
 
-void RedisObjectSegmentation::readHandler(const boost::system::error_code& ec) {
-    if (ec) {
-        REDISOSEG_LOG(error, "Error in read handler.");
-        return;
-    }
-
-    redisAsyncHandleRead(mRedisContext);
-    startRead();
+void RedisObjectSegmentation::finishReadBatch() {
+    issueLookups();
 }
 
-void RedisObjectSegmentation::writeHandler(const boost::system::error_code& ec) {
-    if (ec) {
-        REDISOSEG_LOG(error, "Error in write handler.");
-        return;
-    }
+void RedisObjectSegmentation::issueLookups() {
+    while(!mQueuedLookups.empty() && !mStopping) {
+        // Use the least loaded read connection, or stop if they're all full.
+        // Whatever is left over gets coalesced into larger batches as replies
+        // come back.
+        RedisConnection* conn = NULL;
+        for(ConnectionPool::iterator it = mReadConnections.begin(); it != mReadConnections.end(); it++) {
+            if ((*it)->outstanding() >= mPoolOptions.pipelineDepth) continue;
+            if (conn == NULL || (*it)->outstanding() < conn->outstanding())
+                conn = *it;
+        }
+        if (conn == NULL) break;
+
+        RedisObjectBatchOperationInfo* ri = new RedisObjectBatchOperationInfo();
+        ri->oseg = this;
+        uint32 nkeys = std::min((uint32)mQueuedLookups.size(), mPoolOptions.maxBatchSize);
+        ri->objs.assign(mQueuedLookups.begin(), mQueuedLookups.begin() + nkeys);
+        mQueuedLookups.erase(mQueuedLookups.begin(), mQueuedLookups.begin() + nkeys);
+        mQueuedLookupCount -= nkeys;
+
+        // The keys need to stay alive until the command has been formatted.
+        std::vector<String> keys;
+        keys.reserve(nkeys);
+        std::vector<const char*> argv;
+        std::vector<size_t> argvlen;
+        argv.reserve(nkeys+1);
+        argvlen.reserve(nkeys+1);
+        argv.push_back("MGET");
+        argvlen.push_back(4);
+        for(uint32 i = 0; i < nkeys; i++) {
+            keys.push_back(key(ri->objs[i]));
+            argv.push_back(keys.back().c_str());
+            argvlen.push_back(keys.back().size());
+        }
 
-    redisAsyncHandleWrite(mRedisContext);
-    startWrite();
+        REDISOSEG_LOG(insane, "MGET " << nkeys << " objects");
+        mLookupBatches++;
+        mLookupKeys += nkeys;
+        conn->command(globalRedisLookupObjectsReadFinished, ri, argv.size(), &argv[0], &argvlen[0]);
+    }
 }
 
-OSegEntry RedisObjectSegmentation::cacheLookup(const UUID& obj_id) {
-    // We only check the cache for statistics purposes
-    return mCache->get(obj_id);
-}
+void RedisObjectSegmentation::issueWrite(const UUID& obj_id, const std::vector<String>& args, redisCallbackFn* fn, void* privdata) {
+    RedisConnection* conn = mWriteConnections[obj_id.hash() % mWriteConnections.size()];
 
-OSegEntry RedisObjectSegmentation::lookup(const UUID& obj_id) {
-    // Check locally
-    OSegMap::const_iterator it = mOSeg.find(obj_id);
-    if (it != mOSeg.end()) return it->second;
-
-    // Otherwise, kick off the lookup process and return null
-    if (mStopping) return OSegEntry::null();
-    RedisObjectOperationInfo* ri = new RedisObjectOperationInfo();
-    ri->oseg = this;
-    ri->obj = obj_id;
-    ensureConnected();
-    redisAsyncCommand(mRedisContext, globalRedisLookupObjectReadFinished, ri, "GET %s%s", mRedisPrefix.c_str(), obj_id.toString().c_str());
-    return OSegEntry::null();
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    for(std::vector<String>::const_iterator it = args.begin(); it != args.end(); it++) {
+        argv.push_back(it->c_str());
+        argvlen.push_back(it->size());
+    }
+    conn->command(fn, privdata, argv.size(), &argv[0], &argvlen[0]);
 }
 
 void RedisObjectSegmentation::finishReadObject(const UUID& obj_id, const String& data_str) {
@@ -394,11 +386,13 @@ void RedisObjectSegmentation::failReadObject(const UUID& obj_id) {
 void RedisObjectSegmentation::addNewObject(const UUID& obj_id, float radius) {
     if (mStopping) return;
 
-    mOSeg[obj_id] = OSegEntry(mContext->id(), radius);
+    OSegEntry entry(mContext->id(), radius);
+    mOSeg[obj_id] = entry;
 
     RedisObjectOperationInfo* wi = new RedisObjectOperationInfo();
     wi->oseg = this;
     wi->obj = obj_id;
+    wi->entry = entry;
     // Note: currently we're keeping compatibility with Redis 1.2. This means
     // that there aren't hashes on the server. Instead, we create and parse them
     // ourselves. This isn't so bad since they are all fixed format anyway.
@@ -406,11 +400,17 @@ void RedisObjectSegmentation::addNewObject(const UUID& obj_id, float radius) {
     os << mContext->id() << ":" << radius;
     String valstr = os.str();
     REDISOSEG_LOG(insane, "SETNX " << obj_id.toString() << " " << valstr);
-    ensureConnected();
-    redisAsyncCommand(mRedisContext, globalRedisAddNewObjectWriteFinished, wi, "SETNX %s%s %b", mRedisPrefix.c_str(), obj_id.toString().c_str(), valstr.c_str(), valstr.size());
+    std::vector<String> args;
+    args.push_back("SETNX");
+    args.push_back(key(obj_id));
+    args.push_back(valstr);
+    oStrand->post(
+        std::tr1::bind(&RedisObjectSegmentation::issueWrite, this, obj_id, args, globalRedisAddNewObjectWriteFinished, (void*)wi),
+        "RedisObjectSegmentation::issueWrite"
+    );
 }
 
-void RedisObjectSegmentation::finishWriteNewObject(const UUID& obj_id, OSegWriteListener::OSegAddNewStatus status)
+void RedisObjectSegmentation::finishWriteNewObject(const UUID& obj_id, const OSegEntry& entry, OSegWriteListener::OSegAddNewStatus status)
 {
     REDISOSEG_LOG(detailed, "Finished writing OSEG entry for object "\
         << obj_id.toString() << " with status " << (int)status);
@@ -419,7 +419,7 @@ void RedisObjectSegmentation::finishWriteNewObject(const UUID& obj_id, OSegWrite
 
     //only insert into cache if write was successful.
     if (status == OSegWriteListener::SUCCESS)
-        mCache->insert(obj_id, mOSeg[obj_id]);
+        mCache->insert(obj_id, entry);
 
     mWriteListener->osegAddNewFinished(obj_id, status);
 }
@@ -427,11 +427,13 @@ void RedisObjectSegmentation::finishWriteNewObject(const UUID& obj_id, OSegWrite
 void RedisObjectSegmentation::addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool generateAck) {
     if (mStopping) return;
 
-    mOSeg[obj_id] = OSegEntry(mContext->id(), radius);
+    OSegEntry entry(mContext->id(), radius);
+    mOSeg[obj_id] = entry;
 
     RedisObjectMigratedOperationInfo* wi = new RedisObjectMigratedOperationInfo();
     wi->oseg = this;
     wi->obj = obj_id;
+    wi->entry = entry;
     wi->ackTo = (generateAck ? idServerAckTo : NullServerID);
     // Note: currently we're keeping compatibility with Redis 1.2. This means
     // that there aren't hashes on the server. Instead, we create and parse them
@@ -440,15 +442,21 @@ void RedisObjectSegmentation::addMigratedObject(const UUID& obj_id, float radius
     os << mContext->id() << ":" << radius;
     String valstr = os.str();
     REDISOSEG_LOG(insane, "SET " << obj_id.toString() << " " << valstr);
-    ensureConnected();
-    redisAsyncCommand(mRedisContext, globalRedisAddMigratedObjectWriteFinished, wi, "SET %s%s %b", mRedisPrefix.c_str(), obj_id.toString().c_str(), valstr.c_str(), valstr.size());
+    std::vector<String> args;
+    args.push_back("SET");
+    args.push_back(key(obj_id));
+    args.push_back(valstr);
+    oStrand->post(
+        std::tr1::bind(&RedisObjectSegmentation::issueWrite, this, obj_id, args, globalRedisAddMigratedObjectWriteFinished, (void*)wi),
+        "RedisObjectSegmentation::issueWrite"
+    );
 }
 
-void RedisObjectSegmentation::finishWriteMigratedObject(const UUID& obj_id, ServerID ackTo) {
+void RedisObjectSegmentation::finishWriteMigratedObject(const UUID& obj_id, const OSegEntry& entry, ServerID ackTo) {
     REDISOSEG_LOG(detailed, "Finished writing OSEG entry for migrated object " << obj_id.toString());
     if (mStopping) return;
 
-    mCache->insert(obj_id, mOSeg[obj_id]);
+    mCache->insert(obj_id, entry);
 
     if (ackTo != NullServerID) {
         Sirikata::Protocol::OSeg::MigrateMessageAcknowledge oseg_ack_msg;
@@ -457,7 +465,7 @@ void RedisObjectSegmentation::finishWriteMigratedObject(const UUID& obj_id, Serv
         oseg_ack_msg.set_m_message_destination(ackTo);
         oseg_ack_msg.set_m_message_from(mContext->id());
         oseg_ack_msg.set_m_objid(obj_id);
-        oseg_ack_msg.set_m_objradius( mOSeg[obj_id].radius() );
+        oseg_ack_msg.set_m_objradius( entry.radius() );
         queueMigAck(oseg_ack_msg);
     }
 }
@@ -469,8 +477,13 @@ void RedisObjectSegmentation::removeObject(const UUID& obj_id) {
     RedisObjectOperationInfo* wi = new RedisObjectOperationInfo();
     wi->oseg = this;
     wi->obj = obj_id;
-    ensureConnected();
-    redisAsyncCommand(mRedisContext, globalRedisDeleteFinished, wi, "DEL %s%s", mRedisPrefix.c_str(), obj_id.toString().c_str());
+    std::vector<String> args;
+    args.push_back("DEL");
+    args.push_back(key(obj_id));
+    oStrand->post(
+        std::tr1::bind(&RedisObjectSegmentation::issueWrite, this, obj_id, args, globalRedisDeleteFinished, (void*)wi),
+        "RedisObjectSegmentation::issueWrite"
+    );
 }
 
 bool RedisObjectSegmentation::clearToMigrate(const UUID& obj_id) {
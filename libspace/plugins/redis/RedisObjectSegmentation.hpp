@@ -34,19 +34,39 @@
 #define _SIRIKATA_REDIS_OBJECT_SEGMENTATION_HPP_
 
 #include <sirikata/space/ObjectSegmentation.hpp>
-#include <hiredis/async.h>
+#include "RedisConnection.hpp"
 
 namespace Sirikata {
 
+class RedisStubServer;
+
+/** RedisObjectSegmentation stores OSeg entries in Redis. Requests are spread
+ *  over a pool of connections, with separate lanes for reads and writes so
+ *  that lookups don't queue up behind updates during migration storms. Lookups
+ *  are batched into MGETs. When every read connection has a full pipeline,
+ *  lookups are queued locally, coalesced into the next batch, and reported as
+ *  pushback to the OSegLookupQueue so it stops admitting new lookups.
+ *
+ *  All Redis connections are driven from the OSeg strand.
+ */
 class RedisObjectSegmentation : public ObjectSegmentation {
 public:
-    RedisObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& redis_host, uint32 redis_port, const String& redis_prefix);
+    struct PoolOptions {
+        uint32 readConnections;
+        uint32 writeConnections;
+        uint32 pipelineDepth; // Max outstanding commands per read connection
+        uint32 maxBatchSize; // Max keys in a single MGET
+    };
+
+    RedisObjectSegmentation(SpaceContext* con, Network::IOStrand* o_strand, CoordinateSegmentation* cseg, OSegCache* cache, const String& redis_host, uint32 redis_port, const String& redis_prefix, const PoolOptions& pool_opts, bool run_stub);
     ~RedisObjectSegmentation();
 
     virtual void start();
+    virtual void stop();
 
     virtual OSegEntry cacheLookup(const UUID& obj_id);
     virtual OSegEntry lookup(const UUID& obj_id);
+    virtual void lookupBatch(const std::vector<UUID>& obj_ids);
 
     virtual void addNewObject(const UUID& obj_id, float radius);
     virtual void addMigratedObject(const UUID& obj_id, float radius, ServerID idServerAckTo, bool);
@@ -58,32 +78,32 @@ public:
     virtual void handleMigrateMessageAck(const Sirikata::Protocol::OSeg::MigrateMessageAcknowledge& msg);
     virtual void handleUpdateOSegMessage(const Sirikata::Protocol::OSeg::UpdateOSegMessage& update_oseg_msg);
 
-
-    // Redis event handlers
-    void disconnected();
-    void addRead();
-    void delRead();
-    void addWrite();
-    void delWrite();
-    void cleanup();
+    /** Reports the number of full lookup batches waiting for a free read
+     *  connection.
+     */
+    virtual int getPushback();
 
     // Helper handlers, public since redis needs C functions as callbacks, which
     // then invoke these to complete operations.
     void finishReadObject(const UUID& obj_id, const String& data_str);
     void failReadObject(const UUID& obj_id);
-    void finishWriteNewObject(const UUID& obj_id, OSegWriteListener::OSegAddNewStatus);
-    void finishWriteMigratedObject(const UUID& obj_id, ServerID ackTo);
+    void finishReadBatch();
+    void finishWriteNewObject(const UUID& obj_id, const OSegEntry& entry, OSegWriteListener::OSegAddNewStatus);
+    void finishWriteMigratedObject(const UUID& obj_id, const OSegEntry& entry, ServerID ackTo);
 
 private:
-    void connect();
-    void ensureConnected();
+    typedef std::vector<RedisConnection*> ConnectionPool;
 
-    // If the appropriate flag is set, starts and stops read/write operations
-    void startRead();
-    void startWrite();
+    // Queue lookups and issue as many batches as the read lane allows. Must be
+    // called on the OSeg strand.
+    void queueLookups(const std::vector<UUID>& obj_ids);
+    void issueLookups();
+    // Issue a write on the write lane. Writes for the same object always use
+    // the same connection so they are applied in order. Must be called on the
+    // OSeg strand.
+    void issueWrite(const UUID& obj_id, const std::vector<String>& args, redisCallbackFn* fn, void* privdata);
 
-    void readHandler(const boost::system::error_code& ec);
-    void writeHandler(const boost::system::error_code& ec);
+    String key(const UUID& obj_id) const;
 
     CoordinateSegmentation* mCSeg;
     OSegCache* mCache;
@@ -94,10 +114,21 @@ private:
     String mRedisHost;
     uint16 mRedisPort;
     String mRedisPrefix;
+    PoolOptions mPoolOptions;
+
+    ConnectionPool mReadConnections;
+    ConnectionPool mWriteConnections;
+
+    // Lookups waiting for a read connection, only accessed on the OSeg strand
+    std::deque<UUID> mQueuedLookups;
+    // Size of mQueuedLookups, readable from any strand for pushback
+    AtomicValue<uint32> mQueuedLookupCount;
+
+    RedisStubServer* mStub;
 
-    redisAsyncContext* mRedisContext;
-    boost::asio::posix::stream_descriptor* mRedisFD; // Wrapped hiredis file descriptor
-    bool mReading, mWriting;
+    // Statistics, reported when stopped
+    uint64 mLookupBatches;
+    uint64 mLookupKeys;
 };
 
 } // namespace Sirikata
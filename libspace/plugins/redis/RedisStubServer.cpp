@@ -0,0 +1,256 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "RedisStubServer.hpp"
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
+
+#define REDISSTUB_LOG(lvl,msg) SILOG(redis_stub, lvl, msg)
+
+namespace Sirikata {
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+const size_t REDIS_STUB_READ_BUFFER_SIZE = 16384;
+
+void appendStatus(String* output, const char* status) {
+    output->append("+");
+    output->append(status);
+    output->append("\r\n");
+}
+
+void appendError(String* output, const String& err) {
+    output->append("-ERR ");
+    output->append(err);
+    output->append("\r\n");
+}
+
+void appendInteger(String* output, int64 val) {
+    std::ostringstream os;
+    os << ":" << val << "\r\n";
+    output->append(os.str());
+}
+
+void appendBulk(String* output, const String* val) {
+    if (val == NULL) {
+        output->append("$-1\r\n");
+        return;
+    }
+    std::ostringstream os;
+    os << "$" << val->size() << "\r\n";
+    output->append(os.str());
+    output->append(*val);
+    output->append("\r\n");
+}
+
+// Reads an integer terminated by CRLF starting at pos. Returns false if the
+// line isn't complete yet.
+bool readLineInteger(const String& input, size_t* pos, int64* val_out) {
+    size_t end = input.find("\r\n", *pos);
+    if (end == String::npos) return false;
+    *val_out = atoll(input.substr(*pos, end - *pos).c_str());
+    *pos = end + 2;
+    return true;
+}
+
+} // namespace
+
+RedisStubServer::RedisStubServer(Network::IOService* ios, uint16 port)
+ : mIOService(ios),
+   mPort(port),
+   mStopping(false)
+{
+}
+
+RedisStubServer::~RedisStubServer() {
+}
+
+void RedisStubServer::start() {
+    REDISSTUB_LOG(info, "Starting in-process Redis stub on port " << mPort);
+    mAcceptor =
+        TCPListenerPtr(new Network::TCPListener(*mIOService, tcp::endpoint(tcp::v4(), mPort)));
+    acceptConnection();
+}
+
+void RedisStubServer::stop() {
+    mStopping = true;
+    if (mAcceptor) mAcceptor->close();
+}
+
+void RedisStubServer::acceptConnection() {
+    if (mStopping) return;
+
+    TCPSocketPtr socket(new Network::TCPSocket(*mIOService));
+    mAcceptor->async_accept(
+        *socket,
+        boost::bind(&RedisStubServer::handleConnection, this, socket, boost::asio::placeholders::error)
+    );
+}
+
+void RedisStubServer::handleConnection(TCPSocketPtr socket, const boost::system::error_code& ec) {
+    if (ec) {
+        if (!mStopping)
+            REDISSTUB_LOG(error, "Error accepting connection: " << ec.message());
+        return;
+    }
+
+    // Always start listening for a new connection
+    acceptConnection();
+
+    socket->set_option(tcp::no_delay(true));
+
+    ConnectionPtr conn(new Connection());
+    conn->socket = socket;
+    conn->buffer.resize(REDIS_STUB_READ_BUFFER_SIZE);
+    readRequestData(conn);
+}
+
+void RedisStubServer::readRequestData(ConnectionPtr conn) {
+    if (mStopping) return;
+
+    conn->socket->async_read_some(
+        boost::asio::buffer(&(conn->buffer[0]), conn->buffer.size()),
+        boost::bind(&RedisStubServer::handleReadRequestData, this, conn,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)
+    );
+}
+
+void RedisStubServer::handleReadRequestData(ConnectionPtr conn, const boost::system::error_code& ec, std::size_t bytes_transferred) {
+    if (ec) {
+        // Includes normal disconnection by the client
+        REDISSTUB_LOG(detailed, "Connection closed: " << ec.message());
+        return;
+    }
+
+    conn->input.append(&(conn->buffer[0]), bytes_transferred);
+
+    // Process every complete request we've received. Clients pipeline
+    // requests, so we batch up all the responses into a single write.
+    size_t offset = 0;
+    std::vector<String> args;
+    while(parseRequest(conn->input, &offset, &args)) {
+        execute(args, &(conn->output));
+        args.clear();
+    }
+    conn->input.erase(0, offset);
+
+    if (conn->output.empty())
+        readRequestData(conn);
+    else
+        writeResponseData(conn, 0);
+}
+
+void RedisStubServer::writeResponseData(ConnectionPtr conn, uint32 offset) {
+    conn->socket->async_write_some(
+        boost::asio::buffer(&(conn->output[offset]), conn->output.size()-offset),
+        boost::bind(&RedisStubServer::handleWriteResponseData, this,
+            conn, offset,
+            boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)
+    );
+}
+
+void RedisStubServer::handleWriteResponseData(ConnectionPtr conn, uint32 offset, const boost::system::error_code& ec, std::size_t bytes_transferred) {
+    if (ec) {
+        REDISSTUB_LOG(error, "Error writing response, closing connection");
+        return;
+    }
+
+    offset += bytes_transferred;
+    if (offset < conn->output.size()) {
+        writeResponseData(conn, offset);
+        return;
+    }
+
+    // Everything has been sent, go back to reading requests
+    conn->output.clear();
+    readRequestData(conn);
+}
+
+bool RedisStubServer::parseRequest(const String& input, size_t* offset, std::vector<String>* args_out) {
+    size_t pos = *offset;
+    if (pos >= input.size()) return false;
+
+    if (input[pos] != '*') {
+        // Inline command, e.g. from telnet
+        size_t end = input.find("\r\n", pos);
+        if (end == String::npos) return false;
+        String line = input.substr(pos, end - pos);
+        boost::algorithm::split(*args_out, line, boost::algorithm::is_any_of(" "), boost::algorithm::token_compress_on);
+        *offset = end + 2;
+        return true;
+    }
+
+    pos++;
+    int64 nargs;
+    if (!readLineInteger(input, &pos, &nargs)) return false;
+    for(int64 i = 0; i < nargs; i++) {
+        if (pos >= input.size()) return false;
+        if (input[pos] != '$') {
+            // Protocol error. Drop everything we have, we can't resync.
+            REDISSTUB_LOG(error, "Protocol error, expected bulk string");
+            *offset = input.size();
+            args_out->clear();
+            return false;
+        }
+        pos++;
+        int64 len;
+        if (!readLineInteger(input, &pos, &len)) return false;
+        if (pos + len + 2 > input.size()) return false;
+        args_out->push_back(input.substr(pos, len));
+        pos += len + 2;
+    }
+
+    *offset = pos;
+    return true;
+}
+
+void RedisStubServer::execute(const std::vector<String>& args, String* output) {
+    if (args.empty()) {
+        appendError(output, "empty command");
+        return;
+    }
+
+    String cmd = boost::algorithm::to_upper_copy(args[0]);
+
+    Lock lck(mMutex);
+    if (cmd == "PING") {
+        appendStatus(output, "PONG");
+    }
+    else if (cmd == "GET" && args.size() == 2) {
+        DataMap::const_iterator it = mData.find(args[1]);
+        appendBulk(output, (it == mData.end() ? NULL : &(it->second)));
+    }
+    else if (cmd == "MGET" && args.size() >= 2) {
+        std::ostringstream os;
+        os << "*" << (args.size()-1) << "\r\n";
+        output->append(os.str());
+        for(uint32 i = 1; i < args.size(); i++) {
+            DataMap::const_iterator it = mData.find(args[i]);
+            appendBulk(output, (it == mData.end() ? NULL : &(it->second)));
+        }
+    }
+    else if (cmd == "SET" && args.size() == 3) {
+        mData[args[1]] = args[2];
+        appendStatus(output, "OK");
+    }
+    else if (cmd == "SETNX" && args.size() == 3) {
+        bool inserted = mData.insert( std::make_pair(args[1], args[2]) ).second;
+        appendInteger(output, inserted ? 1 : 0);
+    }
+    else if (cmd == "DEL" && args.size() >= 2) {
+        int64 ndeleted = 0;
+        for(uint32 i = 1; i < args.size(); i++)
+            ndeleted += mData.erase(args[i]);
+        appendInteger(output, ndeleted);
+    }
+    else {
+        appendError(output, "unknown command '" + args[0] + "'");
+    }
+}
+
+} // namespace Sirikata
@@ -0,0 +1,74 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_REDIS_STUB_SERVER_HPP_
+#define _SIRIKATA_REDIS_STUB_SERVER_HPP_
+
+#include <sirikata/core/util/Platform.hpp>
+#include <sirikata/core/network/Asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace Sirikata {
+
+/** RedisStubServer is a minimal, in-process stand-in for redis-server. It
+ *  speaks enough of the Redis protocol (RESP) to serve the OSeg: PING, GET,
+ *  MGET, SET, SETNX and DEL. Other space servers can point at it just like a
+ *  real Redis server, which makes it possible to benchmark the Redis OSeg
+ *  client without running Redis.
+ */
+class RedisStubServer {
+public:
+    RedisStubServer(Network::IOService* ios, uint16 port);
+    ~RedisStubServer();
+
+    void start();
+    void stop();
+
+private:
+    typedef std::tr1::shared_ptr<Network::TCPListener> TCPListenerPtr;
+    typedef std::tr1::shared_ptr<Network::TCPSocket> TCPSocketPtr;
+
+    // Only one read or write is outstanding on a connection at a time, so
+    // these need no locking.
+    struct Connection {
+        TCPSocketPtr socket;
+        std::vector<char> buffer;
+        String input; // Unparsed request data
+        String output; // Responses waiting to be written
+    };
+    typedef std::tr1::shared_ptr<Connection> ConnectionPtr;
+
+    void acceptConnection();
+    void handleConnection(TCPSocketPtr socket, const boost::system::error_code& ec);
+
+    void readRequestData(ConnectionPtr conn);
+    void handleReadRequestData(ConnectionPtr conn, const boost::system::error_code& ec, std::size_t bytes_transferred);
+
+    void writeResponseData(ConnectionPtr conn, uint32 offset);
+    void handleWriteResponseData(ConnectionPtr conn, uint32 offset, const boost::system::error_code& ec, std::size_t bytes_transferred);
+
+    // Parse one request from the input buffer starting at offset, advancing
+    // offset past it. Returns false if the buffer doesn't contain a complete
+    // request.
+    bool parseRequest(const String& input, size_t* offset, std::vector<String>* args_out);
+    // Execute a request, appending the response to the output
+    void execute(const std::vector<String>& args, String* output);
+
+    Network::IOService* mIOService;
+    uint16 mPort;
+    bool mStopping;
+
+    TCPListenerPtr mAcceptor;
+
+    typedef boost::mutex Mutex;
+    typedef boost::lock_guard<Mutex> Lock;
+    Mutex mMutex;
+    typedef std::tr1::unordered_map<String, String> DataMap;
+    DataMap mData;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_REDIS_STUB_SERVER_HPP_
@@ -50,8 +50,8 @@ void SQLiteAuthenticator::stop() {
     mDB.reset();
 }
 
-bool SQLiteAuthenticator::checkSQLiteError(int rc, const String& msg) const {
-    std::pair<bool, String> res = SQLite::check_sql_error(mDB->db(), rc, NULL, msg);
+bool SQLiteAuthenticator::checkSQLiteError(SQLiteDBPtr db, int rc, const String& msg) const {
+    std::pair<bool, String> res = SQLite::check_sql_error(db->db(), rc, NULL, msg);
     if (res.first) {
         SILOG(sqlite-authenticator, error, res.second);
     }
@@ -61,16 +61,19 @@ bool SQLiteAuthenticator::checkSQLiteError(int rc, const String& msg) const {
 bool SQLiteAuthenticator::checkTicket(const String& ticket) {
     bool found_ticket = false;
 
+    // Lookups only need a read-only connection, which lets them run while
+    // tickets are being added by another writer.
+    SQLiteDBPtr reader = SQLite::getSingleton().openReader(mDBFile);
+
     int rc;
-    char* remain;
     sqlite3_stmt* value_query_stmt;
-    rc = sqlite3_prepare_v2(mDB->db(), mDBGetSessionStmt.c_str(), -1, &value_query_stmt, (const char**)&remain);
-    checkSQLiteError(rc, "Error preparing value query statement");
+    rc = reader->prepare(mDBGetSessionStmt, &value_query_stmt);
+    checkSQLiteError(reader, rc, "Error preparing value query statement");
     if (rc != SQLITE_OK)
         return false;
 
     rc = sqlite3_bind_text(value_query_stmt, 1, ticket.data(), (int)ticket.size(), SQLITE_TRANSIENT);
-    checkSQLiteError(rc, "Error binding key name to value query statement");
+    checkSQLiteError(reader, rc, "Error binding key name to value query statement");
     if (rc != SQLITE_OK)
         return false;
 
@@ -82,26 +85,25 @@ bool SQLiteAuthenticator::checkTicket(const String& ticket) {
     if (step_rc != SQLITE_DONE) {
         // reset the statement so it'll clean up properly
         rc = sqlite3_reset(value_query_stmt);
-        checkSQLiteError(rc, "Error finalizing value query statement");
+        checkSQLiteError(reader, rc, "Error finalizing value query statement");
     }
 
-    rc = sqlite3_finalize(value_query_stmt);
-    checkSQLiteError(rc, "Error finalizing value query statement");
+    rc = sqlite3_reset(value_query_stmt);
+    checkSQLiteError(reader, rc, "Error resetting value query statement");
 
     return found_ticket;
 }
 
 void SQLiteAuthenticator::deleteTicket(const String& ticket) {
     int rc;
-    char* remain;
     sqlite3_stmt* value_query_stmt;
-    rc = sqlite3_prepare_v2(mDB->db(), mDBDeleteSessionStmt.c_str(), -1, &value_query_stmt, (const char**)&remain);
-    checkSQLiteError(rc, "Error preparing value query statement");
+    rc = mDB->prepare(mDBDeleteSessionStmt, &value_query_stmt);
+    checkSQLiteError(mDB, rc, "Error preparing value query statement");
     if (rc != SQLITE_OK)
         return;
 
     rc = sqlite3_bind_text(value_query_stmt, 1, ticket.data(), (int)ticket.size(), SQLITE_TRANSIENT);
-    checkSQLiteError(rc, "Error binding key name to value query statement");
+    checkSQLiteError(mDB, rc, "Error binding key name to value query statement");
     if (rc != SQLITE_OK)
         return;
 
@@ -109,11 +111,11 @@ void SQLiteAuthenticator::deleteTicket(const String& ticket) {
     if (step_rc != SQLITE_DONE) {
         // reset the statement so it'll clean up properly
         rc = sqlite3_reset(value_query_stmt);
-        checkSQLiteError(rc, "Error finalizing value query statement");
+        checkSQLiteError(mDB, rc, "Error finalizing value query statement");
     }
 
-    rc = sqlite3_finalize(value_query_stmt);
-    checkSQLiteError(rc, "Error finalizing value query statement");
+    rc = sqlite3_reset(value_query_stmt);
+    checkSQLiteError(mDB, rc, "Error resetting value query statement");
 }
 
 void SQLiteAuthenticator::respond(Callback cb, bool result) {
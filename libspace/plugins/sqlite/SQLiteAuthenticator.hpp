@@ -51,7 +51,7 @@ public:
 private:
     // Helper that checks and logs errors, then returns bool indicating
     // success/failure
-    bool checkSQLiteError(int rc, const String& msg) const;
+    bool checkSQLiteError(SQLiteDBPtr db, int rc, const String& msg) const;
 
     // Check if the ticket is valid
     bool checkTicket(const String& ticket);
@@ -55,6 +55,12 @@ void CoordinateSegmentation::removeListener(Listener* listener) {
     mListeners.erase(listener);
 }
 
+void CoordinateSegmentation::lookupBatch(const std::vector<Vector3f>& positions, std::vector<ServerID>* results) {
+    results->resize(positions.size());
+    for(uint32 i = 0; i < positions.size(); i++)
+        (*results)[i] = lookup(positions[i]);
+}
+
 void CoordinateSegmentation::notifyListeners(const std::vector<SegmentationInfo>& new_segmentation) {
     for( std::set<Listener*>::iterator it = mListeners.begin(); it != mListeners.end(); it++)
         (*it)->updatedSegmentation(this, new_segmentation);
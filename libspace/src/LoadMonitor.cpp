@@ -45,19 +45,29 @@ bool loadInfoComparator(const ServerLoadInfo sli1, const ServerLoadInfo sli2) {
     return sli1.mLoadReading < sli2.mLoadReading;
 }
 
-LoadMonitor::LoadMonitor(SpaceContext* ctx, CoordinateSegmentation* cseg)
+LoadMonitor::LoadMonitor(SpaceContext* ctx, CoordinateSegmentation* cseg, LocationService* loc)
  : PollingService(ctx->mainStrand, "LoadMonitor Poll", Duration::seconds(5)),
    mContext(ctx),
    mCoordinateSegmentation(cseg),
    mCurrentLoadReading(0),
-   mAveragedLoadReading(0)
+   mAveragedLoadReading(0),
+   mLoc(loc),
+   mReportRegionLoad(GetOptionValue<bool>("report-region-load")),
+   mLocationUpdates(0),
+   mLastRegionReport(Time::null())
 {
+    // Local objects are only tracked to report region loads
+    if (mReportRegionLoad)
+        mLoc->addListener(this, false);
+
     mContext->serverDispatcher()->registerMessageRecipient(SERVER_PORT_LOAD_STATUS, this);
     mLoadServerMessageService = mContext->serverRouter()->createServerMessageService("load-monitor");
     mProfiler = mContext->profiler->addStage("Load Monitor");
 }
 
 LoadMonitor::~LoadMonitor() {
+    if (mReportRegionLoad)
+        mLoc->removeListener(this);
     delete mProfiler;
     delete mLoadServerMessageService;
     mContext->serverDispatcher()->unregisterMessageRecipient(SERVER_PORT_LOAD_STATUS, this);
@@ -147,12 +157,76 @@ void LoadMonitor::loadStatusMessage(const ServerID source, const Sirikata::Proto
   mRemoteLoadReadings[source] = load_msg.load();
 }
 
+void LoadMonitor::localObjectAdded(const UUID& uuid, bool agg, const TimedMotionVector3f& loc, const TimedMotionQuaternion& orient, const BoundingSphere3f& bounds, const String& mesh, const String& physics, const String& zernike) {
+    if (agg) return;
+    mLocalObjects[uuid] = loc;
+}
+
+void LoadMonitor::localObjectRemoved(const UUID& uuid, bool agg) {
+    if (agg) return;
+    mLocalObjects.erase(uuid);
+}
+
+void LoadMonitor::localLocationUpdated(const UUID& uuid, bool agg, const TimedMotionVector3f& newval) {
+    if (agg) return;
+    ObjectLocationMap::iterator it = mLocalObjects.find(uuid);
+    if (it == mLocalObjects.end()) return;
+    it->second = newval;
+    mLocationUpdates++;
+}
+
+void LoadMonitor::reportRegionLoads() {
+    Time t = mContext->simTime();
+    float message_rate = 0;
+    if (mLastRegionReport != Time::null() && t > mLastRegionReport)
+        message_rate = mLocationUpdates / (t - mLastRegionReport).toSeconds();
+    mLastRegionReport = t;
+    mLocationUpdates = 0;
+
+    uint32 nbins = std::max(GetOptionValue<uint32>("load-report-bins"), (uint32)1);
+    BoundingBoxList regions = mCoordinateSegmentation->serverRegion(mContext->id());
+    if (regions.empty()) return;
+
+    std::vector<uint32> counts(regions.size(), 0);
+    std::vector< std::vector<uint32> > x_hists(regions.size(), std::vector<uint32>(nbins, 0));
+    std::vector< std::vector<uint32> > y_hists(regions.size(), std::vector<uint32>(nbins, 0));
+
+    for(ObjectLocationMap::iterator it = mLocalObjects.begin(); it != mLocalObjects.end(); it++) {
+        Vector3f pos = it->second.extrapolate(t).position();
+        for(uint32 r = 0; r < regions.size(); r++) {
+            const BoundingBox3f& bbox = regions[r];
+            if (!bbox.contains(pos)) continue;
+
+            counts[r]++;
+            Vector3f extent = bbox.max() - bbox.min();
+            uint32 xbin = (extent.x > 0) ? (uint32)((pos.x - bbox.min().x) / extent.x * nbins) : 0;
+            uint32 ybin = (extent.y > 0) ? (uint32)((pos.y - bbox.min().y) / extent.y * nbins) : 0;
+            x_hists[r][std::min(xbin, nbins-1)]++;
+            y_hists[r][std::min(ybin, nbins-1)]++;
+            break;
+        }
+    }
+
+    // Message rate isn't tracked per region, so divide it up by object count
+    uint32 total_objects = 0;
+    for(uint32 r = 0; r < regions.size(); r++)
+        total_objects += counts[r];
+
+    for(uint32 r = 0; r < regions.size(); r++) {
+        float region_rate = (total_objects > 0) ? message_rate * counts[r] / total_objects : message_rate / regions.size();
+        mCoordinateSegmentation->reportRegionLoad(mContext->id(), regions[r], counts[r], region_rate, x_hists[r], y_hists[r]);
+    }
+}
+
 void LoadMonitor::poll() {
     mProfiler->started();
 
     if (GetOptionValue<bool>("monitor-load"))
         addLoadReading();
 
+    if (mReportRegionLoad)
+        reportRegionLoads();
+
     mProfiler->finished();
 }
 
@@ -47,6 +47,12 @@ ObjectHostConnection::ObjectHostConnection(ShortObjectHostConnectionID sid, Siri
    socket(str),
    base_stream()
 {}
+ObjectHostConnection::ObjectHostConnection(ShortObjectHostConnectionID sid, const LocalSink& sink)
+ : short_id(sid),
+   socket(NULL),
+   base_stream(),
+   local_sink(sink)
+{}
 ObjectHostConnection::~ObjectHostConnection() {
     delete socket;
     // The stream won't be of any use anymore
@@ -141,6 +147,12 @@ bool ObjectHostConnectionManager::sendHelper(ObjectHostConnection* conn, Sirikat
         return false;
     }
 
+    if (conn->socket == NULL) {
+        conn->local_sink(*msg);
+        delete msg;
+        return true;
+    }
+
     String data;
     serializePBJMessage(&data, *msg);
     bool sent = conn->socket->send( Sirikata::MemoryReference(data), Sirikata::Network::ReliableOrdered );
@@ -289,6 +301,27 @@ void ObjectHostConnectionManager::destroyConnection(ObjectHostConnection* conn)
     delete conn;
 }
 
+ObjectHostConnectionID ObjectHostConnectionManager::openLocalConnection(const LocalConnectionSink& sink) {
+    ObjectHostConnection* conn = new ObjectHostConnection(mShortIDSource++, sink);
+    insertConnection(conn);
+    return conn_id(conn);
+}
+
+void ObjectHostConnectionManager::receiveLocal(const ObjectHostConnectionID& conn_id, Sirikata::Protocol::Object::ObjectMessage* msg) {
+    if (mConnections.find(conn_id.conn) == mConnections.end()) {
+        SPACE_LOG(error,"Tried to receive over out-of-date local connection ID.");
+        delete msg;
+        return;
+    }
+
+    TIMESTAMP(msg, Trace::HANDLE_OBJECT_HOST_MESSAGE);
+    mListener->onObjectHostMessageReceived(conn_id, conn_id.conn->short_id, msg);
+}
+
+void ObjectHostConnectionManager::closeLocalConnection(const ObjectHostConnectionID& conn_id) {
+    destroyConnection(conn_id.conn);
+}
+
 void ObjectHostConnectionManager::closeAllConnections() {
     while(!mConnections.empty())
         destroyConnection(*(mConnections.begin()));
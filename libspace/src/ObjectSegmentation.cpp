@@ -76,6 +76,16 @@ ObjectSegmentation::~ObjectSegmentation() {
     delete mOSegServerMessageService;
 }
 
+void ObjectSegmentation::lookupBatch(const std::vector<UUID>& obj_ids) {
+    for(std::vector<UUID>::const_iterator it = obj_ids.begin(); it != obj_ids.end(); it++) {
+        OSegEntry dest = lookup(*it);
+        // Anything not available immediately will be reported to the listener
+        // by the implementation when it completes.
+        if (dest.notNull() && mLookupListener != NULL)
+            mLookupListener->osegLookupCompleted(*it, dest);
+    }
+}
+
 void ObjectSegmentation::receiveMessage(Message* msg)
 {
     if (msg->dest_port() == SERVER_PORT_OSEG_MIGRATE_ACKNOWLEDGE) {
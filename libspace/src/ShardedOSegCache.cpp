@@ -0,0 +1,352 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <sirikata/space/ShardedOSegCache.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+#define SHARDEDCACHE_LOG(lvl,msg) SILOG(oseg_cache, lvl, msg)
+
+namespace Sirikata {
+
+namespace {
+
+// UUID::hash() just combines the two halves of the UUID, so run it through a
+// finalizer to make sure all the bits we use for shard, slot and sketch
+// selection are well mixed.
+uint64 mixHash(uint64 h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint32 nextPowerOfTwo(uint32 v) {
+    uint32 result = 1;
+    while(result < v) result <<= 1;
+    return result;
+}
+
+// Number of hash functions in the frequency sketch
+const uint32 SKETCH_DEPTH = 4;
+// Counters saturate at this value
+const uint8 SKETCH_MAX_COUNT = 15;
+// Counters are halved after this many accesses per entry of capacity
+const uint32 SKETCH_SAMPLE_FACTOR = 10;
+
+} // namespace
+
+ShardedOSegCache::Stats::Stats()
+ : hits(0),
+   misses(0),
+   expirations(0),
+   inserts(0),
+   updates(0),
+   evictions(0),
+   rejections(0)
+{
+}
+
+ShardedOSegCache::Stats& ShardedOSegCache::Stats::operator+=(const Stats& rhs) {
+    hits += rhs.hits;
+    misses += rhs.misses;
+    expirations += rhs.expirations;
+    inserts += rhs.inserts;
+    updates += rhs.updates;
+    evictions += rhs.evictions;
+    rejections += rhs.rejections;
+    return *this;
+}
+
+
+class ShardedOSegCache::Shard {
+public:
+    Shard(uint32 capacity)
+     : mCapacity(std::max(capacity, (uint32)1)),
+       mSize(0),
+       mHand(0),
+       mSketchAdditions(0)
+    {
+        // Keep the load factor at or below 1/2 so probe sequences stay short
+        mSlots.resize(nextPowerOfTwo(mCapacity * 2));
+        mSlotMask = mSlots.size() - 1;
+
+        mSketch.resize(nextPowerOfTwo(std::max(mCapacity * SKETCH_DEPTH, (uint32)64)), 0);
+        mSketchMask = mSketch.size() - 1;
+        mSketchSampleSize = mCapacity * SKETCH_SAMPLE_FACTOR;
+    }
+
+    bool get(const UUID& uuid, uint64 h, const Time& now, OSegEntry* result) {
+        Lock lck(mMutex);
+
+        recordAccess(h);
+
+        int32 idx = find(uuid, h);
+        if (idx < 0) {
+            mStats.misses++;
+            return false;
+        }
+
+        Slot& slot = mSlots[idx];
+        if (slot.expires != Time::null() && now > slot.expires) {
+            mStats.expirations++;
+            mStats.misses++;
+            erase(idx);
+            return false;
+        }
+
+        slot.referenced = true;
+        mStats.hits++;
+        *result = slot.entry;
+        return true;
+    }
+
+    void insert(const UUID& uuid, uint64 h, const OSegEntry& entry, const Time& expires) {
+        Lock lck(mMutex);
+
+        recordAccess(h);
+
+        // Updates always go through, otherwise we'd leave stale data behind
+        int32 idx = find(uuid, h);
+        if (idx >= 0) {
+            Slot& slot = mSlots[idx];
+            slot.entry = entry;
+            slot.expires = expires;
+            slot.referenced = true;
+            mStats.updates++;
+            return;
+        }
+
+        if (mSize >= mCapacity) {
+            uint32 victim = findVictim();
+            if (frequency(h) <= frequency(mSlots[victim].hash)) {
+                mStats.rejections++;
+                return;
+            }
+            erase(victim);
+            mStats.evictions++;
+        }
+
+        uint32 pos = h & mSlotMask;
+        while(mSlots[pos].used)
+            pos = (pos + 1) & mSlotMask;
+
+        Slot& slot = mSlots[pos];
+        slot.used = true;
+        // New entries have to earn their reference bit with a hit, which
+        // keeps a burst of inserts from pinning themselves in the cache.
+        slot.referenced = false;
+        slot.hash = h;
+        slot.id = uuid;
+        slot.entry = entry;
+        slot.expires = expires;
+        mSize++;
+        mStats.inserts++;
+    }
+
+    void remove(const UUID& uuid, uint64 h) {
+        Lock lck(mMutex);
+
+        int32 idx = find(uuid, h);
+        if (idx >= 0) erase(idx);
+    }
+
+    uint32 size() {
+        Lock lck(mMutex);
+        return mSize;
+    }
+
+    Stats stats() {
+        Lock lck(mMutex);
+        return mStats;
+    }
+
+private:
+    typedef boost::mutex Mutex;
+    typedef boost::lock_guard<Mutex> Lock;
+
+    struct Slot {
+        Slot()
+         : used(false),
+           referenced(false),
+           hash(0),
+           entry(),
+           expires(Time::null())
+        {}
+
+        bool used;
+        bool referenced;
+        uint64 hash;
+        UUID id;
+        OSegEntry entry;
+        Time expires;
+    };
+
+    int32 find(const UUID& uuid, uint64 h) const {
+        uint32 pos = h & mSlotMask;
+        while(mSlots[pos].used) {
+            if (mSlots[pos].hash == h && mSlots[pos].id == uuid)
+                return pos;
+            pos = (pos + 1) & mSlotMask;
+        }
+        return -1;
+    }
+
+    // Removes the entry at idx, shifting back any entries later in the probe
+    // sequence so lookups never need tombstones.
+    void erase(uint32 idx) {
+        uint32 next = (idx + 1) & mSlotMask;
+        while(mSlots[next].used) {
+            uint32 home = mSlots[next].hash & mSlotMask;
+            // The entry can fill the hole if the hole lies between its home
+            // slot and its current position.
+            if (((next - home) & mSlotMask) >= ((next - idx) & mSlotMask)) {
+                mSlots[idx] = mSlots[next];
+                idx = next;
+            }
+            next = (next + 1) & mSlotMask;
+        }
+        mSlots[idx] = Slot();
+        mSize--;
+    }
+
+    // Advances the CLOCK hand to the next entry without its reference bit,
+    // clearing reference bits along the way. Only valid if mSize > 0.
+    uint32 findVictim() {
+        while(true) {
+            Slot& slot = mSlots[mHand];
+            if (slot.used) {
+                if (!slot.referenced)
+                    return mHand;
+                slot.referenced = false;
+            }
+            mHand = (mHand + 1) & mSlotMask;
+        }
+    }
+
+    uint32 sketchIndex(uint64 h, uint32 i) const {
+        // Double hashing over a differently mixed copy of the hash so the
+        // sketch doesn't just mirror the slot position.
+        uint64 s = h * 0x9e3779b97f4a7c15ULL;
+        uint32 a = (uint32)s;
+        uint32 b = (uint32)(s >> 32) | 1;
+        return (a + i * b) & mSketchMask;
+    }
+
+    void recordAccess(uint64 h) {
+        for(uint32 i = 0; i < SKETCH_DEPTH; i++) {
+            uint8& count = mSketch[sketchIndex(h, i)];
+            if (count < SKETCH_MAX_COUNT) count++;
+        }
+
+        // Periodically age everything so the sketch tracks recent popularity
+        if (++mSketchAdditions >= mSketchSampleSize) {
+            for(std::vector<uint8>::iterator it = mSketch.begin(); it != mSketch.end(); it++)
+                *it >>= 1;
+            mSketchAdditions /= 2;
+        }
+    }
+
+    uint8 frequency(uint64 h) const {
+        uint8 result = SKETCH_MAX_COUNT;
+        for(uint32 i = 0; i < SKETCH_DEPTH; i++)
+            result = std::min(result, mSketch[sketchIndex(h, i)]);
+        return result;
+    }
+
+    Mutex mMutex;
+
+    uint32 mCapacity;
+    uint32 mSize;
+    std::vector<Slot> mSlots;
+    uint32 mSlotMask;
+    uint32 mHand;
+
+    std::vector<uint8> mSketch;
+    uint32 mSketchMask;
+    uint32 mSketchAdditions;
+    uint32 mSketchSampleSize;
+
+    Stats mStats;
+};
+
+
+ShardedOSegCache::ShardedOSegCache(Context* ctx, uint32 capacity, uint32 nshards, const Duration& entry_lifetime)
+ : mContext(ctx),
+   mEntryLifetime(entry_lifetime),
+   mShardBits(0)
+{
+    assert(mContext != NULL || mEntryLifetime == Duration::zero());
+
+    // Don't let shards get so small that admission decisions are meaningless
+    capacity = std::max(capacity, (uint32)1);
+    nshards = nextPowerOfTwo(std::max(nshards, (uint32)1));
+    while(nshards > 1 && capacity / nshards < 8)
+        nshards /= 2;
+    while((1u << mShardBits) < nshards)
+        mShardBits++;
+
+    for(uint32 i = 0; i < nshards; i++) {
+        uint32 shard_capacity = capacity / nshards + (i < capacity % nshards ? 1 : 0);
+        mShards.push_back(new Shard(shard_capacity));
+    }
+}
+
+ShardedOSegCache::~ShardedOSegCache() {
+    Stats s = stats();
+    SHARDEDCACHE_LOG(debug, "hits: " << s.hits << " misses: " << s.misses << " (" << s.expirations << " expired)"
+        << " inserts: " << s.inserts << " updates: " << s.updates
+        << " evictions: " << s.evictions << " rejections: " << s.rejections);
+
+    for(std::vector<Shard*>::iterator it = mShards.begin(); it != mShards.end(); it++)
+        delete *it;
+}
+
+ShardedOSegCache::Shard* ShardedOSegCache::shard(uint64 h) const {
+    // Shards use the high bits, slots within a shard use the low bits
+    if (mShardBits == 0) return mShards[0];
+    return mShards[h >> (64 - mShardBits)];
+}
+
+void ShardedOSegCache::insert(const UUID& uuid, const OSegEntry& sID) {
+    uint64 h = mixHash(uuid.hash());
+    Time expires = Time::null();
+    if (mEntryLifetime != Duration::zero())
+        expires = mContext->recentSimTime() + mEntryLifetime;
+    shard(h)->insert(uuid, h, sID, expires);
+}
+
+OSegEntry ShardedOSegCache::get(const UUID& uuid) {
+    uint64 h = mixHash(uuid.hash());
+    Time now = Time::null();
+    if (mEntryLifetime != Duration::zero())
+        now = mContext->recentSimTime();
+
+    OSegEntry result(OSegEntry::null());
+    shard(h)->get(uuid, h, now, &result);
+    return result;
+}
+
+void ShardedOSegCache::remove(const UUID& uuid) {
+    uint64 h = mixHash(uuid.hash());
+    shard(h)->remove(uuid, h);
+}
+
+uint32 ShardedOSegCache::size() {
+    uint32 result = 0;
+    for(std::vector<Shard*>::iterator it = mShards.begin(); it != mShards.end(); it++)
+        result += (*it)->size();
+    return result;
+}
+
+ShardedOSegCache::Stats ShardedOSegCache::stats() {
+    Stats result;
+    for(std::vector<Shard*>::iterator it = mShards.begin(); it != mShards.end(); it++)
+        result += (*it)->stats();
+    return result;
+}
+
+} // namespace Sirikata
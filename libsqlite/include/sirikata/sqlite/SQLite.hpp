@@ -37,19 +37,56 @@
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/tss.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <sqlite3.h>
 
 namespace Sirikata {
 
-/** Represents a SQLite database connection. */
+/** Represents a SQLite database connection.
+ *
+ *  Connections are opened in WAL mode with synchronous=NORMAL, so readers
+ *  don't block the writer or each other and commits only sync the log at
+ *  checkpoints. Read-only connections can't create the database and refuse
+ *  writes.
+ *
+ *  Each connection caches the statements prepared through prepare(), keyed by
+ *  their SQL text. Like the connection itself, the cached statements must only
+ *  be used by one thread at a time.
+ */
 class SIRIKATA_SQLITE_EXPORT SQLiteDB {
 public:
-    SQLiteDB(const String& name);
+    SQLiteDB(const String& name, bool readonly = false);
     ~SQLiteDB();
 
     sqlite3* db() const;
+    const String& name() const { return mName; }
+    bool readOnly() const { return mReadOnly; }
+
+    /** Get a prepared statement for sql, preparing and caching it the first
+     *  time it is requested. The statement is reset and its bindings cleared,
+     *  so it is ready to have parameters bound and be stepped.
+     *
+     *  The statement is owned by the connection: don't finalize it. Reset it
+     *  when you're done stepping so it doesn't hold on to locks.
+     *  \param sql the SQL text of a single statement
+     *  \param stmt set to the statement, or NULL if preparing it failed
+     *  \returns the result code from preparing the statement
+     */
+    int prepare(const String& sql, sqlite3_stmt** stmt);
+    /** Reset all cached statements, releasing any locks they hold. */
+    void resetStatements();
+    /** Finalize all cached statements. */
+    void clearStatements();
 private:
+    // Run a pragma, logging but otherwise ignoring failures
+    void pragma(const String& stmt);
+
+    typedef std::tr1::unordered_map<String, sqlite3_stmt*> StatementCache;
+
+    String mName;
+    bool mReadOnly;
     sqlite3* mObjectDB;
+    StatementCache mStatements;
 };
 
 typedef std::tr1::shared_ptr<SQLiteDB> SQLiteDBPtr;
@@ -70,6 +107,18 @@ public:
      *  \returns a shared ptr to the database connection
      */
     SQLiteDBPtr open(const String& name);
+    /** Get a read-only connection to a SQLite database from a pool shared by
+     *  all threads. Unlike open(), every reference returned while another is
+     *  still held is a separate connection, so readers on different threads
+     *  proceed in parallel with each other and with writers using open().
+     *  Discarding the reference returns the connection to the pool.
+     *
+     *  If the database doesn't exist yet there is nothing to read, so this
+     *  falls back to the read-write connection returned by open().
+     *  \param name the name of the database to open or connect to
+     *  \returns a shared ptr to the database connection
+     */
+    SQLiteDBPtr openReader(const String& name);
     // Check and report errors in SQLite. Returns true if there was an error,
     // false otherwise.
     static std::pair<bool, String> check_sql_error(sqlite3* db, int rc, char** sql_error_msg, const String& msg);
@@ -82,6 +131,23 @@ private:
     typedef boost::thread_specific_ptr<WeakSQLiteDBPtr> ThreadDBPtr;
     typedef std::map<String, std::tr1::shared_ptr<ThreadDBPtr> > DBMap;
 
+    // Idle read-only connections for one database. Connections handed out by
+    // openReader() hold a reference to their pool, so it can outlive this
+    // class if they are still in use.
+    struct ReaderPool {
+        ReaderPool(const String& _name) : name(_name) {}
+        ~ReaderPool();
+
+        // Return a connection to the pool, closing it if the pool is full
+        void release(SQLiteDB* db);
+
+        String name;
+        boost::mutex mutex;
+        std::vector<SQLiteDB*> idle;
+    };
+    typedef std::tr1::shared_ptr<ReaderPool> ReaderPoolPtr;
+    typedef std::map<String, ReaderPoolPtr> ReaderPoolMap;
+
     typedef boost::shared_mutex SharedMutex;
     typedef boost::shared_lock<SharedMutex> SharedLock;
     typedef boost::upgrade_lock<SharedMutex> UpgradeLock;
@@ -90,6 +156,9 @@ private:
 
     DBMap mDBs;
     SharedMutex mDBMutex;
+
+    ReaderPoolMap mReaderPools;
+    boost::mutex mReaderPoolMutex;
 };
 
 } // namespace Sirikata
@@ -101,18 +101,41 @@ const String& SQLite::resultAsString(int rc) {
     return rcStrings[-1];
 }
 
-SQLiteDB::SQLiteDB(const String& name) {
+SQLiteDB::SQLiteDB(const String& name, bool readonly)
+ : mName(name),
+   mReadOnly(readonly),
+   mObjectDB(NULL)
+{
     int rc;
 
-    rc = sqlite3_open( name.c_str(), &mObjectDB );
+    // Read-only connections are opened read-write, without permission to
+    // create the database, and then restricted with query_only. A connection
+    // opened with SQLITE_OPEN_READONLY can't recover the WAL index if no
+    // writer has the database open.
+    int flags = SQLITE_OPEN_READWRITE;
+    if (!readonly) flags |= SQLITE_OPEN_CREATE;
+    rc = sqlite3_open_v2( name.c_str(), &mObjectDB, flags, NULL );
     if (rc) {
         std::string errormsg = std::string("Couldn't open specified object DB: ") + String( sqlite3_errmsg(mObjectDB) );
         sqlite3_close(mObjectDB);
         throw std::runtime_error(errormsg);
     }
+
+    if (readonly) {
+        pragma("PRAGMA query_only = 1");
+    }
+    else {
+        // The journal mode is stored in the database, so this only has an
+        // effect the first time, but synchronous is per-connection. In WAL
+        // mode NORMAL can't corrupt the database, it only risks losing the
+        // most recent commits on power failure.
+        pragma("PRAGMA journal_mode = WAL");
+        pragma("PRAGMA synchronous = NORMAL");
+    }
 }
 
 SQLiteDB::~SQLiteDB() {
+    clearStatements();
     sqlite3_close(mObjectDB);
 }
 
@@ -120,6 +143,47 @@ sqlite3* SQLiteDB::db() const {
     return mObjectDB;
 }
 
+void SQLiteDB::pragma(const String& stmt) {
+    char* sql_error_msg = NULL;
+    int rc = sqlite3_exec(mObjectDB, stmt.c_str(), NULL, NULL, &sql_error_msg);
+    std::pair<bool, String> res = SQLite::check_sql_error(mObjectDB, rc, &sql_error_msg, "Error executing " + stmt + " on " + mName);
+    if (res.first)
+        SILOG(sqlite, warning, res.second);
+}
+
+int SQLiteDB::prepare(const String& sql, sqlite3_stmt** stmt) {
+    StatementCache::iterator it = mStatements.find(sql);
+    if (it != mStatements.end()) {
+        // The result of reset is the error from the last step, which the
+        // previous user already handled
+        sqlite3_reset(it->second);
+        sqlite3_clear_bindings(it->second);
+        *stmt = it->second;
+        return SQLITE_OK;
+    }
+
+    *stmt = NULL;
+    int rc = sqlite3_prepare_v2(mObjectDB, sql.c_str(), (int)sql.size() + 1, stmt, NULL);
+    if (rc != SQLITE_OK) {
+        if (*stmt != NULL) sqlite3_finalize(*stmt);
+        *stmt = NULL;
+        return rc;
+    }
+    mStatements[sql] = *stmt;
+    return rc;
+}
+
+void SQLiteDB::resetStatements() {
+    for(StatementCache::iterator it = mStatements.begin(); it != mStatements.end(); it++)
+        sqlite3_reset(it->second);
+}
+
+void SQLiteDB::clearStatements() {
+    for(StatementCache::iterator it = mStatements.begin(); it != mStatements.end(); it++)
+        sqlite3_finalize(it->second);
+    mStatements.clear();
+}
+
 namespace {
 boost::shared_mutex sSingletonMutex;
 }
@@ -191,4 +255,59 @@ SQLiteDBPtr SQLite::open(const String& name) {
     return db;
 }
 
+namespace {
+// Maximum number of idle read-only connections kept open per database
+const size_t MaxIdleReaders = 8;
+}
+
+SQLite::ReaderPool::~ReaderPool() {
+    for(std::vector<SQLiteDB*>::iterator it = idle.begin(); it != idle.end(); it++)
+        delete *it;
+    idle.clear();
+}
+
+void SQLite::ReaderPool::release(SQLiteDB* db) {
+    // Don't let a reader hold on to its last snapshot while idle
+    db->resetStatements();
+
+    boost::unique_lock<boost::mutex> lck(mutex);
+    if (idle.size() < MaxIdleReaders) {
+        idle.push_back(db);
+        return;
+    }
+    lck.unlock();
+    delete db;
+}
+
+SQLiteDBPtr SQLite::openReader(const String& name) {
+    ReaderPoolPtr pool;
+    {
+        boost::unique_lock<boost::mutex> lck(mReaderPoolMutex);
+        ReaderPoolMap::iterator it = mReaderPools.find(name);
+        if (it == mReaderPools.end())
+            it = mReaderPools.insert( ReaderPoolMap::value_type(name, ReaderPoolPtr(new ReaderPool(name))) ).first;
+        pool = it->second;
+    }
+
+    SQLiteDB* db = NULL;
+    {
+        boost::unique_lock<boost::mutex> lck(pool->mutex);
+        if (!pool->idle.empty()) {
+            db = pool->idle.back();
+            pool->idle.pop_back();
+        }
+    }
+
+    if (db == NULL) {
+        try {
+            db = new SQLiteDB(name, true);
+        }
+        catch(std::runtime_error&) {
+            return open(name);
+        }
+    }
+
+    return SQLiteDBPtr(db, std::tr1::bind(&ReaderPool::release, pool, std::tr1::placeholders::_1));
+}
+
 } // namespace Sirikata
@@ -218,6 +218,7 @@ void Object::handleSpaceConnectionIndirect(const SpaceID& space, const ObjectRef
 
     OBJ_LOG(insane,"Got space connection callback");
     mConnectedTo = sid;
+    mObjectFactory->notifyConnected(mID);
 
     // Always record our initial position, may be the only "update" we ever send
     const Time tnow = mContext->simTime();
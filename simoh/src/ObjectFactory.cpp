@@ -69,7 +69,8 @@ static UUID pack2UUID(const uint64 packid) {
 ObjectFactory::ObjectFactory(ObjectHostContext* ctx, const BoundingBox3f& region, const Duration& duration, double forceRadius, int forceNumRandomObjects)
  : Service(),
    mContext(ctx),
-   mLocalIDSource(0)
+   mLocalIDSource(0),
+   mStartTime(Time::null())
 {
     // Note: we do random second in order make sure they get later connect times
     generateRandomObjects(region, duration, forceRadius, forceNumRandomObjects);
@@ -417,6 +418,8 @@ Object* ObjectFactory::object(const UUID& id) {
 
 
 void ObjectFactory::start() {
+    mStartTime = mContext->simTime();
+
     for(ObjectInputsMap::iterator it = mInputs.begin(); it != mInputs.end(); it++) {
         UUID objid = it->first;
         ObjectInputs* inputs = it->second;
@@ -454,4 +457,16 @@ void ObjectFactory::notifyDestroyed(const UUID& id) {
     mObjects.erase(id);
 }
 
+void ObjectFactory::notifyConnected(const UUID& id) {
+    if (!mConnectedObjects.insert(id).second) return;
+    if (mConnectedObjects.size() != mInputs.size()) return;
+
+    Duration elapsed = mContext->simTime() - mStartTime;
+    SILOG(oh,info,"All " << mInputs.size() << " objects connected after " << elapsed);
+    mContext->timeSeries->report(
+        String("oh.server") + boost::lexical_cast<String>(mContext->id) + ".all_connected",
+        elapsed.toSeconds()
+    );
+}
+
 } // namespace Sirikata
@@ -94,12 +94,18 @@ private:
 
     friend class Object;
     void notifyDestroyed(const UUID& id); // called by objects when they are destroyed
+    void notifyConnected(const UUID& id); // called by objects when they first connect
 
     ObjectHostContext* mContext;
     uint32 mLocalIDSource;
     ObjectIDSet mObjectIDs;
     ObjectInputsMap mInputs;
     ObjectMap mObjects;
+
+    // Tracks how long it takes for all the objects to connect
+    Time mStartTime;
+    typedef std::tr1::unordered_set<UUID, UUID::Hasher> ConnectedObjectSet;
+    ConnectedObjectSet mConnectedObjects;
 }; // class ObjectFactory
 
 } // namespace Sirikata
@@ -0,0 +1,367 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "SLOScenario.hpp"
+#include "ScenarioFactory.hpp"
+#include "SimObjectHost.hpp"
+#include "Object.hpp"
+#include <sirikata/core/options/Options.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include "Options.hpp"
+#include "ConnectedObjectTracker.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+namespace Sirikata {
+
+void SLOInitOptions(SLOScenario *thus) {
+    Sirikata::InitializeClassOptions ico("SLOScenario",thus,
+        new OptionValue("initial-rate","100",Sirikata::OptionValueType<double>(),"Pings per second offered in the first step"),
+        new OptionValue("rate-factor","1.5",Sirikata::OptionValueType<double>(),"Factor the offered rate grows by after each step that meets the SLO"),
+        new OptionValue("max-rate","1000000",Sirikata::OptionValueType<double>(),"Stop searching once a step at this rate meets the SLO"),
+        new OptionValue("step-duration","10s",Sirikata::OptionValueType<Duration>(),"How long to offer load at each rate"),
+        new OptionValue("drain-duration","2s",Sirikata::OptionValueType<Duration>(),"How long to wait for outstanding pings after a step before counting them as lost"),
+        new OptionValue("refine-steps","4",Sirikata::OptionValueType<uint32>(),"Number of steps bisecting between the last passing and first failing rate"),
+        new OptionValue("percentile","99",Sirikata::OptionValueType<double>(),"Latency percentile the SLO applies to"),
+        new OptionValue("latency","50ms",Sirikata::OptionValueType<Duration>(),"Maximum latency at the given percentile"),
+        new OptionValue("loss","0.01",Sirikata::OptionValueType<double>(),"Maximum fraction of pings that may be lost, including those the object host refused to send"),
+        new OptionValue("ping-size","1024",Sirikata::OptionValueType<uint32>(),"Size of ping payloads.  Doesn't include any other fields in the ping or the object message headers."),
+        new OptionValue("max-outstanding","0",Sirikata::OptionValueType<uint32>(),"If non-zero, maximum number of pings in flight. Pings that would exceed it aren't sent and reduce the measured throughput."),
+        new OptionValue("label","",Sirikata::OptionValueType<String>(),"Name for this configuration, included in the summary"),
+        new OptionValue("summary","slo_summary.json",Sirikata::OptionValueType<String>(),"File to write the JSON summary to. Empty to only log results."),
+        new OptionValue("exit","true",Sirikata::OptionValueType<bool>(),"If true, shut down once the search finishes"),
+        NULL);
+}
+
+namespace {
+// Quote a string for the JSON summary
+String jsonString(const String& str) {
+    std::ostringstream out;
+    out << '"';
+    for(String::const_iterator it = str.begin(); it != str.end(); it++) {
+        unsigned char c = *it;
+        switch(c) {
+          case '"': out << "\\\""; break;
+          case '\\': out << "\\\\"; break;
+          case '\n': out << "\\n"; break;
+          case '\r': out << "\\r"; break;
+          case '\t': out << "\\t"; break;
+          default:
+            if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out << buf;
+            }
+            else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+}
+
+SLOScenario::StepResult::StepResult(double r)
+ : rate(r),
+   offered(0),
+   sent(0),
+   throttled(0),
+   received(0),
+   latencyPercentile(0),
+   lossFraction(0),
+   throughput(0),
+   passed(false)
+{
+}
+
+SLOScenario::SLOScenario(const String &options)
+ : mContext(NULL),
+   mObjectTracker(NULL),
+   mPingPoller(NULL),
+   mSending(false),
+   mStepStart(Time::epoch()),
+   mRefining(false),
+   mRefineStepsDone(0),
+   mBestPassingRate(0),
+   mLowestFailingRate(0),
+   mFinished(false)
+{
+    SLOInitOptions(this);
+    OptionSet* optionsSet = OptionSet::getOptions("SLOScenario",this);
+    optionsSet->parse(options);
+
+    mInitialRate = optionsSet->referenceOption("initial-rate")->as<double>();
+    mRateFactor = optionsSet->referenceOption("rate-factor")->as<double>();
+    mMaxRate = optionsSet->referenceOption("max-rate")->as<double>();
+    mStepDuration = optionsSet->referenceOption("step-duration")->as<Duration>();
+    mDrainDuration = optionsSet->referenceOption("drain-duration")->as<Duration>();
+    mRefineSteps = optionsSet->referenceOption("refine-steps")->as<uint32>();
+    mPercentile = optionsSet->referenceOption("percentile")->as<double>();
+    mLatencySLO = optionsSet->referenceOption("latency")->as<Duration>();
+    mLossSLO = optionsSet->referenceOption("loss")->as<double>();
+    mPingPayloadSize = optionsSet->referenceOption("ping-size")->as<uint32>();
+    mMaxOutstanding = optionsSet->referenceOption("max-outstanding")->as<uint32>();
+    mLabel = optionsSet->referenceOption("label")->as<String>();
+    mSummaryFile = optionsSet->referenceOption("summary")->as<String>();
+    mExitWhenDone = optionsSet->referenceOption("exit")->as<bool>();
+
+    if (mRateFactor <= 1.0) {
+        SILOG(slo,error,"rate-factor must be greater than 1, using 1.5");
+        mRateFactor = 1.5;
+    }
+}
+
+SLOScenario::~SLOScenario() {
+    if (mContext != NULL)
+        mContext->objectHost->unregisterService(OBJECT_PORT_PING);
+    delete mPingPoller;
+    delete mObjectTracker;
+}
+
+SLOScenario*SLOScenario::create(const String&options) {
+    return new SLOScenario(options);
+}
+void SLOScenario::addConstructorToFactory(ScenarioFactory*thus) {
+    thus->registerConstructor("slo",&SLOScenario::create);
+}
+
+void SLOScenario::initialize(ObjectHostContext*ctx) {
+    using std::tr1::placeholders::_1;
+
+    mContext = ctx;
+    mObjectTracker = new ConnectedObjectTracker(mContext->objectHost);
+    // Send in small bursts so the offered load is smooth even at high rates
+    mPingPoller = new Poller(
+        ctx->mainStrand,
+        std::tr1::bind(&SLOScenario::sendPings, this),
+        "SLOScenario Ping Poller",
+        Duration::milliseconds(5.0)
+    );
+    mContext->objectHost->registerService(OBJECT_PORT_PING, std::tr1::bind(&SLOScenario::handlePing, this, _1));
+}
+
+void SLOScenario::start() {
+    Duration connect_phase = GetOptionValue<Duration>(OBJECT_CONNECT_PHASE);
+    mContext->mainStrand->post(
+        connect_phase,
+        std::tr1::bind(&SLOScenario::delayedStart, this),
+        "SLOScenario::delayedStart"
+    );
+}
+
+void SLOScenario::delayedStart() {
+    startStep(mInitialRate);
+}
+
+void SLOScenario::stop() {
+    mPingPoller->stop();
+    mSending = false;
+    // Report whatever we found if we're stopped early
+    if (!mFinished && !mSteps.empty()) {
+        mFinished = true;
+        writeSummary();
+    }
+}
+
+void SLOScenario::startStep(double rate) {
+    if (mContext->stopped()) return;
+
+    mSteps.push_back(StepResult(rate));
+    mStepStart = mContext->simTime();
+    mSending = true;
+    mPingPoller->start();
+    mContext->mainStrand->post(
+        mStepDuration,
+        std::tr1::bind(&SLOScenario::endSendPhase, this),
+        "SLOScenario::endSendPhase"
+    );
+}
+
+void SLOScenario::sendPings() {
+    if (!mSending) return;
+
+    StepResult& step = mSteps.back();
+    uint32 step_idx = mSteps.size() - 1;
+
+    Time t = mContext->simTime();
+    int64 target = (int64)((t - mStepStart).toSeconds() * step.rate);
+    for(; step.offered < target; step.offered++) {
+        if (mMaxOutstanding > 0 && mOutstanding.size() >= mMaxOutstanding) {
+            step.throttled++;
+            continue;
+        }
+
+        Object* objA = mObjectTracker->randomObject();
+        Object* objB = mObjectTracker->randomObject();
+        if (objA == NULL || objB == NULL)
+            break;
+
+        Sirikata::Protocol::Object::Ping ping;
+        double dist = (objA->location().position(t) - objB->location().position(t)).length();
+        mContext->objectHost->fillPing(dist, mPingPayloadSize, &ping);
+        if (!mContext->objectHost->sendPing(t, objA->uuid(), objB->uuid(), &ping))
+            continue;
+
+        step.sent++;
+        OutstandingPing& outstanding = mOutstanding[ping.id()];
+        outstanding.sent = t;
+        outstanding.step = step_idx;
+    }
+}
+
+void SLOScenario::handlePing(const Sirikata::Protocol::Object::ObjectMessage& msg) {
+    Sirikata::Protocol::Object::Ping ping_msg;
+    ping_msg.ParseFromString(msg.payload());
+    if (!ping_msg.has_id()) return;
+
+    OutstandingPingMap::iterator it = mOutstanding.find(ping_msg.id());
+    // Pings from earlier steps have already been counted as lost
+    if (it == mOutstanding.end()) return;
+
+    StepResult& step = mSteps[it->second.step];
+    step.received++;
+    step.latencies.push_back((mContext->simTime() - it->second.sent).toSeconds());
+    mOutstanding.erase(it);
+}
+
+void SLOScenario::endSendPhase() {
+    mSending = false;
+    mPingPoller->stop();
+    mContext->mainStrand->post(
+        mDrainDuration,
+        std::tr1::bind(&SLOScenario::evaluateStep, this),
+        "SLOScenario::evaluateStep"
+    );
+}
+
+void SLOScenario::evaluateStep() {
+    if (mContext->stopped()) return;
+
+    StepResult& step = mSteps.back();
+    // Anything still outstanding missed its chance
+    mOutstanding.clear();
+
+    if (!step.latencies.empty()) {
+        std::vector<double>::size_type idx = (std::vector<double>::size_type)(step.latencies.size() * mPercentile / 100.0);
+        idx = std::min(idx, step.latencies.size() - 1);
+        std::nth_element(step.latencies.begin(), step.latencies.begin() + idx, step.latencies.end());
+        step.latencyPercentile = step.latencies[idx];
+    }
+    step.lossFraction = (step.offered > 0) ? ((double)(step.offered - step.received) / step.offered) : 1.0;
+    step.throughput = step.received / mStepDuration.toSeconds();
+    step.passed =
+        step.offered > 0 &&
+        !step.latencies.empty() &&
+        step.latencyPercentile <= mLatencySLO.toSeconds() &&
+        step.lossFraction <= mLossSLO;
+    // Free the samples, we only need the summary statistics from here on
+    std::vector<double>().swap(step.latencies);
+
+    SILOG(slo,info,
+        "Step " << mSteps.size() << ": offered " << step.rate << " pings/s," <<
+        " delivered " << step.throughput << " pings/s," <<
+        " p" << mPercentile << " latency " << step.latencyPercentile*1000 << "ms," <<
+        " loss " << step.lossFraction*100 << "%" <<
+        (step.passed ? " PASS" : " FAIL")
+    );
+
+    if (step.passed)
+        mBestPassingRate = std::max(mBestPassingRate, step.rate);
+    else if (mLowestFailingRate == 0 || step.rate < mLowestFailingRate)
+        mLowestFailingRate = step.rate;
+
+    if (!mRefining) {
+        if (step.passed) {
+            if (step.rate >= mMaxRate) {
+                finish();
+                return;
+            }
+            startStep(std::min(step.rate * mRateFactor, mMaxRate));
+            return;
+        }
+        // Nothing below this passed, so there's nothing to refine
+        if (mBestPassingRate == 0) {
+            finish();
+            return;
+        }
+        mRefining = true;
+    }
+    else {
+        mRefineStepsDone++;
+    }
+
+    if (mRefineStepsDone >= mRefineSteps) {
+        finish();
+        return;
+    }
+    startStep((mBestPassingRate + mLowestFailingRate) / 2);
+}
+
+void SLOScenario::finish() {
+    mFinished = true;
+    writeSummary();
+    if (mExitWhenDone)
+        mContext->shutdown();
+}
+
+void SLOScenario::writeSummary() {
+    // The best step is the passing step with the highest delivered throughput
+    const StepResult* best = NULL;
+    for(std::vector<StepResult>::const_iterator it = mSteps.begin(); it != mSteps.end(); it++) {
+        if (it->passed && (best == NULL || it->throughput > best->throughput))
+            best = &(*it);
+    }
+
+    SILOG(slo,info,
+        "SLO p" << mPercentile << " < " << mLatencySLO.toSeconds()*1000 << "ms, loss < " << mLossSLO*100 << "%: " <<
+        "max sustainable throughput " << (best ? best->throughput : 0) << " pings/s" <<
+        " at offered rate " << (best ? best->rate : 0) << " pings/s" <<
+        " (" << mSteps.size() << " steps)"
+    );
+
+    if (mSummaryFile.empty()) return;
+
+    std::ofstream summary(mSummaryFile.c_str(), std::ios::out | std::ios::trunc);
+    if (!summary) {
+        SILOG(slo,error,"Couldn't open " << mSummaryFile << " to write the SLO summary");
+        return;
+    }
+
+    summary << "{" << std::endl;
+    summary << "  \"label\": " << jsonString(mLabel) << "," << std::endl;
+    summary << "  \"config\": {"
+            << " \"servers\": " << mObjectTracker->numServerIDs() << ","
+            << " \"ping_size\": " << mPingPayloadSize << ","
+            << " \"max_outstanding\": " << mMaxOutstanding << ","
+            << " \"step_duration_s\": " << mStepDuration.toSeconds()
+            << " }," << std::endl;
+    summary << "  \"slo\": {"
+            << " \"percentile\": " << mPercentile << ","
+            << " \"latency_ms\": " << mLatencySLO.toSeconds()*1000 << ","
+            << " \"loss\": " << mLossSLO
+            << " }," << std::endl;
+    summary << "  \"max_sustainable_throughput\": " << (best ? best->throughput : 0) << "," << std::endl;
+    summary << "  \"max_sustainable_rate\": " << (best ? best->rate : 0) << "," << std::endl;
+    summary << "  \"steps\": [" << std::endl;
+    for(std::vector<StepResult>::size_type i = 0; i < mSteps.size(); i++) {
+        const StepResult& step = mSteps[i];
+        summary << "    {"
+                << " \"rate\": " << step.rate << ","
+                << " \"offered\": " << step.offered << ","
+                << " \"sent\": " << step.sent << ","
+                << " \"throttled\": " << step.throttled << ","
+                << " \"received\": " << step.received << ","
+                << " \"throughput\": " << step.throughput << ","
+                << " \"latency_ms\": " << step.latencyPercentile*1000 << ","
+                << " \"loss\": " << step.lossFraction << ","
+                << " \"passed\": " << (step.passed ? "true" : "false")
+                << " }" << (i+1 < mSteps.size() ? "," : "") << std::endl;
+    }
+    summary << "  ]" << std::endl;
+    summary << "}" << std::endl;
+}
+
+} // namespace Sirikata
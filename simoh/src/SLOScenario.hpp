@@ -0,0 +1,117 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SLO_SCENARIO_HPP_
+#define _SLO_SCENARIO_HPP_
+
+#include "Scenario.hpp"
+#include <sirikata/core/service/Poller.hpp>
+
+namespace Sirikata {
+
+class ScenarioFactory;
+class ConnectedObjectTracker;
+
+/** SLOScenario searches for the highest ping rate the system can sustain
+ *  while meeting a latency and loss service level objective, e.g. "99% of
+ *  pings delivered within 50ms and less than 1% lost".
+ *
+ *  Load is offered in steps. Each step sends pings between random local
+ *  objects at a fixed rate for step-duration, then waits drain-duration for
+ *  stragglers and checks the delivered pings against the SLO. The rate grows
+ *  by rate-factor after every passing step; after the first failing step the
+ *  scenario bisects between the last passing and first failing rate for
+ *  refine-steps more steps. The results of every step and the maximum
+ *  sustainable throughput are logged and written as JSON to the summary file.
+ *
+ *  Since the pings are sent and received by this object host, latencies are
+ *  one-way delivery times measured against a single clock.
+ */
+class SLOScenario : public Scenario {
+public:
+    SLOScenario(const String &options);
+    ~SLOScenario();
+    virtual void initialize(ObjectHostContext*);
+    void start();
+    void stop();
+    static void addConstructorToFactory(ScenarioFactory*);
+
+private:
+    static SLOScenario*create(const String&options);
+
+    struct StepResult {
+        StepResult(double r);
+
+        // Offered rate, in pings per second
+        double rate;
+        // Pings generated, i.e. the offered load
+        int64 offered;
+        // Pings accepted by the session manager
+        int64 sent;
+        // Pings that weren't sent because too many were outstanding
+        int64 throttled;
+        int64 received;
+        // Latencies of received pings, in seconds
+        std::vector<double> latencies;
+
+        double latencyPercentile;
+        double lossFraction;
+        double throughput;
+        bool passed;
+    };
+
+    struct OutstandingPing {
+        Time sent;
+        uint32 step;
+    };
+    typedef std::tr1::unordered_map<uint64, OutstandingPing> OutstandingPingMap;
+
+    void delayedStart();
+    void startStep(double rate);
+    void sendPings();
+    void endSendPhase();
+    void evaluateStep();
+    void finish();
+    void writeSummary();
+
+    void handlePing(const Sirikata::Protocol::Object::ObjectMessage& msg);
+
+    ObjectHostContext* mContext;
+    ConnectedObjectTracker* mObjectTracker;
+    Poller* mPingPoller;
+
+    // Configuration
+    double mInitialRate;
+    double mRateFactor;
+    double mMaxRate;
+    Duration mStepDuration;
+    Duration mDrainDuration;
+    uint32 mRefineSteps;
+    double mPercentile;
+    Duration mLatencySLO;
+    double mLossSLO;
+    uint32 mPingPayloadSize;
+    uint32 mMaxOutstanding;
+    String mLabel;
+    String mSummaryFile;
+    bool mExitWhenDone;
+
+    // State of the current step
+    std::vector<StepResult> mSteps;
+    bool mSending;
+    Time mStepStart;
+    OutstandingPingMap mOutstanding;
+
+    // Bounds for the search once a step has failed
+    bool mRefining;
+    uint32 mRefineStepsDone;
+    double mBestPassingRate;
+    double mLowestFailingRate;
+
+    bool mFinished;
+};
+
+} // namespace Sirikata
+
+#endif //_SLO_SCENARIO_HPP_
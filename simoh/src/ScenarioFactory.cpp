@@ -41,6 +41,7 @@
 #include "UnreliableHitPointScenario.hpp"
 #include "OSegScenario.hpp"
 #include "AirTrafficControllerScenario.hpp"
+#include "SLOScenario.hpp"
 AUTO_SINGLETON_INSTANCE(Sirikata::ScenarioFactory);
 namespace Sirikata {
 ScenarioFactory::ScenarioFactory(){
@@ -54,6 +55,7 @@ ScenarioFactory::ScenarioFactory(){
     HitPointScenario::addConstructorToFactory(this);
     UnreliableHitPointScenario::addConstructorToFactory(this);
     AirTrafficControllerScenario::addConstructorToFactory(this);
+    SLOScenario::addConstructorToFactory(this);
 }
 ScenarioFactory::~ScenarioFactory(){}
 ScenarioFactory&ScenarioFactory::getSingleton(){
@@ -111,6 +111,11 @@ void CoordinateSegmentationClient::accept_handler() {
   mLookupCache.clear();
   mTopLevelRegion.destroy();
   mServerRegionCache.clear();
+  if (!csegMessage.change_message().has_bsp_tree() ||
+      !mFlatTree.deserialize(csegMessage.change_message().bsp_tree()))
+  {
+    mFlatTree.clear();
+  }
   lock.unlock();
 
   std::map<ServerID, SegmentationInfo> segmentationInfoMap;
@@ -186,6 +191,34 @@ void CoordinateSegmentationClient::reportLoad(ServerID sid, const BoundingBox3f&
   readCSEGMessage(socket, csegMessage);
 }
 
+void CoordinateSegmentationClient::reportRegionLoad(ServerID sid, const BoundingBox3f& bbox, uint32 objectCount, float messageRate,
+                                                    const std::vector<uint32>& xHistogram, const std::vector<uint32>& yHistogram)
+{
+  Sirikata::Protocol::CSeg::CSegMessage csegMessage;
+
+  csegMessage.mutable_load_report_message().set_load_value(objectCount);
+  csegMessage.mutable_load_report_message().set_bbox(bbox);
+  csegMessage.mutable_load_report_message().set_server(sid);
+  csegMessage.mutable_load_report_message().set_object_count(objectCount);
+  csegMessage.mutable_load_report_message().set_message_rate(messageRate);
+  for (uint32 i = 0; i < xHistogram.size(); i++)
+    csegMessage.mutable_load_report_message().add_x_histogram(xHistogram[i]);
+  for (uint32 i = 0; i < yHistogram.size(); i++)
+    csegMessage.mutable_load_report_message().add_y_histogram(yHistogram[i]);
+
+  boost::mutex::scoped_lock scopedLock(mMutex);
+  boost::shared_ptr<TCPSocket> socket = getLeasedSocket();
+
+  if (socket == boost::shared_ptr<TCPSocket>()) {
+    std::cout << "Error connecting to CSEG server for load reporting\n";
+    return ;
+  }
+
+  writeCSEGMessage(socket, csegMessage);
+
+  readCSEGMessage(socket, csegMessage);
+}
+
 boost::shared_ptr<TCPSocket> CoordinateSegmentationClient::getLeasedSocket() {
   if (mLeasedSocket.get() != 0 && mLeasedSocket->is_open()) {
     return mLeasedSocket;
@@ -227,6 +260,10 @@ ServerID CoordinateSegmentationClient::lookup(const Vector3f& pos)  {
   {
     boost::mutex::scoped_lock cachelock(mCacheMutex);
 
+    ServerID flat_sid = mFlatTree.lookup(pos);
+    if (flat_sid != NullServerID)
+      return flat_sid;
+
     for (uint32 i=0 ; i<mLookupCache.size(); i++) {
       if (mLookupCache[i].bbox.contains(pos)) {
 
@@ -272,6 +309,19 @@ ServerID CoordinateSegmentationClient::lookup(const Vector3f& pos)  {
   return retval;
 }
 
+void CoordinateSegmentationClient::lookupBatch(const std::vector<Vector3f>& positions, std::vector<ServerID>* results) {
+  {
+    boost::mutex::scoped_lock cachelock(mCacheMutex);
+    mFlatTree.lookupBatch(positions, results);
+  }
+
+  // Anything the flat tree couldn't answer goes through the regular path
+  for (uint32 i=0; i < positions.size(); i++) {
+    if ((*results)[i] == NullServerID)
+      (*results)[i] = lookup(positions[i]);
+  }
+}
+
 BoundingBoxList CoordinateSegmentationClient::serverRegion(const ServerID& server)
 {
   boost::mutex::scoped_lock cachelock(mCacheMutex);
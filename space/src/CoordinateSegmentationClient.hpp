@@ -40,6 +40,7 @@
 #include <sirikata/core/network/Address4.hpp>
 #include <sirikata/space/CoordinateSegmentation.hpp>
 #include <sirikata/space/SegmentedRegion.hpp>
+#include <sirikata/space/FlatBSPTree.hpp>
 
 #include "Protocol_CSeg.pbj.hpp"
 
@@ -58,6 +59,7 @@ public:
     virtual ~CoordinateSegmentationClient();
 
     virtual ServerID lookup(const Vector3f& pos) ;
+    virtual void lookupBatch(const std::vector<Vector3f>& positions, std::vector<ServerID>* results);
     virtual BoundingBoxList serverRegion(const ServerID& server) ;
     virtual BoundingBox3f region() ;
     virtual uint32 numServers() ;
@@ -67,6 +69,8 @@ public:
     virtual void receiveMessage(Message* msg);
 
     virtual void reportLoad(ServerID, const BoundingBox3f& bbox, uint32 loadValue);
+    virtual void reportRegionLoad(ServerID sid, const BoundingBox3f& bbox, uint32 objectCount, float messageRate,
+                                  const std::vector<uint32>& xHistogram, const std::vector<uint32>& yHistogram);
 
     virtual void migrationHint( std::vector<ServerLoadInfo>& svrLoadInfo );
 
@@ -94,6 +98,9 @@ private:
 
     boost::mutex mCacheMutex;
     std::vector<LookupCacheEntry> mLookupCache;
+    // Copy of the segmentation pushed by the CSEG server with its last
+    // change notification. Leaves it couldn't resolve return NullServerID.
+    FlatBSPTree mFlatTree;
     uint16 mAvailableServersCount;
     std::map<ServerID, BoundingBoxList> mServerRegionCache;
     SegmentedRegion mTopLevelRegion;
@@ -540,6 +540,10 @@ bool Forwarder::tryCacheForward(Sirikata::Protocol::Object::ObjectMessage* msg)
     return true; // If we got here, the cache was successful, we just dropped it.
 }
 
+void Forwarder::invalidateOSegLookup(const UUID& obj_id) {
+    mOSegLookups->invalidate(obj_id);
+}
+
 void Forwarder::routeObjectMessageToServerNoReturn(Sirikata::Protocol::Object::ObjectMessage* obj_msg, const OSegEntry &dest_serv, OSegLookupQueue::ResolvedFrom resolved_from, ServerID forwardFrom) {
     (void) routeObjectMessageToServer(obj_msg, dest_serv, resolved_from, forwardFrom);
 }
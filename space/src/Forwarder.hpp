@@ -180,6 +180,10 @@ private:
     WARN_UNUSED
     bool tryCacheForward(Sirikata::Protocol::Object::ObjectMessage* msg);
 
+    // Used by Server when an object is added or migrates, so cached failed
+    // lookups for it don't keep it unroutable.
+    void invalidateOSegLookup(const UUID& obj_id);
+
     // -- Real routing interface + implementation
 
 
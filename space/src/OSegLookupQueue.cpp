@@ -34,6 +34,7 @@
 #include <sirikata/space/ObjectSegmentation.hpp>
 #include "Options.hpp"
 #include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/Timer.hpp>
 
 namespace Sirikata {
 
@@ -71,12 +72,27 @@ OSegLookupQueue::OSegLookupList::iterator OSegLookupQueue::OSegLookupList::end()
 OSegLookupQueue::OSegLookupQueue(Network::IOStrand* net_strand, ObjectSegmentation* oseg)
  : mNetworkStrand(net_strand),
    mOSeg(oseg),
-   mTotalSize(0)
+   mTotalSize(0),
+   mBatchTimerActive(false)
 {
     mMaxLookups = GetOptionValue<uint32>(OSEG_LOOKUP_QUEUE_SIZE);
+    mBatchWindow = GetOptionValue<Duration>(OSEG_LOOKUP_BATCH_WINDOW);
+    mMaxBatchSize = GetOptionValue<uint32>(OSEG_LOOKUP_BATCH_SIZE);
+    if (mMaxBatchSize == 0) mMaxBatchSize = 1;
+    mNegativeCacheLifetime = GetOptionValue<Duration>(OSEG_NEGATIVE_CACHE_LIFETIME);
+
+    mBatchTimer = Network::IOTimer::create(
+        mNetworkStrand,
+        std::tr1::bind(&OSegLookupQueue::flushBatch, this)
+    );
+
     mOSeg->setLookupListener(this);
 }
 
+OSegLookupQueue::~OSegLookupQueue() {
+    mBatchTimer->cancel();
+}
+
 OSegEntry OSegLookupQueue::cacheLookup(const UUID& destid) const {
     //if get a cache hit from oseg, do not return;
     return mOSeg->cacheLookup(destid);
@@ -110,6 +126,13 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
     return true;
   }
 
+  // If we just found out this object couldn't be found, don't ask again
+  if (negativeCacheLookup(dest_obj))
+  {
+    cb(msg, OSegEntry::null(), ResolvedFromCache);
+    return true;
+  }
+
   //if did not get a cache hit, check if have enough room to add it;
   if (mLookups.size() > mMaxLookups)
     return false;
@@ -120,12 +143,14 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
   if (mOSeg->getPushback() > MAX_OSEG_PUSHBACK_PARAMETER)
       return false;
 
-  //  otherwise, do full oseg lookup;
-  destServer = mOSeg->lookup(dest_obj);
-  // If we already have a server, handle the callback right away
-  if (destServer.notNull()) {
-    cb(msg, destServer, ResolvedFromCache);
-    return true;
+  if (mBatchWindow == Duration::zero()) {
+      //  otherwise, do full oseg lookup;
+      destServer = mOSeg->lookup(dest_obj);
+      // If we already have a server, handle the callback right away
+      if (destServer.notNull()) {
+          cb(msg, destServer, ResolvedFromCache);
+          return true;
+      }
   }
 
   // And if we do, stick it on a list and wait
@@ -135,9 +160,75 @@ bool OSegLookupQueue::lookup(Sirikata::Protocol::Object::ObjectMessage* msg, con
   lu.cb = cb;
   lu.size = cursize;
   mLookups[dest_obj].push_back(lu);
+
+  if (mBatchWindow != Duration::zero())
+      batchLookup(dest_obj);
+
   return true;
 }
 
+void OSegLookupQueue::batchLookup(const UUID& id) {
+    mBatch.push_back(id);
+
+    if (mBatch.size() >= mMaxBatchSize) {
+        flushBatch();
+        return;
+    }
+
+    if (!mBatchTimerActive) {
+        mBatchTimerActive = true;
+        mBatchTimer->wait(mBatchWindow);
+    }
+}
+
+void OSegLookupQueue::flushBatch() {
+    if (mBatchTimerActive) {
+        mBatchTimer->cancel();
+        mBatchTimerActive = false;
+    }
+
+    if (mBatch.empty()) return;
+
+    // Swap out the batch first since results may be reported synchronously
+    std::vector<UUID> batch;
+    batch.swap(mBatch);
+    mOSeg->lookupBatch(batch);
+}
+
+bool OSegLookupQueue::negativeCacheLookup(const UUID& id) {
+    if (mNegativeCache.empty()) return false;
+
+    expireNegativeCache(Timer::now());
+    return (mNegativeCache.find(id) != mNegativeCache.end());
+}
+
+void OSegLookupQueue::negativeCacheInsert(const UUID& id) {
+    if (mNegativeCacheLifetime == Duration::zero()) return;
+
+    Time t = Timer::now();
+    expireNegativeCache(t);
+
+    Time expires = t + mNegativeCacheLifetime;
+    mNegativeCache[id] = expires;
+    mNegativeCacheExpirations.push_back( std::make_pair(expires, id) );
+}
+
+void OSegLookupQueue::invalidate(const UUID& id) {
+    // Any queued expiration for the entry is skipped once it's gone
+    mNegativeCache.erase(id);
+}
+
+void OSegLookupQueue::expireNegativeCache(const Time& t) {
+    while(!mNegativeCacheExpirations.empty() && mNegativeCacheExpirations.front().first <= t) {
+        const UUID& id = mNegativeCacheExpirations.front().second;
+        // The entry may have been refreshed since this expiration was queued
+        NegativeCacheMap::iterator it = mNegativeCache.find(id);
+        if (it != mNegativeCache.end() && it->second <= t)
+            mNegativeCache.erase(it);
+        mNegativeCacheExpirations.pop_front();
+    }
+}
+
 void OSegLookupQueue::osegLookupCompleted(const UUID& id, const OSegEntry& dest) {
     mNetworkStrand->post(
         std::tr1::bind(&OSegLookupQueue::handleLookupCompleted, this, id, dest),
@@ -151,6 +242,9 @@ void OSegLookupQueue::handleLookupCompleted(const UUID& id, const OSegEntry& des
     if (iterQueueMap == mLookups.end())
         return;
 
+    if (dest.isNull())
+        negativeCacheInsert(id);
+
     for (int s=0; s < (signed) ((iterQueueMap->second).size()); ++ s) {
         const OSegLookup& lu = (iterQueueMap->second[s]);
         mTotalSize -= lu.size;
@@ -36,6 +36,7 @@
 #include <sirikata/core/util/Platform.hpp>
 #include <sirikata/space/ServerMessage.hpp>
 #include <sirikata/space/ObjectSegmentation.hpp>
+#include <sirikata/core/network/IOTimer.hpp>
 
 namespace Sirikata {
 
@@ -44,6 +45,12 @@ namespace Sirikata {
  *  The user can specify a policy for how these rejections occur, e.g. based
  *  on a total number of outstanding lookups, a total number of bytes in messages
  *  for outstanding lookups, etc.
+ *
+ *  Lookups for new objects can be collected over a short window and submitted
+ *  to the ObjectSegmentation as a single batch, allowing it to use multi-key
+ *  requests to its backing store. Lookups which resolve to no server are
+ *  remembered for a short period so repeated requests for missing or
+ *  migrating objects don't each cost a round trip.
  */
 class OSegLookupQueue : public OSegLookupListener {
 public:
@@ -82,6 +89,11 @@ private:
 
     typedef std::tr1::unordered_map<UUID, OSegLookupList, UUID::Hasher> LookupMap;
 
+    // Negative cache entries, with a queue in expiration order. Since all
+    // entries have the same lifetime, insertion order is expiration order.
+    typedef std::tr1::unordered_map<UUID, Time, UUID::Hasher> NegativeCacheMap;
+    typedef std::deque< std::pair<Time, UUID> > NegativeCacheExpirationQueue;
+
 
     Network::IOStrand* mNetworkStrand;
     ObjectSegmentation* mOSeg; // The OSeg that does the heavy lifting
@@ -91,6 +103,32 @@ private:
     uint32 mMaxLookups; // Total number of unique OSeg lookups (i.e. number of
                         // UUIDs, not number of requests).
 
+    // Batching of lookups sent to the OSeg. A zero window disables batching
+    // and lookups are passed through immediately.
+    Duration mBatchWindow;
+    uint32 mMaxBatchSize;
+    std::vector<UUID> mBatch; // Accepted lookups not yet submitted to the OSeg
+    Network::IOTimerPtr mBatchTimer;
+    bool mBatchTimerActive;
+
+    // Negative caching of lookups which resolved to no server. A zero lifetime
+    // disables the negative cache.
+    Duration mNegativeCacheLifetime;
+    NegativeCacheMap mNegativeCache;
+    NegativeCacheExpirationQueue mNegativeCacheExpirations;
+
+    // Queue a lookup to be sent in the next batch, flushing immediately if the
+    // batch is full.
+    void batchLookup(const UUID& id);
+    // Submit all queued lookups to the OSeg
+    void flushBatch();
+
+    // Returns true if the object is known to have recently resolved to no
+    // server.
+    bool negativeCacheLookup(const UUID& id);
+    void negativeCacheInsert(const UUID& id);
+    void expireNegativeCache(const Time& t);
+
     /* OSegLookupListener Interface */
     virtual void osegLookupCompleted(const UUID& id, const OSegEntry& dest);
     /* Main thread handler for lookups. */
@@ -104,7 +142,7 @@ public:
      */
     OSegLookupQueue(Network::IOStrand* net_strand, ObjectSegmentation* oseg);
 
-    virtual ~OSegLookupQueue() {}
+    virtual ~OSegLookupQueue();
 
     /** Perform an OSeg cache lookup, returning the ServerID or NullServerID if
      *  the cache doesn't contain an entry for the object.
@@ -120,6 +158,11 @@ public:
      *  \returns true if the lookup was accepted, false if it was rejected (due to the push predicate).
      */
     bool lookup(Sirikata::Protocol::Object::ObjectMessage* msg, const LookupCallback& cb);
+
+    /** Forget any negative result for the object, e.g. because it just
+     *  connected to or migrated to or from this server.
+     */
+    void invalidate(const UUID& id);
 };
 
 } // namespace Sirikata
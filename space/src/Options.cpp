@@ -64,16 +64,23 @@ void InitSpaceOptions() {
         .addOption(new OptionValue(OSEG_OPTIONS,"",Sirikata::OptionValueType<String>(),"Specifies arguments to OSeg."))
 
         .addOption(new OptionValue(OSEG_LOOKUP_QUEUE_SIZE, "2000", Sirikata::OptionValueType<uint32>(), "Number of new lookups you can have on oseg lookup queue."))
+        .addOption(new OptionValue(OSEG_LOOKUP_BATCH_WINDOW, "0s", Sirikata::OptionValueType<Duration>(), "Time to collect new OSeg lookups before submitting them together as a batch. Batching adds up to this much latency to each lookup. 0s disables batching."))
+        .addOption(new OptionValue(OSEG_LOOKUP_BATCH_SIZE, "128", Sirikata::OptionValueType<uint32>(), "Maximum number of OSeg lookups submitted in a single batch."))
+        .addOption(new OptionValue(OSEG_NEGATIVE_CACHE_LIFETIME, "100ms", Sirikata::OptionValueType<Duration>(), "How long to remember that an object couldn't be found by OSeg before looking it up again. 0s disables negative caching."))
 
         .addOption(new OptionValue(OSEG_CACHE_SIZE, "200", Sirikata::OptionValueType<uint32>(), "Maximum number of entries in the OSeg cache."))
 
-        .addOption(new OptionValue(CACHE_SELECTOR,CACHE_TYPE_ORIGINAL_LRU,Sirikata::OptionValueType<String>(),"Which caching algorithm to use."))
+        .addOption(new OptionValue(CACHE_SELECTOR,CACHE_TYPE_SHARDED,Sirikata::OptionValueType<String>(),"Which caching algorithm to use."))
 
          .addOption(new OptionValue(CACHE_COMM_SCALING,"1.0",Sirikata::OptionValueType<double>(),"What the communication falloff function scaling factor is."))
          .addOption(new OptionValue("send-capacity-overestimate","80000",Sirikata::OptionValueType<double>(),"How much to overestimate send capacity when queue is not blocked."))
          .addOption(new OptionValue("receive-capacity-overestimate","1",Sirikata::OptionValueType<double>(),"How much to overestimate recv capacity when queue is not blocked."))
         .addOption(new OptionValue(OSEG_CACHE_CLEAN_GROUP_SIZE, "25", Sirikata::OptionValueType<uint32>(), "Number of items to remove from the OSeg cache when it reaches the maximum size."))
         .addOption(new OptionValue(OSEG_CACHE_ENTRY_LIFETIME, "8s", Sirikata::OptionValueType<Duration>(), "Maximum lifetime for an OSeg cache entry."))
+        .addOption(new OptionValue(OSEG_CACHE_SHARDS, "16", Sirikata::OptionValueType<uint32>(), "Number of independently locked shards in the sharded OSeg cache."))
+
+        .addOption(new OptionValue(LOAD_REPORT_REGION, "false", Sirikata::OptionValueType<bool>(), "If true, periodically report object counts, message rates and object distribution for this server's regions to the CSEG server for load balancing."))
+        .addOption(new OptionValue(LOAD_REPORT_BINS, "16", Sirikata::OptionValueType<uint32>(), "Number of histogram bins per axis used to describe the object distribution in region load reports."))
 
         .addOption(new OptionValue(CSEG, "uniform", Sirikata::OptionValueType<String>(), "Type of Coordinate Segmentation implementation to use."))
         .addOption(new OptionValue("cseg-service-host", "meru00", Sirikata::OptionValueType<String>(), "Hostname of machine running the CSEG service (running with --cseg=distributed)"))
@@ -107,4 +114,18 @@ void InitSpaceOptions() {
       ;
 }
 
+void InitSpaceReplayOptions() {
+    InitializeClassOptions::module(SIRIKATA_OPTIONS_MODULE)
+
+        .addOption(new OptionValue(OPT_REPLAY_TRACE, "", Sirikata::OptionValueType<String>(), "Trace of session events, location updates and object messages to replay. If empty, a synthetic trace is generated from the other replay options."))
+        .addOption(new OptionValue(OPT_REPLAY_OBJECTS, "1000", Sirikata::OptionValueType<uint32>(), "Number of objects in the synthetic trace."))
+        .addOption(new OptionValue(OPT_REPLAY_DURATION, "60s", Sirikata::OptionValueType<Duration>(), "Length of the synthetic trace, in trace time."))
+        .addOption(new OptionValue(OPT_REPLAY_LOC_RATE, "1", Sirikata::OptionValueType<double>(), "Location updates per second per object in the synthetic trace."))
+        .addOption(new OptionValue(OPT_REPLAY_MESSAGE_RATE, "5", Sirikata::OptionValueType<double>(), "Object messages per second per object in the synthetic trace."))
+        .addOption(new OptionValue(OPT_REPLAY_MESSAGE_SIZE, "64", Sirikata::OptionValueType<uint32>(), "Payload size of object messages in the synthetic trace."))
+        .addOption(new OptionValue(OPT_REPLAY_QUERY_ANGLE, "0", Sirikata::OptionValueType<float>(), "Solid angle of the proximity query registered by synthetic objects. 0 registers no query."))
+        .addOption(new OptionValue(OPT_REPLAY_SEED, "1", Sirikata::OptionValueType<uint32>(), "Seed for generating the synthetic trace."))
+      ;
+}
+
 } // namespace Sirikata
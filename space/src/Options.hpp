@@ -60,10 +60,15 @@
 #define OSEG_CACHE_SIZE              "oseg-cache-size"
 #define OSEG_CACHE_CLEAN_GROUP_SIZE  "oseg-cache-clean-group-size"
 #define OSEG_CACHE_ENTRY_LIFETIME    "oseg-cache-entry-lifetime"
+#define OSEG_CACHE_SHARDS            "oseg-cache-shards"
+
+#define LOAD_REPORT_REGION          "report-region-load"
+#define LOAD_REPORT_BINS            "load-report-bins"
 
 #define CACHE_SELECTOR              "oseg-cache-selector"
 #define CACHE_TYPE_COMMUNICATION    "cache_communication"
 #define CACHE_TYPE_ORIGINAL_LRU     "cache_originallru"
+#define CACHE_TYPE_SHARDED          "cache_sharded"
 
 
 #define CACHE_COMM_SCALING          "oseg-cache-scaling"
@@ -72,6 +77,9 @@
 #define FORWARDER_RECEIVE_QUEUE_SIZE "forwarder.receive-queue-size"
 
 #define OSEG_LOOKUP_QUEUE_SIZE     "oseg_lookup_queue_size"
+#define OSEG_LOOKUP_BATCH_WINDOW   "oseg-lookup-batch-window"
+#define OSEG_LOOKUP_BATCH_SIZE     "oseg-lookup-batch-size"
+#define OSEG_NEGATIVE_CACHE_LIFETIME "oseg-negative-cache-lifetime"
 
 #define OPT_PROX                   "prox"
 #define OPT_PROX_OPTIONS           "prox-options"
@@ -87,9 +95,20 @@
 #define OPT_AGGMGR_ACCESS_SECRET     "aggmgr.access-secret"
 #define OPT_AGGMGR_USERNAME          "aggmgr.username"
 
+#define OPT_REPLAY_TRACE             "replay.trace"
+#define OPT_REPLAY_OBJECTS           "replay.objects"
+#define OPT_REPLAY_DURATION          "replay.duration"
+#define OPT_REPLAY_LOC_RATE          "replay.loc-rate"
+#define OPT_REPLAY_MESSAGE_RATE      "replay.message-rate"
+#define OPT_REPLAY_MESSAGE_SIZE      "replay.message-size"
+#define OPT_REPLAY_QUERY_ANGLE       "replay.query-angle"
+#define OPT_REPLAY_SEED              "replay.seed"
+
 namespace Sirikata {
 
 void InitSpaceOptions();
+// Additional options for the space-replay harness
+void InitSpaceReplayOptions();
 
 } // namespace Sirikata
 
@@ -0,0 +1,269 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// space-replay builds the same pipeline as the space server -- Server,
+// Forwarder, LocationService, Proximity and OSeg -- for a single server and
+// drives it with a recorded or synthetic trace instead of real object hosts.
+// See ServerReplay for the trace format.
+
+#include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/util/AtomicTypes.hpp>
+#include <sirikata/core/network/IOStrandImpl.hpp>
+#include <sirikata/space/ObjectHostSession.hpp>
+#include <sirikata/space/ObjectSessionManager.hpp>
+#include <sirikata/space/Authenticator.hpp>
+#include <sirikata/space/SpaceNetwork.hpp>
+#include "Forwarder.hpp"
+#include <sirikata/space/LocationService.hpp>
+#include <sirikata/space/Proximity.hpp>
+#include <sirikata/space/AggregateManager.hpp>
+#include "Server.hpp"
+#include "ServerReplay.hpp"
+#include "Options.hpp"
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/PluginManager.hpp>
+#include <sirikata/core/trace/Trace.hpp>
+#include "TCPSpaceNetwork.hpp"
+#include "FairServerMessageReceiver.hpp"
+#include "FairServerMessageQueue.hpp"
+#include "UniformCoordinateSegmentation.hpp"
+#include <sirikata/space/ObjectSegmentation.hpp>
+#include <sirikata/space/ShardedOSegCache.hpp>
+#include <sirikata/space/SpaceContext.hpp>
+#include <sirikata/mesh/Filter.hpp>
+#include <sirikata/mesh/ModelsSystemFactory.hpp>
+
+#include <new>
+#include <cstdlib>
+
+// Count every allocation made by the process. The replay reports the
+// allocations made while each stage runs, so these are process-wide counts:
+// allocations made by other threads in the meantime, e.g. by the logger or
+// the trace writer, are included in the stage they overlap.
+namespace {
+Sirikata::AtomicValue<Sirikata::int64> gAllocations(0);
+
+Sirikata::int64 allocationCount() {
+    return gAllocations.read();
+}
+
+void* countedAlloc(size_t sz) {
+    ++gAllocations;
+    void* ptr = malloc(sz > 0 ? sz : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+}
+
+void* operator new(size_t sz) {
+    return countedAlloc(sz);
+}
+void* operator new[](size_t sz) {
+    return countedAlloc(sz);
+}
+void operator delete(void* ptr) {
+    free(ptr);
+}
+void operator delete[](void* ptr) {
+    free(ptr);
+}
+
+int main(int argc, char** argv) {
+
+    using namespace Sirikata;
+
+    DynamicLibrary::Initialize();
+
+    InitOptions();
+    Trace::Trace::InitOptions();
+    SpaceTrace::InitOptions();
+    InitSpaceOptions();
+    InitSpaceReplayOptions();
+    ParseOptions(argc, argv, OPT_CONFIG_FILE);
+
+    PluginManager plugins;
+    plugins.loadList( GetOptionValue<String>(OPT_PLUGINS) );
+    plugins.loadList( GetOptionValue<String>(OPT_EXTRA_PLUGINS) );
+    plugins.loadList( GetOptionValue<String>(OPT_SPACE_PLUGINS) );
+    plugins.loadList( GetOptionValue<String>(OPT_SPACE_EXTRA_PLUGINS) );
+
+    FillMissingOptionDefaults();
+    ParseOptions(argc, argv, OPT_CONFIG_FILE);
+
+    ReportVersion(); // After options so log goes to the right place
+
+    ServerID server_id = GetOptionValue<ServerID>("id");
+    String trace_file = GetPerServerFile(STATS_TRACE_FILE, server_id);
+    Sirikata::Trace::Trace* gTrace = new Trace::Trace(trace_file);
+
+    // Simulation time is driven by the trace, starting from the epoch
+    Time start_time = Timer::now();
+
+    Network::IOService* ios = new Network::IOService("Space Replay");
+    Network::IOStrand* mainStrand = ios->createStrand("Space Replay Main");
+
+    ODPSST::ConnectionManager* sstConnMgr = new ODPSST::ConnectionManager();
+    OHDPSST::ConnectionManager* ohSstConnMgr = new OHDPSST::ConnectionManager();
+
+    SpaceContext* space_context = new SpaceContext("space", server_id, sstConnMgr, ohSstConnMgr, ios, mainStrand, start_time, gTrace);
+    space_context->useVirtualSimTime(Time::null());
+    space_context->add(space_context);
+
+    String timeseries_type = GetOptionValue<String>(OPT_TRACE_TIMESERIES);
+    String timeseries_options = GetOptionValue<String>(OPT_TRACE_TIMESERIES_OPTIONS);
+    Trace::TimeSeries* time_series = Trace::TimeSeriesFactory::getSingleton().getConstructor(timeseries_type)(space_context, timeseries_options);
+
+    // With a single server nothing is sent between servers, so the network is
+    // only needed to construct the server queues and is never started.
+    Sirikata::SpaceNetwork* gNetwork = new TCPSpaceNetwork(space_context);
+
+    BoundingBox3f region = GetOptionValue<BoundingBox3f>("region");
+    Vector3ui32 layout = GetOptionValue<Vector3ui32>("layout");
+
+    ObjectHostSessionManager* oh_sess_mgr = new ObjectHostSessionManager(space_context);
+    ObjectSessionManager* obj_sess_mgr = new ObjectSessionManager(space_context);
+
+    String auth_type = GetOptionValue<String>(SPACE_OPT_AUTH);
+    String auth_opts = GetOptionValue<String>(SPACE_OPT_AUTH_OPTIONS);
+    Authenticator* auth =
+        AuthenticatorFactory::getSingleton().getConstructor(auth_type)(space_context, auth_opts);
+
+    Forwarder* forwarder = new Forwarder(space_context);
+
+    CoordinateSegmentation* cseg = new UniformCoordinateSegmentation(space_context, region, layout);
+
+    String loc_update_type = GetOptionValue<String>(LOC_UPDATE);
+    String loc_update_opts = GetOptionValue<String>(LOC_UPDATE_OPTIONS);
+    LocationUpdatePolicy* loc_update_policy =
+        LocationUpdatePolicyFactory::getSingleton().getConstructor(loc_update_type)(space_context, loc_update_opts);
+
+    String loc_service_type = GetOptionValue<String>(LOC);
+    String loc_service_opts = GetOptionValue<String>(LOC_OPTIONS);
+    LocationService* loc_service =
+        LocationServiceFactory::getSingleton().getConstructor(loc_service_type)(space_context, loc_update_policy, loc_service_opts);
+
+    ServerMessageQueue* sq = new FairServerMessageQueue(
+        space_context, gNetwork,
+        (ServerMessageQueue::Sender*)forwarder);
+    ServerMessageReceiver* server_message_receiver =
+        new FairServerMessageReceiver(space_context, gNetwork, (ServerMessageReceiver::Listener*)forwarder);
+
+    // The OSeg type defaults to local, which keeps the whole mapping in
+    // process
+    OSegCache* oseg_cache = new ShardedOSegCache(
+        space_context,
+        GetOptionValue<uint32>(OSEG_CACHE_SIZE),
+        GetOptionValue<uint32>(OSEG_CACHE_SHARDS),
+        GetOptionValue<Duration>(OSEG_CACHE_ENTRY_LIFETIME)
+    );
+    std::string oseg_type = GetOptionValue<String>(OSEG);
+    std::string oseg_options = GetOptionValue<String>(OSEG_OPTIONS);
+    Network::IOStrand* osegStrand = space_context->ioService->createStrand("OSeg");
+    ObjectSegmentation* oseg =
+        OSegFactory::getSingleton().getConstructor(oseg_type)(space_context, osegStrand, cseg, oseg_cache, oseg_options);
+
+    forwarder->initialize(oseg, sq, server_message_receiver, loc_service);
+
+    AggregateManager* aggmgr = new AggregateManager(loc_service, Transfer::OAuthParamsPtr(), "");
+
+    std::string prox_type = GetOptionValue<String>(OPT_PROX);
+    std::string prox_options = GetOptionValue<String>(OPT_PROX_OPTIONS);
+    Proximity* prox = ProximityFactory::getSingleton().getConstructor(prox_type)(space_context, loc_service, cseg, gNetwork, aggmgr, prox_options);
+
+    // Object hosts never connect over the network, but the server still
+    // listens, so use an ephemeral local port.
+    Address4 listen_addr(Sirikata::Network::Address("127.0.0.1", "0"));
+    Server* server = new Server(space_context, auth, forwarder, loc_service, cseg, prox, oseg, listen_addr, oh_sess_mgr, obj_sess_mgr);
+    space_context->add(server);
+
+    space_context->add(auth);
+    space_context->add(cseg);
+    space_context->add(loc_service);
+    space_context->add(oseg);
+    space_context->add(prox);
+
+    {
+        ServerReplay replay(space_context, server, loc_service, std::tr1::bind(&allocationCount));
+
+        String replay_trace = GetOptionValue<String>(OPT_REPLAY_TRACE);
+        bool loaded = true;
+        if (!replay_trace.empty()) {
+            loaded = replay.loadTrace(replay_trace);
+        }
+        else {
+            replay.generateTrace(
+                cseg->serverRegion(server_id)[0],
+                GetOptionValue<uint32>(OPT_REPLAY_OBJECTS),
+                GetOptionValue<Duration>(OPT_REPLAY_DURATION),
+                GetOptionValue<double>(OPT_REPLAY_LOC_RATE),
+                GetOptionValue<double>(OPT_REPLAY_MESSAGE_RATE),
+                GetOptionValue<uint32>(OPT_REPLAY_MESSAGE_SIZE),
+                GetOptionValue<float>(OPT_REPLAY_QUERY_ANGLE),
+                GetOptionValue<uint32>(OPT_REPLAY_SEED)
+            );
+        }
+
+        if (loaded)
+            replay.run();
+    }
+
+    // Stop all the services and let them finish up on this thread
+    space_context->shutdown();
+    ios->reset();
+    while(ios->poll() > 0)
+        ios->reset();
+    space_context->cleanup();
+
+    if (GetOptionValue<bool>(PROFILE)) {
+        space_context->profiler->report();
+    }
+
+    gTrace->prepareShutdown();
+    Mesh::FilterFactory::destroy();
+    ModelsSystemFactory::destroy();
+    LocationServiceFactory::destroy();
+    LocationUpdatePolicyFactory::destroy();
+
+    delete server;
+    delete sq;
+    delete server_message_receiver;
+    delete prox;
+    delete aggmgr;
+
+    delete cseg;
+    delete oseg;
+    delete oseg_cache;
+    delete loc_service;
+    delete forwarder;
+
+    delete obj_sess_mgr;
+    delete oh_sess_mgr;
+
+    delete gNetwork;
+    gNetwork=NULL;
+
+    gTrace->shutdown();
+    delete gTrace;
+    gTrace = NULL;
+
+    delete space_context;
+    space_context = NULL;
+
+    delete time_series;
+
+    delete mainStrand;
+    delete osegStrand;
+
+    delete ios;
+
+    delete sstConnMgr;
+    delete ohSstConnMgr;
+
+    plugins.gc();
+
+    Sirikata::Logging::finishLog();
+
+    return 0;
+}
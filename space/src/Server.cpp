@@ -32,6 +32,7 @@
 
 #include <sirikata/space/SpaceNetwork.hpp>
 #include "Server.hpp"
+#include "Protocol_SessionBatch.pbj.hpp"
 #include <sirikata/space/Proximity.hpp>
 #include <sirikata/space/CoordinateSegmentation.hpp>
 #include <sirikata/space/ServerMessage.hpp>
@@ -93,6 +94,7 @@ Server::Server(SpaceContext* ctx, Authenticator* auth, Forwarder* forwarder, Loc
    mMigrationSendRunning(false),
    mShutdownRequested(false),
    mObjectHostConnectionManager(NULL),
+   mSessionBatchSize(GetOptionValue<uint32>(OPT_OH_SESSION_BATCH)),
    mRouteObjectMessage(Sirikata::SizedResourceMonitor(GetOptionValue<size_t>("route-object-message-buffer"))),
    mTimeSeriesObjects(String("space.server") + boost::lexical_cast<String>(ctx->id()) + ".objects")
 {
@@ -292,6 +294,26 @@ bool Server::isObjectConnecting(const UUID& object_id) const {
 }
 
 void Server::sendSessionMessageWithRetry(const ObjectHostConnectionID& conn, Sirikata::Protocol::Object::ObjectMessage* msg, const Duration& retry_rate) {
+    // If the object host batches its requests, batch the replies as well. The
+    // connection must be checked first since the short ID isn't available
+    // once it's gone.
+    SessionBatchQueueMap::iterator batch_it = mSessionBatchQueues.end();
+    if (!mSessionBatchQueues.empty() && mObjectHostConnectionManager->validConnection(conn))
+        batch_it = mSessionBatchQueues.find(conn.shortID());
+    if (batch_it != mSessionBatchQueues.end() && batch_it->second.conn_id == conn) {
+        SessionBatchQueue& queue = batch_it->second;
+        queue.messages.push_back( std::make_pair(msg->dest_object(), msg->payload()) );
+        delete msg;
+        if (!queue.flushScheduled) {
+            queue.flushScheduled = true;
+            mContext->mainStrand->post(
+                std::tr1::bind(&Server::flushSessionBatch, this, batch_it->first),
+                "Server::flushSessionBatch"
+            );
+        }
+        return;
+    }
+
     bool sent = mObjectHostConnectionManager->send( conn, msg );
     if (!sent) {
         // It's possible we failed due to disconnection, don't keep retrying in
@@ -338,6 +360,18 @@ bool Server::onObjectHostMessageReceived(const ObjectHostConnectionID& conn_id,
         );
         return true;
     }
+    // Batches of session messages from the object host itself get the same
+    // treatment, and are unpacked in the main strand
+    if (obj_msg->dest_port() == OBJECT_PORT_SESSION_BATCH && obj_msg->dest_object() == spaceID) {
+        mContext->mainStrand->post(
+            std::tr1::bind(
+                &Server::handleSessionBatch, this,
+                conn_id, obj_msg
+            ),
+            "Server::handleSessionBatch"
+        );
+        return true;
+    }
 
     // 3. Try to shortcut the main thread. Let the LocalForwarder try
     // to ship it over a connection.  This checks both the source
@@ -486,6 +520,92 @@ bool Server::handleSingleObjectHostMessageRouting() {
     return true;
 }
 
+void Server::flushSessionBatch(ShortObjectHostConnectionID short_conn_id) {
+    SessionBatchQueueMap::iterator batch_it = mSessionBatchQueues.find(short_conn_id);
+    if (batch_it == mSessionBatchQueues.end())
+        return;
+    SessionBatchQueue& queue = batch_it->second;
+    queue.flushScheduled = false;
+
+    // Don't keep retrying after a disconnection
+    if (!mObjectHostConnectionManager->validConnection(queue.conn_id)) {
+        mSessionBatchQueues.erase(batch_it);
+        return;
+    }
+
+    while(!queue.messages.empty()) {
+        uint32 count = std::min((uint32)queue.messages.size(), mSessionBatchSize);
+
+        Sirikata::Protocol::Object::ObjectMessage* obj_msg = NULL;
+        if (count == 1) {
+            obj_msg = createObjectMessage(
+                mContext->id(),
+                UUID::null(), OBJECT_PORT_SESSION,
+                queue.messages.front().first, OBJECT_PORT_SESSION,
+                queue.messages.front().second
+            );
+        }
+        else {
+            Sirikata::Protocol::SessionBatch::SessionBatch batch;
+            for(uint32 i = 0; i < count; i++) {
+                batch.add_object(queue.messages[i].first);
+                batch.add_session(queue.messages[i].second);
+            }
+            obj_msg = createObjectMessage(
+                mContext->id(),
+                UUID::null(), OBJECT_PORT_SESSION_BATCH,
+                UUID::null(), OBJECT_PORT_SESSION_BATCH,
+                serializePBJMessage(batch)
+            );
+        }
+
+        if (!mObjectHostConnectionManager->send(queue.conn_id, obj_msg)) {
+            delete obj_msg;
+            queue.flushScheduled = true;
+            mContext->mainStrand->post(
+                Duration::seconds(0.05),
+                std::tr1::bind(&Server::flushSessionBatch, this, short_conn_id),
+                "Server::flushSessionBatch"
+            );
+            return;
+        }
+        queue.messages.erase(queue.messages.begin(), queue.messages.begin() + count);
+    }
+}
+
+void Server::handleSessionBatch(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg) {
+    Sirikata::Protocol::SessionBatch::SessionBatch batch;
+    bool parse_success = batch.ParseFromString(msg->payload());
+    if (!parse_success || batch.object_size() != batch.session_size()) {
+        LOG_INVALID_MESSAGE(space, error, msg->payload());
+        delete msg;
+        return;
+    }
+
+    // Remember that this object host understands batches so our replies can be
+    // batched too
+    if (mSessionBatchSize > 1) {
+        SessionBatchQueue& queue = mSessionBatchQueues[oh_conn_id.shortID()];
+        if (!(queue.conn_id == oh_conn_id)) {
+            queue.conn_id = oh_conn_id;
+            queue.messages.clear();
+        }
+    }
+
+    // Each entry is handled just as if it had been sent separately
+    for(int32 i = 0; i < batch.session_size(); i++) {
+        Sirikata::Protocol::Object::ObjectMessage* entry = createObjectMessage(
+            mContext->id(),
+            batch.object(i), OBJECT_PORT_SESSION,
+            UUID::null(), OBJECT_PORT_SESSION,
+            batch.session(i)
+        );
+        handleSessionMessage(oh_conn_id, entry);
+    }
+
+    delete msg;
+}
+
 // Handle Session messages from an object
 void Server::handleSessionMessage(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg) {
     Sirikata::Protocol::Session::Container session_msg;
@@ -539,6 +659,13 @@ void Server::handleSessionMessage(const ObjectHostConnectionID& oh_conn_id, Siri
 }
 
 void Server::handleObjectHostConnectionClosed(const ObjectHostConnectionID& oh_conn_id) {
+    for(SessionBatchQueueMap::iterator it = mSessionBatchQueues.begin(); it != mSessionBatchQueues.end(); it++) {
+        if (it->second.conn_id == oh_conn_id) {
+            mSessionBatchQueues.erase(it);
+            break;
+        }
+    }
+
     for(ObjectConnectionMap::iterator it = mObjects.begin(); it != mObjects.end(); ) {
         UUID obj_id = it->first;
         ObjectConnection* obj_conn = it->second;
@@ -688,6 +815,7 @@ void Server::handleConnectAuthResponse(const ObjectHostConnectionID& oh_conn_id,
     mStoredConnectionData[obj_id] = sc;
 
     mOSeg->addNewObject(obj_id,connect_msg.bounds().radius());
+    mForwarder->invalidateOSegLookup(obj_id);
 }
 
 void Server::finishAddObject(const UUID& obj_id, OSegAddNewStatus status)
@@ -969,6 +1097,7 @@ void Server::handleMigration(const UUID& obj_id)
     //update our oseg to show that we know that we have this object now.
     ServerID idOSegAckTo = (ServerID)migrate_msg->source_server();
     mOSeg->addMigratedObject(obj_id, obj_bounds.radius(), idOSegAckTo, true);//true states to send an ack message to idOSegAckTo
+    mForwarder->invalidateOSegLookup(obj_id);
 
 
     // Handle any data packed into the migration message for space components
@@ -1057,6 +1186,7 @@ void Server::handleMigrationEvent(const UUID& obj_id) {
             sendSessionMessageWithRetry(obj_conn->connID(), init_migr_obj_msg, Duration::seconds(0.05));
             BoundingSphere3f obj_bounds=mLocationService->bounds(obj_id);
             mOSeg->migrateObject(obj_id,OSegEntry(new_server_id,obj_bounds.radius()));
+            mForwarder->invalidateOSegLookup(obj_id);
 
             // Send out the migrate message
             Sirikata::Protocol::Migration::MigrationMessage migrate_msg;
@@ -1223,6 +1353,7 @@ void Server::processAlreadyMigrating(const UUID& obj_id)
     //update our oseg to show that we know that we have this object now.
     OSegEntry idOSegAckTo ((ServerID)migrate_msg->source_server(),migrate_msg->bounds().radius());
     mOSeg->addMigratedObject(obj_id, idOSegAckTo.radius(), idOSegAckTo.server(), true);//true states to send an ack message to idOSegAckTo
+    mForwarder->invalidateOSegLookup(obj_id);
 
 
 
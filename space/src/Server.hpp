@@ -92,6 +92,10 @@ public:
     ~Server();
 
     virtual void receiveMessage(Message* msg);
+
+    ObjectHostConnectionManager* objectHostConnectionManager() const {
+        return mObjectHostConnectionManager;
+    }
 private:
     // Service Implementation
     void start();
@@ -136,6 +140,9 @@ private:
     // Send a session message directly to the object via the OH connection manager, bypassing any restrictions on
     // the current state of the connection.  Keeps retrying until the message gets through.
     void sendSessionMessageWithRetry(const ObjectHostConnectionID& conn, Sirikata::Protocol::Object::ObjectMessage* msg, const Duration& retry_rate);
+    // Send the session messages queued for an object host that batches its
+    // session messages, packing them into as few messages as possible
+    void flushSessionBatch(ShortObjectHostConnectionID short_conn_id);
 
 
     // Checks if an object is connected to this server
@@ -156,6 +163,9 @@ private:
 
     // Handle Session messages from an object
     void handleSessionMessage(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg);
+    // Handle a batch of Session messages from an object host, dispatching each
+    // to handleSessionMessage
+    void handleSessionBatch(const ObjectHostConnectionID& oh_conn_id, Sirikata::Protocol::Object::ObjectMessage* msg);
     // Handle Connect message from object
     void handleConnect(const ObjectHostConnectionID& oh_conn_id, const Sirikata::Protocol::Object::ObjectMessage& container, const Sirikata::Protocol::Session::Connect& connect_msg, uint64 seqno);
     void handleConnectAuthResponse(const ObjectHostConnectionID& oh_conn_id, const UUID& obj_id, const Sirikata::Protocol::Session::Connect& connect_msg, uint64 seqno, bool authenticated);
@@ -263,6 +273,20 @@ private:
 
     typedef std::map<UUID, StoredConnection> StoredConnectionMap;
     StoredConnectionMap  mStoredConnectionData;
+
+    // Object hosts that have sent us batched session messages get their
+    // replies batched as well. Only accessed from the main strand.
+    struct SessionBatchQueue {
+        SessionBatchQueue() : flushScheduled(false) {}
+
+        ObjectHostConnectionID conn_id;
+        // Destination object and serialized Session message
+        std::deque< std::pair<UUID, String> > messages;
+        bool flushScheduled;
+    };
+    typedef std::tr1::unordered_map<ShortObjectHostConnectionID, SessionBatchQueue> SessionBatchQueueMap;
+    SessionBatchQueueMap mSessionBatchQueues;
+    uint32 mSessionBatchSize;
     struct ConnectionIDObjectMessagePair{
         ObjectHostConnectionID conn_id;
         Sirikata::Protocol::Object::ObjectMessage* obj_msg;
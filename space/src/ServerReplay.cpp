@@ -0,0 +1,381 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "ServerReplay.hpp"
+#include "Server.hpp"
+#include <sirikata/space/LocationService.hpp>
+#include <sirikata/core/util/Random.hpp>
+#include <sirikata/core/util/Timer.hpp>
+#include <sirikata/core/network/IOStrandImpl.hpp>
+#include "Protocol_Session.pbj.hpp"
+#include "Protocol_Loc.pbj.hpp"
+#include <fstream>
+#include <cstdio>
+
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_LINUX
+#include <time.h>
+#endif
+
+#define REPLAY_LOG(lvl,msg) SILOG(replay,lvl,msg)
+
+namespace Sirikata {
+
+namespace {
+// Port used for object messages in synthetic traces
+const ObjectMessagePort SYNTHETIC_MESSAGE_PORT = 2000;
+
+const char* StageNames[] = {
+    "session",
+    "location",
+    "message",
+    "background"
+};
+
+// Stages run on the replay thread, so only its CPU time is attributed to
+// them. Where per-thread CPU time isn't available, fall back to wall time.
+Duration threadCPUTime() {
+#if SIRIKATA_PLATFORM == SIRIKATA_PLATFORM_LINUX
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return Duration::microseconds((int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#endif
+    return Timer::now() - Time::null();
+}
+}
+
+ServerReplay::ServerReplay(SpaceContext* ctx, Server* server, LocationService* loc, const AllocationCounter& allocations)
+ : mContext(ctx),
+   mServer(server),
+   mLocationService(loc),
+   mAllocations(allocations),
+   mSkipped(0),
+   mConnectFailures(0),
+   mDelivered(0),
+   mDeliveredBytes(0)
+{
+    mConnection = mServer->objectHostConnectionManager()->openLocalConnection(
+        std::tr1::bind(&ServerReplay::handleServerMessage, this, std::tr1::placeholders::_1)
+    );
+}
+
+ServerReplay::~ServerReplay() {
+}
+
+bool ServerReplay::loadTrace(const String& filename) {
+    std::ifstream fp(filename.c_str());
+    if (!fp) {
+        REPLAY_LOG(error, "Couldn't open trace file " << filename);
+        return false;
+    }
+
+    String line;
+    uint32 lineno = 0;
+    while(std::getline(fp, line)) {
+        lineno++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        double t;
+        String type, obj_str;
+        iss >> t >> type >> obj_str;
+
+        Event evt;
+        evt.t = Duration::seconds(t);
+        evt.object = UUID(obj_str, UUID::HumanReadable());
+        evt.port = 0;
+        evt.size = 0;
+        evt.radius = 0.f;
+        evt.queryAngle = 0.f;
+
+        if (type == "connect") {
+            evt.type = Event::Connect;
+            iss >> evt.pos.x >> evt.pos.y >> evt.pos.z >> evt.radius;
+            if (!(iss >> evt.queryAngle))
+                evt.queryAngle = 0.f;
+            iss.clear();
+        }
+        else if (type == "loc") {
+            evt.type = Event::Location;
+            iss >> evt.pos.x >> evt.pos.y >> evt.pos.z >> evt.vel.x >> evt.vel.y >> evt.vel.z;
+        }
+        else if (type == "msg") {
+            evt.type = Event::Message;
+            String dest_str;
+            iss >> dest_str >> evt.port >> evt.size;
+            evt.dest = UUID(dest_str, UUID::HumanReadable());
+        }
+        else if (type == "disconnect") {
+            evt.type = Event::Disconnect;
+        }
+        else {
+            REPLAY_LOG(error, "Unknown event type '" << type << "' on line " << lineno << " of " << filename);
+            return false;
+        }
+
+        if (iss.fail()) {
+            REPLAY_LOG(error, "Couldn't parse line " << lineno << " of " << filename);
+            return false;
+        }
+        mEvents.push_back(evt);
+    }
+
+    // Traces should already be ordered, but a stable sort keeps the order of
+    // simultaneous events if they aren't.
+    std::stable_sort(mEvents.begin(), mEvents.end());
+    REPLAY_LOG(info, "Loaded " << mEvents.size() << " events from " << filename);
+    return true;
+}
+
+void ServerReplay::generateTrace(const BoundingBox3f& region, uint32 nobjects, const Duration& duration,
+    double loc_rate, double msg_rate, uint32 msg_size, float query_angle, uint32 seed)
+{
+    srand(seed);
+
+    std::vector<UUID> objects;
+    objects.reserve(nobjects);
+    for(uint32 i = 0; i < nobjects; i++) {
+        char id_str[40];
+        sprintf(id_str, "%08x-0000-0000-0000-%012x", seed, i);
+        objects.push_back(UUID(String(id_str), UUID::HumanReadable()));
+    }
+
+    Vector3f extents = region.max() - region.min();
+    float max_speed = extents.length() / 100.f;
+
+    Event evt;
+    evt.port = 0;
+    evt.size = 0;
+    evt.radius = 1.f;
+    evt.queryAngle = 0.f;
+
+    // Connections are spread over the first second and disconnections happen
+    // at the end of the trace.
+    Duration connect_spacing = Duration::seconds(1.0 / std::max(nobjects, (uint32)1));
+    for(uint32 i = 0; i < nobjects; i++) {
+        evt.type = Event::Connect;
+        evt.object = objects[i];
+        evt.t = connect_spacing * (double)i;
+        evt.pos = Vector3f(
+            randFloat(region.min().x, region.max().x),
+            randFloat(region.min().y, region.max().y),
+            randFloat(region.min().z, region.max().z)
+        );
+        evt.queryAngle = query_angle;
+        mEvents.push_back(evt);
+
+        evt.type = Event::Disconnect;
+        evt.t = duration + Duration::seconds(1.0);
+        mEvents.push_back(evt);
+    }
+    evt.queryAngle = 0.f;
+
+    // Location updates and messages are uniformly spread over the rest of
+    // the trace
+    uint64 nlocs = (uint64)(loc_rate * nobjects * duration.toSeconds());
+    for(uint64 i = 0; i < nlocs; i++) {
+        evt.type = Event::Location;
+        evt.object = objects[randInt<uint32>(0, nobjects-1)];
+        evt.t = Duration::seconds(1.0) + duration * randFloat();
+        evt.pos = Vector3f(
+            randFloat(region.min().x, region.max().x),
+            randFloat(region.min().y, region.max().y),
+            randFloat(region.min().z, region.max().z)
+        );
+        evt.vel = Vector3f(
+            randFloat(-max_speed, max_speed),
+            randFloat(-max_speed, max_speed),
+            randFloat(-max_speed, max_speed)
+        );
+        mEvents.push_back(evt);
+    }
+
+    uint64 nmsgs = (uint64)(msg_rate * nobjects * duration.toSeconds());
+    for(uint64 i = 0; i < nmsgs; i++) {
+        evt.type = Event::Message;
+        evt.object = objects[randInt<uint32>(0, nobjects-1)];
+        evt.dest = objects[randInt<uint32>(0, nobjects-1)];
+        evt.port = SYNTHETIC_MESSAGE_PORT;
+        evt.size = msg_size;
+        evt.t = Duration::seconds(1.0) + duration * randFloat();
+        mEvents.push_back(evt);
+    }
+
+    std::stable_sort(mEvents.begin(), mEvents.end());
+    REPLAY_LOG(info, "Generated " << mEvents.size() << " events for " << nobjects << " objects");
+}
+
+void ServerReplay::run() {
+    Time start = Timer::now();
+    for(EventList::const_iterator it = mEvents.begin(); it != mEvents.end(); it++) {
+        const Event& evt = *it;
+
+        mContext->setVirtualSimTime(Time::null() + evt.t);
+        drain(BackgroundStage);
+
+        StageID stage = MessageStage;
+        if (evt.type == Event::Connect || evt.type == Event::Disconnect)
+            stage = SessionStage;
+        else if (evt.type == Event::Location)
+            stage = LocationStage;
+
+        Duration cpu_start = threadCPUTime();
+        int64 allocs_start = mAllocations();
+        inject(evt);
+        drain(stage);
+        mStages[stage].cpu += threadCPUTime() - cpu_start;
+        mStages[stage].allocations += mAllocations() - allocs_start;
+        mStages[stage].events++;
+    }
+    Duration wall = Timer::now() - start;
+
+    mServer->objectHostConnectionManager()->closeLocalConnection(mConnection);
+    drain(BackgroundStage);
+
+    report(wall);
+}
+
+void ServerReplay::inject(const Event& evt) {
+    if (evt.type == Event::Connect) {
+        uint64 seqno = ++mSeqNos[evt.object];
+
+        Sirikata::Protocol::Session::Container session_msg;
+        session_msg.set_seqno(seqno);
+        Sirikata::Protocol::Session::IConnect connect_msg = session_msg.mutable_connect();
+        connect_msg.set_type(Sirikata::Protocol::Session::Connect::Fresh);
+        connect_msg.set_object(evt.object);
+        Sirikata::Protocol::ITimedMotionVector loc = connect_msg.mutable_loc();
+        loc.set_t( mContext->simTime() );
+        loc.set_position( evt.pos );
+        loc.set_velocity( Vector3f(0,0,0) );
+        Sirikata::Protocol::ITimedMotionQuaternion orient = connect_msg.mutable_orientation();
+        orient.set_t( mContext->simTime() );
+        orient.set_position( Quaternion::identity() );
+        orient.set_velocity( Quaternion::identity() );
+        connect_msg.set_bounds( BoundingSphere3f(Vector3f(0,0,0), evt.radius) );
+        if (evt.queryAngle > 0.f)
+            connect_msg.set_query_angle(evt.queryAngle);
+
+        sendSession(evt.object, serializePBJMessage(session_msg));
+        return;
+    }
+
+    if (mConnected.find(evt.object) == mConnected.end()) {
+        mSkipped++;
+        return;
+    }
+
+    if (evt.type == Event::Location) {
+        Sirikata::Protocol::Loc::Container container;
+        Sirikata::Protocol::Loc::ILocationUpdateRequest request = container.mutable_update_request();
+        Sirikata::Protocol::ITimedMotionVector loc = request.mutable_location();
+        loc.set_t( mContext->simTime() );
+        loc.set_position( evt.pos );
+        loc.set_velocity( evt.vel );
+
+        // Applied the same way the location substream from the object would
+        String payload = serializePBJMessage(container);
+        mLocationService->locationUpdate(evt.object, (void*)payload.data(), payload.size());
+    }
+    else if (evt.type == Event::Message) {
+        Sirikata::Protocol::Object::ObjectMessage* msg = createObjectMessage(
+            mContext->id(),
+            evt.object, evt.port,
+            evt.dest, evt.port,
+            String(evt.size, 'x')
+        );
+        mServer->objectHostConnectionManager()->receiveLocal(mConnection, msg);
+    }
+    else if (evt.type == Event::Disconnect) {
+        Sirikata::Protocol::Session::Container session_msg;
+        session_msg.set_seqno(mSeqNos[evt.object]);
+        Sirikata::Protocol::Session::IDisconnect disconnect_msg = session_msg.mutable_disconnect();
+        disconnect_msg.set_object(evt.object);
+        disconnect_msg.set_reason("Replay");
+        sendSession(evt.object, serializePBJMessage(session_msg));
+        mConnected.erase(evt.object);
+    }
+}
+
+void ServerReplay::sendSession(const UUID& obj, const String& payload) {
+    Sirikata::Protocol::Object::ObjectMessage* msg = createObjectMessage(
+        mContext->id(),
+        obj, OBJECT_PORT_SESSION,
+        UUID::null(), OBJECT_PORT_SESSION,
+        payload
+    );
+    mServer->objectHostConnectionManager()->receiveLocal(mConnection, msg);
+}
+
+void ServerReplay::drain(StageID stage) {
+    Duration cpu_start = threadCPUTime();
+    int64 allocs_start = mAllocations();
+
+    // Every handler that becomes ready while draining is run before returning,
+    // including ones posted by earlier handlers.
+    Network::IOService* ios = mContext->ioService;
+    uint32 ran;
+    do {
+        ios->reset();
+        ran = ios->poll();
+    } while(ran > 0);
+
+    if (stage == BackgroundStage) {
+        mStages[stage].cpu += threadCPUTime() - cpu_start;
+        mStages[stage].allocations += mAllocations() - allocs_start;
+    }
+}
+
+void ServerReplay::handleServerMessage(const Sirikata::Protocol::Object::ObjectMessage& msg) {
+    mDelivered++;
+    mDeliveredBytes += msg.payload().size();
+
+    if (msg.dest_port() != OBJECT_PORT_SESSION || msg.source_object() != UUID::null())
+        return;
+
+    Sirikata::Protocol::Session::Container session_msg;
+    if (!session_msg.ParseFromString(msg.payload()) || !session_msg.has_connect_response())
+        return;
+
+    UUID obj = msg.dest_object();
+    if (session_msg.connect_response().response() == Sirikata::Protocol::Session::ConnectResponse::Success) {
+        mConnected.insert(obj);
+        // Ack after the server has finished sending, as an object host would
+        mContext->mainStrand->post(
+            std::tr1::bind(&ServerReplay::sendConnectAck, this, obj, session_msg.seqno()),
+            "ServerReplay::sendConnectAck"
+        );
+    }
+    else {
+        mConnectFailures++;
+        REPLAY_LOG(warn, "Connection for " << obj << " wasn't accepted by the server");
+    }
+}
+
+void ServerReplay::sendConnectAck(const UUID& obj, uint64 seqno) {
+    Sirikata::Protocol::Session::Container ack_msg;
+    ack_msg.set_seqno(seqno);
+    ack_msg.mutable_connect_ack();
+    sendSession(obj, serializePBJMessage(ack_msg));
+}
+
+void ServerReplay::report(const Duration& wall) {
+    REPLAY_LOG(info, "Replayed " << mEvents.size() << " events in " << wall.seconds() << "s, "
+        << mSkipped << " skipped because their object wasn't connected, "
+        << mConnectFailures << " failed connections");
+    REPLAY_LOG(info, "Server sent " << mDelivered << " messages, " << mDeliveredBytes << " payload bytes, to the object host");
+
+    for(int s = 0; s < NumStages; s++) {
+        const StageStats& stats = mStages[s];
+        double cpu_ms = stats.cpu.toSeconds() * 1000.0;
+        std::ostringstream per_event;
+        if (stats.events > 0)
+            per_event << ", " << (cpu_ms * 1000.0 / stats.events) << "us/event, "
+                      << ((double)stats.allocations / stats.events) << " allocations/event";
+        REPLAY_LOG(info, StageNames[s] << ": " << stats.events << " events, "
+            << cpu_ms << "ms cpu, " << stats.allocations << " allocations"
+            << per_event.str());
+    }
+}
+
+} // namespace Sirikata
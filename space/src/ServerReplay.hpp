@@ -0,0 +1,145 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef _SIRIKATA_SPACE_SERVER_REPLAY_HPP_
+#define _SIRIKATA_SPACE_SERVER_REPLAY_HPP_
+
+#include <sirikata/space/SpaceContext.hpp>
+#include <sirikata/space/ObjectHostConnectionManager.hpp>
+#include <sirikata/core/util/MotionVector.hpp>
+#include <sirikata/core/network/ObjectMessage.hpp>
+
+namespace Sirikata {
+
+class Server;
+class LocationService;
+
+/** ServerReplay feeds a trace of session events, location updates and object
+ *  messages into a single Server, as if they came from one object host, and
+ *  reports the CPU time and number of allocations spent in each stage. CPU
+ *  time is that of the replay thread, which runs all the stages. Allocation
+ *  counts come from the AllocationCounter and include any allocations other
+ *  threads make while a stage runs.
+ *
+ *  All events are injected through a local object host connection and the
+ *  context's IOService is polled on the calling thread until it runs out of
+ *  ready handlers, so the work triggered by an event runs before the next
+ *  event is injected. The context's simulation time follows the timestamps in
+ *  the trace rather than the system clock, so replies and location updates
+ *  carry the same times on every run.
+ *
+ *  Traces are text files with one event per line, ordered by time in seconds:
+ *
+ *    <t> connect <object> <x> <y> <z> <radius> [<query angle>]
+ *    <t> loc <object> <x> <y> <z> <vx> <vy> <vz>
+ *    <t> msg <source> <dest> <port> <payload bytes>
+ *    <t> disconnect <object>
+ *
+ *  Connections are acked as soon as the server reports success, just like an
+ *  object host would. Location updates and messages from objects that aren't
+ *  connected are skipped. The local connection has no OHDP SST stream, so
+ *  the server's onObjectHostConnected is never called for it and anything
+ *  that relies on that stream, e.g. per-object location substreams, isn't
+ *  exercised. Location updates are applied directly to the LocationService
+ *  instead.
+ */
+class ServerReplay {
+public:
+    // Returns the number of allocations made by all threads in the process
+    // so far
+    typedef std::tr1::function<int64()> AllocationCounter;
+
+    ServerReplay(SpaceContext* ctx, Server* server, LocationService* loc, const AllocationCounter& allocations);
+    ~ServerReplay();
+
+    bool loadTrace(const String& filename);
+    /** Generate a synthetic trace in which objects connect, move randomly
+     *  within region, exchange messages with each other and then disconnect.
+     */
+    void generateTrace(const BoundingBox3f& region, uint32 nobjects, const Duration& duration,
+        double loc_rate, double msg_rate, uint32 msg_size, float query_angle, uint32 seed);
+
+    /** Replay all the events in the trace and log the results. */
+    void run();
+
+private:
+    enum StageID {
+        SessionStage,
+        LocationStage,
+        MessageStage,
+        // Work that becomes ready between events, e.g. periodic services
+        BackgroundStage,
+        NumStages
+    };
+
+    struct Event {
+        enum Type {
+            Connect,
+            Location,
+            Message,
+            Disconnect
+        };
+
+        Type type;
+        Duration t;
+        UUID object;
+        // Destination object and payload for messages
+        UUID dest;
+        ObjectMessagePort port;
+        uint32 size;
+        // Motion for connect and loc, radius and query for connect
+        Vector3f pos;
+        Vector3f vel;
+        float radius;
+        float queryAngle;
+
+        bool operator<(const Event& rhs) const {
+            return t < rhs.t;
+        }
+    };
+    typedef std::vector<Event> EventList;
+
+    struct StageStats {
+        StageStats() : events(0), cpu(Duration::zero()), allocations(0) {}
+
+        uint64 events;
+        Duration cpu;
+        int64 allocations;
+    };
+
+    // Inject a single event into the server
+    void inject(const Event& evt);
+    void sendSession(const UUID& obj, const String& payload);
+    // Run handlers until none are ready, attributing the cost to stage
+    void drain(StageID stage);
+
+    // Handles messages the server sends to the object host
+    void handleServerMessage(const Sirikata::Protocol::Object::ObjectMessage& msg);
+    void sendConnectAck(const UUID& obj, uint64 seqno);
+
+    void report(const Duration& wall);
+
+    SpaceContext* mContext;
+    Server* mServer;
+    LocationService* mLocationService;
+    AllocationCounter mAllocations;
+    ObjectHostConnectionID mConnection;
+
+    EventList mEvents;
+
+    typedef std::tr1::unordered_map<UUID, uint64, UUID::Hasher> SeqNoMap;
+    SeqNoMap mSeqNos;
+    typedef std::tr1::unordered_set<UUID, UUID::Hasher> ObjectSet;
+    ObjectSet mConnected;
+
+    StageStats mStages[NumStages];
+    uint64 mSkipped;
+    uint64 mConnectFailures;
+    uint64 mDelivered;
+    uint64 mDeliveredBytes;
+};
+
+} // namespace Sirikata
+
+#endif //_SIRIKATA_SPACE_SERVER_REPLAY_HPP_
@@ -184,7 +184,7 @@ namespace Sirikata
   }
 
 
-  const OSegEntry& CacheLRUOriginal::get(const UUID& uuid)
+  OSegEntry CacheLRUOriginal::get(const UUID& uuid)
   {
       boost::lock_guard<boost::mutex> lck(mMutex);
 
@@ -90,7 +90,7 @@ namespace Sirikata
     mCompleteCache.insert(uuid,sID.server(),0,0,0,0,sID.radius(),lookupWeight,1);
   }
 
-  const OSegEntry& CommunicationCache::get(const UUID& uuid)
+  OSegEntry CommunicationCache::get(const UUID& uuid)
   {
     boost::lock_guard<boost::mutex> lck(mMutex);
     return mCompleteCache.lookup(uuid);
@@ -66,6 +66,7 @@
 #include <sirikata/space/ObjectSegmentation.hpp>
 #include "caches/CommunicationCache.hpp"
 #include "caches/CacheLRUOriginal.hpp"
+#include <sirikata/space/ShardedOSegCache.hpp>
 
 #include <sirikata/space/SpaceContext.hpp>
 #include <sirikata/mesh/Filter.hpp>
@@ -259,14 +260,19 @@ int main(int argc, char** argv) {
 
 
 
-    LoadMonitor* loadMonitor = new LoadMonitor(space_context, cseg);
+    LoadMonitor* loadMonitor = new LoadMonitor(space_context, cseg, loc_service);
 
 
     // OSeg Cache
     OSegCache* oseg_cache = NULL;
     std::string cacheSelector = GetOptionValue<String>(CACHE_SELECTOR);
     uint32 cacheSize = GetOptionValue<uint32>(OSEG_CACHE_SIZE);
-    if (cacheSelector == CACHE_TYPE_COMMUNICATION) {
+    if (cacheSelector == CACHE_TYPE_SHARDED) {
+        uint32 cacheShards = GetOptionValue<uint32>(OSEG_CACHE_SHARDS);
+        Duration entryLifetime = GetOptionValue<Duration>(OSEG_CACHE_ENTRY_LIFETIME);
+        oseg_cache = new ShardedOSegCache(space_context, cacheSize, cacheShards, entryLifetime);
+    }
+    else if (cacheSelector == CACHE_TYPE_COMMUNICATION) {
         double cacheCommScaling = GetOptionValue<double>(CACHE_COMM_SCALING);
         oseg_cache = new CommunicationCache(space_context, cacheCommScaling, cseg, cacheSize);
     }
@@ -87,10 +87,10 @@ class Manager:
         self._testsByName = dict([(t.name, t) for t in self._tests])
 
 
-    def run(self, testNames=None, output=sys.stdout, binPath=DEFAULT_BIN_PATH, cppohBinName=DEFAULT_CPPOH_BIN_NAME, spaceBinName=DEFAULT_SPACE_BIN_NAME, saveOutput=False):
+    def run(self, testNames=None, output=sys.stdout, binPath=DEFAULT_BIN_PATH, cppohBinName=DEFAULT_CPPOH_BIN_NAME, spaceBinName=DEFAULT_SPACE_BIN_NAME, saveOutput=False, includeLong=False):
 
         if not testNames:
-            testNames = [t.name for t in self._tests]
+            testNames = [t.name for t in self._tests if includeLong or not t.long_running]
         numTests = len(testNames);
         count = 1;
 
@@ -31,6 +31,11 @@ class Test(object):
     # test suite
     disabled = False
 
+    # Set long_running to True for slow tests, e.g. benchmarks, to
+    # leave them out of the default suite. They still run when named
+    # explicitly or when long tests are requested.
+    long_running = False
+
     # Use this to express order dependencies for tests. For example,
     # if TestSuperBar uses feature Bar, you could have after =
     # [TestBar] to make sure TestBar runs before TestSuperBar.
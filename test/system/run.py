@@ -8,12 +8,15 @@ import tests
 if __name__ == "__main__":
 
     saveOutput = False
+    includeLong = False
     output = sys.stdout
 
     testsToRun = []
     for s in range (1, len(sys.argv)):
         if (sys.argv[s] == '--saveOutput'):
             saveOutput=True
+        elif (sys.argv[s] == '--long'):
+            includeLong=True
         elif sys.argv[s].startswith('--log='):
             output = Tee( open( sys.argv[s].split('=', 1)[1], 'w'), sys.stdout )
         else:
@@ -25,4 +28,4 @@ if __name__ == "__main__":
     if len(testsToRun):
         manager.run(testsToRun, output=output, saveOutput=saveOutput)
     else:
-        manager.run(output=output, saveOutput=saveOutput)
+        manager.run(output=output, saveOutput=saveOutput, includeLong=includeLong)
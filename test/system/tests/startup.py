@@ -0,0 +1,56 @@
+#!/usr/bin/python
+
+from __future__ import print_function
+from framework.tests.csv import CSVTest
+from framework.db.entity import Entity
+import re, random
+
+def random_entities(count):
+    # A fixed seed gives the same scene every run, without touching
+    # the global random state other tests use
+    rand = random.Random(0)
+    return [Entity(pos_x=rand.uniform(-1000, 1000),
+                   pos_y=rand.uniform(-1000, 1000),
+                   pos_z=rand.uniform(-1000, 1000))
+            for i in range(count)]
+
+class StartupBenchmark(CSVTest):
+    '''
+    Loads a large scene through the CSV object factory and reports
+    the time to ready: how long the object host took to parse the
+    file, create every object and request its connection. The object
+    host runs until the test's duration expires, so it is expected to
+    be hupped.
+    '''
+
+    object_count = 10000
+    duration = 120
+    needs_hup = True
+    # Takes the full duration, so only run it when asked for
+    long_running = True
+
+    entities = random_entities(object_count)
+
+    touches = ['csvfactory', 'object creation', 'session batching']
+
+    parsed_re = re.compile(r'Parsed (\d+) objects from .* using (\d+) threads in ([\d.e+-]+)s')
+    ready_re = re.compile(r'Created and requested connections for (\d+) objects from .* in ([\d.e+-]+)s')
+
+    def runTest(self, dirtyFolderName, binPath, cppohBinName, spaceBinName, output=None):
+        super(StartupBenchmark, self).runTest(dirtyFolderName, binPath, cppohBinName, spaceBinName, output=output)
+
+        parsed = None
+        ready = None
+        fp = open(self.report_files['Object Host'], 'r')
+        for line in fp.readlines():
+            parsed = parsed or self.parsed_re.search(line)
+            ready = ready or self.ready_re.search(line)
+        fp.close()
+
+        if parsed:
+            print('Parsed %s objects with %s threads in %ss' % parsed.groups(), file=output)
+        if not ready:
+            self.fail('Object host never finished creating objects')
+            return
+        print('Time to ready for %s objects: %ss' % ready.groups(), file=output)
+        self.assertEqual(int(ready.group(1)), self.object_count, 'Not all objects were created')
@@ -0,0 +1,228 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include "../../../cseg/src/LoadBalancePlanner.hpp"
+
+using namespace Sirikata;
+
+class LoadBalancePlannerTest : public CxxTest::TestSuite
+{
+    typedef LoadBalancePlanner::Action Action;
+
+    SegmentedRegion* mRoot;
+
+    static RegionLoad makeLoad(uint32 objects, const uint32* xhist, uint32 nx, const uint32* yhist, uint32 ny) {
+        RegionLoad rl;
+        rl.objectCount = objects;
+        if (xhist != NULL) rl.histogram[0].assign(xhist, xhist + nx);
+        if (yhist != NULL) rl.histogram[1].assign(yhist, yhist + ny);
+        return rl;
+    }
+
+    // Splits a leaf in half along X, giving the halves the specified servers
+    static void split(SegmentedRegion* region, ServerID left, ServerID right) {
+        const BoundingBox3f& bbox = region->mBoundingBox;
+        float mid = (bbox.min().x + bbox.max().x) / 2;
+        region->mLeftChild = new SegmentedRegion(region);
+        region->mRightChild = new SegmentedRegion(region);
+        region->mLeftChild->mBoundingBox = BoundingBox3f(bbox.min(), Vector3f(mid, bbox.max().y, bbox.max().z));
+        region->mRightChild->mBoundingBox = BoundingBox3f(Vector3f(mid, bbox.min().y, bbox.min().z), bbox.max());
+        region->mLeftChild->mServer = left;
+        region->mRightChild->mServer = right;
+        region->mLeftChild->mSplitAxis = region->mRightChild->mSplitAxis = SegmentedRegion::X;
+    }
+
+public:
+    void setUp() {
+        mRoot = new SegmentedRegion(NULL);
+        mRoot->mBoundingBox = BoundingBox3f(Vector3f(0,0,0), Vector3f(100,100,100));
+        mRoot->mServer = 1;
+    }
+
+    void tearDown() {
+        mRoot->destroy();
+        delete mRoot;
+    }
+
+    void testSplitCutsAtHistogramBoundary() {
+        LoadBalancePlanner planner((LoadBalancePlanner::Parameters()));
+
+        // All objects are in the top fifth along X and bunched together
+        // along Y, so only the X cut at 90 balances the halves.
+        uint32 xhist[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1500, 1500 };
+        uint32 yhist[] = { 3000, 0, 0, 0 };
+        LoadBalancePlanner::LoadMap loads;
+        loads[mRoot] = makeLoad(3000, xhist, 10, yhist, 4);
+        std::vector<ServerID> available(1, 2);
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT_EQUALS(actions.size(), (size_t)1);
+        if (actions.size() != 1) return;
+        TS_ASSERT_EQUALS(actions[0].type, Action::SPLIT);
+        TS_ASSERT_EQUALS(actions[0].kept, (ServerID)1);
+        TS_ASSERT_EQUALS(actions[0].other, (ServerID)2);
+        TS_ASSERT_EQUALS(actions[0].axis, (uint32)0);
+        TS_ASSERT_DELTA(actions[0].position, 90.f, 1e-4f);
+        TS_ASSERT_EQUALS(actions[0].migrations, (uint32)1500);
+        TS_ASSERT(available.empty());
+
+        // The children replace the parent with estimated loads and the
+        // histogram bins on either side of the cut.
+        TS_ASSERT_EQUALS(loads.size(), (size_t)2);
+        TS_ASSERT(loads.find(mRoot) == loads.end());
+        const RegionLoad& lower = loads[mRoot->mLeftChild];
+        const RegionLoad& upper = loads[mRoot->mRightChild];
+        TS_ASSERT(lower.estimated && upper.estimated);
+        TS_ASSERT_EQUALS(lower.objectCount, (uint32)1500);
+        TS_ASSERT_EQUALS(upper.objectCount, (uint32)1500);
+        TS_ASSERT_EQUALS(lower.histogram[0].size(), (size_t)9);
+        TS_ASSERT_EQUALS(upper.histogram[0].size(), (size_t)1);
+        TS_ASSERT_DELTA(mRoot->mLeftChild->mBoundingBox.max().x, 90.f, 1e-4f);
+    }
+
+    void testSplitMovesFewestObjects() {
+        LoadBalancePlanner planner((LoadBalancePlanner::Parameters()));
+
+        // X can only be balanced with an even 1200/1200 split, but cutting Y
+        // at 25 also leaves both halves under the target while moving only
+        // 1000 objects, so the new server takes the lower Y quarter.
+        uint32 xhist[] = { 100, 1100, 1100, 100 };
+        uint32 yhist[] = { 1000, 600, 200, 600 };
+        LoadBalancePlanner::LoadMap loads;
+        loads[mRoot] = makeLoad(2400, xhist, 4, yhist, 4);
+        std::vector<ServerID> available(1, 2);
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT_EQUALS(actions.size(), (size_t)1);
+        if (actions.size() != 1) return;
+        TS_ASSERT_EQUALS(actions[0].axis, (uint32)1);
+        TS_ASSERT_DELTA(actions[0].position, 25.f, 1e-4f);
+        TS_ASSERT_EQUALS(actions[0].migrations, (uint32)1000);
+        TS_ASSERT_EQUALS(mRoot->mLeftChild->mServer, (ServerID)2);
+        TS_ASSERT_EQUALS(mRoot->mRightChild->mServer, (ServerID)1);
+    }
+
+    void testSplitNeedsAvailableServer() {
+        LoadBalancePlanner planner((LoadBalancePlanner::Parameters()));
+
+        LoadBalancePlanner::LoadMap loads;
+        loads[mRoot] = makeLoad(5000, NULL, 0, NULL, 0);
+        std::vector<ServerID> available;
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT(actions.empty());
+        TS_ASSERT(mRoot->mLeftChild == NULL);
+    }
+
+    void testEstimatedLoadsAreNotReplanned() {
+        LoadBalancePlanner::Parameters params;
+        params.maxActions = 1;
+        LoadBalancePlanner planner(params);
+
+        LoadBalancePlanner::LoadMap loads;
+        loads[mRoot] = makeLoad(8000, NULL, 0, NULL, 0);
+        uint32 servers[] = { 2, 3, 4 };
+        std::vector<ServerID> available(servers, servers + 3);
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+        TS_ASSERT_EQUALS(actions.size(), (size_t)1);
+
+        // Both halves are still overloaded, but their loads are only
+        // estimates so nothing happens until the servers report.
+        actions.clear();
+        planner.run(&loads, &available, &actions);
+        TS_ASSERT(actions.empty());
+        TS_ASSERT_EQUALS(available.size(), (size_t)2);
+    }
+
+    void testMergeKeepsServerWithMostObjects() {
+        LoadBalancePlanner planner((LoadBalancePlanner::Parameters()));
+
+        split(mRoot, 1, 2);
+        SegmentedRegion* left = mRoot->mLeftChild;
+        SegmentedRegion* right = mRoot->mRightChild;
+        LoadBalancePlanner::LoadMap loads;
+        loads[left] = makeLoad(10, NULL, 0, NULL, 0);
+        loads[right] = makeLoad(40, NULL, 0, NULL, 0);
+        std::vector<ServerID> available;
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT_EQUALS(actions.size(), (size_t)1);
+        if (actions.size() != 1) return;
+        TS_ASSERT_EQUALS(actions[0].type, Action::MERGE);
+        TS_ASSERT_EQUALS(actions[0].region, mRoot);
+        TS_ASSERT_EQUALS(actions[0].kept, (ServerID)2);
+        TS_ASSERT_EQUALS(actions[0].other, (ServerID)1);
+        TS_ASSERT_EQUALS(actions[0].migrations, (uint32)10);
+
+        TS_ASSERT(mRoot->mLeftChild == NULL && mRoot->mRightChild == NULL);
+        TS_ASSERT_EQUALS(mRoot->mServer, (ServerID)2);
+        TS_ASSERT_EQUALS(available.size(), (size_t)1);
+        TS_ASSERT_EQUALS(loads.size(), (size_t)1);
+        TS_ASSERT_EQUALS(loads[mRoot].objectCount, (uint32)50);
+        TS_ASSERT(loads[mRoot].estimated);
+    }
+
+    void testMergeFreesServerForSplit() {
+        LoadBalancePlanner planner((LoadBalancePlanner::Parameters()));
+
+        // A cold pair on one side and a hot leaf on the other with no idle
+        // servers: the merge releases the server the split needs.
+        split(mRoot, 1, 2);
+        split(mRoot->mLeftChild, 1, 3);
+        SegmentedRegion* cold_left = mRoot->mLeftChild->mLeftChild;
+        SegmentedRegion* cold_right = mRoot->mLeftChild->mRightChild;
+        SegmentedRegion* hot = mRoot->mRightChild;
+        LoadBalancePlanner::LoadMap loads;
+        loads[cold_left] = makeLoad(20, NULL, 0, NULL, 0);
+        loads[cold_right] = makeLoad(10, NULL, 0, NULL, 0);
+        loads[hot] = makeLoad(3000, NULL, 0, NULL, 0);
+        std::vector<ServerID> available;
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT_EQUALS(actions.size(), (size_t)2);
+        if (actions.size() != 2) return;
+        TS_ASSERT_EQUALS(actions[0].type, Action::MERGE);
+        TS_ASSERT_EQUALS(actions[0].other, (ServerID)3);
+        TS_ASSERT_EQUALS(actions[1].type, Action::SPLIT);
+        TS_ASSERT_EQUALS(actions[1].region, hot);
+        TS_ASSERT_EQUALS(actions[1].other, (ServerID)3);
+        TS_ASSERT(available.empty());
+    }
+
+    void testThresholdPolicySplitsAtMidpoint() {
+        LoadBalancePlanner::Parameters params;
+        params.policy = LoadBalancePlanner::POLICY_THRESHOLD;
+        LoadBalancePlanner planner(params);
+
+        // The original policy ignores the histograms and gives the upper
+        // half to the new server, even though that moves every object.
+        uint32 yhist[] = { 0, 3000 };
+        LoadBalancePlanner::LoadMap loads;
+        loads[mRoot] = makeLoad(3000, NULL, 0, yhist, 2);
+        std::vector<ServerID> available(1, 2);
+        std::vector<Action> actions;
+
+        planner.run(&loads, &available, &actions);
+
+        TS_ASSERT_EQUALS(actions.size(), (size_t)1);
+        if (actions.size() != 1) return;
+        TS_ASSERT_EQUALS(actions[0].axis, (uint32)1);
+        TS_ASSERT_DELTA(actions[0].position, 50.f, 1e-4f);
+        TS_ASSERT_EQUALS(actions[0].migrations, (uint32)3000);
+        TS_ASSERT_EQUALS(mRoot->mRightChild->mServer, (ServerID)2);
+    }
+};
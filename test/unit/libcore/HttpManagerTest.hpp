@@ -0,0 +1,520 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+
+#include <sirikata/core/util/Thread.hpp>
+#include <sirikata/core/network/Address.hpp>
+#include <sirikata/core/transfer/HttpManager.hpp>
+#include <sirikata/core/transfer/MeerkatTransferHandler.hpp>
+#include <sirikata/core/options/CommonOptions.hpp>
+#include <sirikata/core/util/Timer.hpp>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+using namespace Sirikata;
+using boost::asio::ip::tcp;
+
+/** A minimal keep-alive HTTP/1.1 server for exercising HttpManager without
+ *  network access. GET /<n> returns a body of n bytes derived from n, HEAD
+ *  returns the same headers without a body. GET /gate doesn't respond until
+ *  openGate() is called and GET /gz/<n> returns the same body as /<n>, but
+ *  gzip encoded. Files added with addFile() are served from their path and
+ *  honor Range headers unless setRangesSupported(false). Each batch of requests read from a connection is answered
+ *  after a fixed delay, simulating a round trip to a remote server.
+ */
+class StubHttpServer {
+public:
+    StubHttpServer(const Duration& latency)
+     : mLatency(latency),
+       mAcceptor(mIOService, tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0)),
+       mPort(mAcceptor.local_endpoint().port()),
+       mGateOpen(false),
+       mStopped(false),
+       mMaxBatch(0),
+       mRangesSupported(true),
+       mNumRangeRequests(0)
+    {
+        mAcceptThread = new Thread("StubHttpServer Accept", std::tr1::bind(&StubHttpServer::acceptLoop, this));
+    }
+
+    ~StubHttpServer() {
+        boost::system::error_code ec;
+        {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mStopped = true;
+            mGateOpen = true;
+            mGateCond.notify_all();
+            for(uint32 i = 0; i < mSockets.size(); i++)
+                mSockets[i]->shutdown(tcp::socket::shutdown_both, ec);
+        }
+        // Wake up the acceptor so it notices we're stopping
+        tcp::socket waker(mIOService);
+        waker.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port()), ec);
+        mAcceptThread->join();
+        delete mAcceptThread;
+        mAcceptor.close(ec);
+
+        for(uint32 i = 0; i < mConnThreads.size(); i++) {
+            mConnThreads[i]->join();
+            delete mConnThreads[i];
+        }
+    }
+
+    uint16 port() const {
+        return mPort;
+    }
+
+    Network::Address address() const {
+        return Network::Address("127.0.0.1", boost::lexical_cast<String>(mPort));
+    }
+
+    void openGate() {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mGateOpen = true;
+        mGateCond.notify_all();
+    }
+
+    // Largest number of requests received in a single read
+    uint32 maxBatch() {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        return mMaxBatch;
+    }
+
+    void addFile(const String& path, const String& content) {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mFiles[path] = content;
+    }
+
+    void setRangesSupported(bool supported) {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mRangesSupported = supported;
+    }
+
+    uint32 numRangeRequests() {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        return mNumRangeRequests;
+    }
+
+    static String body(uint32 size) {
+        String result(size, ' ');
+        for(uint32 i = 0; i < size; i++)
+            result[i] = 'a' + ((size + i) % 26);
+        return result;
+    }
+
+    static String gzipped(const String& data) {
+        std::ostringstream compressed;
+        {
+            boost::iostreams::filtering_ostream out;
+            out.push(boost::iostreams::gzip_compressor());
+            out.push(compressed);
+            out << data;
+        }
+        return compressed.str();
+    }
+
+private:
+    typedef std::tr1::shared_ptr<tcp::socket> SocketPtr;
+    typedef std::map<String, String> FileMap;
+
+    String fileResponse(const String& request, const String& path, const String& file, bool ranges_supported) {
+        std::ostringstream response;
+        size_t range_pos = request.find("\r\nRange: bytes=");
+        if (range_pos == String::npos || !ranges_supported) {
+            response << "HTTP/1.1 200 OK\r\n"
+                     << "Content-Length: " << file.size() << "\r\n"
+                     << "X-Path: " << path << "\r\n"
+                     << "\r\n" << file;
+            return response.str();
+        }
+
+        std::istringstream range(request.substr(range_pos + 17));
+        uint64 start = 0, end = 0;
+        char dash;
+        range >> start >> dash >> end;
+        {
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            mNumRangeRequests++;
+        }
+        response << "HTTP/1.1 206 Partial Content\r\n"
+                 << "Content-Length: " << (end - start + 1) << "\r\n"
+                 << "Content-Range: bytes " << start << "-" << end << "/" << file.size() << "\r\n"
+                 << "X-Path: " << path << "\r\n"
+                 << "\r\n" << file.substr((size_t)start, (size_t)(end - start + 1));
+        return response.str();
+    }
+
+    void acceptLoop() {
+        while(true) {
+            SocketPtr sock(new tcp::socket(mIOService));
+            boost::system::error_code ec;
+            mAcceptor.accept(*sock, ec);
+
+            boost::unique_lock<boost::mutex> lock(mMutex);
+            if (ec || mStopped) return;
+            mSockets.push_back(sock);
+            mConnThreads.push_back(
+                new Thread("StubHttpServer Connection", std::tr1::bind(&StubHttpServer::connectionLoop, this, sock))
+            );
+        }
+    }
+
+    void connectionLoop(SocketPtr sock) {
+        String buffered;
+        char buf[4096];
+        while(true) {
+            boost::system::error_code ec;
+            size_t len = sock->read_some(boost::asio::buffer(buf, sizeof(buf)), ec);
+            if (ec || len == 0) return;
+            buffered.append(buf, len);
+
+            std::vector<String> requests;
+            size_t end;
+            while((end = buffered.find("\r\n\r\n")) != String::npos) {
+                requests.push_back(buffered.substr(0, end));
+                buffered.erase(0, end + 4);
+            }
+            if (requests.empty()) continue;
+
+            {
+                boost::unique_lock<boost::mutex> lock(mMutex);
+                mMaxBatch = std::max(mMaxBatch, (uint32)requests.size());
+            }
+            Timer::sleep(mLatency);
+
+            std::ostringstream responses;
+            for(uint32 i = 0; i < requests.size(); i++) {
+                std::istringstream request_line(requests[i]);
+                String method, path;
+                request_line >> method >> path;
+
+                if (path == "/gate") {
+                    boost::unique_lock<boost::mutex> lock(mMutex);
+                    while(!mGateOpen)
+                        mGateCond.wait(lock);
+                }
+
+                String file;
+                bool ranges_supported;
+                {
+                    boost::unique_lock<boost::mutex> lock(mMutex);
+                    FileMap::const_iterator it = mFiles.find(path);
+                    if (it != mFiles.end()) file = it->second;
+                    ranges_supported = mRangesSupported;
+                }
+                if (!file.empty()) {
+                    responses << fileResponse(requests[i], path, file, ranges_supported);
+                    continue;
+                }
+
+                bool gzip = (path.substr(0, 4) == "/gz/");
+                uint32 size = 0;
+                if (gzip)
+                    size = boost::lexical_cast<uint32>(path.substr(4));
+                else if (path.size() > 1 && path != "/gate")
+                    size = boost::lexical_cast<uint32>(path.substr(1));
+                String content = gzip ? gzipped(body(size)) : body(size);
+                responses << "HTTP/1.1 200 OK\r\n"
+                          << "Content-Length: " << content.size() << "\r\n"
+                          << "X-Path: " << path << "\r\n";
+                if (gzip)
+                    responses << "Content-Encoding: gzip\r\n";
+                responses << "\r\n";
+                if (method != "HEAD")
+                    responses << content;
+            }
+
+            String out = responses.str();
+            boost::asio::write(*sock, boost::asio::buffer(out), ec);
+            if (ec) return;
+        }
+    }
+
+    Duration mLatency;
+    boost::asio::io_service mIOService;
+    tcp::acceptor mAcceptor;
+    uint16 mPort;
+
+    boost::mutex mMutex;
+    boost::condition_variable mGateCond;
+    bool mGateOpen;
+    bool mStopped;
+    uint32 mMaxBatch;
+    FileMap mFiles;
+    bool mRangesSupported;
+    uint32 mNumRangeRequests;
+
+    Thread* mAcceptThread;
+    std::vector<SocketPtr> mSockets;
+    std::vector<Thread*> mConnThreads;
+};
+
+class HttpManagerTest : public CxxTest::TestSuite {
+public:
+    typedef Transfer::HttpManager HttpManager;
+
+    boost::mutex mMutex;
+    boost::condition_variable mDone;
+    uint32 mNumResponses;
+    uint32 mNumErrors;
+    std::vector<String> mOrder;
+    String mStreamed;
+    uint32 mNumPieces;
+    Transfer::DenseDataPtr mChunkData;
+
+    void setUp() {
+        mNumResponses = 0;
+        mNumErrors = 0;
+        mOrder.clear();
+        mStreamed.clear();
+        mNumPieces = 0;
+        mChunkData.reset();
+    }
+
+    void tearDown() {
+        // Restore the defaults for other tests sharing the singleton
+        HttpManager::getSingleton().setConnectionLimits(10, 2);
+        HttpManager::getSingleton().setPipelineDepth(4);
+    }
+
+    void chunkFinished(Transfer::DenseDataPtr data) {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        mChunkData = data;
+        mNumResponses++;
+        mDone.notify_all();
+    }
+
+    void response(std::tr1::shared_ptr<HttpManager::HttpResponse> resp,
+        HttpManager::ERR_TYPE error, const boost::system::error_code& boost_error,
+        uint32 expected_size, bool expect_body)
+    {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        if (error != HttpManager::SUCCESS || !resp || resp->getStatusCode() != 200) {
+            mNumErrors++;
+        }
+        else {
+            String data;
+            if (resp->getData())
+                data = resp->getData()->asString();
+            if (expect_body ? (data != StubHttpServer::body(expected_size)) : !data.empty())
+                mNumErrors++;
+            HttpManager::Headers::const_iterator path_it = resp->getHeaders().find("X-Path");
+            mOrder.push_back(path_it == resp->getHeaders().end() ? "" : path_it->second);
+        }
+        mNumResponses++;
+        mDone.notify_all();
+    }
+
+    void waitFor(uint32 count) {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        while(mNumResponses < count) {
+            if (!mDone.timed_wait(lock, boost::posix_time::seconds(30)))
+                break;
+        }
+    }
+
+    void get(const Network::Address& addr, const String& path, uint32 size,
+        Transfer::Priority priority = HttpManager::defaultPriority())
+    {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+        HttpManager::Headers headers;
+        headers["Host"] = addr.getHostName();
+        HttpManager::getSingleton().get(
+            addr, path,
+            std::tr1::bind(&HttpManagerTest::response, this, _1, _2, _3, size, true),
+            headers, HttpManager::QueryParameters(), true, priority
+        );
+    }
+
+    void piece(Transfer::DenseDataPtr data) {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+        // Pieces must arrive in order without gaps
+        if (data->startbyte() != mStreamed.size())
+            mNumErrors++;
+        else
+            mStreamed.append((const char*)data->data(), (size_t)data->length());
+        mNumPieces++;
+    }
+
+    // Fetches count small chunks and returns how long it took
+    Duration fetchChunks(uint32 pipeline_depth, uint32 count) {
+        StubHttpServer server(Duration::milliseconds((int64)2));
+        HttpManager::getSingleton().setConnectionLimits(10, 2);
+        HttpManager::getSingleton().setPipelineDepth(pipeline_depth);
+
+        setUp();
+        Time start = Timer::now();
+        for(uint32 i = 0; i < count; i++)
+            get(server.address(), "/" + boost::lexical_cast<String>(100 + i), 100 + i);
+        waitFor(count);
+        Duration elapsed = Timer::now() - start;
+
+        TS_ASSERT_EQUALS(mNumResponses, count);
+        TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+        if (pipeline_depth == 1)
+            TS_ASSERT_EQUALS(server.maxBatch(), (uint32)1);
+        SILOG(transfer, info, "Fetched " << count << " chunks with pipeline depth " << pipeline_depth
+            << " in " << elapsed << ", max batch " << server.maxBatch());
+        return elapsed;
+    }
+
+    void testPipelinedChunkFetches() {
+        // Correctness is checked for both; the timings show the gain from
+        // pipelining but aren't asserted since they depend on the machine
+        Duration unpipelined = fetchChunks(1, 200);
+        Duration pipelined = fetchChunks(8, 200);
+        SILOG(transfer, info, "Pipelining speedup: " << (unpipelined.toSeconds() / std::max(pipelined.toSeconds(), 0.000001)) << "x");
+    }
+
+    void testPriorityOrder() {
+        StubHttpServer server(Duration::milliseconds((int64)0));
+        HttpManager::getSingleton().setConnectionLimits(1, 1);
+        HttpManager::getSingleton().setPipelineDepth(1);
+
+        // Occupy the only connection so everything else has to queue
+        get(server.address(), "/gate", 0);
+        for(uint32 i = 0; i < 10; i++)
+            get(server.address(), "/" + boost::lexical_cast<String>(i + 1), i + 1, (Transfer::Priority)(i % 5));
+        server.openGate();
+        waitFor(11);
+
+        TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+        TS_ASSERT_EQUALS(mOrder.size(), (size_t)11);
+        if (mOrder.size() != 11) return;
+        // Highest priority first, ties in the order they were made
+        const char* expected[] = { "/gate", "/5", "/10", "/4", "/9", "/3", "/8", "/2", "/7", "/1", "/6" };
+        for(uint32 i = 0; i < 11; i++)
+            TS_ASSERT_EQUALS(mOrder[i], String(expected[i]));
+    }
+
+    void testHeadOnPipelinedConnection() {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+
+        StubHttpServer server(Duration::milliseconds((int64)0));
+        HttpManager::getSingleton().setConnectionLimits(1, 1);
+        HttpManager::getSingleton().setPipelineDepth(4);
+
+        // HEAD responses carry a Content-Length but no body, so the parser
+        // must not swallow the following response as the body
+        HttpManager::Headers headers;
+        headers["Host"] = "127.0.0.1";
+        get(server.address(), "/10", 10);
+        for(uint32 i = 0; i < 4; i++) {
+            HttpManager::getSingleton().head(
+                server.address(), "/50",
+                std::tr1::bind(&HttpManagerTest::response, this, _1, _2, _3, 50, false),
+                headers
+            );
+            get(server.address(), "/20", 20);
+        }
+        waitFor(9);
+
+        TS_ASSERT_EQUALS(mNumResponses, (uint32)9);
+        TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+    }
+
+    void testGzipDecoding() {
+        StubHttpServer server(Duration::milliseconds((int64)0));
+
+        get(server.address(), "/gz/0", 0);
+        get(server.address(), "/gz/100", 100);
+        get(server.address(), "/gz/300000", 300000);
+        waitFor(3);
+
+        TS_ASSERT_EQUALS(mNumResponses, (uint32)3);
+        TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+    }
+
+    void testStreamingBody() {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+
+        StubHttpServer server(Duration::milliseconds((int64)0));
+        HttpManager::Headers headers;
+        headers["Host"] = "127.0.0.1";
+
+        const char* paths[] = { "/300000", "/gz/300000" };
+        for(uint32 i = 0; i < 2; i++) {
+            setUp();
+            // Streamed responses come back without data
+            HttpManager::getSingleton().getStreaming(
+                server.address(), paths[i],
+                std::tr1::bind(&HttpManagerTest::piece, this, _1),
+                std::tr1::bind(&HttpManagerTest::response, this, _1, _2, _3, 0, false),
+                headers
+            );
+            waitFor(1);
+
+            TS_ASSERT_EQUALS(mNumResponses, (uint32)1);
+            TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+            TS_ASSERT(mStreamed == StubHttpServer::body(300000));
+            // The compressed body is tiny, but the raw one takes several reads
+            if (i == 0)
+                TS_ASSERT(mNumPieces > 1);
+        }
+    }
+
+    // Downloads content through the Meerkat chunk handler from server and
+    // checks the result and the pieces it was streamed in
+    void downloadChunk(StubHttpServer& server, const String& content) {
+        using std::tr1::placeholders::_1;
+
+        Transfer::Fingerprint hash = Transfer::Fingerprint::computeDigest(content);
+        server.addFile("/download/" + hash.convertToHexString(), content);
+
+        Transfer::Chunk chunk(hash, Transfer::Range(0, content.size(), Transfer::LENGTH, true));
+        Transfer::ChunkList chunks;
+        chunks.push_back(chunk);
+        Transfer::URI uri("meerkat://127.0.0.1:" + boost::lexical_cast<String>(server.port()) + "/test/large");
+        Transfer::RemoteFileMetadataPtr metadata(
+            new Transfer::RemoteFileMetadata(hash, uri, content.size(), chunks, Transfer::FileHeaders())
+        );
+
+        setUp();
+        Transfer::MeerkatChunkHandler::getSingleton().getStreaming(
+            metadata, std::tr1::shared_ptr<Transfer::Chunk>(new Transfer::Chunk(chunk)), 1.0,
+            std::tr1::bind(&HttpManagerTest::piece, this, _1),
+            std::tr1::bind(&HttpManagerTest::chunkFinished, this, _1)
+        );
+        waitFor(1);
+
+        TS_ASSERT_EQUALS(mNumResponses, (uint32)1);
+        TS_ASSERT(mChunkData);
+        if (mChunkData)
+            TS_ASSERT(mChunkData->asString() == content);
+        TS_ASSERT(mStreamed == content);
+    }
+
+    void testRangedChunkDownload() {
+        InitOptions(); // For CDN settings
+        FakeParseOptions();
+        Transfer::MeerkatChunkHandler::getSingleton().setRangedDownloads(1024 * 1024, 4);
+
+        // Ranges are fetched in parallel and stitched back together
+        StubHttpServer server(Duration::milliseconds((int64)0));
+        downloadChunk(server, StubHttpServer::body(3 * 1024 * 1024 + 123));
+        TS_ASSERT(server.numRangeRequests() > 1);
+        TS_ASSERT_EQUALS(mNumErrors, (uint32)0);
+
+        // Servers that ignore Range headers still work, the download falls
+        // back to requesting the whole file at once
+        StubHttpServer no_ranges(Duration::milliseconds((int64)0));
+        no_ranges.setRangesSupported(false);
+        downloadChunk(no_ranges, StubHttpServer::body(3 * 1024 * 1024 + 456));
+        TS_ASSERT_EQUALS(no_ranges.numRangeRequests(), (uint32)0);
+
+        Transfer::MeerkatChunkHandler::getSingleton().setRangedDownloads(
+            GetOptionValue<uint32>(OPT_CDN_RANGE_THRESHOLD), GetOptionValue<uint32>(OPT_CDN_RANGE_PARALLEL)
+        );
+    }
+};
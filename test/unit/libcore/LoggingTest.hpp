@@ -0,0 +1,83 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include <sirikata/core/util/Standard.hh>
+#include <sirikata/core/options/Options.hpp>
+#include <boost/thread.hpp>
+
+using namespace Sirikata;
+
+class LoggingTest : public CxxTest::TestSuite
+{
+    enum {
+        NumThreads = 4,
+        // More than fit in a thread's queue, so some threads have to write
+        // for themselves
+        LinesPerThread = 3000
+    };
+
+    static void logLines(int thread) {
+        for(int i = 0; i < LinesPerThread; i++)
+            SILOGBARE(logtest,warning,"logtest " << thread << " " << i);
+    }
+
+    void setModuleLevels(const char* levels) {
+        String arg = String("--moduleloglevel=") + levels;
+        const char* argv[3] = { "test", arg.c_str(), NULL };
+        OptionSet::getOptions("")->parse(2, argv, false);
+        Logging::refreshLogLevels();
+    }
+
+public:
+    void tearDown() {
+        setModuleLevels("");
+    }
+
+    void testAsyncLogKeepsAllLines( void ) {
+        std::ostringstream* out = new std::ostringstream();
+        Logging::setLogStream(out);
+        Logging::startAsyncLog();
+
+        std::vector<boost::thread*> threads;
+        for(int t = 0; t < NumThreads; t++)
+            threads.push_back(new boost::thread(std::tr1::bind(&LoggingTest::logLines, t)));
+        for(int t = 0; t < NumThreads; t++) {
+            threads[t]->join();
+            delete threads[t];
+        }
+
+        Logging::stopAsyncLog();
+        Logging::setLogStream(&std::cerr);
+
+        // Lines from different threads may be interleaved arbitrarily, but
+        // each thread's lines must all be there and in order.
+        int next[NumThreads] = { 0 };
+        std::istringstream in(out->str());
+        delete out;
+        String line;
+        while(std::getline(in, line)) {
+            std::istringstream fields(line);
+            String tag;
+            int thread = -1, idx = -1;
+            fields >> tag >> thread >> idx;
+            if (tag != "logtest" || thread < 0 || thread >= NumThreads) continue;
+            TS_ASSERT_EQUALS(idx, next[thread]);
+            next[thread] = idx + 1;
+        }
+        for(int t = 0; t < NumThreads; t++)
+            TS_ASSERT_EQUALS(next[t], (int)LinesPerThread);
+    }
+
+    void testModuleLevelsFollowOptions( void ) {
+        setModuleLevels("logtestquiet=error");
+        TS_ASSERT(SILOGP(logtestquiet,error));
+        TS_ASSERT(!SILOGP(logtestquiet,warning));
+
+        // Cached levels must pick up later changes to the options
+        setModuleLevels("logtestquiet=fatal");
+        TS_ASSERT(!SILOGP(logtestquiet,error));
+        TS_ASSERT(SILOGP(logtestquiet,fatal));
+    }
+};
@@ -69,6 +69,7 @@ public:
     void testRangeRead() {_base.testRangeRead(); }
     void testCount() {_base.testCount(); }
     void testRangeErase() {_base.testRangeErase(); }
+    void testRangeScan() {_base.testRangeScan(); }
 
     void testAllTransaction() {_base.testAllTransaction(); }
 
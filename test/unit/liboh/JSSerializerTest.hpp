@@ -0,0 +1,149 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include "../../../liboh/plugins/js/JSSerializer.hpp"
+
+using namespace Sirikata;
+using namespace Sirikata::JS;
+
+/** Round trips values through both of JSSerializer's message encodings. Only
+ *  plain values are covered since functions, visibles and presences need an
+ *  EmersonScript to be deserialized.
+ */
+class JSSerializerTest : public CxxTest::TestSuite
+{
+    v8::Persistent<v8::Context> mContext;
+
+    v8::Local<v8::Value> eval(const char* src) {
+        return v8::Script::Compile(v8::String::New(src))->Run();
+    }
+
+    String toJSON(v8::Handle<v8::Value> val) {
+        v8::Local<v8::Object> json = mContext->Global()->Get(v8::String::New("JSON"))->ToObject();
+        v8::Local<v8::Function> stringify = v8::Local<v8::Function>::Cast(json->Get(v8::String::New("stringify")));
+        v8::Handle<v8::Value> argv[1] = { val };
+        v8::String::Utf8Value str(stringify->Call(json, 1, argv));
+        return String(*str, str.length());
+    }
+
+    // Serializes the value src evaluates to with the requested encoding and
+    // deserializes it again
+    v8::Handle<v8::Value> roundTrip(const char* src, bool binary) {
+        v8::Local<v8::Value> val = eval(src);
+        String payload = binary ? JSSerializer::serializeBinaryMessage(val) : JSSerializer::serializeMessage(val);
+        TS_ASSERT_EQUALS(JSSerializer::isBinaryMessage(payload), binary);
+
+        bool success = false;
+        v8::Handle<v8::Value> result = JSSerializer::deserializeMessage(NULL, payload, success);
+        TS_ASSERT(success);
+        return result;
+    }
+
+    void checkRoundTrip(const char* src) {
+        String expected = toJSON(eval(src));
+        TS_ASSERT_EQUALS(toJSON(roundTrip(src, false)), expected);
+        TS_ASSERT_EQUALS(toJSON(roundTrip(src, true)), expected);
+    }
+
+    void checkCycles(bool binary) {
+        v8::Handle<v8::Value> result = roundTrip(
+            "(function() {"
+            "  var shared = { v: 1 };"
+            "  var o = { name: 'root', child: {}, a: shared, b: shared };"
+            "  o.child.parent = o;"
+            "  o.self = o;"
+            "  return o;"
+            "})()",
+            binary
+        );
+        TS_ASSERT(result->IsObject());
+        if (!result->IsObject()) return;
+
+        v8::Local<v8::Object> obj = result->ToObject();
+        TS_ASSERT(obj->Get(v8::String::New("self"))->StrictEquals(obj));
+        v8::Local<v8::Object> child = obj->Get(v8::String::New("child"))->ToObject();
+        TS_ASSERT(child->Get(v8::String::New("parent"))->StrictEquals(obj));
+        TS_ASSERT(obj->Get(v8::String::New("a"))->StrictEquals(obj->Get(v8::String::New("b"))));
+    }
+
+public:
+    void setUp() {
+        mContext = v8::Context::New();
+    }
+
+    void tearDown() {
+        mContext.Dispose();
+    }
+
+    void testPrimitives() {
+        v8::HandleScope handle_scope;
+        v8::Context::Scope context_scope(mContext);
+
+        checkRoundTrip("(0)");
+        checkRoundTrip("(-17)");
+        checkRoundTrip("(4000000000)");
+        checkRoundTrip("(-2.5e-10)");
+        checkRoundTrip("(true)");
+        checkRoundTrip("(false)");
+        checkRoundTrip("(null)");
+        checkRoundTrip("('')");
+        checkRoundTrip("('caf\\u00e9 \\u2603')");
+    }
+
+    void testObjectsAndArrays() {
+        v8::HandleScope handle_scope;
+        v8::Context::Scope context_scope(mContext);
+
+        checkRoundTrip("({})");
+        checkRoundTrip("({ x: 1, y: 'two', z: { deep: [1, 2, { three: 3 }] } })");
+        checkRoundTrip("([])");
+        checkRoundTrip("([1, 'a', null, [true, false], { k: -1 }])");
+        // Repeated field names are interned by the binary encoding
+        checkRoundTrip("([{ pos: 1, vel: 2 }, { pos: 3, vel: 4 }, { pos: 5, vel: 6 }])");
+    }
+
+    void testArrayHolesAndProperties() {
+        v8::HandleScope handle_scope;
+        v8::Context::Scope context_scope(mContext);
+
+        v8::Handle<v8::Value> results[2] = {
+            roundTrip("(function() { var a = [1]; a[3] = 4; a.extra = 'x'; return a; })()", false),
+            roundTrip("(function() { var a = [1]; a[3] = 4; a.extra = 'x'; return a; })()", true)
+        };
+        for(int i = 0; i < 2; i++) {
+            TS_ASSERT(results[i]->IsArray());
+            if (!results[i]->IsArray()) continue;
+            v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(results[i]);
+            TS_ASSERT_EQUALS(arr->Length(), (uint32)4);
+            TS_ASSERT_EQUALS(arr->Get(3)->Int32Value(), 4);
+            TS_ASSERT_EQUALS(toJSON(arr->Get(v8::String::New("extra"))), "\"x\"");
+        }
+    }
+
+    void testCyclesAndSharedObjects() {
+        v8::HandleScope handle_scope;
+        v8::Context::Scope context_scope(mContext);
+
+        checkCycles(false);
+        checkCycles(true);
+    }
+
+    void testMalformedBinaryIsRejected() {
+        v8::HandleScope handle_scope;
+        v8::Context::Scope context_scope(mContext);
+
+        String payload = JSSerializer::serializeBinaryMessage(eval("({ a: [1, 2, 3], b: 'text' })"));
+        // Every truncation is missing data the decoder needs
+        for(uint32 len = 2; len < payload.size(); len++) {
+            bool success = true;
+            JSSerializer::deserializeMessage(NULL, payload.substr(0, len), success);
+            TS_ASSERT(!success);
+        }
+
+        bool success = true;
+        JSSerializer::deserializeMessage(NULL, payload + "x", success);
+        TS_ASSERT(!success);
+    }
+};
@@ -0,0 +1,32 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include "StressTestBase.hpp"
+
+
+class LSMStressTest : public CxxTest::TestSuite
+{
+    static const String args;
+    StressTestBase _base;
+public:
+    LSMStressTest()
+     : _base("oh-lsm", "lsm", args)
+    {
+    }
+
+    void setUp() {_base.setUp(); }
+    void tearDown() {_base.tearDown(); }
+
+    void testSetupTeardown() {_base.testSetupTeardown(); }
+
+    //(dataLength, keyNum, bucketNum, rounds)
+    void testMultiRounds() {
+        _base.testMultiRounds("10", 10, 10, 5, StressTestBase::Latency);
+        _base.testMultiRounds("10", 10, 10, 5, StressTestBase::Throughput);
+    }
+
+};
+
+const String LSMStressTest::args("--dir=test.lsm --memtable-size=4096 --max-segments=2");
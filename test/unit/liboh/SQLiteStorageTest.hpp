@@ -68,6 +68,7 @@ public:
     void testRangeRead() {_base.testRangeRead(); }
     void testCount() {_base.testCount(); }
     void testRangeErase() {_base.testRangeErase(); }
+    void testRangeScan() {_base.testRangeScan(); }
 
     void testAllTransaction() {_base.testAllTransaction(); }
 
@@ -41,6 +41,7 @@ class StorageTestBase
 protected:
     typedef OH::Storage::Result Result;
     typedef OH::Storage::ReadSet ReadSet;
+    typedef OH::Storage::ScanToken ScanToken;
 
     static const OH::Storage::Bucket _buckets[2];
 
@@ -68,6 +69,9 @@ protected:
     boost::mutex _mutex;
     boost::condition_variable _cond;
 
+    // Continuation token from the last page of a range scan
+    ScanToken _scanToken;
+
 public:
     StorageTestBase(String plugin, String type, String args)
      : _initialized(0),
@@ -187,6 +191,15 @@ public:
         _cond.notify_one();
     }
 
+    void checkScanPage(Result expected_result, ReadSet expected, bool expected_more, Result result, ReadSet* rs, const ScanToken& next) {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        checkReadValuesImpl(expected_result, expected, result, rs);
+        TS_ASSERT_EQUALS(expected_more, !next.empty());
+        _scanToken = next;
+        delete rs;
+        _cond.notify_one();
+    }
+
     void waitForTransaction() {
         boost::unique_lock<boost::mutex> lock(_mutex);
         _cond.wait(lock);
@@ -487,6 +500,65 @@ public:
     	waitForTransaction();
     }
 
+    void testRangeScan() {
+        using std::tr1::placeholders::_1;
+        using std::tr1::placeholders::_2;
+        using std::tr1::placeholders::_3;
+
+        _storage->beginTransaction(_buckets[0]);
+        _storage->write(_buckets[0], "map:scan:a", "abcde");
+        _storage->write(_buckets[0], "map:scan:f", "fghij");
+        _storage->write(_buckets[0], "map:scan:k", "klmno");
+        _storage->write(_buckets[0], "map:scan:p", "pqrst");
+        _storage->write(_buckets[0], "map:scan:u", "uvwxy");
+        // Outside the range
+        _storage->write(_buckets[0], "map:scanned", "z");
+        _storage->commitTransaction(_buckets[0],
+            std::tr1::bind(&StorageTestBase::checkReadValues, this, OH::Storage::SUCCESS, ReadSet(), _1, _2)
+        );
+        waitForTransaction();
+
+        ReadSet page1;
+        page1["map:scan:a"] = "abcde";
+        page1["map:scan:f"] = "fghij";
+        _storage->rangeScan(_buckets[0], "map:scan", "map:scan@", ScanToken(), 2,
+            std::tr1::bind(&StorageTestBase::checkScanPage, this, OH::Storage::SUCCESS, page1, true, _1, _2, _3)
+        );
+        waitForTransaction();
+
+        ReadSet page2;
+        page2["map:scan:k"] = "klmno";
+        page2["map:scan:p"] = "pqrst";
+        _storage->rangeScan(_buckets[0], "map:scan", "map:scan@", _scanToken, 2,
+            std::tr1::bind(&StorageTestBase::checkScanPage, this, OH::Storage::SUCCESS, page2, true, _1, _2, _3)
+        );
+        waitForTransaction();
+
+        ReadSet page3;
+        page3["map:scan:u"] = "uvwxy";
+        _storage->rangeScan(_buckets[0], "map:scan", "map:scan@", _scanToken, 2,
+            std::tr1::bind(&StorageTestBase::checkScanPage, this, OH::Storage::SUCCESS, page3, false, _1, _2, _3)
+        );
+        waitForTransaction();
+
+        // A page exactly covering the rest of the range is the last one
+        ReadSet all = page1;
+        all.insert(page2.begin(), page2.end());
+        all.insert(page3.begin(), page3.end());
+        _storage->rangeScan(_buckets[0], "map:scan", "map:scan@", ScanToken(), 5,
+            std::tr1::bind(&StorageTestBase::checkScanPage, this, OH::Storage::SUCCESS, all, false, _1, _2, _3)
+        );
+        waitForTransaction();
+
+        // Invalid tokens are rejected up front
+        TS_ASSERT(!_storage->rangeScan(_buckets[0], "map:scan", "map:scan@", "not a token", 2, OH::Storage::ScanCallback()));
+
+        _storage->rangeErase(_buckets[0], "map:scan", "map:scan~",
+            std::tr1::bind(&StorageTestBase::checkReadValues, this, OH::Storage::SUCCESS, ReadSet(), _1, _2)
+        );
+        waitForTransaction();
+    }
+
     void testRangeErase() {
     	// NOTE: Depends on above write
         using std::tr1::placeholders::_1;
@@ -0,0 +1,181 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include <sirikata/proxyobject/ProxyObjectStore.hpp>
+#include <boost/thread.hpp>
+
+using namespace Sirikata;
+
+class ProxyObjectStoreTest : public CxxTest::TestSuite
+{
+    typedef SequencedPresenceProperties Props;
+
+    // SharedProxyState only compares writers, so any distinct addresses will
+    // do as stand-ins for the ProxyObjects of different presences
+    char mWriters[2];
+    ProxyObject* writer(uint32 idx) {
+        return reinterpret_cast<ProxyObject*>(&mWriters[idx]);
+    }
+
+    static SpaceObjectReference objectID(uint32 idx) {
+        UUID::byte data[UUID::static_size] = {0};
+        for(uint32 i = 0; i < 4; i++)
+            data[i] = (UUID::byte)(idx >> (8*i));
+        data[15] = 1;
+        return SpaceObjectReference(SpaceID(UUID::null()), ObjectReference(UUID(data, UUID::static_size)));
+    }
+
+    static TimedMotionVector3f makeLoc(int64 t, float x) {
+        return TimedMotionVector3f(Time::microseconds(t), MotionVector3f(Vector3f(x, 0, 0), Vector3f::zero()));
+    }
+
+    // Repeatedly acquires and drops state for a few objects, one of which the
+    // test holds onto. Counts how often the held state wasn't returned.
+    static void churn(ProxyObjectStore* store, SharedProxyState* held, uint32 offset, uint32* mismatches) {
+        for(uint32 i = 0; i < 5000; i++) {
+            uint32 idx = (offset + i) % 8;
+            SharedProxyStatePtr state = store->acquire(objectID(idx));
+            if (idx == 0 && state.get() != held)
+                (*mismatches)++;
+        }
+    }
+
+public:
+    void testAcquireSharesState(void) {
+        ProxyObjectStorePtr store = ProxyObjectStore::construct();
+
+        SharedProxyStatePtr a = store->acquire(objectID(1));
+        SharedProxyStatePtr b = store->acquire(objectID(1));
+        SharedProxyStatePtr c = store->acquire(objectID(2));
+        TS_ASSERT_EQUALS(a.get(), b.get());
+        TS_ASSERT_DIFFERS(a.get(), c.get());
+        TS_ASSERT_EQUALS(a->id(), objectID(1));
+        TS_ASSERT_EQUALS(store->size(), (uint32)2);
+
+        // Entries go away with the last reference to their state
+        a.reset();
+        TS_ASSERT_EQUALS(store->size(), (uint32)2);
+        b.reset();
+        TS_ASSERT_EQUALS(store->size(), (uint32)1);
+        c.reset();
+        TS_ASSERT_EQUALS(store->size(), (uint32)0);
+
+        SharedProxyStatePtr d = store->acquire(objectID(1));
+        TS_ASSERT_EQUALS(store->size(), (uint32)1);
+        TS_ASSERT_EQUALS(d->version(Props::LOC_POS_PART), (uint64)0);
+    }
+
+    void testPrivateStateIsNotStored(void) {
+        ProxyObjectStorePtr store = ProxyObjectStore::construct();
+        SharedProxyStatePtr priv(new SharedProxyState(ProxyObjectStorePtr(), objectID(1)));
+        SharedProxyStatePtr shared = store->acquire(objectID(1));
+        TS_ASSERT_DIFFERS(priv.get(), shared.get());
+        priv.reset();
+        TS_ASSERT_EQUALS(store->size(), (uint32)1);
+    }
+
+    void testWriterOrdersItsOwnUpdates(void) {
+        SharedProxyState state(ProxyObjectStorePtr(), objectID(1));
+
+        TS_ASSERT(state.updateLocation(writer(0), true, makeLoc(100, 1)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(1, 0, 0));
+        TS_ASSERT_EQUALS(state.version(Props::LOC_POS_PART), (uint64)1);
+
+        // The current writer's sequence numbers already ordered the update,
+        // so it is applied even if it doesn't look new
+        TS_ASSERT(state.updateLocation(writer(0), false, makeLoc(50, 2)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(2, 0, 0));
+        TS_ASSERT_EQUALS(state.version(Props::LOC_POS_PART), (uint64)2);
+
+        // Other parts are versioned separately
+        TS_ASSERT_EQUALS(state.version(Props::LOC_BOUNDS_PART), (uint64)0);
+    }
+
+    void testDuplicatesFromOtherPresencesAreDropped(void) {
+        SharedProxyState state(ProxyObjectStorePtr(), objectID(1));
+        BoundingSphere3f bnds(Vector3f::zero(), 2.f);
+        Transfer::URI mesh("meerkat:///test/mesh.dae");
+
+        TS_ASSERT(state.updateLocation(writer(0), true, makeLoc(100, 1)));
+        TS_ASSERT(state.updateBounds(writer(0), true, bnds));
+        TS_ASSERT(state.updateMesh(writer(0), true, mesh));
+
+        // The same updates arriving through another presence carry nothing new
+        TS_ASSERT(!state.updateLocation(writer(1), true, makeLoc(100, 1)));
+        TS_ASSERT(!state.updateBounds(writer(1), true, bnds));
+        TS_ASSERT(!state.updateMesh(writer(1), true, mesh));
+        TS_ASSERT_EQUALS(state.version(Props::LOC_POS_PART), (uint64)1);
+        TS_ASSERT_EQUALS(state.version(Props::LOC_BOUNDS_PART), (uint64)1);
+        TS_ASSERT_EQUALS(state.version(Props::LOC_MESH_PART), (uint64)1);
+
+        // A replay through another presence can't take over either, even with
+        // a different value
+        TS_ASSERT(!state.updateLocation(writer(1), false, makeLoc(200, 3)));
+        TS_ASSERT(!state.updateBounds(writer(1), false, BoundingSphere3f(Vector3f::zero(), 3.f)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(1, 0, 0));
+        TS_ASSERT_EQUALS(state.bounds().radius(), 2.f);
+    }
+
+    void testFreshUpdateSwitchesWriter(void) {
+        SharedProxyState state(ProxyObjectStorePtr(), objectID(1));
+
+        TS_ASSERT(state.updateLocation(writer(0), true, makeLoc(100, 1)));
+        TS_ASSERT(state.updateLocation(writer(1), true, makeLoc(200, 2)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(2, 0, 0));
+        TS_ASSERT_EQUALS(state.version(Props::LOC_POS_PART), (uint64)2);
+
+        // The old writer now needs new information too, so its late copy of
+        // an older update is dropped
+        TS_ASSERT(!state.updateLocation(writer(0), true, makeLoc(150, 5)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(2, 0, 0));
+
+        TS_ASSERT(state.updatePhysics(writer(0), true, "{\"treatment\":\"static\"}"));
+        TS_ASSERT(!state.updatePhysics(writer(1), false, ""));
+        TS_ASSERT(state.updatePhysics(writer(1), true, ""));
+        TS_ASSERT_EQUALS(state.physics(), "");
+        TS_ASSERT(state.updateIsAggregate(writer(1), true, true));
+        TS_ASSERT(state.isAggregate());
+    }
+
+    void testDetachForgetsWriter(void) {
+        SharedProxyState state(ProxyObjectStorePtr(), objectID(1));
+        state.attach(writer(0));
+        state.attach(writer(1));
+        TS_ASSERT_EQUALS(state.numAttached(), (uint32)2);
+
+        TS_ASSERT(state.updateLocation(writer(0), true, makeLoc(100, 1)));
+        state.detach(writer(0));
+        TS_ASSERT_EQUALS(state.numAttached(), (uint32)1);
+
+        // A new ProxyObject at the same address isn't the old writer, so it
+        // doesn't get to apply an update which carries nothing new
+        state.attach(writer(0));
+        TS_ASSERT(!state.updateLocation(writer(0), false, makeLoc(50, 2)));
+        TS_ASSERT_EQUALS(state.location().position(), Vector3f(1, 0, 0));
+
+        state.detach(writer(0));
+        state.detach(writer(1));
+        TS_ASSERT_EQUALS(state.numAttached(), (uint32)0);
+    }
+
+    void testConcurrentAcquireAndRelease(void) {
+        const uint32 nthreads = 4;
+        ProxyObjectStorePtr store = ProxyObjectStore::construct();
+        SharedProxyStatePtr held = store->acquire(objectID(0));
+
+        uint32 mismatches[nthreads] = {0};
+        boost::thread_group threads;
+        for(uint32 i = 0; i < nthreads; i++)
+            threads.create_thread(std::tr1::bind(&ProxyObjectStoreTest::churn, store.get(), held.get(), i, &mismatches[i]));
+        threads.join_all();
+
+        for(uint32 i = 0; i < nthreads; i++)
+            TS_ASSERT_EQUALS(mismatches[i], (uint32)0);
+        // Only the state we're still holding is left
+        TS_ASSERT_EQUALS(store->size(), (uint32)1);
+        held.reset();
+        TS_ASSERT_EQUALS(store->size(), (uint32)0);
+    }
+};
@@ -0,0 +1,128 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include <sirikata/space/ShardedOSegCache.hpp>
+#include <boost/thread.hpp>
+
+using namespace Sirikata;
+
+/** Replays lookup traces against ShardedOSegCache the same way the
+ *  oseg-cache-replay benchmark does: a lookup that misses is followed by an
+ *  insert of the object's server.
+ */
+class ShardedOSegCacheTest : public CxxTest::TestSuite
+{
+    struct Lookup {
+        UUID id;
+        uint32 server;
+    };
+    typedef std::vector<Lookup> LookupTrace;
+
+    // Deterministic ids so failures are reproducible
+    static UUID objectID(uint32 idx) {
+        UUID::byte data[UUID::static_size] = {0};
+        for(uint32 i = 0; i < 4; i++)
+            data[i] = (UUID::byte)(idx >> (8*i));
+        data[15] = 1;
+        return UUID(data, UUID::static_size);
+    }
+
+    static void addLookup(LookupTrace* trace, uint32 idx) {
+        Lookup lookup;
+        lookup.id = objectID(idx);
+        lookup.server = (idx % 16) + 1;
+        trace->push_back(lookup);
+    }
+
+    static void replay(ShardedOSegCache* cache, const LookupTrace* trace, uint32 offset, uint32 stride) {
+        for(uint32 i = offset; i < trace->size(); i += stride) {
+            const Lookup& lookup = (*trace)[i];
+            if (cache->get(lookup.id).isNull())
+                cache->insert(lookup.id, OSegEntry(lookup.server, 1.f));
+        }
+    }
+
+public:
+    void testRepeatedLookupsHit(void) {
+        ShardedOSegCache cache(NULL, 100, 4, Duration::zero());
+
+        LookupTrace trace;
+        for(uint32 round = 0; round < 5; round++)
+            for(uint32 i = 0; i < 10; i++)
+                addLookup(&trace, i);
+        replay(&cache, &trace, 0, 1);
+
+        ShardedOSegCache::Stats stats = cache.stats();
+        TS_ASSERT_EQUALS(stats.misses, (uint64)10);
+        TS_ASSERT_EQUALS(stats.hits, (uint64)40);
+        TS_ASSERT_EQUALS(stats.inserts, (uint64)10);
+        TS_ASSERT_EQUALS(stats.evictions, (uint64)0);
+        TS_ASSERT_EQUALS(cache.size(), (uint32)10);
+
+        for(uint32 i = 0; i < 10; i++)
+            TS_ASSERT_EQUALS(cache.get(objectID(i)).server(), (i % 16) + 1);
+    }
+
+    void testUpdateReplacesEntry(void) {
+        ShardedOSegCache cache(NULL, 100, 4, Duration::zero());
+
+        cache.insert(objectID(1), OSegEntry(3, 1.f));
+        cache.insert(objectID(1), OSegEntry(7, 1.f));
+        TS_ASSERT_EQUALS(cache.get(objectID(1)).server(), (uint32)7);
+        TS_ASSERT_EQUALS(cache.stats().updates, (uint64)1);
+        TS_ASSERT_EQUALS(cache.size(), (uint32)1);
+
+        cache.remove(objectID(1));
+        TS_ASSERT(cache.get(objectID(1)).isNull());
+        TS_ASSERT_EQUALS(cache.size(), (uint32)0);
+    }
+
+    void testScanDoesNotFlushHotEntries(void) {
+        const uint32 capacity = 64;
+        const uint32 hot = 16;
+        ShardedOSegCache cache(NULL, capacity, 1, Duration::zero());
+
+        // Warm up a hot set, then interleave a long scan of objects which
+        // are only looked up once with continued lookups of the hot set.
+        LookupTrace trace;
+        for(uint32 round = 0; round < 10; round++)
+            for(uint32 i = 0; i < hot; i++)
+                addLookup(&trace, i);
+        for(uint32 i = 0; i < 2000; i++) {
+            addLookup(&trace, 1000 + i);
+            if (i % 4 == 0)
+                addLookup(&trace, (i / 4) % hot);
+        }
+        replay(&cache, &trace, 0, 1);
+
+        TS_ASSERT(cache.size() <= capacity);
+        uint32 hot_hits = 0;
+        for(uint32 i = 0; i < hot; i++)
+            if (cache.get(objectID(i)).notNull()) hot_hits++;
+        TS_ASSERT_EQUALS(hot_hits, hot);
+    }
+
+    void testConcurrentReplay(void) {
+        const uint32 capacity = 256;
+        const uint32 nthreads = 4;
+        ShardedOSegCache cache(NULL, capacity, 8, Duration::zero());
+
+        LookupTrace trace;
+        for(uint32 i = 0; i < 20000; i++)
+            addLookup(&trace, (i * 7919) % 1000);
+
+        boost::thread_group threads;
+        for(uint32 i = 0; i < nthreads; i++)
+            threads.create_thread(std::tr1::bind(&ShardedOSegCacheTest::replay, &cache, &trace, i, nthreads));
+        threads.join_all();
+
+        // Every lookup is accounted for exactly once and the cache never
+        // grows past its capacity.
+        ShardedOSegCache::Stats stats = cache.stats();
+        TS_ASSERT_EQUALS(stats.hits + stats.misses, (uint64)trace.size());
+        TS_ASSERT(cache.size() <= capacity);
+        TS_ASSERT_EQUALS((uint64)cache.size(), stats.inserts - stats.evictions);
+    }
+};
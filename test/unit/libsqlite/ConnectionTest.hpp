@@ -0,0 +1,113 @@
+// Copyright (c) 2012 Sirikata Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include <cxxtest/TestSuite.h>
+#include <sirikata/sqlite/SQLite.hpp>
+
+class SQLiteConnectionTest : public CxxTest::TestSuite
+{
+    static const String dbfile;
+
+    // Run a statement which returns a single string value, e.g. a pragma
+    String queryString(SQLiteDBPtr db, const String& sql) {
+        sqlite3_stmt* stmt = NULL;
+        String result;
+        if (db->prepare(sql, &stmt) != SQLITE_OK)
+            return result;
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            result = String((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+        sqlite3_reset(stmt);
+        return result;
+    }
+
+    int execute(SQLiteDBPtr db, const String& sql) {
+        sqlite3_stmt* stmt = NULL;
+        int rc = db->prepare(sql, &stmt);
+        if (rc != SQLITE_OK)
+            return rc;
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        return rc;
+    }
+public:
+
+    void setUp(void) {
+        SQLiteDBPtr db = SQLite::getSingleton().open(dbfile);
+        sqlite3_busy_timeout(db->db(), 1000);
+        TS_ASSERT_EQUALS(execute(db, "CREATE TABLE IF NOT EXISTS \"values\"(key TEXT PRIMARY KEY, value TEXT)"), SQLITE_DONE);
+        TS_ASSERT_EQUALS(execute(db, "DELETE FROM \"values\""), SQLITE_DONE);
+    }
+
+    void testWALMode(void) {
+        SQLiteDBPtr db = SQLite::getSingleton().open(dbfile);
+        TS_ASSERT_EQUALS(queryString(db, "PRAGMA journal_mode"), "wal");
+    }
+
+    void testStatementCache(void) {
+        SQLiteDBPtr db = SQLite::getSingleton().open(dbfile);
+
+        sqlite3_stmt* stmt = NULL;
+        TS_ASSERT_EQUALS(db->prepare("SELECT value FROM \"values\" WHERE key == ?", &stmt), SQLITE_OK);
+        TS_ASSERT_DIFFERS(stmt, (sqlite3_stmt*)NULL);
+        TS_ASSERT_EQUALS(sqlite3_bind_text(stmt, 1, "a", 1, SQLITE_TRANSIENT), SQLITE_OK);
+
+        // Asking again gives back the same statement, without the old binding
+        sqlite3_stmt* stmt2 = NULL;
+        TS_ASSERT_EQUALS(db->prepare("SELECT value FROM \"values\" WHERE key == ?", &stmt2), SQLITE_OK);
+        TS_ASSERT_EQUALS(stmt, stmt2);
+        TS_ASSERT_EQUALS(sqlite3_bind_parameter_count(stmt2), 1);
+        TS_ASSERT_EQUALS(sqlite3_step(stmt2), SQLITE_DONE);
+        sqlite3_reset(stmt2);
+
+        // Errors are reported and nothing is cached
+        sqlite3_stmt* bad_stmt = NULL;
+        TS_ASSERT_DIFFERS(db->prepare("SELECT FROM WHERE", &bad_stmt), SQLITE_OK);
+        TS_ASSERT_EQUALS(bad_stmt, (sqlite3_stmt*)NULL);
+    }
+
+    void testReaderSeesWrites(void) {
+        SQLiteDBPtr db = SQLite::getSingleton().open(dbfile);
+        SQLiteDBPtr reader = SQLite::getSingleton().openReader(dbfile);
+        TS_ASSERT(reader);
+        TS_ASSERT(reader->readOnly());
+        TS_ASSERT_DIFFERS(reader->db(), db->db());
+
+        TS_ASSERT_EQUALS(execute(db, "INSERT INTO \"values\" VALUES('a', 'b')"), SQLITE_DONE);
+        TS_ASSERT_EQUALS(queryString(reader, "SELECT value FROM \"values\" WHERE key == 'a'"), "b");
+
+        // But can't write itself
+        TS_ASSERT_DIFFERS(execute(reader, "INSERT INTO \"values\" VALUES('c', 'd')"), SQLITE_DONE);
+    }
+
+    void testReaderWhileWriting(void) {
+        SQLiteDBPtr db = SQLite::getSingleton().open(dbfile);
+        SQLiteDBPtr reader = SQLite::getSingleton().openReader(dbfile);
+
+        TS_ASSERT_EQUALS(execute(db, "INSERT INTO \"values\" VALUES('a', 'b')"), SQLITE_DONE);
+        // An open write transaction doesn't block the reader, which still sees
+        // the last committed value
+        TS_ASSERT_EQUALS(execute(db, "BEGIN IMMEDIATE TRANSACTION"), SQLITE_DONE);
+        TS_ASSERT_EQUALS(execute(db, "UPDATE \"values\" SET value = 'c' WHERE key == 'a'"), SQLITE_DONE);
+        TS_ASSERT_EQUALS(queryString(reader, "SELECT value FROM \"values\" WHERE key == 'a'"), "b");
+        TS_ASSERT_EQUALS(execute(db, "COMMIT TRANSACTION"), SQLITE_DONE);
+        TS_ASSERT_EQUALS(queryString(reader, "SELECT value FROM \"values\" WHERE key == 'a'"), "c");
+    }
+
+    void testReaderPool(void) {
+        sqlite3* first = NULL;
+        {
+            SQLiteDBPtr reader = SQLite::getSingleton().openReader(dbfile);
+            SQLiteDBPtr reader2 = SQLite::getSingleton().openReader(dbfile);
+            TS_ASSERT_DIFFERS(reader->db(), reader2->db());
+            first = reader->db();
+        }
+
+        // Released connections are reused
+        SQLiteDBPtr reader = SQLite::getSingleton().openReader(dbfile);
+        SQLiteDBPtr reader2 = SQLite::getSingleton().openReader(dbfile);
+        TS_ASSERT(reader->db() == first || reader2->db() == first);
+    }
+};
+
+const String SQLiteConnectionTest::dbfile("connection_test.db");